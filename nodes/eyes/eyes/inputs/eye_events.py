@@ -0,0 +1,115 @@
+"""Input handler for the eyes' playback events (firmware /events, Server-Sent Events)."""
+import json
+import queue
+import threading
+import time
+
+import pyarrow as pa
+import requests
+
+# Same fixed addresses as the play_gif handler
+EYE_DISPLAYS = [
+    "10.42.0.156",
+    "10.42.0.218"
+]
+STATS_INTERVAL_MS = 5000  # stats snapshots in the stream, like the poll_stats timer
+READ_TIMEOUT = 30.0       # the eye sends a keepalive every 15 s
+RECONNECT_DELAY = 5.0
+
+
+def parse_events(lines):
+    """
+    Parse the lines of a text/event-stream.
+
+    Args:
+        lines (iterable): Decoded lines without their line ends.
+
+    Yields:
+        tuple: (event name, data) of each complete event; comments are skipped.
+    """
+    name, data = "message", []
+    for line in lines:
+        if not line:
+            if data:
+                yield name, "\n".join(data)
+            name, data = "message", []
+        elif line.startswith(":"):
+            continue
+        else:
+            field, _, value = line.partition(":")
+            if value.startswith(" "):
+                value = value[1:]
+            if field == "event":
+                name = value
+            elif field == "data":
+                data.append(value)
+
+
+class EyeEventStream:
+    """Keeps a connection to one eye's /events open in a thread and queues what it sends."""
+
+    def __init__(self, ip, events, stats_ms=STATS_INTERVAL_MS):
+        """
+        Start reading the events of one eye.
+
+        Args:
+            ip (str): IP address of the eye display.
+            events (queue.Queue): Where each event goes, as a dict with "ip" and "event" added.
+            stats_ms (int): Interval of the stats snapshots, 0 for none.
+        """
+        self.url = f"http://{ip}/events"
+        self.params = {"stats": stats_ms} if stats_ms else {}
+        self.ip = ip
+        self.events = events
+        self.thread = threading.Thread(target=self._run, name=f"eye-events-{ip}", daemon=True)
+        self.thread.start()
+
+    def _run(self):
+        while True:
+            try:
+                with requests.get(self.url, params=self.params, stream=True, timeout=(3.0, READ_TIMEOUT)) as response:
+                    if response.status_code == 200:
+                        for name, data in parse_events(response.iter_lines(decode_unicode=True)):
+                            try:
+                                event = json.loads(data)
+                            except ValueError:
+                                continue
+                            event["ip"] = self.ip
+                            event["event"] = name
+                            self.events.put(event)
+            except requests.exceptions.RequestException:
+                pass
+            time.sleep(RECONNECT_DELAY)  # the eye is off or rebooting, or its firmware has no /events
+
+
+def process_eye_events(context, event):
+    """
+    Forward the events the eyes pushed since the last call as the 'eye_events' output.
+
+    The streams are opened on the first call. Each entry is the JSON text of one
+    event: started, frame, finished, cancelled, catalog or stats, with the eye's "ip".
+
+    Args:
+        context (dict): The context dictionary containing dependencies.
+        event (dict): The event data (unused).
+
+    Returns:
+        None
+    """
+    if "eye_events" not in context:
+        context["eye_events"] = queue.Queue()
+        context["eye_event_streams"] = [EyeEventStream(ip, context["eye_events"]) for ip in EYE_DISPLAYS]
+
+    events = []
+    while True:
+        try:
+            events.append(json.dumps(context["eye_events"].get_nowait()))
+        except queue.Empty:
+            break
+    if events:
+        context["node"].send_output(
+            output_id="eye_events",
+            data=pa.array(events),
+            metadata={"count": len(events)}
+        )
+    return None
@@ -1,10 +1,16 @@
 """Input handler for playing GIFs on eye displays."""
+import os
+import socket
 import requests
 import pyarrow as pa
 import logging
 import concurrent.futures
 from functools import partial
 
+# Multicast group and port of the eyes' sync protocol (see firmware Readme)
+SYNC_GROUP = "239.10.42.1"
+SYNC_PORT = 4210
+
 
 def process_play_gif(context, event):
     """
@@ -48,6 +54,12 @@ def process_play_gif(context, event):
             "10.42.0.218"
         ]
         
+        # With EYES_SYNC=1 the sync leader eye starts both displays on a shared clock
+        if os.environ.get("EYES_SYNC") == "1":
+            if send_sync_play(filename):
+                print(f"Sent synced play request for {filename}")
+            return None
+
         # Send requests to both eye displays in parallel
         print(f"Sending parallel requests to {len(eye_displays)} eye displays")
         results = send_parallel_requests(eye_displays, filename)
@@ -106,8 +118,8 @@ def send_play_request(ip, filename):
         url = f"http://{ip}/playgif?name={filename}"
         print(f"Sending request to {url}")
         
-        # Use a long timeout for ESP32 devices (20 seconds)
-        response = requests.get(url, timeout=20.0)
+        # The eye queues the animation and answers right away
+        response = requests.get(url, timeout=5.0)
         
         if response.status_code == 200:
             print(f"Successfully sent play request to {ip}")
@@ -121,4 +133,26 @@ def send_play_request(ip, filename):
         return False
     except Exception as e:
         print(f"Error sending play request to {ip}: {e}")
-        return False
\ No newline at end of file
+        return False
+
+
+def send_sync_play(filename):
+    """
+    Send a play trigger to the eyes' sync multicast group.
+
+    The eye configured as sync leader schedules the GIF on both displays.
+
+    Args:
+        filename (str): Name of the GIF file to play.
+
+    Returns:
+        bool: True if the datagram was sent, False otherwise.
+    """
+    try:
+        with socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP) as sock:
+            sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_TTL, 1)
+            sock.sendto(f"play {filename}".encode(), (SYNC_GROUP, SYNC_PORT))
+        return True
+    except OSError as e:
+        print(f"Error sending synced play request: {e}")
+        return False
@@ -0,0 +1,60 @@
+"""Input handler for polling the eyes' frame statistics."""
+import concurrent.futures
+import json
+
+import pyarrow as pa
+import requests
+
+# Same fixed addresses as the play_gif handler
+EYE_DISPLAYS = [
+    "10.42.0.156",
+    "10.42.0.218"
+]
+
+
+def fetch_stats(ip):
+    """
+    Fetch the rolling frame statistics of one eye display.
+
+    Args:
+        ip (str): IP address of the eye display.
+
+    Returns:
+        dict: The /stats JSON with an added "ip" field, or None on failure.
+    """
+    try:
+        response = requests.get(f"http://{ip}/stats", timeout=5.0)
+        if response.status_code != 200:
+            return None
+        stats = response.json()
+        stats["ip"] = ip
+        return stats
+    except (requests.exceptions.RequestException, ValueError):
+        return None
+
+
+def process_poll_stats(context, event):
+    """
+    Poll /stats on both eyes and forward the results as the 'eye_stats' output.
+
+    Each entry is the JSON text of one eye's statistics, so the dashboard can
+    read the histograms without a fixed Arrow schema.
+
+    Args:
+        context (dict): The context dictionary containing dependencies.
+        event (dict): The event data (unused).
+
+    Returns:
+        None
+    """
+    with concurrent.futures.ThreadPoolExecutor(max_workers=len(EYE_DISPLAYS)) as executor:
+        results = list(executor.map(fetch_stats, EYE_DISPLAYS))
+
+    stats = [json.dumps(result) for result in results if result is not None]
+    if stats:
+        context["node"].send_output(
+            output_id="eye_stats",
+            data=pa.array(stats),
+            metadata={"count": len(stats)}
+        )
+    return None
@@ -0,0 +1,73 @@
+"""Input handler forwarding the battery level to the eyes' quality governor."""
+import socket
+import time
+
+# Same fixed addresses as the play_gif handler
+EYE_DISPLAYS = [
+    "10.42.0.156",
+    "10.42.0.218"
+]
+CONTROL_PORT = 4211     # the eyes' control channel, one command per UDP datagram
+MIN_CHANGE = 1.0        # % of charge that is worth a new datagram
+RESEND_INTERVAL = 60.0  # s, resent unchanged in case an eye restarted or lost one
+
+
+def _value(event):
+    """First value of an event, or None."""
+    value = event.get("value")
+    data = value.to_pylist() if hasattr(value, "to_pylist") else value
+    return data[0] if data else None
+
+
+def power_line(soc, runtime_s):
+    """
+    The control line for a battery level.
+
+    Args:
+        soc (float): State of charge in %.
+        runtime_s (float): Estimated runtime in seconds, 0 or None when unknown.
+
+    Returns:
+        str: "power <soc> [runtime min]".
+    """
+    line = f"power {max(0, min(100, round(soc)))}"
+    if runtime_s:
+        line += f" {int(runtime_s // 60)}"
+    return line
+
+
+def process_power_level(context, event):
+    """
+    Send the power node's state of charge to both eyes, which pick a render profile for it.
+
+    A "runtime" event only updates the estimate sent along with the next level.
+    The level goes out when it moved by MIN_CHANGE or RESEND_INTERVAL passed,
+    so the eyes aren't woken for every reading.
+
+    Args:
+        context (dict): The context dictionary containing dependencies.
+        event (dict): A "soc" or "runtime" event of the power node.
+
+    Returns:
+        None
+    """
+    value = _value(event)
+    if value is None:
+        return None
+    if event["id"] == "runtime":
+        context["power_runtime"] = float(value)
+        return None
+    soc = float(value)
+    sent = context.get("power_sent")  # (soc, time.monotonic())
+    now = time.monotonic()
+    if sent and abs(soc - sent[0]) < MIN_CHANGE and now - sent[1] < RESEND_INTERVAL:
+        return None
+    line = power_line(soc, context.get("power_runtime"))
+    try:
+        with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as sock:
+            for ip in EYE_DISPLAYS:
+                sock.sendto(line.encode(), (ip, CONTROL_PORT))
+        context["power_sent"] = (soc, now)
+    except OSError as e:
+        print(f"Error sending the battery level to the eyes: {e}")
+    return None
@@ -0,0 +1,75 @@
+"""Input handler passing the GIFs likely to play next to the eyes' prefetcher."""
+import concurrent.futures
+import requests
+
+# Same fixed addresses as the play_gif handler
+EYE_DISPLAYS = [
+    "10.42.0.156",
+    "10.42.0.218"
+]
+MAX_HINTS = 8  # the eyes keep no more than this many
+
+
+def prefetch_names(event):
+    """
+    The GIF names of a prefetch event, most likely first.
+
+    Args:
+        event (dict): A prefetch event, a list of names or one comma separated string.
+
+    Returns:
+        list: At most MAX_HINTS names, without blanks and duplicates.
+    """
+    value = event.get("value")
+    data = value.to_pylist() if hasattr(value, "to_pylist") else value
+    names = []
+    for item in data or []:
+        for name in str(item).split(","):
+            name = name.strip()
+            if name and name not in names:
+                names.append(name)
+    return names[:MAX_HINTS]
+
+
+def send_prefetch_request(ip, names):
+    """
+    Send the hints to one eye.
+
+    Args:
+        ip (str): IP address of the eye display.
+        names (list): GIF names, most likely first.
+
+    Returns:
+        bool: True if the eye took the hints.
+    """
+    try:
+        response = requests.get(f"http://{ip}/prefetch", params={"names": ",".join(names)}, timeout=5.0)
+        if response.status_code != 200:
+            print(f"Failed to send prefetch hints to {ip}: HTTP {response.status_code}")
+        return response.status_code == 200
+    except requests.exceptions.RequestException as e:
+        print(f"Request error for {ip}: {e}")
+        return False
+
+
+def process_prefetch(context, event):
+    """
+    Tell both eyes which GIFs are expected next, so they read them into PSRAM while idle.
+
+    The hints replace the ones sent before; the same list twice in a row isn't sent again.
+
+    Args:
+        context (dict): The context dictionary containing dependencies.
+        event (dict): A prefetch event with the GIF names, most likely first.
+
+    Returns:
+        None
+    """
+    names = prefetch_names(event)
+    if not names or names == context.get("prefetch_sent"):
+        return None
+    with concurrent.futures.ThreadPoolExecutor(max_workers=len(EYE_DISPLAYS)) as executor:
+        results = list(executor.map(lambda ip: send_prefetch_request(ip, names), EYE_DISPLAYS))
+    if all(results):
+        context["prefetch_sent"] = names
+    return None
@@ -6,6 +6,7 @@ import subprocess
 import platform
 import requests
 import hashlib
+import json
 from pathlib import Path
 import glob
 
@@ -19,6 +20,11 @@ class GifSyncHandler:
         # Correctly locate the gif_sync directory relative to the eyes package
         self.current_dir = Path(os.path.dirname(os.path.dirname(os.path.dirname(__file__))))
         self.gif_sync_dir = self.current_dir / "gif_sync"
+        # Host emulator of the eye's display path, built with 'make -C firmware/tools tftemu'
+        self.tftemu = self.current_dir / "firmware" / "tools" / "tftemu"
+        # /capabilities of each eye, and the catalog hash and local files after its last sync
+        self.capabilities = {}
+        self.synced = {}
     
     def should_sync(self):
         """Check if it's time to perform a sync."""
@@ -53,6 +59,14 @@ class GifSyncHandler:
     
     def _check_device(self, ip):
         """Check if an IP address belongs to an eye display."""
+        # Current firmware answers /capabilities at once, an eye that is off costs 3 s, not 20
+        try:
+            response = requests.get(f"http://{ip}/capabilities", timeout=3.0)
+            if response.status_code == 200:
+                self.capabilities[ip] = response.json()
+                return True
+        except (requests.exceptions.RequestException, ValueError):
+            return False
         try:
             # Much longer timeout for ESP32 devices
             sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
@@ -86,14 +100,21 @@ class GifSyncHandler:
             return False
         
         try:
-            # Get list of files on device
-            device_files = self._get_device_files(ip)
-            
             # Get list of local files
             local_files = self._get_local_files()
+            local_state = sorted((name, info['checksum']) for name, info in local_files.items())
+
+            # Nothing changed on either side since the last sync
+            catalog_hash = self.capabilities.get(ip, {}).get('catalog', {}).get('hash')
+            if catalog_hash and self.synced.get(ip) == (catalog_hash, local_state):
+                return True
+
+            # Get list of files on device
+            device_files = self._get_device_files(ip)
             
             # Determine which files to upload
             to_upload = self._determine_files_to_upload(local_files, device_files)
+            self._flag_stuttering(to_upload)
             
             # Upload files
             success_count = 0
@@ -101,16 +122,28 @@ class GifSyncHandler:
                 if self._upload_file(ip, file_path):
                     success_count += 1
             
+            if success_count == len(to_upload) and catalog_hash:
+                self._remember_sync(ip, local_state)
             return success_count == len(to_upload)
         except Exception:
             return False
     
+    def _remember_sync(self, ip, local_state):
+        """Record the eye's catalog hash after a sync, so the next one is skipped until it moves."""
+        try:
+            response = requests.get(f"http://{ip}/capabilities", timeout=3.0)
+            if response.status_code == 200:
+                self.capabilities[ip] = response.json()
+                self.synced[ip] = (self.capabilities[ip]['catalog']['hash'], local_state)
+        except (requests.exceptions.RequestException, ValueError, KeyError):
+            pass
+    
     def _get_device_files(self, ip):
         """Get list of files on the device."""
         try:
-            # Try to use the enhanced endpoint that would return checksums
+            # The manifest has checksums, so changed files are found too
             try:
-                response = requests.get(f"http://{ip}/files", timeout=20.0)
+                response = requests.get(f"http://{ip}/manifest", timeout=20.0)
                 if response.status_code == 200:
                     try:
                         # If we have enhanced API with checksums
@@ -168,23 +201,49 @@ class GifSyncHandler:
         for filename, local_info in local_files.items():
             if filename not in device_files:
                 to_upload.append(local_info['path'])
-            elif device_files[filename]['checksum'] is not None and local_info['checksum'] != device_files[filename]['checksum']:
+            elif device_files[filename].get('store') in ('builtin', 'pack'):
+                continue  # played from firmware or the asset pack, an upload would be shadowed
+            elif device_files[filename]['checksum'] and local_info['checksum'] != device_files[filename]['checksum']:
                 to_upload.append(local_info['path'])
         
         return to_upload
     
+    def _flag_stuttering(self, file_paths):
+        """Print the GIFs among file_paths whose frames would miss their delays on the eye."""
+        gifs = [p for p in file_paths if p.lower().endswith('.gif')]
+        if not gifs or not self.tftemu.exists():
+            return []
+        try:
+            result = subprocess.run([str(self.tftemu), '--json'] + gifs, stdout=subprocess.PIPE,
+                                    stderr=subprocess.PIPE, text=True, timeout=600)
+        except Exception:
+            return []
+        flagged = []
+        for line in result.stdout.splitlines():
+            try:
+                report = json.loads(line)
+            except ValueError:
+                continue
+            if report.get('stutter'):
+                flagged.append(report['name'])
+                print(f"Warning: {report['name']} will stutter on the eye, {report['framesOver']} of "
+                      f"{report['frames']} frames miss their delay ({report['predictedFps']:.1f} of "
+                      f"{report['authoredFps']:.1f} fps)")
+        return flagged
+    
     def _upload_file(self, ip, file_path):
         """Upload a single file to the device."""
         filename = os.path.basename(file_path)
         
         try:
             with open(file_path, 'rb') as f:
-                files = {'file': (filename, f)}
+                # Streamed as the request body, the device checks it against the checksum
                 # 60 seconds timeout for file uploads (ESP32 devices are very slow)
-                response = requests.post(f'http://{ip}/upload', files=files, timeout=60.0)
-                
-                # Accept both 302 (redirect) and 200 (OK) as success
-                return response.status_code in [200, 302]
+                response = requests.put(f'http://{ip}/upload',
+                                        params={'name': filename, 'md5': self._calculate_file_md5(file_path)},
+                                        data=f, headers={'Content-Type': 'application/octet-stream'},
+                                        timeout=60.0)
+                return response.status_code == 200
         except Exception:
             return False
     
@@ -12,6 +12,10 @@ import pyarrow as pa
 from eyes.inputs.tick import process_tick
 from eyes.inputs.list_images import process_list_images
 from eyes.inputs.play_gif import process_play_gif
+from eyes.inputs.poll_stats import process_poll_stats
+from eyes.inputs.eye_events import process_eye_events
+from eyes.inputs.power_level import process_power_level
+from eyes.inputs.prefetch import process_prefetch
 from eyes.outputs.images import broadcast_available_images
 
 
@@ -20,7 +24,8 @@ def main():
 
     Initializes the Dora node, sets up the context, broadcasts the initial
     list of available images, and enters the main event loop to process
-    tick, list_images, and play_gif events.
+    tick, list_images, play_gif, poll_stats, eye_events, soc, runtime and
+    prefetch events.
     """
     # Create the Node
     node = Node()
@@ -50,6 +55,22 @@ def main():
             elif event["id"] == "play_gif":
                 process_play_gif(context, event)
 
+            # Forward the eyes' frame statistics to the dashboard
+            elif event["id"] == "poll_stats":
+                process_poll_stats(context, event)
+
+            # Forward what the eyes pushed on /events (plays started and finished, catalog changes)
+            elif event["id"] == "eye_events":
+                process_eye_events(context, event)
+
+            # Let the eyes scale their render quality with the battery level
+            elif event["id"] in ("soc", "runtime"):
+                process_power_level(context, event)
+
+            # Let the eyes read the GIFs expected next while they idle
+            elif event["id"] == "prefetch":
+                process_prefetch(context, event)
+
 
 if __name__ == "__main__":
     main()
@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+"""Script to compile Adafruit GFX fonts into span fonts for the firmware.
+
+Reads GFX font headers (e.g. TFT_eSPI's Fonts/GFXFF/FreeSans9pt7b.h) and writes
+a C header with only the glyphs that are kept, each stored as horizontal runs
+of set pixels (row, x, length) instead of a bitmap. The sketch picks the header
+up when it is next to it and draws the status text lines with it: the first
+font for text size 1, the second for size 2 and so on.
+"""
+
+import re
+import sys
+import argparse
+
+PRINTABLE = "".join(chr(c) for c in range(0x20, 0x7F))
+
+BITMAP_RE = re.compile(r"const\s+uint8_t\s+(\w+)Bitmaps\[\]\s*PROGMEM\s*=\s*\{(.*?)\};", re.S)
+GLYPHS_RE = re.compile(r"const\s+GFXglyph\s+(\w+)Glyphs\[\]\s*PROGMEM\s*=\s*\{(.*?)\}\s*;", re.S)
+GLYPH_RE = re.compile(r"\{\s*(-?\d+)\s*,\s*(-?\d+)\s*,\s*(-?\d+)\s*,\s*(-?\d+)\s*,\s*(-?\d+)\s*,\s*(-?\d+)\s*\}")
+FONT_RE = re.compile(r"const\s+GFXfont\s+(\w+)\s*PROGMEM\s*=\s*\{[^}]*?,\s*(0x[0-9A-Fa-f]+|\d+)\s*,"
+                     r"\s*(0x[0-9A-Fa-f]+|\d+)\s*,\s*(\d+)\s*\}", re.S)
+STRING_RE = re.compile(r'"((?:[^"\\\n]|\\.)*)"')
+
+
+def parse_gfx_font(path: str) -> dict:
+    """Read a GFX font header.
+
+    Returns:
+        name, first and last character, yAdvance, the bitmap bytes and the glyphs
+        as (offset, width, height, xAdvance, xOffset, yOffset) tuples.
+    """
+    with open(path) as f:
+        text = f.read()
+    bitmap = BITMAP_RE.search(text)
+    glyphs = GLYPHS_RE.search(text)
+    font = FONT_RE.search(text)
+    if not bitmap or not glyphs or not font:
+        raise ValueError(f"{path} is not a GFX font header")
+    return {
+        "name": font.group(1),
+        "first": int(font.group(2), 0),
+        "last": int(font.group(3), 0),
+        "y_advance": int(font.group(4)),
+        "bitmap": [int(v, 0) for v in re.findall(r"0x[0-9A-Fa-f]+|\d+", bitmap.group(2))],
+        "glyphs": [tuple(int(v) for v in g) for g in GLYPH_RE.findall(glyphs.group(2))],
+    }
+
+
+def glyph_spans(bitmap: list[int], offset: int, width: int, height: int) -> list[tuple[int, int, int]]:
+    """Runs of set pixels of a glyph, row by row; GFX bitmaps are packed MSB first across rows."""
+    spans = []
+    bit = offset * 8
+    for y in range(height):
+        x = 0
+        while x < width:
+            if bitmap[(bit + x) >> 3] & (0x80 >> ((bit + x) & 7)):
+                start = x
+                while x < width and bitmap[(bit + x) >> 3] & (0x80 >> ((bit + x) & 7)):
+                    x += 1
+                spans.append((y, start, x - start))
+            else:
+                x += 1
+        bit += width
+    return spans
+
+
+def scan_chars(paths: list[str]) -> str:
+    """Characters of the string literals in the given sources."""
+    chars = set()
+    for path in paths:
+        with open(path) as f:
+            for literal in STRING_RE.findall(f.read()):
+                chars.update(literal.encode().decode("unicode_escape", errors="ignore"))
+    return "".join(sorted(chars))
+
+
+def write_header(font_paths: list[str], chars: str, output: str):
+    """Write the header for the given fonts, in text size order.
+
+    Args:
+        font_paths: GFX font headers; the first is text size 1.
+        chars: Characters to keep, the others are left out of every font.
+        output: Path of the header to write.
+    """
+    lines = [
+        "// Generated by compile_fonts.py, do not edit",
+        "#pragma once",
+        "",
+    ]
+    entries = []
+    total = 0
+    for path in font_paths:
+        font = parse_gfx_font(path)
+        name = font["name"]
+        kept = sorted(c for c in set(chars) if font["first"] <= ord(c) <= font["last"])
+        if not kept:
+            raise ValueError(f"{path} has none of the characters to keep")
+        first, last = ord(kept[0]), ord(kept[-1])
+        spans = []
+        table = []
+        ascent = descent = 0
+        for code in range(first, last + 1):
+            offset, width, height, advance, x_offset, y_offset = font["glyphs"][code - font["first"]]
+            if chr(code) not in kept:
+                table.append(f"  {{ 0, 0, 0, 0, 0 }}, // 0x{code:02X} left out")
+                continue
+            glyph = glyph_spans(font["bitmap"], offset, width, height)
+            table.append(f"  {{ {len(spans)}, {len(glyph)}, {advance}, {x_offset}, {y_offset} }}, // 0x{code:02X} {chr(code)!r}")
+            spans.extend(glyph)
+            if height:
+                ascent = max(ascent, -y_offset)
+                descent = max(descent, height + y_offset)
+        lines.append(f"static const uint8_t {name}Spans[] PROGMEM = {{ // row, x, length")
+        for i in range(0, len(spans), 8):
+            lines.append("  " + " ".join(f"{y},{x},{n}," for y, x, n in spans[i:i + 8]))
+        lines.append("};")
+        lines.append("")
+        lines.append(f"static const SpanGlyph {name}SpanGlyphs[] PROGMEM = {{")
+        lines.extend(table)
+        lines.append("};")
+        lines.append("")
+        entries.append(f"  {{ {name}SpanGlyphs, {name}Spans, 0x{first:02X}, 0x{last:02X}, {ascent}, {descent} }},")
+        size = len(spans) * 3 + len(table) * 6
+        total += size
+        print(f"Compiled {name}: {len(kept)} glyphs, {len(spans)} spans, {size} bytes")
+
+    lines.append("static const SpanFont spanFonts[] = {")
+    lines.extend(entries)
+    lines.append("};")
+    lines.append(f"#define SPAN_FONT_COUNT {len(entries)}")
+    with open(output, "w") as f:
+        f.write("\n".join(lines) + "\n")
+    print(f"Wrote {output}: {len(entries)} fonts, {total} bytes of flash")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compile GFX fonts into span fonts for the eye firmware")
+    parser.add_argument("fonts", nargs="+", help="GFX font headers, one per text size starting at 1")
+    parser.add_argument("-o", "--output", default="span_fonts.h", help="header to write")
+    parser.add_argument("--chars", default=None,
+                        help="characters to keep (default: printable ASCII, or only those found with --scan)")
+    parser.add_argument("--scan", action="append", default=[], metavar="SOURCE",
+                        help="source whose string literals supply characters to keep, added to --chars (repeatable)")
+    args = parser.parse_args()
+    try:
+        chars = args.chars if args.chars is not None else ("" if args.scan else PRINTABLE)
+        chars += scan_chars(args.scan)
+        write_header(args.fonts, chars, args.output)
+    except (OSError, ValueError) as e:
+        print(f"Error: {e}")
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+"""Script to embed GIF files into the firmware as flash-resident arrays.
+
+Writes a C header with one const array per GIF and a table of their names,
+which wall-e_eye.ino picks up when the header is next to it. The GIFs are
+played with AnimatedGIF's openFLASH() and never touch the SD card.
+"""
+
+import os
+import re
+import sys
+import argparse
+
+
+def symbol_for(name: str) -> str:
+    """Turn a file name into a C identifier, e.g. "eye-idle.gif" -> "builtin_eye_idle"."""
+    stem = os.path.splitext(name)[0]
+    return "builtin_" + re.sub(r"[^0-9A-Za-z_]", "_", stem)
+
+
+def write_header(gif_paths: list[str], output: str):
+    """Write the header for the given GIFs, in the given order.
+
+    Args:
+        gif_paths: GIF files to embed; each is played as /gif/<file name>.
+        output: Path of the header to write.
+    """
+    lines = [
+        "// Generated by embed_gifs.py, do not edit",
+        "#pragma once",
+        "",
+    ]
+    entries = []
+    total = 0
+    for path in gif_paths:
+        name = os.path.basename(path)
+        with open(path, "rb") as f:
+            data = f.read()
+        if data[:6] not in (b"GIF87a", b"GIF89a"):
+            print(f"Skipping {path}: not a GIF")
+            continue
+        symbol = symbol_for(name)
+        lines.append(f"static const uint8_t {symbol}[] PROGMEM = {{")
+        for i in range(0, len(data), 16):
+            lines.append("  " + ",".join(f"0x{b:02x}" for b in data[i:i + 16]) + ",")
+        lines.append("};")
+        lines.append("")
+        entries.append(f'  {{ "/gif/{name}", {symbol}, sizeof({symbol}) }},')
+        total += len(data)
+        print(f"Embedded {name}: {len(data)} bytes")
+
+    lines.append("static const BuiltinGif builtinGifs[] = {")
+    lines.extend(entries)
+    lines.append("  { NULL, NULL, 0 }")
+    lines.append("};")
+    with open(output, "w") as f:
+        f.write("\n".join(lines) + "\n")
+    print(f"Wrote {output}: {len(entries)} GIFs, {total} bytes of flash")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Embed GIFs into the eye firmware")
+    parser.add_argument("gifs", nargs="*", help="GIF files, e.g. builtin/idle.gif builtin/blink.gif")
+    parser.add_argument("-o", "--output", default="builtin_gifs.h", help="header to write")
+    args = parser.parse_args()
+    try:
+        write_header(args.gifs, args.output)
+    except OSError as e:
+        print(f"Error: {e}")
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+"""Script to embed the web control page into the firmware, gzip-compressed.
+
+Writes a C header with the gzip of web/index.html as a const array and its
+ETag, which wall-e_eye.ino picks up when the header is next to it. The eye
+serves the bytes as they are with Content-Encoding: gzip, so building the
+page costs it nothing; the page fetches the catalog from the JSON API.
+"""
+
+import sys
+import gzip
+import hashlib
+import argparse
+
+
+def write_header(html_path: str, output: str):
+    """Compress the page and write the header.
+
+    Args:
+        html_path: The page to embed, with its styles and scripts inline.
+        output: Path of the header to write.
+    """
+    with open(html_path, "rb") as f:
+        html = f.read()
+    # mtime=0 keeps the bytes, and so the ETag, the same for the same page
+    data = gzip.compress(html, compresslevel=9, mtime=0)
+    etag = hashlib.md5(data).hexdigest()[:16]
+    lines = [
+        "// Generated by embed_web.py, do not edit",
+        "#pragma once",
+        "",
+        f'#define WEB_UI_ETAG "\\"{etag}\\""',
+        "static const uint8_t webUiGz[] PROGMEM = {",
+    ]
+    for i in range(0, len(data), 16):
+        lines.append("  " + ",".join(f"0x{b:02x}" for b in data[i:i + 16]) + ",")
+    lines.append("};")
+    with open(output, "w") as f:
+        f.write("\n".join(lines) + "\n")
+    print(f"Wrote {output}: {len(html)} bytes of page, {len(data)} gzipped")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Embed the gzipped web control page into a C header")
+    parser.add_argument("page", nargs="?", default="web/index.html", help="HTML page to embed")
+    parser.add_argument("-o", "--output", default="web_ui.h", help="header to write")
+    args = parser.parse_args()
+    try:
+        write_header(args.page, args.output)
+    except OSError as e:
+        print(f"Error: {e}")
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -23,14 +23,94 @@
 // Here is all of the actual code...
 #include "gif.inl"
 
+AnimatedGIFDecoder::AnimatedGIFDecoder(void *pImage, int iMaxWidth, int iMaxColors, bool bStorage) :
+    _gif(*(GIFIMAGE *)pImage), _iMaxWidth(iMaxWidth), _iMaxColors(iMaxColors), _bStorage(bStorage),
+    _pHot(NULL), _pLine(NULL), _pWorkspace(NULL), _pPalettes(NULL)
+{
+    memset(&_gif, 0, offsetof(GIFIMAGE, u32Buffers));
+    bindBuffers();
+} /* AnimatedGIFDecoder() */
+//
+// Point the decoder at the buffers from allocBuffers() or setWorkspace(),
+// or else its own
+//
+void AnimatedGIFDecoder::bindBuffers()
+{
+    if (_pHot && _pLine)
+        GIFSetBuffers(&_gif, _pLine, _pHot, _pHot + GIF_PALETTE_SET_BYTES(_iMaxColors), _iMaxWidth, _iMaxColors);
+    else if (_pWorkspace && _pPalettes)
+        GIFSetBuffers(&_gif, _pWorkspace, _pPalettes, _pWorkspace + FILE_BUF_SIZE, _iMaxWidth, _iMaxColors);
+    else if (_bStorage)
+        GIFBindBuffers(&_gif, _iMaxWidth, _iMaxColors);
+    else
+        GIFSetBuffers(&_gif, NULL, NULL, NULL, _iMaxWidth, _iMaxColors);
+} /* bindBuffers() */
+//
+// Allocate the decoder buffers (LZW tables, palettes and file data) instead
+// of using the ones in the object; the memory hint of each tells the callback
+// where it is best placed. Call before open(), the buffers are kept by
+// begin(). If an allocation fails the decoder keeps its own buffers and
+// freeBuffers() releases the other one
+//
+int AnimatedGIFDecoder::allocBuffers(GIF_ALLOC_CAPS_CALLBACK *pfnAlloc)
+{
+    if (_pHot || _pLine || _pWorkspace)
+        return GIF_INVALID_PARAMETER;
+    _pHot = (uint8_t *)(*pfnAlloc)(GIF_HOT_BYTES(_iMaxWidth, _iMaxColors), GIF_MEM_HOT);
+    _pLine = (uint8_t *)(*pfnAlloc)(FILE_BUF_SIZE, GIF_MEM_LINE);
+    if (_pHot == NULL || _pLine == NULL)
+        return GIF_ERROR_MEMORY;
+    memset(_pHot, 0, GIF_HOT_BYTES(_iMaxWidth, _iMaxColors)); // like the object's own, for bad color indices
+    bindBuffers();
+    return GIF_SUCCESS;
+} /* allocBuffers() */
+//
+// Release the buffers of allocBuffers(), the decoder goes back to its own
+//
+int AnimatedGIFDecoder::freeBuffers(GIF_FREE_CALLBACK *pfnFree)
+{
+    if (_pHot == NULL && _pLine == NULL)
+        return GIF_INVALID_PARAMETER;
+    if (_pHot)
+        (*pfnFree)(_pHot);
+    if (_pLine)
+        (*pfnFree)(_pLine);
+    _pHot = _pLine = NULL;
+    bindBuffers();
+    return GIF_SUCCESS;
+} /* freeBuffers() */
+//
+// Decode with iSize bytes of scratch at pWorkspace, at least
+// GIF_WORKSPACE_BYTES() for the decoder's limits, which other decoders may
+// use as well: nothing in it outlives a playFrame() call, so decoders which
+// take turns between frames on one task can share it. The palettes outlive
+// frames, pPalettes holds GIF_PALETTE_SET_BYTES() of them for this decoder
+// alone. Both 32-bit aligned; call before open(), NULL goes back to the
+// decoder's own buffers
+//
+int AnimatedGIFDecoder::setWorkspace(void *pWorkspace, int iSize, void *pPalettes)
+{
+    if (_pHot || _pLine)
+        return GIF_INVALID_PARAMETER; // allocBuffers() has them
+    if (pWorkspace && (pPalettes == NULL || iSize < (int)GIF_WORKSPACE_BYTES(_iMaxWidth, _iMaxColors)))
+        return GIF_INVALID_PARAMETER;
+    _pWorkspace = (uint8_t *)pWorkspace;
+    _pPalettes = pWorkspace ? (uint8_t *)pPalettes : NULL;
+    if (_pPalettes)
+        memset(_pPalettes, 0, GIF_PALETTE_SET_BYTES(_iMaxColors)); // like the object's own, for bad color indices
+    bindBuffers();
+    return GIF_SUCCESS;
+} /* setWorkspace() */
+
 //
 // Memory initialization
 //
-int AnimatedGIF::open(uint8_t *pData, int iDataSize, GIF_DRAW_CALLBACK *pfnDraw)
+int AnimatedGIFDecoder::open(uint8_t *pData, int iDataSize, GIF_DRAW_CALLBACK *pfnDraw)
 {
     _gif.iError = GIF_SUCCESS;
     _gif.pfnRead = readMem;
     _gif.pfnSeek = seekMem;
+    _gif.pfnBorrow = borrowMem;
     _gif.pfnDraw = pfnDraw;
     _gif.pfnOpen = NULL;
     _gif.pfnClose = NULL;
@@ -39,11 +119,16 @@ int AnimatedGIF::open(uint8_t *pData, int iDataSize, GIF_DRAW_CALLBACK *pfnDraw)
     return GIFInit(&_gif);
 } /* open() */
 
-int AnimatedGIF::openFLASH(uint8_t *pData, int iDataSize, GIF_DRAW_CALLBACK *pfnDraw)
+int AnimatedGIFDecoder::openFLASH(uint8_t *pData, int iDataSize, GIF_DRAW_CALLBACK *pfnDraw)
 {
     _gif.iError = GIF_SUCCESS;
     _gif.pfnRead = readFLASH;
     _gif.pfnSeek = seekMem;
+#ifdef __AVR__
+    _gif.pfnBorrow = NULL; // program memory can't be read through a pointer
+#else
+    _gif.pfnBorrow = borrowMem; // mapped flash reads like memory
+#endif
     _gif.pfnDraw = pfnDraw;
     _gif.pfnOpen = NULL;
     _gif.pfnClose = NULL;
@@ -55,7 +140,7 @@ int AnimatedGIF::openFLASH(uint8_t *pData, int iDataSize, GIF_DRAW_CALLBACK *pfn
 //
 // Returns the first comment block found (if any)
 //
-int AnimatedGIF::getComment(char *pDest)
+int AnimatedGIFDecoder::getComment(char *pDest)
 {
 int32_t iOldPos;
 
@@ -70,13 +155,13 @@ int32_t iOldPos;
 //  
 // Allocate a block of memory to hold the entire canvas (as 8-bpp)
 //
-int AnimatedGIF::allocFrameBuf(GIF_ALLOC_CALLBACK *pfnAlloc)
+int AnimatedGIFDecoder::allocFrameBuf(GIF_ALLOC_CALLBACK *pfnAlloc)
 {
     if (_gif.iCanvasWidth > 0 && _gif.iCanvasHeight > 0 && _gif.pFrameBuffer == NULL)
     {
         // Allocate a little extra space for the current line
         // as RGB565 or RGB888
-        int iCanvasSize = _gif.iCanvasWidth * (_gif.iCanvasHeight+3);
+        int iCanvasSize = getCanvasWidth() * (getCanvasHeight()+3);
         _gif.pFrameBuffer = (unsigned char *)(*pfnAlloc)(iCanvasSize);
         if (_gif.pFrameBuffer == NULL)
             return GIF_ERROR_MEMORY;
@@ -88,7 +173,7 @@ int AnimatedGIF::allocFrameBuf(GIF_ALLOC_CALLBACK *pfnAlloc)
 // Allocate a block of memory to hold the Turbo Buffer entire canvas (as 8-bpp)
 // as well as 32k needed for faster decoding
 //
-int AnimatedGIF::allocTurboBuf(GIF_ALLOC_CALLBACK *pfnAlloc)
+int AnimatedGIFDecoder::allocTurboBuf(GIF_ALLOC_CALLBACK *pfnAlloc)
 {
     if (_gif.iCanvasWidth > 0 && _gif.iCanvasHeight > 0 && _gif.pTurboBuffer == NULL)
     {
@@ -103,24 +188,80 @@ int AnimatedGIF::allocTurboBuf(GIF_ALLOC_CALLBACK *pfnAlloc)
     return GIF_INVALID_PARAMETER;
 } /* allocTurboBuf() */
 //
+// Same as above, with the memory hint of each block passed to the callback
+//
+int AnimatedGIFDecoder::allocFrameBuf(GIF_ALLOC_CAPS_CALLBACK *pfnAlloc)
+{
+    if (_gif.iCanvasWidth > 0 && _gif.iCanvasHeight > 0 && _gif.pFrameBuffer == NULL)
+    {
+        int iCanvasSize = getCanvasWidth() * (getCanvasHeight()+3);
+        _gif.pFrameBuffer = (unsigned char *)(*pfnAlloc)(iCanvasSize, GIF_MEM_BULK);
+        if (_gif.pFrameBuffer == NULL)
+            return GIF_ERROR_MEMORY;
+        return GIF_SUCCESS;
+    }
+    return GIF_INVALID_PARAMETER;
+} /* allocFrameBuf() */
+//
+// The LZW tables of the Turbo buffer are allocated apart as GIF_MEM_HOT and
+// only the canvas sized pixels as GIF_MEM_BULK; if the tables can't be had
+// they stay in a single Turbo buffer
+//
+int AnimatedGIFDecoder::allocTurboBuf(GIF_ALLOC_CAPS_CALLBACK *pfnAlloc)
+{
+    if (_gif.iCanvasWidth > 0 && _gif.iCanvasHeight > 0 && _gif.pTurboBuffer == NULL)
+    {
+        int iPixels = _gif.iCanvasWidth * _gif.iCanvasHeight;
+        int iTurboSize = TURBO_BUFFER_SIZE + iPixels;
+        _gif.pTurboTables = (unsigned char *)(*pfnAlloc)(GIF_TURBO_TABLE_BYTES, GIF_MEM_HOT);
+        if (_gif.pTurboTables) // root symbols and the cooked line still follow the pixels
+            iTurboSize = iPixels + 256 + 4 * _gif.iCanvasWidth;
+        _gif.pTurboBuffer = (unsigned char *)(*pfnAlloc)(iTurboSize, GIF_MEM_BULK);
+        if (_gif.pTurboBuffer == NULL)
+            return GIF_ERROR_MEMORY;
+        return GIF_SUCCESS;
+    }
+    return GIF_INVALID_PARAMETER;
+} /* allocTurboBuf() */
+//
 // Set the frame buffer pointer
 //
-void AnimatedGIF::setFrameBuf(void *pFrameBuf)
+void AnimatedGIFDecoder::setFrameBuf(void *pFrameBuf)
 {
     _gif.pFrameBuffer = (uint8_t*)pFrameBuf;
 }
 //
 // Set the Turbo buffer pointer
 //
-void AnimatedGIF::setTurboBuf(void *pBuf)
+void AnimatedGIFDecoder::setTurboBuf(void *pBuf)
 {
     _gif.pTurboBuffer = (uint8_t *)pBuf;
 } /* setTurboBuf() */
 //
+// Keep the Turbo mode LZW tables (GIF_TURBO_TABLE_BYTES) apart from the
+// Turbo buffer, e.g. in internal RAM while the pixels are in PSRAM
+// NULL puts them back at the end of the Turbo buffer
+//
+void AnimatedGIFDecoder::setTurboTables(void *pTables)
+{
+    _gif.pTurboTables = (uint8_t *)pTables;
+} /* setTurboTables() */
+//
+// Decode with the Turbo mode LZW tables and a window of recent lines in
+// pBuf (GIF_TURBO_WINDOW_BYTES()) instead of a frame sized Turbo buffer,
+// which takes precedence. Frames too wide for the window decode without it
+// NULL turns it off
+//
+void AnimatedGIFDecoder::setTurboWindow(void *pBuf, int iSize)
+{
+    _gif.pTurboWindow = (uint8_t *)pBuf;
+    _gif.iTurboWindowSize = pBuf ? iSize : 0;
+} /* setTurboWindow() */
+//
 // Set the DRAW callback behavior to RAW (default)
 // or COOKED (requires allocating a frame buffer)
 //
-int AnimatedGIF::setDrawType(int iType)
+int AnimatedGIFDecoder::setDrawType(int iType)
 {
     if (iType != GIF_DRAW_RAW && iType != GIF_DRAW_COOKED)
         return GIF_INVALID_PARAMETER; // invalid drawing mode
@@ -128,14 +269,93 @@ int AnimatedGIF::setDrawType(int iType)
     return GIF_SUCCESS;
 } /* setDrawType() */
 //
+// Enable/disable delta reporting for COOKED output
+// When enabled, iDirtyX/iDirtyWidth of each line passed to GIFDraw
+// only cover the pixels which changed since the previous frame
+//
+void AnimatedGIFDecoder::setDeltaMode(int bDelta)
+{
+    _gif.ucDeltaMode = (uint8_t)(bDelta != 0);
+    _gif.bDeltaFull = 1; // the display may not match the canvas yet
+} /* setDeltaMode() */
+//
+// Decode the next frames into the frame buffer without calling GIFDraw,
+// e.g. to catch up on one the following frame draws over anyway. Only works
+// with a frame buffer; the first frame drawn afterwards is reported in full
+//
+void AnimatedGIFDecoder::setSkipDraw(int bSkip)
+{
+    _gif.bSkipDraw = (uint8_t)(bSkip != 0);
+} /* setSkipDraw() */
+//
+// Collect up to iMaxLines consecutive COOKED lines in pStrip (iPixels RGB565
+// pixels) and call GIFDraw once per strip, with iLines and iPitch set, instead
+// of once per line. A strip ends early at a line that doesn't follow it (e.g.
+// interlaced frames) and at the end of the frame; lines wider than pStrip are
+// still drawn one by one from the frame buffer. The draw callback may hand
+// over the next buffer with another call, e.g. while the last one is sent.
+// NULL turns strips off; only RGB565 palettes use them
+//
+void AnimatedGIFDecoder::setStripBuffer(void *pStrip, int iPixels, int iMaxLines)
+{
+    _gif.pStrip = (uint8_t *)pStrip;
+    _gif.iStripPixels = iPixels;
+    _gif.iStripMaxLines = iMaxLines;
+} /* setStripBuffer() */
+//
+// Scratch memory for disposal method 3 (restore to previous) in COOKED RGB565
+// mode with a frame buffer: before such a frame is merged, the canvas under
+// its rectangle (one byte per pixel, at the output scale) is saved here and
+// it is put back before the next frame. Frames whose rectangle doesn't fit,
+// or all of them without a buffer, are kept like method 1
+//
+void AnimatedGIFDecoder::setDisposeBuffer(void *pBuffer, int iSize)
+{
+    _gif.pDisposeBuffer = (uint8_t *)pBuffer;
+    _gif.iDisposeSize = pBuffer ? iSize : 0;
+    _gif.bSaved = 0;
+} /* setDisposeBuffer() */
+//
+// Recolor RGB565 output: each palette entry goes through the transform when
+// it is converted, so a recolored GIF costs one transform per palette entry
+// instead of one per pixel. NULL turns it off. Local palettes converted from
+// now on use it, the global palette only from the next open(). The transform
+// is read while palettes are converted and must stay valid until then
+//
+void AnimatedGIFDecoder::setColorTransform(const GIFCOLORXFORM *pXform)
+{
+    int i;
+    _gif.pColorXform = pXform;
+    _gif.usLocalColors = 0; // converted with the previous transform
+#if GIF_PALETTE_CACHE
+    for (i=0; i<GIF_PALETTE_CACHE; i++)
+        _gif.palCache[i].usColors = 0;
+#else
+    (void)i;
+#endif
+} /* setColorTransform() */
+//
+// Scale the output down by 1<<iShift (GIF_SCALE_FULL/HALF/QUARTER)
+// Call after open() and before allocating the frame buffer; the canvas size
+// getters, frame buffer and GIFDRAW coordinates are all in the scaled size.
+// The Turbo buffer still holds a frame at its original size
+//
+int AnimatedGIFDecoder::setScale(int iShift)
+{
+    return GIF_setScale(&_gif, iShift);
+} /* setScale() */
+//
 // Release the memory used by the Turbo buffer
 //
-int AnimatedGIF::freeTurboBuf(GIF_FREE_CALLBACK *pfnFree)
+int AnimatedGIFDecoder::freeTurboBuf(GIF_FREE_CALLBACK *pfnFree)
 {
     if (_gif.pTurboBuffer)
     {
         (*pfnFree)(_gif.pTurboBuffer);
         _gif.pTurboBuffer = NULL;
+        if (_gif.pTurboTables)
+            (*pfnFree)(_gif.pTurboTables);
+        _gif.pTurboTables = NULL;
         return GIF_SUCCESS;
     }
     return GIF_INVALID_PARAMETER;
@@ -143,7 +363,7 @@ int AnimatedGIF::freeTurboBuf(GIF_FREE_CALLBACK *pfnFree)
 //
 // Release the memory used by the frame buffer
 //
-int AnimatedGIF::freeFrameBuf(GIF_FREE_CALLBACK *pfnFree)
+int AnimatedGIFDecoder::freeFrameBuf(GIF_FREE_CALLBACK *pfnFree)
 {
     if (_gif.pFrameBuffer)
     {
@@ -156,52 +376,97 @@ int AnimatedGIF::freeFrameBuf(GIF_FREE_CALLBACK *pfnFree)
 //
 // Return a pointer to the frame buffer (if it was allocated)
 //
-uint8_t * AnimatedGIF::getFrameBuf()
+uint8_t * AnimatedGIFDecoder::getFrameBuf()
 {
     return _gif.pFrameBuffer;
 } /* getFrameBuf() */
 
+//
+// Return the palette of the last decoded frame (its local one or the global one),
+// which turns lines of the 8-bpp frame buffer into the COOKED output
+//
+uint16_t * AnimatedGIFDecoder::getFramePalette()
+{
+    return _gif.bUseLocalPalette ? _gif.pLocalPalette : _gif.pPalette;
+} /* getFramePalette() */
+
 //
 // Return a pointer to the Turbo buffer (if it was allocated)
 //
-uint8_t * AnimatedGIF::getTurboBuf()
+uint8_t * AnimatedGIFDecoder::getTurboBuf()
 {
     return _gif.pTurboBuffer;
 } /* getTurboBuf() */
 
-int AnimatedGIF::getCanvasWidth()
+int AnimatedGIFDecoder::getCanvasWidth()
 {
-    return _gif.iCanvasWidth;
+    return GIF_SCALED(&_gif, _gif.iCanvasWidth);
 } /* getCanvasWidth() */
 
-int AnimatedGIF::getCanvasHeight()
+int AnimatedGIFDecoder::getCanvasHeight()
 {
-    return _gif.iCanvasHeight;
+    return GIF_SCALED(&_gif, _gif.iCanvasHeight);
 } /* getCanvasHeight() */
 
-int AnimatedGIF::getLoopCount()
+int AnimatedGIFDecoder::getLoopCount()
 {
     return _gif.iRepeatCount;
 } /* getLoopCount() */
 
-int AnimatedGIF::getInfo(GIFINFO *pInfo)
+int AnimatedGIFDecoder::getInfo(GIFINFO *pInfo)
 {
    return GIF_getInfo(&_gif, pInfo);
 } /* getInfo() */
 
-int AnimatedGIF::getLastError()
+int AnimatedGIFDecoder::getLastError()
 {
     return _gif.iError;
 } /* getLastError() */
 
+//
+// Attach storage for a frame index, getInfo() fills all of it, playFrame()
+// adds each frame it reaches for the first time. iCount entries may already
+// be valid, e.g. read from a sidecar file written for the same GIF
+//
+void AnimatedGIFDecoder::setFrameIndex(GIFFRAME *pFrames, int iMaxFrames, int iCount)
+{
+    GIF_setFrameIndex(&_gif, pFrames, iMaxFrames, iCount);
+} /* setFrameIndex() */
+
+int AnimatedGIFDecoder::getIndexedFrames()
+{
+    return _gif.iIndexCount;
+} /* getIndexedFrames() */
+
+//
+// Make the next playFrame() decode frame iFrame, see GIF_seekFrame()
+//
+int AnimatedGIFDecoder::seekFrame(int iFrame)
+{
+    return GIF_seekFrame(&_gif, iFrame);
+} /* seekFrame() */
+//
+// Step over the next frame if the frame after it covers the canvas, see GIF_skipFrame()
+//
+int AnimatedGIFDecoder::skipFrame(int *delayMilliseconds)
+{
+    return GIF_skipFrame(&_gif, delayMilliseconds);
+} /* skipFrame() */
+
+int AnimatedGIFDecoder::getFrame()
+{
+    return _gif.iFrame;
+} /* getFrame() */
+
 //
 // File (SD/MMC) based initialization
 //
-int AnimatedGIF::open(const char *szFilename, GIF_OPEN_CALLBACK *pfnOpen, GIF_CLOSE_CALLBACK *pfnClose, GIF_READ_CALLBACK *pfnRead, GIF_SEEK_CALLBACK *pfnSeek, GIF_DRAW_CALLBACK *pfnDraw)
+int AnimatedGIFDecoder::open(const char *szFilename, GIF_OPEN_CALLBACK *pfnOpen, GIF_CLOSE_CALLBACK *pfnClose, GIF_READ_CALLBACK *pfnRead, GIF_SEEK_CALLBACK *pfnSeek, GIF_DRAW_CALLBACK *pfnDraw, GIF_BORROW_CALLBACK *pfnBorrow)
 {
     _gif.iError = GIF_SUCCESS;
     _gif.pfnRead = pfnRead;
     _gif.pfnSeek = pfnSeek;
+    _gif.pfnBorrow = pfnBorrow;
     _gif.pfnDraw = pfnDraw;
     _gif.pfnOpen = pfnOpen;
     _gif.pfnClose = pfnClose;
@@ -214,22 +479,35 @@ int AnimatedGIF::open(const char *szFilename, GIF_OPEN_CALLBACK *pfnOpen, GIF_CL
 
 } /* open() */
 
-void AnimatedGIF::close()
+void AnimatedGIFDecoder::close()
 {
     if (_gif.pfnClose)
         (*_gif.pfnClose)(_gif.GIFFile.fHandle);
 } /* close() */
 
-void AnimatedGIF::reset()
+void AnimatedGIFDecoder::reset()
 {
     _gif.iError = GIF_SUCCESS;
     (*_gif.pfnSeek)(&_gif.GIFFile, 0);
+    _gif.iFrame = 0;
 } /* reset() */
 
-void AnimatedGIF::begin(unsigned char ucPaletteType)
+//
+// Restart at the first frame, keeping the parsed header and the converted global
+// palette, so a GIF played in a loop doesn't need begin() and open() again
+//
+void AnimatedGIFDecoder::rewind()
+{
+    _gif.iError = GIF_SUCCESS;
+    GIFRewind(&_gif);
+} /* rewind() */
+
+void AnimatedGIFDecoder::begin(unsigned char ucPaletteType)
 {
-    memset(&_gif, 0, sizeof(_gif));
-    if (ucPaletteType != GIF_PALETTE_RGB565_LE && ucPaletteType != GIF_PALETTE_RGB565_BE && ucPaletteType != GIF_PALETTE_RGB888)
+    memset(&_gif, 0, offsetof(GIFIMAGE, u32Buffers)); // the buffers are only as large as the limits need
+    bindBuffers();
+    if (ucPaletteType != GIF_PALETTE_RGB565_LE && ucPaletteType != GIF_PALETTE_RGB565_BE && ucPaletteType != GIF_PALETTE_RGB888 &&
+        ucPaletteType != GIF_PALETTE_4BPP)
         _gif.iError = GIF_INVALID_PARAMETER;
     _gif.ucPaletteType = ucPaletteType;
     _gif.ucDrawType = GIF_DRAW_RAW; // assume RAW pixel handling
@@ -241,29 +519,35 @@ void AnimatedGIF::begin(unsigned char ucPaletteType)
 // 1 = good result and more frames exist
 // 0 = no more frames exist, a frame may or may not have been played: use getLastError() and look for GIF_SUCCESS to know if a frame was played
 // -1 = error
-int AnimatedGIF::playFrame(bool bSync, int *delayMilliseconds, void *pUser)
+int AnimatedGIFDecoder::playFrame(bool bSync, int *delayMilliseconds, void *pUser)
 {
 int rc;
+int32_t iFrameStart;
 #if !defined( __MACH__ ) && !defined( __LINUX__ )
 long lTime = millis();
 #endif
 
     if (_gif.GIFFile.iPos >= _gif.GIFFile.iSize-1) // no more data exists
     {
-        (*_gif.pfnSeek)(&_gif.GIFFile, 0); // seek to start
+        GIFRewind(&_gif); // back to the first frame
     }
+    iFrameStart = _gif.GIFFile.iPos;
     if (GIFParseInfo(&_gif, 0))
     {
         _gif.pUser = pUser;
         if (_gif.iError == GIF_EMPTY_FRAME) // don't try to decode it
             return 0;
+        GIFIndexFrame(&_gif, iFrameStart);
         if (_gif.pTurboBuffer) {
             rc = DecodeLZWTurbo(&_gif, 0);
+        } else if (_gif.pTurboWindow) {
+            rc = DecodeLZWWindow(&_gif, 0);
         } else {
             rc = DecodeLZW(&_gif, 0);
         }
         if (rc != 0) // problem
             return -1;
+        _gif.iFrame++;
     }
     else
     {
@@ -22,12 +22,27 @@
 #else
 #include <Arduino.h>
 #endif
+#include <stddef.h> // offsetof()
 
 // Cortex-M4/M7 allow unaligned access to SRAM
 #if defined(HAL_ESP32_HAL_H_) || defined(TEENSYDUINO) || defined(ARM_MATH_CM4) || defined(ARM_MATH_CM7)
 #define ALLOWS_UNALIGNED
 #endif
 
+// On the ESP32-S3 the per-pixel code (LZW decoders, GIFMakePels, DrawCooked, the strip writer
+// and the RGB565 palette kernels) runs from IRAM and the constant tables sit in internal DRAM,
+// so a frame doesn't stall on instruction cache misses after WiFi or SD traffic has evicted its
+// flash lines. About 20 KB of IRAM; define GIF_NO_IRAM to leave it all in flash
+#if defined(CONFIG_IDF_TARGET_ESP32S3) && !defined(GIF_NO_IRAM)
+#include <esp_attr.h>
+#define GIF_IRAM IRAM_ATTR
+#define GIF_DRAM DRAM_ATTR
+#define GIF_HOT_LOOPS_IN_IRAM
+#else
+#define GIF_IRAM
+#define GIF_DRAM
+#endif
+
 //
 // GIF Animator
 // Written by Larry Bank
@@ -46,21 +61,24 @@
 /* GIF Defines and variables */
 #define MAX_CHUNK_SIZE 255
 //
-// These 2 macros can be changed to limit the amount of RAM
-// required by the decoder. For example, decoding 1-bit images to
-// a 128x32 display will not need a max code size of 12 nor a palette
-// with 256 entries
+// MAX_WIDTH and MAX_COLORS are the limits of the default AnimatedGIF class;
+// AnimatedGIFT<iMaxWidth, iMaxColors> sizes the line buffers and palettes of
+// a decoder for smaller content at compile time. For example, decoding 240
+// pixel wide images with 16 colors needs about 6.8K less RAM, 4K of it
+// because their LZW strings' pixels pack two to a byte. MAX_CODE_SIZE is
+// fixed since any GIF, whatever its colors, may use codes up to 12 bits
 //
 #define TURBO_BUFFER_SIZE 0x6100
 #define MAX_CODE_SIZE 12
 #define MAX_COLORS 256
+// Converted local palettes kept for GIFs which alternate between a few of them (0 = none)
+#define GIF_PALETTE_CACHE 2
 #ifdef __LINUX__
 #define MAX_WIDTH 2048
 #else
 #define MAX_WIDTH 480
 #endif // __LINUX__
 #define LZW_BUF_SIZE (6*MAX_CHUNK_SIZE)
-#define LZW_HIGHWATER (4*MAX_CHUNK_SIZE)
 // This buffer is used to store the pixel sequence in reverse order
 // it needs to be large enough to hold the longest possible
 // sequence (1<<MAX_CODE_SIZE)
@@ -71,9 +89,29 @@
 #define LINK_UNUSED 5911 // 0x1717 to use memset
 #define LINK_END 5912
 #define MAX_HASH 5003
-// expanded LZW buffer for Turbo mode
-#define LZW_BUF_SIZE_TURBO (LZW_BUF_SIZE + (2<<MAX_CODE_SIZE) + (PIXEL_LAST*2) + MAX_WIDTH)
-#define LZW_HIGHWATER_TURBO ((LZW_BUF_SIZE_TURBO * 14) / 16)
+// first and last pixel of every LZW string; pixels of up to 16 colors share a byte
+#define GIF_PIXEL_TABLE_BYTES(c) ((c) <= 16 ? PIXEL_LAST : PIXEL_LAST*2)
+// expanded LZW buffer for Turbo mode, for line buffers of w pixels and c palette entries
+#define LZW_BUF_SIZE_TURBO(w, c) (LZW_BUF_SIZE + (2<<MAX_CODE_SIZE) + GIF_PIXEL_TABLE_BYTES(c) + (w))
+// De-chunked LZW data is a ring over the LZW buffer less LZW_MIRROR bytes, which repeat the
+// first bytes of the ring so the code readers can load a word across its end
+#define LZW_MIRROR 16
+#define LZW_RING_SIZE(pGIF) (((pGIF)->pTurboBuffer ? LZW_BUF_SIZE_TURBO((pGIF)->iMaxWidth, (pGIF)->iMaxColors) : LZW_BUF_SIZE) - LZW_MIRROR)
+// bytes of decoder buffers for w pixel lines and c palette entries (see GIFIMAGE.u32Buffers),
+// the GIF_MEM_LINE file buffer and the GIF_MEM_HOT rest
+#define GIF_PALETTE_BYTES(c) (((c) * 3 + 3) & ~3)
+#define GIF_PALETTE_SET_BYTES(c) ((2 + GIF_PALETTE_CACHE) * GIF_PALETTE_BYTES(c))
+#define GIF_HOT_BYTES(w, c) (GIF_PALETTE_SET_BYTES(c) + LZW_BUF_SIZE_TURBO(w, c) + (w) + 16)
+#define GIF_BUFFER_BYTES(w, c) (FILE_BUF_SIZE + GIF_HOT_BYTES(w, c))
+// scratch of setWorkspace(): the file buffer, LZW ring, tables and line buffers, which only hold
+// data while a frame decodes, so decoders that take turns between frames can share one
+#define GIF_WORKSPACE_BYTES(w, c) (FILE_BUF_SIZE + LZW_BUF_SIZE_TURBO(w, c) + (w) + 16)
+// LZW symbol offsets and lengths of Turbo mode, at the end of the Turbo buffer unless set apart
+#define GIF_TURBO_TABLE_BYTES ((4<<MAX_CODE_SIZE) + (2<<MAX_CODE_SIZE))
+// windowed Turbo mode (setTurboWindow()): the tables and a ring of h lines of w pixels, at
+// least the longest LZW string and its line; fewer lines mean more strings rebuilt from links
+#define GIF_TURBO_WINDOW_BYTES(w, h) (GIF_TURBO_TABLE_BYTES + (w) * (h) + 16)
+#define GIF_TURBO_WINDOW_MIN_LINES(w) ((FILE_BUF_SIZE + 16) / (w) + 2)
 
 //
 // Pixel types
@@ -84,7 +122,8 @@ enum {
    GIF_PALETTE_RGB888,        // original 24-bpp entries
    GIF_PALETTE_RGB8888,       // 32-bit (alpha = 0xff)
    GIF_PALETTE_1BPP,          // 1-bit per pixel (horizontal, MSB on left)
-   GIF_PALETTE_1BPP_OLED      // 1-bit per pixel (vertical, LSB on top)
+   GIF_PALETTE_1BPP_OLED,     // 1-bit per pixel (vertical, LSB on top)
+   GIF_PALETTE_4BPP           // 4-bit palette indices (2 per byte, left in the high nibble), RGB565 LE palette
 };
 // for compatibility with older code
 #define LITTLE_ENDIAN_PIXELS GIF_PALETTE_RGB565_LE
@@ -100,11 +139,30 @@ enum {
 //          room for the fully rendered pixels at the end of the 8-bit pixel buffer. For example, a 160x120
 //          canvas size with 24-bit output would require (160*120 + 3*160) bytes.
 //          Each prepared line is sent to the GIFDraw callback as a row of 16/24/32-bit pixels.
+//          GIF_PALETTE_4BPP lines are palette indices two to a byte instead, for content of up to 16
+//          colors drawn into 4-bit sprites with pPalette as their palette.
 //
 enum {
    GIF_DRAW_RAW = 0,
    GIF_DRAW_COOKED
 };
+//
+// Scaled output, see setScale(): every 2nd or 4th pixel and line of the canvas is kept
+// while the lines are emitted, so the canvas size, frame buffer and GIFDRAW coordinates
+// are all in the scaled size
+//
+#define GIF_SCALE_FULL 0
+#define GIF_SCALE_HALF 1
+#define GIF_SCALE_QUARTER 2
+
+//
+// Memory hints passed to a GIF_ALLOC_CAPS_CALLBACK
+//
+enum {
+   GIF_MEM_HOT = 0, // read for every LZW code or pixel (palettes, LZW tables): fastest RAM
+   GIF_MEM_LINE,    // file data, accessed a chunk or a line at a time
+   GIF_MEM_BULK     // canvas sized (Turbo pixels, frame buffer), external RAM is fine
+};
 
 enum {
    GIF_SUCCESS = 0,
@@ -135,6 +193,52 @@ typedef struct gif_info_tag
   int32_t iMinDelay; // minimum frame delay
 } GIFINFO;
 
+//
+// Frame index, filled by getInfo() or while the frames are played the first time,
+// so seekFrame() can go to any frame without parsing the ones before it.
+// As a sidecar file the entries follow a GIFINDEXHEADER.
+//
+#define GIF_FRAME_TRANSPARENT 1   // the frame has a transparent colour
+#define GIF_FRAME_LOCAL_PALETTE 2 // the frame has its own palette
+#define GIF_FRAME_KEY 4           // covers the canvas without transparency, decodes without the frames before it
+#define GIF_INDEX_MAGIC 0x58444947 // "GIDX"
+
+typedef struct gif_frame_tag
+{
+    int32_t iOffset; // file offset of the blocks of this frame (extensions, image descriptor)
+    uint16_t iX, iY, iWidth, iHeight; // frame rectangle on the canvas
+    uint16_t iDelay; // delay in milliseconds, as playFrame() reports it
+    uint8_t ucDisposal; // disposal method of the graphic control extension
+    uint8_t ucFlags; // GIF_FRAME_xxx
+} GIFFRAME;
+
+typedef struct gif_index_header_tag
+{
+    uint32_t u32Magic; // GIF_INDEX_MAGIC
+    int32_t iFileSize; // size of the GIF the index was built for
+    int32_t iFrameCount; // GIFFRAME entries that follow
+} GIFINDEXHEADER;
+
+//
+// A converted local palette and the hash of the color table it came from
+//
+typedef struct gif_palette_tag
+{
+    uint32_t u32Hash; // hash of the RGB888 table in the file
+    uint16_t usColors; // entries in the table, 0 = unused
+    unsigned short *pPalette;
+} GIFPALETTE;
+
+// Colour transform applied to each palette entry as it is converted to RGB565:
+// the RGB888 color is multiplied by the matrix, offset, and then every channel
+// is mapped through the curve (e.g. brightness and gamma)
+typedef struct gif_color_xform_tag
+{
+    int16_t matrix[9]; // rows for R, G and B, 256 = 1.0
+    int16_t offset[3]; // added to R, G and B after the matrix
+    uint8_t curve[256];
+} GIFCOLORXFORM;
+
 typedef struct gif_draw_tag
 {
     int iX, iY; // Corner offset of this frame on the canvas
@@ -150,16 +254,26 @@ typedef struct gif_draw_tag
     uint8_t ucDisposalMethod; // frame disposal method
     uint8_t ucBackground; // background color
     uint8_t ucIsGlobalPalette; // Flag to indicate that a global palette, rather than a local palette is being used
+    int iDirtyX, iDirtyWidth; // span of this line that differs from the previous frame (COOKED + delta mode only)
+    int iLines; // lines in pPixels, starting at line y; more than 1 only for strips, see setStripBuffer()
+    int iPitch; // pixels from one line of pPixels to the next
 } GIFDRAW;
 
 // Callback function prototypes
 typedef int32_t (GIF_READ_CALLBACK)(GIFFILE *pFile, uint8_t *pBuf, int32_t iLen);
 typedef int32_t (GIF_SEEK_CALLBACK)(GIFFILE *pFile, int32_t iPosition);
+// Lends the bytes at file position iPos in the source's own buffer: sets *ppData and returns how
+// many follow there, 0 at the end or on an error. The position doesn't move, and the pointer only
+// has to stay valid until the next call
+typedef int32_t (GIF_BORROW_CALLBACK)(GIFFILE *pFile, int32_t iPos, const uint8_t **ppData);
 typedef void (GIF_DRAW_CALLBACK)(GIFDRAW *pDraw);
 typedef void * (GIF_OPEN_CALLBACK)(const char *szFilename, int32_t *pFileSize);
 typedef void (GIF_CLOSE_CALLBACK)(void *pHandle);
 typedef void * (GIF_ALLOC_CALLBACK)(uint32_t iSize);
+typedef void * (GIF_ALLOC_CAPS_CALLBACK)(uint32_t iSize, int iMemHint);
 typedef void (GIF_FREE_CALLBACK)(void *buffer);
+// Writes a decoded line of a frame into the canvas and as output pixels, see GIFSelectCook()
+typedef void (GIF_COOK_LINE)(uint8_t *pDest, uint8_t *pCanvas, const uint8_t *pSrc, const void *pPalette, int iCount, uint8_t ucTransparent, uint8_t ucBackground);
 //
 // our private structure to hold a GIF image decode state
 //
@@ -172,68 +286,156 @@ typedef struct gif_image_tag
     uint16_t iFrameDelay; // delay in milliseconds for this frame
     int16_t iRepeatCount; // NETSCAPE animation repeat count. 0=forever
     uint16_t iXCount, iYCount; // decoding position in image (countdown values)
-    int iLZWOff; // current LZW data offset
-    int iLZWSize; // current quantity of data in the LZW buffer
+    int iLZWOff; // read position in the LZW ring
+    int iLZWSize; // write position in the LZW ring
     int iCommentPos; // file offset of start of comment data
     short sCommentLen; // length of comment
     unsigned char bEndOfFrame;
     unsigned char ucGIFBits, ucBackground, ucTransparent, ucCodeStart, ucMap, bUseLocalPalette;
     unsigned char ucPaletteType; // RGB565 or RGB888
     unsigned char ucDrawType; // RAW or COOKED
+    unsigned char ucDeltaMode; // report changed spans of COOKED lines in iDirtyX/iDirtyWidth
+    unsigned char ucScale; // output is 1/(1<<ucScale) of the canvas size, see setScale()
+    unsigned char bDeltaFull; // next frame must be reported in full (new file or palette change)
+    unsigned char bDeltaFrameFull, bDeltaLastLocal; // state of the current/previous frame
+    unsigned char bSkipDraw; // decode into the frame buffer only, see setSkipDraw()
+    unsigned char ucPrevDisposal; // disposal method of the previous frame, applied by the next one
+    unsigned char bDisposed; // it was disposed of outside this frame's rectangle
+    unsigned char bSaved; // pDisposeBuffer holds the canvas under the previous frame (method 3)
+    const GIFCOLORXFORM *pColorXform; // setColorTransform(), owned by the caller
+    uint16_t iPrevX, iPrevY, iPrevWidth, iPrevHeight; // rectangle of the previous frame
+    GIFFRAME *pFrameIndex; // optional frame index, owned by the caller
+    int iIndexMax, iIndexCount; // entries available / filled in pFrameIndex
+    int iFrame; // number of the frame playFrame() decodes next
+    int32_t iFirstFrame; // file offset after the header and global palette, see rewind()
+    uint32_t u32LocalHash; // hash of the color table converted into pLocalPalette
+    uint16_t usLocalColors; // entries of that table, 0 = nothing converted yet
+    unsigned char bLocalChanged; // this frame's local palette differs from the last one
+    int iPaletteNext; // palette cache entry replaced next
     GIF_READ_CALLBACK *pfnRead;
     GIF_SEEK_CALLBACK *pfnSeek;
+    GIF_BORROW_CALLBACK *pfnBorrow; // LZW data is de-chunked from the source's buffer, NULL reads it
     GIF_DRAW_CALLBACK *pfnDraw;
+    GIF_COOK_LINE *pfnCook; // line writer of the current frame for COOKED output
     GIF_OPEN_CALLBACK *pfnOpen;
     GIF_CLOSE_CALLBACK *pfnClose;
     GIFFILE GIFFile;
     void *pUser;
     unsigned char *pFrameBuffer;
     unsigned char *pTurboBuffer;
+    unsigned char *pTurboTables; // GIF_TURBO_TABLE_BYTES apart from pTurboBuffer (optional)
+    unsigned char *pTurboWindow; // setTurboWindow(): Turbo tables and a ring of recent lines
+    int iTurboWindowSize; // bytes at pTurboWindow
     unsigned char *pPixels, *pOldPixels;
-    unsigned char ucFileBuf[FILE_BUF_SIZE]; // holds temp data and pixel stack
-    unsigned short pPalette[(MAX_COLORS * 3)/2]; // can hold RGB565 or RGB888 - set in begin()
-    unsigned short pLocalPalette[(MAX_COLORS * 3)/2]; // color palettes for GIF images
-    unsigned char ucLZW[LZW_BUF_SIZE]; // holds de-chunked LZW data
-    // These next 3 are used in Turbo mode to have a larger ucLZW buffer
-    unsigned short usGIFTable[1<<MAX_CODE_SIZE];
-    unsigned char ucGIFPixels[(PIXEL_LAST*2)];
-    unsigned char ucLineBuf[MAX_WIDTH]; // current line
+    int iMaxWidth, iMaxColors; // limits the buffers below were sized for
+    unsigned char *ucFileBuf; // holds temp data and pixel stack
+    unsigned short *pPalette; // can hold RGB565 or RGB888 - set in begin()
+    unsigned short *pLocalPalette; // color palettes for GIF images
+#if GIF_PALETTE_CACHE
+    GIFPALETTE palCache[GIF_PALETTE_CACHE]; // recently converted local palettes
+#endif
+    unsigned char *ucLZW; // holds de-chunked LZW data
+    // These next 3 follow ucLZW and are used in Turbo mode to have a larger ucLZW buffer
+    unsigned short *usGIFTable; // 1<<MAX_CODE_SIZE entries
+    unsigned char *ucGIFPixels; // PIXEL_LAST*2 entries
+    unsigned char *ucLineBuf; // current line
+    unsigned char *ucDeltaLine; // canvas pixels of the current line before merging (delta mode)
+    uint8_t *pStrip; // setStripBuffer(): COOKED RGB565 lines are collected here
+    int iStripPixels, iStripMaxLines; // size of pStrip, most lines handed over at once
+    int iStripLines; // lines collected in pStrip so far
+    uint8_t *pDisposeBuffer; // setDisposeBuffer(): canvas under a frame with disposal method 3
+    int iDisposeSize; // bytes in pDisposeBuffer
+    GIFDRAW gdStrip; // first of those lines, with the union of their dirty spans
+    // Storage of the buffers above for MAX_WIDTH and MAX_COLORS; AnimatedGIFT only
+    // reserves the part its own limits need, so this must stay the last member
+    uint32_t u32Buffers[(GIF_BUFFER_BYTES(MAX_WIDTH, MAX_COLORS) + 3) / 4];
 } GIFIMAGE;
+#define GIF_IMAGE_BYTES(w, c) (offsetof(GIFIMAGE, u32Buffers) + GIF_BUFFER_BYTES(w, c))
 
 #ifdef __cplusplus
 //
 // The GIF class wraps portable C code which does the actual work
+// The decoder state is sized by AnimatedGIFT below, AnimatedGIF is the
+// default with MAX_WIDTH and MAX_COLORS
 //
-class AnimatedGIF
+class AnimatedGIFDecoder
 {
   public:
+    AnimatedGIFDecoder(const AnimatedGIFDecoder &) = delete;
+    AnimatedGIFDecoder &operator=(const AnimatedGIFDecoder &) = delete;
     int open(uint8_t *pData, int iDataSize, GIF_DRAW_CALLBACK *pfnDraw);
     int openFLASH(uint8_t *pData, int iDataSize, GIF_DRAW_CALLBACK *pfnDraw);
-    int open(const char *szFilename, GIF_OPEN_CALLBACK *pfnOpen, GIF_CLOSE_CALLBACK *pfnClose, GIF_READ_CALLBACK *pfnRead, GIF_SEEK_CALLBACK *pfnSeek, GIF_DRAW_CALLBACK *pfnDraw);
+    int open(const char *szFilename, GIF_OPEN_CALLBACK *pfnOpen, GIF_CLOSE_CALLBACK *pfnClose, GIF_READ_CALLBACK *pfnRead, GIF_SEEK_CALLBACK *pfnSeek, GIF_DRAW_CALLBACK *pfnDraw, GIF_BORROW_CALLBACK *pfnBorrow = NULL);
     void close();
     void reset();
+    void rewind();
     void begin(uint8_t ucPaletteType = GIF_PALETTE_RGB565_LE);
     void begin(int iEndian, uint8_t ucPaletteType) { begin(ucPaletteType); };
     int playFrame(bool bSync, int *delayMilliseconds, void *pUser = NULL);
     int getCanvasWidth();
     int allocTurboBuf(GIF_ALLOC_CALLBACK *pfnAlloc);
     int allocFrameBuf(GIF_ALLOC_CALLBACK *pfnAlloc);
+    int allocTurboBuf(GIF_ALLOC_CAPS_CALLBACK *pfnAlloc);
+    int allocFrameBuf(GIF_ALLOC_CAPS_CALLBACK *pfnAlloc);
+    int allocBuffers(GIF_ALLOC_CAPS_CALLBACK *pfnAlloc);
+    int freeBuffers(GIF_FREE_CALLBACK *pfnFree);
+    int setWorkspace(void *pWorkspace, int iSize, void *pPalettes);
     void setTurboBuf(void *pTurboBuffer);
+    void setTurboTables(void *pTables);
+    void setTurboWindow(void *pBuf, int iSize);
     void setFrameBuf(void *pFrameBuffer);
     int setDrawType(int iType);
+    void setDeltaMode(int bDelta);
+    void setSkipDraw(int bSkip);
+    void setStripBuffer(void *pStrip, int iPixels, int iMaxLines);
+    void setDisposeBuffer(void *pBuffer, int iSize);
+    void setColorTransform(const GIFCOLORXFORM *pXform);
+    int setScale(int iShift);
     int freeFrameBuf(GIF_FREE_CALLBACK *pfnFree);
     int freeTurboBuf(GIF_FREE_CALLBACK *pfnFree);
     uint8_t *getFrameBuf();
+    uint16_t *getFramePalette();
     uint8_t *getTurboBuf();
     int getCanvasHeight();
     int getLoopCount();
     int getInfo(GIFINFO *pInfo);
     int getLastError();
     int getComment(char *destBuffer);
+    void setFrameIndex(GIFFRAME *pFrames, int iMaxFrames, int iCount = 0);
+    int getIndexedFrames();
+    int seekFrame(int iFrame);
+    int skipFrame(int *delayMilliseconds = NULL);
+    int getFrame();
+
+  protected:
+    AnimatedGIFDecoder(void *pImage, int iMaxWidth, int iMaxColors, bool bStorage);
 
   private:
-    GIFIMAGE _gif;
+    void bindBuffers();
+    GIFIMAGE &_gif; // GIF_IMAGE_BYTES(_iMaxWidth, _iMaxColors) of storage, or just the state
+    int _iMaxWidth, _iMaxColors;
+    bool _bStorage; // _gif has its own buffers
+    uint8_t *_pHot, *_pLine; // buffers from allocBuffers()
+    uint8_t *_pWorkspace, *_pPalettes; // buffers from setWorkspace()
 };
+//
+// Decoder for images up to iMaxWidth pixels wide with up to iMaxColors
+// palette entries; larger ones fail to open (GIF_TOO_WIDE) or to
+// decode (GIF_UNSUPPORTED_FEATURE). With bExternal the object only holds
+// the decoder state and allocBuffers() must provide the buffers
+//
+template <int iMaxWidth, int iMaxColors = MAX_COLORS, bool bExternal = false>
+class AnimatedGIFT : public AnimatedGIFDecoder
+{
+    static_assert(iMaxWidth > 0 && iMaxColors >= 2 && iMaxColors <= MAX_COLORS, "invalid decoder limits");
+  public:
+    AnimatedGIFT() : AnimatedGIFDecoder(_u32Image, iMaxWidth, iMaxColors, !bExternal) {}
+
+  private:
+    uint32_t _u32Image[((bExternal ? offsetof(GIFIMAGE, u32Buffers) : GIF_IMAGE_BYTES(iMaxWidth, iMaxColors)) + 3) / 4];
+};
+
+class AnimatedGIF : public AnimatedGIFT<MAX_WIDTH, MAX_COLORS> {};
 #else
 // C interface
     int GIF_openRAM(GIFIMAGE *pGIF, uint8_t *pData, int iDataSize, GIF_DRAW_CALLBACK *pfnDraw);
@@ -241,15 +443,26 @@ class AnimatedGIF
     void GIF_close(GIFIMAGE *pGIF);
     void GIF_begin(GIFIMAGE *pGIF, unsigned char ucPaletteType);
     void GIF_reset(GIFIMAGE *pGIF);
+    void GIF_rewind(GIFIMAGE *pGIF);
     int GIF_playFrame(GIFIMAGE *pGIF, int *delayMilliseconds, void *pUser);
     int GIF_getCanvasWidth(GIFIMAGE *pGIF);
     int GIF_getCanvasHeight(GIFIMAGE *pGIF);
+    int GIF_setScale(GIFIMAGE *pGIF, int iShift);
     int GIF_getComment(GIFIMAGE *pGIF, char *destBuffer);
     int GIF_getInfo(GIFIMAGE *pGIF, GIFINFO *pInfo);
     int GIF_getLastError(GIFIMAGE *pGIF);
     int GIF_getLoopCount(GIFIMAGE *pGIF);
+    void GIF_setFrameIndex(GIFIMAGE *pGIF, GIFFRAME *pFrames, int iMaxFrames, int iCount);
+    int GIF_seekFrame(GIFIMAGE *pGIF, int iFrame);
+    int GIF_skipFrame(GIFIMAGE *pGIF, int *delayMilliseconds);
 #endif // __cplusplus
 
+// Line kernels shared by DrawCooked() and RAW draw callbacks
+// pPalette holds RGB565 entries in the output byte order
+void GIF_expandLine565(uint16_t *pDest, const uint8_t *pSrc, const uint16_t *pPalette, int iCount);
+void GIF_mergeLine565(uint16_t *pDest, uint8_t *pCanvas, const uint8_t *pSrc, const uint16_t *pPalette, int iCount, uint8_t ucTransparent, int iBackground);
+void GIF_blendLine565(uint16_t *pDest, const uint8_t *pSrc, const uint16_t *pPalette, int iCount, uint8_t ucTransparent, int *pLeft, int *pRight);
+
 #if (INTPTR_MAX == INT64_MAX)
 #define ALLOWS_UNALIGNED
 #define INTELSHORT(p) (*(uint16_t *)p)
@@ -25,18 +25,44 @@
 #pragma GCC optimize("O2")
 #endif
 
-static const unsigned char cGIFBits[9] = {1,4,4,4,8,8,8,8,8}; // convert odd bpp values to ones we can handle
+static const unsigned char GIF_DRAM cGIFBits[9] = {1,4,4,4,8,8,8,8,8}; // convert odd bpp values to ones we can handle
+// canvas coordinate or size in the scaled output, rounded up like the kept pixels
+#define GIF_SCALED(pGIF, i) (((i) + (1 << (pGIF)->ucScale) - 1) >> (pGIF)->ucScale)
 
 // forward references
 static int GIFInit(GIFIMAGE *pGIF);
 static int GIFParseInfo(GIFIMAGE *pPage, int bInfoOnly);
+static uint32_t GIFHashPalette(const uint8_t *p, int iLen);
+static int GIFCachedPalette(GIFIMAGE *pPage, uint32_t u32Hash, int iColors);
+static void GIFCachePalette(GIFIMAGE *pPage, uint32_t u32Hash, int iColors);
+static void GIFConvertPalette(GIFIMAGE *pPage, const uint8_t *pRGB, uint16_t *pDest, int iColors);
+static void GIFIndexFrame(GIFIMAGE *pGIF, int32_t iFrameStart);
+static void GIFRewind(GIFIMAGE *pGIF);
+static int GIFScaleLine(GIFIMAGE *pPage, GIFDRAW *pDraw);
+static int GIFStripLine(GIFIMAGE *pPage, GIFDRAW *pDraw, int bMerged);
+static void GIFFlushStrip(GIFIMAGE *pPage);
+static int GIFCookedCanvas(GIFIMAGE *pPage);
+static int GIFDeferLines(GIFIMAGE *pPage);
+static void GIFDispose(GIFIMAGE *pPage);
+static int GIFSkipDraw(GIFIMAGE *pPage);
+static void GIFDrawDeferred(GIFIMAGE *pPage);
+static void GIFEndFrame(GIFIMAGE *pPage);
+static void GIFBindBuffers(GIFIMAGE *pGIF, int iMaxWidth, int iMaxColors);
+static void GIFSetBuffers(GIFIMAGE *pGIF, uint8_t *pLine, uint8_t *pPalettes, uint8_t *pLZW, int iMaxWidth, int iMaxColors);
 static int GIFGetMoreData(GIFIMAGE *pPage);
-static void GIFMakePels(GIFIMAGE *pPage, unsigned int code);
+static void GIFPutLZW(GIFIMAGE *pPage, const uint8_t *pSrc, int iLen);
+static void GIFMakePels(GIFIMAGE *pPage, unsigned int code, unsigned int oldcode, int bPacked);
 static int DecodeLZW(GIFIMAGE *pImage, int iOptions);
 static int DecodeLZWTurbo(GIFIMAGE *pImage, int iOptions);
+static int DecodeLZWWindow(GIFIMAGE *pImage, int iOptions);
 static int32_t readMem(GIFFILE *pFile, uint8_t *pBuf, int32_t iLen);
 static int32_t seekMem(GIFFILE *pFile, int32_t iPosition);
+static int32_t borrowMem(GIFFILE *pFile, int32_t iPos, const uint8_t **ppData);
 int GIF_getInfo(GIFIMAGE *pPage, GIFINFO *pInfo);
+void GIF_setFrameIndex(GIFIMAGE *pGIF, GIFFRAME *pFrames, int iMaxFrames, int iCount);
+int GIF_seekFrame(GIFIMAGE *pGIF, int iFrame);
+int GIF_skipFrame(GIFIMAGE *pGIF, int *delayMilliseconds);
+int GIF_setScale(GIFIMAGE *pGIF, int iShift);
 #if defined( PICO_BUILD ) || defined( __LINUX__ ) || defined( __MCUXPRESSO )
 static int32_t readFile(GIFFILE *pFile, uint8_t *pBuf, int32_t iLen);
 static int32_t seekFile(GIFFILE *pFile, int32_t iPosition);
@@ -48,6 +74,7 @@ int GIF_openRAM(GIFIMAGE *pGIF, uint8_t *pData, int iDataSize, GIF_DRAW_CALLBACK
     pGIF->iError = GIF_SUCCESS;
     pGIF->pfnRead = readMem;
     pGIF->pfnSeek = seekMem;
+    pGIF->pfnBorrow = borrowMem;
     pGIF->pfnDraw = pfnDraw;
     pGIF->pfnOpen = NULL;
     pGIF->pfnClose = NULL;
@@ -62,6 +89,7 @@ int GIF_openFile(GIFIMAGE *pGIF, const char *szFilename, GIF_DRAW_CALLBACK *pfnD
     pGIF->iError = GIF_SUCCESS;
     pGIF->pfnRead = readFile;
     pGIF->pfnSeek = seekFile;
+    pGIF->pfnBorrow = NULL;
     pGIF->pfnDraw = pfnDraw;
     pGIF->pfnOpen = NULL;
     pGIF->pfnClose = closeFile;
@@ -84,14 +112,22 @@ void GIF_close(GIFIMAGE *pGIF)
 void GIF_begin(GIFIMAGE *pGIF, unsigned char ucPaletteType)
 {
     memset(pGIF, 0, sizeof(GIFIMAGE));
+    GIFBindBuffers(pGIF, MAX_WIDTH, MAX_COLORS);
     pGIF->ucPaletteType = ucPaletteType;
 } /* GIF_begin() */
 
 void GIF_reset(GIFIMAGE *pGIF)
 {
     (*pGIF->pfnSeek)(&pGIF->GIFFile, 0);
+    pGIF->iFrame = 0;
 } /* GIF_reset() */
 
+void GIF_rewind(GIFIMAGE *pGIF)
+{
+    pGIF->iError = GIF_SUCCESS;
+    GIFRewind(pGIF);
+} /* GIF_rewind() */
+
 //
 // Return value:
 // 1 = good decode, more frames exist
@@ -101,25 +137,31 @@ void GIF_reset(GIFIMAGE *pGIF)
 int GIF_playFrame(GIFIMAGE *pGIF, int *delayMilliseconds, void *pUser)
 {
 int rc;
+int32_t iFrameStart;
 
     if (delayMilliseconds)
        *delayMilliseconds = 0; // clear any old valid
     if (pGIF->GIFFile.iPos >= pGIF->GIFFile.iSize-1) // no more data exists
     {   
-        (*pGIF->pfnSeek)(&pGIF->GIFFile, 0); // seek to start
+        GIFRewind(pGIF); // back to the first frame
     }
+    iFrameStart = pGIF->GIFFile.iPos;
     if (GIFParseInfo(pGIF, 0))
     {
         pGIF->pUser = pUser;
         if (pGIF->iError == GIF_EMPTY_FRAME) // don't try to decode it
             return 0;
+        GIFIndexFrame(pGIF, iFrameStart);
         if (pGIF->pTurboBuffer) { // the presence of the Turbo buffer indicates Turbo mode
             rc = DecodeLZWTurbo(pGIF, 0);
+        } else if (pGIF->pTurboWindow) {
+            rc = DecodeLZWWindow(pGIF, 0);
         } else {
             rc = DecodeLZW(pGIF, 0);
         }
         if (rc != 0) // problem
             return 0;
+        pGIF->iFrame++;
     }
     else
     {
@@ -133,12 +175,12 @@ int rc;
 
 int GIF_getCanvasWidth(GIFIMAGE *pGIF)
 {
-    return pGIF->iCanvasWidth;
+    return GIF_SCALED(pGIF, pGIF->iCanvasWidth);
 } /* GIF_getCanvasWidth() */
 
 int GIF_getCanvasHeight(GIFIMAGE *pGIF)
 {
-    return pGIF->iCanvasHeight;
+    return GIF_SCALED(pGIF, pGIF->iCanvasHeight);
 } /* GIF_getCanvasHeight() */
 
 int GIF_getLoopCount(GIFIMAGE *pGIF)
@@ -182,6 +224,14 @@ static int32_t readMem(GIFFILE *pFile, uint8_t *pBuf, int32_t iLen)
     return iBytesRead;
 } /* readMem() */
 
+static int32_t borrowMem(GIFFILE *pFile, int32_t iPos, const uint8_t **ppData)
+{
+    if (iPos < 0 || iPos >= pFile->iSize)
+       return 0;
+    *ppData = &pFile->pData[iPos];
+    return pFile->iSize - iPos;
+} /* borrowMem() */
+
 #ifndef __LINUX__
 static int32_t readFLASH(GIFFILE *pFile, uint8_t *pBuf, int32_t iLen)
 {
@@ -248,16 +298,139 @@ static int32_t readFile(GIFFILE *pFile, uint8_t *pBuf, int32_t iLen)
 static int GIFInit(GIFIMAGE *pGIF)
 {
     pGIF->GIFFile.iPos = 0; // start at beginning of file
+    pGIF->iFrame = 0;
+    pGIF->bDeltaFull = 1; // first frame of a new file is always reported in full
+    if (pGIF->ucFileBuf == NULL) { // see allocBuffers()
+        pGIF->iError = GIF_ERROR_MEMORY;
+        return 0;
+    }
     if (!GIFParseInfo(pGIF, 1)) // gather info for the first frame
        return 0; // something went wrong; not a GIF file?
     (*pGIF->pfnSeek)(&pGIF->GIFFile, 0); // seek back to start of the file
-    if (pGIF->iCanvasWidth > MAX_WIDTH) { // need to allocate more space
+    if (pGIF->iCanvasWidth > pGIF->iMaxWidth) { // need to allocate more space
         pGIF->iError = GIF_TOO_WIDE;
         return 0;
     }
   return 1;
 } /* GIFInit() */
 
+//
+// Point the buffers of a decoder at its u32Buffers storage, which holds
+// GIF_BUFFER_BYTES(iMaxWidth, iMaxColors)
+//
+static void GIFBindBuffers(GIFIMAGE *pGIF, int iMaxWidth, int iMaxColors)
+{
+    uint8_t *p = (uint8_t *)pGIF->u32Buffers;
+    GIFSetBuffers(pGIF, p, p + FILE_BUF_SIZE, p + FILE_BUF_SIZE + GIF_PALETTE_SET_BYTES(iMaxColors), iMaxWidth, iMaxColors);
+} /* GIFBindBuffers() */
+//
+// Point the buffers of a decoder at FILE_BUF_SIZE bytes at pLine,
+// GIF_PALETTE_SET_BYTES(iMaxColors) at pPalettes and the rest of
+// GIF_HOT_BYTES(iMaxWidth, iMaxColors) at pLZW (all 32-bit aligned);
+// ucLZW, usGIFTable, ucGIFPixels and ucLineBuf are one block for the
+// Turbo mode LZW data. NULL pointers leave the decoder without buffers
+//
+static void GIFSetBuffers(GIFIMAGE *pGIF, uint8_t *pLine, uint8_t *pPalettes, uint8_t *pLZW, int iMaxWidth, int iMaxColors)
+{
+    uint8_t *p = pPalettes;
+    int i, iPalette = GIF_PALETTE_BYTES(iMaxColors);
+
+    pGIF->iMaxWidth = iMaxWidth;
+    pGIF->iMaxColors = iMaxColors;
+    pGIF->ucFileBuf = pLine;
+    if (p == NULL || pLZW == NULL || pLine == NULL) {
+        pGIF->ucFileBuf = NULL; // GIFInit() fails with GIF_ERROR_MEMORY
+        return;
+    }
+    pGIF->pPalette = (unsigned short *)p; p += iPalette;
+    pGIF->pLocalPalette = (unsigned short *)p; p += iPalette;
+    for (i=0; i<GIF_PALETTE_CACHE; i++) {
+        pGIF->palCache[i].pPalette = (unsigned short *)p; p += iPalette;
+    }
+    p = pLZW;
+    pGIF->ucLZW = p; p += LZW_BUF_SIZE;
+    pGIF->usGIFTable = (unsigned short *)p; p += (2<<MAX_CODE_SIZE);
+    pGIF->ucGIFPixels = p; p += GIF_PIXEL_TABLE_BYTES(iMaxColors);
+    pGIF->ucLineBuf = p; p += iMaxWidth;
+    pGIF->ucDeltaLine = p;
+} /* GIFSetBuffers() */
+//
+// FNV-1a hash of a color table, identifies local palettes which
+// were already converted
+//
+static uint32_t GIFHashPalette(const uint8_t *p, int iLen)
+{
+    uint32_t u32 = 0x811c9dc5;
+    while (iLen--) {
+        u32 ^= *p++;
+        u32 *= 0x01000193;
+    }
+    return u32;
+} /* GIFHashPalette() */
+//
+// Copy a previously converted local palette into pLocalPalette
+// Returns 1 if the palette cache held it, 0 if it must be converted
+//
+static int GIFCachedPalette(GIFIMAGE *pPage, uint32_t u32Hash, int iColors)
+{
+#if GIF_PALETTE_CACHE
+    int i;
+    for (i=0; i<GIF_PALETTE_CACHE; i++) {
+        GIFPALETTE *pPal = &pPage->palCache[i];
+        if (pPal->usColors == iColors && pPal->u32Hash == u32Hash) {
+            memcpy(pPage->pLocalPalette, pPal->pPalette, iColors * 3); // 3 bytes covers every palette type
+            return 1;
+        }
+    }
+#else
+    (void)pPage; (void)u32Hash; (void)iColors;
+#endif
+    return 0;
+} /* GIFCachedPalette() */
+//
+// Keep a copy of the local palette just converted, replacing the oldest entry
+//
+static void GIFCachePalette(GIFIMAGE *pPage, uint32_t u32Hash, int iColors)
+{
+#if GIF_PALETTE_CACHE
+    GIFPALETTE *pPal = &pPage->palCache[pPage->iPaletteNext];
+    pPal->u32Hash = u32Hash;
+    pPal->usColors = (uint16_t)iColors;
+    memcpy(pPal->pPalette, pPage->pLocalPalette, iColors * 3);
+    pPage->iPaletteNext = (pPage->iPaletteNext + 1) % GIF_PALETTE_CACHE;
+#else
+    (void)pPage; (void)u32Hash; (void)iColors;
+#endif
+} /* GIFCachePalette() */
+
+//
+// Convert an RGB888 color table to RGB565 in the output byte order, through
+// the color transform if there is one (see setColorTransform())
+//
+static void GIFConvertPalette(GIFIMAGE *pPage, const uint8_t *pRGB, uint16_t *pDest, int iColors)
+{
+    const GIFCOLORXFORM *pX = pPage->pColorXform;
+    int i, c, r, g, b;
+    for (i=0; i<iColors; i++, pRGB += 3) {
+        uint16_t usRGB565;
+        r = pRGB[0]; g = pRGB[1]; b = pRGB[2];
+        if (pX) {
+            int rgb[3];
+            for (c=0; c<3; c++) {
+                int v = ((pX->matrix[c*3] * r + pX->matrix[c*3+1] * g + pX->matrix[c*3+2] * b) >> 8) + pX->offset[c];
+                rgb[c] = pX->curve[v < 0 ? 0 : (v > 255 ? 255 : v)];
+            }
+            r = rgb[0]; g = rgb[1]; b = rgb[2];
+        }
+        usRGB565 = ((r >> 3) << 11); // R
+        usRGB565 |= ((g >> 2) << 5); // G
+        usRGB565 |= (b >> 3); // B
+        if (pPage->ucPaletteType != GIF_PALETTE_RGB565_BE) // LE, also for the sprites of 4-bit output
+            pDest[i] = usRGB565;
+        else
+            pDest[i] = __builtin_bswap16(usRGB565); // SPI wants MSB first
+    }
+} /* GIFConvertPalette() */
 //
 // Parse the GIF header, gather the size and palette info
 // If called with bInfoOnly set to true, it will test for a valid file
@@ -268,6 +441,7 @@ static int GIFParseInfo(GIFIMAGE *pPage, int bInfoOnly)
 {
     int i, j, iColorTableBits;
     int iBytesRead;
+    uint32_t u32Hash;
     unsigned char c, *p;
     int32_t iOffset = 0;
     int32_t iStartPos = pPage->GIFFile.iPos; // starting file position
@@ -305,20 +479,16 @@ static int GIFParseInfo(GIFIMAGE *pPage, int bInfoOnly)
         iOffset = 13;
         if (p[10] & 0x80) // global color table?
         { // by default, convert to byte-reversed RGB565 for immediate use
+            if ((1<<iColorTableBits) > pPage->iMaxColors) {
+                pPage->iError = GIF_UNSUPPORTED_FEATURE;
+                return 0;
+            }
             // Read enough additional data for the color table
             iBytesRead += (*pPage->pfnRead)(&pPage->GIFFile, &pPage->ucFileBuf[iBytesRead], 3*(1<<iColorTableBits));
-            if (pPage->ucPaletteType == GIF_PALETTE_RGB565_LE || pPage->ucPaletteType == GIF_PALETTE_RGB565_BE) {
-                for (i=0; i<(1<<iColorTableBits); i++) {
-                    uint16_t usRGB565;
-                    usRGB565 = ((p[iOffset] >> 3) << 11); // R
-                    usRGB565 |= ((p[iOffset+1] >> 2) << 5); // G
-                    usRGB565 |= (p[iOffset+2] >> 3); // B
-                    if (pPage->ucPaletteType == GIF_PALETTE_RGB565_LE)
-                        pPage->pPalette[i] = usRGB565;
-                    else
-                        pPage->pPalette[i] = __builtin_bswap16(usRGB565); // SPI wants MSB first
-                    iOffset += 3;
-                }
+            if (pPage->ucPaletteType == GIF_PALETTE_RGB565_LE || pPage->ucPaletteType == GIF_PALETTE_RGB565_BE ||
+                pPage->ucPaletteType == GIF_PALETTE_4BPP) {
+                GIFConvertPalette(pPage, &p[iOffset], pPage->pPalette, 1<<iColorTableBits);
+                iOffset += 3*(1<<iColorTableBits);
             } else if (pPage->ucPaletteType == GIF_PALETTE_1BPP || pPage->ucPaletteType == GIF_PALETTE_1BPP_OLED) {
                 uint8_t *pPal1 = (uint8_t*)pPage->pPalette;
                 for (i=0; i<(1<<iColorTableBits); i++) {
@@ -334,6 +504,7 @@ static int GIFParseInfo(GIFIMAGE *pPage, int bInfoOnly)
                 iOffset += (1 << iColorTableBits) * 3;
             }
         }
+        pPage->iFirstFrame = iOffset; // where a rewind starts, the header and palette are kept
     }
     while (p[iOffset] != ',' && p[iOffset] != ';') /* Wait for image separator */
     {
@@ -461,36 +632,43 @@ static int GIFParseInfo(GIFIMAGE *pPage, int bInfoOnly)
     if (pPage->ucMap & 0x80) // local color table?
     {// by default, convert to byte-reversed RGB565 for immediate use
         j = (1<<((pPage->ucMap & 7)+1));
+        if (j > pPage->iMaxColors) {
+            pPage->iError = GIF_UNSUPPORTED_FEATURE;
+            return 0;
+        }
         // Read enough additional data for the color table
         iBytesRead += (*pPage->pfnRead)(&pPage->GIFFile, &pPage->ucFileBuf[iBytesRead], j*3);            
-        if (pPage->ucPaletteType == GIF_PALETTE_RGB565_LE || pPage->ucPaletteType == GIF_PALETTE_RGB565_BE)
+        u32Hash = GIFHashPalette(&p[iOffset], j*3);
+        pPage->bLocalChanged = (u32Hash != pPage->u32LocalHash || j != pPage->usLocalColors);
+        if (!pPage->bLocalChanged || GIFCachedPalette(pPage, u32Hash, j))
+        { // converted before, encoders often repeat the same table
+            iOffset += j*3;
+        }
+        else
         {
-            for (i=0; i<j; i++)
+            if (pPage->ucPaletteType == GIF_PALETTE_RGB565_LE || pPage->ucPaletteType == GIF_PALETTE_RGB565_BE ||
+                pPage->ucPaletteType == GIF_PALETTE_4BPP)
             {
-                uint16_t usRGB565;
-                usRGB565 = ((p[iOffset] >> 3) << 11); // R
-                usRGB565 |= ((p[iOffset+1] >> 2) << 5); // G
-                usRGB565 |= (p[iOffset+2] >> 3); // B
-                if (pPage->ucPaletteType == GIF_PALETTE_RGB565_LE)
-                    pPage->pLocalPalette[i] = usRGB565;
-                else
-                    pPage->pLocalPalette[i] = __builtin_bswap16(usRGB565); // SPI wants MSB first
-                iOffset += 3;
-            }
-        } else if (pPage->ucPaletteType == GIF_PALETTE_1BPP || pPage->ucPaletteType == GIF_PALETTE_1BPP_OLED) {
-            uint8_t *pPal1 = (uint8_t*)pPage->pLocalPalette;
-            for (i=0; i<j; i++) {
-                uint16_t usGray;
-                usGray = p[iOffset]; // R
-                usGray += p[iOffset+1]*2; // G is twice as important
-                usGray += p[iOffset+2]; // B
-                pPal1[i] = (usGray >= 512); // bright enough = 1
-                iOffset += 3;
+                GIFConvertPalette(pPage, &p[iOffset], pPage->pLocalPalette, j);
+                iOffset += j*3;
+            } else if (pPage->ucPaletteType == GIF_PALETTE_1BPP || pPage->ucPaletteType == GIF_PALETTE_1BPP_OLED) {
+                uint8_t *pPal1 = (uint8_t*)pPage->pLocalPalette;
+                for (i=0; i<j; i++) {
+                    uint16_t usGray;
+                    usGray = p[iOffset]; // R
+                    usGray += p[iOffset+1]*2; // G is twice as important
+                    usGray += p[iOffset+2]; // B
+                    pPal1[i] = (usGray >= 512); // bright enough = 1
+                    iOffset += 3;
+                }
+            } else { // just copy it as-is
+                memcpy(pPage->pLocalPalette, &p[iOffset], j * 3);
+                iOffset += j*3;
             }
-        } else { // just copy it as-is
-            memcpy(pPage->pLocalPalette, &p[iOffset], j * 3);
-            iOffset += j*3;
+            GIFCachePalette(pPage, u32Hash, j);
         }
+        pPage->u32LocalHash = u32Hash;
+        pPage->usLocalColors = (uint16_t)j;
         pPage->bUseLocalPalette = 1;
     }
     pPage->ucCodeStart = p[iOffset++]; /* initial code size */
@@ -507,18 +685,15 @@ static int GIFParseInfo(GIFIMAGE *pPage, int bInfoOnly)
 //     Serial.printf("Chunk size = %d\n", c);
      if (c <= (iBytesRead - iOffset))
      {
-       memcpy(&pPage->ucLZW[pPage->iLZWSize], &p[iOffset], c);
-       pPage->iLZWSize += c;
+       GIFPutLZW(pPage, &p[iOffset], c);
        iOffset += c;
      }
      else // partial chunk in our buffer
      {
        int iPartialLen = (iBytesRead - iOffset);
-       memcpy(&pPage->ucLZW[pPage->iLZWSize], &p[iOffset], iPartialLen);
-       pPage->iLZWSize += iPartialLen;
+       GIFPutLZW(pPage, &p[iOffset], iPartialLen);
        iOffset += iPartialLen;
-       (*pPage->pfnRead)(&pPage->GIFFile, &pPage->ucLZW[pPage->iLZWSize], c - iPartialLen);
-       pPage->iLZWSize += (c - iPartialLen);
+       GIFPutLZW(pPage, NULL, c - iPartialLen); // the rest from the file
      }
      if (c == 0)
         pPage->bEndOfFrame = 1; // signal not to read beyond the end of the frame
@@ -533,6 +708,101 @@ static int GIFParseInfo(GIFIMAGE *pPage, int bInfoOnly)
     return 1; // we are now at the start of the chunk data
 } /* GIFParseInfo() */
 //
+// Add the frame GIFParseInfo() has just read to the index, if it is the next one missing
+//
+static void GIFIndexFrame(GIFIMAGE *pGIF, int32_t iFrameStart)
+{
+    GIFFRAME *pFrame;
+
+    if (pGIF->iFrame != pGIF->iIndexCount || pGIF->iIndexCount >= pGIF->iIndexMax)
+        return;
+    pFrame = &pGIF->pFrameIndex[pGIF->iIndexCount++];
+    pFrame->iOffset = iFrameStart;
+    pFrame->iX = pGIF->iX;
+    pFrame->iY = pGIF->iY;
+    pFrame->iWidth = pGIF->iWidth;
+    pFrame->iHeight = pGIF->iHeight;
+    pFrame->iDelay = pGIF->iFrameDelay;
+    pFrame->ucDisposal = (pGIF->ucGIFBits >> 2) & 7;
+    pFrame->ucFlags = 0;
+    if (pGIF->ucGIFBits & 1)
+        pFrame->ucFlags |= GIF_FRAME_TRANSPARENT;
+    if (pGIF->bUseLocalPalette)
+        pFrame->ucFlags |= GIF_FRAME_LOCAL_PALETTE;
+    if (!(pGIF->ucGIFBits & 1) && pGIF->iX == 0 && pGIF->iY == 0 &&
+        pGIF->iWidth == pGIF->iCanvasWidth && pGIF->iHeight == pGIF->iCanvasHeight)
+        pFrame->ucFlags |= GIF_FRAME_KEY;
+} /* GIFIndexFrame() */
+//
+// Go back to the first frame without parsing the header and global palette again,
+// they are kept from the open (or from the start of the file if nothing was parsed yet)
+//
+static void GIFRewind(GIFIMAGE *pGIF)
+{
+    (*pGIF->pfnSeek)(&pGIF->GIFFile, pGIF->iFirstFrame);
+    pGIF->ucGIFBits = 0; // as after parsing the header
+    pGIF->iFrame = 0;
+} /* GIFRewind() */
+//
+// Attach storage for a frame index, iCount entries of it may already be
+// filled (e.g. loaded from a sidecar file of the same GIF)
+//
+void GIF_setFrameIndex(GIFIMAGE *pGIF, GIFFRAME *pFrames, int iMaxFrames, int iCount)
+{
+    pGIF->pFrameIndex = pFrames;
+    pGIF->iIndexMax = pFrames ? iMaxFrames : 0;
+    pGIF->iIndexCount = (iCount < pGIF->iIndexMax) ? iCount : pGIF->iIndexMax;
+} /* GIF_setFrameIndex() */
+
+//
+// Continue playback at an indexed frame
+// The canvas keeps what the last decoded frame left, so unless the frame is a
+// GIF_FRAME_KEY frame, seek to one and play forward from there
+// Returns 1 for success, 0 if the frame is not in the index
+//
+int GIF_setScale(GIFIMAGE *pGIF, int iShift)
+{
+    if (iShift < GIF_SCALE_FULL || iShift > GIF_SCALE_QUARTER)
+        return GIF_INVALID_PARAMETER;
+    pGIF->ucScale = (unsigned char)iShift;
+    pGIF->bDeltaFull = 1; // nothing on the display is in the new size yet
+    return GIF_SUCCESS;
+} /* GIF_setScale() */
+
+int GIF_seekFrame(GIFIMAGE *pGIF, int iFrame)
+{
+    if (iFrame < 0 || iFrame >= pGIF->iIndexCount)
+    {
+        pGIF->iError = GIF_INVALID_PARAMETER;
+        return 0;
+    }
+    (*pGIF->pfnSeek)(&pGIF->GIFFile, pGIF->pFrameIndex[iFrame].iOffset);
+    pGIF->iFrame = iFrame;
+    pGIF->bDeltaFull = 1; // the display no longer shows the frame before this one
+    pGIF->ucPrevDisposal = 0; // nor does the frame buffer
+    return 1;
+} /* GIF_seekFrame() */
+//
+// Step over the next frame without reading it when the index shows that the
+// frame after it is a GIF_FRAME_KEY frame: nothing the skipped frame draws
+// would be left on the canvas. The delay it would have had is returned.
+// Returns 1 if it was skipped, 0 if it has to be decoded (e.g. with setSkipDraw())
+//
+int GIF_skipFrame(GIFIMAGE *pGIF, int *delayMilliseconds)
+{
+    int iNext = pGIF->iFrame + 1;
+
+    if (iNext >= pGIF->iIndexCount || !(pGIF->pFrameIndex[iNext].ucFlags & GIF_FRAME_KEY))
+        return 0;
+    (*pGIF->pfnSeek)(&pGIF->GIFFile, pGIF->pFrameIndex[iNext].iOffset);
+    if (delayMilliseconds)
+        *delayMilliseconds = pGIF->pFrameIndex[pGIF->iFrame].iDelay;
+    pGIF->iFrame = iNext;
+    pGIF->bDeltaFull = 1; // the display still shows an older frame
+    pGIF->ucPrevDisposal = 0; // the key frame covers whatever it would dispose of
+    return 1;
+} /* GIF_skipFrame() */
+//
 // Gather info about an animated GIF file
 //
 int GIF_getInfo(GIFIMAGE *pPage, GIFINFO *pInfo)
@@ -546,6 +816,11 @@ int GIF_getInfo(GIFIMAGE *pPage, GIFINFO *pInfo)
     int bDone = 0;
     int bExt;
     uint8_t c, *cBuf;
+    int32_t iBufPos = 0; // file offset of cBuf[0]
+    int32_t iFrameStart = 0; // file offset of the blocks of the current frame
+    int iFrameDelay = 0; // as GIFParseInfo() reads it, for the frame index
+    uint8_t ucBits = 0;
+    int iIndexed = 0;
 
     iMaxDelay = iTotalDelay = 0;
     iMinDelay = 10000;
@@ -573,6 +848,7 @@ int GIF_getInfo(GIFIMAGE *pPage, GIFINFO *pInfo)
             {
                 memmove(cBuf, &cBuf[iOff], (iDataAvailable-iOff)); // move existing data down
                 iDataAvailable -= iOff;
+                iBufPos += iOff;
                 iOff = 0;
                 iReadAmount = (*pPage->pfnRead)(&pPage->GIFFile, &cBuf[iDataAvailable], FILE_BUF_SIZE-iDataAvailable);
                 iDataAvailable += iReadAmount;
@@ -595,6 +871,8 @@ int GIF_getInfo(GIFIMAGE *pPage, GIFINFO *pInfo)
                        //cBuf[iOff+3]; // page disposition flags
                         iDelay = cBuf[iOff+4]; // delay low byte
                         iDelay |= ((uint16_t)(cBuf[iOff+5]) << 8); // delay high byte
+                        ucBits = cBuf[iOff+3];
+                        iFrameDelay = (iDelay <= 0) ? 100 : iDelay * 10; // playFrame() timing, not the one below
                         if (iDelay < 2) // too fast, provide a default
                             iDelay = 2;
                         iDelay *= 10; // turn JIFFIES into milliseconds
@@ -616,6 +894,7 @@ int GIF_getInfo(GIFIMAGE *pPage, GIFINFO *pInfo)
                         {
                             memmove(cBuf, &cBuf[iOff], (iDataAvailable-iOff)); // move existing data down
                             iDataAvailable -= iOff;
+                            iBufPos += iOff;
                             iOff = 0;
                             iReadAmount = (*pPage->pfnRead)(&pPage->GIFFile, &cBuf[iDataAvailable], FILE_BUF_SIZE-iDataAvailable);
                             iDataAvailable += iReadAmount;
@@ -631,6 +910,23 @@ int GIF_getInfo(GIFIMAGE *pPage, GIFINFO *pInfo)
                     break;
                 case 0x2c: /* Start of image data */
                     bExt = 0; /* Stop doing extension blocks */
+                    if (iIndexed < pPage->iIndexMax)
+                    {
+                        GIFFRAME *pFrame = &pPage->pFrameIndex[iIndexed++];
+                        pFrame->iOffset = iFrameStart;
+                        pFrame->iX = INTELSHORT(&cBuf[iOff+1]);
+                        pFrame->iY = INTELSHORT(&cBuf[iOff+3]);
+                        pFrame->iWidth = INTELSHORT(&cBuf[iOff+5]);
+                        pFrame->iHeight = INTELSHORT(&cBuf[iOff+7]);
+                        pFrame->iDelay = iFrameDelay;
+                        pFrame->ucDisposal = (ucBits >> 2) & 7;
+                        pFrame->ucFlags = (cBuf[iOff+9] & 0x80) ? GIF_FRAME_LOCAL_PALETTE : 0;
+                        if (ucBits & 1)
+                            pFrame->ucFlags |= GIF_FRAME_TRANSPARENT;
+                        else if (pFrame->iX == 0 && pFrame->iY == 0 && pFrame->iWidth == pPage->iCanvasWidth &&
+                                 pFrame->iHeight == pPage->iCanvasHeight)
+                            pFrame->ucFlags |= GIF_FRAME_KEY;
+                    }
                     break;
                 default:
                    /* Corrupt data, stop here */
@@ -657,9 +953,11 @@ int GIF_getInfo(GIFIMAGE *pPage, GIFINFO *pInfo)
              if (iOff < iDataAvailable) {
                  memmove(cBuf, &cBuf[iOff], (iDataAvailable-iOff)); // move existing data down
                  iDataAvailable -= iOff;
+                 iBufPos += iOff;
                  iOff = 0;
              } else { // already points beyond end
                  iOff -= iDataAvailable;
+                 iBufPos += iDataAvailable;
                  iDataAvailable = 0;
              }
              iReadAmount = (*pPage->pfnRead)(&pPage->GIFFile, &cBuf[iDataAvailable], FILE_BUF_SIZE-iDataAvailable);
@@ -674,6 +972,7 @@ int GIF_getInfo(GIFIMAGE *pPage, GIFINFO *pInfo)
             {
                 memmove(cBuf, &cBuf[iOff], (iDataAvailable-iOff)); // move existing data down
                 iDataAvailable -= iOff;
+                iBufPos += iOff;
                 iOff = 0;
                 iReadAmount = (FILE_BUF_SIZE - iDataAvailable);
                 if (iReadAmount > iDataRemaining)
@@ -699,11 +998,14 @@ int GIF_getInfo(GIFIMAGE *pPage, GIFINFO *pInfo)
         else /* More pages to scan */
         {
             iNumFrames++;
+            iFrameStart = iBufPos + iOff;
+            iFrameDelay = 0; // frames without a graphic control extension
              // read new page data starting at this offset
             if (pPage->GIFFile.iSize > FILE_BUF_SIZE && iDataRemaining > 0) // since we didn't read the whole file in one shot
             {
                 memmove(cBuf, &cBuf[iOff], (iDataAvailable-iOff)); // move existing data down
                 iDataAvailable -= iOff;
+                iBufPos += iOff;
                 iOff = 0;
                 iReadAmount = (FILE_BUF_SIZE - iDataAvailable);
                 if (iReadAmount > iDataRemaining)
@@ -720,56 +1022,496 @@ gifpagesz:
     pInfo->iMaxDelay = iMaxDelay;
     pInfo->iMinDelay = iMinDelay;
     pInfo->iDuration = iTotalDelay;
+    if (iIndexed > iNumFrames)
+        iIndexed = iNumFrames;
+    if (iIndexed > pPage->iIndexCount)
+        pPage->iIndexCount = iIndexed;
+    (*pPage->pfnSeek)(&pPage->GIFFile, 0); // playback starts over at the first frame
+    pPage->iFrame = 0;
     return 1;
 } /* GIF_getInfo() */
 
+//
+// Append iLen bytes of LZW data to the ring, from pSrc or read from the
+// file when it is NULL. Writes that reach the end carry on at the start,
+// and the first LZW_MIRROR bytes are repeated past the end
+//
+static void GIF_IRAM GIFPutLZW(GIFIMAGE *pPage, const uint8_t *pSrc, int iLen)
+{
+    int iRing = LZW_RING_SIZE(pPage);
+    int iPos = pPage->iLZWSize;
+    while (iLen > 0)
+    {
+        int n = (iLen < iRing - iPos) ? iLen : iRing - iPos;
+        if (pSrc) {
+            memcpy(&pPage->ucLZW[iPos], pSrc, n);
+            pSrc += n;
+        } else {
+            (*pPage->pfnRead)(&pPage->GIFFile, &pPage->ucLZW[iPos], n);
+        }
+        if (iPos < LZW_MIRROR)
+            memcpy(&pPage->ucLZW[iRing], pPage->ucLZW, LZW_MIRROR);
+        iPos += n;
+        if (iPos == iRing)
+            iPos = 0;
+        iLen -= n;
+    }
+    pPage->iLZWSize = iPos;
+} /* GIFPutLZW() */
 //
 // Unpack more chunk data for decoding
 // returns 1 to signify more data available for this image
 // 0 indicates there is no more data
 //
-static int GIFGetMoreData(GIFIMAGE *pPage)
+// The chunks are appended to the LZW ring behind the data not read yet,
+// as long as a whole chunk still fits, so nothing is moved
+//
+static int GIF_IRAM GIFGetMoreData(GIFIMAGE *pPage)
 {
-    int iDelta = (pPage->iLZWSize - pPage->iLZWOff);
-    int iLZWBufSize;
+    int iRing = LZW_RING_SIZE(pPage);
+    int iUnread = pPage->iLZWSize - pPage->iLZWOff;
     unsigned char c = 1;
-    
-    // Turbo mode uses combined buffers to read more compressed data
-    iLZWBufSize = (pPage->pTurboBuffer) ? LZW_BUF_SIZE_TURBO : LZW_BUF_SIZE;
-    // move any existing data down
-    if (pPage->bEndOfFrame ||  iDelta >= (iLZWBufSize - MAX_CHUNK_SIZE) || iDelta <= 0)
+
+    if (iUnread < 0)
+        iUnread += iRing;
+    // one byte stays free, a full ring would look empty
+    if (pPage->bEndOfFrame || iUnread >= (iRing - 1 - MAX_CHUNK_SIZE))
         return 1; // frame is finished or buffer is already full; no need to read more data
-    if (pPage->iLZWOff != 0)
+    if (pPage->pfnBorrow) // the source lends its buffer: de-chunk straight from it
     {
-// NB: memcpy() fails on some systems because the src and dest ptrs overlap
-// so copy the bytes in a simple loop to avoid problems
-      for (int i=0; i<pPage->iLZWSize - pPage->iLZWOff; i++) {
-         pPage->ucLZW[i] = pPage->ucLZW[i + pPage->iLZWOff];
-      }
-      pPage->iLZWSize -= pPage->iLZWOff;
-      pPage->iLZWOff = 0;
+        const uint8_t *pData = NULL;
+        int32_t iPos = pPage->GIFFile.iPos, iSize = pPage->GIFFile.iSize;
+        int32_t iLent = 0; // bytes left at pData
+        while (c && iPos < iSize && iUnread < (iRing - 1 - MAX_CHUNK_SIZE))
+        {
+            if (iLent == 0 && (iLent = (*pPage->pfnBorrow)(&pPage->GIFFile, iPos, &pData)) <= 0)
+                break; // read error
+            c = *pData++;
+            iLent--;
+            iPos++;
+            if (c > iSize - iPos)
+                c = (unsigned char)(iSize - iPos); // truncated file
+            int iLeft = c;
+            while (iLeft) // a sub-block can continue in the source's next buffer
+            {
+                if (iLent == 0 && (iLent = (*pPage->pfnBorrow)(&pPage->GIFFile, iPos, &pData)) <= 0)
+                    break;
+                int n = (iLeft < iLent) ? iLeft : iLent;
+                GIFPutLZW(pPage, pData, n);
+                pData += n;
+                iLent -= n;
+                iPos += n;
+                iUnread += n;
+                iLeft -= n;
+            }
+            if (iLeft) {
+                iPos = iSize; // read error, end the frame with what there is
+                break;
+            }
+        }
+        pPage->GIFFile.iPos = iPos;
+        if (c == 0)
+            pPage->bEndOfFrame = 1;
+        return (c != 0 && iPos < iSize);
     }
-    while (c && pPage->GIFFile.iPos < pPage->GIFFile.iSize && pPage->iLZWSize < (iLZWBufSize-MAX_CHUNK_SIZE))
+    while (c && pPage->GIFFile.iPos < pPage->GIFFile.iSize && iUnread < (iRing - 1 - MAX_CHUNK_SIZE))
     {
         (*pPage->pfnRead)(&pPage->GIFFile, &c, 1); // current length
-        (*pPage->pfnRead)(&pPage->GIFFile, &pPage->ucLZW[pPage->iLZWSize], c);
-        pPage->iLZWSize += c;
+        GIFPutLZW(pPage, NULL, c);
+        iUnread += c;
     }
     if (c == 0) // end of frame
         pPage->bEndOfFrame = 1;
     return (c != 0 && pPage->GIFFile.iPos < pPage->GIFFile.iSize); // more data available?
 } /* GIFGetMoreData() */
 //
+// Decide if the frame about to be decoded can be reported as a delta
+// A palette change alters pixels with unchanged color indices, so those frames are reported in full
+// (a local palette repeating the previous frame's is no change)
+//
+static void GIFDeltaFrame(GIFIMAGE *pPage)
+{
+    pPage->bDeltaFrameFull = pPage->bDeltaFull || pPage->bUseLocalPalette != pPage->bDeltaLastLocal ||
+                             (pPage->bUseLocalPalette && pPage->bLocalChanged);
+    pPage->bDeltaLastLocal = pPage->bUseLocalPalette;
+    pPage->bDeltaFull = 0;
+} /* GIFDeltaFrame() */
+//
+// Find the span of the canvas line which changed while merging the new pixels
+//
+static void GIF_IRAM GIFDeltaSpan(GIFIMAGE *pPage, GIFDRAW *pDraw, uint8_t *d8)
+{
+    uint8_t *pOld = pPage->ucDeltaLine;
+    int iLeft = 0, iRight = pDraw->iWidth;
+
+    if (!pPage->bDeltaFrameFull) {
+        while (iLeft < iRight && d8[iLeft] == pOld[iLeft])
+            iLeft++;
+        while (iRight > iLeft && d8[iRight-1] == pOld[iRight-1])
+            iRight--;
+    }
+    pDraw->iDirtyX = iLeft;
+    pDraw->iDirtyWidth = iRight - iLeft;
+} /* GIFDeltaSpan() */
+//
+// Palette expansion and transparent merge kernels
+// There is no table lookup in the ESP32-S3 vector unit, so instead of SIMD these
+// read 4 indices per aligned 32-bit load, write 2 pixels per 32-bit store and
+// test 4 pixels at once for transparency; other targets use the byte loops
+//
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define GIF_WORD_KERNELS
+#endif
+
+// The line writers below are one body with constant arguments per output format,
+// transparency and disposal; forced inline, each caller is compiled for its case
+#if defined(__GNUC__)
+#define GIF_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define GIF_ALWAYS_INLINE inline
+#endif
+
+#ifdef GIF_WORD_KERNELS
+// 0xff in every byte of w which equals the transparent index (replicated in tt)
+static GIF_ALWAYS_INLINE uint32_t GIFTransparentMask(uint32_t w, uint32_t tt)
+{
+    uint32_t x = w ^ tt;
+    uint32_t y = (x & 0x7f7f7f7f) + 0x7f7f7f7f; // high bit set for non-zero low 7 bits
+    y = ~(y | x | 0x7f7f7f7f); // high bit set only for zero bytes
+    return (y >> 7) * 0xff;
+} /* GIFTransparentMask() */
+
+// Write the 4 pixels of index word w
+static GIF_ALWAYS_INLINE void GIFExpandWord(uint16_t *d, uint32_t w, const uint16_t *pPal, int bAligned)
+{
+    uint32_t lo = pPal[w & 0xff] | ((uint32_t)pPal[(w >> 8) & 0xff] << 16);
+    uint32_t hi = pPal[(w >> 16) & 0xff] | ((uint32_t)pPal[w >> 24] << 16);
+    if (bAligned) {
+        ((uint32_t *)d)[0] = lo;
+        ((uint32_t *)d)[1] = hi;
+    } else {
+        d[0] = (uint16_t)lo; d[1] = (uint16_t)(lo >> 16);
+        d[2] = (uint16_t)hi; d[3] = (uint16_t)(hi >> 16);
+    }
+} /* GIFExpandWord() */
+#endif // GIF_WORD_KERNELS
+
+//
+// Translate a line of 8-bit pixels through the palette
+//
+void GIF_IRAM GIF_expandLine565(uint16_t *pDest, const uint8_t *pSrc, const uint16_t *pPalette, int iCount)
+{
+    const uint8_t *pEnd = pSrc + iCount;
+#ifdef GIF_WORD_KERNELS
+    while (pSrc < pEnd && ((uintptr_t)pSrc & 3)) // byte steps until the source is word aligned
+        *pDest++ = pPalette[*pSrc++];
+    int bAligned = ((uintptr_t)pDest & 3) == 0;
+    while (pSrc + 4 <= pEnd) {
+        GIFExpandWord(pDest, *(const uint32_t *)pSrc, pPalette, bAligned);
+        pSrc += 4;
+        pDest += 4;
+    }
+#endif
+    while (pSrc < pEnd)
+        *pDest++ = pPalette[*pSrc++];
+} /* GIF_expandLine565() */
+
+//
+// Merge the opaque pixels of a new line into the 8-bit canvas and write the
+// resulting line through the palette. Transparent pixels keep the canvas pixel,
+// or become ucBackground with bDispose (disposal method 2). bDispose is a
+// constant in every caller, so each gets a loop without that test
+//
+static GIF_ALWAYS_INLINE void GIFMergeLine565(uint16_t *pDest, uint8_t *pCanvas, const uint8_t *pSrc, const uint16_t *pPalette, int iCount, uint8_t ucTransparent, uint8_t ucBackground, const int bDispose)
+{
+    const uint8_t *pEnd = pSrc + iCount;
+    uint8_t c;
+#ifdef GIF_WORD_KERNELS
+    while (pSrc < pEnd && ((uintptr_t)pSrc & 3)) {
+        c = *pSrc++;
+        if (c != ucTransparent)
+            *pCanvas = c;
+        else if (bDispose)
+            *pCanvas = ucBackground;
+        *pDest++ = pPalette[*pCanvas++];
+    }
+    const uint32_t tt = ucTransparent * 0x01010101u;
+    const uint32_t bg = ucBackground * 0x01010101u;
+    int bAligned = ((uintptr_t)pDest & 3) == 0;
+    int bCanvasAligned = ((uintptr_t)pCanvas & 3) == 0;
+    while (pSrc + 4 <= pEnd) {
+        uint32_t w = *(const uint32_t *)pSrc;
+        uint32_t m = GIFTransparentMask(w, tt);
+        if (m) { // take the transparent pixels from the canvas or the background
+            uint32_t old;
+            if (bDispose)
+                old = bg;
+            else if (bCanvasAligned)
+                old = *(uint32_t *)pCanvas;
+            else
+                memcpy(&old, pCanvas, 4);
+            w = (w & ~m) | (old & m);
+        }
+        if (bCanvasAligned)
+            *(uint32_t *)pCanvas = w;
+        else
+            memcpy(pCanvas, &w, 4);
+        GIFExpandWord(pDest, w, pPalette, bAligned);
+        pSrc += 4;
+        pCanvas += 4;
+        pDest += 4;
+    }
+#endif
+    while (pSrc < pEnd) {
+        c = *pSrc++;
+        if (c != ucTransparent)
+            *pCanvas = c;
+        else if (bDispose)
+            *pCanvas = ucBackground;
+        *pDest++ = pPalette[*pCanvas++];
+    }
+} /* GIFMergeLine565() */
+
+//
+// As GIFMergeLine565(), with iBackground a color index for disposal method 2 or -1
+//
+void GIF_IRAM GIF_mergeLine565(uint16_t *pDest, uint8_t *pCanvas, const uint8_t *pSrc, const uint16_t *pPalette, int iCount, uint8_t ucTransparent, int iBackground)
+{
+    if (iBackground >= 0)
+        GIFMergeLine565(pDest, pCanvas, pSrc, pPalette, iCount, ucTransparent, (uint8_t)iBackground, 1);
+    else
+        GIFMergeLine565(pDest, pCanvas, pSrc, pPalette, iCount, ucTransparent, 0, 0);
+} /* GIF_mergeLine565() */
+
+//
+// Write only the opaque pixels of a line through the palette into an RGB565 line
+// *pLeft and *pRight receive the span which was written (*pLeft >= *pRight if none)
+//
+void GIF_IRAM GIF_blendLine565(uint16_t *pDest, const uint8_t *pSrc, const uint16_t *pPalette, int iCount, uint8_t ucTransparent, int *pLeft, int *pRight)
+{
+    int x = 0, iLeft = iCount, iRight = 0;
+    uint8_t c;
+#ifdef GIF_WORD_KERNELS
+    while (x < iCount && ((uintptr_t)&pSrc[x] & 3)) {
+        c = pSrc[x];
+        if (c != ucTransparent) {
+            pDest[x] = pPalette[c];
+            if (x < iLeft)
+                iLeft = x;
+            iRight = x + 1;
+        }
+        x++;
+    }
+    const uint32_t tt = ucTransparent * 0x01010101u;
+    int bAligned = ((uintptr_t)&pDest[x] & 3) == 0;
+    for (; x + 4 <= iCount; x += 4) {
+        uint32_t w = *(const uint32_t *)&pSrc[x];
+        uint32_t m = GIFTransparentMask(w, tt);
+        if (m == 0xffffffff) // all transparent, nothing to write
+            continue;
+        if (m == 0) { // all opaque
+            GIFExpandWord(&pDest[x], w, pPalette, bAligned);
+            if (x < iLeft)
+                iLeft = x;
+            iRight = x + 4;
+            continue;
+        }
+        for (int i = 0; i < 4; i++, w >>= 8, m >>= 8) {
+            if (!(m & 0xff)) {
+                pDest[x + i] = pPalette[w & 0xff];
+                if (x + i < iLeft)
+                    iLeft = x + i;
+                iRight = x + i + 1;
+            }
+        }
+    }
+#endif
+    for (; x < iCount; x++) {
+        c = pSrc[x];
+        if (c != ucTransparent) {
+            pDest[x] = pPalette[c];
+            if (x < iLeft)
+                iLeft = x;
+            iRight = x + 1;
+        }
+    }
+    *pLeft = iLeft;
+    *pRight = iRight;
+} /* GIF_blendLine565() */
+//
+// Line writers of DrawCooked(), one per output format x transparency x disposal.
+// Each merges the new opaque pixels of a line into the 8-bit canvas and writes
+// the line through the palette, without testing the case per line or pixel.
+// GIFSelectCook() picks the one of a frame when it starts
+//
+static void GIF_IRAM GIFCook565Opaque(uint8_t *pDest, uint8_t *pCanvas, const uint8_t *pSrc, const void *pPalette, int iCount, uint8_t ucTransparent, uint8_t ucBackground)
+{
+    memcpy(pCanvas, pSrc, iCount); // just write the new opaque pixels over the old
+    GIF_expandLine565((uint16_t *)pDest, pSrc, (const uint16_t *)pPalette, iCount);
+}
+static void GIF_IRAM GIFCook565Keep(uint8_t *pDest, uint8_t *pCanvas, const uint8_t *pSrc, const void *pPalette, int iCount, uint8_t ucTransparent, uint8_t ucBackground)
+{
+    GIFMergeLine565((uint16_t *)pDest, pCanvas, pSrc, (const uint16_t *)pPalette, iCount, ucTransparent, 0, 0);
+}
+static void GIF_IRAM GIFCook565Dispose(uint8_t *pDest, uint8_t *pCanvas, const uint8_t *pSrc, const void *pPalette, int iCount, uint8_t ucTransparent, uint8_t ucBackground)
+{
+    GIFMergeLine565((uint16_t *)pDest, pCanvas, pSrc, (const uint16_t *)pPalette, iCount, ucTransparent, ucBackground, 1);
+}
+//
+// RGB888 (iBytes 3) and RGBA8888 (iBytes 4, opaque alpha) from the 3 byte palette;
+// iMode 0 opaque, 1 transparent pixels keep the canvas, 2 they become the background
+//
+static GIF_ALWAYS_INLINE void GIFCookRGB(uint8_t *d, uint8_t *pCanvas, const uint8_t *s, const uint8_t *pPal, int iCount, uint8_t ucTransparent, uint8_t ucBackground, const int iBytes, const int iMode)
+{
+    const uint8_t *pEnd = s + iCount;
+    uint8_t pixel;
+    while (s < pEnd) {
+        pixel = *s++;
+        if (iMode == 1 && pixel == ucTransparent)
+            pixel = *pCanvas;
+        else if (iMode == 2 && pixel == ucTransparent)
+            pixel = ucBackground;
+        *pCanvas++ = pixel;
+        d[0] = pPal[(pixel * 3) + 0];
+        d[1] = pPal[(pixel * 3) + 1];
+        d[2] = pPal[(pixel * 3) + 2];
+        if (iBytes == 4)
+            d[3] = 0xff;
+        d += iBytes;
+    }
+}
+#define GIF_COOK_RGB(name, bytes, mode) \
+static void name(uint8_t *pDest, uint8_t *pCanvas, const uint8_t *pSrc, const void *pPalette, int iCount, uint8_t ucTransparent, uint8_t ucBackground) \
+{ \
+    GIFCookRGB(pDest, pCanvas, pSrc, (const uint8_t *)pPalette, iCount, ucTransparent, ucBackground, bytes, mode); \
+}
+GIF_COOK_RGB(GIFCook888Opaque, 3, 0)
+GIF_COOK_RGB(GIFCook888Keep, 3, 1)
+GIF_COOK_RGB(GIFCook888Dispose, 3, 2)
+GIF_COOK_RGB(GIFCook8888Opaque, 4, 0)
+GIF_COOK_RGB(GIFCook8888Keep, 4, 1)
+GIF_COOK_RGB(GIFCook8888Dispose, 4, 2)
+#undef GIF_COOK_RGB
+//
+// GIF_PALETTE_4BPP: the canvas indices packed two to a byte, the left pixel in
+// the high nibble as in TFT_eSprite's 4-bit sprites, for sprites which take
+// the converted palette as theirs. Only the low nibble of an index is kept
+//
+static GIF_ALWAYS_INLINE void GIFCook4(uint8_t *d, uint8_t *pCanvas, const uint8_t *s, int iCount, uint8_t ucTransparent, uint8_t ucBackground, const int iMode)
+{
+    uint8_t c0, c1;
+    int x;
+    for (x = 0; x < iCount; x += 2) {
+        c0 = s[x];
+        c1 = (x + 1 < iCount) ? s[x + 1] : 0;
+        if (iMode == 1) {
+            if (c0 == ucTransparent) c0 = pCanvas[x];
+            if (c1 == ucTransparent && x + 1 < iCount) c1 = pCanvas[x + 1];
+        } else if (iMode == 2) {
+            if (c0 == ucTransparent) c0 = ucBackground;
+            if (c1 == ucTransparent && x + 1 < iCount) c1 = ucBackground;
+        }
+        pCanvas[x] = c0;
+        if (x + 1 < iCount)
+            pCanvas[x + 1] = c1;
+        *d++ = (uint8_t)((c0 << 4) | (c1 & 0xf));
+    }
+}
+#define GIF_COOK_4(name, mode) \
+static void name(uint8_t *pDest, uint8_t *pCanvas, const uint8_t *pSrc, const void *pPalette, int iCount, uint8_t ucTransparent, uint8_t ucBackground) \
+{ \
+    (void)pPalette; \
+    GIFCook4(pDest, pCanvas, pSrc, iCount, ucTransparent, ucBackground, mode); \
+}
+GIF_COOK_4(GIFCook4Opaque, 0)
+GIF_COOK_4(GIFCook4Keep, 1)
+GIF_COOK_4(GIFCook4Dispose, 2)
+#undef GIF_COOK_4
+//
+// Pick the line writer for the frame about to be decoded; 1-bit output keeps
+// its own loops in DrawCooked(). Transparent pixels of a frame with disposal
+// method 2 only become the background here when the canvas isn't disposed of
+// as a whole by GIFDispose()
+//
+static void GIFSelectCook(GIFIMAGE *pPage)
+{
+    int iMode = 0;
+    if (pPage->ucGIFBits & 1)
+        iMode = (((pPage->ucGIFBits & 0x1c)>>2) == 2 && !GIFCookedCanvas(pPage)) ? 2 : 1;
+    switch (pPage->ucPaletteType) {
+        case GIF_PALETTE_RGB565_LE:
+        case GIF_PALETTE_RGB565_BE:
+            pPage->pfnCook = iMode == 0 ? GIFCook565Opaque : (iMode == 1 ? GIFCook565Keep : GIFCook565Dispose);
+            break;
+        case GIF_PALETTE_RGB888:
+            pPage->pfnCook = iMode == 0 ? GIFCook888Opaque : (iMode == 1 ? GIFCook888Keep : GIFCook888Dispose);
+            break;
+        case GIF_PALETTE_4BPP:
+            pPage->pfnCook = iMode == 0 ? GIFCook4Opaque : (iMode == 1 ? GIFCook4Keep : GIFCook4Dispose);
+            break;
+        case GIF_PALETTE_1BPP:
+        case GIF_PALETTE_1BPP_OLED:
+            pPage->pfnCook = NULL;
+            break;
+        default: // RGBA8888
+            pPage->pfnCook = iMode == 0 ? GIFCook8888Opaque : (iMode == 1 ? GIFCook8888Keep : GIFCook8888Dispose);
+            break;
+    }
+} /* GIFSelectCook() */
+//
+// Map a decoded line to the scaled output (see setScale()), keeping every
+// (1<<ucScale)th pixel and line of the canvas. The pixels are compacted in
+// place and the GIFDRAW geometry is changed to the scaled size.
+// Returns 0 if no pixel of this line is kept
+//
+static int GIF_IRAM GIFScaleLine(GIFIMAGE *pPage, GIFDRAW *pDraw)
+{
+    int i, iStep, iFirst, iY, iWidth;
+    uint8_t *s, *d;
+
+    if (pPage->ucScale == 0)
+        return 1;
+    iStep = 1 << pPage->ucScale;
+    iY = pDraw->iY + pDraw->y; // canvas line
+    if (iY & (iStep-1))
+        return 0;
+    iWidth = GIF_SCALED(pPage, pDraw->iX + pDraw->iWidth) - GIF_SCALED(pPage, pDraw->iX);
+    if (iWidth <= 0)
+        return 0;
+    iFirst = (iStep - pDraw->iX) & (iStep-1); // first kept pixel of the frame line
+    s = &pDraw->pPixels[iFirst];
+    d = pDraw->pPixels;
+    for (i=0; i<iWidth; i++) {
+        *d++ = *s;
+        s += iStep;
+    }
+    pDraw->iHeight = GIF_SCALED(pPage, pDraw->iY + pDraw->iHeight) - GIF_SCALED(pPage, pDraw->iY);
+    pDraw->iY = GIF_SCALED(pPage, pDraw->iY);
+    pDraw->y = (iY >> pPage->ucScale) - pDraw->iY;
+    pDraw->iX = GIF_SCALED(pPage, pDraw->iX);
+    pDraw->iWidth = iWidth;
+    pDraw->iDirtyX = 0;
+    pDraw->iDirtyWidth = iWidth;
+    pDraw->iCanvasWidth = GIF_SCALED(pPage, pPage->iCanvasWidth);
+    return 1;
+} /* GIFScaleLine() */
+//
 // Draw and convert pixels when the user wants fully rendered output
 //
-static void DrawCooked(GIFIMAGE *pPage, GIFDRAW *pDraw, void *pDest)
+static void GIF_IRAM DrawCooked(GIFIMAGE *pPage, GIFDRAW *pDraw, void *pDest)
 {
     uint8_t c, *s, *d8, *pEnd;
+    int iPitch = GIF_SCALED(pPage, pPage->iCanvasWidth);
 
     // d8 points to the line in the full sized canvas where the new opaque pixels will be merged
-    d8 = &pPage->pFrameBuffer[pDraw->iX + (pDraw->iY + pDraw->y) * pPage->iCanvasWidth];
+    d8 = &pPage->pFrameBuffer[pDraw->iX + (pDraw->iY + pDraw->y) * iPitch];
     s = pDraw->pPixels; // s points to the newly decoded pixels of this line of the current frame
     pEnd = s + pDraw->iWidth; // faster way to loop over the source pixels - eliminates a counter variable
+    pDraw->iDirtyX = 0;
+    pDraw->iDirtyWidth = pDraw->iWidth;
+    if (pPage->ucDeltaMode) { // keep the old pixels to compare against after merging
+        memcpy(pPage->ucDeltaLine, d8, pDraw->iWidth);
+    }
     
     if (pPage->ucPaletteType == GIF_PALETTE_1BPP || pPage->ucPaletteType == GIF_PALETTE_1BPP_OLED) { // 1-bit mono
         uint8_t *d = NULL;
@@ -833,9 +1575,9 @@ static void DrawCooked(GIFIMAGE *pPage, GIFDRAW *pDraw, void *pDest)
              }
          } else { // vertical pixels
              d = pPage->pFrameBuffer;
-             d += (pPage->iCanvasWidth * pPage->iCanvasHeight);
+             d += (iPitch * GIF_SCALED(pPage, pPage->iCanvasHeight));
              d += pDraw->iX; // starting column
-             d += ((pDraw->iY + pDraw->y)>>3) * pPage->iCanvasWidth;
+             d += ((pDraw->iY + pDraw->y)>>3) * iPitch;
              ucMask = 1 << ((pDraw->iY + pDraw->y) & 7);
              // Apply the new pixels to the main image and generate 1-bpp output
              if (pDraw->ucHasTransparency) { // if transparency used
@@ -875,139 +1617,238 @@ static void DrawCooked(GIFIMAGE *pPage, GIFDRAW *pDraw, void *pDest)
                  }
              }
          }
-    } else if (pPage->ucPaletteType == GIF_PALETTE_RGB565_LE || pPage->ucPaletteType == GIF_PALETTE_RGB565_BE) {
-        uint16_t *d, *pPal = (uint16_t *)pDraw->pPalette;
-        d = (uint16_t *)pDest; // dest pointer to the cooked pixels
-        // Apply the new pixels to the main image
-        if (pDraw->ucHasTransparency) { // if transparency used
-            uint8_t ucTransparent = pDraw->ucTransparent;
-            if (pDraw->ucDisposalMethod == 2) { // restore to background color
-                uint16_t u16BG = pPal[pDraw->ucBackground];
-                while (s < pEnd) {
-                    c = *s++;
-                    if (c != ucTransparent) {
-                        *d++ = pPal[c];
-                        *d8++ = c;
-                    } else {
-                        *d++ = u16BG; // transparent pixel is restored to background color
-                        *d8++ = pDraw->ucBackground;
-                    }
-                }
-            } else { // no disposal, just write non-transparent pixels
-                while (s < pEnd) {
-                    c = *s++;
-                    if (c != ucTransparent) {
-                        *d++ = pPal[c];
-                        *d8++ = c;
-                    } else {
-                        *d++ = pPal[*d8++];
-                    }
-                }
-            }
-        } else { // convert all pixels through the palette without transparency
-#if REGISTER_WIDTH == 64
-            // parallelize the writes
-            // optimizing for the write buffer helps; reading 4 bytes at a time vs 1 doesn't on M1
-            while (s < pEnd + 4) { // group 4 pixels
-                BIGUINT bu;
-                uint8_t s0, s1, s2, s3;
-                uint16_t d1, d2, d3;
-                *(uint32_t *)d8 = *(uint32_t *)s; // just copy new opaque pixels over the old
-                s0 = s[0]; s1 = s[1]; s2 = s[2]; s3 = s[3];
-                bu = pPal[s0]; // not much difference on Apple M1
-                d1 = pPal[s1]; // but other processors may gain
-                d2 = pPal[s2]; // from unrolling the reads
-                d3 = pPal[s3];
-                bu |= (BIGUINT)d1 << 16;
-                bu |= (BIGUINT)d2 << 32;
-                bu |= (BIGUINT)d3 << 48;
-                s += 4;
-                d8 += 4;
-                *(BIGUINT *)d = bu;
-                d += 4;
-            }
-#endif
-            while (s < pEnd) {
-                c = *d8++ = *s++; // just write the new opaque pixels over the old
-                *d++ = pPal[c]; // and create the cooked pixels through the palette
-            }
+    } else { // the line writer of this frame, see GIFSelectCook()
+        (*pPage->pfnCook)((uint8_t *)pDest, d8, s, pDraw->pPalette, pDraw->iWidth, pDraw->ucTransparent, pDraw->ucBackground);
+    }
+    if (pPage->ucDeltaMode) {
+        GIFDeltaSpan(pPage, pDraw, &pPage->pFrameBuffer[pDraw->iX + (pDraw->iY + pDraw->y) * iPitch]);
+    }
+} /* DrawCooked() */
+
+//
+// Hand the lines collected by GIFStripLine() to the draw callback
+//
+static void GIF_IRAM GIFFlushStrip(GIFIMAGE *pPage)
+{
+    GIFDRAW *pDraw = &pPage->gdStrip;
+
+    if (pPage->iStripLines == 0)
+        return;
+    pDraw->iLines = pPage->iStripLines;
+    pDraw->pPixels = pPage->pStrip;
+    pPage->iStripLines = 0; // the callback may set the next strip buffer
+    (*pPage->pfnDraw)(pDraw);
+} /* GIFFlushStrip() */
+//
+// Cook a line into the strip buffer instead of the line after the canvas
+// bMerged: pPixels is the line of the frame buffer, which only needs the palette
+// Returns 0 if strips are off or the line is too wide, it is drawn on its own then
+//
+static int GIF_IRAM GIFStripLine(GIFIMAGE *pPage, GIFDRAW *pDraw, int bMerged)
+{
+    GIFDRAW *pStrip = &pPage->gdStrip;
+    int iLines;
+
+    if (!pPage->pStrip || !pPage->pfnDraw || (pPage->ucPaletteType != GIF_PALETTE_RGB565_LE && pPage->ucPaletteType != GIF_PALETTE_RGB565_BE))
+        return 0;
+    if (pPage->iStripLines && (pDraw->y != pStrip->y + pPage->iStripLines || pDraw->iX != pStrip->iX || pDraw->iWidth != pStrip->iWidth))
+        GIFFlushStrip(pPage); // doesn't continue the strip
+    iLines = pPage->iStripPixels / pDraw->iWidth;
+    if (iLines > pPage->iStripMaxLines)
+        iLines = pPage->iStripMaxLines;
+    if (iLines < 1 || !pPage->pStrip) {
+        GIFFlushStrip(pPage); // keep the lines in order
+        return 0;
+    }
+    if (bMerged)
+        GIF_expandLine565((uint16_t *)&pPage->pStrip[pPage->iStripLines * pDraw->iWidth * sizeof(uint16_t)], pDraw->pPixels, pDraw->pPalette, pDraw->iWidth);
+    else
+        DrawCooked(pPage, pDraw, &pPage->pStrip[pPage->iStripLines * pDraw->iWidth * sizeof(uint16_t)]);
+    if (pPage->iStripLines == 0) {
+        *pStrip = *pDraw;
+        pStrip->iPitch = pDraw->iWidth;
+    } else if (pDraw->iDirtyWidth > 0) { // grow the dirty span to cover this line's
+        if (pStrip->iDirtyWidth <= 0) {
+            pStrip->iDirtyX = pDraw->iDirtyX;
+            pStrip->iDirtyWidth = pDraw->iDirtyWidth;
+        } else {
+            int iLeft = (pDraw->iDirtyX < pStrip->iDirtyX) ? pDraw->iDirtyX : pStrip->iDirtyX;
+            int iRight = pStrip->iDirtyX + pStrip->iDirtyWidth;
+            if (pDraw->iDirtyX + pDraw->iDirtyWidth > iRight)
+                iRight = pDraw->iDirtyX + pDraw->iDirtyWidth;
+            pStrip->iDirtyX = iLeft;
+            pStrip->iDirtyWidth = iRight - iLeft;
         }
-    } else { // 24bpp or 32bpp
-        uint8_t pixel, *d, *pPal;
-        int x;
-        d = (uint8_t *)pDest;
-        pPal = (uint8_t *)pDraw->pPalette;
-        if (pDraw->ucHasTransparency) {
-            uint8_t ucTransparent = pDraw->ucTransparent;
-            if (pDraw->ucDisposalMethod == 2) { // restore to background color
-                uint16_t u16BG = pPal[pDraw->ucBackground];
-                while (s < pEnd) {
-                    c = *s++;
-                    if (c != ucTransparent) {
-                        *d++ = pPal[c];
-                        *d8++ = c;
-                    } else {
-                        *d++ = u16BG; // transparent pixel is restored to background color
-                        *d8++ = pDraw->ucBackground;
-                    }
-                }
-            } else { // no disposal, just write non-transparent pixels
-                if (pPage->ucPaletteType == GIF_PALETTE_RGB888) {
-                    for (x=0; x<pPage->iWidth; x++) {
-                        pixel = *s++;
-                        if (pixel == ucTransparent)
-                            pixel = *d8;
-                        else
-                            *d8 = pixel;
-                        *d++ = pPal[(pixel * 3) + 0]; // convert to RGB888 pixels
-                        *d++ = pPal[(pixel * 3) + 1];
-                        *d++ = pPal[(pixel * 3) + 2];
-                        d8++;
-                    }
-                } else { // must be RGBA32
-                    for (x=0; x<pPage->iWidth; x++) {
-                        pixel = *s++;
-                        if (pixel == ucTransparent)
-                            pixel = *d8;
-                        else
-                            *d8 = pixel;
-                        *d++ = pPal[(pixel * 3) + 0]; // convert to RGB8888 pixels
-                        *d++ = pPal[(pixel * 3) + 1];
-                        *d++ = pPal[(pixel * 3) + 2];
-                        *d++ = 0xff;
-                        d8++;
-                    }
-                }
-            }
-        } else { // no transparency
-            if (pPage->ucPaletteType == GIF_PALETTE_RGB888) {
-                for (x=0; x<pPage->iWidth; x++) {
-                    pixel = *d8++ = *s++;
-                    *d++ = pPal[(pixel * 3) + 0]; // convert to RGB888 pixels
-                    *d++ = pPal[(pixel * 3) + 1];
-                    *d++ = pPal[(pixel * 3) + 2];
-                }
-            } else { // must be RGBA32
-                for (x=0; x<pPage->iWidth; x++) {
-                    pixel = *d8++ = *s++;
-                    *d++ = pPal[(pixel * 3) + 0]; // convert to RGB8888 pixels
-                    *d++ = pPal[(pixel * 3) + 1];
-                    *d++ = pPal[(pixel * 3) + 2];
-                    *d++ = 0xff;
-                }
+    }
+    if (++pPage->iStripLines >= iLines)
+        GIFFlushStrip(pPage);
+    return 1;
+} /* GIFStripLine() */
+//
+// Line of an interlaced frame stored at position iRow in decoding order
+// (pass 1 every 8th line from 0, pass 2 every 8th from 4, pass 3 every 4th from 2,
+// pass 4 every 2nd from 1)
+//
+static int GIFInterlacedRow(int iHeight, int y)
+{
+    int iPass1 = (iHeight + 7) / 8, iPass2 = (iHeight + 3) / 8, iPass3 = (iHeight + 1) / 4;
+
+    if ((y & 7) == 0)
+        return y / 8;
+    if ((y & 7) == 4)
+        return iPass1 + y / 8;
+    if ((y & 3) == 2)
+        return iPass1 + iPass2 + y / 4;
+    return iPass1 + iPass2 + iPass3 + y / 2;
+} /* GIFInterlacedRow() */
+//
+// The frame buffer holds the canvas and its lines can be drawn as RGB565 COOKED
+// output, so disposal is applied to it and lines may be drawn from it later
+//
+static int GIFCookedCanvas(GIFIMAGE *pPage)
+{
+    return pPage->pFrameBuffer && pPage->pfnDraw && pPage->ucDrawType == GIF_DRAW_COOKED &&
+           (pPage->ucPaletteType == GIF_PALETTE_RGB565_LE || pPage->ucPaletteType == GIF_PALETTE_RGB565_BE);
+} /* GIFCookedCanvas() */
+//
+// Lines which are only merged into the frame buffer while decoding and drawn
+// top to bottom by GIFDrawDeferred() at the end of the frame: those of an
+// interlaced frame without Turbo (they come in pass order), and all of a frame
+// whose predecessor was disposed outside its rectangle
+//
+static int GIFDeferLines(GIFIMAGE *pPage)
+{
+    return GIFCookedCanvas(pPage) && (((pPage->ucMap & 0x40) && !pPage->pTurboBuffer) || pPage->bDisposed);
+} /* GIFDeferLines() */
+//
+// Apply the disposal method of the previous frame to the frame buffer before
+// this frame is merged into it, instead of painting transparent pixels of each
+// line with the background: method 2 fills its rectangle with the background
+// color, method 3 puts back what was saved there. Then save the part of the
+// canvas this frame covers if it is to be restored (see setDisposeBuffer())
+//
+static void GIFDispose(GIFIMAGE *pPage)
+{
+    int x, y, x1, y1, iPitch;
+    uint8_t *d, *s;
+
+    pPage->bDisposed = 0;
+    if (!GIFCookedCanvas(pPage))
+        return;
+    iPitch = GIF_SCALED(pPage, pPage->iCanvasWidth);
+    if (pPage->ucPrevDisposal == 2 || (pPage->ucPrevDisposal == 3 && pPage->bSaved)) {
+        x = GIF_SCALED(pPage, pPage->iPrevX);
+        x1 = GIF_SCALED(pPage, pPage->iPrevX + pPage->iPrevWidth);
+        y1 = GIF_SCALED(pPage, pPage->iPrevY + pPage->iPrevHeight);
+        s = pPage->pDisposeBuffer;
+        for (y = GIF_SCALED(pPage, pPage->iPrevY); y < y1 && x < x1; y++) {
+            d = &pPage->pFrameBuffer[x + y * iPitch];
+            if (pPage->ucPrevDisposal == 2) {
+                memset(d, pPage->ucBackground, x1 - x);
+            } else {
+                memcpy(d, s, x1 - x);
+                s += x1 - x;
             }
-        } // opaque
+        }
+        pPage->bDeltaFrameFull = 1; // the display still shows the pixels from before the disposal
+        pPage->bDisposed = pPage->iPrevX < pPage->iX || pPage->iPrevY < pPage->iY ||
+                           pPage->iPrevX + pPage->iPrevWidth > pPage->iX + pPage->iWidth ||
+                           pPage->iPrevY + pPage->iPrevHeight > pPage->iY + pPage->iHeight;
     }
-} /* DrawCooked() */
+    pPage->bSaved = 0;
+    if (((pPage->ucGIFBits & 0x1c)>>2) != 3 || !pPage->pDisposeBuffer)
+        return;
+    x = GIF_SCALED(pPage, pPage->iX);
+    x1 = GIF_SCALED(pPage, pPage->iX + pPage->iWidth);
+    y = GIF_SCALED(pPage, pPage->iY);
+    y1 = GIF_SCALED(pPage, pPage->iY + pPage->iHeight);
+    if ((x1 - x) * (y1 - y) > pPage->iDisposeSize)
+        return; // kept like method 1
+    for (d = pPage->pDisposeBuffer; y < y1 && x < x1; y++, d += x1 - x)
+        memcpy(d, &pPage->pFrameBuffer[x + y * iPitch], x1 - x);
+    pPage->bSaved = 1;
+} /* GIFDispose() */
+//
+// The frame is only merged into the frame buffer, see setSkipDraw()
+//
+static int GIFSkipDraw(GIFIMAGE *pPage)
+{
+    return pPage->bSkipDraw && pPage->pFrameBuffer;
+} /* GIFSkipDraw() */
+//
+// Draw the frame rectangle from the frame buffer, in strips if enabled, grown
+// to cover the disposed rectangle of the previous frame
+// The lines are reported in full, the old pixels weren't kept to compare against
+//
+static void GIFDrawDeferred(GIFIMAGE *pPage)
+{
+    GIFDRAW gd;
+    int y, iPitch = GIF_SCALED(pPage, pPage->iCanvasWidth);
+    int x0 = pPage->iX, y0 = pPage->iY, x1 = pPage->iX + pPage->iWidth, y1 = pPage->iY + pPage->iHeight;
+    uint16_t *pCooked = (uint16_t *)&pPage->pFrameBuffer[iPitch * GIF_SCALED(pPage, pPage->iCanvasHeight)];
 
+    if (pPage->bDisposed) {
+        if (pPage->iPrevX < x0) x0 = pPage->iPrevX;
+        if (pPage->iPrevY < y0) y0 = pPage->iPrevY;
+        if (pPage->iPrevX + pPage->iPrevWidth > x1) x1 = pPage->iPrevX + pPage->iPrevWidth;
+        if (pPage->iPrevY + pPage->iPrevHeight > y1) y1 = pPage->iPrevY + pPage->iPrevHeight;
+    }
+    memset(&gd, 0, sizeof(gd));
+    gd.iX = GIF_SCALED(pPage, x0);
+    gd.iY = GIF_SCALED(pPage, y0);
+    gd.iWidth = GIF_SCALED(pPage, x1) - gd.iX;
+    gd.iHeight = GIF_SCALED(pPage, y1) - gd.iY;
+    if (gd.iWidth <= 0)
+        return;
+    gd.iCanvasWidth = iPitch;
+    gd.pUser = pPage->pUser;
+    gd.pPalette = (pPage->bUseLocalPalette) ? pPage->pLocalPalette : pPage->pPalette;
+    gd.pPalette24 = (uint8_t *)gd.pPalette;
+    gd.ucIsGlobalPalette = pPage->bUseLocalPalette==1?0:1;
+    gd.ucDisposalMethod = (pPage->ucGIFBits & 0x1c)>>2;
+    gd.ucTransparent = pPage->ucTransparent;
+    gd.ucBackground = pPage->ucBackground; // transparency is already merged
+    for (y=0; y<gd.iHeight; y++) {
+        gd.y = y;
+        gd.iDirtyX = 0;
+        gd.iDirtyWidth = gd.iWidth;
+        gd.iLines = 1;
+        gd.iPitch = gd.iWidth;
+        gd.pPixels = &pPage->pFrameBuffer[gd.iX + (gd.iY + y) * iPitch];
+        if (GIFStripLine(pPage, &gd, 1))
+            continue;
+        GIF_expandLine565(pCooked, gd.pPixels, gd.pPalette, gd.iWidth);
+        gd.pPixels = (uint8_t *)pCooked;
+        (*pPage->pfnDraw)(&gd);
+    }
+} /* GIFDrawDeferred() */
+//
+// Draw what the decoder held back until the frame was complete
+//
+static void GIFEndFrame(GIFIMAGE *pPage)
+{
+    if (GIFSkipDraw(pPage)) {
+        pPage->bDeltaFull = 1; // the display still shows an older frame
+    } else {
+        if (GIFDeferLines(pPage))
+            GIFDrawDeferred(pPage); // the lines were only merged into the frame buffer
+        GIFFlushStrip(pPage); // the last lines of the frame
+    }
+    // disposed of before the next frame, see GIFDispose()
+    pPage->ucPrevDisposal = (pPage->ucGIFBits & 0x1c)>>2;
+    pPage->iPrevX = pPage->iX;
+    pPage->iPrevY = pPage->iY;
+    pPage->iPrevWidth = pPage->iWidth;
+    pPage->iPrevHeight = pPage->iHeight;
+} /* GIFEndFrame() */
 //
 // Handle transparent pixels and disposal method
 // Used only when a frame buffer is allocated
 //
-static void DrawNewPixels(GIFIMAGE *pPage, GIFDRAW *pDraw)
+static void GIF_IRAM DrawNewPixels(GIFIMAGE *pPage, GIFDRAW *pDraw)
 {
     uint8_t *d, *s;
-    int x, iPitch = pPage->iCanvasWidth;
+    int x, iPitch = GIF_SCALED(pPage, pPage->iCanvasWidth);
 
     s = pDraw->pPixels;
     d = &pPage->pFrameBuffer[pDraw->iX + (pDraw->y + pDraw->iY)  * iPitch]; // dest pointer in our complete canvas buffer
@@ -1015,7 +1856,7 @@ static void DrawNewPixels(GIFIMAGE *pPage, GIFDRAW *pDraw)
     // Apply the new pixels to the main image
     if (pDraw->ucHasTransparency) { // if transparency used
         uint8_t c, ucTransparent = pDraw->ucTransparent;
-        if (pDraw->ucDisposalMethod == 2) {
+        if (pDraw->ucDisposalMethod == 2 && !GIFCookedCanvas(pPage)) { // else see GIFDispose()
             memset(d, pDraw->ucBackground, pDraw->iWidth); // start with background color
         }
         for (x=0; x<pDraw->iWidth; x++) {
@@ -1033,7 +1874,7 @@ static void DrawNewPixels(GIFIMAGE *pPage, GIFDRAW *pDraw)
 //
 // Output the bytes for a single code (checks for buffer len)
 //
-static int LZWCopyBytes(unsigned char *buf, int iOffset, uint32_t *pSymbols, uint16_t *pLengths)
+static int GIF_IRAM LZWCopyBytes(unsigned char *buf, int iOffset, uint32_t *pSymbols, uint16_t *pLengths)
 {
 int iLen;
 uint8_t c, *s, *d, *pEnd;
@@ -1078,6 +1919,7 @@ uint32_t u32Offset;
 // Macro to extract a variable length code
 //
 #define GET_CODE_TURBO if (bitnum > (REGISTER_WIDTH - MAX_CODE_SIZE/*codesize*/)) { p += (bitnum >> 3); \
+            if (p >= pRingEnd) p -= iRing; /* the mirror covers the word */ \
             bitnum &= 7; ulBits = INTELLONG(p); } \
         code = ((ulBits >> bitnum) & sMask);  \
         bitnum += codesize;
@@ -1110,14 +1952,14 @@ uint32_t u32Offset;
 // backwards through the linked list of codes when outputting pixels. It also doesn't
 // have to copy pixels in reverse order, then unwind them.
 //
-static int DecodeLZWTurbo(GIFIMAGE *pImage, int iOptions)
+static int GIF_IRAM DecodeLZWTurbo(GIFIMAGE *pImage, int iOptions)
 {
-int i, bitnum;
+int i, bitnum, iRing;
 int iUncompressedLen;
 uint32_t code, oldcode, codesize, nextcode, nextlim;
 uint32_t cc, eoi;
 uint32_t sMask;
-uint8_t c, *p, *buf, codestart;
+uint8_t c, *p, *pRingEnd, *buf, codestart;
 BIGUINT ulBits;
 int iLen, iColors;
 int iErr = GIF_SUCCESS;
@@ -1126,6 +1968,10 @@ uint32_t *pSymbols;
 uint16_t *pLengths;
 
     (void)iOptions;
+    GIFDeltaFrame(pImage);
+    GIFDispose(pImage);
+    GIFSelectCook(pImage);
+    pImage->iStripLines = 0;
     pImage->iYCount = pImage->iHeight; // count down the lines
     pImage->iXCount = pImage->iWidth;
     bitnum = 0;
@@ -1139,10 +1985,15 @@ uint16_t *pLengths;
     eoi = cc + 1;
     iUncompressedLen = (pImage->iWidth * pImage->iHeight);
     buf = (uint8_t *)pImage->pTurboBuffer;
-    pSymbols = (uint32_t *)&buf[iUncompressedLen+256]; // we need 32-bits (really 23) for the offsets
+    if (pImage->pTurboTables) // kept apart, e.g. in faster RAM than the pixels
+        pSymbols = (uint32_t *)pImage->pTurboTables;
+    else
+        pSymbols = (uint32_t *)&buf[iUncompressedLen+256]; // we need 32-bits (really 23) for the offsets
     pLengths = (uint16_t *)&pSymbols[4096]; // but only 16-bits for the length of any single string
     iOffset = 0; // output data offset
     p = pImage->ucLZW; // un-chunked LZW data
+    iRing = LZW_RING_SIZE(pImage);
+    pRingEnd = p + iRing;
     ulBits = INTELLONG(p); // start by reading some LZW data
     // set up the default symbols (0..iColors-1)
    for (i = 0; i<iColors; i++) {
@@ -1191,11 +2042,8 @@ init_codetable:
                 codesize++;
                 nextlim <<= 1;
                 sMask = (sMask << 1) | 1;
-                if (p >= (pImage->ucLZW + LZW_HIGHWATER_TURBO)) { // good place to see if we need more compressed data
-                    pImage->iLZWOff = (int)(p - pImage->ucLZW); // restore object member var
-                    GIFGetMoreData(pImage); // We need to read more LZW data
-                    p = &pImage->ucLZW[pImage->iLZWOff];
-                }
+                pImage->iLZWOff = (int)(p - pImage->ucLZW); // good place to top up the LZW ring
+                GIFGetMoreData(pImage); // appends behind the unread data, p stays valid
             }
             oldcode = code;
             GET_CODE_TURBO
@@ -1212,56 +2060,212 @@ init_codetable:
         gd.ucIsGlobalPalette = pImage->bUseLocalPalette==1?0:1;
 
         for (int y=0; y<pImage->iHeight; y++) {
+            // Lines go out top to bottom, also for interlaced frames, so they form strips
+            int iRow = (pImage->ucMap & 0x40) ? GIFInterlacedRow(pImage->iHeight, y) : y;
             gd.y = y;
-            gd.pPixels = &buf[(y * pImage->iWidth)]; // source pixels
-            // Ugly logic to handle the interlaced line position, but it
-            // saves having to have another set of state variables
-            if (pImage->ucMap & 0x40) { // interlaced?
-               int height = pImage->iHeight-1;
-               if (gd.y > height / 2)
-                  gd.y = gd.y * 2 - (height | 1);
-               else if (gd.y > height / 4)
-                  gd.y = gd.y * 4 - ((height & ~1) | 2);
-               else if (gd.y > height / 8)
-                  gd.y = gd.y * 8 - ((height & ~3) | 4);
-               else
-                  gd.y = gd.y * 8;
-            }
+            gd.pPixels = &buf[(iRow * pImage->iWidth)]; // source pixels
             gd.ucDisposalMethod = (pImage->ucGIFBits & 0x1c)>>2;
             gd.ucTransparent = pImage->ucTransparent;
             gd.ucHasTransparency = pImage->ucGIFBits & 1;
             gd.ucBackground = pImage->ucBackground;
             gd.iCanvasWidth = pImage->iCanvasWidth;
+            gd.iX = pImage->iX; gd.iWidth = pImage->iWidth; // GIFScaleLine() changed them for the previous line
+            gd.iY = pImage->iY; gd.iHeight = pImage->iHeight;
+            gd.pUser = pImage->pUser;
+            gd.iLines = 1;
+            if (!GIFScaleLine(pImage, &gd))
+                continue;
+            if (GIFSkipDraw(pImage) || GIFDeferLines(pImage)) {
+                DrawNewPixels(pImage, &gd); // only keep the canvas up to date, or drawn by GIFDrawDeferred()
+                continue;
+            }
+            if (GIFStripLine(pImage, &gd, 0))
+                continue; // drawn with the strip it is in
+            gd.iPitch = gd.iWidth;
             DrawCooked(pImage, &gd, &buf[pImage->iCanvasHeight * pImage->iCanvasWidth]); // dest = past end of canvas
             gd.pPixels = &buf[pImage->iCanvasHeight * pImage->iCanvasWidth]; // point to the line we just converted
             (*pImage->pfnDraw)(&gd); // callback to handle this line
         }
     }
+    GIFEndFrame(pImage);
     return iErr;
 } /* DecodeLZWTurbo() */
 
+//
+// Non-Turbo LZW strings are written forward into the line (see GIFMakePels());
+// define GIF_REVERSE_LZW for the original stack of reversed pixels
+//
+#if !defined(GIF_FORWARD_LZW) && !defined(GIF_REVERSE_LZW)
+#define GIF_FORWARD_LZW
+#endif
+#define GIF_NO_CODE 0xffff // oldcode of the first string after a clear code
+//
+// GIFFlushLine
+//
+// The line in ucLineBuf is complete: hand it to the frame buffer and draw
+// callback and start the next one
+//
+static void GIF_IRAM GIFFlushLine(GIFIMAGE *pPage)
+{
+    GIFDRAW gd;
+    pPage->iXCount = pPage->iWidth; /* Reset pixel count */
+    // Prepare GIDRAW structure for callback
+    gd.iX = pPage->iX;
+    gd.iY = pPage->iY;
+    gd.iWidth = pPage->iWidth;
+    gd.iHeight = pPage->iHeight;
+    gd.pPixels = pPage->ucLineBuf;
+    gd.pPalette = (pPage->bUseLocalPalette) ? pPage->pLocalPalette : pPage->pPalette;
+    gd.pPalette24 = (uint8_t *)gd.pPalette; // just cast the pointer for RGB888
+    gd.ucIsGlobalPalette = pPage->bUseLocalPalette==1?0:1;
+    gd.y = pPage->iHeight - pPage->iYCount;
+    // Ugly logic to handle the interlaced line position, but it
+    // saves having to have another set of state variables
+    if (pPage->ucMap & 0x40) { // interlaced?
+       int height = pPage->iHeight-1;
+       if (gd.y > height / 2)
+          gd.y = gd.y * 2 - (height | 1);
+       else if (gd.y > height / 4)
+          gd.y = gd.y * 4 - ((height & ~1) | 2);
+       else if (gd.y > height / 8)
+          gd.y = gd.y * 8 - ((height & ~3) | 4);
+       else
+          gd.y = gd.y * 8;
+    }
+    gd.ucDisposalMethod = (pPage->ucGIFBits & 0x1c)>>2;
+    gd.ucTransparent = pPage->ucTransparent;
+    gd.ucHasTransparency = pPage->ucGIFBits & 1;
+    gd.ucBackground = pPage->ucBackground;
+    gd.iCanvasWidth = pPage->iCanvasWidth;
+    gd.pUser = pPage->pUser;
+    gd.iDirtyX = 0;
+    gd.iDirtyWidth = gd.iWidth;
+    gd.iLines = 1;
+    if (!GIFScaleLine(pPage, &gd)) {
+        // line is not part of the (scaled) output
+    } else if (GIFSkipDraw(pPage)) {
+        DrawNewPixels(pPage, &gd); // only keep the canvas up to date
+    } else if (GIFDeferLines(pPage)) {
+        DrawNewPixels(pPage, &gd); // drawn in order by GIFDrawDeferred()
+    } else if (!(pPage->pFrameBuffer && pPage->ucDrawType == GIF_DRAW_COOKED && GIFStripLine(pPage, &gd, 0))) {
+        int iCooked = GIF_SCALED(pPage, pPage->iCanvasWidth) * GIF_SCALED(pPage, pPage->iCanvasHeight);
+        gd.iPitch = gd.iWidth;
+        if (pPage->pFrameBuffer) // update the frame buffer
+        {
+            if (pPage->ucDrawType == GIF_DRAW_COOKED) {
+                DrawCooked(pPage, &gd, &pPage->pFrameBuffer[iCooked]);
+                // pass the cooked pixel pointer to the GIFDraw callback
+                gd.pPixels = &pPage->pFrameBuffer[iCooked];
+            } else { // the user will manage converting them through the palette
+                DrawNewPixels(pPage, &gd); // merge the new opaque pixels
+            }
+        }
+        if (pPage->pfnDraw) {
+            (*pPage->pfnDraw)(&gd); // callback to handle this line
+        }
+    }
+    pPage->iYCount--;
+    GIFGetMoreData(pPage); // top up the LZW ring
+} /* GIFFlushLine() */
+#ifdef GIF_FORWARD_LZW
+//
+// The length of every dictionary string is kept next to usGIFTable and the
+// first and last pixels in ucGIFPixels, in ucFileBuf: nothing else uses it
+// while a frame's LZW data is decoded, and without the reversed pixel stack
+// neither does GIFMakePels(). One byte per code, strings of 255 pixels and
+// longer are counted along their links when they are output
+//
+#define GIF_LEN_LONG 255
+//
+// Write pixels iFirst to iFirst + iCount - 1 of the iLen pixel string of
+// code to d, back to front along the links, skipping the ones after them;
+// the last pixels of the strings are gifpels[code] & ucMask
+//
+static void GIF_IRAM GIFPlaceString(GIFIMAGE *pPage, const uint8_t *gifpels, uint8_t ucMask, unsigned int code, int iLen, int iFirst, int iCount, uint8_t *d)
+{
+    const unsigned short *giftabs = pPage->usGIFTable;
+    int i = iLen;
+    while (i > iFirst + iCount && code < LINK_UNUSED) { // pixels for the next lines
+        code = giftabs[code];
+        i--;
+    }
+    d += iCount;
+    while (i > iFirst && code < LINK_UNUSED) {
+        *(--d) = gifpels[code] & ucMask;
+        code = giftabs[code];
+        i--;
+    }
+} /* GIFPlaceString() */
+//
+// GIFMakePels
+//
+// Output the string of code. A string which continues the previous one
+// (oldcode), as the codes of a run of flat colour do, is copied forward from
+// that string while it is still in the line and gets its last pixel added;
+// others are written in place along their links. Either way there is no
+// reversed copy to unwind. bPacked: the pixel table of GIFDecodeLZWCodes()
+// holds two pixels per byte
+//
+static void GIF_IRAM GIFMakePels(GIFIMAGE *pPage, unsigned int code, unsigned int oldcode, int bPacked)
+{
+    int iLen, iDone, iFit;
+    uint8_t *buf = pPage->ucLineBuf + (pPage->iWidth - pPage->iXCount);
+    const uint8_t *gifpels = bPacked ? pPage->ucGIFPixels : &pPage->ucGIFPixels[PIXEL_LAST];
+    uint8_t ucMask = bPacked ? 0xf : 0xff;
+
+    iLen = pPage->ucFileBuf[code];
+    if (pPage->usGIFTable[code] == oldcode && iLen < GIF_LEN_LONG && iLen < pPage->iXCount &&
+        iLen - 1 <= pPage->iWidth - pPage->iXCount)
+    {
+        memcpy(buf, buf - (iLen - 1), iLen - 1); // oldcode's string ends right here
+        buf[iLen - 1] = gifpels[code] & ucMask;
+        pPage->iXCount -= iLen;
+        return;
+    }
+    if (iLen == GIF_LEN_LONG) {
+        unsigned int link = code;
+        for (iLen = 0; link < LINK_UNUSED && iLen < FILE_BUF_SIZE; iLen++)
+            link = pPage->usGIFTable[link];
+    }
+    for (iDone = 0; iDone < iLen && pPage->iYCount > 0; iDone += iFit)
+    {
+        iFit = iLen - iDone;
+        if (iFit > pPage->iXCount) /* Pixels cross into next line */
+            iFit = pPage->iXCount;
+        GIFPlaceString(pPage, gifpels, ucMask, code, iLen, iDone, iFit, buf);
+        buf += iFit;
+        pPage->iXCount -= iFit;
+        if (pPage->iXCount == 0) {
+            GIFFlushLine(pPage);
+            buf = pPage->ucLineBuf;
+        }
+    }
+} /* GIFMakePels() */
+#else
 //
 // GIFMakePels
 //
-static void GIFMakePels(GIFIMAGE *pPage, unsigned int code)
+static void GIF_IRAM GIFMakePels(GIFIMAGE *pPage, unsigned int code, unsigned int oldcode, int bPacked)
 {
     int iPixCount;
+    uint8_t ucMask = bPacked ? 0xf : 0xff;
     unsigned short *giftabs;
     unsigned char *buf, *s, *pEnd, *gifpels;
+    (void)oldcode;
     /* Copy this string of sequential pixels to output buffer */
     //   iPixCount = 0;
     pEnd = pPage->ucFileBuf;
     s = pEnd + FILE_BUF_SIZE; /* Pixels will come out in reversed order */
     buf = pPage->ucLineBuf + (pPage->iWidth - pPage->iXCount);
     giftabs = pPage->usGIFTable;
-    gifpels = &pPage->ucGIFPixels[PIXEL_LAST];
+    gifpels = bPacked ? pPage->ucGIFPixels : &pPage->ucGIFPixels[PIXEL_LAST];
     while (code < LINK_UNUSED)
     {
         if (s == pEnd) /* Houston, we have a problem */
         {
             return; /* Exit with error */
         }
-        *(--s) = gifpels[code];
+        *(--s) = gifpels[code] & ucMask;
         code = giftabs[code];
     }
     iPixCount = (int)(intptr_t)(pEnd + FILE_BUF_SIZE - s);
@@ -1286,101 +2290,89 @@ static void GIFMakePels(GIFIMAGE *pPage, unsigned int code)
             }
             pPage->iXCount -= iPixCount;
             //         iPixCount = 0;
-//            if (pPage->iLZWOff >= LZW_HIGHWATER)
-//                GIFGetMoreData(pPage); // We need to read more LZW data
             return;
         }
         else  /* Pixels cross into next line */
         {
-            GIFDRAW gd;
             pEnd = buf + pPage->iXCount;
             while (buf < pEnd)
             {
                 *buf++ = *s++;
             }
             iPixCount -= pPage->iXCount;
-            pPage->iXCount = pPage->iWidth; /* Reset pixel count */
-            // Prepare GIDRAW structure for callback
-            gd.iX = pPage->iX;
-            gd.iY = pPage->iY;
-            gd.iWidth = pPage->iWidth;
-            gd.iHeight = pPage->iHeight;
-            gd.pPixels = pPage->ucLineBuf;
-            gd.pPalette = (pPage->bUseLocalPalette) ? pPage->pLocalPalette : pPage->pPalette;
-            gd.pPalette24 = (uint8_t *)gd.pPalette; // just cast the pointer for RGB888
-            gd.ucIsGlobalPalette = pPage->bUseLocalPalette==1?0:1;
-            gd.y = pPage->iHeight - pPage->iYCount;
-            // Ugly logic to handle the interlaced line position, but it
-            // saves having to have another set of state variables
-            if (pPage->ucMap & 0x40) { // interlaced?
-               int height = pPage->iHeight-1;
-               if (gd.y > height / 2)
-                  gd.y = gd.y * 2 - (height | 1);
-               else if (gd.y > height / 4)
-                  gd.y = gd.y * 4 - ((height & ~1) | 2);
-               else if (gd.y > height / 8)
-                  gd.y = gd.y * 8 - ((height & ~3) | 4);
-               else
-                  gd.y = gd.y * 8;
-            }
-            gd.ucDisposalMethod = (pPage->ucGIFBits & 0x1c)>>2;
-            gd.ucTransparent = pPage->ucTransparent;
-            gd.ucHasTransparency = pPage->ucGIFBits & 1;
-            gd.ucBackground = pPage->ucBackground;
-            gd.iCanvasWidth = pPage->iCanvasWidth;
-            gd.pUser = pPage->pUser;
-            if (pPage->pFrameBuffer) // update the frame buffer
-            {
-                if (pPage->ucDrawType == GIF_DRAW_COOKED) {
-                    DrawCooked(pPage, &gd, &pPage->pFrameBuffer[pPage->iCanvasWidth * pPage->iCanvasHeight]);
-                    // pass the cooked pixel pointer to the GIFDraw callback
-                    gd.pPixels = &pPage->pFrameBuffer[pPage->iCanvasWidth * pPage->iCanvasHeight];
-                } else { // the user will manage converting them through the palette
-                    DrawNewPixels(pPage, &gd); // merge the new opaque pixels
-                }
-            }
-            if (pPage->pfnDraw) {
-                (*pPage->pfnDraw)(&gd); // callback to handle this line
-            }
-            pPage->iYCount--;
+            GIFFlushLine(pPage);
             buf = pPage->ucLineBuf;
-            if (pPage->iLZWOff >= LZW_HIGHWATER)
-                GIFGetMoreData(pPage); // We need to read more LZW data
         }
     } /* while */
-    if (pPage->iLZWOff >= LZW_HIGHWATER)
-        GIFGetMoreData(pPage); // We need to read more LZW data
     return;
 } /* GIFMakePels() */
+#endif // GIF_FORWARD_LZW
+//
+// 32-bit little endian targets (ESP32-S3) fill a 64-bit bit accumulator from
+// aligned 32-bit words instead of assembling INTELLONG() one byte at a time;
+// a refill then holds 4 codes of 12 bits instead of 2
+//
+#if !defined(GIF_WORD_LZW) && REGISTER_WIDTH == 32 && defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define GIF_WORD_LZW
+#endif
+
+#ifdef GIF_WORD_LZW
+#define LZW_BITS_WIDTH 64
+#define LZWBITS uint64_t
+//
+// Read 64 bits of LZW data starting at p with aligned word loads
+// The words may reach up to 3 bytes before and 11 bytes after p; those bytes
+// lie inside GIFIMAGE and their bits are shifted out
+//
+static GIF_ALWAYS_INLINE uint64_t GIFLoadBits(const uint8_t *p)
+{
+    uintptr_t addr = (uintptr_t)p;
+    const uint32_t *pWords = (const uint32_t *)(addr & ~(uintptr_t)3);
+    int iShift = (int)(addr & 3) * 8;
+    uint64_t ullBits = pWords[0] | ((uint64_t)pWords[1] << 32);
+    if (iShift)
+        ullBits = (ullBits >> iShift) | ((uint64_t)pWords[2] << (64 - iShift));
+    return ullBits;
+} /* GIFLoadBits() */
+#define LZW_LOAD_BITS(p) GIFLoadBits(p)
+#else
+#define LZW_BITS_WIDTH REGISTER_WIDTH
+#define LZWBITS BIGUINT
+#define LZW_LOAD_BITS(p) INTELLONG(p)
+#endif // GIF_WORD_LZW
 //
 // Macro to extract a variable length code
 //
-#define GET_CODE if (bitnum > (REGISTER_WIDTH - codesize)) { pImage->iLZWOff += (bitnum >> 3); \
-            bitnum &= 7; ulBits = INTELLONG(&p[pImage->iLZWOff]); } \
-        code = (unsigned short) (ulBits >> bitnum); /* Read a REGISTER_WIDTH chunk */ \
+#define GET_CODE if (bitnum > (LZW_BITS_WIDTH - codesize)) { pImage->iLZWOff += (bitnum >> 3); \
+            if (pImage->iLZWOff >= iRing) pImage->iLZWOff -= iRing; /* the mirror covers the word */ \
+            bitnum &= 7; ulBits = LZW_LOAD_BITS(&p[pImage->iLZWOff]); } \
+        code = (unsigned short) (ulBits >> bitnum); /* Read a LZW_BITS_WIDTH chunk */ \
         code &= sMask; bitnum += codesize;
 //
 // Decode LZW into an image
+// iCodeStart is the frame's initial code size when it is a constant of the
+// instance, 0 to read it from the frame. With bPacked the pixels fit in 4 bits
+// (16 colors or fewer) and the first and last pixel of a string share one
+// byte of ucGIFPixels, first in the high nibble: half the table to walk, and
+// all a decoder limited to 16 colors has (see GIF_PIXEL_TABLE_BYTES())
 //
-static int DecodeLZW(GIFIMAGE *pImage, int iOptions)
+static GIF_ALWAYS_INLINE int GIFDecodeLZWCodes(GIFIMAGE *pImage, const int iCodeStart, const int bPacked)
 {
-    int i, bitnum;
+    int i, bitnum, iRing;
+    const int iStart = iCodeStart ? iCodeStart : pImage->ucCodeStart;
     unsigned short oldcode, codesize, nextcode, nextlim;
     unsigned short *giftabs, cc, eoi;
     signed short sMask;
     unsigned char c, *gifpels, *p;
-    //    int iStripSize;
-    //unsigned char **index;
-    BIGUINT ulBits;
+    LZWBITS ulBits;
     unsigned short code;
-    (void)iOptions; // not used for now
-    // if output can be used for string table, do it faster
-    //       if (bGIF && (OutPage->cBitsperpixel == 8 && ((OutPage->iWidth & 3) == 0)))
-    //          return PILFastLZW(InPage, OutPage, bGIF, iOptions);
+    GIFDeltaFrame(pImage);
+    GIFDispose(pImage);
+    GIFSelectCook(pImage);
+    pImage->iStripLines = 0;
     p = pImage->ucLZW; // un-chunked LZW data
-    sMask = 0xffff << (pImage->ucCodeStart + 1);
-    sMask = 0xffff - sMask;
-    cc = (sMask >> 1) + 1; /* Clear code */
+    iRing = LZW_RING_SIZE(pImage);
+    cc = (unsigned short) (1 << iStart); /* Clear code */
     eoi = cc + 1;
     giftabs = pImage->usGIFTable;
     gifpels = pImage->ucGIFPixels;
@@ -1394,25 +2386,37 @@ static int DecodeLZW(GIFIMAGE *pImage, int iOptions)
     // this part only needs to be initialized once
     for (i = 0; i < cc; i++)
     {
-        gifpels[PIXEL_FIRST + i] = gifpels[PIXEL_LAST + i] = (unsigned short) i;
+        if (bPacked)
+            gifpels[i] = (unsigned char) ((i << 4) | (i & 0xf));
+        else
+            gifpels[PIXEL_FIRST + i] = gifpels[PIXEL_LAST + i] = (unsigned char) i;
         giftabs[i] = LINK_END;
+#ifdef GIF_FORWARD_LZW
+        pImage->ucFileBuf[i] = 1; // string lengths
+#endif
     }
+    // The rest of the table starts out unused once per frame; a clear code
+    // only resets the entries filled in since the previous one
+    memset(&giftabs[cc], LINK_UNUSED, (4096 - cc)*sizeof(short));
+    nextcode = cc + 2;
 init_codetable:
-    codesize = pImage->ucCodeStart + 1;
-    sMask = 0xffff << (pImage->ucCodeStart + 1);
-    sMask = 0xffff - sMask;
+    if (nextcode > 4096)
+        nextcode = 4096; // entries stop at the end of the table
+    memset(&giftabs[cc + 2], LINK_UNUSED, (nextcode - cc - 2)*sizeof(short));
+    codesize = iStart + 1;
+    sMask = (signed short) ((1 << codesize) - 1);
     nextcode = cc + 2;
     nextlim = (unsigned short) ((1 << codesize));
-    // This part of the table needs to be reset multiple times
-    memset(&giftabs[cc], LINK_UNUSED, (4096 - cc)*sizeof(short));
-    ulBits = INTELLONG(&p[pImage->iLZWOff]); // start by reading 4 bytes of LZW data
+    ulBits = LZW_LOAD_BITS(&p[pImage->iLZWOff]); // start by reading some LZW data
     GET_CODE
     if (code == cc) // we just reset the dictionary, so get another code
     {
       GET_CODE
     }
     c = oldcode = code;
-    GIFMakePels(pImage, code); // first code is output as the first pixel
+    if (bPacked)
+        c &= 0xf;
+    GIFMakePels(pImage, code, GIF_NO_CODE, bPacked); // first code is output as the first pixel
     // Main decode loop
     while (code != eoi && pImage->iYCount > 0) // && y < pImage->iHeight+1) /* Loop through all lines of the image (or strip) */
     {
@@ -1424,8 +2428,18 @@ init_codetable:
                 if (nextcode < nextlim) // for deferred cc case, don't let it overwrite the last entry (fff)
                 {
                     giftabs[nextcode] = oldcode;
-                    gifpels[PIXEL_FIRST + nextcode] = c; // oldcode pixel value
-                    gifpels[PIXEL_LAST + nextcode] = c = gifpels[PIXEL_FIRST + code];
+                    if (bPacked) { // the first pixel of code is oldcode's when it is this new string
+                        unsigned char ucFirst = (code == nextcode) ? c : (unsigned char) (gifpels[code] >> 4);
+                        gifpels[nextcode] = (unsigned char) ((c << 4) | ucFirst);
+                        c = ucFirst;
+                    } else {
+                        gifpels[PIXEL_FIRST + nextcode] = c; // oldcode pixel value
+                        gifpels[PIXEL_LAST + nextcode] = c = gifpels[PIXEL_FIRST + code];
+                    }
+#ifdef GIF_FORWARD_LZW
+                    i = pImage->ucFileBuf[oldcode];
+                    pImage->ucFileBuf[nextcode] = (unsigned char)(i < GIF_LEN_LONG ? i + 1 : GIF_LEN_LONG);
+#endif
                 }
                 nextcode++;
                 if (nextcode >= nextlim && codesize < MAX_CODE_SIZE)
@@ -1434,16 +2448,245 @@ init_codetable:
                     nextlim <<= 1;
                     sMask = nextlim - 1;
                 }
-            GIFMakePels(pImage, code);
+            GIFMakePels(pImage, code, oldcode, bPacked);
             oldcode = code;
         }
     } /* while not end of LZW code stream */
+    GIFEndFrame(pImage);
     return 0;
-//gif_forced_error:
-//    free(pImage->pPixels);
-//    pImage->pPixels = NULL;
-//    return -1;
+} /* GIFDecodeLZWCodes() */
+
+static int GIF_IRAM GIFDecodeLZW2(GIFIMAGE *pImage) { return GIFDecodeLZWCodes(pImage, 2, 1); }
+static int GIF_IRAM GIFDecodeLZW3(GIFIMAGE *pImage) { return GIFDecodeLZWCodes(pImage, 3, 1); }
+static int GIF_IRAM GIFDecodeLZW4(GIFIMAGE *pImage) { return GIFDecodeLZWCodes(pImage, 4, 1); }
+static int GIF_IRAM GIFDecodeLZWPacked(GIFIMAGE *pImage) { return GIFDecodeLZWCodes(pImage, 0, 1); }
+static int GIF_IRAM GIFDecodeLZWBytes(GIFIMAGE *pImage) { return GIFDecodeLZWCodes(pImage, 0, 0); }
+//
+// Frames of up to 16 colors (code start 2 to 4) have a decoder instance of
+// their own, and so do all frames of a decoder limited to 16 colors
+//
+static int GIF_IRAM DecodeLZW(GIFIMAGE *pImage, int iOptions)
+{
+    (void)iOptions; // not used for now
+    switch (pImage->ucCodeStart) {
+        case 2:
+            return GIFDecodeLZW2(pImage);
+        case 3:
+            return GIFDecodeLZW3(pImage);
+        case 4:
+            return GIFDecodeLZW4(pImage);
+        default:
+            return (pImage->iMaxColors <= 16 || pImage->ucCodeStart < 2) ? GIFDecodeLZWPacked(pImage) : GIFDecodeLZWBytes(pImage);
+    }
 } /* DecodeLZW() */
+//
+// Windowed Turbo mode (see setTurboWindow())
+//
+// The string offsets of DecodeLZWTurbo() point into a ring of the most
+// recent output lines instead of a frame sized buffer, and every string
+// points to the place it was output last; a new one to its prefix, as in
+// Turbo mode. Where that place has been overwritten since, the string is
+// written along the links of the non-Turbo dictionary, which is kept as
+// well, up to the first prefix that is still in the ring. Complete lines
+// are handed to GIFFlushLine() as DecodeLZW() does
+//
+#define GIF_WINDOW_SLACK 16 // the 8 byte copies write past the end of a string
+#define GIF_WINDOW_EXTEND 0x80000000 // the offset is the prefix's, the last pixel is in ucGIFPixels
+//
+// Ring index of a string at frame pixel iPos, or -1 if writing iTotal pixels
+// at iOffset (and the overshoot of the 8 byte copies) would overwrite it first
+//
+static GIF_ALWAYS_INLINE int GIFWindowSource(uint32_t u32Pos, int iOffset, int iTotal, int iBase, int iWin)
+{
+    int iPos = (int)(u32Pos & ~GIF_WINDOW_EXTEND);
+    if (iPos + iWin < iOffset + iTotal + 8)
+        return -1;
+    iPos -= iBase;
+    return (iPos < 0) ? iPos + iWin : iPos;
+} /* GIFWindowSource() */
+//
+// Write the iLen pixel string of code at frame pixel iOffset, copied from
+// where it was output last or built along its links; iTotal pixels are
+// written there in all
+//
+static void GIF_IRAM GIFWindowString(GIFIMAGE *pImage, const uint32_t *pSymbols, uint8_t *win, int iWin, int iBase,
+                            int iOffset, int iTotal, unsigned int code, int iLen)
+{
+    const unsigned short *giftabs = pImage->usGIFTable;
+    const uint8_t *gifpels = pImage->ucGIFPixels; // last pixels only, fits the 16 color table too
+    uint32_t u32Sym = pSymbols[code];
+    int iDst = iOffset - iBase;
+    int iSrc = GIFWindowSource(u32Sym, iOffset, iTotal, iBase, iWin);
+    int iCopy = (u32Sym & GIF_WINDOW_EXTEND) ? iLen - 1 : iLen;
+    int iEnd;
+
+    if (iSrc >= 0 && iDst + iCopy <= iWin && iSrc + iCopy <= iWin) { // the slack takes the overshoot
+        uint8_t *s = &win[iSrc], *d = &win[iDst], *pEnd = &win[iDst + iCopy];
+        while (d < pEnd) {
+#ifdef ALLOWS_UNALIGNED
+            BIGUINT tmp = *(BIGUINT *) s;
+            s += sizeof(BIGUINT);
+            *(BIGUINT *)d = tmp;
+            d += sizeof(BIGUINT);
+#else
+            *d++ = *s++;
+#endif
+        }
+        if (iCopy < iLen)
+            win[(iDst + iCopy < iWin) ? iDst + iCopy : 0] = gifpels[code];
+        return;
+    }
+    iEnd = iDst + iLen;
+    if (iEnd >= iWin)
+        iEnd -= iWin;
+    // back to front until the rest is a prefix still in the ring
+    while (iSrc < 0 || iCopy < iLen) {
+        if (--iEnd < 0)
+            iEnd += iWin;
+        win[iEnd] = gifpels[code];
+        if (iSrc >= 0) { // the prefix iCopy points to
+            iLen--;
+            break;
+        }
+        code = giftabs[code];
+        if (--iLen == 0 || code >= LINK_UNUSED)
+            return;
+        u32Sym = pSymbols[code];
+        iSrc = GIFWindowSource(u32Sym, iOffset, iTotal, iBase, iWin);
+        iCopy = (u32Sym & GIF_WINDOW_EXTEND) ? iLen - 1 : iLen;
+    }
+    if (iDst + iLen <= iWin && iSrc + iLen <= iWin) {
+        memcpy(&win[iDst], &win[iSrc], iLen); // not past the pixels after it
+    } else {
+        while (iLen-- > 0) {
+            win[iDst] = win[iSrc];
+            if (++iDst == iWin)
+                iDst = 0;
+            if (++iSrc == iWin)
+                iSrc = 0;
+        }
+    }
+} /* GIFWindowString() */
+
+static int GIF_IRAM DecodeLZWWindow(GIFIMAGE *pImage, int iOptions)
+{
+    int i, bitnum, iRing, iWin, iLen, iIdx;
+    int iOffset, iBase, iLineEnd; // output position, and that of ring index 0, in frame pixels
+    unsigned short code, oldcode, codesize, nextcode, nextlim;
+    unsigned short *giftabs, cc, eoi;
+    signed short sMask;
+    unsigned char *gifpels, *p, *win;
+    uint32_t *pSymbols;
+    uint16_t *pLengths;
+    LZWBITS ulBits;
+
+    // whole lines, and room for the longest string behind the line it starts in
+    iWin = pImage->iTurboWindowSize - GIF_TURBO_TABLE_BYTES - GIF_WINDOW_SLACK;
+    iWin -= iWin % pImage->iWidth;
+    if (iWin < FILE_BUF_SIZE + pImage->iWidth + GIF_WINDOW_SLACK)
+        return DecodeLZW(pImage, iOptions);
+    pSymbols = (uint32_t *)pImage->pTurboWindow;
+    pLengths = (uint16_t *)&pSymbols[4096];
+    win = (uint8_t *)&pLengths[4096];
+    GIFDeltaFrame(pImage);
+    GIFDispose(pImage);
+    GIFSelectCook(pImage);
+    pImage->iStripLines = 0;
+    p = pImage->ucLZW; // un-chunked LZW data
+    iRing = LZW_RING_SIZE(pImage);
+    sMask = 0xffff << (pImage->ucCodeStart + 1);
+    sMask = 0xffff - sMask;
+    cc = (sMask >> 1) + 1; /* Clear code */
+    eoi = cc + 1;
+    giftabs = pImage->usGIFTable;
+    gifpels = pImage->ucGIFPixels;
+    pImage->iYCount = pImage->iHeight; // count down the lines
+    pImage->iXCount = pImage->iWidth;
+    bitnum = 0;
+    pImage->iLZWOff = 0; // Offset into compressed data
+    GIFGetMoreData(pImage); // Read some data to start
+    iOffset = iBase = 0;
+    iLineEnd = pImage->iWidth;
+    for (i = 0; i < cc; i++)
+    {
+        gifpels[i] = (unsigned char) i;
+        giftabs[i] = LINK_END;
+        pSymbols[i] = GIF_WINDOW_EXTEND; // nothing and the pixel
+        pLengths[i] = 1;
+    }
+init_codetable:
+    codesize = pImage->ucCodeStart + 1;
+    sMask = 0xffff << (pImage->ucCodeStart + 1);
+    sMask = 0xffff - sMask;
+    nextcode = cc + 2;
+    nextlim = (unsigned short) ((1 << codesize));
+    ulBits = LZW_LOAD_BITS(&p[pImage->iLZWOff]); // start by reading some LZW data
+    GET_CODE
+    if (code == cc) // we just reset the dictionary, so get another code
+    {
+      GET_CODE
+    }
+    oldcode = GIF_NO_CODE; // the first code after a reset is just stored
+    // Main decode loop
+    while (code != eoi && pImage->iYCount > 0)
+    {
+        if (code == cc) /* Clear code? */
+            goto init_codetable;
+        if (code > nextcode || (oldcode == GIF_NO_CODE && code >= cc))
+            break; // corrupt data, the string isn't defined
+        iIdx = iOffset - iBase;
+        if (code < cc) { // root
+            win[iIdx] = (unsigned char) code;
+            iLen = 1;
+        } else if (code == nextcode) { // the previous string and its first pixel
+            if (nextcode >= nextlim)
+                break;
+            iLen = pLengths[oldcode];
+            GIFWindowString(pImage, pSymbols, win, iWin, iBase, iOffset, iLen + 1, oldcode, iLen);
+            i = iIdx + iLen;
+            if (i >= iWin)
+                i -= iWin;
+            win[i] = win[iIdx];
+            iLen++;
+        } else {
+            iLen = pLengths[code];
+            GIFWindowString(pImage, pSymbols, win, iWin, iBase, iOffset, iLen, code, iLen);
+        }
+        if (oldcode != GIF_NO_CODE) {
+            if (nextcode < nextlim) // for deferred cc case, don't let it overwrite the last entry (fff)
+            {
+                giftabs[nextcode] = oldcode;
+                gifpels[nextcode] = win[iIdx]; // first pixel of this string
+                pSymbols[nextcode] = pSymbols[oldcode] | GIF_WINDOW_EXTEND;
+                pLengths[nextcode] = pLengths[oldcode] + 1;
+            }
+            nextcode++;
+            if (nextcode >= nextlim && codesize < MAX_CODE_SIZE)
+            {
+                codesize++;
+                nextlim <<= 1;
+                sMask = nextlim - 1;
+            }
+        }
+        pSymbols[code] = iOffset; // the string's newest place
+        oldcode = code;
+        iOffset += iLen;
+        if (iOffset - iBase >= iWin)
+            iBase += iWin;
+        while (iOffset >= iLineEnd && pImage->iYCount > 0) // hand over the lines it completed
+        {
+            iIdx = iLineEnd - pImage->iWidth - iBase;
+            if (iIdx < 0)
+                iIdx += iWin;
+            memcpy(pImage->ucLineBuf, &win[iIdx], pImage->iWidth);
+            GIFFlushLine(pImage);
+            iLineEnd += pImage->iWidth;
+        }
+        GET_CODE
+    } /* while not end of LZW code stream */
+    GIFEndFrame(pImage);
+    return 0;
+} /* DecodeLZWWindow() */
 
 void GIF_setDrawCallback(GIFIMAGE *pGIF, GIF_DRAW_CALLBACK *pfnDraw)
 {
@@ -0,0 +1,124 @@
+/***************************************************************************************
+// Compile-time geometry for a panel whose size never changes, such as a round 240x240
+// GC9A01. The screen bounds are constants and the circle inscribed in the screen is a
+// table of row spans built by the compiler, so clipping a strip on the playback path is a
+// few compares and table reads instead of viewport checks and a square root per row.
+//
+// Valid while the viewport is the whole screen with no datum and the screen is not
+// scrolled, see matches(). The sketch keeps the TFT_eSPI functions for everything else.
+// attach() hands the table to a TFT_eSPI instance, whose own circle clipping then reads
+// it too whenever the viewport is the whole screen.
+***************************************************************************************/
+
+// Row spans of the circle inscribed in a w x h screen, worked in half pixels as
+// TFT_eSPI::clipCircleRow() does so both clip alike
+static constexpr int32_t fixedPanelCeilSqrt(int32_t n, int32_t lo, int32_t hi)
+{
+  return lo >= hi ? lo : ((lo + hi) / 2) * ((lo + hi) / 2) >= n ? fixedPanelCeilSqrt(n, lo, (lo + hi) / 2)
+                                                                 : fixedPanelCeilSqrt(n, (lo + hi) / 2 + 1, hi);
+}
+
+// Distance from the centre to the nearest edge of row y
+static constexpr int32_t fixedPanelRowDistance(int32_t h, int32_t y)
+{
+  return 2 * y + 1 - h > 0 ? 2 * y - h : (h - 2 * y - 1 > 0 ? h - 2 * y - 2 : 0);
+}
+
+static constexpr int32_t fixedPanelHalfSpan(int32_t d, int32_t dy)
+{
+  return fixedPanelCeilSqrt(d * d - dy * dy, 0, d);
+}
+
+// First and last + 1 visible column of row y, an empty span for rows outside the circle
+static constexpr int16_t fixedPanelSpanStart(int32_t w, int32_t h, int32_t y)
+{
+  return fixedPanelRowDistance(h, y) >= (w < h ? w : h) ? w
+       : (w - fixedPanelHalfSpan(w < h ? w : h, fixedPanelRowDistance(h, y))) >> 1;
+}
+
+static constexpr int16_t fixedPanelSpanEnd(int32_t w, int32_t h, int32_t y)
+{
+  return fixedPanelRowDistance(h, y) >= (w < h ? w : h) ? 0
+       : (w + fixedPanelHalfSpan(w < h ? w : h, fixedPanelRowDistance(h, y)) + 1) >> 1;
+}
+
+// Row index list for the tables (std::index_sequence is C++14)
+template <int32_t... I> struct fixedPanelRows {};
+template <int32_t N, int32_t... I> struct fixedPanelRowList : fixedPanelRowList<N - 1, N - 1, I...> {};
+template <int32_t... I> struct fixedPanelRowList<0, I...> { typedef fixedPanelRows<I...> type; };
+
+template <int32_t W, int32_t H, typename Rows> struct fixedPanelSpans;
+template <int32_t W, int32_t H, int32_t... I> struct fixedPanelSpans<W, H, fixedPanelRows<I...>> {
+  static constexpr int16_t xs[H] = { fixedPanelSpanStart(W, H, I)... };
+  static constexpr int16_t xe[H] = { fixedPanelSpanEnd(W, H, I)... };
+};
+template <int32_t W, int32_t H, int32_t... I>
+constexpr int16_t fixedPanelSpans<W, H, fixedPanelRows<I...>>::xs[H];
+template <int32_t W, int32_t H, int32_t... I>
+constexpr int16_t fixedPanelSpans<W, H, fixedPanelRows<I...>>::xe[H];
+
+// W x H is the panel at rotation 0; odd ROT swap them. Mirroring does not move the circle
+template <int32_t W, int32_t H, uint8_t ROT = 0>
+class TFT_eFixedPanel {
+
+ public:
+
+  static constexpr int32_t width  = (ROT & 1) ? H : W;
+  static constexpr int32_t height = (ROT & 1) ? W : H;
+
+           // True while tft draws in the geometry the tables were built for
+  static bool matches(TFT_eSPI &tft)
+  {
+    return tft.width() == width && tft.height() == height && tft.getViewportCircle() &&
+           tft.getViewportX() == 0 && tft.getViewportY() == 0 && !tft.getViewportDatum() &&
+           tft.getViewportWidth() == width && tft.getViewportHeight() == height && tft.getScrollY() == 0;
+  }
+
+           // Let tft clip to the circle with the tables while its viewport is the whole screen
+  static void attach(TFT_eSPI &tft) { tft.setCircleSpans(_xs, _xe, width, height); }
+
+           // As TFT_eSPI::clipCircleRow() for the whole screen
+  static inline bool clipCircleRow(int32_t y, int32_t *x, int32_t *w)
+  {
+    if (y < 0 || y >= height) return false;
+    int32_t xs = _xs[y], xe = _xe[y];
+    if (xs < *x) xs = *x;
+    if (xe > *x + *w) xe = *x + *w;
+    if (xe <= xs) return false;
+    *x = xs;
+    *w = xe - xs;
+    return true;
+  }
+
+           // As TFT_eSPI::clipCircleRect() for the whole screen, the window is clipped to it too
+  static inline bool clipCircleRect(int32_t *x, int32_t *y, int32_t *w, int32_t *h)
+  {
+    int32_t ys = *y < 0 ? 0 : *y, ye = *y + *h > height ? height : *y + *h;
+    int32_t sx, sw;
+
+    while (ys < ye) { sx = *x; sw = *w; if (clipCircleRow(ys,     &sx, &sw)) break; ys++; }
+    while (ye > ys) { sx = *x; sw = *w; if (clipCircleRow(ye - 1, &sx, &sw)) break; ye--; }
+    if (ys >= ye) return false;
+
+    // The row spans are nested, the one nearest the middle covers the others
+    int32_t mid = height >> 1;
+    if (mid < ys) mid = ys;
+    if (mid >= ye) mid = ye - 1;
+    if (!clipCircleRow(mid, x, w)) return false;
+
+    *y = ys;
+    *h = ye - ys;
+    return true;
+  }
+
+ private:
+
+  typedef fixedPanelSpans<width, height, typename fixedPanelRowList<height>::type> spans;
+  static constexpr const int16_t *_xs = spans::xs;
+  static constexpr const int16_t *_xe = spans::xe;
+};
+
+template <int32_t W, int32_t H, uint8_t ROT>
+constexpr const int16_t *TFT_eFixedPanel<W, H, ROT>::_xs;
+template <int32_t W, int32_t H, uint8_t ROT>
+constexpr const int16_t *TFT_eFixedPanel<W, H, ROT>::_xe;
@@ -0,0 +1,155 @@
+/***************************************************************************************
+// Per-pixel effects fused at compile time. An effect is a small class with
+//
+//   void row(int32_t y)                          once per line, for terms that only depend on y
+//   uint16_t operator()(uint16_t c, int32_t x)   one pixel of that line, native RGB565
+//
+// TFT_ePixelKernel<A, B, C> chains them into one inlined loop, so a strip gets A, B and C in
+// a single pass over its pixels, with one byte swap each way and no call through a pointer
+// per pixel. Each effect keeps an on flag; effects that are off cost a test per pixel, and a
+// kernel with none on returns without touching the pixels.
+***************************************************************************************/
+
+// Scale the channels of a native RGB565 colour by f/32, f 0..32. Red and blue are scaled in
+// one multiply, the six bits between them leave room for blue's carry
+static inline uint16_t kernelScale565(uint16_t c, uint32_t f)
+{
+  return (((c & 0xF81F) * f >> 5) & 0xF81F) | (((c & 0x07E0) * f >> 5) & 0x07E0);
+}
+
+// Add colour g scaled by f/32 to c, each channel saturating
+static inline uint16_t kernelAdd565(uint16_t c, uint16_t g, uint32_t f)
+{
+  uint32_t r = (c >> 11) + ((g >> 11) * f >> 5), gr = ((c >> 5) & 0x3F) + (((g >> 5) & 0x3F) * f >> 5),
+           b = (c & 0x1F) + ((g & 0x1F) * f >> 5);
+  return (r > 31 ? 31 : r) << 11 | (gr > 63 ? 63 : gr) << 5 | (b > 31 ? 31 : b);
+}
+
+// The effects of a kernel, each a member, applied left to right
+template <typename... E> struct TFT_eFusedEffects {
+  void row(int32_t) {}
+  bool on() const { return false; }
+  inline uint16_t pixel(uint16_t c, int32_t) const { return c; }
+};
+
+template <typename E, typename... R> struct TFT_eFusedEffects<E, R...> : TFT_eFusedEffects<R...> {
+  typedef E effect_type;
+  typedef TFT_eFusedEffects<R...> rest;
+  E effect;
+
+  void row(int32_t y) { effect.row(y); rest::row(y); }
+  bool on() const { return effect.on || rest::on(); }
+  inline uint16_t pixel(uint16_t c, int32_t x) const
+  {
+    return rest::pixel(effect.on ? effect(c, x) : c, x);
+  }
+};
+
+// The chain from the I-th effect on
+template <size_t I, typename F> struct TFT_eKernelAt : TFT_eKernelAt<I - 1, typename F::rest> {};
+template <typename F> struct TFT_eKernelAt<0, F> { typedef F type; };
+
+template <typename... E>
+class TFT_ePixelKernel : public TFT_eFusedEffects<E...> {
+
+ public:
+
+  typedef TFT_eFusedEffects<E...> effects;
+
+           // The I-th effect, e.g. kernel.get<0>().on = true
+  template <size_t I> typename TFT_eKernelAt<I, effects>::type::effect_type &get()
+  {
+    return static_cast<typename TFT_eKernelAt<I, effects>::type &>(*this).effect;
+  }
+
+           // Apply to lines of w pixels at x, y on the screen, pitch pixels apart. Big-endian
+           // pixels (as sprites and DMA strips hold them) are swapped on the way in and out
+  void apply(uint16_t *pixels, int32_t x, int32_t y, int32_t w, int32_t lines, int32_t pitch, bool bigEndian = true)
+  {
+    if (!effects::on()) return;
+    for (int32_t row = 0; row < lines; row++) {
+      effects::row(y + row);
+      if (!effects::on()) continue;
+      uint16_t *p = pixels + row * pitch;
+      if (bigEndian) {
+        for (int32_t i = 0; i < w; i++)
+          p[i] = __builtin_bswap16(effects::pixel(__builtin_bswap16(p[i]), x + i));
+      } else {
+        for (int32_t i = 0; i < w; i++)
+          p[i] = effects::pixel(p[i], x + i);
+      }
+    }
+  }
+};
+
+// Darkens towards the rim of the panel: full brightness inside `inner` px from (cx, cy), then
+// down to `strength` % darker at `outer` px
+struct TFT_eVignette {
+  bool on = false;
+  int32_t cx = 120, cy = 120, inner = 80, outer = 120;
+  uint8_t strength = 50;
+
+  void row(int32_t y) { dy2 = (y - cy) * (y - cy); }
+  inline uint16_t operator()(uint16_t c, int32_t x) const
+  {
+    int32_t d2 = (x - cx) * (x - cx) + dy2;
+    if (d2 <= inner * inner) return c;
+    int32_t span = outer * outer - inner * inner;
+    int32_t t = d2 >= outer * outer || span <= 0 ? 32 : (d2 - inner * inner) * 32 / span;
+    return kernelScale565(c, 32 - t * strength / 100);
+  }
+
+  int32_t dy2 = 0;
+};
+
+// Alternate lines darkened by up to `depth` %, the pattern moving down with `phase`
+// (1/256 of a cycle of `period` lines)
+struct TFT_eScanlines {
+  bool on = false;
+  uint8_t depth = 25;
+  uint8_t period = 4;
+  uint32_t phase = 0;
+
+  void row(int32_t y)
+  {
+    uint32_t p = period ? ((uint32_t)y * 256 / period + phase) & 255 : 0;
+    uint32_t wave = p < 128 ? p : 255 - p; // triangle 0..127
+    f = 32 - depth * wave / (100 * 4);     // up to depth % of 32
+  }
+  inline uint16_t operator()(uint16_t c, int32_t) const { return f >= 32 ? c : kernelScale565(c, f); }
+
+  uint32_t f = 32;
+};
+
+// A ring of light in `color` around (cx, cy): brightest at `radius`, fading out over `width` px
+// on either side
+struct TFT_eGlow {
+  bool on = false;
+  int32_t cx = 120, cy = 120, radius = 32, width = 8;
+  uint16_t color = 0xFFE0;
+  uint8_t strength = 60;
+
+  void row(int32_t y)
+  {
+    dy = y - cy;
+    int32_t r = radius + width;
+    near = dy > -r && dy < r;
+  }
+  inline uint16_t operator()(uint16_t c, int32_t x) const
+  {
+    if (!near) return c;
+    int32_t dx = x - cx, r = radius + width;
+    if (dx <= -r || dx >= r) return c;
+    int32_t d2 = dx * dx + dy * dy, lo = radius - width > 0 ? radius - width : 0;
+    if (d2 >= r * r || d2 <= lo * lo) return c;
+    // Distance from the ring in squared px, near enough for a falloff this narrow
+    int32_t off = d2 - radius * radius;
+    if (off < 0) off = -off;
+    int32_t fade = off / (2 * (radius > 0 ? radius : 1)); // ~ px from the ring
+    if (fade >= width) return c;
+    return kernelAdd565(c, color, (uint32_t)(32 - fade * 32 / width) * strength / 100);
+  }
+
+  int32_t dy = 0;
+  bool near = false;
+};
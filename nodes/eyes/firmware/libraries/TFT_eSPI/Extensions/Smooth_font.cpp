@@ -183,21 +183,47 @@ void TFT_eSPI::loadMetrics(void)
   Serial.print("descent = "); Serial.println(gFont.descent);
 #endif
 
+  // File fonts: read the whole metrics table in one go rather than 7 fields
+  // per glyph, falling back to readInt32() if there is no RAM for it
+  uint8_t* table = nullptr;
+
 #ifdef FONT_FS_AVAILABLE
-  if (fs_font) fontFile.seek(headerPtr, fs::SeekSet);
+  if (fs_font) {
+    fontFile.seek(headerPtr, fs::SeekSet);
+    table = (uint8_t*)malloc(gFont.gCount * 28);
+    if (table && fontFile.read(table, gFont.gCount * 28) != gFont.gCount * 28) {
+      free(table);
+      table = nullptr;
+      fontFile.seek(headerPtr, fs::SeekSet);
+    }
+
+  #if (SMOOTH_FONT_CACHE_SIZE > 0)
+    gCacheSlot = (uint8_t*)malloc(gFont.gCount); // No cache if this fails
+    if (gCacheSlot) memset(gCacheSlot, 0xFF, gFont.gCount);
+  #endif
+  }
 #endif
 
   uint16_t gNum = 0;
 
   while (gNum < gFont.gCount)
   {
-    gUnicode[gNum]  = (uint16_t)readInt32(); // Unicode code point value
-    gHeight[gNum]   =  (uint8_t)readInt32(); // Height of glyph
-    gWidth[gNum]    =  (uint8_t)readInt32(); // Width of glyph
-    gxAdvance[gNum] =  (uint8_t)readInt32(); // xAdvance - to move x cursor
-    gdY[gNum]       =  (int16_t)readInt32(); // y delta from baseline
-    gdX[gNum]       =   (int8_t)readInt32(); // x delta from cursor
-    readInt32(); // ignored
+    uint32_t m[7]; // The 7 metrics fields of this glyph
+    if (table) {
+      const uint8_t* p = table + gNum * 28;
+      for (uint8_t i = 0; i < 7; i++, p += 4) m[i] = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+    }
+    else {
+      for (uint8_t i = 0; i < 7; i++) m[i] = readInt32();
+    }
+
+    gUnicode[gNum]  = (uint16_t)m[0]; // Unicode code point value
+    gHeight[gNum]   =  (uint8_t)m[1]; // Height of glyph
+    gWidth[gNum]    =  (uint8_t)m[2]; // Width of glyph
+    gxAdvance[gNum] =  (uint8_t)m[3]; // xAdvance - to move x cursor
+    gdY[gNum]       =  (int16_t)m[4]; // y delta from baseline
+    gdX[gNum]       =   (int8_t)m[5]; // x delta from cursor
+                                      // m[6] is padding, ignored
 
     //Serial.print("Unicode = 0x"); Serial.print(gUnicode[gNum], HEX); Serial.print(", gHeight  = "); Serial.println(gHeight[gNum]);
     //Serial.print("Unicode = 0x"); Serial.print(gUnicode[gNum], HEX); Serial.print(", gWidth  = "); Serial.println(gWidth[gNum]);
@@ -239,9 +265,11 @@ void TFT_eSPI::loadMetrics(void)
     bitmapPtr += gWidth[gNum] * gHeight[gNum];
 
     gNum++;
-    yield();
+    if (!table) yield();
   }
 
+  if (table) free(table);
+
   gFont.yAdvance = gFont.maxAscent + gFont.maxDescent;
 
   gFont.spaceWidth = (gFont.ascent + gFont.descent) * 2/7;  // Guess at space width
@@ -299,6 +327,22 @@ void TFT_eSPI::unloadFont( void )
   gFont.gArray = nullptr;
 
 #ifdef FONT_FS_AVAILABLE
+  clearGlyphCache();
+
+  if (gCacheSlot)
+  {
+    free(gCacheSlot);
+    gCacheSlot = NULL;
+  }
+
+  if (gCacheArena)
+  {
+    free(gCacheArena);
+    gCacheArena = NULL;
+  }
+
+  glyphCacheHits = glyphCacheMisses = 0;
+
   if (fs_font && fontFile) fontFile.close();
 #endif
 
@@ -334,6 +378,93 @@ uint32_t TFT_eSPI::readInt32(void)
 }
 
 
+#ifdef FONT_FS_AVAILABLE
+/***************************************************************************************
+** Function name:           evictGlyph
+** Description:             Drop the oldest glyph from the glyph cache
+*************************************************************************************x*/
+void TFT_eSPI::evictGlyph(void)
+{
+  gCacheSlot[gCacheEntry[gCacheFirst].gNum] = 0xFF;
+  gCacheFirst = (gCacheFirst + 1) % SMOOTH_FONT_CACHE_SLOTS;
+  gCacheCount--;
+}
+
+
+/***************************************************************************************
+** Function name:           clearGlyphCache
+** Description:             Forget every cached glyph, the arena is kept
+*************************************************************************************x*/
+void TFT_eSPI::clearGlyphCache(void)
+{
+  if (gCacheSlot) while (gCacheCount) evictGlyph();
+  gCacheFirst = 0;
+  gCacheHead = 0;
+}
+
+
+/***************************************************************************************
+** Function name:           getGlyphBitmap
+** Description:             Get the alpha bitmap of a glyph from the glyph cache
+*************************************************************************************x*/
+const uint8_t* TFT_eSPI::getGlyphBitmap(uint16_t gNum, bool releaseBus)
+{
+  uint32_t size = gWidth[gNum] * gHeight[gNum];
+  if (!gCacheSlot || size == 0 || size > SMOOTH_FONT_CACHE_SIZE) return nullptr;
+
+  uint8_t slot = gCacheSlot[gNum];
+  if (slot != 0xFF)
+  {
+    glyphCacheHits++;
+    return gCacheArena + gCacheEntry[slot].offset;
+  }
+
+  if (!gCacheArena)
+  {
+#if defined (ESP32) && defined (CONFIG_SPIRAM_SUPPORT)
+    if ( psramFound() ) gCacheArena = (uint8_t*)ps_malloc(SMOOTH_FONT_CACHE_SIZE);
+    else
+#endif
+    gCacheArena = (uint8_t*)malloc(SMOOTH_FONT_CACHE_SIZE);
+    if (!gCacheArena) return nullptr;
+  }
+
+  // Find room at the head of the ring, past the end it wraps to the start and
+  // the glyphs to the end of the arena go too
+  uint32_t start = gCacheHead;
+  if (start + size > SMOOTH_FONT_CACHE_SIZE)
+  {
+    while (gCacheCount && gCacheEntry[gCacheFirst].offset >= start) evictGlyph();
+    start = 0;
+  }
+  while (gCacheCount)
+  {
+    glyphCacheEntry* oldest = &gCacheEntry[gCacheFirst];
+    uint32_t oldSize = gWidth[oldest->gNum] * gHeight[oldest->gNum];
+    bool overlaps = oldest->offset < start + size && oldest->offset + oldSize > start;
+    if (!overlaps && gCacheCount < SMOOTH_FONT_CACHE_SLOTS) break;
+    evictGlyph();
+  }
+
+  if (releaseBus) endWrite();    // Release SPI for SD card transaction
+  fontFile.seek(gBitmap[gNum], fs::SeekSet);
+  bool ok = fontFile.read(gCacheArena + start, size) == size;
+  if (releaseBus) startWrite();  // Re-start SPI for TFT transaction
+  if (!ok) return nullptr;
+
+  slot = (gCacheFirst + gCacheCount) % SMOOTH_FONT_CACHE_SLOTS;
+  gCacheEntry[slot].gNum = gNum;
+  gCacheEntry[slot].offset = start;
+  gCacheSlot[gNum] = slot;
+  gCacheCount++;
+  gCacheHead = start + size;
+  glyphCacheMisses++;
+
+  return gCacheArena + start;
+}
+#endif
+
+
 /***************************************************************************************
 ** Function name:           getUnicodeIndex
 ** Description:             Get the font file index of a Unicode character
@@ -404,16 +535,21 @@ void TFT_eSPI::drawGlyph(uint16_t code)
     if (textwrapY && ((cursor_y + gFont.yAdvance) >= height())) cursor_y = 0;
     if (cursor_x == 0) cursor_x -= gdX[gNum];
 
-    uint8_t* pbuffer = nullptr;
-    const uint8_t* gPtr = (const uint8_t*) gFont.gArray;
+    uint8_t* pbuffer = nullptr;       // Row buffer when the bitmap is read row by row
+    const uint8_t* gPtr = nullptr;    // Bitmap in the font array or the glyph cache
 
 #ifdef FONT_FS_AVAILABLE
     if (fs_font)
     {
-      fontFile.seek(gBitmap[gNum], fs::SeekSet);
-      pbuffer =  (uint8_t*)malloc(gWidth[gNum]);
+      gPtr = getGlyphBitmap(gNum, !spiffs);
+      if (!gPtr) {
+        fontFile.seek(gBitmap[gNum], fs::SeekSet);
+        pbuffer =  (uint8_t*)malloc(gWidth[gNum]);
+      }
     }
+    else
 #endif
+    gPtr = (const uint8_t*) gFont.gArray + gBitmap[gNum];
 
     int16_t cy = cursor_y + gFont.maxAscent - gdY[gNum];
     int16_t cx = cursor_x + gdX[gNum];
@@ -461,7 +597,7 @@ void TFT_eSPI::drawGlyph(uint16_t code)
     for (int32_t y = 0; y < gHeight[gNum]; y++)
     {
 #ifdef FONT_FS_AVAILABLE
-      if (fs_font) {
+      if (pbuffer) {
         if (spiffs)
         {
           fontFile.read(pbuffer, gWidth[gNum]);
@@ -479,11 +615,8 @@ void TFT_eSPI::drawGlyph(uint16_t code)
 
       for (int32_t x = 0; x < gWidth[gNum]; x++)
       {
-#ifdef FONT_FS_AVAILABLE
-        if (fs_font) pixel = pbuffer[x];
-        else
-#endif
-        pixel = pgm_read_byte(gPtr + gBitmap[gNum] + x + gWidth[gNum] * y);
+        if (pbuffer) pixel = pbuffer[x];
+        else pixel = pgm_read_byte(gPtr + x + gWidth[gNum] * y);
 
         if (pixel)
         {
@@ -1,6 +1,17 @@
  // Coded by Bodmer 10/2/18, see license in root directory.
  // This is part of the TFT_eSPI class and is associated with anti-aliased font functions
 
+// Glyph cache for fonts loaded from a file system: decoded alpha bitmaps of
+// recently drawn glyphs are kept in an arena of SMOOTH_FONT_CACHE_SIZE bytes
+// (PSRAM when available), so redrawing status text needs no file access.
+// 0 disables the cache and every glyph is read row by row as before
+#ifndef SMOOTH_FONT_CACHE_SIZE
+  #define SMOOTH_FONT_CACHE_SIZE  16384
+#endif
+#ifndef SMOOTH_FONT_CACHE_SLOTS
+  #define SMOOTH_FONT_CACHE_SLOTS 64     // Glyphs held at most, up to 255
+#endif
+
  public:
 
   // These are for the new anti-aliased fonts
@@ -16,6 +27,16 @@
 
   void     showFont(uint32_t td);
 
+#ifdef FONT_FS_AVAILABLE
+  // Alpha bitmap of glyph gNum from the glyph cache, read from the font file in
+  // one go on a miss; nullptr if it cannot be cached. releaseBus ends the TFT
+  // transaction around the file read (SD card on the same SPI bus)
+  const uint8_t* getGlyphBitmap(uint16_t gNum, bool releaseBus = false);
+  void     clearGlyphCache(void);
+
+  uint32_t glyphCacheHits = 0, glyphCacheMisses = 0; // Since the font was loaded
+#endif
+
  // This is for the whole font
   typedef struct
   {
@@ -59,3 +80,21 @@ fontMetrics gFont = { nullptr, 0, 0, 0, 0, 0, 0, 0 };
 
   uint8_t* fontPtr = nullptr;
 
+#ifdef FONT_FS_AVAILABLE
+  // Glyph cache: bitmaps are appended to the arena as a ring, entries are
+  // evicted oldest first when the ring reaches them or the slots run out
+  typedef struct {
+    uint16_t gNum;   // Glyph index
+    uint32_t offset; // Bitmap position in gCacheArena
+  } glyphCacheEntry;
+
+  uint8_t* gCacheArena = nullptr;  // SMOOTH_FONT_CACHE_SIZE bytes, allocated on first use
+  uint8_t* gCacheSlot  = nullptr;  // Per glyph: entry index, 0xFF if not cached
+  glyphCacheEntry gCacheEntry[SMOOTH_FONT_CACHE_SLOTS];
+  uint32_t gCacheHead  = 0;        // Arena offset for the next bitmap
+  uint8_t  gCacheFirst = 0;        // Oldest entry
+  uint8_t  gCacheCount = 0;        // Entries in use
+
+  void     evictGlyph(void);
+#endif
+
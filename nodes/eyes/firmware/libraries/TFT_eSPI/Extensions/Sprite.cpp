@@ -36,6 +36,15 @@ TFT_eSprite::TFT_eSprite(TFT_eSPI *tft)
 
   _colorMap = nullptr;
 
+  _spans    = nullptr;
+  _spanRows = nullptr;
+  _spanKey  = 0;
+
+  _pool     = nullptr;
+  _preowned = false;
+
+  makeBlendTable(&_blend, TFT_WHITE, TFT_BLACK);
+
   _psram_enable = true;
   
   // Ensure end_tft_write() does nothing in inherited functions.
@@ -55,6 +64,69 @@ void* TFT_eSprite::createSprite(int16_t w, int16_t h, uint8_t frames)
 
   if ( w < 1 || h < 1 ) return nullptr;
 
+  return placeSprite(w, h, frames, nullptr);
+}
+
+
+/***************************************************************************************
+** Function name:           createSprite
+** Description:             Create a sprite on memory owned by the sketch
+***************************************************************************************/
+void* TFT_eSprite::createSprite(int16_t w, int16_t h, void *buffer, uint32_t bytes, uint8_t frames)
+{
+  if ( _created ) return _img8_1;
+
+  if ( w < 1 || h < 1 || buffer == nullptr || bytes < spriteBytes(w, h, frames) ) return nullptr;
+
+  void *img = placeSprite(w, h, frames, buffer);
+  _preowned = (img != nullptr);
+  return img;
+}
+
+
+/***************************************************************************************
+** Function name:           createSprite
+** Description:             Create a sprite on a block of a pool
+***************************************************************************************/
+void* TFT_eSprite::createSprite(int16_t w, int16_t h, TFT_eSpritePool *pool, uint8_t frames)
+{
+  if ( _created ) return _img8_1;
+
+  if ( w < 1 || h < 1 ) return nullptr;
+
+  void *block = pool ? pool->take(spriteBytes(w, h, frames)) : nullptr;
+  if (block == nullptr) return placeSprite(w, h, frames, nullptr); // Pool exhausted, use the heap
+
+  void *img = placeSprite(w, h, frames, block);
+  _pool = pool;
+  return img;
+}
+
+
+/***************************************************************************************
+** Function name:           spriteBytes
+** Description:             Bytes of the image of a sprite at the current colour depth
+***************************************************************************************/
+// Includes the extra "off screen" pixel per frame that callocSprite() adds
+uint32_t TFT_eSprite::spriteBytes(int16_t w, int16_t h, uint8_t frames)
+{
+  if (frames > 2) frames = 2;
+  if (frames < 1) frames = 1;
+
+  if (_bpp == 16) return (frames * w * h + frames) * sizeof(uint16_t);
+  if (_bpp == 8)  return frames * w * h + frames;
+  if (_bpp == 4)  return ((frames * ((w+1) & 0xFFFE) * h) >> 1) + frames;
+  return frames * (((w+7) & 0xFFF8) >> 3) * h + frames;
+}
+
+
+/***************************************************************************************
+** Function name:           placeSprite
+** Description:             Set up a sprite on new or given memory
+***************************************************************************************/
+void* TFT_eSprite::placeSprite(int16_t w, int16_t h, uint8_t frames, void *mem)
+{
+
   _iwidth  = _dwidth  = _bitwidth = w;
   _iheight = _dheight = h;
 
@@ -68,7 +140,7 @@ void* TFT_eSprite::createSprite(int16_t w, int16_t h, uint8_t frames)
   _sh = h;
   _scolor = TFT_BLACK;
 
-  _img8   = (uint8_t*) callocSprite(w, h, frames);
+  _img8   = (uint8_t*) callocSprite(w, h, frames, mem);
   _img8_1 = _img8;
   _img8_2 = _img8;
   _img    = (uint16_t*) _img8;
@@ -150,7 +222,7 @@ TFT_eSprite::~TFT_eSprite(void)
 ** Function name:           callocSprite
 ** Description:             Allocate a memory area for the Sprite and return pointer
 ***************************************************************************************/
-void* TFT_eSprite::callocSprite(int16_t w, int16_t h, uint8_t frames)
+void* TFT_eSprite::callocSprite(int16_t w, int16_t h, uint8_t frames, void *mem)
 {
   // Add one extra "off screen" pixel to point out-of-bounds setWindow() coordinates
   // this means push/writeColor functions do not need additional bounds checks and
@@ -160,6 +232,13 @@ void* TFT_eSprite::callocSprite(int16_t w, int16_t h, uint8_t frames)
   if (frames > 2) frames = 2; // Currently restricted to 2 frame buffers
   if (frames < 1) frames = 1;
 
+  if (mem != nullptr) // Pool block or sketch memory of spriteBytes(), only the widths to set
+  {
+    if (_bpp == 4) _iwidth = (w+1) & 0xFFFE;
+    else if (_bpp == 1) _iwidth = _bitwidth = (w+7) & 0xFFF8;
+    return mem;
+  }
+
   if (_bpp == 16)
   {
 #if defined (ESP32) && defined (CONFIG_SPIRAM_SUPPORT)
@@ -378,9 +457,14 @@ void TFT_eSprite::deleteSprite(void)
     _colorMap = nullptr;
   }
 
+  uncompileSprite();
+
   if (_created)
   {
-    free(_img8_1);
+    if (_pool) _pool->give(_img8_1);
+    else if (!_preowned) free(_img8_1);
+    _pool = nullptr;
+    _preowned = false;
     _img8 = nullptr;
     _created = false;
     _vpOoB   = true;  // TFT_eSPI class write() uses this to check for valid sprite
@@ -529,6 +613,174 @@ bool TFT_eSprite::pushRotated(TFT_eSprite *spr, int16_t angle, uint32_t transp)
 }
 
 
+/***************************************************************************************
+** Function name:           setTransform
+** Description:             Set up a pushTransformed() map for a scale, rotate and move
+***************************************************************************************/
+void TFT_eSprite::setTransform(spriteTransform *m, float angle, float scaleX, float scaleY, float x, float y)
+{
+  // Trig values for the rotation
+  float radAngle = angle * 0.0174532925; // Convert degrees to radians
+  float sina = sin(radAngle);
+  float cosa = cos(radAngle);
+
+  // Inverse rotation then inverse scale takes a destination step back into this Sprite
+  float xx =  cosa / scaleX, xy = sina / scaleX;
+  float yx = -sina / scaleY, yy = cosa / scaleY;
+
+  m->xx = (int32_t)roundf(xx * 65536.0f);
+  m->xy = (int32_t)roundf(xy * 65536.0f);
+  m->yx = (int32_t)roundf(yx * 65536.0f);
+  m->yy = (int32_t)roundf(yy * 65536.0f);
+
+  // Destination pixel x,y lands on the centre of the pivot pixel
+  m->x0 = (int32_t)roundf((_xPivot + 0.5f - xx * x - xy * y) * 65536.0f);
+  m->y0 = (int32_t)roundf((_yPivot + 0.5f - yx * x - yy * y) * 65536.0f);
+}
+
+// Division rounding towards minus infinity, b > 0
+static int64_t floorDivTransform(int64_t a, int64_t b)
+{
+  return (a >= 0) ? a / b : -((b - 1 - a) / b);
+}
+
+// Narrow the steps k0 to k1 - 1 along a row so that position p + k * dp stays in 0 to limit - 1
+static void clipTransformSpan(int64_t p, int32_t dp, int32_t limit, int32_t *k0, int32_t *k1)
+{
+  int64_t lo, hi;
+  if (dp > 0) {
+    lo = -floorDivTransform(p, dp);
+    hi =  floorDivTransform(limit - 1 - p, dp) + 1;
+  }
+  else if (dp < 0) {
+    lo = -floorDivTransform(limit - 1 - p, -dp);
+    hi =  floorDivTransform(p, -dp) + 1;
+  }
+  else {
+    if (p < 0 || p >= limit) *k1 = *k0; // Row is wholly outside
+    return;
+  }
+  if (lo > *k0) *k0 = (lo < *k1) ? (int32_t)lo : *k1;
+  if (hi < *k1) *k1 = (hi > *k0) ? (int32_t)hi : *k0;
+}
+
+// RGB565 spread over 32 bits (green in the top half) so all three channels blend in one multiply
+static inline uint32_t spreadRGB565(uint16_t c) { return (c | ((uint32_t)c << 16)) & 0x07E0F81F; }
+static inline uint16_t packRGB565(uint32_t c)   { return (uint16_t)((c & 0xF81F) | ((c >> 16) & 0x07E0)); }
+static inline uint32_t blendRGB565(uint32_t a, uint32_t b, uint32_t f) // f = 0-31 weight of b
+{
+  return ((a * (32 - f) + b * f) >> 5) & 0x07E0F81F;
+}
+
+/***************************************************************************************
+** Function name:           pushTransformed
+** Description:             Draw an affine transformed copy of this Sprite into a Sprite
+***************************************************************************************/
+// Walks the destination rows with integer steps. The part of each row that samples this
+// Sprite is found up front, so the inner loops have no bounds tests. The transform uses
+// destination Sprite coordinates and is clipped to its viewport.
+bool TFT_eSprite::pushTransformed(TFT_eSprite *spr, const spriteTransform *m, uint32_t transp,
+                                  bool bilinear, const uint16_t *cmap)
+{
+  if ( !_created || (_bpp != 8 && _bpp != 16)) return false; // Check this Sprite is created
+  if ( !spr->_created || spr->_bpp != 16) return false;       // Check destination Sprite is created
+
+  // Sprites hold byte swapped colours, the 8-bit colour lookup is swapped to match
+  uint16_t lut[256];
+  if (_bpp == 8) {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint16_t c = cmap ? cmap[i] : color8to16(i);
+      lut[i] = c >> 8 | c << 8;
+    }
+  }
+
+  bool     useTransp = (transp != 0x00FFFFFF);
+  uint32_t tp = (_bpp == 8) ? (transp & 0xFF) : (uint16_t)(transp >> 8 | transp << 8);
+
+  int32_t  sw = _dwidth << 16;
+  int32_t  sh = _dheight << 16;
+  int32_t  stride = _iwidth;
+
+  for (int32_t y = spr->_vpY; y < spr->_vpH; y++) {
+    // Source position of the first viewport pixel on this row
+    int64_t xs = (int64_t)m->xx * spr->_vpX + (int64_t)m->xy * y + m->x0;
+    int64_t ys = (int64_t)m->yx * spr->_vpX + (int64_t)m->yy * y + m->y0;
+
+    int32_t k0 = 0, k1 = spr->_vpW - spr->_vpX;
+    clipTransformSpan(xs, m->xx, sw, &k0, &k1);
+    clipTransformSpan(ys, m->yx, sh, &k0, &k1);
+    if (k0 >= k1) continue;
+
+    int32_t  sx = (int32_t)(xs + (int64_t)k0 * m->xx);
+    int32_t  sy = (int32_t)(ys + (int64_t)k0 * m->yx);
+    uint16_t *out = spr->_img + y * spr->_iwidth + spr->_vpX + k0;
+    int32_t  n = k1 - k0;
+
+    if (bilinear) {
+      for (; n--; out++, sx += m->xx, sy += m->yx) {
+        // The four texels around the sample point, clamped at the edges
+        int32_t bx = sx - 0x8000, by = sy - 0x8000;
+        int32_t x0 = bx >> 16, y0 = by >> 16;
+        uint32_t fx = (bx >> 11) & 0x1F, fy = (by >> 11) & 0x1F;
+        int32_t x1 = x0 + 1, y1 = y0 + 1;
+        if (x0 < 0) x0 = 0;
+        if (y0 < 0) y0 = 0;
+        if (x1 >= _dwidth)  x1 = _dwidth - 1;
+        if (y1 >= _dheight) y1 = _dheight - 1;
+
+        uint32_t r[4];
+        if (_bpp == 16) {
+          r[0] = _img[x0 + y0 * stride]; r[1] = _img[x1 + y0 * stride];
+          r[2] = _img[x0 + y1 * stride]; r[3] = _img[x1 + y1 * stride];
+        }
+        else {
+          r[0] = _img8[x0 + y0 * stride]; r[1] = _img8[x1 + y0 * stride];
+          r[2] = _img8[x0 + y1 * stride]; r[3] = _img8[x1 + y1 * stride];
+        }
+
+        // Transparency follows the nearest texel, transparent neighbours take its colour
+        uint32_t nearest = r[(fx >= 16) + 2 * (fy >= 16)];
+        if (useTransp) {
+          if (nearest == tp) continue;
+          for (uint32_t i = 0; i < 4; i++) if (r[i] == tp) r[i] = nearest;
+        }
+
+        uint32_t c[4];
+        for (uint32_t i = 0; i < 4; i++) {
+          uint16_t v = (_bpp == 16) ? (uint16_t)r[i] : lut[r[i]];
+          c[i] = spreadRGB565(v >> 8 | v << 8);
+        }
+        uint16_t v = packRGB565(blendRGB565(blendRGB565(c[0], c[1], fx), blendRGB565(c[2], c[3], fx), fy));
+        *out = v >> 8 | v << 8;
+      }
+    }
+    else if (_bpp == 16) {
+      if (useTransp) {
+        for (; n--; out++, sx += m->xx, sy += m->yx) {
+          uint16_t v = _img[(sx >> 16) + (sy >> 16) * stride];
+          if (v != tp) *out = v;
+        }
+      }
+      else {
+        for (; n--; sx += m->xx, sy += m->yx) *out++ = _img[(sx >> 16) + (sy >> 16) * stride];
+      }
+    }
+    else {
+      if (useTransp) {
+        for (; n--; out++, sx += m->xx, sy += m->yx) {
+          uint8_t v = _img8[(sx >> 16) + (sy >> 16) * stride];
+          if (v != tp) *out = lut[v];
+        }
+      }
+      else {
+        for (; n--; sx += m->xx, sy += m->yx) *out++ = lut[_img8[(sx >> 16) + (sy >> 16) * stride]];
+      }
+    }
+  }
+  return true;
+}
+
+
 /***************************************************************************************
 ** Function name:           getRotatedBounds
 ** Description:             Get TFT bounding box of a rotated Sprite wrt pivot
@@ -683,7 +935,26 @@ void TFT_eSprite::pushSprite(int32_t x, int32_t y, uint16_t transp)
 {
   if (!_created) return;
 
-  if (_bpp == 16)
+  if (_spans && transp == _spanKey)
+  {
+    // One pushImage() per opaque run in a single transaction, the screen clips each of them
+    bool held = _tft->inTransaction; // the caller's startWrite() must outlive this
+    if (!held) _tft->startWrite();
+    bool oldSwapBytes = _tft->getSwapBytes();
+    _tft->setSwapBytes(false);
+    for (int32_t row = 0; row < _dheight; row++)
+    {
+      for (uint32_t s = _spanRows[row]; s < _spanRows[row + 1]; s++)
+      {
+        int32_t sx = _spans[2 * s], sw = _spans[2 * s + 1];
+        if (_bpp == 16) _tft->pushImage(x + sx, y + row, sw, 1, _img + row * _iwidth + sx);
+        else _tft->pushImage(x + sx, y + row, sw, 1, _img8 + row * _iwidth + sx, (bool)true);
+      }
+    }
+    _tft->setSwapBytes(oldSwapBytes);
+    if (!held) _tft->endWrite();
+  }
+  else if (_bpp == 16)
   {
     bool oldSwapBytes = _tft->getSwapBytes();
     _tft->setSwapBytes(false);
@@ -703,6 +974,83 @@ void TFT_eSprite::pushSprite(int32_t x, int32_t y, uint16_t transp)
 }
 
 
+#ifndef SPRITE_DMA_PIXELS
+  #define SPRITE_DMA_PIXELS 1920 // pixels in each of the two pushSpriteDMA() buffers (8 rows of 240)
+#endif
+static uint16_t *spriteDmaLines = nullptr; // the two buffers, DMA capable RAM shared by all Sprites
+
+/***************************************************************************************
+** Function name:           pushSpriteDMA
+** Description:             Push the sprite to the TFT at x, y with DMA
+***************************************************************************************/
+// Rows are expanded into two small buffers in turn: while one is sent the next rows are
+// expanded into the other, so the palette lookup overlaps the transfer and only the
+// buffers need DMA capable RAM. Clipped to the screen, not to a viewport.
+bool TFT_eSprite::pushSpriteDMA(int32_t x, int32_t y, const uint16_t *cmap)
+{
+  if (!_created || _bpp == 1 || !_tft->DMA_Enabled) return false;
+
+  int32_t sx = 0, sy = 0, w = _dwidth, h = _dheight;
+  if (x < 0) { sx = -x; w += x; x = 0; }
+  if (y < 0) { sy = -y; h += y; y = 0; }
+  if (x + w > _tft->width())  w = _tft->width() - x;
+  if (y + h > _tft->height()) h = _tft->height() - y;
+  if (w < 1 || h < 1) return true;
+  if (w > SPRITE_DMA_PIXELS) return false;
+
+  if (!spriteDmaLines) {
+#if defined (ESP32)
+    spriteDmaLines = (uint16_t*) heap_caps_malloc(2 * SPRITE_DMA_PIXELS * sizeof(uint16_t), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+#else
+    spriteDmaLines = (uint16_t*) malloc(2 * SPRITE_DMA_PIXELS * sizeof(uint16_t));
+#endif
+    if (!spriteDmaLines) return false;
+  }
+
+  // Colour lookup in the panel byte order, as 16-bit Sprites hold it
+  uint16_t lut[256];
+  if (_bpp == 8) {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint16_t c = cmap ? cmap[i] : color8to16(i);
+      lut[i] = c >> 8 | c << 8;
+    }
+  }
+  else if (_bpp == 4) {
+    for (uint32_t i = 0; i < 16; i++) lut[i] = _colorMap[i] >> 8 | _colorMap[i] << 8;
+  }
+
+  bool oldSwapBytes = _tft->getSwapBytes();
+  _tft->setSwapBytes(false);
+  _tft->dmaWait();
+  _tft->setAddrWindow(x, y, w, h);
+
+  int32_t rows = SPRITE_DMA_PIXELS / w;
+  uint16_t *buf = spriteDmaLines;
+  for (int32_t row = 0; row < h; row += rows) {
+    int32_t n = (h - row < rows) ? h - row : rows;
+    uint16_t *out = buf;
+    for (int32_t ys = sy + row; ys < sy + row + n; ys++, out += w) {
+      if (_bpp == 16) memcpy(out, _img + sx + ys * _iwidth, w * 2);
+      else if (_bpp == 8) {
+        const uint8_t *in = _img8 + sx + ys * _iwidth;
+        for (int32_t i = 0; i < w; i++) out[i] = lut[in[i]];
+      }
+      else {
+        for (int32_t i = 0, xs = sx; i < w; i++, xs++) {
+          uint8_t b = _img4[(xs + ys * _iwidth) >> 1];
+          out[i] = lut[(xs & 1) ? (b & 0x0F) : (b >> 4)];
+        }
+      }
+    }
+    // Waits for the rows in the other buffer, then returns while these are sent
+    _tft->pushPixelsDMA(buf, n * w);
+    buf = (buf == spriteDmaLines) ? spriteDmaLines + SPRITE_DMA_PIXELS : spriteDmaLines;
+  }
+  _tft->setSwapBytes(oldSwapBytes);
+  return true;
+}
+
+
 /***************************************************************************************
 ** Function name:           pushToSprite
 ** Description:             Push the sprite to another sprite at x, y
@@ -759,6 +1107,22 @@ bool TFT_eSprite::pushToSprite(TFT_eSprite *dspr, int32_t x, int32_t y, uint16_t
   if (_bpp ==  1 && ds_bpp !=  1) return false;
 
   bool oldSwapBytes = dspr->getSwapBytes();
+
+  if (_spans && transp == _spanKey && _bpp != 1)
+  {
+    // Copy the opaque runs straight from the image, the destination clips each of them
+    for (int32_t row = 0; row < _dheight; row++)
+    {
+      for (uint32_t s = _spanRows[row]; s < _spanRows[row + 1]; s++)
+      {
+        int32_t sx = _spans[2 * s], sw = _spans[2 * s + 1];
+        if (_bpp == 16) dspr->pushImage(x + sx, y + row, sw, 1, _img + row * _iwidth + sx);
+        else dspr->pushImage(x + sx, y + row, sw, 1, (uint16_t *)(_img8 + row * _iwidth + sx), 8);
+      }
+    }
+    return true;
+  }
+
   uint16_t sline_buffer[width()];
 
   transp = transp>>8 | transp<<8;
@@ -794,6 +1158,76 @@ bool TFT_eSprite::pushToSprite(TFT_eSprite *dspr, int32_t x, int32_t y, uint16_t
 }
 
 
+/***************************************************************************************
+** Function name:           compileSprite
+** Description:             Build the table of opaque runs for a transparent colour
+***************************************************************************************/
+// Two passes over the image, one to count the runs and one to record them, so the
+// table is a single allocation of the exact size. Runs are in unrotated Sprite rows.
+bool TFT_eSprite::compileSprite(uint16_t transp)
+{
+  uncompileSprite();
+  if (!_created || (_bpp != 16 && _bpp != 8) || _iwidth != _dwidth) return false;
+
+  // The key as it is stored in the image: byte swapped 565 or 332
+  uint16_t key16 = transp >> 8 | transp << 8;
+  uint8_t  key8  = (uint8_t)((transp & 0xE000)>>8 | (transp & 0x0700)>>6 | (transp & 0x0018)>>3);
+
+  uint32_t count = 0;
+  for (int pass = 0; pass < 2; pass++)
+  {
+    count = 0;
+    for (int32_t row = 0; row < _dheight; row++)
+    {
+      if (pass) _spanRows[row] = count;
+      int32_t xs = 0;
+      while (xs < _dwidth)
+      {
+        if (_bpp == 16) while (xs < _dwidth && _img[row * _iwidth + xs] == key16) xs++;
+        else while (xs < _dwidth && _img8[row * _iwidth + xs] == key8) xs++;
+        if (xs >= _dwidth) break;
+        int32_t start = xs;
+        if (_bpp == 16) while (xs < _dwidth && _img[row * _iwidth + xs] != key16) xs++;
+        else while (xs < _dwidth && _img8[row * _iwidth + xs] != key8) xs++;
+        if (pass)
+        {
+          _spans[2 * count]     = start;
+          _spans[2 * count + 1] = xs - start;
+        }
+        count++;
+      }
+    }
+    if (pass) _spanRows[_dheight] = count;
+    else
+    {
+      // At least one entry so that a fully transparent Sprite still counts as compiled
+      _spans    = (uint16_t *)malloc(2 * sizeof(uint16_t) * (count ? count : 1));
+      _spanRows = (uint32_t *)malloc(sizeof(uint32_t) * (_dheight + 1));
+      if (!_spans || !_spanRows)
+      {
+        uncompileSprite();
+        return false;
+      }
+    }
+  }
+  _spanKey = transp;
+  return true;
+}
+
+
+/***************************************************************************************
+** Function name:           uncompileSprite
+** Description:             Free the table of opaque runs
+***************************************************************************************/
+void TFT_eSprite::uncompileSprite(void)
+{
+  free(_spans);
+  free(_spanRows);
+  _spans    = nullptr;
+  _spanRows = nullptr;
+}
+
+
 /***************************************************************************************
 ** Function name:           pushSprite
 ** Description:             Push a cropped sprite to the TFT at tx, ty
@@ -1683,6 +2117,38 @@ void TFT_eSprite::drawPixel(int32_t x, int32_t y, uint32_t color)
 }
 
 
+/***************************************************************************************
+** Function name:           drawPixel (alpha blended)
+** Description:             Blend a pixel into the Sprite, in the buffer for 16 bits
+***************************************************************************************/
+uint16_t TFT_eSprite::drawPixel(int32_t x, int32_t y, uint32_t color, uint8_t alpha, uint32_t bg_color)
+{
+  if (_bpp != 16) return TFT_eSPI::drawPixel(x, y, color, alpha, bg_color);
+
+  if (!_created || _vpOoB) return color;
+
+  x+= _xDatum;
+  y+= _yDatum;
+
+  // Range checking
+  if ((x < _vpX) || (y < _vpY) ||(x >= _vpW) || (y >= _vpH)) return color;
+
+  uint16_t *p = _img + x + y * _iwidth;
+  if (bg_color == 0x00FFFFFF) {
+    // Blend with the pixel in the buffer, no readPixel() round trip
+    uint16_t bg = *p >> 8 | *p << 8;
+    color = swarBlend(alpha, color, bg);
+  }
+  else {
+    if ((uint16_t)color != _blend.fgc || (uint16_t)bg_color != _blend.bgc)
+      makeBlendTable(&_blend, color, bg_color);
+    color = tableBlend(&_blend, alpha);
+  }
+  *p = (uint16_t)(color >> 8 | color << 8);
+  return color;
+}
+
+
 /***************************************************************************************
 ** Function name:           drawLine
 ** Description:             draw a line between 2 arbitrary points
@@ -1865,6 +2331,33 @@ void TFT_eSprite::drawFastHLine(int32_t x, int32_t y, int32_t w, uint32_t color)
 }
 
 
+/***************************************************************************************
+** Function name:           pushRow
+** Description:             copy a row of colours in the Sprite byte order
+***************************************************************************************/
+void TFT_eSprite::pushRow(int32_t x, int32_t y, int32_t w, const uint16_t *data)
+{
+  if (!_created || _vpOoB) return;
+
+  x+= _xDatum;
+  y+= _yDatum;
+
+  // Clipping
+  if ((y < _vpY) || (x >= _vpW) || (y >= _vpH)) return;
+
+  if (x < _vpX) { data += _vpX - x; w += x - _vpX; x = _vpX; }
+
+  if ((x + w) > _vpW) w = _vpW - x;
+
+  if (w < 1) return;
+
+  if (_bpp == 16) memcpy(_img + _iwidth * y + x, data, w * 2);
+  else {
+    for (int32_t i = 0; i < w; i++) drawPixel(x - _xDatum + i, y - _yDatum, (uint16_t)(data[i] >> 8 | data[i] << 8));
+  }
+}
+
+
 /***************************************************************************************
 ** Function name:           fillRect
 ** Description:             draw a filled rectangle
@@ -2475,15 +2968,20 @@ void TFT_eSprite::drawGlyph(uint16_t code)
       if ( cursor_x == 0) cursor_x -= gdX[gNum];
     }
 
-    uint8_t* pbuffer = nullptr;
-    const uint8_t* gPtr = (const uint8_t*) gFont.gArray;
+    uint8_t* pbuffer = nullptr;       // Row buffer when the bitmap is read row by row
+    const uint8_t* gPtr = nullptr;    // Bitmap in the font array or the glyph cache
 
 #ifdef FONT_FS_AVAILABLE
     if (fs_font) {
-      fontFile.seek(gBitmap[gNum], fs::SeekSet); // This is slow for a significant position shift!
-      pbuffer =  (uint8_t*)malloc(gWidth[gNum]);
+      gPtr = getGlyphBitmap(gNum);
+      if (!gPtr) {
+        fontFile.seek(gBitmap[gNum], fs::SeekSet); // This is slow for a significant position shift!
+        pbuffer =  (uint8_t*)malloc(gWidth[gNum]);
+      }
     }
+    else
 #endif
+    gPtr = (const uint8_t*) gFont.gArray + gBitmap[gNum];
 
     int16_t cy = cursor_y + gFont.maxAscent - gdY[gNum];
     int16_t cx = cursor_x + gdX[gNum];
@@ -2528,18 +3026,15 @@ void TFT_eSprite::drawGlyph(uint16_t code)
     for (int32_t y = 0; y < gHeight[gNum]; y++)
     {
 #ifdef FONT_FS_AVAILABLE
-      if (fs_font) {
+      if (pbuffer) {
         fontFile.read(pbuffer, gWidth[gNum]);
       }
 #endif
 
       for (int32_t x = 0; x < gWidth[gNum]; x++)
       {
-#ifdef FONT_FS_AVAILABLE
-        if (fs_font) pixel = pbuffer[x];
-        else
-#endif
-        pixel = pgm_read_byte(gPtr + gBitmap[gNum] + x + gWidth[gNum] * y);
+        if (pbuffer) pixel = pbuffer[x];
+        else pixel = pgm_read_byte(gPtr + x + gWidth[gNum] * y);
 
         if (pixel)
         {
@@ -2696,3 +3191,100 @@ int16_t TFT_eSprite::printToSprite(int16_t x, int16_t y, uint16_t index)
   return gxAdvance[index];
 }
 #endif
+
+
+/***************************************************************************************
+** Function name:           TFT_eSpritePool::begin
+** Description:             Allocate the blocks of a sprite pool
+***************************************************************************************/
+bool TFT_eSpritePool::begin(const spritePoolClass *classes, uint8_t count, bool psram)
+{
+  end();
+  if (count > SPRITE_POOL_CLASSES) count = SPRITE_POOL_CLASSES;
+
+  uint32_t total = 0;
+  for (uint8_t c = 0; c < count; c++)
+  {
+    // Room for the free list link, and 4 byte aligned blocks
+    uint32_t bytes = classes[c].bytes < sizeof(void*) ? sizeof(void*) : classes[c].bytes;
+    _bytes[c] = (bytes + 3) & ~3UL;
+    _count[c] = classes[c].count;
+    total += _bytes[c] * _count[c];
+  }
+  if (total == 0) return false;
+
+#if defined (ESP32) && defined (CONFIG_SPIRAM_SUPPORT)
+  if (psram) _arena = psramFound() ? (uint8_t*)ps_malloc(total) : nullptr;
+  else
+#endif
+  _arena = (uint8_t*)malloc(total);
+  if (_arena == nullptr) return false;
+
+  uint8_t *block = _arena;
+  for (uint8_t c = 0; c < count; c++)
+  {
+    _base[c] = block;
+    _head[c] = nullptr;
+    // Chain the blocks so that the first is taken first
+    for (int32_t i = _count[c] - 1; i >= 0; i--)
+    {
+      void *b = block + i * _bytes[c];
+      *(void**)b = _head[c];
+      _head[c] = b;
+    }
+    _available[c] = _count[c];
+    block += _bytes[c] * _count[c];
+  }
+  _classes = count;
+  _misses = 0;
+  return true;
+}
+
+
+/***************************************************************************************
+** Function name:           TFT_eSpritePool::end
+** Description:             Free the blocks, Sprites on them must be deleted first
+***************************************************************************************/
+void TFT_eSpritePool::end(void)
+{
+  free(_arena);
+  _arena = nullptr;
+  _classes = 0;
+}
+
+
+/***************************************************************************************
+** Function name:           TFT_eSpritePool::take
+** Description:             Take the smallest free block of at least bytes
+***************************************************************************************/
+void* TFT_eSpritePool::take(uint32_t bytes)
+{
+  for (uint8_t c = 0; c < _classes; c++)
+  {
+    if (_bytes[c] < bytes || _head[c] == nullptr) continue;
+    void *block = _head[c];
+    _head[c] = *(void**)block;
+    _available[c]--;
+    return block;
+  }
+  _misses++;
+  return nullptr;
+}
+
+
+/***************************************************************************************
+** Function name:           TFT_eSpritePool::give
+** Description:             Return a block to the free list of its class
+***************************************************************************************/
+void TFT_eSpritePool::give(void *block)
+{
+  uint8_t *b = (uint8_t*)block;
+  for (uint8_t c = 0; c < _classes; c++)
+  {
+    if (b < _base[c] || b >= _base[c] + _bytes[c] * _count[c]) continue;
+    *(void**)block = _head[c];
+    _head[c] = block;
+    _available[c]++;
+    return;
+  }
+}
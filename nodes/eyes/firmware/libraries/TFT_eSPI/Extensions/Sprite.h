@@ -5,6 +5,57 @@
 // graphics are written to the Sprite rather than the TFT.
 ***************************************************************************************/
 
+// Affine map used by pushTransformed(), from destination pixel x,y to the source Sprite
+// position in 16.16 fixed point: xs = xx * x + xy * y + x0, ys = yx * x + yy * y + y0
+typedef struct {
+  int32_t xx, xy, x0;
+  int32_t yx, yy, y0;
+} spriteTransform;
+
+#ifndef SPRITE_POOL_CLASSES
+  #define SPRITE_POOL_CLASSES 4 // Size classes a TFT_eSpritePool can have
+#endif
+
+// A size class of a TFT_eSpritePool: count blocks of bytes each
+typedef struct {
+  uint32_t bytes;
+  uint16_t count;
+} spritePoolClass;
+
+// Fixed size blocks for Sprite images, carved from one allocation made at begin(). The free
+// blocks of each class are chained through their first bytes, so taking and giving back a
+// block is O(1), and creating and deleting Sprites cannot fragment the heap over long uptimes.
+class TFT_eSpritePool {
+
+ public:
+
+           // Allocate the blocks, classes in ascending size. With psram the blocks go to PSRAM
+           // only, as the heap would. Returns false if there is no memory for them.
+  bool     begin(const spritePoolClass *classes, uint8_t count, bool psram = true);
+  void     end(void);
+
+           // The smallest free block of at least bytes, nullptr if every class that fits is used.
+           // Blocks are not cleared.
+  void*    take(uint32_t bytes);
+  void     give(void *block);
+
+  uint8_t  classes(void) { return _classes; }
+  uint32_t blockBytes(uint8_t c) { return _bytes[c]; }
+  uint16_t available(uint8_t c) { return _available[c]; }
+  uint32_t misses(void) { return _misses; } // take() calls that found no block
+
+ private:
+
+  uint8_t  *_arena = nullptr;
+  uint8_t  _classes = 0;
+  uint8_t  *_base[SPRITE_POOL_CLASSES];      // first block of each class
+  uint32_t _bytes[SPRITE_POOL_CLASSES];      // block size, a multiple of 4
+  uint16_t _count[SPRITE_POOL_CLASSES];
+  uint16_t _available[SPRITE_POOL_CLASSES];
+  void     *_head[SPRITE_POOL_CLASSES];      // free list
+  uint32_t _misses = 0;
+};
+
 class TFT_eSprite : public TFT_eSPI {
 
  public:
@@ -21,6 +72,17 @@ class TFT_eSprite : public TFT_eSPI {
            //  - 2 bytes per pixel for 16-bit color depth (565 RGB format)
   void*    createSprite(int16_t width, int16_t height, uint8_t frames = 1);
 
+           // Create the sprite on memory the sketch owns, at least spriteBytes() long. The memory
+           // is not cleared, and deleteSprite() leaves it to the sketch. nullptr if it is too small
+  void*    createSprite(int16_t width, int16_t height, void *buffer, uint32_t bytes, uint8_t frames = 1);
+
+           // Create the sprite on a block of the pool, or on the heap as above when the pool has
+           // no block big enough. A pool block is not cleared; deleteSprite() gives it back
+  void*    createSprite(int16_t width, int16_t height, TFT_eSpritePool *pool, uint8_t frames = 1);
+
+           // Bytes createSprite() needs at the current colour depth
+  uint32_t spriteBytes(int16_t width, int16_t height, uint8_t frames = 1);
+
            // Returns a pointer to the sprite or nullptr if not created, user must cast to pointer type
   void*    getPointer(void);
 
@@ -54,6 +116,9 @@ class TFT_eSprite : public TFT_eSPI {
 
            // Draw a single pixel at x,y
   void     drawPixel(int32_t x, int32_t y, uint32_t color);
+           // Draw a pixel at x,y blended with bg_color, or with the Sprite pixel if bg_color is not given.
+           // 16-bit Sprites blend in place and look a repeated colour pair up in a cached blendTable
+  uint16_t drawPixel(int32_t x, int32_t y, uint32_t color, uint8_t alpha, uint32_t bg_color = 0x00FFFFFF);
 
            // Draw a single character in the GLCD or GFXFF font
   void     drawChar(int32_t x, int32_t y, uint16_t c, uint32_t color, uint32_t bg, uint8_t size),
@@ -85,7 +150,10 @@ class TFT_eSprite : public TFT_eSPI {
            drawFastHLine(int32_t x, int32_t y, int32_t w, uint32_t color),
 
            // Fill a rectangular area with a color (aka draw a filled rectangle)
-           fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color);
+           fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color),
+
+           // Copy a row of colours in the Sprite byte order into the Sprite
+           pushRow(int32_t x, int32_t y, int32_t w, const uint16_t *data);
 
            // Set the coordinate rotation of the Sprite (for 1bpp Sprites only)
            // Note: this uses coordinate rotation and is primarily for ePaper which does not support
@@ -98,6 +166,15 @@ class TFT_eSprite : public TFT_eSPI {
            // Push a rotated copy of Sprite to another different Sprite with optional transparent colour
   bool     pushRotated(TFT_eSprite *spr, int16_t angle, uint32_t transp = 0x00FFFFFF);
 
+           // Build a transform that puts the Sprite pivot at x,y of the destination, scaled then
+           // rotated clockwise by angle degrees about the pivot (scales must be > 0)
+  void     setTransform(spriteTransform *m, float angle, float scaleX, float scaleY, float x, float y);
+           // Draw a transformed copy of this 8 or 16-bit Sprite into a 16-bit Sprite with optional
+           // transparent colour (8-bit: the pixel value) and bilinear filtering, a 256 entry RGB565
+           // palette maps 8-bit values instead of RGB332
+  bool     pushTransformed(TFT_eSprite *spr, const spriteTransform *m, uint32_t transp = 0x00FFFFFF,
+                           bool bilinear = false, const uint16_t *cmap = nullptr);
+
            // Get the TFT bounding box for a rotated copy of this Sprite
   bool     getRotatedBounds(int16_t angle, int16_t *min_x, int16_t *min_y, int16_t *max_x, int16_t *max_y);
            // Get the destination Sprite bounding box for a rotated copy of this Sprite
@@ -123,6 +200,11 @@ class TFT_eSprite : public TFT_eSPI {
   void     pushSprite(int32_t x, int32_t y);
   void     pushSprite(int32_t x, int32_t y, uint16_t transparent);
 
+           // Push the sprite to the TFT with DMA, 4 and 8-bit Sprites are expanded to RGB565 a few rows
+           // at a time while the previous rows are sent. A 256 entry RGB565 palette maps 8-bit values
+           // instead of RGB332. Use startWrite() first, the Sprite may be drawn again once this returns.
+  bool     pushSpriteDMA(int32_t x, int32_t y, const uint16_t *cmap = nullptr);
+
            // Push a windowed area of the sprite to the TFT at tx, ty
   bool     pushSprite(int32_t tx, int32_t ty, int32_t sx, int32_t sy, int32_t sw, int32_t sh);
 
@@ -130,6 +212,14 @@ class TFT_eSprite : public TFT_eSPI {
   bool     pushToSprite(TFT_eSprite *dspr, int32_t x, int32_t y);
   bool     pushToSprite(TFT_eSprite *dspr, int32_t x, int32_t y, uint16_t transparent);
 
+           // Scan a 16 or 8-bit Sprite once for the runs of pixels that are not the transparent colour.
+           // pushSprite() and pushToSprite() with the same transparent colour then copy those runs
+           // without testing each pixel. Drawing in the Sprite makes the runs stale: compile again
+           // after it, or uncompile. Returns false if there is no memory for the table.
+  bool     compileSprite(uint16_t transparent);
+  void     uncompileSprite(void);
+  bool     compiled(void) { return _spans != nullptr; }
+
            // Draw a single character in the selected font
   int16_t  drawChar(uint16_t uniCode, int32_t x, int32_t y, uint8_t font),
            drawChar(uint16_t uniCode, int32_t x, int32_t y);
@@ -152,8 +242,14 @@ class TFT_eSprite : public TFT_eSPI {
 
   TFT_eSPI *_tft;
 
-           // Reserve memory for the Sprite and return a pointer
-  void*    callocSprite(int16_t width, int16_t height, uint8_t frames = 1);
+           // Reserve memory for the Sprite and return a pointer, or use mem when it is given
+  void*    callocSprite(int16_t width, int16_t height, uint8_t frames = 1, void *mem = nullptr);
+
+           // Set the Sprite up on the memory callocSprite() returns
+  void*    placeSprite(int16_t width, int16_t height, uint8_t frames, void *mem);
+
+  TFT_eSpritePool *_pool; // pool the image came from, nullptr if not from a pool
+  bool     _preowned;     // the image is on memory the sketch owns
 
            // Override the non-inlined TFT_eSPI functions
   void     begin_nin_write(void) { ; }
@@ -170,6 +266,12 @@ class TFT_eSprite : public TFT_eSPI {
 
   uint16_t *_colorMap; // color map pointer: 16 entries, used with 4-bit color map.
 
+  uint16_t *_spans;    // compileSprite(): x and width of each opaque run, row after row
+  uint32_t *_spanRows; // index in _spans of the first run of each row, _dheight + 1 entries
+  uint16_t _spanKey;   // transparent colour the runs were compiled for
+
+  blendTable _blend;   // blends of the last fg/bg colour pair given to the alpha drawPixel()
+
   int32_t  _sinra;   // Sine of rotation angle in fixed point
   int32_t  _cosra;   // Cosine of rotation angle in fixed point
 
@@ -30,26 +30,8 @@
 #endif
 
 #ifdef ESP32_DMA
-  // DMA SPA handle
-  spi_device_handle_t dmaHAL;
-  #ifdef CONFIG_IDF_TARGET_ESP32
-    #define DMA_CHANNEL 1
-    #ifdef USE_HSPI_PORT
-      spi_host_device_t spi_host = HSPI_HOST;
-    #elif defined(USE_FSPI_PORT)
-      spi_host_device_t spi_host = SPI_HOST;
-    #else // use VSPI port
-      spi_host_device_t spi_host = VSPI_HOST;
-    #endif
-  #else
-    #ifdef USE_HSPI_PORT
-      #define DMA_CHANNEL SPI_DMA_CH_AUTO
-      spi_host_device_t spi_host = SPI3_HOST;
-    #else // use FSPI port
-      #define DMA_CHANNEL SPI_DMA_CH_AUTO
-      spi_host_device_t spi_host = SPI2_HOST;
-    #endif
-  #endif
+  // The SPI host and the DMA device handle are per instance, see setDMAHost()
+  #define DMA_CHANNEL SPI_DMA_CH_AUTO
 #endif
 
 ////////////////////////////////////////////////////////////////////////////////////////
@@ -157,6 +139,8 @@ void TFT_eSPI::gpioMode(uint8_t gpio, uint8_t mode)
 ***************************************************************************************/
 void TFT_eSPI::pushBlock(uint16_t color, uint32_t len)
 {
+  if (_shadow) shadowWrite(nullptr, color, len, false);
+
   uint8_t colorBin[] = { (uint8_t) (color >> 8), (uint8_t) color };
   if(len) spi.writePattern(&colorBin[0], 2, 1); len--;
   while(len--) {WR_L; WR_H;}
@@ -168,6 +152,8 @@ void TFT_eSPI::pushBlock(uint16_t color, uint32_t len)
 ***************************************************************************************/
 void TFT_eSPI::pushPixels(const void* data_in, uint32_t len)
 {
+  if (_shadow) shadowWrite((const uint16_t*)data_in, 0, len, !_swapBytes);
+
   uint8_t *data = (uint8_t*)data_in;
 
   if(_swapBytes) {
@@ -235,7 +221,8 @@ void TFT_eSPI::pushBlock(uint16_t color, uint32_t len){
 }
 //*/
 //*
-void TFT_eSPI::pushBlock(uint16_t color, uint32_t len){
+void TFT_IRAM TFT_eSPI::pushBlock(uint16_t color, uint32_t len){
+  if (_shadow) shadowWrite(nullptr, color, len, false);
 
   volatile uint32_t* spi_w = _spi_w;
   uint32_t color32 = (color<<8 | color >>8)<<16 | (color<<8 | color >>8);
@@ -282,7 +269,10 @@ void TFT_eSPI::pushBlock(uint16_t color, uint32_t len){
 ** Function name:           pushSwapBytePixels - for ESP32
 ** Description:             Write a sequence of pixels with swapped bytes
 ***************************************************************************************/
-void TFT_eSPI::pushSwapBytePixels(const void* data_in, uint32_t len){
+void TFT_IRAM TFT_eSPI::pushSwapBytePixels(const void* data_in, uint32_t len){
+  if (pushPixelsBurst(data_in, len, true)) return;
+
+  if (_shadow) shadowWrite((const uint16_t*)data_in, 0, len, false);
 
   uint8_t* data = (uint8_t*)data_in;
   uint32_t color[16];
@@ -371,13 +361,17 @@ void TFT_eSPI::pushSwapBytePixels(const void* data_in, uint32_t len){
 ** Function name:           pushPixels - for ESP32
 ** Description:             Write a sequence of pixels
 ***************************************************************************************/
-void TFT_eSPI::pushPixels(const void* data_in, uint32_t len){
+void TFT_IRAM TFT_eSPI::pushPixels(const void* data_in, uint32_t len){
 
   if(_swapBytes) {
     pushSwapBytePixels(data_in, len);
     return;
   }
 
+  if (pushPixelsBurst(data_in, len, false)) return;
+
+  if (_shadow) shadowWrite((const uint16_t*)data_in, 0, len, true);
+
   uint32_t *data = (uint32_t*)data_in;
 
   if (len > 31)
@@ -425,6 +419,42 @@ void TFT_eSPI::pushPixels(const void* data_in, uint32_t len){
   while (READ_PERI_REG(SPI_CMD_REG(SPI_PORT))&SPI_USR);
 }
 
+/***************************************************************************************
+** Function name:           pushIndexedPixels - for ESP32
+** Description:             Write 8-bit palette indices as RGB565 pixels
+***************************************************************************************/
+// The next 32 pixels are looked up while the previous ones shift out, as pushSwapBytePixels()
+// does, so the palette pass costs no time of its own. Palette byte order follows _swapBytes
+#define TFT_INDEXED_PIXELS // Replaces the generic version in TFT_eSPI.cpp
+void TFT_eSPI::pushIndexedPixels(const uint8_t* data, const uint16_t* cmap, uint32_t len){
+  uint32_t color[16];
+  bool swap = _swapBytes;
+
+  while (len)
+  {
+    uint32_t n = len > 32 ? 32 : len;
+    for (uint32_t i = 0; i < n; i += 2) {
+      uint16_t c0 = cmap[data[i]];
+      uint16_t c1 = (i + 1 < n) ? cmap[data[i + 1]] : 0;
+      if (swap) { c0 = c0 >> 8 | c0 << 8; c1 = c1 >> 8 | c1 << 8; }
+      color[i >> 1] = c0 | (uint32_t)c1 << 16;
+    }
+    if (_shadow) shadowWrite((const uint16_t*)color, 0, n, true);
+
+    while (READ_PERI_REG(SPI_CMD_REG(SPI_PORT))&SPI_USR);
+    WRITE_PERI_REG(SPI_MOSI_DLEN_REG(SPI_PORT), (n << 4) - 1);
+    for (uint32_t i = 0; i < (n + 1) >> 1; i++) WRITE_PERI_REG(SPI_W0_REG(SPI_PORT) + (i << 2), color[i]);
+#if CONFIG_IDF_TARGET_ESP32S3
+    SET_PERI_REG_MASK(SPI_CMD_REG(SPI_PORT), SPI_UPDATE);
+    while (READ_PERI_REG(SPI_CMD_REG(SPI_PORT))&SPI_UPDATE);
+#endif
+    SET_PERI_REG_MASK(SPI_CMD_REG(SPI_PORT), SPI_USR);
+    data += n;
+    len -= n;
+  }
+  while (READ_PERI_REG(SPI_CMD_REG(SPI_PORT))&SPI_USR);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////
 #elif defined (SPI_18BIT_DRIVER) // SPI 18-bit colour
 ////////////////////////////////////////////////////////////////////////////////////////
@@ -435,6 +465,8 @@ void TFT_eSPI::pushPixels(const void* data_in, uint32_t len){
 ***************************************************************************************/
 void TFT_eSPI::pushBlock(uint16_t color, uint32_t len)
 {
+  if (_shadow) shadowWrite(nullptr, color, len, false);
+
   // Split out the colours
   uint32_t r = (color & 0xF800)>>8;
   uint32_t g = (color & 0x07E0)<<5;
@@ -511,6 +543,7 @@ void TFT_eSPI::pushBlock(uint16_t color, uint32_t len)
 ** Description:             Write a sequence of pixels
 ***************************************************************************************/
 void TFT_eSPI::pushPixels(const void* data_in, uint32_t len){
+  if (_shadow) shadowWrite((const uint16_t*)data_in, 0, len, !_swapBytes);
 
   uint16_t *data = (uint16_t*)data_in;
   // ILI9488 write macro is not endianess dependant, hence !_swapBytes
@@ -523,6 +556,7 @@ void TFT_eSPI::pushPixels(const void* data_in, uint32_t len){
 ** Description:             Write a sequence of pixels with swapped bytes
 ***************************************************************************************/
 void TFT_eSPI::pushSwapBytePixels(const void* data_in, uint32_t len){
+  if (_shadow) shadowWrite((const uint16_t*)data_in, 0, len, false);
 
   uint16_t *data = (uint16_t*)data_in;
   // ILI9488 write macro is not endianess dependant, so swap byte macro not used here
@@ -538,6 +572,8 @@ void TFT_eSPI::pushSwapBytePixels(const void* data_in, uint32_t len){
 ** Description:             Write a block of pixels of the same colour
 ***************************************************************************************/
 void TFT_eSPI::pushBlock(uint16_t color, uint32_t len){
+  if (_shadow) shadowWrite(nullptr, color, len, false);
+
   if ( (color >> 8) == (color & 0x00FF) )
   { if (!len) return;
     tft_Write_16(color);
@@ -559,6 +595,7 @@ void TFT_eSPI::pushBlock(uint16_t color, uint32_t len){
 ** Description:             Write a sequence of pixels with swapped bytes
 ***************************************************************************************/
 void TFT_eSPI::pushSwapBytePixels(const void* data_in, uint32_t len){
+  if (_shadow) shadowWrite((const uint16_t*)data_in, 0, len, false);
 
   uint16_t *data = (uint16_t*)data_in;
   while ( len-- ) {tft_Write_16(*data); data++;}
@@ -569,6 +606,7 @@ void TFT_eSPI::pushSwapBytePixels(const void* data_in, uint32_t len){
 ** Description:             Write a sequence of pixels
 ***************************************************************************************/
 void TFT_eSPI::pushPixels(const void* data_in, uint32_t len){
+  if (_shadow) shadowWrite((const uint16_t*)data_in, 0, len, !_swapBytes);
 
   uint16_t *data = (uint16_t*)data_in;
   if(_swapBytes) { while ( len-- ) {tft_Write_16(*data); data++; } }
@@ -584,13 +622,298 @@ void TFT_eSPI::pushPixels(const void* data_in, uint32_t len){
 #if defined (ESP32_DMA) && !defined (TFT_PARALLEL_8_BIT) //       DMA FUNCTIONS
 ////////////////////////////////////////////////////////////////////////////////////////
 
+#ifndef TFT_DMA_QUEUE
+  #define TFT_DMA_QUEUE 24 // SPI transactions in the DMA queue, each queued image takes DMA_IMAGE_TRANS
+#endif
+#define DMA_WINDOW_TRANS 5 // CASET, column range, PASET, row range, RAMWR
+#define DMA_MAX_BYTES 65536 // ESP32 S3 max transaction size, larger images are split
+#define DMA_MAX_PIXELS (DMA_MAX_BYTES / 2)
+#define DMA_MAX_PACKED 65532 // bytes of 12 bit pixels per transaction, whole pixel pairs and words
+#define DMA_COLMOD 0x3A
+#define DMA_COLMOD_12 0x03  // 12 bits per pixel, 2 pixels in 3 bytes
+#define DMA_COLMOD_16 0x05
+#ifndef TFT_DMA_FILL_PIXELS
+  #define TFT_DMA_FILL_PIXELS 4096 // Pattern buffer of dmaFillRect(), a 240x240 fill takes 15 transactions
+#endif
+#ifndef TFT_BURST_PIXELS
+  #define TFT_BURST_PIXELS 1024 // Each of the two bounce buffers of pushPixelsBurst()
+#endif
+#ifndef TFT_BURST_MIN_PIXELS
+  #define TFT_BURST_MIN_PIXELS 256 // Shorter pushPixels() calls use the SPI registers
+#endif
+
+// Ring of pre-allocated transactions for dmaSubmitImage(), they complete in queue order
+static spi_transaction_t dmaRing[TFT_DMA_QUEUE];
+static dmaDoneCallback dmaRingDone[TFT_DMA_QUEUE]; // set on the last pixel transaction of an image
+static void *dmaRingArg[TFT_DMA_QUEUE];
+static bool dmaRingLast[TFT_DMA_QUEUE];            // true for the last pixel transaction of an image
+static uint8_t dmaRingHead = 0;                    // next slot to fill
+static uint8_t dmaRingQueued = 0;                  // slots in flight
+
+// dmaFillRect() sends one internal RAM buffer of a single colour over and over
+static uint16_t *dmaFillBuf = nullptr;             // TFT_DMA_FILL_PIXELS in wire byte order
+static uint16_t dmaFillColor = 0;                  // colour in dmaFillBuf
+static bool dmaRingFill[TFT_DMA_QUEUE];            // true for a transaction reading dmaFillBuf
+static uint8_t dmaFillQueued = 0;                  // such transactions in flight
+
+// Pixel format the panel is in after the queued transactions, dmaSubmitImage12() switches
+// to 12 bits, the 16 bit transfers queued after it and dmaWait() switch back
+static bool dmaColmod12 = false;
+
+// pushPixelsBurst() copies into one buffer while the other one is sent
+static uint16_t *dmaBurstBuf[2] = { nullptr, nullptr }; // TFT_BURST_PIXELS each, internal RAM
+
+#ifdef TFT_ESP_LCD_IO
+// pushImageDMA() and pushPixelsDMA() go through an esp_lcd panel IO device on the same
+// SPI host. It splits big transfers itself and the SPI master copies buffers the DMA
+// cannot read (PSRAM) into internal RAM. Queued windows and fills stay on dmaHAL: they
+// have their own commands in the queue, which esp_lcd would not send until the colour
+// transfers before them are over
+#include "esp_lcd_panel_io.h"
+#ifndef TFT_LCD_IO_QUEUE
+  #define TFT_LCD_IO_QUEUE 4 // esp_lcd transactions in flight, a 240x240 image takes 2
+#endif
+static esp_lcd_panel_io_handle_t lcdIo = nullptr;
+static SemaphoreHandle_t lcdIoIdle = nullptr;      // given when a colour transfer ends
+static uint32_t lcdIoSent = 0;                     // colour transfers queued, task side
+static volatile uint32_t lcdIoFinished = 0;        // and finished, written by lcdIoDone()
+
+static inline bool lcdIoBusy(void) { return lcdIoSent != lcdIoFinished; }
+#else
+static inline bool lcdIoBusy(void) { return false; }
+#endif
+
+/***************************************************************************************
+** Function name:           dmaRetire
+** Description:             Release a finished transaction, true if it ended an image
+***************************************************************************************/
+static bool TFT_IRAM dmaRetire(spi_transaction_t *rtrans)
+{
+  if (rtrans < dmaRing || rtrans >= dmaRing + TFT_DMA_QUEUE) return false; // not from the ring
+
+  uint8_t i = rtrans - dmaRing;
+  dmaRingQueued--;
+  if (dmaRingFill[i]) dmaFillQueued--;
+  if (dmaRingDone[i]) {
+    dmaDoneCallback done = dmaRingDone[i];
+    dmaRingDone[i] = nullptr;
+    done(dmaRingArg[i]);
+  }
+  return dmaRingLast[i];
+}
+
+/***************************************************************************************
+** Function name:           dmaRingNext
+** Description:             Claim the next ring slot (caller checks there is room)
+***************************************************************************************/
+static TFT_IRAM spi_transaction_t *dmaRingNext(void)
+{
+  uint8_t i = dmaRingHead;
+  dmaRingHead = (dmaRingHead + 1) % TFT_DMA_QUEUE;
+  dmaRingQueued++;
+  dmaRingDone[i] = nullptr;
+  dmaRingLast[i] = false;
+  dmaRingFill[i] = false;
+  memset(&dmaRing[i], 0, sizeof(spi_transaction_t));
+  return &dmaRing[i];
+}
+
+/***************************************************************************************
+** Function name:           dmaQueueCommand
+** Description:             Queue a command byte, with up to 2 16-bit parameters
+***************************************************************************************/
+static void TFT_IRAM dmaQueueCommand(spi_device_handle_t dmaHAL, uint8_t cmd, int params, uint16_t p0, uint16_t p1)
+{
+  spi_transaction_t *trans = dmaRingNext();
+  trans->user = (void *)0;            // DC low, see dc_callback()
+  trans->flags = SPI_TRANS_USE_TXDATA;
+  trans->length = 8;
+  trans->tx_data[0] = cmd;
+  esp_err_t ret = spi_device_queue_trans(dmaHAL, trans, portMAX_DELAY);
+  assert(ret == ESP_OK);
+
+  if (!params) return;
+  trans = dmaRingNext();
+  trans->user = (void *)1;            // DC high
+  trans->flags = SPI_TRANS_USE_TXDATA;
+  trans->length = 32;
+  trans->tx_data[0] = p0 >> 8; trans->tx_data[1] = p0;
+  trans->tx_data[2] = p1 >> 8; trans->tx_data[3] = p1;
+  ret = spi_device_queue_trans(dmaHAL, trans, portMAX_DELAY);
+  assert(ret == ESP_OK);
+}
+
+/***************************************************************************************
+** Function name:           dmaQueueColmod
+** Description:             Queue a pixel format switch if needed, returns transactions used
+***************************************************************************************/
+// Caller makes room for 2 slots and adds the result to spiBusyCheck
+static uint8_t dmaQueueColmod(spi_device_handle_t dmaHAL, bool twelve)
+{
+  if (twelve == dmaColmod12) return 0;
+  dmaQueueCommand(dmaHAL, DMA_COLMOD, 0, 0, 0);
+  spi_transaction_t *trans = dmaRingNext();
+  trans->user = (void *)1;
+  trans->flags = SPI_TRANS_USE_TXDATA;
+  trans->length = 8;
+  trans->tx_data[0] = twelve ? DMA_COLMOD_12 : DMA_COLMOD_16;
+  esp_err_t ret = spi_device_queue_trans(dmaHAL, trans, portMAX_DELAY);
+  assert(ret == ESP_OK);
+  dmaColmod12 = twelve;
+  return 2;
+}
+
+/***************************************************************************************
+** Function name:           dmaPackedTrans
+** Description:             Number of transactions needed for len packed bytes
+***************************************************************************************/
+static uint8_t TFT_IRAM dmaPackedTrans(uint32_t len)
+{
+  return (len + DMA_MAX_PACKED - 1) / DMA_MAX_PACKED;
+}
+
+/***************************************************************************************
+** Function name:           dmaQueuePacked
+** Description:             Queue 12 bit pixel bytes in transactions of DMA_MAX_PACKED or less
+***************************************************************************************/
+// Caller makes room for dmaPackedTrans(len) slots and adds them to spiBusyCheck
+static void TFT_IRAM dmaQueuePacked(spi_device_handle_t dmaHAL, uint8_t const* data, uint32_t len, dmaDoneCallback done, void *arg)
+{
+  while (len) {
+    uint32_t count = (len > DMA_MAX_PACKED) ? DMA_MAX_PACKED : len;
+    uint8_t slot = dmaRingHead;
+    spi_transaction_t *trans = dmaRingNext();
+    len -= count;
+    if (len == 0) {
+      dmaRingDone[slot] = done;
+      dmaRingArg[slot] = arg;
+      dmaRingLast[slot] = true;
+    }
+    trans->user = (void *)1;
+    trans->tx_buffer = data;
+    trans->length = count * 8;
+    esp_err_t ret = spi_device_queue_trans(dmaHAL, trans, portMAX_DELAY);
+    assert(ret == ESP_OK);
+    data += count;
+  }
+}
+
+/***************************************************************************************
+** Function name:           dmaPixelTrans
+** Description:             Number of transactions needed for len pixels
+***************************************************************************************/
+static uint8_t TFT_IRAM dmaPixelTrans(uint32_t len)
+{
+  return (len + DMA_MAX_PIXELS - 1) / DMA_MAX_PIXELS;
+}
+
+/***************************************************************************************
+** Function name:           dmaQueuePixels
+** Description:             Queue pixels in transactions of DMA_MAX_PIXELS or less
+***************************************************************************************/
+// Caller makes room for dmaPixelTrans(len) slots and adds them to spiBusyCheck
+static void TFT_IRAM dmaQueuePixels(spi_device_handle_t dmaHAL, uint16_t const* data, uint32_t len, dmaDoneCallback done, void *arg)
+{
+  while (len) {
+    uint32_t count = (len > DMA_MAX_PIXELS) ? DMA_MAX_PIXELS : len;
+    uint8_t slot = dmaRingHead;
+    spi_transaction_t *trans = dmaRingNext();
+    len -= count;
+    if (len == 0) { // the image is sent once its last part is
+      dmaRingDone[slot] = done;
+      dmaRingArg[slot] = arg;
+      dmaRingLast[slot] = true;
+    }
+    trans->user = (void *)1;
+    trans->tx_buffer = data;
+    trans->length = count * 16;      // Data length, in bits
+    esp_err_t ret = spi_device_queue_trans(dmaHAL, trans, portMAX_DELAY);
+    assert(ret == ESP_OK);
+    data += count;
+  }
+}
+
+/***************************************************************************************
+** Function name:           dmaFillTrans
+** Description:             Number of transactions needed for a fill of len pixels
+***************************************************************************************/
+static uint8_t dmaFillTrans(uint32_t len)
+{
+  return (len + TFT_DMA_FILL_PIXELS - 1) / TFT_DMA_FILL_PIXELS;
+}
+
+/***************************************************************************************
+** Function name:           dmaQueueFill
+** Description:             Queue len pixels of dmaFillBuf, repeating the buffer
+***************************************************************************************/
+// Caller makes room for dmaFillTrans(len) slots and adds them to spiBusyCheck
+static void dmaQueueFill(spi_device_handle_t dmaHAL, uint32_t len, dmaDoneCallback done, void *arg)
+{
+  while (len) {
+    uint32_t count = (len > TFT_DMA_FILL_PIXELS) ? TFT_DMA_FILL_PIXELS : len;
+    uint8_t slot = dmaRingHead;
+    spi_transaction_t *trans = dmaRingNext();
+    dmaRingFill[slot] = true;
+    dmaFillQueued++;
+    len -= count;
+    if (len == 0) {
+      dmaRingDone[slot] = done;
+      dmaRingArg[slot] = arg;
+      dmaRingLast[slot] = true;
+    }
+    trans->user = (void *)1;
+    trans->tx_buffer = dmaFillBuf;
+    trans->length = count * 16;
+    esp_err_t ret = spi_device_queue_trans(dmaHAL, trans, portMAX_DELAY);
+    assert(ret == ESP_OK);
+  }
+}
+
+#ifdef TFT_ESP_LCD_IO
+/***************************************************************************************
+** Function name:           lcdIoDone
+** Description:             esp_lcd callback at the end of a colour transfer (ISR)
+***************************************************************************************/
+static bool IRAM_ATTR lcdIoDone(esp_lcd_panel_io_handle_t io, esp_lcd_panel_io_event_data_t *edata, void *ctx)
+{
+  WRITE_PERI_REG(SPI_DMA_CONF_REG((spi_host_device_t)(intptr_t)ctx), 0); // as dma_end_callback(), for the register writes
+  lcdIoFinished = lcdIoFinished + 1;
+  BaseType_t woken = pdFALSE;
+  xSemaphoreGiveFromISR(lcdIoIdle, &woken);
+  return woken == pdTRUE;
+}
+
+/***************************************************************************************
+** Function name:           lcdIoWait
+** Description:             Wait until the esp_lcd colour transfers are over
+***************************************************************************************/
+static void TFT_IRAM lcdIoWait(void)
+{
+  // A give left over from an earlier transfer only costs one more turn
+  while (lcdIoBusy()) xSemaphoreTake(lcdIoIdle, portMAX_DELAY);
+}
+
+/***************************************************************************************
+** Function name:           lcdIoSend
+** Description:             Queue pixels for the window already set up, no command
+***************************************************************************************/
+static void TFT_IRAM lcdIoSend(uint16_t const* data, uint32_t len)
+{
+  lcdIoSent++;
+  esp_err_t ret = esp_lcd_panel_io_tx_color(lcdIo, -1, data, len * 2);
+  assert(ret == ESP_OK);
+}
+#endif
+
 /***************************************************************************************
 ** Function name:           dmaBusy
 ** Description:             Check if DMA is busy
 ***************************************************************************************/
-bool TFT_eSPI::dmaBusy(void)
+bool TFT_IRAM TFT_eSPI::dmaBusy(void)
 {
-  if (!DMA_Enabled || !spiBusyCheck) return false;
+  if (!DMA_Enabled) return false;
+  if (lcdIoBusy()) return true;
+  if (!spiBusyCheck) return false;
 
   spi_transaction_t *rtrans;
   esp_err_t ret;
@@ -598,7 +921,7 @@ bool TFT_eSPI::dmaBusy(void)
   for (int i = 0; i < checks; ++i)
   {
     ret = spi_device_get_trans_result(dmaHAL, &rtrans, 0);
-    if (ret == ESP_OK) spiBusyCheck--;
+    if (ret == ESP_OK) { spiBusyCheck--; dmaRetire(rtrans); }
   }
 
   //Serial.print("spiBusyCheck=");Serial.println(spiBusyCheck);
@@ -611,26 +934,247 @@ bool TFT_eSPI::dmaBusy(void)
 ** Function name:           dmaWait
 ** Description:             Wait until DMA is over (blocking!)
 ***************************************************************************************/
-void TFT_eSPI::dmaWait(void)
+void TFT_IRAM TFT_eSPI::dmaWait(void)
 {
-  if (!DMA_Enabled || !spiBusyCheck) return;
+#ifdef TFT_ESP_LCD_IO
+  if (DMA_Enabled) lcdIoWait();
+#endif
+  if (!DMA_Enabled || (!spiBusyCheck && !dmaColmod12)) return;
   spi_transaction_t *rtrans;
   esp_err_t ret;
   for (int i = 0; i < spiBusyCheck; ++i)
   {
     ret = spi_device_get_trans_result(dmaHAL, &rtrans, portMAX_DELAY);
     assert(ret == ESP_OK);
+    dmaRetire(rtrans);
   }
   spiBusyCheck = 0;
+
+  // Blocking drawing may follow, it sends 16 bit pixels
+  for (uint8_t i = dmaQueueColmod(dmaHAL, false); i; i--)
+  {
+    ret = spi_device_get_trans_result(dmaHAL, &rtrans, portMAX_DELAY);
+    assert(ret == ESP_OK);
+    dmaRetire(rtrans);
+  }
+}
+
+
+/***************************************************************************************
+** Function name:           dmaPoll
+** Description:             Retire finished transfers, returns transactions still queued
+***************************************************************************************/
+uint8_t TFT_IRAM TFT_eSPI::dmaPoll(bool wait)
+{
+  if (!DMA_Enabled) return 0;
+#ifdef TFT_ESP_LCD_IO
+  if (lcdIoBusy()) { // an image from pushImageDMA(), nothing is queued on dmaHAL behind it
+    if (wait) lcdIoWait();
+    return lcdIoBusy();
+  }
+#endif
+  spi_transaction_t *rtrans;
+  bool imageDone = false;
+  while (spiBusyCheck) {
+    // Only block while waiting for an image, then collect what has finished already
+    TickType_t timeout = (wait && !imageDone) ? portMAX_DELAY : 0;
+    if (spi_device_get_trans_result(dmaHAL, &rtrans, timeout) != ESP_OK) break;
+    spiBusyCheck--;
+    imageDone |= dmaRetire(rtrans);
+  }
+  return spiBusyCheck;
+}
+
+
+/***************************************************************************************
+** Function name:           dmaSubmitImage
+** Description:             Queue an image with its address window, never blocks
+***************************************************************************************/
+// Fixed const data assumed, will NOT clip or swap bytes
+// Images over DMA_MAX_PIXELS are split, the queue holds up to TFT_DMA_QUEUE - 5 parts
+bool TFT_IRAM TFT_eSPI::dmaSubmitImage(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t const* data,
+                              dmaDoneCallback done, void *arg)
+{
+  if ((w <= 0) || (h <= 0) || (!DMA_Enabled) || lcdIoBusy()) return false;
+
+  uint32_t len = w * h;
+  uint8_t needed = DMA_WINDOW_TRANS + dmaPixelTrans(len) + (dmaColmod12 ? 2 : 0);
+  if (TFT_DMA_QUEUE - dmaRingQueued < needed) dmaPoll(false);
+  if (TFT_DMA_QUEUE - dmaRingQueued < needed) return false;
+
+  int32_t x0 = x, y0 = y, x1 = x + w - 1, y1 = y + h - 1;
+  #ifdef CGRAM_OFFSET
+    x0 += colstart; x1 += colstart;
+    y0 += rowstart; y1 += rowstart;
+  #endif
+  addr_row = 0xFFFF; // the window caches of drawPixel() and setWindow() no longer hold
+  addr_col = 0xFFFF;
+  forgetWindow();
+
+  dmaQueueColmod(dmaHAL, false);
+  dmaQueueCommand(dmaHAL, TFT_CASET, 2, x0, x1);
+  dmaQueueCommand(dmaHAL, TFT_PASET, 2, y0, y1);
+  dmaQueueCommand(dmaHAL, TFT_RAMWR, 0, 0, 0);
+  dmaQueuePixels(dmaHAL, data, len, done, arg);
+  if (_shadow) {
+    shadowWindow(x, y, x + w - 1, y + h - 1);
+    shadowWrite(data, 0, len, true);
+  }
+
+  spiBusyCheck += needed;
+  return true;
+}
+
+
+/***************************************************************************************
+** Function name:           dmaSubmitImage12
+** Description:             Queue an image as 12 bit pixels, packing the data in place
+***************************************************************************************/
+// Big-endian RGB565 data is packed to RGB444, 2 pixels in 3 bytes, so 25% fewer bytes go
+// over the bus; the data holds the packed bytes afterwards, unless false was returned.
+// An odd pixel count ends with half a pair, which the panel drops
+bool TFT_IRAM TFT_eSPI::dmaSubmitImage12(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t* data,
+                                dmaDoneCallback done, void *arg)
+{
+  if ((w <= 0) || (h <= 0) || (!DMA_Enabled) || lcdIoBusy()) return false;
+
+  uint32_t len = w * h;
+  uint32_t bytes = (len * 3 + 1) / 2;
+  uint8_t needed = DMA_WINDOW_TRANS + dmaPackedTrans(bytes) + (dmaColmod12 ? 0 : 2);
+  if (TFT_DMA_QUEUE - dmaRingQueued < needed) dmaPoll(false);
+  if (TFT_DMA_QUEUE - dmaRingQueued < needed) return false;
+
+  if (_shadow) { // from the RGB565 pixels, before they are packed over
+    shadowWindow(x, y, x + w - 1, y + h - 1);
+    shadowWrite(data, 0, len, true);
+  }
+
+  // Pairs are read 4 bytes at a time and written 3, so the output stays behind the input
+  uint8_t *out = (uint8_t *)data;
+  for (uint32_t i = 0; i < len; i += 2) {
+    uint16_t a = __builtin_bswap16(data[i]);
+    uint16_t b = (i + 1 < len) ? __builtin_bswap16(data[i + 1]) : 0;
+    *out++ = (a >> 8 & 0xF0) | (a >> 7 & 0x0F);    // R1 G1
+    *out++ = (a << 3 & 0xF0) | (b >> 12);          // B1 R2
+    *out++ = (b >> 3 & 0xF0) | (b >> 1 & 0x0F);    // G2 B2
+  }
+
+  int32_t x0 = x, y0 = y, x1 = x + w - 1, y1 = y + h - 1;
+  #ifdef CGRAM_OFFSET
+    x0 += colstart; x1 += colstart;
+    y0 += rowstart; y1 += rowstart;
+  #endif
+  addr_row = 0xFFFF;
+  addr_col = 0xFFFF;
+  forgetWindow();
+
+  dmaQueueColmod(dmaHAL, true);
+  dmaQueueCommand(dmaHAL, TFT_CASET, 2, x0, x1);
+  dmaQueueCommand(dmaHAL, TFT_PASET, 2, y0, y1);
+  dmaQueueCommand(dmaHAL, TFT_RAMWR, 0, 0, 0);
+  dmaQueuePacked(dmaHAL, (uint8_t *)data, bytes, done, arg);
+
+  spiBusyCheck += needed;
+  return true;
+}
+
+
+/***************************************************************************************
+** Function name:           dmaFillRect
+** Description:             Queue a filled rectangle with its address window, never blocks
+***************************************************************************************/
+// Clips to the viewport and to the bounds of the viewport circle. The pattern buffer
+// holds one colour, so a fill in another colour waits for queued fills to finish
+bool TFT_eSPI::dmaFillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color,
+                           dmaDoneCallback done, void *arg)
+{
+  if (!DMA_Enabled || !dmaFillBuf || lcdIoBusy()) return false;
+
+  if (x < _vpX) { w += x - _vpX; x = _vpX; }
+  if (y < _vpY) { h += y - _vpY; y = _vpY; }
+  if ((x + w) > _vpW) w = _vpW - x;
+  if ((y + h) > _vpH) h = _vpH - y;
+  if ((w < 1) || (h < 1)) return false;
+  if (!clipCircleRect(&x, &y, &w, &h)) return false;
+
+  uint32_t len = w * h;
+  uint8_t needed = DMA_WINDOW_TRANS + dmaFillTrans(len) + (dmaColmod12 ? 2 : 0);
+  uint16_t wire = (uint16_t)(color << 8 | (color >> 8 & 0xFF));
+  if (needed > TFT_DMA_QUEUE) return false; // never fits, use fillRect()
+  if (TFT_DMA_QUEUE - dmaRingQueued < needed || (dmaFillQueued && wire != dmaFillColor)) {
+    dmaPoll(false);
+    if (TFT_DMA_QUEUE - dmaRingQueued < needed || (dmaFillQueued && wire != dmaFillColor)) return false;
+  }
+
+  if (wire != dmaFillColor) {
+    for (uint32_t i = 0; i < TFT_DMA_FILL_PIXELS; i++) dmaFillBuf[i] = wire;
+    dmaFillColor = wire;
+  }
+
+  int32_t x0 = x, y0 = y, x1 = x + w - 1, y1 = y + h - 1;
+  #ifdef CGRAM_OFFSET
+    x0 += colstart; x1 += colstart;
+    y0 += rowstart; y1 += rowstart;
+  #endif
+  addr_row = 0xFFFF;
+  addr_col = 0xFFFF;
+  forgetWindow();
+
+  dmaQueueColmod(dmaHAL, false);
+  dmaQueueCommand(dmaHAL, TFT_CASET, 2, x0, x1);
+  dmaQueueCommand(dmaHAL, TFT_PASET, 2, y0, y1);
+  dmaQueueCommand(dmaHAL, TFT_RAMWR, 0, 0, 0);
+  dmaQueueFill(dmaHAL, len, done, arg);
+  if (_shadow) {
+    shadowWindow(x, y, x + w - 1, y + h - 1);
+    shadowWrite(nullptr, color, len, false);
+  }
+
+  spiBusyCheck += needed;
+  return true;
+}
+
+
+/***************************************************************************************
+** Function name:           pushPixelsBurst
+** Description:             Send pixels through two DMA buffers, false to use the registers
+***************************************************************************************/
+// The register path loads 64 bytes and then waits for them to shift out. Here the next
+// TFT_BURST_PIXELS are copied (and byte swapped if swap) while the previous ones are
+// sent, and the call returns once the last one has been, like the register path does
+bool TFT_eSPI::pushPixelsBurst(const void* data_in, uint32_t len, bool swap)
+{
+  if (!DMA_Enabled || !dmaBurstBuf[1] || len < TFT_BURST_MIN_PIXELS) return false;
+
+  dmaWait();                // nothing else may be queued ahead of the window set up by the caller
+  SPI_BUSY_CHECK;           // nor may a register write still be shifting out
+  if (_shadow) shadowWrite((const uint16_t*)data_in, 0, len, !swap);
+
+  const uint16_t *data = (const uint16_t*)data_in;
+  uint8_t b = 0;
+  while (len) {
+    uint32_t n = (len > TFT_BURST_PIXELS) ? TFT_BURST_PIXELS : len;
+    while (spiBusyCheck > 1) dmaPoll(true); // the buffer about to be filled was sent
+    uint16_t *buf = dmaBurstBuf[b];
+    if (swap) for (uint32_t i = 0; i < n; i++) buf[i] = data[i] << 8 | data[i] >> 8;
+    else memcpy(buf, data, n * sizeof(uint16_t));
+    dmaQueuePixels(dmaHAL, buf, n, nullptr, nullptr);
+    spiBusyCheck += dmaPixelTrans(n);
+    data += n;
+    len -= n;
+    b ^= 1;
+  }
+  dmaWait();
+  return true;
 }
 
 
 /***************************************************************************************
 ** Function name:           pushPixelsDMA
-** Description:             Push pixels to TFT (len must be less than 32767)
+** Description:             Push pixels to TFT, split into DMA_MAX_PIXELS transactions
 ***************************************************************************************/
 // This will byte swap the original image if setSwapBytes(true) was called by sketch.
-void TFT_eSPI::pushPixelsDMA(uint16_t* image, uint32_t len)
+void TFT_IRAM TFT_eSPI::pushPixelsDMA(uint16_t* image, uint32_t len)
 {
   if ((len == 0) || (!DMA_Enabled)) return;
 
@@ -640,41 +1184,26 @@ void TFT_eSPI::pushPixelsDMA(uint16_t* image, uint32_t len)
     for (uint32_t i = 0; i < len; i++) (image[i] = image[i] << 8 | image[i] >> 8);
   }
 
-  // DMA byte count for transmit is 64Kbytes maximum, so to avoid this constraint
-  // small transfers are performed using a blocking call until DMA capacity is reached.
-  // User sketch can prevent blocking by managing pixel count and splitting into blocks
-  // of 32768 pixels maximum. (equivalent to an area of ~320 x 100 pixels)
-  bool temp = _swapBytes;
-  _swapBytes = false;
-  while(len>0x4000) { // Transfer 16-bit pixels in blocks if len*2 over 65536 bytes
-    pushPixels(image, 0x400);
-    len -= 0x400; image+= 0x400; // Arbitrarily send 1K pixel blocks (2Kbytes)
+#ifdef TFT_ESP_LCD_IO
+  if (lcdIo) lcdIoSend(image, len); // esp_lcd splits the transfer itself
+  else
+#endif
+  {
+    // DMA byte count for transmit is 64Kbytes maximum, so the pixels are queued in
+    // parts of DMA_MAX_PIXELS; the queue is empty after dmaWait()
+    dmaQueuePixels(dmaHAL, image, len, nullptr, nullptr);
+    spiBusyCheck += dmaPixelTrans(len);
   }
-  _swapBytes = temp;
-
-  esp_err_t ret;
-  static spi_transaction_t trans;
-
-  memset(&trans, 0, sizeof(spi_transaction_t));
-
-  trans.user = (void *)1;
-  trans.tx_buffer = image;  //finally send the line data
-  trans.length = len * 16;        //Data length, in bits
-  trans.flags = 0;                //SPI_TRANS_USE_TXDATA flag
-
-  ret = spi_device_queue_trans(dmaHAL, &trans, portMAX_DELAY);
-  assert(ret == ESP_OK);
-
-  spiBusyCheck++;
+  if (_shadow) shadowWrite(image, 0, len, true);
 }
 
 
 /***************************************************************************************
 ** Function name:           pushImageDMA
-** Description:             Push image to a window (w*h must be less than 65536)
+** Description:             Push image to a window, split into DMA_MAX_PIXELS transactions
 ***************************************************************************************/
 // Fixed const data assumed, will NOT clip or swap bytes
-void TFT_eSPI::pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t const* image)
+void TFT_IRAM TFT_eSPI::pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t const* image)
 {
   if ((w == 0) || (h == 0) || (!DMA_Enabled)) return;
 
@@ -684,41 +1213,26 @@ void TFT_eSPI::pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t
   dmaWait();
 
   setAddrWindow(x, y, w, h);
-  // DMA byte count for transmit is 64Kbytes maximum, so to avoid this constraint
-  // small transfers are performed using a blocking call until DMA capacity is reached.
-  // User sketch can prevent blocking by managing pixel count and splitting into blocks
-  // of 32768 pixels maximum. (equivalent to an area of ~320 x 100 pixels)
-  bool temp = _swapBytes;
-  _swapBytes = false;
-  while(len>0x4000) { // Transfer 16-bit pixels in blocks if len*2 over 65536 bytes
-    pushPixels(buffer, 0x400);
-    len -= 0x400; buffer+= 0x400; // Arbitrarily send 1K pixel blocks (2Kbytes)
-  }
-  _swapBytes = temp;
-
-  esp_err_t ret;
-  static spi_transaction_t trans;
-
-  memset(&trans, 0, sizeof(spi_transaction_t));
-
-  trans.user = (void *)1;
-  trans.tx_buffer = buffer;   //Data pointer
-  trans.length = len * 16;   //Data length, in bits
-  trans.flags = 0;           //SPI_TRANS_USE_TXDATA flag
-
-  ret = spi_device_queue_trans(dmaHAL, &trans, portMAX_DELAY);
-  assert(ret == ESP_OK);
-
-  spiBusyCheck++;
+#ifdef TFT_ESP_LCD_IO
+  if (lcdIo) lcdIoSend(buffer, len); // esp_lcd splits the transfer itself
+  else
+#endif
+  {
+    // DMA byte count for transmit is 64Kbytes maximum, so the pixels are queued in
+    // parts of DMA_MAX_PIXELS; the queue is empty after dmaWait()
+    dmaQueuePixels(dmaHAL, buffer, len, nullptr, nullptr);
+    spiBusyCheck += dmaPixelTrans(len);
+  }
+  if (_shadow) shadowWrite(buffer, 0, len, true);
 }
 
 
 /***************************************************************************************
 ** Function name:           pushImageDMA
-** Description:             Push image to a window (w*h must be less than 65536)
+** Description:             Push image to a window, split into DMA_MAX_PIXELS transactions
 ***************************************************************************************/
 // This will clip and also swap bytes if setSwapBytes(true) was called by sketch
-void TFT_eSPI::pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t* image, uint16_t* buffer)
+void TFT_IRAM TFT_eSPI::pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t* image, uint16_t* buffer)
 {
   if ((x >= _vpW) || (y >= _vpH) || (!DMA_Enabled)) return;
 
@@ -735,10 +1249,18 @@ void TFT_eSPI::pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t
 
   if (dw < 1 || dh < 1) return;
 
+  // Round display: the copy below also drops what lies outside the viewport circle
+  if (_vpCircle) {
+    int32_t cx = x, cy = y;
+    if (!clipCircleRect(&cx, &cy, &dw, &dh)) return;
+    dx += cx - x; x = cx;
+    dy += cy - y; y = cy;
+  }
+
   uint32_t len = dw*dh;
 
-  if (buffer == nullptr) {
-    buffer = image;
+  if (buffer == nullptr || dmaColmod12) { // the window below is set up with blocking writes
+    if (buffer == nullptr) buffer = image;
     dmaWait();
   }
 
@@ -768,36 +1290,21 @@ void TFT_eSPI::pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t
     }
   }
 
-  if (spiBusyCheck) dmaWait(); // In case we did not wait earlier
+  if (spiBusyCheck || lcdIoBusy()) dmaWait(); // In case we did not wait earlier
 
   setAddrWindow(x, y, dw, dh);
 
-  // DMA byte count for transmit is 64Kbytes maximum, so to avoid this constraint
-  // small transfers are performed using a blocking call until DMA capacity is reached.
-  // User sketch can prevent blocking by managing pixel count and splitting into blocks
-  // of 32768 pixels maximum. (equivalent to an area of ~320 x 100 pixels)
-  bool temp = _swapBytes;
-  _swapBytes = false;
-  while(len>0x4000) { // Transfer 16-bit pixels in blocks if len*2 over 65536 bytes
-    pushPixels(buffer, 0x400);
-    len -= 0x400; buffer+= 0x400; // Arbitrarily send 1K pixel blocks (2Kbytes)
+#ifdef TFT_ESP_LCD_IO
+  if (lcdIo) lcdIoSend(buffer, len); // esp_lcd splits the transfer itself
+  else
+#endif
+  {
+    // DMA byte count for transmit is 64Kbytes maximum, so the pixels are queued in
+    // parts of DMA_MAX_PIXELS; the queue is empty after dmaWait()
+    dmaQueuePixels(dmaHAL, buffer, len, nullptr, nullptr);
+    spiBusyCheck += dmaPixelTrans(len);
   }
-  _swapBytes = temp;
-
-  esp_err_t ret;
-  static spi_transaction_t trans;
-
-  memset(&trans, 0, sizeof(spi_transaction_t));
-
-  trans.user = (void *)1;
-  trans.tx_buffer = buffer;  //finally send the line data
-  trans.length = len * 16;   //Data length, in bits
-  trans.flags = 0;           //SPI_TRANS_USE_TXDATA flag
-
-  ret = spi_device_queue_trans(dmaHAL, &trans, portMAX_DELAY);
-  assert(ret == ESP_OK);
-
-  spiBusyCheck++;
+  if (_shadow) shadowWrite(buffer, 0, len, true);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////
@@ -821,20 +1328,41 @@ void IRAM_ATTR dc_callback(spi_transaction_t *spi_tx)
 ** Function name:           dma_end_callback
 ** Description:             Clear DMA run flag to stop retransmission loop
 ***************************************************************************************/
-extern "C" void dma_end_callback();
+// One per SPI host, the device callbacks get no context of their own
+static void IRAM_ATTR dma_end_callback(spi_transaction_t *spi_tx)
+{
+  WRITE_PERI_REG(SPI_DMA_CONF_REG(SPI2_HOST), 0);
+}
 
-void IRAM_ATTR dma_end_callback(spi_transaction_t *spi_tx)
+static void IRAM_ATTR dma_end_callback_spi3(spi_transaction_t *spi_tx)
 {
-  WRITE_PERI_REG(SPI_DMA_CONF_REG(spi_host), 0);
+  WRITE_PERI_REG(SPI_DMA_CONF_REG(SPI3_HOST), 0);
+}
+
+/***************************************************************************************
+** Function name:           setDMAHost
+** Description:             Select the SPI host initDMA() takes - false while DMA is on
+***************************************************************************************/
+bool TFT_eSPI::setDMAHost(spi_host_device_t host)
+{
+  if (DMA_Enabled || (host != SPI2_HOST && host != SPI3_HOST)) return false;
+  spi_host = host;
+  return true;
 }
 
 /***************************************************************************************
 ** Function name:           initDMA
 ** Description:             Initialise the DMA engine - returns true if init OK
 ***************************************************************************************/
+// Each instance has its own SPI host and device handle, but the transaction ring, fill and
+// burst buffers above exist once, like the compile time pins and SPI_PORT registers; a
+// second instance gets false here until the first one calls deInitDMA(), instead of
+// aborting in spi_bus_initialize() or sharing the ring
+static TFT_eSPI *dmaOwner = nullptr;
+
 bool TFT_eSPI::initDMA(bool ctrl_cs)
 {
-  if (DMA_Enabled) return false;
+  if (DMA_Enabled || dmaOwner) return false;
 
   esp_err_t ret;
   spi_bus_config_t buscfg = {
@@ -847,7 +1375,7 @@ bool TFT_eSPI::initDMA(bool ctrl_cs)
     .data5_io_num = -1,
     .data6_io_num = -1,
     .data7_io_num = -1,
-    .max_transfer_sz = 65536, // ESP32 S3 max size is 64Kbytes
+    .max_transfer_sz = DMA_MAX_BYTES, // ESP32 S3 max size is 64Kbytes
     .flags = 0,
     .intr_flags = 0
   };
@@ -863,21 +1391,57 @@ bool TFT_eSPI::initDMA(bool ctrl_cs)
     .duty_cycle_pos = 0,
     .cs_ena_pretrans = 0,
     .cs_ena_posttrans = 0,
-    .clock_speed_hz = SPI_FREQUENCY,
+    .clock_speed_hz = (int)_writeFreq, // setWriteFrequency() or tuneWriteFrequency() before initDMA()
     .input_delay_ns = 0,
     .spics_io_num = pin,
     .flags = SPI_DEVICE_NO_DUMMY, //0,
-    .queue_size = 1,            // Not using queues
-    .pre_cb = 0, //dc_callback, //Callback to handle D/C line (not used)
-    .post_cb = dma_end_callback //Callback to end transmission
+    .queue_size = TFT_DMA_QUEUE, // Ring of dmaSubmitImage() transactions
+    .pre_cb = dc_callback,       // Callback to handle D/C line for queued address windows
+    .post_cb = spi_host == SPI3_HOST ? dma_end_callback_spi3 : dma_end_callback //Callback to end transmission
   };
   ret = spi_bus_initialize(spi_host, &buscfg, DMA_CHANNEL);
   ESP_ERROR_CHECK(ret);
   ret = spi_bus_add_device(spi_host, &devcfg, &dmaHAL);
   ESP_ERROR_CHECK(ret);
 
+  // Optional, dmaFillRect() returns false without it
+  dmaFillBuf = (uint16_t *)heap_caps_malloc(TFT_DMA_FILL_PIXELS * sizeof(uint16_t), MALLOC_CAP_DMA);
+  if (dmaFillBuf) memset(dmaFillBuf, 0, TFT_DMA_FILL_PIXELS * sizeof(uint16_t));
+  dmaFillColor = 0;
+  dmaFillQueued = 0;
+
+  // Optional too, pushPixels() stays on the SPI registers without them
+  dmaBurstBuf[0] = (uint16_t *)heap_caps_malloc(TFT_BURST_PIXELS * sizeof(uint16_t), MALLOC_CAP_DMA);
+  dmaBurstBuf[1] = (uint16_t *)heap_caps_malloc(TFT_BURST_PIXELS * sizeof(uint16_t), MALLOC_CAP_DMA);
+  if (!dmaBurstBuf[0] || !dmaBurstBuf[1]) {
+    heap_caps_free(dmaBurstBuf[0]);
+    heap_caps_free(dmaBurstBuf[1]);
+    dmaBurstBuf[0] = dmaBurstBuf[1] = nullptr;
+  }
+
+#ifdef TFT_ESP_LCD_IO
+  // Optional as well, the pixels of pushImageDMA() go through dmaHAL without it
+  esp_lcd_panel_io_spi_config_t iocfg = {};
+  iocfg.cs_gpio_num = pin;
+  iocfg.dc_gpio_num = TFT_DC;
+  iocfg.spi_mode = TFT_SPI_MODE;
+  iocfg.pclk_hz = _writeFreq;
+  iocfg.trans_queue_depth = TFT_LCD_IO_QUEUE;
+  iocfg.on_color_trans_done = lcdIoDone;
+  iocfg.user_ctx = (void *)(intptr_t)spi_host;
+  iocfg.lcd_cmd_bits = 8;
+  iocfg.lcd_param_bits = 8;
+  lcdIoSent = lcdIoFinished = 0;
+  if (!lcdIoIdle) lcdIoIdle = xSemaphoreCreateBinary();
+  if (!lcdIoIdle || esp_lcd_new_panel_io_spi((esp_lcd_spi_bus_handle_t)spi_host, &iocfg, &lcdIo) != ESP_OK)
+    lcdIo = nullptr;
+#endif
+
   DMA_Enabled = true;
+  dmaOwner = this;
   spiBusyCheck = 0;
+  dmaRingHead = 0;
+  dmaRingQueued = 0;
   return true;
 }
 
@@ -888,9 +1452,21 @@ bool TFT_eSPI::initDMA(bool ctrl_cs)
 void TFT_eSPI::deInitDMA(void)
 {
   if (!DMA_Enabled) return;
+  dmaWait();
+#ifdef TFT_ESP_LCD_IO
+  if (lcdIo) esp_lcd_panel_io_del(lcdIo);
+  lcdIo = nullptr;
+#endif
   spi_bus_remove_device(dmaHAL);
   spi_bus_free(spi_host);
+  dmaHAL = nullptr;
+  heap_caps_free(dmaFillBuf);
+  dmaFillBuf = nullptr;
+  heap_caps_free(dmaBurstBuf[0]);
+  heap_caps_free(dmaBurstBuf[1]);
+  dmaBurstBuf[0] = dmaBurstBuf[1] = nullptr;
   DMA_Enabled = false;
+  dmaOwner = nullptr;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////
@@ -13,6 +13,7 @@
 // Include processor specific header
 #include "soc/spi_reg.h"
 #include "driver/spi_master.h"
+#include "esp_heap_caps.h"
 #include "hal/gpio_ll.h"
 
 #if !defined(CONFIG_IDF_TARGET_ESP32S3) && !defined(CONFIG_IDF_TARGET_ESP32S2) && !defined(CONFIG_IDF_TARGET_ESP32)
@@ -43,6 +44,16 @@
   #define SUPPORT_TRANSACTIONS
 #endif
 
+// The pixel pushes and the DMA queue and submit path run from IRAM, so sending a strip doesn't
+// fetch code through the flash cache that WiFi and SD traffic keep evicting. Define TFT_NO_IRAM
+// in the setup to leave them in flash and keep the few KB of IRAM
+#include "esp_attr.h"
+#ifndef TFT_NO_IRAM
+  #define TFT_IRAM IRAM_ATTR
+#else
+  #define TFT_IRAM
+#endif
+
 /*
 ESP32:
 FSPI not defined
@@ -136,6 +147,12 @@ SPI3_HOST = 2
   #define ESP32_DMA
   // Code to check if DMA is busy, used by SPI DMA + transaction + endWrite functions
   #define DMA_BUSY_CHECK  dmaWait()
+  // SPI host initDMA() takes unless setDMAHost() picks another
+  #ifdef USE_HSPI_PORT
+    #define TFT_DMA_HOST SPI3_HOST
+  #else // use FSPI port
+    #define TFT_DMA_HOST SPI2_HOST
+  #endif
 #else
   #define DMA_BUSY_CHECK
 #endif
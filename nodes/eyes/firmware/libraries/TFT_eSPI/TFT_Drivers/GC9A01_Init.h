@@ -226,7 +226,11 @@
   writecommand(0x21);
 
   writecommand(0x11);
-  delay(120);
+  end_tft_write();         // sleep out: the bus is free for initStep()'s caller meanwhile
+  TFT_INIT_WAIT(10, 120);
+  begin_tft_write();
   writecommand(0x29);
-  delay(20);
+  end_tft_write();         // display on
+  TFT_INIT_WAIT(11, 20);
+  begin_tft_write();
 }
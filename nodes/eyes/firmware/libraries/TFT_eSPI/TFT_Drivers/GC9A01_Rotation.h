@@ -1,7 +1,7 @@
 
 // This is the command sequence that rotates the GC9A01 driver coordinate frame
 
-  rotation = m % 4;
+  rotation = m % 8; // 4-7 are 0-3 mirrored left to right
 
   writecommand(TFT_MADCTL);
   switch (rotation) {
@@ -51,6 +51,54 @@
         colstart = 1;
         rowstart = 2;
       }
+#endif
+      break;
+    case 4: // Mirrored portrait
+      writedata(TFT_MAD_MX | TFT_MAD_BGR);
+      _width  = _init_width;
+      _height = _init_height;
+#ifdef CGRAM_OFFSET
+      if (_init_width == 128)
+      {
+        colstart = 2;
+        rowstart = 1;
+      }
+#endif
+      break;
+    case 5: // Mirrored landscape
+      writedata(TFT_MAD_MX | TFT_MAD_MY | TFT_MAD_MV | TFT_MAD_BGR);
+      _width  = _init_height;
+      _height = _init_width;
+#ifdef CGRAM_OFFSET
+      if (_init_width == 128)
+      {
+        colstart = 1;
+        rowstart = 2;
+      }
+#endif
+      break;
+    case 6: // Mirrored inverted portrait
+      writedata(TFT_MAD_MY | TFT_MAD_BGR);
+      _width  = _init_width;
+      _height = _init_height;
+#ifdef CGRAM_OFFSET
+      if (_init_width == 128)
+      {
+        colstart = 2;
+        rowstart = 1;
+      }
+#endif
+      break;
+    case 7: // Mirrored inverted landscape
+      writedata(TFT_MAD_MV | TFT_MAD_BGR);
+      _width  = _init_height;
+      _height = _init_width;
+#ifdef CGRAM_OFFSET
+      if (_init_width == 128)
+      {
+        colstart = 1;
+        rowstart = 2;
+      }
 #endif
       break;
   }
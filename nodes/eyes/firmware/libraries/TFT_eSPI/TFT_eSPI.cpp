@@ -72,24 +72,26 @@
 ** Description:             Start SPI transaction for writes and select TFT
 ***************************************************************************************/
 inline void TFT_eSPI::begin_tft_write(void){
+  if (_batchCount) runBatch(); // Recorded fills go first
   if (locked) {
     locked = false; // Flag to show SPI access now unlocked
 #if defined (SPI_HAS_TRANSACTION) && defined (SUPPORT_TRANSACTIONS) && !defined(TFT_PARALLEL_8_BIT) && !defined(RP2040_PIO_INTERFACE)
-    spi.beginTransaction(SPISettings(SPI_FREQUENCY, MSBFIRST, TFT_SPI_MODE));
+    spi.beginTransaction(SPISettings(_writeFreq, MSBFIRST, TFT_SPI_MODE));
 #endif
-    CS_L;
+    if (!_panelHold) { CS_L; } // CS_L can be multi-statement
     SET_BUS_WRITE_MODE;  // Some processors (e.g. ESP32) allow recycling the tx buffer when rx is not used
   }
 }
 
 // Non-inlined version to permit override
 void TFT_eSPI::begin_nin_write(void){
+  if (_batchCount) runBatch();
   if (locked) {
     locked = false; // Flag to show SPI access now unlocked
 #if defined (SPI_HAS_TRANSACTION) && defined (SUPPORT_TRANSACTIONS) && !defined(TFT_PARALLEL_8_BIT) && !defined(RP2040_PIO_INTERFACE)
-    spi.beginTransaction(SPISettings(SPI_FREQUENCY, MSBFIRST, TFT_SPI_MODE));
+    spi.beginTransaction(SPISettings(_writeFreq, MSBFIRST, TFT_SPI_MODE));
 #endif
-    CS_L;
+    if (!_panelHold) { CS_L; } // CS_L can be multi-statement
     SET_BUS_WRITE_MODE;  // Some processors (e.g. ESP32) allow recycling the tx buffer when rx is not used
   }
 }
@@ -133,6 +135,7 @@ inline void TFT_eSPI::end_nin_write(void){
 ***************************************************************************************/
 // Reads require a lower SPI clock rate than writes
 inline void TFT_eSPI::begin_tft_read(void){
+  if (_batchCount) runBatch();
   DMA_BUSY_CHECK; // Wait for any DMA transfer to complete before changing SPI settings
 #if defined (SPI_HAS_TRANSACTION) && defined (SUPPORT_TRANSACTIONS) && !defined(TFT_PARALLEL_8_BIT) && !defined(RP2040_PIO_INTERFACE)
   if (locked) {
@@ -164,19 +167,103 @@ inline void TFT_eSPI::end_tft_read(void){
   }
 #else
   #if !defined(TFT_PARALLEL_8_BIT) && !defined(RP2040_PIO_INTERFACE)
-    spi.setFrequency(SPI_FREQUENCY);
+    spi.setFrequency(_writeFreq);
   #endif
    if(!inTransaction) {CS_H;}
 #endif
   SET_BUS_WRITE_MODE;
 }
 
+/***************************************************************************************
+** Function name:           setWriteFrequency
+** Description:             Set the SPI clock for the following write transactions
+***************************************************************************************/
+void TFT_eSPI::setWriteFrequency(uint32_t hz)
+{
+  _writeFreq = hz;
+}
+
+/***************************************************************************************
+** Function name:           getWriteFrequency
+** Description:             Return the SPI write clock
+***************************************************************************************/
+uint32_t TFT_eSPI::getWriteFrequency(void)
+{
+  return _writeFreq;
+}
+
+/***************************************************************************************
+** Function name:           tuneWriteFrequency
+** Description:             Find the fastest write clock a test pattern survives
+***************************************************************************************/
+// The top left corner is outside the visible circle of a round display. ESP32 SPI
+// clocks are APB_CLK_FREQ / n, so those are the steps tried.
+#define TUNE_BLOCK_W 32
+#define TUNE_BLOCK_H 8
+#define TUNE_PIXELS  (TUNE_BLOCK_W * TUNE_BLOCK_H)
+uint32_t TFT_eSPI::tuneWriteFrequency(uint32_t max_hz)
+{
+#if defined (ESP32) && !defined (TFT_PARALLEL_8_BIT)
+  #ifndef APB_CLK_FREQ
+    #define APB_CLK_FREQ 80000000
+  #endif
+  uint16_t saved[TUNE_PIXELS], pattern[TUNE_PIXELS], readback[TUNE_PIXELS];
+
+  // The panel itself is checked: raw pixels, no circle clipping and no shadow copy
+  bool swap = _swapBytes, circle = _vpCircle;
+  uint16_t *shadow = _shadow;
+  _swapBytes = false;
+  _vpCircle  = false;
+  _shadow    = nullptr;
+
+  // Alternating bits, full swings between pixels, then pseudo random data
+  auto passes = [&](uint32_t hz) {
+    setWriteFrequency(hz);
+    uint32_t rnd = 0x2545F491;
+    for (uint8_t run = 0; run < 3; run++) {
+      for (uint32_t i = 0; i < TUNE_PIXELS; i++) {
+        if (run == 0) pattern[i] = (i & 1) ? 0xAAAA : 0x5555;
+        else if (run == 1) pattern[i] = (i & 1) ? 0xFFFF : 0x0000;
+        else { rnd ^= rnd << 13; rnd ^= rnd >> 17; rnd ^= rnd << 5; pattern[i] = (uint16_t)rnd; }
+      }
+      pushImage(0, 0, TUNE_BLOCK_W, TUNE_BLOCK_H, pattern);
+      readRect(0, 0, TUNE_BLOCK_W, TUNE_BLOCK_H, readback);
+      if (memcmp(pattern, readback, sizeof(pattern))) return false;
+    }
+    return true;
+  };
+
+  uint32_t start = _writeFreq, best = 0;
+  readRect(0, 0, TUNE_BLOCK_W, TUNE_BLOCK_H, saved);
+  if (passes(start)) {
+    best = start;
+    for (uint32_t div = APB_CLK_FREQ / start; div >= 1; div--) {
+      uint32_t hz = APB_CLK_FREQ / div;
+      if (hz <= best) continue;
+      if (hz > max_hz || !passes(hz)) break;
+      best = hz;
+    }
+  }
+  setWriteFrequency(best ? best : start);
+  pushImage(0, 0, TUNE_BLOCK_W, TUNE_BLOCK_H, saved);
+
+  _swapBytes = swap;
+  _vpCircle  = circle;
+  _shadow    = shadow;
+  return best;
+#else
+  (void)max_hz;
+  return 0;
+#endif
+}
+
 /***************************************************************************************
 ** Function name:           setViewport
 ** Description:             Set the clipping region for the TFT screen
 ***************************************************************************************/
 void TFT_eSPI::setViewport(int32_t x, int32_t y, int32_t w, int32_t h, bool vpDatum)
 {
+  if (_batchCount) runBatch(); // Recorded fills are clipped to the current viewport circle
   // Viewport metrics (not clipped)
   _xDatum  = x; // Datum x position in screen coordinates
   _yDatum  = y; // Datum y position in screen coordinates
@@ -269,6 +356,7 @@ bool TFT_eSPI::checkViewport(int32_t x, int32_t y, int32_t w, int32_t h)
 ***************************************************************************************/
 void TFT_eSPI::resetViewport(void)
 {
+  if (_batchCount) runBatch();
   // Reset viewport to the whole screen (or sprite) area
   _vpDatum = false;
   _vpOoB   = false;
@@ -432,6 +520,281 @@ bool TFT_eSPI::clipWindow(int32_t *xs, int32_t *ys, int32_t *xe, int32_t *ye)
   return true;  // Area is wholly or partially inside viewport
 }
 
+/***************************************************************************************
+** Function name:           setViewportCircle
+** Description:             Clip drawing to the circle inscribed in the viewport
+***************************************************************************************/
+// For round displays such as the GC9A01, fillRect(), fillScreen(), pushImage() and on
+// ESP32-S3 the clipping pushImageDMA() then skip the corners that are never visible
+void TFT_eSPI::setViewportCircle(bool enable)
+{
+  if (_batchCount) runBatch();
+  _vpCircle = enable;
+}
+
+/***************************************************************************************
+** Function name:           getViewportCircle
+** Description:             Get circle clipping flag of the viewport
+***************************************************************************************/
+bool TFT_eSPI::getViewportCircle(void)
+{
+  return _vpCircle;
+}
+
+/***************************************************************************************
+** Function name:           clipCircleRow
+** Description:             Clip span x,w of screen row y to the viewport circle
+***************************************************************************************/
+// Coordinates are screen coordinates as returned by clipAddrWindow(). A pixel is kept
+// if any part of it is inside the circle, so nothing visible is ever trimmed.
+bool TFT_eSPI::clipCircleRow(int32_t y, int32_t *x, int32_t *w)
+{
+  if (!_vpCircle) return true;
+
+  // Memory row y shows on screen row y + _scrollY, rows that wrap round are not drawn
+  y += _scrollY;
+  if (y < 0 || y >= _height) return false;
+
+  int32_t xs, xe;
+  if (_circleXs && _vpX == 0 && _vpY == 0 && _vpW == _circleW && _vpH == _circleH &&
+      _width == _circleW && _height == _circleH) {
+    xs = _circleXs[y];                       // Precomputed for the whole screen
+    xe = _circleXe[y];
+  }
+  else {
+    // Work in half pixels so odd viewport sizes have an exact centre
+    int32_t d  = _vpW - _vpX;                // Circle diameter = radius in half pixels
+    if ((_vpH - _vpY) < d) d = _vpH - _vpY;
+    int32_t cx = _vpX + _vpW;                // Centre in half pixels
+    int32_t cy = _vpY + _vpH;
+
+    // Distance from the centre to the nearest edge of the row
+    int32_t dy = abs(2 * y + 1 - cy) - 1;
+    if (dy < 0) dy = 0;
+    if (dy >= d) return false;
+
+    int32_t half = (int32_t)ceilf(sqrtf((float)(d * d - dy * dy)));
+    xs = (cx - half) >> 1;
+    xe = (cx + half + 1) >> 1;               // Right edge + 1
+  }
+
+  if (xs < *x) xs = *x;
+  if (xe > *x + *w) xe = *x + *w;
+  if (xe <= xs) return false;
+
+  *x = xs;
+  *w = xe - xs;
+  return true;
+}
+
+/***************************************************************************************
+** Function name:           clipCircleRect
+** Description:             Shrink window x,y,w,h to the bounds of its part in the circle
+***************************************************************************************/
+// The row spans of a circle are nested, so the widest visible span is on the row
+// nearest the centre and covers all the others
+bool TFT_eSPI::clipCircleRect(int32_t *x, int32_t *y, int32_t *w, int32_t *h)
+{
+  if (!_vpCircle) return true;
+
+  int32_t ys = *y, ye = *y + *h;
+  int32_t sx, sw;
+
+  // Drop rows above and below the circle
+  while (ys < ye) { sx = *x; sw = *w; if (clipCircleRow(ys,     &sx, &sw)) break; ys++; }
+  while (ye > ys) { sx = *x; sw = *w; if (clipCircleRow(ye - 1, &sx, &sw)) break; ye--; }
+  if (ys >= ye) return false;
+
+  int32_t mid = ((_vpY + _vpH) >> 1) - _scrollY; // memory row on the middle of the screen
+  if (mid < ys) mid = ys;
+  if (mid >= ye) mid = ye - 1;
+  if (!clipCircleRow(mid, x, w)) return false;
+
+  *y = ys;
+  *h = ye - ys;
+  return true;
+}
+
+/***************************************************************************************
+** Function name:           setCircleSpans
+** Description:             Use precomputed circle row spans for a w x h screen
+***************************************************************************************/
+void TFT_eSPI::setCircleSpans(const int16_t *xs, const int16_t *xe, int32_t w, int32_t h)
+{
+  _circleXs = xe ? xs : nullptr;
+  _circleXe = xe;
+  _circleW  = w;
+  _circleH  = h;
+}
+
+/***************************************************************************************
+** Function name:           insideCircle
+** Description:             Check if a clipped window needs no circle clipping
+***************************************************************************************/
+bool TFT_eSPI::insideCircle(int32_t x, int32_t y, int32_t w, int32_t h)
+{
+  if (!_vpCircle) return true;
+
+  // The circle is convex, so the window is inside if its top and bottom rows are
+  int32_t sx = x, sw = w;
+  if (!clipCircleRow(y, &sx, &sw) || sw != w) return false;
+  if (!clipCircleRow(y + h - 1, &sx, &sw) || sw != w) return false;
+  return true;
+}
+
+/***************************************************************************************
+** Function name:           setScrollY
+** Description:             Show the frame memory dy rows lower with the vertical scroll
+***************************************************************************************/
+// The scroll area is the whole screen and its start address is the memory row shown on
+// the top line, so a move is a 10 byte command instead of a redraw
+bool TFT_eSPI::setScrollY(int32_t dy)
+{
+#ifdef TFT_VSCRDEF
+  if ((rotation & 1) || dy <= -_height || dy >= _height) return false; // MV: the panel scrolls along x
+  if (_batchCount) runBatch();
+
+  int32_t start = (rotation & 2) ? dy : -dy; // MY addresses the rows bottom up
+  if (start < 0) start += _init_height;
+
+  writecommand(TFT_VSCRDEF);
+  writedata(0); writedata(0);                                // No top fixed area
+  writedata(_init_height >> 8); writedata(_init_height);     // Scroll area
+  writedata(0); writedata(0);                                // No bottom fixed area
+  writecommand(TFT_VSCRSADD);
+  writedata(start >> 8); writedata(start);
+
+  _scrollY = dy;
+  return true;
+#else
+  return dy == 0;
+#endif
+}
+
+/***************************************************************************************
+** Function name:           getScrollY
+** Description:             Get the rows the frame memory is shown lower by
+***************************************************************************************/
+int32_t TFT_eSPI::getScrollY(void)
+{
+  return _scrollY;
+}
+
+/***************************************************************************************
+** Function name:           blankScrollWrap
+** Description:             Fill the memory rows that wrap round at scroll dy
+***************************************************************************************/
+// The band is clipped to the circle where it shows, at the opposite edge of the screen
+bool TFT_eSPI::blankScrollWrap(int32_t dy, uint32_t color)
+{
+  if (!dy || dy <= -_height || dy >= _height) return false;
+  if (_batchCount) runBatch();
+
+  int32_t scroll = _scrollY;
+  _scrollY = dy > 0 ? dy - _height : dy + _height;
+  fillClippedRect(0, dy > 0 ? _height - dy : 0, _width, abs(dy), color);
+  _scrollY = scroll;
+  return true;
+}
+
+/***************************************************************************************
+** Function name:           setShadowBuffer
+** Description:             Keep a copy of the screen in PSRAM for pixel reads
+***************************************************************************************/
+// Only the ESP32-S3 interface functions update the copy, elsewhere this returns false
+bool TFT_eSPI::setShadowBuffer(bool enable)
+{
+  if (!enable) {
+    free(_shadow);
+    _shadow = nullptr;
+    return true;
+  }
+#if defined (CONFIG_IDF_TARGET_ESP32S3) && defined (CONFIG_SPIRAM_SUPPORT)
+  if (!_shadow && psramFound())
+    _shadow = (uint16_t*)ps_calloc(_init_width * _init_height, sizeof(uint16_t));
+  shadowWindow(0, 0, -1, -1); // no window yet
+#endif
+  return _shadow != nullptr;
+}
+
+/***************************************************************************************
+** Function name:           getShadowBuffer
+** Description:             Return the screen copy, nullptr if not enabled
+***************************************************************************************/
+uint16_t* TFT_eSPI::getShadowBuffer(void)
+{
+  if (_batchCount) runBatch();
+  return _shadow;
+}
+
+/***************************************************************************************
+** Function name:           setPanelHold
+** Description:             Keep the panel deselected so writes only reach the screen copy
+***************************************************************************************/
+void TFT_eSPI::setPanelHold(bool hold)
+{
+  if (_batchCount) runBatch(); // Recorded fills go to the side they were drawn for
+  _panelHold = hold && _shadow;
+  forgetWindow(); // windows set while held never reached the panel
+}
+
+/***************************************************************************************
+** Function name:           getPanelHold
+** Description:             Return true while writes only update the screen copy
+***************************************************************************************/
+bool TFT_eSPI::getPanelHold(void)
+{
+  return _panelHold;
+}
+
+/***************************************************************************************
+** Function name:           forgetWindow
+** Description:             The panel window is no longer known to setWindow()
+***************************************************************************************/
+void TFT_eSPI::forgetWindow(void)
+{
+  _winX0 = _winX1 = -1;
+  _winOpen = false;
+}
+
+/***************************************************************************************
+** Function name:           shadowWindow
+** Description:             Start writes to the screen copy at a new window
+***************************************************************************************/
+void TFT_eSPI::shadowWindow(int32_t x0, int32_t y0, int32_t x1, int32_t y1)
+{
+  _shX0 = _shX = x0;
+  _shX1 = x1;
+  _shY  = y0;
+  _shY1 = y1;
+}
+
+/***************************************************************************************
+** Function name:           shadowWrite
+** Description:             Mirror pixels sent to the window into the screen copy
+***************************************************************************************/
+// Pixels the panel would wrap past the window end are dropped like the panel drops them
+void TFT_eSPI::shadowWrite(const uint16_t *data, uint16_t color, uint32_t len, bool wireOrder)
+{
+  while (len && _shY <= _shY1) {
+    uint32_t n = _shX1 - _shX + 1;
+    if (n > len) n = len;
+    if (_shY >= 0 && _shY < _height) {
+      uint16_t *row = _shadow + _shY * _width;
+      for (uint32_t i = 0; i < n; i++) {
+        int32_t x = _shX + i;
+        if (x < 0 || x >= _width) continue;
+        uint16_t c = data ? data[i] : color;
+        row[x] = wireOrder ? (uint16_t)(c >> 8 | c << 8) : c;
+      }
+    }
+    if (data) data += n;
+    len -= n;
+    _shX += n;
+    if (_shX > _shX1) { _shX = _shX0; _shY++; }
+  }
+}
+
 /***************************************************************************************
 ** Function name:           TFT_eSPI
 ** Description:             Constructor , we must use hardware SPI pins
@@ -443,6 +806,8 @@ TFT_eSPI::TFT_eSPI(int16_t w, int16_t h)
 
   // Reset the viewport to the whole screen
   resetViewport();
+  _vpCircle = false;
+  _scrollY = 0;
 
   rotation  = 0;
   cursor_y  = cursor_x  = last_cursor_x = bg_cursor_x = 0;
@@ -467,6 +832,7 @@ TFT_eSPI::TFT_eSPI(int16_t w, int16_t h)
   lockTransaction = false; // start/endWrite lock flag to allow sketch to keep SPI bus access open
 
   _booted   = true;     // Default attributes
+  _initStep = 0;
   _cp437    = false;    // Legacy GLCD font bug fix disabled by default
   _utf8     = true;     // UTF8 decoding enabled
 
@@ -610,6 +976,23 @@ void TFT_eSPI::begin(uint8_t tc)
 ***************************************************************************************/
 void TFT_eSPI::init(uint8_t tc)
 {
+  _initStep = 0;
+  for (uint32_t ms; (ms = initStep(tc)) != 0; ) delay(ms);
+}
+
+
+/***************************************************************************************
+** Function name:           initStep
+** Description:             Run init() up to its next wait, return the wait in ms or 0 when done
+***************************************************************************************/
+// Ends the step: the next call resumes at case `step`, a protothread over the init sequence.
+// Driver init files that use it release the bus around it; those that don't still delay()
+#define TFT_INIT_WAIT(step, ms) do { _initStep = (step); return (ms); case (step):; } while (0)
+
+uint32_t TFT_eSPI::initStep(uint8_t tc)
+{
+  switch (_initStep) {
+  case 0:
   if (_booted)
   {
     initBus();
@@ -691,9 +1074,9 @@ void TFT_eSPI::init(uint8_t tc)
   if (TFT_RST >= 0) {
     writecommand(0x00); // Put SPI bus in known state for TFT with CS tied low
     digitalWrite(TFT_RST, HIGH);
-    delay(5);
+    TFT_INIT_WAIT(1, 5);
     digitalWrite(TFT_RST, LOW);
-    delay(20);
+    TFT_INIT_WAIT(2, 20);
     digitalWrite(TFT_RST, HIGH);
   }
   else writecommand(TFT_SWRST); // Software reset
@@ -701,7 +1084,7 @@ void TFT_eSPI::init(uint8_t tc)
   writecommand(TFT_SWRST); // Software reset
 #endif
 
-  delay(150); // Wait for reset to complete
+  TFT_INIT_WAIT(3, 150); // Wait for reset to complete
 
   begin_tft_write();
 
@@ -797,6 +1180,9 @@ void TFT_eSPI::init(uint8_t tc)
     }
   #endif
 #endif
+  }
+  _initStep = 0; // a later init() starts over
+  return 0;
 }
 
 
@@ -878,6 +1264,19 @@ void TFT_eSPI::setRotation(uint8_t m)
 
   addr_row = 0xFFFF;
   addr_col = 0xFFFF;
+  forgetWindow();
+
+  // The copy holds the old orientation, start again from black
+  if (_shadow) memset(_shadow, 0, _init_width * _init_height * sizeof(uint16_t));
+
+#ifdef TFT_VSCRDEF
+  // The scroll axis may have turned with the screen, start again unscrolled
+  if (_scrollY) {
+    writecommand(TFT_VSCRSADD);
+    writedata(0); writedata(0);
+    _scrollY = 0;
+  }
+#endif
 
   // Reset the viewport to the whole screen
   resetViewport();
@@ -979,6 +1378,7 @@ void TFT_eSPI::spiwrite(uint8_t c)
 #ifndef RM68120_DRIVER
 void TFT_eSPI::writecommand(uint8_t c)
 {
+  forgetWindow(); // a command ends the RAMWR stream and may move the window
   begin_tft_write();
 
   DC_C;
@@ -992,6 +1392,7 @@ void TFT_eSPI::writecommand(uint8_t c)
 #else
 void TFT_eSPI::writecommand(uint16_t c)
 {
+  forgetWindow();
   begin_tft_write();
 
   DC_C;
@@ -1005,6 +1406,7 @@ void TFT_eSPI::writecommand(uint16_t c)
 }
 void TFT_eSPI::writeRegister8(uint16_t c, uint8_t d)
 {
+  forgetWindow();
   begin_tft_write();
 
   DC_C;
@@ -1020,6 +1422,7 @@ void TFT_eSPI::writeRegister8(uint16_t c, uint8_t d)
 }
 void TFT_eSPI::writeRegister16(uint16_t c, uint16_t d)
 {
+  forgetWindow();
   begin_tft_write();
 
   DC_C;
@@ -1061,6 +1464,7 @@ void TFT_eSPI::writedata(uint8_t d)
 uint8_t TFT_eSPI::readcommand8(uint8_t cmd_function, uint8_t index)
 {
   uint8_t reg = 0;
+  forgetWindow();
 #if defined(TFT_PARALLEL_8_BIT) || defined(RP2040_PIO_INTERFACE)
 
   writecommand(cmd_function); // Sets DC and CS high
@@ -1143,6 +1547,9 @@ uint16_t TFT_eSPI::readPixel(int32_t x0, int32_t y0)
   // Range checking
   if ((x0 < _vpX) || (y0 < _vpY) ||(x0 >= _vpW) || (y0 >= _vpH)) return 0;
 
+  if (_batchCount) runBatch();
+  if (_shadow) return _shadow[x0 + y0 * _width];
+
 #if defined(TFT_PARALLEL_8_BIT) || defined(RP2040_PIO_INTERFACE)
 
   if (!inTransaction) { CS_L; } // CS_L can be multi-statement
@@ -1274,6 +1681,17 @@ void TFT_eSPI::readRect(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t *da
 {
   PI_CLIP ;
 
+  if (_batchCount) runBatch();
+  if (_shadow) {
+    // Swapped byte order for compatibility with pushRect(), as read from the panel
+    for (int32_t yb = 0; yb < dh; yb++) {
+      const uint16_t *src = _shadow + x + (y + yb) * _width;
+      uint16_t *line = data + dx + (dy + yb) * w;
+      for (int32_t xb = 0; xb < dw; xb++) line[xb] = src[xb] << 8 | src[xb] >> 8;
+    }
+    return;
+  }
+
 #if defined(TFT_PARALLEL_8_BIT) || defined(RP2040_PIO_INTERFACE)
 
   CS_L;
@@ -1452,10 +1870,24 @@ void TFT_eSPI::pushImage(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t *d
   begin_tft_write();
   inTransaction = true;
 
-  setWindow(x, y, x + dw - 1, y + dh - 1);
-
   data += dx + dy * w;
 
+  if (!insideCircle(x, y, dw, dh)) {
+    // Round display: one window per line, trimmed to the viewport circle
+    for (int32_t row = 0; row < dh; row++) {
+      int32_t sx = x, sw = dw;
+      if (!clipCircleRow(y + row, &sx, &sw)) continue;
+      setWindow(sx, y + row, sx + sw - 1, y + row);
+      pushPixels(data + row * w + sx - x, sw);
+      _winOpen = true;
+    }
+    inTransaction = lockTransaction;
+    end_tft_write();
+    return;
+  }
+
+  setWindow(x, y, x + dw - 1, y + dh - 1);
+
   // Check if whole image can be pushed
   if (dw == w) pushPixels(data, dw * dh);
   else {
@@ -1466,6 +1898,7 @@ void TFT_eSPI::pushImage(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t *d
       data += w;
     }
   }
+  _winOpen = true; // the window is filled, a line below can carry on the stream
 
   inTransaction = lockTransaction;
   end_tft_write();
@@ -1546,6 +1979,22 @@ void TFT_eSPI::pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const uint1
 
   uint16_t  buffer[dw];
 
+  if (!insideCircle(x, y, dw, dh)) {
+    // Round display: one window per line, trimmed to the viewport circle
+    for (int32_t i = 0; i < dh; i++) {
+      int32_t sx = x, sw = dw;
+      if (!clipCircleRow(y + i, &sx, &sw)) continue;
+      for (int32_t j = 0; j < sw; j++) {
+        buffer[j] = pgm_read_word(&data[i * w + sx - x + j]);
+      }
+      setWindow(sx, y + i, sx + sw - 1, y + i);
+      pushPixels(buffer, sw);
+    }
+    inTransaction = lockTransaction;
+    end_tft_write();
+    return;
+  }
+
   setWindow(x, y, x + dw - 1, y + dh - 1);
 
   // Fill and send line buffers to TFT
@@ -1749,6 +2198,25 @@ void TFT_eSPI::pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const uint8
 }
 
 
+#if !defined (TFT_INDEXED_PIXELS)
+/***************************************************************************************
+** Function name:           pushIndexedPixels
+** Description:             Write 8-bit palette indices as RGB565 pixels
+***************************************************************************************/
+// Generic version, the interface files may provide one that looks up while the bus is busy
+void TFT_eSPI::pushIndexedPixels(const uint8_t* data, const uint16_t* cmap, uint32_t len)
+{
+  uint16_t buf[32];
+  while (len) {
+    uint32_t n = len > 32 ? 32 : len;
+    for (uint32_t i = 0; i < n; i++) buf[i] = cmap[data[i]];
+    pushPixels(buf, n); // Palette byte order follows _swapBytes like the pixels
+    data += n;
+    len -= n;
+  }
+}
+#endif
+
 /***************************************************************************************
 ** Function name:           pushImage
 ** Description:             plot 8-bit or 4-bit or 1 bit image or sprite using a line buffer
@@ -1766,7 +2234,21 @@ void TFT_eSPI::pushImage(int32_t x, int32_t y, int32_t w, int32_t h, uint8_t *da
   // Line buffer makes plotting faster
   uint16_t  lineBuf[dw];
 
-  if (bpp8)
+  if (bpp8 && cmap != nullptr) // 8bpp palette indices, no line buffer needed
+  {
+    data += dx + dy * w;
+    bool inside = insideCircle(x, y, dw, dh);
+    for (int32_t row = 0; row < dh; row++) {
+      int32_t sx = x, sw = dw;
+      if (!inside) { // Round display: one window per line, trimmed to the viewport circle
+        if (!clipCircleRow(y + row, &sx, &sw)) continue;
+        setWindow(sx, y + row, sx + sw - 1, y + row);
+      }
+      pushIndexedPixels(data + row * w + sx - x, cmap, sw);
+      _winOpen = true;
+    }
+  }
+  else if (bpp8)
   {
     _swapBytes = false;
 
@@ -1898,7 +2380,27 @@ void TFT_eSPI::pushImage(int32_t x, int32_t y, int32_t w, int32_t h, uint8_t *da
   // Line buffer makes plotting faster
   uint16_t  lineBuf[dw];
 
-  if (bpp8) { // 8 bits per pixel
+  if (bpp8 && cmap != nullptr) { // 8bpp palette indices, each run of opaque pixels is pushed as it is
+    data += dx + dy * w;
+
+    while (dh--) {
+      uint8_t* ptr = data;
+      int32_t px = 0;
+      while (px < dw) {
+        while (px < dw && ptr[px] == transp) px++;
+        int32_t sx = px;
+        while (px < dw && ptr[px] != transp) px++;
+        int32_t rx = x + sx, rw = px - sx;
+        if (rw > 0 && clipCircleRow(y, &rx, &rw)) {
+          setWindow(rx, y, rx + rw - 1, y);
+          pushIndexedPixels(ptr + rx - x, cmap, rw);
+        }
+      }
+      y++;
+      data += w;
+    }
+  }
+  else if (bpp8) { // 8 bits per pixel
     _swapBytes = false;
 
     data += dx + dy * w;
@@ -2411,18 +2913,20 @@ void TFT_eSPI::drawCircleHelper( int32_t x0, int32_t y0, int32_t rr, uint8_t cor
 ***************************************************************************************/
 // Optimised midpoint circle algorithm, changed to horizontal lines (faster in sprites)
 // Improved algorithm avoids repetition of lines
+// Near the middle rows keep the same span, they are batched and filled as one rectangle
+// above and one below the centre, so a TFT needs one window for each run instead of each row
 void TFT_eSPI::fillCircle(int32_t x0, int32_t y0, int32_t r, uint32_t color)
 {
   int32_t  x  = 0;
   int32_t  dx = 1;
   int32_t  dy = r+r;
   int32_t  p  = -(r>>1);
+  int32_t  runStart = 0;        // Rows runStart..x from the centre have span dy+1
+  int32_t  runWidth = dy+1;
 
   //begin_tft_write();          // Sprite class can use this function, avoiding begin_tft_write()
   inTransaction = true;
 
-  drawFastHLine(x0 - r, y0, dy+1, color);
-
   while(x<r){
 
     if(p>=0) {
@@ -2437,10 +2941,13 @@ void TFT_eSPI::fillCircle(int32_t x0, int32_t y0, int32_t r, uint32_t color)
     p+=dx;
     x++;
 
-    drawFastHLine(x0 - r, y0 + x, dy+1, color);
-    drawFastHLine(x0 - r, y0 - x, dy+1, color);
-
+    if (dy+1 != runWidth) {
+      fillCircleRun(x0 - (runWidth>>1), y0, runStart, x - 1, runWidth, 0x3, color);
+      runStart = x;
+      runWidth = dy+1;
+    }
   }
+  fillCircleRun(x0 - (runWidth>>1), y0, runStart, x, runWidth, 0x3, color);
 
   inTransaction = lockTransaction;
   end_tft_write();              // Does nothing if Sprite class uses this function
@@ -2451,12 +2958,15 @@ void TFT_eSPI::fillCircle(int32_t x0, int32_t y0, int32_t r, uint32_t color)
 ** Description:             Support function for fillRoundRect()
 ***************************************************************************************/
 // Support drawing roundrects, changed to horizontal lines (faster in sprites)
+// Rows that keep the same span are batched, as in fillCircle()
 void TFT_eSPI::fillCircleHelper(int32_t x0, int32_t y0, int32_t r, uint8_t cornername, int32_t delta, uint32_t color)
 {
   int32_t f     = 1 - r;
   int32_t ddF_x = 1;
   int32_t ddF_y = -r - r;
   int32_t y     = 0;
+  int32_t runStart = 1;         // Rows runStart..y from y0 start at x0 - runLeft
+  int32_t runLeft  = r;
 
   delta++;
 
@@ -2473,9 +2983,30 @@ void TFT_eSPI::fillCircleHelper(int32_t x0, int32_t y0, int32_t r, uint8_t corne
     ddF_x += 2;
     f     += ddF_x;
 
-    if (cornername & 0x1) drawFastHLine(x0 - r, y0 + y, r + r + delta, color);
-    if (cornername & 0x2) drawFastHLine(x0 - r, y0 - y, r + r + delta, color);
+    if (r != runLeft) {
+      fillCircleRun(x0 - runLeft, y0, runStart, y - 1, runLeft + runLeft + delta, cornername, color);
+      runStart = y;
+      runLeft  = r;
+    }
+  }
+  fillCircleRun(x0 - runLeft, y0, runStart, y, runLeft + runLeft + delta, cornername, color);
+}
+
+
+/***************************************************************************************
+** Function name:           fillCircleRun
+** Description:             Support function for fillCircle() and fillCircleHelper()
+***************************************************************************************/
+// Row 0 (the centre row) is only filled once
+void TFT_eSPI::fillCircleRun(int32_t x, int32_t y, int32_t first, int32_t last, int32_t w, uint8_t cornername, uint32_t color)
+{
+  if (last < first) return;
+  if (first == 0 && (cornername & 0x3) == 0x3) {
+    fillRect(x, y - last, w, last + last + 1, color);
+    return;
   }
+  if (cornername & 0x1) fillRect(x, y + first, w, last - first + 1, color);
+  if (cornername & 0x2) fillRect(x, y - last,  w, last - first + 1, color);
 }
 
 
@@ -3225,6 +3756,14 @@ void TFT_eSPI::drawChar(int32_t x, int32_t y, uint16_t c, uint32_t color, uint32
       tft_Write_16(bg);
     }
 
+    if (_shadow) { // The raw writes above bypass pushBlock(), mirror the glyph
+      mask = 0x1;
+      for (int8_t j = 0; j < 8; j++) {
+        for (int8_t k = 0; k < 6; k++) shadowWrite(nullptr, (column[k] & mask) ? color : bg, 1, false);
+        mask <<= 1;
+      }
+    }
+
     end_tft_write();
   }
   else {
@@ -3363,6 +3902,8 @@ void TFT_eSPI::setWindow(int32_t x0, int32_t y0, int32_t x1, int32_t y1)
   addr_row = 0xFFFF;
   addr_col = 0xFFFF;
 
+  if (_shadow) shadowWindow(x0, y0, x1, y1);
+
 #if defined (ILI9225_DRIVER)
   if (rotation & 0x01) { transpose(x0, y0); transpose(x1, y1); }
   SPI_BUSY_CHECK;
@@ -3482,12 +4023,34 @@ void TFT_eSPI::setWindow(int32_t x0, int32_t y0, int32_t x1, int32_t y1)
     #endif
   #else
     SPI_BUSY_CHECK;
-    DC_C; tft_Write_8(TFT_CASET);
-    DC_D; tft_Write_32C(x0, x1);
+    // Rows just below a filled window in the same columns carry on its RAMWR stream
+    if (_winOpen && x0 == _winX0 && x1 == _winX1 && y0 == _winRow && y1 <= _winY1) {
+      _winOpen = false;
+      _winRow = y1 + 1;
+      DC_D;
+      return;
+    }
+    // No need to send the columns if they have not changed (line by line images)
+    if (x0 != _winX0 || x1 != _winX1) {
+      DC_C; tft_Write_8(TFT_CASET);
+      DC_D; tft_Write_32C(x0, x1);
+      _winX0 = x0;
+      _winX1 = x1;
+    }
+    // The rows run on to the bottom of the panel so that the next rows can follow
+    // without commands; callers send w * h pixels, so the panel stops at y1 anyway
+    int32_t ye = _height - 1;
+    #ifdef CGRAM_OFFSET
+      ye += rowstart;
+    #endif
+    if (ye < y1) ye = y1;
     DC_C; tft_Write_8(TFT_PASET);
-    DC_D; tft_Write_32C(y0, y1);
+    DC_D; tft_Write_32C(y0, ye);
     DC_C; tft_Write_8(TFT_RAMWR);
     DC_D;
+    _winOpen = false;
+    _winRow = y1 + 1;
+    _winY1 = ye;
   #endif // RP2040 SPI
 #endif
   //end_tft_write(); // Must be called after setWindow
@@ -3506,6 +4069,7 @@ void TFT_eSPI::readAddrWindow(int32_t xs, int32_t ys, int32_t w, int32_t h)
 
   addr_col = 0xFFFF;
   addr_row = 0xFFFF;
+  forgetWindow();
 
 #if defined (SSD1963_DRIVER)
   if ((rotation & 0x1) == 0) { transpose(xs, ys); transpose(xe, ye); }
@@ -3589,6 +4153,8 @@ void TFT_eSPI::drawPixel(int32_t x, int32_t y, uint32_t color)
   // Range checking
   if ((x < _vpX) || (y < _vpY) ||(x >= _vpW) || (y >= _vpH)) return;
 
+  if (_shadow) _shadow[x + y * _width] = color;
+
 #ifdef CGRAM_OFFSET
   x+=colstart;
   y+=rowstart;
@@ -3598,6 +4164,7 @@ void TFT_eSPI::drawPixel(int32_t x, int32_t y, uint32_t color)
   addr_row = 0xFFFF;
   addr_col = 0xFFFF;
 #endif
+  forgetWindow(); // the pixel window below replaces the one setWindow() sent
 
   begin_tft_write();
 
@@ -3793,6 +4360,7 @@ void TFT_eSPI::pushColor(uint16_t color)
 
   SPI_BUSY_CHECK;
   tft_Write_16N(color);
+  if (_shadow) shadowWrite(nullptr, color, 1, false);
 
   end_tft_write();
 }
@@ -4093,6 +4661,9 @@ void TFT_eSPI::drawArc(int32_t x, int32_t y, int32_t r, int32_t ir,
   if (smooth) ir--;      // Inner AA zone radius
   uint32_t r4 = ir * ir; // Inner AA radius^2
 
+  blendTable edges;      // The AA pixels all blend fg_color over bg_color
+  makeBlendTable(&edges, fg_color, bg_color);
+
   //     1 | 2
   //    ---¦---    Arc quadrant index
   //     0 | 3
@@ -4200,7 +4771,7 @@ void TFT_eSPI::drawArc(int32_t x, int32_t y, int32_t r, int32_t ir,
       if (alpha < 16) continue;  // Skip low alpha pixels
 
       // If background is read it must be done in each quadrant
-      uint16_t pcol = fastBlend(alpha, fg_color, bg_color);
+      uint16_t pcol = tableBlend(&edges, alpha);
       // Check if an AA pixels need to be drawn
       slope = ((r - cy)<<16)/(r - cx);
       if (slope <= startSlope[0] && slope >= endSlope[0]) // BL
@@ -4243,6 +4814,8 @@ void TFT_eSPI::drawSmoothCircle(int32_t x, int32_t y, int32_t r, uint32_t fg_col
 ** Function name:           fillSmoothCircle
 ** Description:             Draw a filled anti-aliased circle
 ***************************************************************************************/
+// With a background colour each row, edges and span, is built in a line buffer and
+// written with pushRow(): one window per row on a TFT, a row copy in a 16-bit Sprite
 void TFT_eSPI::fillSmoothCircle(int32_t x, int32_t y, int32_t r, uint32_t color, uint32_t bg_color)
 {
   if (r <= 0) return;
@@ -4253,6 +4826,12 @@ void TFT_eSPI::fillSmoothCircle(int32_t x, int32_t y, int32_t r, uint32_t color,
   int32_t xs = 1;
   int32_t cx = 0;
 
+  bool     buffered = (bg_color != 0x00FFFFFF);
+  uint16_t line[buffered ? 2 * r + 1 : 1];
+  uint16_t fg = (uint16_t)(color >> 8 | color << 8);
+  blendTable edges;
+  if (buffered) makeBlendTable(&edges, color, bg_color);
+
   int32_t r1 = r * r;
   r++;
   int32_t r2 = r * r;
@@ -4260,6 +4839,7 @@ void TFT_eSPI::fillSmoothCircle(int32_t x, int32_t y, int32_t r, uint32_t color,
   for (int32_t cy = r - 1; cy > 0; cy--)
   {
     int32_t dy2 = (r - cy) * (r - cy);
+    int32_t edge = 0;               // Edge pixels in line[]
     for (cx = xs; cx < r; cx++)
     {
       int32_t hyp2 = (r - cx) * (r - cx) + dy2;
@@ -4271,18 +4851,25 @@ void TFT_eSPI::fillSmoothCircle(int32_t x, int32_t y, int32_t r, uint32_t color,
       xs = cx;
       if (alpha < 9) continue;
 
-      if (bg_color == 0x00FFFFFF) {
+      if (buffered) {
+        uint16_t pcol = tableBlend(&edges, alpha);
+        line[edge++] = pcol >> 8 | pcol << 8;
+      }
+      else {
         drawPixel(x + cx - r, y + cy - r, color, alpha, bg_color);
         drawPixel(x - cx + r, y + cy - r, color, alpha, bg_color);
         drawPixel(x - cx + r, y - cy + r, color, alpha, bg_color);
         drawPixel(x + cx - r, y - cy + r, color, alpha, bg_color);
       }
-      else {
-        uint16_t pcol = drawPixel(x + cx - r, y + cy - r, color, alpha, bg_color);
-        drawPixel(x - cx + r, y + cy - r, pcol);
-        drawPixel(x - cx + r, y - cy + r, pcol);
-        drawPixel(x + cx - r, y - cy + r, pcol);
-      }
+    }
+    if (edge) {
+      // Edge pixels run up to the span, mirror them on the right
+      int32_t w = 2 * (r - cx + edge) + 1;
+      for (int32_t i = edge; i < w - edge; i++) line[i] = fg;
+      for (int32_t i = 0; i < edge; i++) line[w - 1 - i] = line[i];
+      pushRow(x + cx - edge - r, y + cy - r, w, line);
+      pushRow(x + cx - edge - r, y - cy + r, w, line);
+      continue;
     }
     drawFastHLine(x + cx - r, y + cy - r, 2 * (r - cx) + 1, color);
     drawFastHLine(x + cx - r, y - cy + r, 2 * (r - cx) + 1, color);
@@ -4612,6 +5199,8 @@ void TFT_eSPI::drawFastVLine(int32_t x, int32_t y, int32_t h, uint32_t color)
 
   if (h < 1) return;
 
+  if (recordBatch(x, y, 1, h, color)) return;
+
   begin_tft_write();
 
   setWindow(x, y, x, y + h - 1);
@@ -4642,6 +5231,8 @@ void TFT_eSPI::drawFastHLine(int32_t x, int32_t y, int32_t w, uint32_t color)
 
   if (w < 1) return;
 
+  if (recordBatch(x, y, w, 1, color)) return;
+
   begin_tft_write();
 
   setWindow(x, y, x + w - 1, y);
@@ -4652,6 +5243,44 @@ void TFT_eSPI::drawFastHLine(int32_t x, int32_t y, int32_t w, uint32_t color)
 }
 
 
+/***************************************************************************************
+** Function name:           pushRow
+** Description:             push a row of colours in the panel byte order
+***************************************************************************************/
+void TFT_eSPI::pushRow(int32_t x, int32_t y, int32_t w, const uint16_t *data)
+{
+  if (_vpOoB) return;
+
+  x+= _xDatum;
+  y+= _yDatum;
+
+  // Clipping
+  if ((y < _vpY) || (x >= _vpW) || (y >= _vpH)) return;
+
+  if (x < _vpX) { data += _vpX - x; w += x - _vpX; x = _vpX; }
+
+  if ((x + w) > _vpW) w = _vpW - x;
+
+  if (w < 1) return;
+
+  if (_vpCircle) {
+    int32_t cx = x;
+    if (!clipCircleRow(y, &cx, &w)) return;
+    data += cx - x; x = cx;
+  }
+
+  begin_tft_write();
+
+  setWindow(x, y, x + w - 1, y);
+
+  bool swap = _swapBytes; _swapBytes = false;
+  pushPixels(data, w);
+  _swapBytes = swap;
+
+  end_tft_write();
+}
+
+
 /***************************************************************************************
 ** Function name:           fillRect
 ** Description:             draw a filled rectangle
@@ -4683,8 +5312,37 @@ void TFT_eSPI::fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t col
   //Serial.print(" x=");Serial.print( y);Serial.print(", y=");Serial.print( y);
   //Serial.print(", w=");Serial.print(w);Serial.print(", h=");Serial.println(h);
 
+  if (recordBatch(x, y, w, h, color)) return;
+
+  fillClippedRect(x, y, w, h, color);
+}
+
+
+/***************************************************************************************
+** Function name:           fillClippedRect
+** Description:             fill a rectangle inside the viewport, clipped to its circle
+***************************************************************************************/
+void TFT_eSPI::fillClippedRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color)
+{
   begin_tft_write();
 
+  if (!insideCircle(x, y, w, h)) {
+    // Round display: trim each row to the viewport circle, rows with the same span share a window
+    int32_t by = y, bx = x, bw = 0;
+    for (int32_t ye = y + h; y <= ye; y++) {
+      int32_t sx = x, sw = w;
+      if ((y == ye) || !clipCircleRow(y, &sx, &sw)) sw = 0;
+      if ((sx == bx) && (sw == bw)) continue;
+      if (bw) {
+        setWindow(bx, by, bx + bw - 1, y - 1);
+        pushBlock(color, bw * (y - by));
+      }
+      by = y; bx = sx; bw = sw;
+    }
+    end_tft_write();
+    return;
+  }
+
   setWindow(x, y, x + w - 1, y + h - 1);
 
   pushBlock(color, w * h);
@@ -4693,6 +5351,110 @@ void TFT_eSPI::fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t col
 }
 
 
+/***************************************************************************************
+** Function name:           beginBatch
+** Description:             Start recording fills, see endBatch()
+***************************************************************************************/
+void TFT_eSPI::beginBatch(void)
+{
+  if (!_batch) _batch = (batchRect*)malloc(TFT_BATCH_SIZE * sizeof(batchRect));
+  _batching = (_batch != nullptr); // Without the buffer the fills are drawn as they come
+}
+
+/***************************************************************************************
+** Function name:           endBatch
+** Description:             Send the recorded fills and stop recording
+***************************************************************************************/
+void TFT_eSPI::endBatch(void)
+{
+  _batching = false;
+  runBatch();
+}
+
+/***************************************************************************************
+** Function name:           recordBatch
+** Description:             Record a fill, clipped to the viewport, false if not batching
+***************************************************************************************/
+bool TFT_eSPI::recordBatch(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color)
+{
+  if (!_batching) return false;
+  if (_batchCount == TFT_BATCH_SIZE) runBatch(); // Full, send what is there and go on
+  batchRect *r = &_batch[_batchCount++];
+  r->x = x; r->y = y; r->w = w; r->h = h;
+  r->color = color;
+  return true;
+}
+
+/***************************************************************************************
+** Function name:           runBatch
+** Description:             Send the recorded fills in one SPI session
+***************************************************************************************/
+void TFT_eSPI::runBatch(void)
+{
+  uint16_t n = _batchCount;
+  if (!n) return;
+  _batchCount = 0; // So begin_tft_write() below does not run the batch again
+
+  // Drop the fills a later one covers, w 0 marks them. Fills in between are drawn after
+  // the dropped one anyway, so leaving it out changes nothing
+  for (uint16_t i = 0; i < n; i++) {
+    batchRect *a = &_batch[i];
+    uint16_t end = (n - i > TFT_BATCH_LOOKAHEAD) ? i + 1 + TFT_BATCH_LOOKAHEAD : n;
+    for (uint16_t j = i + 1; j < end; j++) {
+      const batchRect *b = &_batch[j];
+      if ((b->x <= a->x) && (b->y <= a->y) && (b->x + b->w >= a->x + a->w) && (b->y + b->h >= a->y + a->h)) {
+        a->w = 0;
+        break;
+      }
+    }
+  }
+
+  begin_tft_write();
+  inTransaction = true; // fillClippedRect() must not end the session
+
+  uint16_t i = 0;
+  while (i < n) {
+    const batchRect *a = &_batch[i];
+    if (!a->w) { i++; continue; }
+    int32_t x = a->x, y = a->y, w = a->w, h = a->h;
+    if (!insideCircle(x, y, w, h)) { // Trimmed row by row, no window to share
+      fillClippedRect(x, y, w, h, a->color);
+      i++;
+      continue;
+    }
+
+    // Grow the window over the following fills that continue it in pixel order: stacked
+    // below with the same columns, or beside it while it is one row high
+    uint16_t j = i + 1;
+    while (j < n) {
+      const batchRect *b = &_batch[j];
+      if (!b->w) { j++; continue; }
+      int32_t nw, nh;
+      if ((b->x == x) && (b->w == w) && (b->y == y + h)) { nw = w; nh = h + b->h; }
+      else if ((h == 1) && (b->h == 1) && (b->y == y) && (b->x == x + w)) { nw = w + b->w; nh = 1; }
+      else break;
+      if (!insideCircle(x, y, nw, nh)) break;
+      w = nw; h = nh;
+      j++;
+    }
+
+    setWindow(x, y, x + w - 1, y + h - 1);
+    uint16_t color = a->color;
+    uint32_t len = 0;
+    for (; i < j; i++) { // Same colour in a row is one block
+      const batchRect *b = &_batch[i];
+      if (!b->w) continue;
+      if (b->color != color) { pushBlock(color, len); color = b->color; len = 0; }
+      len += b->w * b->h;
+    }
+    pushBlock(color, len);
+  }
+
+  inTransaction = lockTransaction;
+  end_tft_write();
+}
+
+
 /***************************************************************************************
 ** Function name:           fillRectVGradient
 ** Description:             draw a filled rectangle with a vertical colour gradient
@@ -6004,7 +6766,7 @@ void TFT_eSPI::getSetup(setup_t &tft_settings)
   tft_settings.tft_spi_freq = 0;
 #else
   tft_settings.serial = true;
-  tft_settings.tft_spi_freq = SPI_FREQUENCY/100000;
+  tft_settings.tft_spi_freq = _writeFreq/100000;
   #ifdef SPI_READ_FREQUENCY
     tft_settings.tft_rd_freq = SPI_READ_FREQUENCY/100000;
   #endif
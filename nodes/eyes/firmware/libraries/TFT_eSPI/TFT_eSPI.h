@@ -424,6 +424,22 @@ int16_t tch_spi_freq;// Touch controller read/write SPI frequency
 // Callback prototype for smooth font pixel colour read
 typedef uint16_t (*getColorCallback)(uint16_t x, uint16_t y);
 
+// Callback prototype for a finished queued DMA transfer (ESP32-S3), see dmaSubmitImage()
+typedef void (*dmaDoneCallback)(void *arg);
+
+// A fill recorded between beginBatch() and endBatch(), in screen coordinates after viewport clipping
+typedef struct {
+  int16_t  x, y, w, h;
+  uint16_t color;
+} batchRect;
+
+#ifndef TFT_BATCH_SIZE
+  #define TFT_BATCH_SIZE 1024      // Fills recorded before the batch is sent early, 10 bytes each
+#endif
+#ifndef TFT_BATCH_LOOKAHEAD
+  #define TFT_BATCH_LOOKAHEAD 16   // Later fills checked for covering a recorded one
+#endif
+
 // Class functions and variables
 class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has access to protected members
 
@@ -436,13 +452,20 @@ class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has ac
   // Sketch defined tab colour option is for ST7735 displays only
   void     init(uint8_t tc = TAB_COLOUR), begin(uint8_t tc = TAB_COLOUR);
 
+  // init() in steps, for sketches with other boot work to do during the panel's reset and
+  // sleep-out waits: each call runs up to the next wait and returns its length in ms, the
+  // bus released; call again once it has passed. Returns 0 when the panel is ready
+  uint32_t initStep(uint8_t tc = TAB_COLOUR);
+
   // These are virtual so the TFT_eSprite class can override them with sprite specific functions
   virtual void     drawPixel(int32_t x, int32_t y, uint32_t color),
                    drawChar(int32_t x, int32_t y, uint16_t c, uint32_t color, uint32_t bg, uint8_t size),
                    drawLine(int32_t xs, int32_t ys, int32_t xe, int32_t ye, uint32_t color),
                    drawFastVLine(int32_t x, int32_t y, int32_t h, uint32_t color),
                    drawFastHLine(int32_t x, int32_t y, int32_t w, uint32_t color),
-                   fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color);
+                   fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color),
+                   // Push a row of colours already in the panel byte order (as 16-bit Sprites hold them)
+                   pushRow(int32_t x, int32_t y, int32_t w, const uint16_t *data);
 
   virtual int16_t  drawChar(uint16_t uniCode, int32_t x, int32_t y, uint8_t font),
                    drawChar(uint16_t uniCode, int32_t x, int32_t y),
@@ -492,6 +515,46 @@ class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has ac
            // Clip input window area to viewport bounds, return false if whole area is out of bounds
   bool     clipWindow(int32_t* xs, int32_t* ys, int32_t* xe, int32_t* ye);
 
+  // Round displays: clip to the circle inscribed in the viewport so the hidden corners are not sent
+  void     setViewportCircle(bool enable);
+  bool     getViewportCircle(void);
+           // Clip span x,w of screen row y to the viewport circle, return false if none of it is visible
+  bool     clipCircleRow(int32_t y, int32_t* x, int32_t* w);
+           // Shrink window to the bounds of its part inside the viewport circle, return false if none is inside
+  bool     clipCircleRect(int32_t* x, int32_t* y, int32_t* w, int32_t* h);
+           // Row spans of the circle for a w x h screen (TFT_eFixedPanel tables), read instead of
+           // working them out while the viewport is the whole screen; nullptr to stop
+  void     setCircleSpans(const int16_t* xs, const int16_t* xe, int32_t w, int32_t h);
+
+  // Hardware vertical scroll (VSCRDEF/VSCRSADD): the panel shows its memory dy rows lower (negative: higher),
+  // so the picture moves without being sent again. The rows pushed past one edge wrap round to the other;
+  // with circle clipping on they are never drawn to, blankScrollWrap() clears them. Screen coordinates stay
+  // those of the memory. Rotations 0, 2, 4 and 6 only, reset by setRotation(); wait for DMA before calling
+  bool     setScrollY(int32_t dy);
+  int32_t  getScrollY(void);
+           // Fill the memory rows that wrap round at scroll dy, past the clipping; false if there are none
+  bool     blankScrollWrap(int32_t dy, uint32_t color);
+
+  // Shadow buffer (ESP32-S3 with PSRAM): an RGB565 copy of the screen that every write also updates,
+  // so readPixel(), readRect() and the smooth graphics that blend with the screen read RAM instead of
+  // the panel. The copy starts out black and is cleared by setRotation(), redraw the screen after either
+  bool     setShadowBuffer(bool enable);
+           // Returns the copy (width() x height() at the current rotation) or nullptr if not enabled
+  uint16_t* getShadowBuffer(void);
+           // Panel hold: writes only update the shadow buffer and the panel keeps what it shows, because
+           // chip select is left high. Draws a frame off screen, e.g. the target of a transition. Switch
+           // between writes (after endWrite() and dmaWait()); ignored without a shadow buffer
+  void     setPanelHold(bool hold);
+  bool     getPanelHold(void);
+
+  // Display list: fillRect(), drawFastHLine() and drawFastVLine() between beginBatch() and endBatch()
+  // are recorded and sent in one SPI session. A fill covered by one of the next TFT_BATCH_LOOKAHEAD
+  // fills is dropped, and fills that continue each other's window in pixel order (stacked with the
+  // same x and width, or side by side on one row) go out as one window. Any other drawing sends the
+  // recorded fills first, so the result is the same as without the batch
+  void     beginBatch(void);
+  void     endBatch(void);
+
            // Push (aka write pixel) colours to the TFT (use setAddrWindow() first)
   void     pushColor(uint16_t color, uint32_t len),  // Deprecated, use pushBlock()
            pushColors(uint16_t  *data, uint32_t len, bool swap = true), // With byte swap option
@@ -502,6 +565,8 @@ class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has ac
 
            // Write a set of pixels stored in memory, use setSwapBytes(true/false) function to correct endianess
   void     pushPixels(const void * data_in, uint32_t len);
+           // Write 8-bit indices through a 256 entry RGB565 palette, looked up as the SPI buffer is filled
+  void     pushIndexedPixels(const uint8_t* data, const uint16_t* cmap, uint32_t len);
 
            // Support for half duplex (bi-directional SDA) SPI bus where MOSI must be switched to input
            #ifdef TFT_SDA_READ
@@ -526,6 +591,8 @@ class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has ac
            drawCircleHelper(int32_t x, int32_t y, int32_t r, uint8_t cornername, uint32_t color),
            fillCircle(int32_t x, int32_t y, int32_t r, uint32_t color),
            fillCircleHelper(int32_t x, int32_t y, int32_t r, uint8_t cornername, int32_t delta, uint32_t color),
+           // Fill the rows first..last below (cornername 0x1) and above (0x2) y as rectangles
+           fillCircleRun(int32_t x, int32_t y, int32_t first, int32_t last, int32_t w, uint8_t cornername, uint32_t color),
 
            drawEllipse(int16_t x, int16_t y, int32_t rx, int32_t ry, uint16_t color),
            fillEllipse(int16_t x, int16_t y, int32_t rx, int32_t ry, uint16_t color),
@@ -538,7 +605,8 @@ class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has ac
   // Smooth (anti-aliased) graphics drawing
            // Draw a pixel blended with the background pixel colour (bg_color) specified,  return blended colour
            // If the bg_color is not specified, the background pixel colour will be read from TFT or sprite
-  uint16_t drawPixel(int32_t x, int32_t y, uint32_t color, uint8_t alpha, uint32_t bg_color = 0x00FFFFFF);
+           // Virtual so that 16-bit Sprites blend in their buffer, the smooth graphics below all draw through it
+  virtual uint16_t drawPixel(int32_t x, int32_t y, uint32_t color, uint8_t alpha, uint32_t bg_color = 0x00FFFFFF);
 
            // Draw an anti-aliased (smooth) arc between start and end angles. Arc ends are anti-aliased.
            // By default the arc is drawn with square ends unless the "roundEnds" parameter is included and set true
@@ -614,7 +682,9 @@ class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has ac
 
            // These are used by Sprite class pushSprite() member function for 1, 4 and 8 bits per pixel (bpp) colours
            // They are not intended to be used with user sketches (but could be)
-           // Set bpp8 true for 8bpp sprites, false otherwise. The cmap pointer must be specified for 4bpp
+           // Set bpp8 true for 8bpp sprites, false otherwise. The cmap pointer must be specified for 4bpp.
+           // With bpp8 and a cmap the data are indices into a 256 entry RGB565 palette (byte order as for
+           // 16-bit images, see setSwapBytes()) instead of RGB332, e.g. GIF lines pushed as decoded
   void     pushImage(int32_t x, int32_t y, int32_t w, int32_t h, uint8_t  *data, bool bpp8 = true, uint16_t *cmap = nullptr);
   void     pushImage(int32_t x, int32_t y, int32_t w, int32_t h, uint8_t  *data, uint8_t  transparent, bool bpp8 = true, uint16_t *cmap = nullptr);
            // FLASH version
@@ -783,6 +853,11 @@ class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has ac
            //
            // The function will wait for the last DMA to complete if it is called while a previous DMA is still
            // in progress, this simplifies the sketch and helps avoid "gotchas".
+           //
+           // On the ESP32-S3 images over 64 Kbytes are split into several queued transfers, so a whole frame
+           // (e.g. 240x240) is sent with one call without blocking. With TFT_ESP_LCD_IO defined in the
+           // setup the pixels go through an ESP-IDF esp_lcd panel IO device instead, which also takes
+           // buffers in PSRAM.
   void     pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t* data, uint16_t* buffer = nullptr);
 
 #if defined (ESP32) // ESP32 only at the moment
@@ -796,14 +871,53 @@ class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has ac
   bool     dmaBusy(void); // returns true if DMA is still in progress
   void     dmaWait(void); // wait until DMA is complete
 
+#if defined (CONFIG_IDF_TARGET_ESP32S3)
+           // Queued DMA: the address window is sent through the DMA queue too, so several
+           // windows can be in flight and window N+1 is set up while window N is transferred.
+           // dmaSubmitImage() never blocks, it returns false when the queue has no room; the data
+           // must stay untouched until done(arg) has been called. done() runs from dmaPoll(),
+           // dmaBusy() or dmaWait() in the calling task and must not draw.
+           // Do not mix with blocking (non DMA) drawing before dmaWait() has returned.
+  bool     dmaSubmitImage(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t const* data,
+                          dmaDoneCallback done = nullptr, void *arg = nullptr);
+           // Queued fill, sent from a small buffer of the colour without CPU time. Same rules
+           // as dmaSubmitImage(); also false while fills of another colour are still queued
+  bool     dmaFillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color,
+                       dmaDoneCallback done = nullptr, void *arg = nullptr);
+           // As dmaSubmitImage(), but sent with the panel in 12 bit colour (COLMOD 0x03): the
+           // big-endian RGB565 data is packed in place to 2 pixels per 3 bytes. The next 16 bit
+           // queued transfer or dmaWait() switches the panel back
+  bool     dmaSubmitImage12(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t* data,
+                            dmaDoneCallback done = nullptr, void *arg = nullptr);
+           // Retire finished transfers and return the number of transactions still queued
+           // If wait is true, block until at least one submitted image has been sent
+  uint8_t  dmaPoll(bool wait = false);
+#endif
+
   bool     DMA_Enabled = false;   // Flag for DMA enabled state
   uint8_t  spiBusyCheck = 0;      // Number of ESP32 transfer buffers to check
+#if defined (CONFIG_IDF_TARGET_ESP32S3) && defined (ESP32_DMA)
+           // SPI host for initDMA(), SPI2_HOST or SPI3_HOST; false if DMA is running
+  bool     setDMAHost(spi_host_device_t host);
+  spi_host_device_t spi_host = TFT_DMA_HOST; // SPI host of this instance's DMA device
+  spi_device_handle_t dmaHAL = nullptr;      // and the device, while DMA_Enabled
+#endif
 
   // Bare metal functions
   void     startWrite(void);                         // Begin SPI transaction
   void     writeColor(uint16_t color, uint32_t len); // Deprecated, use pushBlock()
   void     endWrite(void);                           // End SPI transaction
 
+  // SPI write clock, SPI_FREQUENCY at start. Reads stay at SPI_READ_FREQUENCY. The DMA engine takes
+  // the clock set when initDMA() is called, so set or tune it before that
+  void     setWriteFrequency(uint32_t hz);
+  uint32_t getWriteFrequency(void);
+           // Step the write clock up from the current one to at most max_hz, writing a test pattern at each
+           // step and checking it with readRect(). Leaves the fastest clock that passed set and returns it,
+           // or returns 0 with nothing changed if the pattern does not read back at the current clock (no
+           // MISO, or a panel that cannot be read). Uses a block at the top left corner, restored afterwards
+  uint32_t tuneWriteFrequency(uint32_t max_hz);
+
   // Set/get an arbitrary library configuration attribute or option
   //       Use to switch ON/OFF capabilities such as UTF8 decoding - each attribute has a unique ID
   //       id = 0: reserved - may be used in future to reset all attributes to a default state
@@ -862,6 +976,12 @@ class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has ac
            // Temporary  library development function  TODO: remove need for this
   void     pushSwapBytePixels(const void* data_in, uint32_t len);
 
+#if defined (CONFIG_IDF_TARGET_ESP32S3) && defined (ESP32_DMA)
+           // pushPixels() through two DMA bounce buffers once initDMA() has run, so the
+           // next block is copied while the previous one is sent; false if not used
+  bool     pushPixelsBurst(const void* data_in, uint32_t len, bool swap);
+#endif
+
            // Same as setAddrWindow but exits with CGRAM in read mode
   void     readAddrWindow(int32_t xs, int32_t ys, int32_t w, int32_t h);
 
@@ -880,6 +1000,9 @@ class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has ac
            // Helper function: calculate distance of a point from a finite length line between two points
   float    wedgeLineDistance(float pax, float pay, float bax, float bay, float dr);
 
+           // True if the clipped window lies wholly inside the viewport circle (or circle clipping is off)
+  bool     insideCircle(int32_t x, int32_t y, int32_t w, int32_t h);
+
            // Display variant settings
   uint8_t  tabcolor,                   // ST7735 screen protector "tab" colour (now invalid)
            colstart = 0, rowstart = 0; // Screen display area to CGRAM area coordinate offsets
@@ -923,6 +1046,43 @@ class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has ac
   int32_t  _yHeight;
   bool     _vpDatum;
   bool     _vpOoB;
+  bool     _vpCircle;                // Clip to the circle inscribed in the viewport
+  int32_t  _scrollY;                 // Hardware scroll in rows, see setScrollY()
+  const int16_t *_circleXs = nullptr; // setCircleSpans(): first visible column of each screen row
+  const int16_t *_circleXe = nullptr; // and the last + 1
+  int32_t  _circleW = 0, _circleH = 0; // screen size the spans are for
+
+  uint32_t _writeFreq = SPI_FREQUENCY; // SPI write clock, see setWriteFrequency()
+
+  // Display list, see beginBatch()
+  batchRect *_batch = nullptr;        // TFT_BATCH_SIZE entries, allocated by the first beginBatch()
+  uint16_t _batchCount = 0;           // Fills recorded
+  bool     _batching = false;         // Between beginBatch() and endBatch()
+           // Record a clipped fill, false if not batching
+  bool     recordBatch(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color);
+           // Send and forget the recorded fills
+  void     runBatch(void);
+           // fillRect() after viewport clipping
+  void     fillClippedRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color);
+
+  // Shadow buffer, see setShadowBuffer()
+  uint16_t *_shadow = nullptr;        // Screen copy, _width x _height
+  bool     _panelHold = false;        // Chip select stays high, see setPanelHold()
+  int32_t  _shX0, _shX1, _shY1;       // Columns and last row of the window being written
+  int32_t  _shX, _shY;                // Next pixel written into the window
+           // Start writes to a window, x1,y1 inclusive as for setWindow()
+  void     shadowWindow(int32_t x0, int32_t y0, int32_t x1, int32_t y1);
+           // Copy the next len pixels of the window, data in panel byte order if wireOrder,
+           // or fill them with color if data is nullptr
+  void     shadowWrite(const uint16_t *data, uint16_t color, uint32_t len, bool wireOrder);
+
+  // setWindow() skips CASET when the columns are unchanged and carries on the RAMWR
+  // stream for the rows just below a filled window (SPI panels without RP2040)
+  int32_t  _winX0 = -1, _winX1 = -1;  // Columns last sent with CASET, -1 when unknown
+  int32_t  _winRow = 0, _winY1 = -1;  // Next row of the RAMWR stream, last row sent with PASET
+  bool     _winOpen = false;          // The stream stopped at the start of _winRow
+           // Drop the above, for anything that sends commands other than setWindow()
+  void     forgetWindow(void);
 
   int32_t  cursor_x, cursor_y, padX;       // Text cursor x,y and padding setting
   int32_t  bg_cursor_x;                    // Background fill cursor
@@ -938,6 +1098,7 @@ class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has ac
   bool     _swapBytes; // Swap the byte order for TFT pushImage()
 
   bool     _booted;    // init() or begin() has already run once
+  uint8_t  _initStep;  // where initStep() resumes, 0 to start over
 
                        // User sketch manages these via set/getAttribute()
   bool     _cp437;        // If set, use correct CP437 charset (default is OFF)
@@ -1000,6 +1161,50 @@ fastBlend(A alpha, F fgc, B bgc)
   return (rxb & 0xF81F) | (xgx & 0x07E0);
 }
 
+// Table and packed blends: alpha is used in BLEND_LEVELS steps, (alpha + 4) >> 3
+#define BLEND_SHIFT  5
+#define BLEND_LEVELS (1 << BLEND_SHIFT)
+
+// The blends of one fixed colour pair, c[n] is n / BLEND_LEVELS of fgc over bgc
+typedef struct {
+  uint16_t fgc, bgc;
+  uint16_t c[BLEND_LEVELS + 1];
+} blendTable;
+
+// Spread RGB565 over 32 bits, green in bits 21-26, red 11-15 and blue 0-4, so that each
+// channel has room above it and a single multiply scales all three
+static inline uint32_t
+expand565(uint32_t c) { return (c | c << 16) & 0x07E0F81F; }
+
+// Blend two expanded colours, a = 0 to BLEND_LEVELS, and pack the result back to RGB565
+static inline uint16_t
+packedBlend(uint32_t a, uint32_t fgx, uint32_t bgx)
+{
+  uint32_t c = ((fgx * a + bgx * (BLEND_LEVELS - a)) >> BLEND_SHIFT) & 0x07E0F81F;
+  return (uint16_t)(c | c >> 16);
+}
+
+// alphaBlend with two multiplies for all three channels instead of per channel ones
+static inline uint16_t
+swarBlend(uint8_t alpha, uint16_t fgc, uint16_t bgc)
+{
+  return packedBlend((alpha + 4) >> 3, expand565(fgc), expand565(bgc));
+}
+
+// Fill a blendTable for fgc over bgc
+static inline void
+makeBlendTable(blendTable *t, uint16_t fgc, uint16_t bgc)
+{
+  uint32_t fgx = expand565(fgc), bgx = expand565(bgc);
+  t->fgc = fgc;
+  t->bgc = bgc;
+  for (uint32_t a = 0; a <= BLEND_LEVELS; a++) t->c[a] = packedBlend(a, fgx, bgx);
+}
+
+// Blend of the table colour pair, a lookup instead of any multiply
+static inline uint16_t
+tableBlend(const blendTable *t, uint8_t alpha) { return t->c[(alpha + 4) >> 3]; }
+
 /***************************************************************************************
 **                         Section 10: Additional extension classes
 ***************************************************************************************/
@@ -1009,4 +1214,10 @@ fastBlend(A alpha, F fgc, B bgc)
 // Load the Sprite Class
 #include "Extensions/Sprite.h"
 
+// Load the fixed geometry helpers
+#include "Extensions/FixedPanel.h"
+
+// Load the fused per-pixel effect kernels
+#include "Extensions/PixelKernel.h"
+
 #endif // ends #ifndef _TFT_eSPIH_
\ No newline at end of file
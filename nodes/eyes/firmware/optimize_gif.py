@@ -288,9 +288,15 @@ def main():
     )
     parser.add_argument("input_dir", help="Path to the directory containing original GIF files")
     parser.add_argument("output_dir", help="Path to the directory where optimized GIFs and previews will be stored")
-    parser.add_argument("--rotate", type=int, default=0, help="If set, rotate the optimized GIF by this many degrees. Produces additional _left+<angle>.gif and _right-<angle>.gif files.")
+    parser.add_argument("--rotate", type=int, default=0, help="If set, rotate the optimized GIF by this many degrees. Produces additional _left+<angle>.gif and _right-<angle>.gif files. Multiples of 90 are left to the display (/rotate).")
     args = parser.parse_args()
 
+    if args.rotate % 90 == 0 and args.rotate != 0:
+        # Quarter turns and mirroring are done by the panel, one asset set serves both eyes
+        print(f"Not writing rotated copies: set the eyes to {args.rotate % 360} degrees with "
+              f"/rotate?value={args.rotate % 360 // 90} (add &mirror=1 for the mirrored eye) instead.")
+        args.rotate = 0
+
     input_dir = args.input_dir
     output_dir = args.output_dir
     if not os.path.exists(output_dir):
@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+"""Script to update the firmware of both eyes over WiFi, in parallel.
+
+Streams the app image (wall-e_eye.ino.bin from `make build`) to PUT /ota on
+every eye at once with its MD5, so each eye checks what it wrote before it
+switches to it. Then waits for the eyes to come back and prints the firmware
+build each one reports in /capabilities.
+
+Exits with 1 when any eye failed, so it can gate a rollout.
+"""
+
+import os
+import sys
+import json
+import time
+import hashlib
+import argparse
+import urllib.error
+import urllib.request
+from concurrent.futures import ThreadPoolExecutor
+
+
+def update(ip: str, image: str, md5: str, timeout: float) -> str:
+    """Send the image to one eye; returns its reply, raises OSError when it failed."""
+    size = os.path.getsize(image)
+    with open(image, "rb") as f:
+        request = urllib.request.Request(f"http://{ip}/ota?md5={md5}", data=f, method="PUT",
+                                         headers={"Content-Type": "application/octet-stream",
+                                                  "Content-Length": str(size)})
+        try:
+            with urllib.request.urlopen(request, timeout=timeout) as response:
+                return response.read().decode(errors="replace")
+        except urllib.error.HTTPError as e:
+            raise OSError(e.read().decode(errors="replace") or str(e)) from e
+
+
+def wait_for(ip: str, timeout: float) -> dict:
+    """/capabilities of the eye once it answers again after the restart."""
+    deadline = time.monotonic() + timeout
+    time.sleep(2)  # the eye replies before it restarts
+    while True:
+        try:
+            with urllib.request.urlopen(f"http://{ip}/capabilities", timeout=2) as response:
+                return json.loads(response.read())
+        except (OSError, ValueError):
+            if time.monotonic() > deadline:
+                raise OSError("did not come back")
+            time.sleep(0.5)
+
+
+def rollout(ip: str, image: str, md5: str, timeout: float) -> bool:
+    start = time.monotonic()
+    try:
+        update(ip, image, md5, timeout)
+        print(f"{ip}: written in {time.monotonic() - start:.1f} s, restarting")
+        caps = wait_for(ip, timeout)
+    except OSError as e:
+        print(f"{ip}: FAILED, {e}")
+        return False
+    print(f"{ip}: back after {time.monotonic() - start:.1f} s, firmware {caps.get('firmware')} "
+          f"built {caps.get('build')}")
+    return True
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Update the firmware of the eyes over WiFi, all at once")
+    parser.add_argument("image", help="app image, e.g. build/wall-e_eye.ino.bin")
+    parser.add_argument("eyes", nargs="+", help="addresses of the eyes")
+    parser.add_argument("--timeout", type=float, default=60, help="s to allow each eye for the upload and the restart")
+    args = parser.parse_args()
+
+    try:
+        with open(args.image, "rb") as f:
+            md5 = hashlib.md5(f.read()).hexdigest()
+    except OSError as e:
+        print(f"Error: {e}")
+        sys.exit(1)
+    print(f"{args.image}: {os.path.getsize(args.image)} bytes, MD5 {md5}")
+    with ThreadPoolExecutor(max_workers=len(args.eyes)) as pool:
+        results = list(pool.map(lambda ip: rollout(ip, args.image, md5, args.timeout), args.eyes))
+    if not all(results):
+        sys.exit(1)
+    print("OK")
+
+
+if __name__ == "__main__":
+    main()
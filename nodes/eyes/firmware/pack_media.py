@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+"""Script to build media packs for the firmware.
+
+A pack starts with a header ("EPAK", version, entry count) and a table of
+64-byte entries (name, offset, size), followed by the files, each aligned to
+4 bytes. Two kinds are built from it:
+
+- the image of the "media" flash partition (default), which the firmware maps
+  at boot and plays the GIFs from without a file system. Write it with
+  `make flash-media`.
+- an asset pack for the SD card (--assets), holding GIFs, JPEGs, their
+  _preview thumbnails and native .565 copies. The firmware opens it once and
+  plays everything in it through that one handle; sync_images.py --pack
+  uploads it.
+"""
+
+import os
+import sys
+import struct
+import argparse
+
+MAGIC = b"EPAK"
+VERSION = 1
+HEADER = struct.Struct("<4sHH")
+ENTRY = struct.Struct("<56sII")
+ALIGN = 4
+
+
+MEDIA_EXTENSIONS = (".gif", ".jpg", ".jpeg")
+
+
+def pack_name(path: str) -> str:
+    """Name of a file inside a pack, e.g. "eye.gif.565" -> ".native/eye.gif.565"."""
+    name = os.path.basename(path)
+    if name.lower().endswith(".565"):
+        return ".native/" + name
+    return name
+
+
+def build_pack(paths: list[str], max_size: int | None, assets: bool = False) -> bytes:
+    """Pack the given files, in the given order.
+
+    Args:
+        paths: Files to pack; each is played as /gif/<file name>.
+        max_size: Size of the partition the pack must fit into, None for no limit.
+        assets: Build an asset pack, which also takes JPEGs and .565 native copies.
+
+    Returns:
+        The pack image.
+    """
+    extensions = MEDIA_EXTENSIONS + (".565",) if assets else (".gif",)
+    files = []
+    for path in paths:
+        name = pack_name(path) if assets else os.path.basename(path)
+        if not name.lower().endswith(extensions):
+            print(f"Skipping {path}: not a file the pack plays")
+            continue
+        if len(name.encode()) >= ENTRY.size - 8:
+            print(f"Skipping {path}: name longer than 55 bytes")
+            continue
+        with open(path, "rb") as f:
+            files.append((name, f.read()))
+
+    offset = HEADER.size + ENTRY.size * len(files)
+    table = []
+    data = bytearray()
+    for name, content in files:
+        pad = (-(offset + len(data))) % ALIGN
+        data += b"\0" * pad
+        table.append(ENTRY.pack(name.encode(), offset + len(data), len(content)))
+        data += content
+        print(f"Packed {name}: {len(content)} bytes")
+
+    image = HEADER.pack(MAGIC, VERSION, len(files)) + b"".join(table) + bytes(data)
+    if max_size is not None and len(image) > max_size:
+        raise ValueError(f"pack is {len(image)} bytes, the partition holds {max_size}")
+    return image
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Build a media pack for the eye's flash partition or SD card")
+    parser.add_argument("files", nargs="*", help="files to pack")
+    parser.add_argument("-o", "--output", default="media.bin", help="image to write")
+    parser.add_argument("--size", type=lambda v: int(v, 0), default=0x2E0000,
+                        help="partition size (default 0x2E0000, see partitions.csv)")
+    parser.add_argument("--assets", action="store_true",
+                        help="build an asset pack for the SD card, with no size limit")
+    args = parser.parse_args()
+    try:
+        image = build_pack(args.files, None if args.assets else args.size, args.assets)
+    except (OSError, ValueError) as e:
+        print(f"Error: {e}")
+        sys.exit(1)
+    with open(args.output, "wb") as f:
+        f.write(image)
+    print(f"Wrote {args.output}: {len(image)} bytes")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+"""Script to turn an eye's /profile samples into a flame graph.
+
+Given the eye's address it starts sampling (/profile?start=1&ms=N), waits
+and fetches the dump; given a file it reads a dump saved earlier. The dump
+is a header ("EPRF", version, task count, sample count, ticks dropped, tick
+rate, ms sampled), 16-byte task names and 12-byte samples (interrupted PC,
+return address, task, core). The addresses are symbolised in one batch with
+addr2line against the ELF of the same build, then written as folded stacks
+(core;task;caller;function count, as flamegraph.pl and speedscope read them)
+and as a self-contained SVG flame graph. The functions with the most samples
+are printed too.
+"""
+
+import os
+import sys
+import html
+import time
+import struct
+import zlib
+import argparse
+import subprocess
+import urllib.request
+from collections import Counter
+
+HEADER = struct.Struct("<4sHHIIII")
+SAMPLE = struct.Struct("<IIHBB")
+TASK_LEN = 16
+MAGIC = b"EPRF"
+VERSION = 1
+
+
+def parse_dump(data: bytes) -> tuple[dict, list[str], list[tuple]]:
+    """Split a dump into its header, task names and samples.
+
+    Returns:
+        The header as a dict, the task names and the samples as
+        (pc, caller, task, core, reserved) tuples in the order taken.
+    """
+    if len(data) < HEADER.size:
+        raise ValueError("dump is too short")
+    magic, version, task_count, sample_count, dropped, hz, ms = HEADER.unpack_from(data)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("not a version 1 /profile dump")
+    offset = HEADER.size
+    tasks = []
+    for _ in range(task_count):
+        tasks.append(data[offset:offset + TASK_LEN].split(b"\0", 1)[0].decode(errors="replace"))
+        offset += TASK_LEN
+    if len(data) < offset + sample_count * SAMPLE.size:
+        raise ValueError("dump is truncated")
+    samples = [SAMPLE.unpack_from(data, offset + i * SAMPLE.size) for i in range(sample_count)]
+    return {"samples": sample_count, "dropped": dropped, "hz": hz, "ms": ms}, tasks, samples
+
+
+def fetch_profile(address: str, ms: int) -> bytes:
+    """Sample the eye for ms and return the dump."""
+    with urllib.request.urlopen(f"http://{address}/profile?start=1&ms={ms}", timeout=5) as response:
+        response.read()
+    time.sleep(ms / 1000 + 0.1)
+    with urllib.request.urlopen(f"http://{address}/profile", timeout=30) as response:
+        return response.read()
+
+
+def symbolise(addresses: set[int], elf: str, addr2line: str) -> dict[int, str]:
+    """Function names of the addresses, '??' where the ELF has none."""
+    ordered = sorted(addresses)
+    result = subprocess.run([addr2line, "-f", "-C", "-e", elf], input="".join(f"{a:#x}\n" for a in ordered),
+                            capture_output=True, text=True, check=True)
+    lines = result.stdout.splitlines()
+    # Two lines per address: the function, then file:line
+    return {a: lines[2 * i].strip() or "??" for i, a in enumerate(ordered) if 2 * i < len(lines)}
+
+
+def fold(tasks: list[str], samples: list[tuple], names: dict[int, str]) -> Counter:
+    """Folded stacks: root to leaf frames joined by ';' and the samples of each."""
+    stacks = Counter()
+    for pc, caller, task, core, _ in samples:
+        frames = [f"core{core}", tasks[task] if task < len(tasks) else "?"]
+        function = names.get(pc, "??")
+        caller_name = names.get(caller, "??") if caller else "??"
+        if caller_name != "??" and caller_name != function:
+            frames.append(caller_name)
+        frames.append(function if function != "??" else f"{pc:#010x}")
+        stacks[";".join(f.replace(";", ":") for f in frames)] += 1
+    return stacks
+
+
+def flame_svg(stacks: Counter, title: str, width: int = 1200, row: int = 17) -> str:
+    """A flame graph of the folded stacks, widest at the bottom, with the sample counts as tooltips."""
+    tree = {"children": {}, "count": 0}
+    for stack, count in stacks.items():
+        node = tree
+        node["count"] += count
+        for frame in stack.split(";"):
+            node = node["children"].setdefault(frame, {"children": {}, "count": 0})
+            node["count"] += count
+    total = tree["count"] or 1
+    depth = max((s.count(";") + 1 for s in stacks), default=0)
+    height = (depth + 2) * row
+    out = [f'<svg xmlns="http://www.w3.org/2000/svg" width="{width}" height="{height}" font-family="monospace" '
+           f'font-size="11">',
+           f'<text x="4" y="{row - 4}">{html.escape(title)}</text>']
+
+    def draw(node: dict, x: float, level: int):
+        for name, child in sorted(node["children"].items()):
+            w = child["count"] * width / total
+            if w >= 0.5:
+                y = height - (level + 1) * row
+                hue = zlib.crc32(name.encode()) % 60  # red to yellow, stable per function
+                label = f"{name} ({child['count']} samples, {100 * child['count'] / total:.1f}%)"
+                out.append(f'<g><title>{html.escape(label)}</title>'
+                           f'<rect x="{x:.1f}" y="{y}" width="{w:.1f}" height="{row - 1}" '
+                           f'fill="hsl({hue},90%,60%)"/>')
+                chars = int(w / 7)
+                if chars >= 3:
+                    text = name if len(name) <= chars else name[:chars - 2] + ".."
+                    out.append(f'<text x="{x + 2:.1f}" y="{y + row - 5}">{html.escape(text)}</text>')
+                out.append("</g>")
+                draw(child, x, level + 1)
+            x += w
+
+    draw(tree, 0, 0)
+    out.append("</svg>")
+    return "\n".join(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Symbolise an eye's /profile samples and draw a flame graph")
+    parser.add_argument("source", help="address of the eye to profile, or a saved /profile dump")
+    parser.add_argument("elf", help="ELF of the running build, e.g. build/wall-e_eye.ino.elf")
+    parser.add_argument("--ms", type=int, default=5000, help="ms to sample when profiling an eye")
+    parser.add_argument("--addr2line", default="xtensa-esp32s3-elf-addr2line", help="addr2line of the toolchain")
+    parser.add_argument("-o", "--output", default="profile.svg", help="flame graph to write")
+    parser.add_argument("--folded", help="also write the folded stacks here")
+    parser.add_argument("--save", help="also save the raw dump here")
+    parser.add_argument("--top", type=int, default=15, help="functions to list")
+    args = parser.parse_args()
+
+    try:
+        if os.path.exists(args.source):
+            with open(args.source, "rb") as f:
+                data = f.read()
+        else:
+            data = fetch_profile(args.source, args.ms)
+            if args.save:
+                with open(args.save, "wb") as f:
+                    f.write(data)
+        header, tasks, samples = parse_dump(data)
+        addresses = {s[0] for s in samples} | {s[1] for s in samples if s[1]}
+        names = symbolise(addresses, args.elf, args.addr2line)
+    except (OSError, ValueError, subprocess.CalledProcessError) as e:
+        print(f"Error: {e}")
+        sys.exit(1)
+    if not samples:
+        print("No samples")
+        sys.exit(1)
+
+    stacks = fold(tasks, samples, names)
+    if args.folded:
+        with open(args.folded, "w") as f:
+            f.writelines(f"{stack} {count}\n" for stack, count in stacks.most_common())
+    title = (f"{header['samples']} samples over {header['ms']} ms at {header['hz']} Hz per core"
+             f"{', ' + str(header['dropped']) + ' ticks dropped' if header['dropped'] else ''}")
+    with open(args.output, "w") as f:
+        f.write(flame_svg(stacks, title))
+    print(f"{title}; wrote {args.output}")
+
+    functions = Counter()
+    for pc, _, _, core, _ in samples:
+        functions[(core, names.get(pc, "??"))] += 1
+    per_core = Counter(s[3] for s in samples)
+    for (core, function), count in functions.most_common(args.top):
+        print(f"  core{core} {100 * count / per_core[core]:5.1f}%  {function}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""Script to measure the current each quality profile of the eyes draws.
+
+Runs on the robot's host, next to the INA226 that the power node reads (I2C
+bus 1, 0x40). The eyes loop one GIF through a temporary playlist while each
+profile of /quality is pinned in turn; after the profile has settled, the
+battery current is sampled and one line per profile is printed: mean and peak
+current, the saving against "full", the eyes' fps from /stats and how much of
+the time their CPUs were stepped down (/power). Everything else on the robot
+should stay as it is during the run, since the sensor sees the whole battery.
+The eyes' playlists and automatic profiles are restored afterwards.
+
+  python3 quality_bench.py 192.168.1.50 192.168.1.51 --gif idle.gif -o quality.json
+"""
+
+import sys
+import json
+import time
+import argparse
+import statistics
+import urllib.request
+
+PROFILES = ["full", "reduced", "saver", "static"]
+INA226_BUS = 1
+INA226_ADDRESS = 0x40
+INA226_CURRENT = 0x04
+CURRENT_LSB_MA = 0.457  # the power node's calibration
+
+
+def get(ip: str, path: str) -> dict:
+    with urllib.request.urlopen(f"http://{ip}{path}", timeout=10) as response:
+        return json.loads(response.read())
+
+
+def post_playlist(ip: str, text: str, mode: str):
+    request = urllib.request.Request(f"http://{ip}/playlist?mode={mode}", data=text.encode(),
+                                     headers={"Content-Type": "text/plain"}, method="POST")
+    urllib.request.urlopen(request, timeout=10).close()
+
+
+def read_current_ma(bus) -> float:
+    raw = bus.read_i2c_block_data(INA226_ADDRESS, INA226_CURRENT, 2)
+    value = int.from_bytes(bytes(raw), byteorder="big")
+    if value > 32767:
+        value -= 65536
+    return value * CURRENT_LSB_MA
+
+
+def measure(bus, eyes: list, profile: str, settle: float, seconds: float, rate: float) -> dict:
+    for ip in eyes:
+        get(ip, f"/quality?profile={profile}")
+        get(ip, "/power?reset=1")
+    time.sleep(settle)
+    samples = []
+    end = time.monotonic() + seconds
+    while time.monotonic() < end:
+        samples.append(read_current_ma(bus))
+        time.sleep(1 / rate)
+    fps = [get(ip, "/stats").get("fps", 0) for ip in eyes]
+    idle = [get(ip, "/power").get("idlePct", 0) for ip in eyes]
+    return {"profile": profile, "meanMa": statistics.mean(samples), "peakMa": max(samples),
+            "samples": len(samples), "fps": fps, "idlePct": idle}
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Measure the battery current of each eye quality profile")
+    parser.add_argument("eyes", nargs="+", help="addresses of the eyes")
+    parser.add_argument("--gif", required=True, help="GIF in /gif to loop while measuring")
+    parser.add_argument("--settle", type=float, default=10, help="seconds before sampling, more than the idle governor's 3 s")
+    parser.add_argument("--seconds", type=float, default=30, help="seconds of samples per profile")
+    parser.add_argument("--rate", type=float, default=10, help="current samples per second")
+    parser.add_argument("-o", "--output", help="save the results as JSON")
+    args = parser.parse_args()
+
+    try:
+        import smbus2
+        bus = smbus2.SMBus(INA226_BUS)
+        saved = {ip: get(ip, "/playlist") for ip in args.eyes}
+    except (ImportError, OSError, ValueError) as e:
+        print(f"Error: {e}")
+        sys.exit(1)
+    results = []
+    try:
+        for ip in args.eyes:
+            post_playlist(ip, f"{args.gif} 1000\n", "order")
+        for profile in PROFILES:
+            result = measure(bus, args.eyes, profile, args.settle, args.seconds, args.rate)
+            results.append(result)
+            saving = results[0]["meanMa"] - result["meanMa"]
+            print(f"{profile:8s} {result['meanMa']:7.1f} mA mean, {result['peakMa']:7.1f} mA peak, "
+                  f"saves {saving:6.1f} mA, fps {'/'.join(f'{f:.1f}' for f in result['fps'])}, "
+                  f"idle {'/'.join(f'{p:.0f}' for p in result['idlePct'])} %")
+    except (OSError, ValueError) as e:
+        print(f"Error: {e}")
+    finally:
+        for ip, playlist in saved.items():
+            try:
+                get(ip, "/quality?profile=auto")
+                lines = "".join(f"{item['name']} {item['loops']} {item['weight']}\n" for item in playlist["items"])
+                post_playlist(ip, lines, playlist["mode"])
+                if not playlist["running"]:
+                    get(ip, "/playlist?run=0")
+            except (OSError, ValueError) as e:
+                print(f"{ip}: could not restore the playlist: {e}")
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(results, f, indent=2)
+    if len(results) < len(PROFILES):
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
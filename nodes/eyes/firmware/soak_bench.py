@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""Script to run the firmware soak test on both eyes and compare builds.
+
+Starts /soak on every eye at once, so each eye drives itself with random
+plays, blinks and gaze moves, then polls the rolling summaries until the run
+ends and prints one line per eye and summary period: fps percentiles, frame
+and SD read time percentiles, the internal heap low-water mark and WiFi
+drops. The final summaries, with the firmware build each eye runs, are saved
+as JSON so a later run on another build can be compared with --compare.
+
+  python3 soak_bench.py 192.168.1.50 192.168.1.51 --hours 12 -o before.json
+  python3 soak_bench.py --compare before.json after.json
+"""
+
+import sys
+import json
+import time
+import argparse
+import urllib.request
+from concurrent.futures import ThreadPoolExecutor
+
+# Whole-run metrics compared between builds: name, label, True when higher is better
+METRICS = [
+    ("fpsP5", "fps p5", True),
+    ("fpsP50", "fps p50", True),
+    ("frameP99Us", "frame p99 us", False),
+    ("frameMaxUs", "frame max us", False),
+    ("sdReadP50Us", "SD read p50 us", False),
+    ("sdReadP99Us", "SD read p99 us", False),
+    ("internalMin", "internal free min", True),
+    ("internalLargestMin", "internal largest min", True),
+    ("psramLargestMin", "PSRAM largest min", True),
+    ("late", "late frames", False),
+    ("dropped", "dropped frames", False),
+    ("busy", "busy commands", False),
+    ("wifiDrops", "WiFi drops", False),
+]
+
+
+def soak(ip: str, query: str = "") -> dict:
+    with urllib.request.urlopen(f"http://{ip}/soak{query}", timeout=10) as response:
+        return json.loads(response.read())
+
+
+def period_line(period: dict) -> str:
+    return (f"{period['startS'] // 60:4d} min: fps {period['fpsP5']:.1f}/{period['fpsP50']:.1f} (p5/p50), "
+            f"frame {period['frameP50Us'] // 1000}/{period['frameP99Us'] // 1000}/{period['frameMaxUs'] // 1000} ms, "
+            f"SD read {period['sdReadP50Us'] // 1000}/{period['sdReadP99Us'] // 1000} ms, "
+            f"internal min {period['internalMin'] // 1024} KB ({period['internalLargestMin'] // 1024} KB block), "
+            f"WiFi drops {period['wifiDrops']}, busy {period['busy']}/{period['commands']}")
+
+
+def follow(ip: str, hours: int, poll: float) -> dict:
+    """Run the soak on one eye and return its final summary; raises OSError when the eye is lost."""
+    summary = soak(ip, f"?run=1&hours={hours}")
+    print(f"{ip}: soaking firmware {summary['firmware']} ({summary['build']}) for {hours} h")
+    printed = 0
+    while summary["running"]:
+        time.sleep(poll)
+        try:
+            summary = soak(ip)
+        except OSError as e:
+            print(f"{ip}: {e}, retrying")  # a WiFi drop is part of the test, the eye keeps going
+            continue
+        finished = summary["periods"][:-1]  # the last one is still filling up
+        done = summary["elapsedS"] // summary["periodS"]
+        for period in finished[max(0, len(finished) - (done - printed)):]:
+            print(f"{ip}: {period_line(period)}")
+        printed = done
+    return summary
+
+
+def compare(before: dict, after: dict):
+    for ip in sorted(set(before) & set(after)):
+        b, a = before[ip], after[ip]
+        print(f"{ip}: {b['firmware']} ({b['build']}) -> {a['firmware']} ({a['build']})")
+        for key, label, higher_better in METRICS:
+            old, new = b["run"][key], a["run"][key]
+            change = (new - old) / old * 100 if old else 0
+            worse = (new < old) if higher_better else (new > old)
+            flag = "  worse" if worse and abs(change) >= 5 else ""
+            print(f"  {label:22s} {old:>12} {new:>12} {change:+7.1f}%{flag}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Run the soak test on the eyes, or compare two runs")
+    parser.add_argument("eyes", nargs="*", help="addresses of the eyes")
+    parser.add_argument("--hours", type=int, default=8, help="length of the run")
+    parser.add_argument("--poll", type=float, default=60, help="seconds between two polls of /soak")
+    parser.add_argument("-o", "--output", help="save the final summaries as JSON")
+    parser.add_argument("--compare", nargs=2, metavar=("BEFORE", "AFTER"), help="compare two saved runs")
+    args = parser.parse_args()
+
+    if args.compare:
+        with open(args.compare[0]) as f, open(args.compare[1]) as g:
+            compare(json.load(f), json.load(g))
+        return
+    if not args.eyes:
+        parser.error("no eyes to soak")
+    try:
+        with ThreadPoolExecutor(max_workers=len(args.eyes)) as pool:
+            summaries = dict(zip(args.eyes, pool.map(lambda ip: follow(ip, args.hours, args.poll), args.eyes)))
+    except (OSError, ValueError) as e:
+        print(f"Error: {e}")
+        sys.exit(1)
+    for ip, summary in summaries.items():
+        print(f"{ip} run: {period_line(summary['run'])}")
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(summaries, f, indent=2)
+
+
+if __name__ == "__main__":
+    main()
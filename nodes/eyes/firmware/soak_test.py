@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+"""Script to soak an eye with requests and report heap drift.
+
+Replays thousands of /playgif requests, with the index page every few of
+them, against an eye, then compares the heap monitor in /stats with where it
+stood after a warm-up: allocated blocks, free memory and the largest free
+block per capability, allocation failures and the routes whose requests left
+blocks allocated. Caches fill during the warm-up, so what keeps growing after
+it is a leak, and a largest free block that keeps shrinking while free memory
+doesn't is fragmentation.
+
+Exits with 1 when the eye reports allocation failures or the allocated blocks
+grew by more than --max-block-growth, so it can gate a release.
+"""
+
+import sys
+import json
+import random
+import argparse
+import urllib.parse
+import urllib.request
+
+
+def get(ip: str, path: str, timeout: float = 10) -> bytes:
+    with urllib.request.urlopen(f"http://{ip}{path}", timeout=timeout) as response:
+        return response.read()
+
+
+def heap_stats(ip: str, reset: bool = False) -> dict:
+    stats = json.loads(get(ip, "/stats?reset=1" if reset else "/stats"))
+    if "heap" not in stats:
+        raise ValueError("the eye has no heap monitor (USE_HEAP_MONITOR)")
+    return stats["heap"]
+
+
+def heap_line(heap: dict) -> str:
+    parts = [f"blocks {heap['blocks']}"]
+    for kind in ("internal", "psram", "dma"):
+        if kind in heap:
+            parts.append(f"{kind} {heap[kind]['free'] // 1024} KB free, {heap[kind]['largest'] // 1024} KB largest")
+    return ", ".join(parts)
+
+
+def replay(ip: str, names: list[str], count: int, index_every: int) -> int:
+    """Send count /playgif requests, and / every index_every of them; returns the failed ones."""
+    failed = 0
+    for i in range(count):
+        paths = ["/playgif?name=" + urllib.parse.quote(random.choice(names))]
+        if index_every and i % index_every == 0:
+            paths.append("/")
+        for path in paths:
+            try:
+                get(ip, path)
+            except OSError as e:
+                failed += 1
+                print(f"{path}: {e}")
+    return failed
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Replay /playgif and / requests against an eye and report heap drift")
+    parser.add_argument("ip", help="address of the eye")
+    parser.add_argument("-n", "--requests", type=int, default=5000, help="/playgif requests after the warm-up")
+    parser.add_argument("--warmup", type=int, default=200, help="requests before the baseline is taken")
+    parser.add_argument("--index-every", type=int, default=5, help="load / after every N-th /playgif, 0 never")
+    parser.add_argument("--report-every", type=int, default=500, help="print the heap every N requests")
+    parser.add_argument("--max-block-growth", type=int, default=50,
+                        help="allocated blocks the soak may add before it fails")
+    parser.add_argument("--seed", type=int, help="random seed, to replay the same sequence")
+    args = parser.parse_args()
+    random.seed(args.seed)
+
+    try:
+        names = [name for name in json.loads(get(args.ip, "/gifs")) if "_preview." not in name]
+        if not names:
+            raise ValueError("no media on the eye")
+        replay(args.ip, names, args.warmup, args.index_every)
+        baseline = heap_stats(args.ip, reset=True)
+        print(f"Baseline: {heap_line(baseline)}")
+        failed = 0
+        for done in range(0, args.requests, args.report_every):
+            batch = min(args.report_every, args.requests - done)
+            failed += replay(args.ip, names, batch, args.index_every)
+            print(f"{done + batch} requests: {heap_line(heap_stats(args.ip))}")
+        final = heap_stats(args.ip)
+    except (OSError, ValueError) as e:
+        print(f"Error: {e}")
+        sys.exit(1)
+
+    growth = final["blocks"] - baseline["blocks"]
+    print(f"\nAllocated blocks: {growth:+d}, allocation failures: {final['allocFailures']}, failed requests: {failed}")
+    for kind in ("internal", "psram", "dma"):
+        if kind in final:
+            b, f = baseline[kind], final[kind]
+            print(f"{kind}: free {f['free'] - b['free']:+d} B (low {f['minFree']}), largest block "
+                  f"{f['largest'] - b['largest']:+d} B (low {f['minLargest']}), fragmentation {f['fragPct']}%")
+    for route in sorted(final["routes"], key=lambda r: -r["netBlocks"]):
+        if route["netBlocks"] > 0:
+            print(f"{route['path']}: {route['netBlocks']} blocks, {route['netBytes']} B left over "
+                  f"{route['requests']} requests, {route['grew']} of them grew the heap")
+    if final["allocFailures"] or growth > args.max_block_growth:
+        print("FAILED: the heap did not settle")
+        sys.exit(1)
+    print("OK")
+
+
+if __name__ == "__main__":
+    main()
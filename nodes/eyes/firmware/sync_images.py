@@ -2,8 +2,15 @@
 """Script to synchronize image files between a local directory and Wall-E eye devices.
 
 Scans the network for devices (or uses a specified IP), compares local files
-(GIFs/JPGs) with files on the device using MD5 checksums (if available on the device),
-and uploads/deletes files as needed to keep them in sync.
+(GIFs/JPGs) with the device's /manifest of MD5 checksums, and uploads/deletes
+files as needed to keep them in sync. Uploads stream the file as the request
+body and the device checks it against the local checksum.
+
+With --pack the directory is instead bundled into one asset pack (see
+pack_media.py) and uploaded in ranges that resume where the device left off.
+
+GIFs about to be uploaded are run through tools/tftemu when it is built, and
+those whose frames can't make their delays on the eye are flagged.
 
 Requires 'requests' and 'tqdm' Python packages.
 Network scanning relies on standard OS tools ('ping', 'netstat', 'ipconfig').
@@ -21,9 +28,19 @@ import socket
 import subprocess
 import platform
 import glob
+import json
+import zlib
 import concurrent.futures
 from tqdm import tqdm
 
+from pack_media import build_pack
+
+PACK_RANGE_SIZE = 256 * 1024  # bytes per /pack request
+READ_ONLY_STORES = ('builtin', 'pack')  # files the device plays from firmware or the asset pack
+CHUNK_SIZE = 32 * 1024  # bytes per /asset request, one upload buffer on the device
+RETRY_ERRORS = ('chunk CRC mismatch', 'checksum mismatch', 'past total')  # /asset errors a resend can fix
+TFTEMU = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'tools', 'tftemu')  # make -C tools tftemu
+
 
 def find_devices() -> list[str]:
     """Scan the network for Wall-E eye devices.
@@ -240,9 +257,9 @@ def get_local_files_with_checksums(local_dir: str) -> dict:
 def get_device_files_with_metadata(ip: str, max_retries: int = 3) -> dict:
     """Get a dictionary of files on the device with metadata (checksum, size).
 
-    Attempts to use an enhanced '/files' endpoint first (which should return
-    checksums). If that fails or is unavailable, falls back to the basic
-    '/gifs' endpoint which only returns filenames. Includes retry logic with
+    Uses the '/manifest' endpoint, which returns checksums and sizes. If that
+    fails or is unavailable (older firmware), falls back to the basic '/gifs'
+    endpoint which only returns filenames. Includes retry logic with
     increasing timeouts for robustness.
 
     Args:
@@ -251,7 +268,8 @@ def get_device_files_with_metadata(ip: str, max_retries: int = 3) -> dict:
 
     Returns:
         A dictionary where keys are filenames and values are dictionaries
-        containing 'checksum' and 'size' (which may be None if using fallback).
+        containing 'checksum', 'size' (which may be None if using fallback)
+        and, from the manifest, 'store'.
         Returns an empty dictionary on failure.
     """
 
@@ -274,9 +292,9 @@ def get_device_files_with_metadata(ip: str, max_retries: int = 3) -> dict:
                     raise
     
     try:
-        # First try to use the enhanced endpoint that would return checksums
+        # First try the manifest, which has the checksums
         try:
-            response = try_get_with_retry(f"http://{ip}/files", max_retries, 2)
+            response = try_get_with_retry(f"http://{ip}/manifest", max_retries, 2)
             if response and response.status_code == 200:
                 try:
                     # If we have enhanced API with checksums
@@ -329,57 +347,71 @@ def determine_sync_actions(local_files: dict, device_files: dict, delete_remote:
     for filename, local_info in local_files.items():
         if filename not in device_files:
             to_upload.append(local_info['path'])
-        elif device_files[filename]['checksum'] is not None and local_info['checksum'] != device_files[filename]['checksum']:
+        elif device_files[filename].get('store') in READ_ONLY_STORES:
+            continue  # an upload would be shadowed by the built-in or packed copy
+        elif device_files[filename]['checksum'] and local_info['checksum'] != device_files[filename]['checksum']:
             to_upload.append(local_info['path'])
     
     # Files to delete from device (if not in local directory)
     if delete_remote:
         for filename in device_files:
-            if filename not in local_files:
+            if filename not in local_files and device_files[filename].get('store') not in READ_ONLY_STORES:
                 to_delete.append(filename)
     
     return to_upload, to_delete
 
 
-def upload_file(args: tuple) -> tuple[bool, str, str]:
-    """Upload a single file to the device. Designed for parallel execution.
+def upload_file(args: tuple, max_retries: int = 5) -> tuple[bool, str, str]:
+    """Upload a single file to the device in checked chunks. Designed for parallel execution.
+
+    Continues where an earlier, interrupted upload of the file left off. Each
+    chunk carries its CRC-32 and the last one the file's MD5, which the device
+    checks against what reached its card.
 
     Args:
         args: A tuple containing (ip_address, local_file_path).
+        max_retries: Failed chunks tolerated before giving up.
 
     Returns:
         A tuple containing (success_boolean, filename, message).
     """
     ip, file_path = args
     filename = os.path.basename(file_path)
+    url = f'http://{ip}/asset/{filename}'
     
     try:
         with open(file_path, 'rb') as f:
-            files = {'file': (filename, f)}
-            response = requests.post(f'http://{ip}/upload', files=files, allow_redirects=False)
-            
-            # Accept both 302 (redirect) and 200 (OK) as success
-            if response.status_code in [200, 302]:
-                # Double-check the file was actually uploaded
-                try:
-                    # First try to get updated file list
-                    check_response = requests.get(f"http://{ip}/gifs", timeout=2)
-                    filenames = check_response.json()
-                    if filename in filenames:
-                        return (True, filename, "Success")
-                    else:
-                        # Try direct access as backup
-                        direct_check = requests.head(f"http://{ip}/gif/{filename}", timeout=2)
-                        if direct_check.status_code == 200:
-                            return (True, filename, "Success (verified by direct access)")
-                        else:
-                            # File not found despite 200/302 response
-                            return (False, filename, f"Upload appeared to succeed but file not found on device")
-                except Exception as e:
-                    # If we can't verify, assume success based on the upload response
-                    return (True, filename, "Success (unverified)")
+            data = f.read()
+        md5 = hashlib.md5(data).hexdigest()
+        offset = requests.get(url, timeout=5).json().get('received', 0)
+        if offset > len(data):
+            offset = 0
+        failures = 0
+        while failures <= max_retries:
+            chunk = data[offset:offset + CHUNK_SIZE]
+            try:
+                response = requests.put(url,
+                                        params={'offset': offset, 'total': len(data),
+                                                'crc': f'{zlib.crc32(chunk):08x}', 'md5': md5},
+                                        data=chunk, headers={'Content-Type': 'application/octet-stream'},
+                                        timeout=30)
+            except requests.exceptions.RequestException:
+                failures += 1
+                offset = requests.get(url, timeout=5).json().get('received', 0)
+                continue
+            if response.status_code == 200:
+                offset = response.json()['received']
+                if offset >= len(data):
+                    return (True, filename, "Success (checksum verified)")
+            elif response.status_code == 409 or (response.status_code == 400 and
+                                                  response.json().get('error') in RETRY_ERRORS):
+                failures += 1  # out of order or corrupted on the way, continue where the device is
+                offset = response.json()['received']
+                if offset > len(data):
+                    offset = 0  # a part file of another version, start over
             else:
-                return (False, filename, f"Failed: {response.status_code}")
+                return (False, filename, f"Failed: {response.status_code} {response.text}")
+        return (False, filename, "Failed: too many retries, run again to resume")
     except Exception as e:
         return (False, filename, f"Error: {str(e)}")
 
@@ -405,6 +437,120 @@ def delete_file(args: tuple) -> tuple[bool, str, str]:
         return (False, filename, f"Error deleting: {str(e)}")
 
 
+def get_pack_files(local_dir: str) -> list[str]:
+    """List the files for an asset pack: media in local_dir, native copies in local_dir/.native.
+
+    Args:
+        local_dir: The path to the local directory to scan.
+
+    Returns:
+        Sorted file paths, so an unchanged directory gives the same pack.
+    """
+    paths = []
+    for ext in ['*.gif', '*.jpg', '*.jpeg', '*.GIF', '*.JPG', '*.JPEG']:
+        paths.extend(glob.glob(os.path.join(local_dir, ext)))
+    paths.extend(glob.glob(os.path.join(local_dir, '.native', '*.565')))
+    return sorted(set(paths))
+
+
+def render_cost_report(paths: list[str]) -> list[dict] | None:
+    """Render cost of the GIFs among paths on the eye, from tools/tftemu --json.
+
+    Args:
+        paths: Local files; only GIFs are checked.
+
+    Returns:
+        One dict per GIF with decodeUs, bytesPerFrame, turboBytes, framesOver,
+        stutter and so on (see the Readme), or None when tftemu isn't built.
+    """
+    gifs = [p for p in paths if p.lower().endswith('.gif')]
+    if not os.path.exists(TFTEMU):
+        return None
+    if not gifs:
+        return []
+    try:
+        result = subprocess.run([TFTEMU, '--json'] + gifs, stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                                text=True, timeout=600)
+    except (OSError, subprocess.SubprocessError):
+        return None
+    reports = []
+    for line in result.stdout.splitlines():
+        try:
+            reports.append(json.loads(line))
+        except ValueError:
+            pass
+    return reports
+
+
+def flag_stuttering(paths: list[str]) -> list[str]:
+    """Print the render cost check of the GIFs about to be uploaded.
+
+    Returns:
+        Names of the GIFs with frames that would miss their delay on the eye.
+    """
+    reports = render_cost_report(paths)
+    if reports is None:
+        print("Render cost not checked: build tools/tftemu with 'make -C tools tftemu'")
+        return []
+    flagged = []
+    for r in reports:
+        if r['stutter']:
+            flagged.append(r['name'])
+            print(f"⚠ {r['name']} will stutter: {r['framesOver']} of {r['frames']} frames miss their delay, "
+                  f"{r['frameUs'] / 1000:.1f} ms per frame ({r['decodeUs'] / 1000:.1f} ms decoding, "
+                  f"{r['bytesPerFrame'] / 1024:.0f} KB on the bus), {r['predictedFps']:.1f} of "
+                  f"{r['authoredFps']:.1f} fps")
+    if reports and not flagged:
+        print(f"Render cost checked: all {len(reports)} GIFs keep their frame rate")
+    return flagged
+
+
+def upload_pack(ip: str, image: bytes, max_retries: int = 5) -> bool:
+    """Upload an asset pack in ranges, resuming a pending upload of the same pack.
+
+    Args:
+        ip: The IP address of the device.
+        image: The pack, as built by pack_media.build_pack().
+        max_retries: Failed requests tolerated before giving up.
+
+    Returns:
+        True once the device installed the pack.
+    """
+    pack_id = hashlib.sha1(image).hexdigest()[:16]
+    total = len(image)
+    failures = 0
+    status = None
+    while failures <= max_retries:
+        try:
+            if status is None:
+                status = requests.get(f'http://{ip}/pack', timeout=10).json()
+            if status.get('installed') == pack_id and status.get('id') != pack_id:
+                print("Device has this pack installed")
+                return True
+            offset = status['received'] if status.get('id') == pack_id and status['received'] <= total else 0
+            end = min(offset + PACK_RANGE_SIZE, total)
+            response = requests.post(f'http://{ip}/pack',
+                                     params={'id': pack_id, 'offset': offset, 'total': total},
+                                     data=image[offset:end],
+                                     headers={'Content-Type': 'application/octet-stream'},
+                                     timeout=60)
+            if response.status_code == 400:
+                print(f"Device refused the pack: {response.text}")
+                return False
+            status = response.json() if response.status_code in (200, 409) else None
+            if response.status_code != 200:
+                failures += 1
+                continue
+            print(f"Sent {end} of {total} bytes")
+        except (requests.exceptions.RequestException, ValueError) as e:
+            print(f"Pack upload interrupted: {e}")
+            failures += 1
+            status = None
+            time.sleep(1)
+    print("Giving up on the pack upload, run again to resume")
+    return False
+
+
 def sync_files(ip: str, files_to_upload: list, files_to_delete: list, max_workers: int = 5, use_parallel: bool = False) -> tuple[int, int]:
     """Perform file synchronization (uploads and deletes) with the device.
 
@@ -530,6 +676,7 @@ def main():
     parser.add_argument('--upload-workers', type=int, default=5, help='Number of parallel uploads/deletes (default: 5)')
     parser.add_argument('--parallel', action='store_true', help='Use parallel uploads instead of sequential (not recommended)')
     parser.add_argument('--delete-remote', action='store_true', help='Delete files on device that do not exist locally')
+    parser.add_argument('--pack', action='store_true', help='Upload the directory as one resumable asset pack instead of file by file')
     args = parser.parse_args()
     
     # Validate local directory
@@ -559,6 +706,14 @@ def main():
             ip = devices[0]
     else:
         ip = args.ip
+
+    if args.pack:
+        pack_files = get_pack_files(args.local_dir)
+        flag_stuttering(pack_files)
+        print("Building the asset pack...")
+        image = build_pack(pack_files, None, assets=True)
+        print(f"Uploading {len(image)} bytes to {ip}...")
+        sys.exit(0 if upload_pack(ip, image) else 1)
     
     # Get local and device files with checksums
     print("Scanning local files...")
@@ -587,6 +742,7 @@ def main():
             print(f"  {os.path.basename(file_path)}")
         if len(files_to_upload) > 5:
             print(f"  ... and {len(files_to_upload) - 5} more")
+        flag_stuttering(files_to_upload)
     else:
         print("No files to upload")
         
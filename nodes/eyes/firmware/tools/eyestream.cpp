@@ -0,0 +1,454 @@
+// Host-side frame streamer for the Wall-E eyes.
+//
+// Sends 240x240 RGB565 frames to an eye's stream port (UDP 4212) as the
+// firmware's playStream() expects them: every frame is compared with the one
+// sent before, the rectangles that changed are cut into pieces of at most one
+// DMA strip, and each piece goes out in a datagram of its own, raw, run-length
+// coded or LZ4 compressed, whichever is smallest. A full keyframe every
+// --keyframe frames repairs what lost datagrams left behind.
+//
+// Frames come from a GIF, decoded with the firmware's AnimatedGIF sources, or
+// as raw big-endian RGB565 from stdin ("-"), so the robot brain can pipe in
+// anything it renders. StreamEncoder can also be used on its own.
+//
+// Build: make -C tools eyestream
+
+#include "../libraries/AnimatedGIF/src/AnimatedGIF.h"
+#include "../libraries/AnimatedGIF/src/gif.inl"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Must match wall-e_eye.ino
+#define STREAM_SIZE 240             // DISPLAY_WIDTH, the panel is square
+#define STREAM_PORT 4212
+#define STREAM_PACKET_SIZE 1472
+#define STREAM_RECT_PIXELS (240 * 8) // DISPLAY_WIDTH * DMA_STRIP_LINES
+#define STREAM_FRAME_END 1
+#define STREAM_KEYFRAME 2
+
+enum StreamCodec { STREAM_RAW, STREAM_RLE, STREAM_LZ4, STREAM_AUTO };
+static const char *codecNames[] = { "raw", "rle", "lz4", "auto" };
+
+#define DEFAULT_FPS 30
+#define DEFAULT_KEYFRAME 30 // frames between full frames
+#define LZ4_HASH_BITS 12
+
+struct __attribute__((packed)) StreamHeader {
+  char magic[2];
+  uint8_t codec;
+  uint8_t flags;
+  uint16_t seq;
+  uint16_t frame;
+  uint16_t x, y, w, h;
+};
+
+#define STREAM_PAYLOAD (STREAM_PACKET_SIZE - (int)sizeof(StreamHeader))
+
+typedef std::vector<uint8_t> Datagram;
+
+// Run-length code of big-endian RGB565: n < 128 then n + 1 literal pixels, 128 + n then one pixel
+// repeated n + 1 times
+static void rleEncode(const uint16_t *pixels, size_t count, std::vector<uint8_t> &out)
+{
+  size_t i = 0;
+  while (i < count) {
+    size_t run = 1;
+    while (i + run < count && run < 128 && pixels[i + run] == pixels[i])
+      run++;
+    if (run >= 2) {
+      out.push_back(0x80 | (run - 1));
+      out.insert(out.end(), (const uint8_t *)&pixels[i], (const uint8_t *)&pixels[i] + 2);
+      i += run;
+      continue;
+    }
+    size_t start = i++;
+    while (i < count && i - start < 128 && !(i + 1 < count && pixels[i + 1] == pixels[i]))
+      i++;
+    out.push_back(i - start - 1);
+    out.insert(out.end(), (const uint8_t *)&pixels[start], (const uint8_t *)&pixels[i]);
+  }
+}
+
+static void lz4Length(size_t length, std::vector<uint8_t> &out)
+{
+  for (length -= 15; length >= 255; length -= 255)
+    out.push_back(255);
+  out.push_back(length);
+}
+
+static void lz4Sequence(const uint8_t *literals, size_t count, size_t offset, size_t match,
+                        std::vector<uint8_t> &out)
+{
+  uint8_t token = std::min<size_t>(count, 15) << 4;
+  if (match)
+    token |= std::min<size_t>(match - 4, 15);
+  out.push_back(token);
+  if (count >= 15)
+    lz4Length(count, out);
+  out.insert(out.end(), literals, literals + count);
+  if (!match)
+    return;
+  out.push_back(offset & 0xFF);
+  out.push_back(offset >> 8);
+  if (match - 4 >= 15)
+    lz4Length(match - 4, out);
+}
+
+// Greedy LZ4 block compression; keeps the format's end rules (last 5 bytes literal, no match
+// starting in the last 12) so any LZ4 decoder takes it
+static void lz4Encode(const uint8_t *src, size_t size, std::vector<uint8_t> &out)
+{
+  std::vector<int> table(1 << LZ4_HASH_BITS, -1);
+  size_t anchor = 0, i = 0;
+  while (size >= 13 && i < size - 12) {
+    uint32_t word;
+    memcpy(&word, src + i, 4);
+    uint32_t hash = (word * 2654435761u) >> (32 - LZ4_HASH_BITS);
+    int candidate = table[hash];
+    table[hash] = (int)i;
+    if (candidate < 0 || i - candidate > 65535 || memcmp(src + candidate, src + i, 4) != 0) {
+      i++;
+      continue;
+    }
+    size_t match = 4;
+    while (i + match < size - 5 && src[candidate + match] == src[i + match])
+      match++;
+    lz4Sequence(src + anchor, i - anchor, i - candidate, match, out);
+    i += match;
+    anchor = i;
+  }
+  lz4Sequence(src + anchor, size - anchor, 0, 0, out);
+}
+
+// Turns frames into stream datagrams; keeps the previous frame to find what changed
+class StreamEncoder {
+public:
+  StreamEncoder(int codec = STREAM_AUTO, int keyframeInterval = DEFAULT_KEYFRAME)
+    : codec(codec), keyframeInterval(keyframeInterval), last(STREAM_SIZE * STREAM_SIZE) {}
+
+  // Datagrams for the next frame of STREAM_SIZE x STREAM_SIZE big-endian RGB565 pixels
+  std::vector<Datagram> encode(const uint16_t *pixels)
+  {
+    bool keyframe = frame == 0 || (keyframeInterval > 0 && frame % keyframeInterval == 0);
+    std::vector<Datagram> datagrams;
+    int bandLines = STREAM_RECT_PIXELS / STREAM_SIZE;
+    for (int y0 = 0; y0 < STREAM_SIZE; y0 += bandLines) {
+      int y1 = std::min(y0 + bandLines, STREAM_SIZE);
+      int top = STREAM_SIZE, bottom = -1, left = STREAM_SIZE, right = -1;
+      for (int y = y0; y < y1; y++) {
+        const uint16_t *row = pixels + y * STREAM_SIZE, *before = &last[y * STREAM_SIZE];
+        int x0 = 0, x1 = STREAM_SIZE - 1;
+        if (!keyframe) {
+          while (x0 < STREAM_SIZE && row[x0] == before[x0])
+            x0++;
+          if (x0 == STREAM_SIZE)
+            continue;
+          while (row[x1] == before[x1])
+            x1--;
+        }
+        top = std::min(top, y);
+        bottom = y;
+        left = std::min(left, x0);
+        right = std::max(right, x1);
+      }
+      if (bottom >= 0)
+        addRect(pixels, left, top, right - left + 1, bottom - top + 1, keyframe, datagrams);
+    }
+    if (datagrams.empty())
+      datagrams.push_back(datagram(STREAM_RAW, 0, 0, 0, 0, 0, NULL, 0)); // frame boundary only
+    StreamHeader *header = (StreamHeader *)datagrams.back().data();
+    header->flags |= STREAM_FRAME_END;
+    memcpy(last.data(), pixels, last.size() * sizeof(uint16_t));
+    frame++;
+    return datagrams;
+  }
+
+  // The next frame is sent whole, e.g. after the eye restarted
+  void forceKeyframe() { frame = 0; }
+
+private:
+  Datagram datagram(int codec, int flags, int x, int y, int w, int h, const uint8_t *payload, size_t length)
+  {
+    StreamHeader header = { { 'E', 'S' }, (uint8_t)codec, (uint8_t)flags, seq++, (uint16_t)frame,
+                            (uint16_t)x, (uint16_t)y, (uint16_t)w, (uint16_t)h };
+    Datagram out((const uint8_t *)&header, (const uint8_t *)&header + sizeof(header));
+    out.insert(out.end(), payload, payload + length);
+    return out;
+  }
+
+  // One rectangle in the smallest coding; halved by rows while it doesn't fit a datagram
+  void addRect(const uint16_t *pixels, int x, int y, int w, int h, bool keyframe, std::vector<Datagram> &out)
+  {
+    std::vector<uint16_t> rect(w * h);
+    for (int row = 0; row < h; row++)
+      memcpy(&rect[row * w], pixels + (y + row) * STREAM_SIZE + x, w * sizeof(uint16_t));
+    const uint8_t *raw = (const uint8_t *)rect.data();
+    size_t rawBytes = rect.size() * sizeof(uint16_t);
+    int bestCodec = STREAM_RAW;
+    std::vector<uint8_t> best(raw, raw + rawBytes), coded;
+    if (codec == STREAM_RLE || codec == STREAM_AUTO) {
+      rleEncode(rect.data(), rect.size(), coded);
+      if (coded.size() < best.size() || codec == STREAM_RLE) {
+        bestCodec = STREAM_RLE;
+        best.swap(coded);
+      }
+    }
+    if (codec == STREAM_LZ4 || codec == STREAM_AUTO) {
+      coded.clear();
+      lz4Encode(raw, rawBytes, coded);
+      if (coded.size() < best.size() || codec == STREAM_LZ4) {
+        bestCodec = STREAM_LZ4;
+        best.swap(coded);
+      }
+    }
+    if ((int)best.size() > STREAM_PAYLOAD && h > 1) {
+      addRect(pixels, x, y, w, h / 2, keyframe, out);
+      addRect(pixels, x, y + h / 2, w, h - h / 2, keyframe, out);
+      return;
+    }
+    if ((int)best.size() > STREAM_PAYLOAD) { // one row that a forced codec grew past a datagram
+      bestCodec = STREAM_RAW;
+      best.assign(raw, raw + rawBytes);
+    }
+    out.push_back(datagram(bestCodec, keyframe ? STREAM_KEYFRAME : 0, x, y, w, h, best.data(), best.size()));
+  }
+
+  int codec;
+  int keyframeInterval;
+  uint16_t seq = 0;
+  uint32_t frame = 0;
+  std::vector<uint16_t> last; // frame sent before
+};
+
+// GIF frames composed onto the stream canvas, centred and cropped
+static std::vector<uint16_t> gifCanvas;
+static int gifX, gifY;
+
+static void gifDraw(GIFDRAW *pDraw)
+{
+  int y = gifY + pDraw->iY + pDraw->y;
+  if (y < 0 || y >= STREAM_SIZE)
+    return;
+  const uint16_t *line = (const uint16_t *)pDraw->pPixels;
+  for (int i = 0; i < pDraw->iWidth; i++) {
+    int x = gifX + pDraw->iX + i;
+    if (x >= 0 && x < STREAM_SIZE)
+      gifCanvas[y * STREAM_SIZE + x] = line[i];
+  }
+}
+
+static bool readFile(const char *path, std::vector<uint8_t> &data)
+{
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return false;
+  fseek(f, 0, SEEK_END);
+  data.resize(ftell(f));
+  fseek(f, 0, SEEK_SET);
+  bool ok = fread(data.data(), 1, data.size(), f) == data.size();
+  fclose(f);
+  return ok;
+}
+
+struct Options {
+  int fps = DEFAULT_FPS;
+  int codec = STREAM_AUTO;
+  int keyframe = DEFAULT_KEYFRAME;
+  bool loop = false;
+  bool verbose = false;
+  const char *host = NULL;
+  int port = STREAM_PORT;
+  const char *input = NULL;
+};
+
+static void usage()
+{
+  fprintf(stderr,
+          "Usage: eyestream [options] <host>[:port] <input.gif | ->\n"
+          "  Streams frames to an eye's stream port (default %d). \"-\" reads raw frames of\n"
+          "  %dx%d big-endian RGB565 from stdin.\n"
+          "  --fps N           frame rate for stdin frames, GIFs use their own delays (default %d)\n"
+          "  --codec C         raw, rle, lz4 or auto (default auto: the smallest per rectangle)\n"
+          "  --keyframe N      send the whole frame every N frames, 0 only the first (default %d)\n"
+          "  --loop            play the GIF until interrupted\n"
+          "  -v, --verbose     print datagrams and bytes once a second\n",
+          STREAM_PORT, STREAM_SIZE, STREAM_SIZE, DEFAULT_FPS, DEFAULT_KEYFRAME);
+}
+
+static bool parseArgs(int argc, char **argv, Options &opt)
+{
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--fps" && i + 1 < argc) {
+      opt.fps = atoi(argv[++i]);
+    } else if (arg == "--codec" && i + 1 < argc) {
+      std::string name = argv[++i];
+      opt.codec = -1;
+      for (int c = 0; c <= STREAM_AUTO; c++)
+        if (name == codecNames[c])
+          opt.codec = c;
+      if (opt.codec < 0)
+        return false;
+    } else if (arg == "--keyframe" && i + 1 < argc) {
+      opt.keyframe = atoi(argv[++i]);
+    } else if (arg == "--loop") {
+      opt.loop = true;
+    } else if (arg == "-v" || arg == "--verbose") {
+      opt.verbose = true;
+    } else if (arg.size() > 1 && arg[0] == '-') {
+      return false;
+    } else if (!opt.host) {
+      opt.host = argv[i];
+    } else if (!opt.input) {
+      opt.input = argv[i];
+    } else {
+      return false;
+    }
+  }
+  return opt.host && opt.input && opt.fps > 0 && opt.keyframe >= 0;
+}
+
+// UDP socket connected to host[:port]; -1 on failure
+static int openSocket(const Options &opt)
+{
+  std::string host = opt.host;
+  std::string port = std::to_string(opt.port);
+  size_t colon = host.rfind(':');
+  if (colon != std::string::npos) {
+    port = host.substr(colon + 1);
+    host.resize(colon);
+  }
+  addrinfo hints = {}, *addr = NULL;
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addr) != 0)
+    return -1;
+  int sock = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+  if (sock >= 0 && connect(sock, addr->ai_addr, addr->ai_addrlen) != 0) {
+    close(sock);
+    sock = -1;
+  }
+  freeaddrinfo(addr);
+  return sock;
+}
+
+struct Sender {
+  int sock;
+  bool verbose;
+  StreamEncoder encoder;
+  std::chrono::steady_clock::time_point due = std::chrono::steady_clock::now();
+  std::chrono::steady_clock::time_point reported = due;
+  long datagrams = 0, bytes = 0, frames = 0;
+
+  Sender(int sock, const Options &opt) : sock(sock), verbose(opt.verbose), encoder(opt.codec, opt.keyframe) {}
+
+  // Send a frame when it is due, then hold the next one back for delayMs
+  bool send(const uint16_t *pixels, int delayMs)
+  {
+    std::this_thread::sleep_until(due);
+    for (const Datagram &d : encoder.encode(pixels)) {
+      if (::send(sock, d.data(), d.size(), 0) < 0) {
+        perror("send");
+        return false;
+      }
+      datagrams++;
+      bytes += d.size();
+    }
+    frames++;
+    due += std::chrono::milliseconds(delayMs);
+    auto now = std::chrono::steady_clock::now();
+    if (due < now)
+      due = now; // behind, don't catch up with a burst
+    if (verbose && now - reported >= std::chrono::seconds(1)) {
+      double s = std::chrono::duration<double>(now - reported).count();
+      fprintf(stderr, "%.1f frames/s, %.0f datagrams/s, %.1f KB/s\n", frames / s, datagrams / s, bytes / s / 1024);
+      reported = now;
+      frames = datagrams = bytes = 0;
+    }
+    return true;
+  }
+};
+
+static int streamGif(const Options &opt, Sender &sender)
+{
+  std::vector<uint8_t> data;
+  if (!readFile(opt.input, data)) {
+    fprintf(stderr, "Error: cannot read %s\n", opt.input);
+    return 1;
+  }
+  GIFIMAGE *gif = (GIFIMAGE *)malloc(sizeof(GIFIMAGE));
+  GIF_begin(gif, GIF_PALETTE_RGB565_BE);
+  if (!GIF_openRAM(gif, data.data(), (int)data.size(), gifDraw)) {
+    fprintf(stderr, "Error: %s is not a GIF\n", opt.input);
+    free(gif);
+    return 1;
+  }
+  int width = GIF_getCanvasWidth(gif), height = GIF_getCanvasHeight(gif);
+  std::vector<uint8_t> frameBuf(width * height + 2 * MAX_WIDTH, 0); // canvas plus one cooked line
+  gif->pFrameBuffer = frameBuf.data();
+  gif->ucDrawType = GIF_DRAW_COOKED;
+  gifCanvas.assign(STREAM_SIZE * STREAM_SIZE, 0);
+  gifX = (STREAM_SIZE - width) / 2;
+  gifY = (STREAM_SIZE - height) / 2;
+  int result = 0;
+  do {
+    int rc = 1, delayMs = 0;
+    while (rc > 0) {
+      rc = GIF_playFrame(gif, &delayMs, NULL);
+      if (gif->iError != GIF_SUCCESS && gif->iError != GIF_EMPTY_FRAME) {
+        fprintf(stderr, "Error: decoding %s failed (%d)\n", opt.input, gif->iError);
+        result = 1;
+        break;
+      }
+      if (!sender.send(gifCanvas.data(), delayMs > 0 ? delayMs : 1000 / opt.fps)) {
+        result = 1;
+        break;
+      }
+    }
+    GIF_reset(gif);
+  } while (opt.loop && result == 0);
+  GIF_close(gif);
+  free(gif);
+  return result;
+}
+
+static int streamStdin(const Options &opt, Sender &sender)
+{
+  std::vector<uint16_t> frame(STREAM_SIZE * STREAM_SIZE);
+  size_t bytes = frame.size() * sizeof(uint16_t);
+  while (fread(frame.data(), 1, bytes, stdin) == bytes) {
+    if (!sender.send(frame.data(), 1000 / opt.fps))
+      return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  Options opt;
+  if (!parseArgs(argc, argv, opt)) {
+    usage();
+    return 2;
+  }
+  int sock = openSocket(opt);
+  if (sock < 0) {
+    fprintf(stderr, "Error: cannot reach %s\n", opt.host);
+    return 1;
+  }
+  Sender sender(sock, opt);
+  int result = strcmp(opt.input, "-") == 0 ? streamStdin(opt, sender) : streamGif(opt, sender);
+  close(sock);
+  return result;
+}
@@ -0,0 +1,294 @@
+// Host benchmark for AnimatedGIF decode throughput over a directory of GIFs.
+//
+// Every file is decoded from memory in the four modes the firmware can use:
+// RAW (8-bit lines translated through the palette in the draw callback),
+// COOKED (frame buffer, library does transparency and palette), TURBO
+// (COOKED plus the Turbo buffer) and WINDOW (COOKED plus the windowed Turbo
+// buffer of USE_TURBO_WINDOW). Results are written as CSV, one line per file
+// and mode, so they can be kept and compared with --baseline.
+//
+// Build: make -C tools gifbench
+
+#include "../libraries/AnimatedGIF/src/AnimatedGIF.h"
+#include "../libraries/AnimatedGIF/src/gif.inl"
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#define DEFAULT_RUNS 3          // passes per file and mode, the fastest one counts
+#define DEFAULT_MIN_TIME 100    // ms a pass keeps decoding the file again, evens out timer noise
+#define DEFAULT_TOLERANCE 10.0  // % of frames/s a file may lose against the baseline
+#define WINDOW_BYTES GIF_TURBO_WINDOW_BYTES(240, 24) // the firmware's TURBO_WINDOW_BYTES
+
+enum BenchMode { MODE_RAW, MODE_COOKED, MODE_TURBO, MODE_WINDOW };
+static const char *modeNames[] = { "raw", "cooked", "turbo", "window" };
+
+struct BenchResult {
+  std::string file;
+  std::string mode;
+  int frames = 0;
+  long pixels = 0;       // pixels in all frame rectangles
+  double ms = 0;         // decode time of one pass
+  long bytesRead = 0;    // bytes requested from the reader in one pass
+  long peakBytes = 0;    // decoder state plus buffers
+};
+
+static long bytesRead = 0;
+static uint16_t lineBuf[MAX_WIDTH];
+
+// Count what the decoder pulls from the file, the same reads would go to the SD card
+static int32_t countingRead(GIFFILE *pFile, uint8_t *pBuf, int32_t iLen)
+{
+  int32_t n = readMem(pFile, pBuf, iLen);
+  bytesRead += n;
+  return n;
+}
+
+// RAW mode does the palette lookup the firmware's GIFDraw() does
+static void rawDraw(GIFDRAW *pDraw)
+{
+  GIF_expandLine565(lineBuf, pDraw->pPixels, pDraw->pPalette, pDraw->iWidth);
+}
+
+static void cookedDraw(GIFDRAW *pDraw)
+{
+  (void)pDraw; // lines are already RGB565
+}
+
+// Decode the whole file once; false if no frame could be decoded
+static bool decodeFile(std::vector<uint8_t> &data, int mode, BenchResult &result)
+{
+  GIFIMAGE *gif = (GIFIMAGE *)malloc(sizeof(GIFIMAGE));
+  GIF_begin(gif, GIF_PALETTE_RGB565_BE);
+  if (!GIF_openRAM(gif, data.data(), (int)data.size(), mode == MODE_RAW ? rawDraw : cookedDraw)) {
+    free(gif);
+    return false;
+  }
+  gif->pfnRead = countingRead;
+  int pixels = GIF_getCanvasWidth(gif) * GIF_getCanvasHeight(gif);
+  std::vector<uint8_t> frameBuf, turboBuf;
+  if (mode != MODE_RAW) {
+    frameBuf.assign(pixels + 2 * MAX_WIDTH, 0); // canvas plus one cooked line, as on the device
+    gif->pFrameBuffer = frameBuf.data();
+    gif->ucDrawType = GIF_DRAW_COOKED;
+  }
+  if (mode == MODE_TURBO) {
+    turboBuf.assign(TURBO_BUFFER_SIZE + pixels, 0);
+    gif->pTurboBuffer = turboBuf.data();
+  } else if (mode == MODE_WINDOW) {
+    turboBuf.assign(WINDOW_BYTES, 0);
+    gif->pTurboWindow = turboBuf.data();
+    gif->iTurboWindowSize = (int)turboBuf.size();
+  }
+  result.peakBytes = sizeof(GIFIMAGE) + frameBuf.size() + turboBuf.size();
+
+  result.frames = 0;
+  result.pixels = 0;
+  int rc = 1;
+  while (rc > 0) {
+    rc = GIF_playFrame(gif, NULL, NULL);
+    if (gif->iError != GIF_SUCCESS)
+      break;
+    result.frames++;
+    result.pixels += (long)gif->iWidth * gif->iHeight;
+  }
+  GIF_close(gif);
+  free(gif);
+  return result.frames > 0;
+}
+
+// One pass: decode the file repeatedly for at least minTimeMs and report the time of one decode
+static bool runOnce(std::vector<uint8_t> &data, int mode, double minTimeMs, BenchResult &result)
+{
+  bytesRead = 0;
+  int loops = 0;
+  double elapsed = 0;
+  auto start = std::chrono::steady_clock::now();
+  do {
+    if (!decodeFile(data, mode, result))
+      return false;
+    loops++;
+    elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  } while (elapsed < minTimeMs);
+  result.ms = elapsed / loops;
+  result.bytesRead = bytesRead / loops;
+  return true;
+}
+
+static bool readFile(const std::string &path, std::vector<uint8_t> &data)
+{
+  FILE *f = fopen(path.c_str(), "rb");
+  if (!f)
+    return false;
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  data.resize(size > 0 ? size : 0);
+  bool ok = size > 0 && fread(data.data(), 1, size, f) == (size_t)size;
+  fclose(f);
+  return ok;
+}
+
+static std::vector<std::string> listGifs(const char *dir)
+{
+  std::vector<std::string> names;
+  DIR *d = opendir(dir);
+  if (!d)
+    return names;
+  while (struct dirent *e = readdir(d)) {
+    std::string name = e->d_name;
+    if (name.size() > 4 && name[0] != '.' &&
+        (name.compare(name.size() - 4, 4, ".gif") == 0 || name.compare(name.size() - 4, 4, ".GIF") == 0))
+      names.push_back(name);
+  }
+  closedir(d);
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+static double framesPerSecond(const BenchResult &r)
+{
+  return r.ms > 0 ? r.frames * 1000.0 / r.ms : 0;
+}
+
+static void printCsvHeader(FILE *out)
+{
+  fprintf(out, "file,mode,frames,pixels,ms,fps,ns_per_pixel,bytes_read,peak_bytes\n");
+}
+
+static void printCsv(FILE *out, const BenchResult &r)
+{
+  fprintf(out, "%s,%s,%d,%ld,%.3f,%.1f,%.2f,%ld,%ld\n", r.file.c_str(), r.mode.c_str(), r.frames, r.pixels, r.ms,
+          framesPerSecond(r), r.pixels ? r.ms * 1e6 / r.pixels : 0, r.bytesRead, r.peakBytes);
+}
+
+// file,mode -> fps of an earlier run
+static std::map<std::string, double> loadBaseline(const char *path)
+{
+  std::map<std::string, double> fps;
+  FILE *f = fopen(path, "r");
+  if (!f)
+    return fps;
+  char line[512];
+  while (fgets(line, sizeof(line), f)) {
+    char file[256], mode[16];
+    int frames;
+    long pixels;
+    double ms, value;
+    if (sscanf(line, "%255[^,],%15[^,],%d,%ld,%lf,%lf", file, mode, &frames, &pixels, &ms, &value) == 6)
+      fps[std::string(file) + "," + mode] = value;
+  }
+  fclose(f);
+  return fps;
+}
+
+static void usage()
+{
+  fprintf(stderr,
+          "usage: gifbench [options] directory\n"
+          "  --runs N          passes per file and mode, fastest counts (default %d)\n"
+          "  --min-time MS     keep decoding a file for at least MS per pass (default %d)\n"
+          "  --mode M          only raw, cooked, turbo or window\n"
+          "  --baseline FILE   compare frames/s with an earlier CSV, exit 1 on regressions\n"
+          "  --tolerance P     allowed frames/s loss in %% (default %.0f)\n",
+          DEFAULT_RUNS, DEFAULT_MIN_TIME, DEFAULT_TOLERANCE);
+}
+
+int main(int argc, char **argv)
+{
+  int runs = DEFAULT_RUNS;
+  double minTime = DEFAULT_MIN_TIME;
+  int onlyMode = -1;
+  double tolerance = DEFAULT_TOLERANCE;
+  const char *baselinePath = NULL;
+  const char *dir = NULL;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--runs" && i + 1 < argc) {
+      runs = atoi(argv[++i]);
+    } else if (arg == "--min-time" && i + 1 < argc) {
+      minTime = atof(argv[++i]);
+    } else if (arg == "--mode" && i + 1 < argc) {
+      std::string m = argv[++i];
+      for (int k = MODE_RAW; k <= MODE_WINDOW; k++) {
+        if (m == modeNames[k])
+          onlyMode = k;
+      }
+      if (onlyMode < 0) {
+        usage();
+        return 2;
+      }
+    } else if (arg == "--baseline" && i + 1 < argc) {
+      baselinePath = argv[++i];
+    } else if (arg == "--tolerance" && i + 1 < argc) {
+      tolerance = atof(argv[++i]);
+    } else if (arg[0] != '-' && !dir) {
+      dir = argv[i];
+    } else {
+      usage();
+      return 2;
+    }
+  }
+  if (!dir || runs <= 0 || minTime < 0) {
+    usage();
+    return 2;
+  }
+
+  std::vector<std::string> names = listGifs(dir);
+  if (names.empty()) {
+    fprintf(stderr, "No GIFs in %s\n", dir);
+    return 1;
+  }
+  std::map<std::string, double> baseline;
+  if (baselinePath)
+    baseline = loadBaseline(baselinePath);
+
+  printCsvHeader(stdout);
+  int regressions = 0, failures = 0;
+  for (const std::string &name : names) {
+    std::vector<uint8_t> data;
+    if (!readFile(std::string(dir) + "/" + name, data)) {
+      fprintf(stderr, "Could not read %s\n", name.c_str());
+      failures++;
+      continue;
+    }
+    for (int mode = MODE_RAW; mode <= MODE_WINDOW; mode++) {
+      if (onlyMode >= 0 && mode != onlyMode)
+        continue;
+      BenchResult best;
+      bool ok = false;
+      for (int run = 0; run < runs; run++) {
+        BenchResult r;
+        if (!runOnce(data, mode, minTime, r))
+          break;
+        if (!ok || r.ms < best.ms)
+          best = r;
+        ok = true;
+      }
+      if (!ok) {
+        fprintf(stderr, "Could not decode %s in %s mode\n", name.c_str(), modeNames[mode]);
+        failures++;
+        continue;
+      }
+      best.file = name;
+      best.mode = modeNames[mode];
+      printCsv(stdout, best);
+
+      auto known = baseline.find(name + "," + best.mode);
+      if (known != baseline.end() && framesPerSecond(best) < known->second * (1.0 - tolerance / 100.0)) {
+        fprintf(stderr, "Regression: %s %s %.1f fps, baseline %.1f fps\n", name.c_str(), best.mode.c_str(),
+                framesPerSecond(best), known->second);
+        regressions++;
+      }
+    }
+  }
+  return (regressions || failures) ? 1 : 0;
+}
@@ -0,0 +1,296 @@
+// Host check of a directory of eye assets before they are synced, on every core.
+//
+// Each GIF is decoded from memory in Turbo mode, as the player decodes it, by a
+// pool of worker threads; every worker owns its GIFIMAGE and buffers, so the
+// files are checked in parallel without any locking in the decoder. A file fails
+// when it does not decode to the end or is cut short, uses a disposal method the GIF spec does
+// not define (4-7) or has a canvas larger than the panel. It gets a warning for
+// "restore to previous" frames (the player needs a canvas copy for them) and for
+// hot spots: frames that take more than --hot times the file's median frame to
+// decode (in thread CPU time), which is where the eye stalls.
+//
+// One line per file, in name order, then a summary; exit 1 if any file failed.
+//
+// Build: make -C tools gifcheck
+
+#include "../libraries/AnimatedGIF/src/AnimatedGIF.h"
+#include "../libraries/AnimatedGIF/src/gif.inl"
+
+#include <dirent.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define DEFAULT_MAX_CANVAS 240  // the panel, DISPLAY_WIDTH x DISPLAY_HEIGHT in wall-e_eye.ino
+#define DEFAULT_HOT 4.0         // a frame this many times slower than the median is a hot spot
+#define HOT_MIN_US 100          // faster frames are never hot, that is timer noise
+#define MAX_HOT_REPORTED 3      // hot frames listed per file
+
+static const char *errorNames[] = { "success", "decode error", "too wide", "invalid parameter",
+                                    "unsupported feature", "file not open", "early EOF", "empty frame",
+                                    "bad file", "out of memory" };
+
+struct Options {
+  int jobs = 0;               // 0 = one per core
+  int maxWidth = DEFAULT_MAX_CANVAS, maxHeight = DEFAULT_MAX_CANVAS;
+  double hot = DEFAULT_HOT;
+  bool quiet = false;         // only files with problems
+};
+
+struct FrameStat {
+  double us;
+  int x, y, w, h;
+};
+
+struct CheckResult {
+  std::string name;
+  int width = 0, height = 0;
+  size_t bytes = 0;
+  std::vector<FrameStat> frames;
+  double totalMs = 0;
+  std::vector<std::string> errors, warnings;
+};
+
+// A worker's decoder, reused for every file it takes
+struct Worker {
+  GIFIMAGE gif;
+  std::vector<uint8_t> frameBuf, turboBuf;
+  int disposal = 0; // of the frame being decoded, from the draw callback
+};
+
+static void checkDraw(GIFDRAW *pDraw)
+{
+  ((Worker *)pDraw->pUser)->disposal = pDraw->ucDisposalMethod;
+}
+
+static bool readFile(const std::string &path, std::vector<uint8_t> &data)
+{
+  FILE *f = fopen(path.c_str(), "rb");
+  if (!f)
+    return false;
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  data.resize(size > 0 ? size : 0);
+  bool ok = size > 0 && fread(data.data(), 1, size, f) == (size_t)size;
+  fclose(f);
+  return ok;
+}
+
+static std::vector<std::string> listGifs(const char *dir)
+{
+  std::vector<std::string> names;
+  DIR *d = opendir(dir);
+  if (!d)
+    return names;
+  while (struct dirent *e = readdir(d)) {
+    std::string name = e->d_name;
+    if (name.size() > 4 && name[0] != '.' &&
+        (name.compare(name.size() - 4, 4, ".gif") == 0 || name.compare(name.size() - 4, 4, ".GIF") == 0))
+      names.push_back(name);
+  }
+  closedir(d);
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+static const char *errorName(int error)
+{
+  return error >= 0 && error < (int)(sizeof(errorNames) / sizeof(errorNames[0])) ? errorNames[error] : "unknown error";
+}
+
+static std::string format(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+static std::string format(const char *fmt, ...)
+{
+  char buf[256];
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  return buf;
+}
+
+// CPU time of the calling thread, so a frame's time doesn't include other workers running on its core
+static double threadMicros()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void checkFile(Worker &worker, const std::string &path, const Options &opt, CheckResult &result)
+{
+  std::vector<uint8_t> data;
+  if (!readFile(path, data)) {
+    result.errors.push_back("could not read the file");
+    return;
+  }
+  result.bytes = data.size();
+  GIFIMAGE *gif = &worker.gif;
+  GIF_begin(gif, GIF_PALETTE_RGB565_BE);
+  if (!GIF_openRAM(gif, data.data(), (int)data.size(), checkDraw)) {
+    result.errors.push_back(format("does not open: %s", errorName(GIF_getLastError(gif))));
+    return;
+  }
+  result.width = GIF_getCanvasWidth(gif);
+  result.height = GIF_getCanvasHeight(gif);
+  if (result.width > opt.maxWidth || result.height > opt.maxHeight)
+    result.errors.push_back(format("canvas %dx%d is larger than the panel (%dx%d)", result.width, result.height,
+                                   opt.maxWidth, opt.maxHeight));
+  int pixels = result.width * result.height;
+  worker.frameBuf.assign(pixels + 2 * MAX_WIDTH, 0); // canvas plus one cooked line, as on the device
+  worker.turboBuf.assign(TURBO_BUFFER_SIZE + pixels, 0);
+  gif->pFrameBuffer = worker.frameBuf.data();
+  gif->ucDrawType = GIF_DRAW_COOKED;
+  gif->pTurboBuffer = worker.turboBuf.data();
+
+  int restoring = 0;
+  int rc = 1;
+  while (rc > 0) {
+    worker.disposal = 0;
+    double start = threadMicros();
+    rc = GIF_playFrame(gif, NULL, &worker);
+    double us = threadMicros() - start;
+    if (gif->iError != GIF_SUCCESS) {
+      result.errors.push_back(format("frame %zu: %s", result.frames.size(), errorName(gif->iError)));
+      break;
+    }
+    int frame = (int)result.frames.size();
+    result.frames.push_back({ us, gif->iX, gif->iY, gif->iWidth, gif->iHeight });
+    result.totalMs += us / 1000;
+    if (worker.disposal > 3)
+      result.errors.push_back(format("frame %d: undefined disposal method %d", frame, worker.disposal));
+    else if (worker.disposal == 3)
+      restoring++;
+  }
+  GIF_close(gif);
+  if (!result.frames.empty() && data.back() != 0x3B) // the decoder takes the end of the data for the end of the animation
+    result.errors.push_back(format("truncated, no trailer after frame %zu", result.frames.size() - 1));
+  if (result.frames.empty() && result.errors.empty())
+    result.errors.push_back("no frames");
+  if (restoring)
+    result.warnings.push_back(format("%d frames restore to previous, the player needs a canvas copy", restoring));
+
+  // Hot spots against the median frame, the first one aside: it always decodes the whole canvas
+  if (result.frames.size() > 2) {
+    std::vector<double> times;
+    for (size_t i = 1; i < result.frames.size(); i++)
+      times.push_back(result.frames[i].us);
+    std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+    double median = times[times.size() / 2];
+    std::vector<int> hot;
+    for (size_t i = 1; i < result.frames.size(); i++)
+      if (result.frames[i].us > median * opt.hot && result.frames[i].us > HOT_MIN_US)
+        hot.push_back((int)i);
+    std::sort(hot.begin(), hot.end(), [&](int a, int b) { return result.frames[a].us > result.frames[b].us; });
+    for (size_t i = 0; i < hot.size() && i < MAX_HOT_REPORTED; i++) {
+      const FrameStat &f = result.frames[hot[i]];
+      result.warnings.push_back(format("hot frame %d: %.0f us, %.1fx the median, %dx%d at %d,%d", hot[i], f.us,
+                                       f.us / median, f.w, f.h, f.x, f.y));
+    }
+    if (hot.size() > MAX_HOT_REPORTED)
+      result.warnings.push_back(format("%zu more hot frames", hot.size() - MAX_HOT_REPORTED));
+  }
+}
+
+static void usage()
+{
+  fprintf(stderr,
+          "usage: gifcheck [options] directory...\n"
+          "  --jobs N          worker threads (default: one per core)\n"
+          "  --max-canvas WxH  largest canvas allowed (default %dx%d)\n"
+          "  --hot X           flag frames X times slower than the median (default %.0f)\n"
+          "  -q                only print files with errors or warnings\n",
+          DEFAULT_MAX_CANVAS, DEFAULT_MAX_CANVAS, DEFAULT_HOT);
+}
+
+int main(int argc, char **argv)
+{
+  Options opt;
+  std::vector<const char *> dirs;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--jobs" && i + 1 < argc) {
+      opt.jobs = atoi(argv[++i]);
+    } else if (arg == "--max-canvas" && i + 1 < argc) {
+      if (sscanf(argv[++i], "%dx%d", &opt.maxWidth, &opt.maxHeight) != 2) {
+        usage();
+        return 2;
+      }
+    } else if (arg == "--hot" && i + 1 < argc) {
+      opt.hot = atof(argv[++i]);
+    } else if (arg == "-q") {
+      opt.quiet = true;
+    } else if (arg[0] != '-') {
+      dirs.push_back(argv[i]);
+    } else {
+      usage();
+      return 2;
+    }
+  }
+  if (dirs.empty() || opt.jobs < 0 || opt.hot <= 1) {
+    usage();
+    return 2;
+  }
+
+  std::vector<std::string> paths;
+  std::vector<CheckResult> results;
+  for (const char *dir : dirs) {
+    for (const std::string &name : listGifs(dir)) {
+      paths.push_back(std::string(dir) + "/" + name);
+      results.emplace_back();
+      results.back().name = paths.back();
+    }
+  }
+  if (paths.empty()) {
+    fprintf(stderr, "No GIFs found\n");
+    return 1;
+  }
+
+  // Workers take the next file until none are left; results go to the file's slot
+  int jobs = opt.jobs ? opt.jobs : std::max(1u, std::thread::hardware_concurrency());
+  jobs = std::min<int>(jobs, (int)paths.size());
+  std::atomic<size_t> next(0);
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> pool;
+  for (int j = 0; j < jobs; j++) {
+    pool.emplace_back([&]() {
+      Worker *worker = new Worker; // GIFIMAGE is too large for a thread's stack
+      for (size_t i; (i = next++) < paths.size();)
+        checkFile(*worker, paths[i], opt, results[i]);
+      delete worker;
+    });
+  }
+  for (std::thread &t : pool)
+    t.join();
+  double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  int failed = 0, warned = 0;
+  double decodeMs = 0;
+  for (const CheckResult &r : results) {
+    decodeMs += r.totalMs;
+    failed += !r.errors.empty();
+    warned += r.errors.empty() && !r.warnings.empty();
+    if (opt.quiet && r.errors.empty() && r.warnings.empty())
+      continue;
+    printf("%-4s %s: %dx%d, %zu bytes, %zu frames, %.1f ms\n",
+           !r.errors.empty() ? "FAIL" : !r.warnings.empty() ? "WARN" : "OK", r.name.c_str(), r.width, r.height,
+           r.bytes, r.frames.size(), r.totalMs);
+    for (const std::string &e : r.errors)
+      printf("       error: %s\n", e.c_str());
+    for (const std::string &w : r.warnings)
+      printf("       warning: %s\n", w.c_str());
+  }
+  printf("%zu files, %d failed, %d with warnings; %.0f ms of decoding in %.0f ms on %d threads\n", results.size(),
+         failed, warned, decodeMs, wallMs, jobs);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,759 @@
+// Host-side GIF pre-optimizer for the Wall-E eyes.
+//
+// Decodes a GIF with the firmware's AnimatedGIF sources and writes a copy
+// shaped for the decoder fast paths on the device: a square canvas of the
+// display size, one global palette, no transparency, frames cropped to the
+// rectangle that changed and disposal "leave in place", so no frame forces a
+// full-canvas redraw. Input and output are both timed with the real decoder
+// in the mode the firmware uses (COOKED + Turbo + delta, RGB565 big-endian).
+//
+// Build: make -C tools gifopt
+
+#include "../libraries/AnimatedGIF/src/AnimatedGIF.h"
+#include "../libraries/AnimatedGIF/src/gif.inl"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define DEFAULT_SIZE 240          // GC9A01 panel
+#define DEFAULT_DEVICE_FACTOR 20  // rough host/ESP32-S3 decode time ratio, calibrate with --device-factor
+#define DEFAULT_RUNS 5            // timing passes, the fastest one is reported
+
+struct Options {
+  int size = DEFAULT_SIZE;
+  double deviceFactor = DEFAULT_DEVICE_FACTOR;
+  int runs = DEFAULT_RUNS;
+  int fuzz = 0;             // max channel difference still treated as unchanged between frames
+  int colors = 255;         // palette entries besides the transparent one
+  bool analyzeOnly = false;
+  bool verbose = false;
+  const char *input = NULL;
+  const char *output = NULL;
+};
+
+// One composed frame as the viewer sees it
+struct Frame {
+  std::vector<uint8_t> rgb; // canvas RGB888
+  int delayMs;
+  int x, y, w, h;           // rectangle of the source frame
+  bool transparent;
+  bool localPalette;
+  int disposal;
+};
+
+struct SourceGif {
+  int width = 0, height = 0;
+  int loopCount = 0;
+  std::vector<Frame> frames;
+};
+
+// Per-frame timing with the device decode mode
+struct FrameCost {
+  int x, y, w, h;
+  int delayMs;
+  double hostUs;
+};
+
+static bool readFile(const char *path, std::vector<uint8_t> &data)
+{
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return false;
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  data.resize(size > 0 ? size : 0);
+  bool ok = size > 0 && fread(data.data(), 1, size, f) == (size_t)size;
+  fclose(f);
+  return ok;
+}
+
+struct DecodeState {
+  SourceGif *gif;
+  std::vector<uint8_t> canvas; // RGB888, carries over from frame to frame like the display
+  bool transparent;
+  int disposal;
+};
+
+static void captureDraw(GIFDRAW *pDraw)
+{
+  DecodeState *state = (DecodeState *)pDraw->pUser;
+  int canvasW = state->gif->width;
+  int y = pDraw->iY + pDraw->y;
+  int w = std::min(pDraw->iWidth, canvasW - pDraw->iX);
+  if (y >= state->gif->height || w <= 0)
+    return;
+  memcpy(&state->canvas[(y * canvasW + pDraw->iX) * 3], pDraw->pPixels, w * 3);
+  if (pDraw->ucHasTransparency)
+    state->transparent = true;
+  state->disposal = pDraw->ucDisposalMethod;
+}
+
+// Decode every frame into a full RGB canvas, the way the firmware's cooked path composes them
+static bool decodeSource(std::vector<uint8_t> &data, SourceGif &out)
+{
+  GIFIMAGE gif;
+  GIF_begin(&gif, GIF_PALETTE_RGB888);
+  if (!GIF_openRAM(&gif, data.data(), (int)data.size(), captureDraw))
+    return false;
+  out.width = GIF_getCanvasWidth(&gif);
+  out.height = GIF_getCanvasHeight(&gif);
+  std::vector<uint8_t> frameBuf(out.width * out.height + 4 * MAX_WIDTH, 0);
+  gif.pFrameBuffer = frameBuf.data();
+  gif.ucDrawType = GIF_DRAW_COOKED;
+
+  DecodeState state;
+  state.gif = &out;
+  state.canvas.assign(out.width * out.height * 3, 0);
+  int rc = 1;
+  while (rc > 0) {
+    int delayMs = 0;
+    state.transparent = false;
+    state.disposal = 0;
+    rc = GIF_playFrame(&gif, &delayMs, &state);
+    if (gif.iError != GIF_SUCCESS)
+      break;
+    Frame f;
+    f.rgb = state.canvas;
+    f.delayMs = delayMs;
+    f.x = gif.iX;
+    f.y = gif.iY;
+    f.w = gif.iWidth;
+    f.h = gif.iHeight;
+    f.transparent = state.transparent;
+    f.localPalette = gif.bUseLocalPalette;
+    f.disposal = state.disposal;
+    out.frames.push_back(f);
+  }
+  out.loopCount = GIF_getLoopCount(&gif);
+  GIF_close(&gif);
+  return !out.frames.empty();
+}
+
+static void noDraw(GIFDRAW *pDraw)
+{
+  (void)pDraw;
+}
+
+// Time each frame with the decode setup of gifPlay() on the device
+static std::vector<FrameCost> measureDecode(std::vector<uint8_t> &data, int runs)
+{
+  std::vector<FrameCost> best;
+  for (int run = 0; run < runs; run++) {
+    GIFIMAGE gif;
+    GIF_begin(&gif, GIF_PALETTE_RGB565_BE);
+    if (!GIF_openRAM(&gif, data.data(), (int)data.size(), noDraw))
+      return best;
+    int pixels = GIF_getCanvasWidth(&gif) * GIF_getCanvasHeight(&gif);
+    std::vector<uint8_t> turboBuf(TURBO_BUFFER_SIZE + pixels);
+    std::vector<uint8_t> frameBuf(pixels + 2 * MAX_WIDTH, 0);
+    gif.pTurboBuffer = turboBuf.data();
+    gif.pFrameBuffer = frameBuf.data();
+    gif.ucDrawType = GIF_DRAW_COOKED;
+    gif.ucDeltaMode = 1;
+
+    size_t frame = 0;
+    int rc = 1;
+    while (rc > 0) {
+      int delayMs = 0;
+      auto start = std::chrono::steady_clock::now();
+      rc = GIF_playFrame(&gif, &delayMs, NULL);
+      auto end = std::chrono::steady_clock::now();
+      if (gif.iError != GIF_SUCCESS)
+        break;
+      double us = std::chrono::duration<double, std::micro>(end - start).count();
+      if (frame == best.size()) {
+        FrameCost c = { gif.iX, gif.iY, gif.iWidth, gif.iHeight, delayMs, us };
+        best.push_back(c);
+      } else {
+        best[frame].hostUs = std::min(best[frame].hostUs, us);
+      }
+      frame++;
+    }
+    GIF_close(&gif);
+  }
+  return best;
+}
+
+// Scale to cover size x size and crop the center, like optimize_gif.py; box filter when shrinking
+static std::vector<uint8_t> scaleCover(const std::vector<uint8_t> &src, int sw, int sh, int size)
+{
+  if (sw == size && sh == size)
+    return src;
+  double scale = std::max((double)size / sw, (double)size / sh);
+  double cropX = (sw * scale - size) / 2;
+  double cropY = (sh * scale - size) / 2;
+  std::vector<uint8_t> dst(size * size * 3);
+  for (int y = 0; y < size; y++) {
+    int y0 = (int)((y + cropY) / scale);
+    int y1 = std::max(y0 + 1, (int)((y + 1 + cropY) / scale));
+    y1 = std::min(y1, sh);
+    for (int x = 0; x < size; x++) {
+      int x0 = (int)((x + cropX) / scale);
+      int x1 = std::max(x0 + 1, (int)((x + 1 + cropX) / scale));
+      x1 = std::min(x1, sw);
+      unsigned sum[3] = { 0, 0, 0 }, count = 0;
+      for (int sy = y0; sy < y1; sy++) {
+        for (int sx = x0; sx < x1; sx++) {
+          const uint8_t *p = &src[(sy * sw + sx) * 3];
+          sum[0] += p[0];
+          sum[1] += p[1];
+          sum[2] += p[2];
+          count++;
+        }
+      }
+      uint8_t *d = &dst[(y * size + x) * 3];
+      for (int c = 0; c < 3; c++)
+        d[c] = count ? (uint8_t)((sum[c] + count / 2) / count) : 0;
+    }
+  }
+  return dst;
+}
+
+static inline uint16_t toRgb565(const uint8_t *p)
+{
+  return ((p[0] >> 3) << 11) | ((p[1] >> 2) << 5) | (p[2] >> 3);
+}
+
+static inline void fromRgb565(uint16_t c, uint8_t *p)
+{
+  p[0] = ((c >> 11) << 3) | (c >> 13);
+  p[1] = (((c >> 5) & 0x3f) << 2) | ((c >> 9) & 3);
+  p[2] = ((c & 0x1f) << 3) | ((c >> 2) & 7);
+}
+
+struct ColorBox {
+  std::vector<uint16_t> colors;
+};
+
+// Median cut over the RGB565 histogram; the panel can't show more than RGB565 anyway
+static std::vector<uint16_t> buildPalette(const std::vector<uint32_t> &histogram, size_t maxColors)
+{
+  std::vector<uint16_t> used;
+  for (int c = 0; c < 65536; c++) {
+    if (histogram[c])
+      used.push_back((uint16_t)c);
+  }
+  if (used.size() <= maxColors)
+    return used;
+
+  std::vector<ColorBox> boxes(1);
+  boxes[0].colors = used;
+  while (boxes.size() < maxColors) {
+    // split the box with the widest channel range, weighted by its pixel count
+    int bestBox = -1, bestChannel = 0;
+    double bestScore = 0;
+    for (size_t b = 0; b < boxes.size(); b++) {
+      if (boxes[b].colors.size() < 2)
+        continue;
+      int lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 };
+      uint64_t pixels = 0;
+      for (uint16_t c : boxes[b].colors) {
+        uint8_t p[3];
+        fromRgb565(c, p);
+        for (int ch = 0; ch < 3; ch++) {
+          lo[ch] = std::min(lo[ch], (int)p[ch]);
+          hi[ch] = std::max(hi[ch], (int)p[ch]);
+        }
+        pixels += histogram[c];
+      }
+      for (int ch = 0; ch < 3; ch++) {
+        double score = (double)(hi[ch] - lo[ch]) * std::sqrt((double)pixels);
+        if (score > bestScore) {
+          bestScore = score;
+          bestBox = (int)b;
+          bestChannel = ch;
+        }
+      }
+    }
+    if (bestBox < 0)
+      break;
+    std::vector<uint16_t> &colors = boxes[bestBox].colors;
+    std::sort(colors.begin(), colors.end(), [bestChannel](uint16_t a, uint16_t b) {
+      uint8_t pa[3], pb[3];
+      fromRgb565(a, pa);
+      fromRgb565(b, pb);
+      return pa[bestChannel] < pb[bestChannel];
+    });
+    uint64_t total = 0, half = 0;
+    for (uint16_t c : colors)
+      total += histogram[c];
+    size_t split = 0;
+    while (split < colors.size() - 1 && (half += histogram[colors[split]]) < total / 2)
+      split++;
+    split = std::max<size_t>(1, std::min(split + 1, colors.size() - 1));
+    ColorBox upper;
+    upper.colors.assign(colors.begin() + split, colors.end());
+    colors.resize(split);
+    boxes.push_back(upper);
+  }
+
+  std::vector<uint16_t> palette;
+  for (const ColorBox &box : boxes) {
+    double sum[3] = { 0, 0, 0 }, weight = 0;
+    for (uint16_t c : box.colors) {
+      uint8_t p[3];
+      fromRgb565(c, p);
+      for (int ch = 0; ch < 3; ch++)
+        sum[ch] += (double)p[ch] * histogram[c];
+      weight += histogram[c];
+    }
+    uint8_t avg[3];
+    for (int ch = 0; ch < 3; ch++)
+      avg[ch] = (uint8_t)std::lround(sum[ch] / weight);
+    palette.push_back(toRgb565(avg));
+  }
+  std::sort(palette.begin(), palette.end());
+  palette.erase(std::unique(palette.begin(), palette.end()), palette.end());
+  return palette;
+}
+
+// RGB565 -> palette index for every color that occurs
+static std::vector<uint8_t> buildColorMap(const std::vector<uint32_t> &histogram, const std::vector<uint16_t> &palette)
+{
+  std::vector<uint8_t> map(65536, 0);
+  for (int c = 0; c < 65536; c++) {
+    if (!histogram[c])
+      continue;
+    uint8_t p[3];
+    fromRgb565(c, p);
+    int best = 0, bestDist = 1 << 30;
+    for (size_t i = 0; i < palette.size(); i++) {
+      uint8_t q[3];
+      fromRgb565(palette[i], q);
+      int dr = p[0] - q[0], dg = p[1] - q[1], db = p[2] - q[2];
+      int dist = 2 * dr * dr + 4 * dg * dg + 3 * db * db;
+      if (dist < bestDist) {
+        bestDist = dist;
+        best = (int)i;
+      }
+    }
+    map[c] = (uint8_t)best;
+  }
+  return map;
+}
+
+// Let pixels that barely changed keep their previous color, so they drop out of the frame rectangles
+static void applyFuzz(std::vector<std::vector<uint8_t>> &indexed, const std::vector<uint16_t> &palette, int fuzz)
+{
+  std::vector<uint8_t> close(256 * 256, 0);
+  for (size_t a = 0; a < palette.size(); a++) {
+    for (size_t b = 0; b < palette.size(); b++) {
+      uint8_t pa[3], pb[3];
+      fromRgb565(palette[a], pa);
+      fromRgb565(palette[b], pb);
+      close[a * 256 + b] = abs(pa[0] - pb[0]) <= fuzz && abs(pa[1] - pb[1]) <= fuzz && abs(pa[2] - pb[2]) <= fuzz;
+    }
+  }
+  for (size_t i = 1; i < indexed.size(); i++) {
+    for (size_t p = 0; p < indexed[i].size(); p++) {
+      if (close[indexed[i][p] * 256 + indexed[i - 1][p]])
+        indexed[i][p] = indexed[i - 1][p];
+    }
+  }
+}
+
+// GIF LZW encoder with a hashed string table, resets once all 4096 codes are in use
+class LzwWriter {
+public:
+  LzwWriter(std::vector<uint8_t> &out, int minCodeSize) : out(out), minCodeSize(minCodeSize) {}
+
+  void encode(const uint8_t *pixels, size_t count)
+  {
+    out.push_back((uint8_t)minCodeSize);
+    clearCode = 1 << minCodeSize;
+    resetTable();
+    putCode(clearCode);
+    int prefix = -1;
+    for (size_t i = 0; i < count; i++) {
+      int c = pixels[i];
+      if (prefix < 0) {
+        prefix = c;
+        continue;
+      }
+      int key = (prefix << 8) | c;
+      int slot = findSlot(key);
+      if (hashKey[slot] == key) {
+        prefix = hashCode[slot];
+        continue;
+      }
+      putCode(prefix);
+      if (nextCode < 4096) {
+        hashKey[slot] = key;
+        hashCode[slot] = nextCode++;
+        if (nextCode > (1 << codeSize) && codeSize < 12)
+          codeSize++;
+      } else {
+        putCode(clearCode);
+        resetTable();
+      }
+      prefix = c;
+    }
+    if (prefix >= 0)
+      putCode(prefix);
+    putCode(clearCode + 1); // end of information
+    if (bitCount)
+      putByte(bitBuffer & 0xff);
+    flushBlock();
+    out.push_back(0); // block terminator
+  }
+
+private:
+  static const int HASH_SIZE = 5003;
+
+  void resetTable()
+  {
+    std::fill(hashKey, hashKey + HASH_SIZE, -1);
+    codeSize = minCodeSize + 1;
+    nextCode = clearCode + 2;
+  }
+
+  int findSlot(int key)
+  {
+    int slot = (key * 31) % HASH_SIZE;
+    while (hashKey[slot] != -1 && hashKey[slot] != key)
+      slot = (slot + 1) % HASH_SIZE;
+    return slot;
+  }
+
+  void putCode(int code)
+  {
+    bitBuffer |= (uint32_t)code << bitCount;
+    bitCount += codeSize;
+    while (bitCount >= 8) {
+      putByte(bitBuffer & 0xff);
+      bitBuffer >>= 8;
+      bitCount -= 8;
+    }
+  }
+
+  void putByte(uint8_t b)
+  {
+    block[blockLen++] = b;
+    if (blockLen == 255)
+      flushBlock();
+  }
+
+  void flushBlock()
+  {
+    if (!blockLen)
+      return;
+    out.push_back((uint8_t)blockLen);
+    out.insert(out.end(), block, block + blockLen);
+    blockLen = 0;
+  }
+
+  std::vector<uint8_t> &out;
+  int minCodeSize, clearCode = 0, codeSize = 0, nextCode = 0;
+  int hashKey[HASH_SIZE], hashCode[HASH_SIZE];
+  uint32_t bitBuffer = 0;
+  int bitCount = 0;
+  uint8_t block[255];
+  int blockLen = 0;
+};
+
+static void put16(std::vector<uint8_t> &out, int v)
+{
+  out.push_back(v & 0xff);
+  out.push_back((v >> 8) & 0xff);
+}
+
+struct OutputStats {
+  int frames = 0;
+  int merged = 0;      // frames without changes, their delay went to the previous frame
+  int transparent = 0; // frames where marking unchanged pixels transparent encoded smaller
+  long pixels = 0;     // pixels in all frame rectangles
+  std::vector<size_t> emitted; // source frame of every frame written
+};
+
+// Write the indexed canvases as frames that only cover what changed since the previous one
+static std::vector<uint8_t> encodeGif(const std::vector<std::vector<uint8_t>> &indexed, const std::vector<int> &delays,
+                                      const std::vector<uint16_t> &palette, int size, int loopCount, OutputStats &stats)
+{
+  int transparentIndex = (int)palette.size(); // one past the colors, see buildPalette()
+  int bits = 1;
+  while ((1 << bits) < transparentIndex + 1)
+    bits++;
+  std::vector<uint8_t> out = { 'G', 'I', 'F', '8', '9', 'a' };
+  put16(out, size);
+  put16(out, size);
+  out.push_back(0x80 | 0x70 | (bits - 1)); // global color table, 8 bit color resolution
+  out.push_back(0); // background
+  out.push_back(0); // aspect ratio
+  for (int i = 0; i < (1 << bits); i++) {
+    uint8_t p[3] = { 0, 0, 0 };
+    if (i < (int)palette.size())
+      fromRgb565(palette[i], p);
+    out.insert(out.end(), p, p + 3);
+  }
+  if (indexed.size() > 1) { // NETSCAPE2.0 loop extension
+    const char *app = "NETSCAPE2.0";
+    out.push_back(0x21);
+    out.push_back(0xff);
+    out.push_back(11);
+    out.insert(out.end(), app, app + 11);
+    out.push_back(3);
+    out.push_back(1);
+    put16(out, loopCount);
+    out.push_back(0);
+  }
+
+  // find the changed rectangles first, so unchanged frames can hand their delay to the previous one
+  struct Rect { int x, y, w, h; int delayMs; size_t frame; };
+  std::vector<Rect> rects;
+  for (size_t i = 0; i < indexed.size(); i++) {
+    Rect r = { 0, 0, size, size, delays[i], i };
+    if (i > 0) {
+      const std::vector<uint8_t> &a = indexed[i - 1], &b = indexed[i];
+      int left = size, right = -1, top = size, bottom = -1;
+      for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+          if (a[y * size + x] != b[y * size + x]) {
+            left = std::min(left, x);
+            right = std::max(right, x);
+            top = std::min(top, y);
+            bottom = std::max(bottom, y);
+          }
+        }
+      }
+      if (right < 0) {
+        rects.back().delayMs += delays[i];
+        stats.merged++;
+        continue;
+      }
+      r.x = left;
+      r.y = top;
+      r.w = right - left + 1;
+      r.h = bottom - top + 1;
+    }
+    rects.push_back(r);
+  }
+
+  int minCodeSize = std::max(2, bits);
+  std::vector<uint8_t> pixels, opaque, keyed;
+  for (size_t k = 0; k < rects.size(); k++) {
+    const Rect &r = rects[k];
+    const std::vector<uint8_t> &src = indexed[r.frame];
+    pixels.resize(r.w * r.h);
+    for (int y = 0; y < r.h; y++)
+      memcpy(&pixels[y * r.w], &src[(r.y + y) * size + r.x], r.w);
+    opaque.clear();
+    LzwWriter(opaque, minCodeSize).encode(pixels.data(), pixels.size());
+
+    // Unchanged pixels inside the rectangle may compress better as transparent runs;
+    // only use transparency when it actually wins
+    bool useTransparency = false;
+    if (k > 0) {
+      const std::vector<uint8_t> &prev = indexed[rects[k - 1].frame];
+      for (int y = 0; y < r.h; y++) {
+        for (int x = 0; x < r.w; x++) {
+          int p = (r.y + y) * size + r.x + x;
+          if (prev[p] == src[p])
+            pixels[y * r.w + x] = (uint8_t)transparentIndex;
+        }
+      }
+      keyed.clear();
+      LzwWriter(keyed, minCodeSize).encode(pixels.data(), pixels.size());
+      useTransparency = keyed.size() < opaque.size();
+    }
+
+    int delayCs = (r.delayMs + 5) / 10;
+    out.push_back(0x21); // graphic control extension
+    out.push_back(0xf9);
+    out.push_back(4);
+    out.push_back((1 << 2) | (useTransparency ? 1 : 0)); // disposal 1: leave in place
+    put16(out, delayCs);
+    out.push_back(useTransparency ? (uint8_t)transparentIndex : 0);
+    out.push_back(0);
+
+    out.push_back(0x2c); // image descriptor
+    put16(out, r.x);
+    put16(out, r.y);
+    put16(out, r.w);
+    put16(out, r.h);
+    out.push_back(0); // no local palette, not interlaced
+    const std::vector<uint8_t> &data = useTransparency ? keyed : opaque;
+    out.insert(out.end(), data.begin(), data.end());
+    stats.frames++;
+    stats.transparent += useTransparency;
+    stats.pixels += (long)r.w * r.h;
+    stats.emitted.push_back(r.frame);
+  }
+  out.push_back(0x3b);
+  return out;
+}
+
+// Decode the written GIF again and compare every frame with what was meant to be shown
+static bool verifyOutput(std::vector<uint8_t> &encoded, const std::vector<std::vector<uint8_t>> &indexed,
+                         const std::vector<uint16_t> &palette, const std::vector<size_t> &emitted, int size)
+{
+  SourceGif check;
+  if (!decodeSource(encoded, check) || check.frames.size() != emitted.size())
+    return false;
+  for (size_t k = 0; k < emitted.size(); k++) {
+    const std::vector<uint8_t> &expected = indexed[emitted[k]];
+    const std::vector<uint8_t> &rgb = check.frames[k].rgb;
+    for (int p = 0; p < size * size; p++) {
+      if (toRgb565(&rgb[p * 3]) != palette[expected[p]])
+        return false;
+    }
+  }
+  return true;
+}
+
+static void printCostReport(const char *label, const std::vector<FrameCost> &costs, const Options &opt)
+{
+  double totalUs = 0, maxUs = 0;
+  int late = 0;
+  for (size_t i = 0; i < costs.size(); i++) {
+    const FrameCost &c = costs[i];
+    double deviceMs = c.hostUs * opt.deviceFactor / 1000.0;
+    totalUs += c.hostUs;
+    maxUs = std::max(maxUs, c.hostUs);
+    bool isLate = c.delayMs > 0 && deviceMs > c.delayMs; // a delay of 0 marks a still image
+    if (isLate)
+      late++;
+    if (opt.verbose) {
+      printf("  %s frame %3zu: %3dx%-3d at %3d,%-3d delay %4d ms, host %8.1f us, device ~%6.2f ms%s\n",
+             label, i, c.w, c.h, c.x, c.y, c.delayMs, c.hostUs, deviceMs, isLate ? "  LATE" : "");
+    }
+  }
+  if (costs.empty())
+    return;
+  double avgUs = totalUs / costs.size();
+  printf("%s: %zu frames, host %.1f us/frame (max %.1f), expected device decode %.2f ms/frame (max %.2f), %d frame%s slower than its delay\n",
+         label, costs.size(), avgUs, maxUs, avgUs * opt.deviceFactor / 1000.0, maxUs * opt.deviceFactor / 1000.0,
+         late, late == 1 ? "" : "s");
+}
+
+static void usage()
+{
+  fprintf(stderr,
+          "usage: gifopt [options] input.gif [output.gif]\n"
+          "  --size N           output canvas N x N (default %d)\n"
+          "  --device-factor F  device/host decode time ratio for the estimate (default %d)\n"
+          "  --fuzz N           keep the previous pixel when no channel changed by more than N (default 0)\n"
+          "  --colors N         at most N colors, 15 or fewer take the 16 color decoder (default 255)\n"
+          "  --runs N           timing passes (default %d)\n"
+          "  -n, --analyze      only report the decode cost of the input\n"
+          "  -v, --verbose      report every frame\n",
+          DEFAULT_SIZE, DEFAULT_DEVICE_FACTOR, DEFAULT_RUNS);
+}
+
+static bool parseOptions(int argc, char **argv, Options &opt)
+{
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--size" && i + 1 < argc) {
+      opt.size = atoi(argv[++i]);
+    } else if (arg == "--device-factor" && i + 1 < argc) {
+      opt.deviceFactor = atof(argv[++i]);
+    } else if (arg == "--fuzz" && i + 1 < argc) {
+      opt.fuzz = atoi(argv[++i]);
+    } else if (arg == "--colors" && i + 1 < argc) {
+      opt.colors = atoi(argv[++i]);
+    } else if (arg == "--runs" && i + 1 < argc) {
+      opt.runs = atoi(argv[++i]);
+    } else if (arg == "-n" || arg == "--analyze") {
+      opt.analyzeOnly = true;
+    } else if (arg == "-v" || arg == "--verbose") {
+      opt.verbose = true;
+    } else if (arg[0] == '-') {
+      return false;
+    } else if (!opt.input) {
+      opt.input = argv[i];
+    } else if (!opt.output) {
+      opt.output = argv[i];
+    } else {
+      return false;
+    }
+  }
+  if (opt.size <= 0 || opt.size > MAX_WIDTH || opt.runs <= 0 || opt.deviceFactor <= 0 || opt.fuzz < 0 ||
+      opt.colors < 1 || opt.colors > 255)
+    return false;
+  return opt.input && (opt.analyzeOnly || opt.output);
+}
+
+int main(int argc, char **argv)
+{
+  Options opt;
+  if (!parseOptions(argc, argv, opt)) {
+    usage();
+    return 2;
+  }
+
+  std::vector<uint8_t> data;
+  if (!readFile(opt.input, data)) {
+    fprintf(stderr, "Could not read %s\n", opt.input);
+    return 1;
+  }
+  SourceGif source;
+  if (!decodeSource(data, source)) {
+    fprintf(stderr, "Could not decode %s\n", opt.input);
+    return 1;
+  }
+
+  int transparent = 0, local = 0, fullCanvas = 0, restore = 0;
+  for (const Frame &f : source.frames) {
+    transparent += f.transparent;
+    local += f.localPalette;
+    fullCanvas += (f.w == source.width && f.h == source.height);
+    restore += (f.disposal >= 2);
+  }
+  printf("%s: %dx%d, %zu bytes, %zu frames (%d transparent, %d local palette, %d full canvas, %d restoring disposal)\n",
+         opt.input, source.width, source.height, data.size(), source.frames.size(), transparent, local, fullCanvas, restore);
+  printCostReport("input", measureDecode(data, opt.runs), opt);
+  if (opt.analyzeOnly)
+    return 0;
+
+  std::vector<std::vector<uint8_t>> scaled;
+  std::vector<int> delays;
+  std::vector<uint32_t> histogram(65536, 0);
+  for (const Frame &f : source.frames) {
+    scaled.push_back(scaleCover(f.rgb, source.width, source.height, opt.size));
+    delays.push_back(f.delayMs);
+    const std::vector<uint8_t> &rgb = scaled.back();
+    for (size_t p = 0; p < rgb.size(); p += 3)
+      histogram[toRgb565(&rgb[p])]++;
+  }
+  std::vector<uint16_t> palette = buildPalette(histogram, opt.colors); // one more index is kept for transparency
+  std::vector<uint8_t> colorMap = buildColorMap(histogram, palette);
+
+  std::vector<std::vector<uint8_t>> indexed;
+  for (const std::vector<uint8_t> &rgb : scaled) {
+    std::vector<uint8_t> idx(opt.size * opt.size);
+    for (size_t p = 0; p < idx.size(); p++)
+      idx[p] = colorMap[toRgb565(&rgb[p * 3])];
+    indexed.push_back(idx);
+  }
+  if (opt.fuzz > 0)
+    applyFuzz(indexed, palette, opt.fuzz);
+
+  OutputStats stats;
+  std::vector<uint8_t> encoded = encodeGif(indexed, delays, palette, opt.size, source.loopCount, stats);
+  FILE *f = fopen(opt.output, "wb");
+  if (!f || fwrite(encoded.data(), 1, encoded.size(), f) != encoded.size()) {
+    fprintf(stderr, "Could not write %s\n", opt.output);
+    if (f)
+      fclose(f);
+    return 1;
+  }
+  fclose(f);
+
+  long canvasPixels = (long)opt.size * opt.size;
+  printf("%s: %dx%d, %zu bytes, %d frames (%d unchanged merged, %d transparent), %zu colors, %.0f%% of the canvas redrawn per frame\n",
+         opt.output, opt.size, opt.size, encoded.size(), stats.frames, stats.merged, stats.transparent, palette.size(),
+         100.0 * stats.pixels / (stats.frames * canvasPixels));
+  if (!verifyOutput(encoded, indexed, palette, stats.emitted, opt.size)) {
+    fprintf(stderr, "%s does not decode to the expected frames\n", opt.output);
+    return 1;
+  }
+  printCostReport("output", measureDecode(encoded, opt.runs), opt);
+  return 0;
+}
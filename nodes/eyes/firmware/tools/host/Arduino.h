@@ -0,0 +1,73 @@
+// Host stand-in for the parts of the Arduino core TFT_eSPI uses; pins, delays and the
+// clock are emulated in panel.cpp
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <algorithm>
+#include <string>
+
+#include "Print.h"
+
+#define PROGMEM
+// Flash is plain memory on the host. TFT_eSPI reads the pointers in its font tables with
+// pgm_read_dword(), so that one reads a whole pointer here
+inline uint8_t pgm_read_byte(const void *addr) { return *(const uint8_t *)addr; }
+inline uint16_t pgm_read_word(const void *addr) { uint16_t v; memcpy(&v, addr, sizeof(v)); return v; }
+inline uintptr_t pgm_read_dword(const void *addr) { uintptr_t v; memcpy(&v, addr, sizeof(v)); return v; }
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+using std::min;
+using std::max;
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+int digitalRead(int pin);
+#define digitalPinToBitMask(pin) (1UL << ((pin) & 31))
+
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+unsigned long millis();
+unsigned long micros();
+inline void yield() {}
+inline long random(long howbig) { return howbig > 0 ? rand() % howbig : 0; }
+inline char *ltoa(long value, char *str, int radix)
+{
+  (void)radix; // TFT_eSPI only asks for base 10
+  sprintf(str, "%ld", value);
+  return str;
+}
+
+// Just what TFT_eSPI's String overloads need
+class String {
+public:
+  String(const char *s = "") : s_(s ? s : "") {}
+  unsigned int length() const { return s_.size(); }
+  const char *c_str() const { return s_.c_str(); }
+  void toCharArray(char *buf, unsigned int size) const
+  {
+    if (!size)
+      return;
+    size_t n = std::min<size_t>(size - 1, s_.size());
+    memcpy(buf, s_.data(), n);
+    buf[n] = 0;
+  }
+  bool operator==(const String &o) const { return s_ == o.s_; }
+  String operator+(const String &o) const { return String((s_ + o.s_).c_str()); }
+
+private:
+  std::string s_;
+};
@@ -0,0 +1,21 @@
+// Host stand-in for Arduino's Print, the base TFT_eSPI's print()/println() come from
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buf, size_t len)
+  {
+    size_t n = 0;
+    while (len--)
+      n += write(*buf++);
+    return n;
+  }
+  size_t print(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+  size_t println(const char *s) { return print(s) + print("\n"); }
+};
@@ -0,0 +1,29 @@
+// Host stand-in for Arduino's SPI: every byte goes to the emulated panel in panel.cpp
+#pragma once
+
+#include <stdint.h>
+
+#define SPI_HAS_TRANSACTION
+#define MSBFIRST 1
+#define SPI_MODE0 0
+
+class SPISettings {
+public:
+  SPISettings() {}
+  SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode) { (void)clock; (void)bitOrder; (void)dataMode; }
+};
+
+class SPIClass {
+public:
+  void begin() {}
+  void begin(int8_t sck, int8_t miso, int8_t mosi, int8_t ss) { (void)sck; (void)miso; (void)mosi; (void)ss; }
+  void end() {}
+  void beginTransaction(SPISettings settings);
+  void endTransaction();
+  void setFrequency(uint32_t hz) { (void)hz; }
+  void setHwCs(bool use) { (void)use; }
+  uint8_t transfer(uint8_t data);
+  uint16_t transfer16(uint16_t data);
+};
+
+extern SPIClass SPI;
@@ -0,0 +1,314 @@
+// Host emulator of the GC9A01 panel, the Arduino and SPI stand-ins that feed it and
+// the DMA functions TFT_eSPI's Generic processor code leaves out. See panel.h.
+
+#include "panel.h"
+
+#include <SPI.h>
+#include "TFT_eSPI.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#define PIN_CS TFT_CS
+#define PIN_DC TFT_DC
+
+#define CMD_CASET 0x2A
+#define CMD_RASET 0x2B
+#define CMD_RAMWR 0x2C
+#define CMD_MADCTL 0x36
+#define CMD_COLMOD 0x3A
+#define CMD_RAMWRC 0x3C // memory write continue
+
+Panel panel;
+SPIClass SPI;
+
+double busMicros(const BusCounters &c, const BusModel &m)
+{
+  double bits = (double)(c.commands + c.dataBytes) * 8;
+  return bits * 1e6 / m.clockHz + c.transactions * m.transactionUs + c.commands * m.commandUs;
+}
+
+Panel::Panel()
+{
+  memset(pixels, 0, sizeof(pixels));
+}
+
+void Panel::select(bool low)
+{
+  if (low && !selected)
+    counters.transactions++;
+  selected = low;
+}
+
+void Panel::write(uint8_t b)
+{
+  if (!selected)
+    return; // another device on the bus
+  if (!data) {
+    counters.commands++;
+    command = b;
+    param = 0;
+    pendingCount = 0;
+    if (b == CMD_CASET)
+      counters.caset++;
+    else if (b == CMD_RASET)
+      counters.raset++;
+    else if (b == CMD_RAMWR || b == CMD_RAMWRC)
+      counters.ramwr++;
+    if (b == CMD_RAMWR) { // starts at the window origin, RAMWRC where the last one stopped
+      x = xs;
+      y = ys;
+    }
+    return;
+  }
+  counters.dataBytes++;
+  switch (command) {
+  case CMD_CASET:
+  case CMD_RASET: {
+    uint16_t &v = param < 2 ? (command == CMD_CASET ? xs : ys) : (command == CMD_CASET ? xe : ye);
+    v = (param & 1) ? (v & 0xFF00) | b : (uint16_t)(b << 8) | (v & 0x00FF);
+    param++;
+    break;
+  }
+  case CMD_MADCTL:
+    madctlValue = b;
+    break;
+  case CMD_COLMOD:
+    colmod = b;
+    break;
+  case CMD_RAMWR:
+  case CMD_RAMWRC:
+    pixelByte(b);
+    break;
+  default:
+    break;
+  }
+}
+
+// Assemble pixels in the colour format COLMOD selected: 16 bit RGB565, 12 bit RGB444
+// (two pixels in three bytes) or 18 bit (one byte per channel, top 6 bits)
+void Panel::pixelByte(uint8_t b)
+{
+  pending[pendingCount++] = b;
+  switch (colmod & 0x07) {
+  case 0x03:
+    if (pendingCount == 3) {
+      uint16_t p0 = (pending[0] << 4) | (pending[1] >> 4), p1 = ((pending[1] & 0x0F) << 8) | pending[2];
+      putPixel(((p0 & 0xF00) << 4) | ((p0 & 0x0F0) << 3) | ((p0 & 0x00F) << 1));
+      putPixel(((p1 & 0xF00) << 4) | ((p1 & 0x0F0) << 3) | ((p1 & 0x00F) << 1));
+      pendingCount = 0;
+    }
+    break;
+  case 0x06:
+    if (pendingCount == 3) {
+      putPixel(((pending[0] & 0xF8) << 8) | ((pending[1] & 0xFC) << 3) | (pending[2] >> 3));
+      pendingCount = 0;
+    }
+    break;
+  default:
+    if (pendingCount == 2) {
+      putPixel((pending[0] << 8) | pending[1]);
+      pendingCount = 0;
+    }
+    break;
+  }
+}
+
+// Write at the current position and step through the window, wrapping at its end as the controller does
+void Panel::putPixel(uint16_t color)
+{
+  if (x < PANEL_WIDTH && y < PANEL_HEIGHT)
+    pixels[y * PANEL_WIDTH + x] = color;
+  counters.pixels++;
+  if (++x > xe) {
+    x = xs;
+    if (++y > ye)
+      y = ys;
+  }
+}
+
+static uint32_t crcTable[256];
+
+static uint32_t crc32(uint32_t crc, const uint8_t *p, size_t n)
+{
+  if (!crcTable[1]) {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++)
+        c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+      crcTable[i] = c;
+    }
+  }
+  crc = ~crc;
+  while (n--)
+    crc = crcTable[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+static void put32(std::vector<uint8_t> &out, uint32_t v)
+{
+  out.push_back(v >> 24);
+  out.push_back(v >> 16);
+  out.push_back(v >> 8);
+  out.push_back(v);
+}
+
+static void pngChunk(FILE *f, const char *type, const std::vector<uint8_t> &body)
+{
+  std::vector<uint8_t> chunk;
+  put32(chunk, body.size());
+  chunk.insert(chunk.end(), type, type + 4);
+  chunk.insert(chunk.end(), body.begin(), body.end());
+  put32(chunk, crc32(0, chunk.data() + 4, chunk.size() - 4));
+  fwrite(chunk.data(), 1, chunk.size(), f);
+}
+
+// Uncompressed PNG: the zlib stream holds stored deflate blocks, so no zlib is needed
+bool Panel::writePng(const char *path, bool round) const
+{
+  std::vector<uint8_t> raw;
+  raw.reserve(PANEL_HEIGHT * (1 + PANEL_WIDTH * 3));
+  float r = PANEL_WIDTH / 2.0f, cx = r - 0.5f, cy = PANEL_HEIGHT / 2.0f - 0.5f;
+  for (int row = 0; row < PANEL_HEIGHT; row++) {
+    raw.push_back(0); // no filter
+    for (int col = 0; col < PANEL_WIDTH; col++) {
+      uint16_t c = pixels[row * PANEL_WIDTH + col];
+      if (round && (col - cx) * (col - cx) + (row - cy) * (row - cy) > r * r)
+        c = 0;
+      raw.push_back(((c >> 11) * 255 + 15) / 31);
+      raw.push_back((((c >> 5) & 0x3F) * 255 + 31) / 63);
+      raw.push_back(((c & 0x1F) * 255 + 15) / 31);
+    }
+  }
+
+  std::vector<uint8_t> z = { 0x78, 0x01 };
+  for (size_t pos = 0; pos < raw.size();) {
+    size_t n = std::min<size_t>(raw.size() - pos, 65535);
+    z.push_back(pos + n == raw.size()); // BFINAL, BTYPE 00
+    z.push_back(n & 0xFF);
+    z.push_back(n >> 8);
+    z.push_back(~n & 0xFF);
+    z.push_back((~n >> 8) & 0xFF);
+    z.insert(z.end(), raw.begin() + pos, raw.begin() + pos + n);
+    pos += n;
+  }
+  uint32_t a = 1, b = 0;
+  for (uint8_t v : raw) {
+    a = (a + v) % 65521;
+    b = (b + a) % 65521;
+  }
+  put32(z, (b << 16) | a);
+
+  FILE *f = fopen(path, "wb");
+  if (!f)
+    return false;
+  static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+  fwrite(signature, 1, sizeof(signature), f);
+  std::vector<uint8_t> ihdr;
+  put32(ihdr, PANEL_WIDTH);
+  put32(ihdr, PANEL_HEIGHT);
+  ihdr.insert(ihdr.end(), { 8, 2, 0, 0, 0 }); // 8 bit RGB
+  pngChunk(f, "IHDR", ihdr);
+  pngChunk(f, "IDAT", z);
+  pngChunk(f, "IEND", std::vector<uint8_t>());
+  return fclose(f) == 0;
+}
+
+// Arduino stand-ins
+
+void pinMode(int pin, int mode)
+{
+  (void)pin;
+  (void)mode;
+}
+
+void digitalWrite(int pin, int value)
+{
+  if (pin == PIN_CS)
+    panel.select(value == LOW);
+  else if (pin == PIN_DC)
+    panel.setData(value == HIGH);
+}
+
+int digitalRead(int pin)
+{
+  (void)pin;
+  return HIGH;
+}
+
+void delay(unsigned long ms)
+{
+  panel.delayMicros(ms * 1000.0);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  panel.delayMicros(us);
+}
+
+unsigned long millis()
+{
+  return (unsigned long)(panel.clockMicros() / 1000);
+}
+
+unsigned long micros()
+{
+  return (unsigned long)panel.clockMicros();
+}
+
+void SPIClass::beginTransaction(SPISettings settings)
+{
+  (void)settings;
+}
+
+void SPIClass::endTransaction()
+{
+}
+
+uint8_t SPIClass::transfer(uint8_t data)
+{
+  panel.write(data);
+  return 0; // nothing to read back, MISO is not wired on the eye either
+}
+
+uint16_t SPIClass::transfer16(uint16_t data)
+{
+  panel.write(data >> 8);
+  panel.write(data & 0xFF);
+  return 0;
+}
+
+// The Generic processor code has no DMA; on the host a transfer is over when the call returns
+
+bool TFT_eSPI::initDMA(bool ctrl_cs)
+{
+  (void)ctrl_cs;
+  DMA_Enabled = true;
+  return true;
+}
+
+void TFT_eSPI::deInitDMA(void)
+{
+  DMA_Enabled = false;
+}
+
+bool TFT_eSPI::dmaBusy(void)
+{
+  return false;
+}
+
+void TFT_eSPI::dmaWait(void)
+{
+}
+
+void TFT_eSPI::pushPixelsDMA(uint16_t *image, uint32_t len)
+{
+  pushPixels(image, len);
+}
+
+void TFT_eSPI::pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t *data, uint16_t *buffer)
+{
+  (void)buffer;
+  pushImage(x, y, w, h, data);
+}
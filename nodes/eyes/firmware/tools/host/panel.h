@@ -0,0 +1,98 @@
+// Host emulator of the GC9A01 panel behind TFT_eSPI, with a cost model of the SPI bus.
+//
+// TFT_eSPI is built for the host with its Generic processor code and the stand-ins
+// next to this file (Arduino.h, SPI.h, tft_setup.h): chip select and data/command go
+// through digitalWrite(), every byte through SPI.transfer(). The panel decodes that
+// stream like the controller does (CASET, RASET, RAMWR, COLMOD), keeps the pixels in
+// a frame of its own and counts what crossed the bus. busMicros() turns the counts
+// into the time the wire needs at a given clock, plus a fixed cost per transaction
+// (chip select low to high) and per command byte (the D/C line switching).
+//
+// millis() and micros() return that bus time plus whatever delay() added, so code
+// that times itself sees the emulated clock.
+
+#pragma once
+
+#include <stdint.h>
+
+#define PANEL_WIDTH 240
+#define PANEL_HEIGHT 240
+
+#define DEFAULT_BUS_CLOCK 40000000 // Hz, SPI_FREQUENCY of Setup66_Seeed_XIAO_Round
+#define DEFAULT_TRANSACTION_US 2.0 // queueing a DMA transaction and toggling chip select
+#define DEFAULT_COMMAND_US 0.25    // switching D/C around a command byte
+
+struct BusModel {
+  uint32_t clockHz = DEFAULT_BUS_CLOCK;
+  double transactionUs = DEFAULT_TRANSACTION_US;
+  double commandUs = DEFAULT_COMMAND_US;
+};
+
+struct BusCounters {
+  uint64_t transactions = 0; // chip select low to high
+  uint64_t commands = 0;     // bytes sent with D/C low
+  uint64_t caset = 0;
+  uint64_t raset = 0;
+  uint64_t ramwr = 0;
+  uint64_t dataBytes = 0;    // bytes sent with D/C high, parameters and pixels
+  uint64_t pixels = 0;       // pixels written into the panel memory
+
+  BusCounters operator-(const BusCounters &o) const
+  {
+    BusCounters d;
+    d.transactions = transactions - o.transactions;
+    d.commands = commands - o.commands;
+    d.caset = caset - o.caset;
+    d.raset = raset - o.raset;
+    d.ramwr = ramwr - o.ramwr;
+    d.dataBytes = dataBytes - o.dataBytes;
+    d.pixels = pixels - o.pixels;
+    return d;
+  }
+};
+
+// Time the bus needs for what the counters saw
+double busMicros(const BusCounters &c, const BusModel &m);
+
+class Panel {
+public:
+  Panel();
+
+  void select(bool low);        // chip select
+  void setData(bool high) { data = high; }
+  void write(uint8_t b);
+  void delayMicros(double us) { delayedUs += us; }
+
+  // Bus time so far plus delays, what millis() and micros() return
+  double clockMicros() const { return busMicros(counters, model) + delayedUs; }
+
+  // The panel memory as native RGB565, PANEL_WIDTH x PANEL_HEIGHT, in the
+  // coordinates TFT_eSPI addresses (the rotation in MADCTL is not applied)
+  const uint16_t *frame() const { return pixels; }
+  uint8_t madctl() const { return madctlValue; }
+
+  // Write the panel memory as an RGB PNG; round blanks the corners the glass hides
+  bool writePng(const char *path, bool round) const;
+
+  BusModel model;
+  BusCounters counters;
+
+private:
+  void pixelByte(uint8_t b);
+  void putPixel(uint16_t color);
+
+  uint16_t pixels[PANEL_WIDTH * PANEL_HEIGHT];
+  bool selected = false;
+  bool data = true;
+  uint8_t command = 0;
+  int param = 0;               // parameter byte of the current command
+  uint16_t xs = 0, xe = PANEL_WIDTH - 1, ys = 0, ye = PANEL_HEIGHT - 1;
+  int x = 0, y = 0;            // next pixel of RAMWR
+  uint8_t colmod = 0x55;       // 16 bit colour
+  uint8_t madctlValue = 0;
+  uint8_t pending[3];          // bytes of a pixel (or of two 12 bit pixels) still incomplete
+  int pendingCount = 0;
+  double delayedUs = 0;
+};
+
+extern Panel panel;
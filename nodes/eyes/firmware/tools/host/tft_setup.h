@@ -0,0 +1,20 @@
+// TFT_eSPI setup of the host emulator: the panel and clock of Setup66_Seeed_XIAO_Round,
+// with host pin numbers that panel.h watches for chip select and data/command
+#define GC9A01_DRIVER
+#define TFT_WIDTH  240
+#define TFT_HEIGHT 240
+
+#define TFT_MOSI 1
+#define TFT_SCLK 2
+#define TFT_CS   3
+#define TFT_DC   4
+#define TFT_RST  -1
+#define TFT_BL   -1
+
+#define LOAD_GLCD
+#define SMOOTH_FONT
+
+#define SPI_FREQUENCY      40000000
+#define SPI_READ_FREQUENCY 20000000
+
+#define DISABLE_ALL_LIBRARY_WARNINGS
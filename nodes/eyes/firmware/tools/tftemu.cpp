@@ -0,0 +1,493 @@
+// Host emulator of the eye's display path: TFT_eSPI built for the host, drawing
+// into an emulated GC9A01 that counts what crosses the SPI bus (host/panel.h).
+//
+// GIFs are decoded with the firmware's AnimatedGIF sources and sent the way the
+// player sends cooked frames: the canvas centred on the panel, in DMA_STRIP_LINES
+// strips of only the columns that changed, each strip clipped to the round glass
+// (clipCircleRect) and sent as one window in a transaction of its own, like one
+// dmaSubmitImage(). For every frame the bus time at the modelled clock is compared
+// with the frame's delay, which gives the frame rate the bus allows and the frames
+// that cannot make their delay.
+//
+// Frames are decoded in Turbo mode as on the device and each decode is timed on
+// the host, times --cpu-scale for the ESP32-S3. With decode-ahead the next frame
+// is decoded while the current one is sent, so a frame takes the longer of the
+// two (--serial adds them). An asset with a frame that takes longer than its
+// delay stutters on the eye; --json prints one line per asset for the sync
+// tools, which flag those before they upload.
+//
+// --bench runs the cases of the firmware's /bench once each and prints the
+// predicted time per op in the same JSON, to hold against the device's numbers.
+//
+// Build: make -C tools tftemu
+
+#include "../libraries/AnimatedGIF/src/AnimatedGIF.h"
+#include "../libraries/AnimatedGIF/src/gif.inl"
+
+#include "TFT_eSPI.h"
+#include "panel.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define DMA_STRIP_LINES 8 // as in wall-e_eye.ino
+#define DEFAULT_CPU_SCALE 12.0 // ESP32-S3 decode time over a desktop's; calibrate against /stats
+
+static TFT_eSPI tft;
+
+struct Options {
+  bool full = false;      // whole canvas every frame
+  bool clip = true;       // leave out what the round glass hides
+  bool verbose = false;
+  const char *pngDir = NULL;
+  bool bench = false;
+  bool json = false;
+  bool serial = false;    // decode and send one after the other, no decode-ahead
+  double cpuScale = DEFAULT_CPU_SCALE;
+  std::vector<const char *> inputs;
+};
+
+struct FrameCost {
+  int delayMs = 0;
+  int strips = 0;
+  BusCounters bus;
+  double us = 0;       // on the bus
+  double decodeUs = 0; // on the device, the host time scaled
+};
+
+// Time of a frame on the eye
+static double frameMicros(const FrameCost &f, const Options &opt)
+{
+  return opt.serial ? f.decodeUs + f.us : std::max(f.decodeUs, f.us);
+}
+
+// Cooked GIF frames composed into a canvas of big-endian RGB565, the order the firmware sends
+static std::vector<uint16_t> gifCanvas;
+static int gifWidth, gifHeight;
+
+static void gifDraw(GIFDRAW *pDraw)
+{
+  int y = pDraw->iY + pDraw->y;
+  if (y < 0 || y >= gifHeight)
+    return;
+  const uint16_t *line = (const uint16_t *)pDraw->pPixels;
+  for (int i = 0; i < pDraw->iWidth; i++) {
+    int x = pDraw->iX + i;
+    if (x >= 0 && x < gifWidth)
+      gifCanvas[y * gifWidth + x] = line[i];
+  }
+}
+
+static bool readFile(const char *path, std::vector<uint8_t> &data)
+{
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return false;
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  data.resize(size > 0 ? size : 0);
+  bool ok = size > 0 && fread(data.data(), 1, size, f) == (size_t)size;
+  fclose(f);
+  return ok;
+}
+
+static const char *baseName(const char *path)
+{
+  const char *slash = strrchr(path, '/');
+  return slash ? slash + 1 : path;
+}
+
+typedef TFT_eFixedPanel<PANEL_WIDTH, PANEL_HEIGHT> EyePanel; // the firmware's fixed geometry
+
+// Send one strip as the player's flushStrip() queues it: clipped to the circle, one window
+static void sendStrip(int x, int y, int w, int h, const uint16_t *pixels, const Options &opt)
+{
+  int32_t cx = x, cy = y, cw = w, ch = h;
+  if (opt.clip && !(EyePanel::matches(tft) ? EyePanel::clipCircleRect(&cx, &cy, &cw, &ch)
+                                           : tft.clipCircleRect(&cx, &cy, &cw, &ch)))
+    return;
+  std::vector<uint16_t> strip(cw * ch);
+  for (int row = 0; row < ch; row++)
+    memcpy(&strip[row * cw], pixels + (cy - y + row) * w + (cx - x), cw * sizeof(uint16_t));
+  tft.startWrite();
+  tft.setAddrWindow(cx, cy, cw, ch);
+  tft.pushPixels(strip.data(), cw * ch);
+  tft.endWrite();
+}
+
+// Send what changed between prev and the canvas, strip by strip; returns the strips sent
+static int sendFrame(const std::vector<uint16_t> &prev, int xOffset, int yOffset, const Options &opt)
+{
+  int strips = 0;
+  std::vector<uint16_t> lines;
+  for (int y0 = 0; y0 < gifHeight; y0 += DMA_STRIP_LINES) {
+    int rows = std::min(DMA_STRIP_LINES, gifHeight - y0);
+    int x0 = gifWidth, x1 = 0; // changed columns of the strip
+    for (int row = y0; row < y0 + rows; row++) {
+      const uint16_t *now = &gifCanvas[row * gifWidth], *was = &prev[row * gifWidth];
+      int l = 0, r = gifWidth;
+      if (!opt.full) {
+        while (l < r && now[l] == was[l])
+          l++;
+        while (r > l && now[r - 1] == was[r - 1])
+          r--;
+      }
+      if (l < r) {
+        x0 = std::min(x0, l);
+        x1 = std::max(x1, r);
+      }
+    }
+    if (x0 >= x1)
+      continue;
+    int w = x1 - x0;
+    lines.resize(w * rows);
+    for (int row = 0; row < rows; row++)
+      memcpy(&lines[row * w], &gifCanvas[(y0 + row) * gifWidth + x0], w * sizeof(uint16_t));
+    sendStrip(xOffset + x0, yOffset + y0, w, rows, lines.data(), opt);
+    strips++;
+  }
+  return strips;
+}
+
+// Black out the panel around the canvas, once per play as clearCanvasBorder() does
+static void clearBorder(int xOffset, int yOffset)
+{
+  int x1 = xOffset + gifWidth, y1 = yOffset + gifHeight;
+  if (yOffset > 0)
+    tft.fillRect(0, 0, PANEL_WIDTH, yOffset, TFT_BLACK);
+  if (y1 < PANEL_HEIGHT)
+    tft.fillRect(0, y1, PANEL_WIDTH, PANEL_HEIGHT - y1, TFT_BLACK);
+  if (xOffset > 0)
+    tft.fillRect(0, yOffset, xOffset, gifHeight, TFT_BLACK);
+  if (x1 < PANEL_WIDTH)
+    tft.fillRect(x1, yOffset, PANEL_WIDTH - x1, gifHeight, TFT_BLACK);
+}
+
+static void printFrame(int n, const FrameCost &f, const Options &opt)
+{
+  printf("  frame %3d: %3d ms delay, %2d strips, %6llu px, %7llu bytes, %3llu windows, %7.2f ms on the bus, "
+         "%7.2f ms decoding%s\n", n, f.delayMs, f.strips, (unsigned long long)f.bus.pixels,
+         (unsigned long long)(f.bus.commands + f.bus.dataBytes), (unsigned long long)f.bus.ramwr, f.us / 1000,
+         f.decodeUs / 1000, f.delayMs > 0 && frameMicros(f, opt) > f.delayMs * 1000.0 ? "  OVER" : "");
+}
+
+// Escape a file name for a JSON string
+static std::string jsonString(const char *s)
+{
+  std::string out = "\"";
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\')
+      out += '\\';
+    if ((unsigned char)*s >= 0x20)
+      out += *s;
+  }
+  return out + "\"";
+}
+
+static int emulateGif(const char *path, const Options &opt)
+{
+  std::vector<uint8_t> data;
+  if (!readFile(path, data)) {
+    fprintf(stderr, "Error: cannot read %s\n", path);
+    return 1;
+  }
+  GIFIMAGE *gif = (GIFIMAGE *)malloc(sizeof(GIFIMAGE));
+  GIF_begin(gif, GIF_PALETTE_RGB565_BE);
+  if (!GIF_openRAM(gif, data.data(), (int)data.size(), gifDraw)) {
+    fprintf(stderr, "Error: %s is not a GIF\n", path);
+    free(gif);
+    return 1;
+  }
+  gifWidth = GIF_getCanvasWidth(gif);
+  gifHeight = GIF_getCanvasHeight(gif);
+  std::vector<uint8_t> frameBuf(gifWidth * gifHeight + 2 * MAX_WIDTH, 0); // canvas plus one cooked line
+  std::vector<uint8_t> turboBuf(TURBO_BUFFER_SIZE + gifWidth * gifHeight, 0);
+  gif->pFrameBuffer = frameBuf.data();
+  gif->pTurboBuffer = turboBuf.data();
+  gif->ucDrawType = GIF_DRAW_COOKED;
+  long cookedBytes = sizeof(GIFIMAGE) + frameBuf.size(), turboBytes = cookedBytes + turboBuf.size();
+  gifCanvas.assign(gifWidth * gifHeight, 0);
+  std::vector<uint16_t> prev(gifCanvas.size(), 0);
+  int xOffset = (PANEL_WIDTH - gifWidth) / 2, yOffset = (PANEL_HEIGHT - gifHeight) / 2;
+
+  if (opt.verbose && !opt.json)
+    printf("%s: %dx%d\n", baseName(path), gifWidth, gifHeight);
+  tft.fillScreen(TFT_BLACK); // what was shown before doesn't count
+  BusCounters start = panel.counters;
+  clearBorder(xOffset, yOffset);
+  std::vector<FrameCost> frames;
+  int rc = 1, result = 0;
+  while (rc > 0) {
+    FrameCost f;
+    auto t0 = std::chrono::steady_clock::now();
+    rc = GIF_playFrame(gif, &f.delayMs, NULL);
+    f.decodeUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count() * opt.cpuScale;
+    if (gif->iError != GIF_SUCCESS && gif->iError != GIF_EMPTY_FRAME) {
+      fprintf(stderr, "Error: decoding %s failed (%d)\n", path, gif->iError);
+      result = 1;
+      break;
+    }
+    f.strips = sendFrame(prev, xOffset, yOffset, opt);
+    BusCounters now = panel.counters;
+    f.bus = now - start;
+    f.us = busMicros(f.bus, panel.model);
+    start = now;
+    prev = gifCanvas;
+    frames.push_back(f);
+    if (opt.verbose && !opt.json)
+      printFrame((int)frames.size() - 1, f, opt);
+    if (opt.pngDir) {
+      char png[512];
+      snprintf(png, sizeof(png), "%s/%s_%04d.png", opt.pngDir, baseName(path), (int)frames.size() - 1);
+      if (!panel.writePng(png, true)) {
+        fprintf(stderr, "Error: cannot write %s\n", png);
+        result = 1;
+        break;
+      }
+    }
+  }
+  GIF_close(gif);
+  free(gif);
+  if (frames.empty())
+    return 1;
+
+  // Frame 0 carries the border and the whole canvas; a loop repeats from frame 1 on
+  // against the last frame, which the averages leave out as the device's stats do
+  double busUs = 0, decodeUs = 0, frameUs = 0, playUs = 0, delayUs = 0, worstUs = 0;
+  unsigned long long bytes = 0, windows = 0;
+  int over = 0, worst = -1;
+  size_t first = frames.size() > 1 ? 1 : 0;
+  for (size_t i = first; i < frames.size(); i++) {
+    const FrameCost &f = frames[i];
+    double us = frameMicros(f, opt);
+    busUs += f.us;
+    decodeUs += f.decodeUs;
+    frameUs += us;
+    delayUs += f.delayMs * 1000.0;
+    playUs += std::max(us, f.delayMs * 1000.0);
+    bytes += f.bus.commands + f.bus.dataBytes;
+    windows += f.bus.ramwr;
+    if (f.delayMs > 0 && us > f.delayMs * 1000.0) {
+      over++;
+      if (us - f.delayMs * 1000.0 > worstUs) {
+        worstUs = us - f.delayMs * 1000.0;
+        worst = (int)i;
+      }
+    }
+  }
+  double n = frames.size() - first;
+  double fps = playUs > 0 ? n * 1e6 / playUs : 0.0;
+  if (opt.json) {
+    printf("{\"name\":%s,\"width\":%d,\"height\":%d,\"frames\":%d,\"decodeUs\":%.0f,\"busUs\":%.0f,"
+           "\"frameUs\":%.0f,\"bytesPerFrame\":%.0f,\"windowsPerFrame\":%.1f,\"firstFrameUs\":%.0f,"
+           "\"cookedBytes\":%ld,\"turboBytes\":%ld,\"spiHz\":%lu,\"authoredFps\":%.1f,\"predictedFps\":%.1f,"
+           "\"framesOver\":%d,\"worstFrame\":%d,\"worstOverUs\":%.0f,\"stutter\":%s}\n",
+           jsonString(baseName(path)).c_str(), gifWidth, gifHeight, (int)frames.size(), decodeUs / n, busUs / n,
+           frameUs / n, bytes / n, windows / n, frameMicros(frames[0], opt), cookedBytes, turboBytes,
+           (unsigned long)panel.model.clockHz, delayUs > 0 ? n * 1e6 / delayUs : 0.0, fps, over, worst, worstUs,
+           over ? "true" : "false");
+    return result;
+  }
+  char authored[32] = "no delays";
+  if (delayUs > 0)
+    snprintf(authored, sizeof(authored), "%.1f fps authored", n * 1e6 / delayUs);
+  printf("%s: %dx%d, %d frames, first %.2f ms, %.0f bytes and %.1f windows per frame, %.2f ms on the bus "
+         "at %.0f MHz, %.2f ms decoding, %ld KB in Turbo mode (%ld KB cooked): %.0f fps bus-bound, %s, "
+         "%.1f fps predicted, %d frames over their delay%s\n",
+         baseName(path), gifWidth, gifHeight, (int)frames.size(), frames[0].us / 1000, bytes / n, windows / n,
+         busUs / n / 1000, panel.model.clockHz / 1e6, decodeUs / n / 1000, turboBytes / 1024, cookedBytes / 1024,
+         busUs > 0 ? n * 1e6 / busUs : 0.0, authored, fps, over, over ? "  STUTTERS" : "");
+  if (over)
+    printf("  worst: frame %d, %.2f ms over its %d ms delay\n", worst, worstUs / 1000, frames[worst].delayMs);
+  return result;
+}
+
+// The cases of the firmware's /bench, each run once
+static uint16_t benchFrame[PANEL_WIDTH * PANEL_HEIGHT];
+static TFT_eSprite benchSprite8 = TFT_eSprite(&tft), benchSprite16 = TFT_eSprite(&tft);
+static TFT_eSprite benchSpans = TFT_eSprite(&tft); // benchSprite16 compiled with TFT_DARKGREY transparent
+static TFT_eSpritePool benchPool; // blocks for the three, as the firmware's sprite pool gives them
+
+static void benchFill(int i) { tft.fillScreen(i & 1 ? TFT_NAVY : TFT_MAROON); }
+
+static void benchImageLines(int i)
+{
+  for (int y = 0; y < PANEL_HEIGHT; y++)
+    tft.pushImage(0, y, PANEL_WIDTH, 1, benchFrame + y * PANEL_WIDTH);
+}
+
+static void benchImageFrame(int i) { tft.pushImage(0, 0, PANEL_WIDTH, PANEL_HEIGHT, benchFrame); }
+
+static void benchImageDma(int i)
+{
+  tft.startWrite();
+  for (int y = 0; y < PANEL_HEIGHT; y += DMA_STRIP_LINES)
+    tft.pushImageDMA(0, y, PANEL_WIDTH, DMA_STRIP_LINES, benchFrame + y * PANEL_WIDTH);
+  tft.dmaWait();
+  tft.endWrite();
+}
+
+static void benchSprite8bpp(int i) { benchSprite8.pushSprite(0, 0); }
+static void benchSprite16bpp(int i) { benchSprite16.pushSprite(0, 0); }
+static void benchSpriteKey(int i) { benchSprite16.pushSprite(0, 0, TFT_DARKGREY); }
+static void benchSpriteSpans(int i) { benchSpans.pushSprite(0, 0, TFT_DARKGREY); }
+
+static void benchSmoothCircle(int i) { tft.fillSmoothCircle(120, 120, 100, i & 1 ? TFT_WHITE : TFT_BLUE, TFT_BLACK); }
+
+static void benchSmoothArc(int i)
+{
+  tft.drawSmoothArc(120, 120, 115, 95, 30, 330, i & 1 ? TFT_WHITE : TFT_ORANGE, TFT_BLACK, true);
+}
+
+static void benchWideLine(int i)
+{
+  tft.drawWideLine(20, 40 + (i & 7), 220, 200 - (i & 7), 6, i & 1 ? TFT_WHITE : TFT_GREEN, TFT_BLACK);
+}
+
+static void benchText(int i)
+{
+  tft.setTextColor(i & 1 ? TFT_WHITE : TFT_YELLOW, TFT_BLACK);
+  tft.drawString("WALL-E 0123456789", 120, 120, 1);
+}
+
+struct BenchCase {
+  const char *name;
+  void (*run)(int i);
+};
+
+static const BenchCase benchCases[] = {
+  { "fillScreen", benchFill },
+  { "pushImageLines", benchImageLines },
+  { "pushImageFrame", benchImageFrame },
+  { "pushImageDMA", benchImageDma },
+  { "sprite8", benchSprite8bpp },
+  { "sprite16", benchSprite16bpp },
+  { "sprite16Key", benchSpriteKey },
+  { "sprite16Spans", benchSpriteSpans },
+  { "fillSmoothCircle", benchSmoothCircle },
+  { "drawSmoothArc", benchSmoothArc },
+  { "drawWideLine", benchWideLine },
+  { "drawString", benchText },
+};
+
+static int runBench(const Options &opt)
+{
+  for (int y = 0; y < PANEL_HEIGHT; y++)
+    for (int x = 0; x < PANEL_WIDTH; x++)
+      benchFrame[y * PANEL_WIDTH + x] = tft.color565(x, y, x ^ y);
+  benchSprite8.setColorDepth(8);
+  benchSprite16.setColorDepth(16);
+  const spritePoolClass classes[] = { { PANEL_WIDTH * PANEL_HEIGHT + 1, 1 }, { PANEL_WIDTH * PANEL_HEIGHT * 2 + 2, 2 } };
+  benchPool.begin(classes, 2, false);
+  benchSprite8.createSprite(PANEL_WIDTH, PANEL_HEIGHT, &benchPool);
+  benchSprite16.createSprite(PANEL_WIDTH, PANEL_HEIGHT, &benchPool);
+  benchSpans.createSprite(PANEL_WIDTH, PANEL_HEIGHT, &benchPool);
+  for (TFT_eSprite *sprite : { &benchSprite8, &benchSprite16, &benchSpans }) {
+    sprite->fillSprite(TFT_DARKGREY);
+    sprite->fillCircle(120, 120, 90, TFT_WHITE);
+    sprite->fillCircle(120, 120, 40, TFT_BLUE);
+  }
+  benchSpans.compileSprite(TFT_DARKGREY);
+  tft.setTextDatum(MC_DATUM);
+  tft.setTextSize(2);
+  printf("{\"spiHz\":%lu,\"emulated\":true,\"cases\":[", (unsigned long)panel.model.clockHz);
+  for (size_t c = 0; c < sizeof(benchCases) / sizeof(benchCases[0]); c++) {
+    BusCounters before = panel.counters;
+    benchCases[c].run(1);
+    BusCounters d = panel.counters - before;
+    double us = busMicros(d, panel.model);
+    printf("%s{\"name\":\"%s\",\"usPerOp\":%.1f,\"mbps\":%.2f,\"bytes\":%llu,\"windows\":%llu,\"transactions\":%llu}",
+           c ? "," : "", benchCases[c].name, us, us > 0 ? d.pixels * 2 / us : 0.0,
+           (unsigned long long)(d.commands + d.dataBytes), (unsigned long long)d.ramwr,
+           (unsigned long long)d.transactions);
+    if (opt.pngDir) {
+      std::string png = std::string(opt.pngDir) + "/bench_" + benchCases[c].name + ".png";
+      panel.writePng(png.c_str(), true);
+    }
+  }
+  printf("]}\n");
+  benchSprite8.deleteSprite();
+  benchSprite16.deleteSprite();
+  benchSpans.deleteSprite();
+  benchPool.end();
+  return 0;
+}
+
+static void usage()
+{
+  fprintf(stderr,
+          "Usage: tftemu [options] <input.gif>...\n"
+          "       tftemu [options] --bench\n"
+          "  Plays GIFs through TFT_eSPI into an emulated GC9A01 and reports the SPI bus cost\n"
+          "  of every frame, or runs the cases of the firmware's /bench.\n"
+          "  --clock MHZ       SPI write clock (default %d)\n"
+          "  --tx-us US        fixed cost of a transaction, chip select low to high (default %.2f)\n"
+          "  --cmd-us US       fixed cost of a command byte, D/C switching (default %.2f)\n"
+          "  --cpu-scale X     device decode time over the host's (default %.0f)\n"
+          "  --serial          decode and send one after the other, as without decode-ahead\n"
+          "  --full            send the whole canvas every frame, not only the changed columns\n"
+          "  --no-clip         send the corners the round glass hides as well\n"
+          "  --png DIR         write the panel as DIR/<gif>_NNNN.png after every frame\n"
+          "  --json            one JSON object per GIF, with \"stutter\" set when a frame misses its delay\n"
+          "  -v, --verbose     print every frame\n",
+          DEFAULT_BUS_CLOCK / 1000000, DEFAULT_TRANSACTION_US, DEFAULT_COMMAND_US, DEFAULT_CPU_SCALE);
+}
+
+static bool parseArgs(int argc, char **argv, Options &opt)
+{
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--clock" && i + 1 < argc) {
+      panel.model.clockHz = (uint32_t)(atof(argv[++i]) * 1e6);
+    } else if (arg == "--tx-us" && i + 1 < argc) {
+      panel.model.transactionUs = atof(argv[++i]);
+    } else if (arg == "--cmd-us" && i + 1 < argc) {
+      panel.model.commandUs = atof(argv[++i]);
+    } else if (arg == "--cpu-scale" && i + 1 < argc) {
+      opt.cpuScale = atof(argv[++i]);
+    } else if (arg == "--serial") {
+      opt.serial = true;
+    } else if (arg == "--json") {
+      opt.json = true;
+    } else if (arg == "--full") {
+      opt.full = true;
+    } else if (arg == "--no-clip") {
+      opt.clip = false;
+    } else if (arg == "--png" && i + 1 < argc) {
+      opt.pngDir = argv[++i];
+    } else if (arg == "--bench") {
+      opt.bench = true;
+    } else if (arg == "-v" || arg == "--verbose") {
+      opt.verbose = true;
+    } else if (arg.size() > 1 && arg[0] == '-') {
+      return false;
+    } else {
+      opt.inputs.push_back(argv[i]);
+    }
+  }
+  return panel.model.clockHz > 0 && (opt.bench || !opt.inputs.empty());
+}
+
+int main(int argc, char **argv)
+{
+  Options opt;
+  if (!parseArgs(argc, argv, opt)) {
+    usage();
+    return 2;
+  }
+  tft.begin();
+  tft.setViewportCircle(opt.clip); // as the firmware's setup()
+  EyePanel::attach(tft);
+  tft.initDMA();
+  if (opt.bench)
+    return runBench(opt);
+  int result = 0;
+  for (const char *input : opt.inputs)
+    result |= emulateGif(input, opt);
+  return result;
+}
@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+"""Script to turn an eye's /trace dump into Chrome trace JSON.
+
+The dump is a header ("ETRC", version, name count, event count, events lost,
+the device's micros() at the time), a table of 24-byte HTTP path names and
+16-byte events (start in µs, duration, arg, id, core, arg2), oldest first.
+The JSON opens in https://ui.perfetto.dev or chrome://tracing with one track
+per core and kind of event, and one track per DMA strip buffer showing each
+strip from its submit to its completion, so SD reads, decoding and SPI
+transfers can be lined up against each other.
+
+--contention prints how much HTTP traffic slows decoding down: the compute
+time of each GIF frame decode (its span less the SD reads inside it) is
+split by whether a request was being served at the same time, when the other
+core runs web server code from flash and WiFi evicts the shared flash cache.
+Comparing the two on builds with and without the hot loops in IRAM
+(USE_IRAM_HOT_LOOPS, GIF_NO_IRAM, TFT_NO_IRAM) shows the cost of the misses.
+"""
+
+import sys
+import json
+import struct
+import argparse
+import urllib.request
+
+HEADER = struct.Struct("<4sHHIII")
+EVENT = struct.Struct("<IIIBBH")
+NAME_LEN = 24
+MAGIC = b"ETRC"
+VERSION = 1
+
+FRAME, DECODE, DMA_SUBMIT, DMA_DONE, SD_READ, HTTP = range(1, 7)
+TRACKS = {FRAME: "frames", DECODE: "decode", SD_READ: "SD reads", HTTP: "HTTP"}
+HTTP_METHODS = {1: "GET", 2: "HEAD", 3: "POST", 4: "PUT", 5: "PATCH", 6: "DELETE", 7: "OPTIONS"}
+
+
+def parse_dump(data: bytes) -> tuple[dict, list[str], list[tuple]]:
+    """Split a dump into its header, names and events.
+
+    Returns:
+        The header as a dict, the HTTP path names and the events as
+        (us, dur_us, arg, id, core, arg2) tuples, oldest first.
+    """
+    if len(data) < HEADER.size:
+        raise ValueError("dump is too short")
+    magic, version, name_count, event_count, lost, now_us = HEADER.unpack_from(data)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("not a version 1 /trace dump")
+    offset = HEADER.size
+    names = []
+    for _ in range(name_count):
+        names.append(data[offset:offset + NAME_LEN].split(b"\0", 1)[0].decode(errors="replace"))
+        offset += NAME_LEN
+    if len(data) < offset + event_count * EVENT.size:
+        raise ValueError("dump is truncated")
+    events = [EVENT.unpack_from(data, offset + i * EVENT.size) for i in range(event_count)]
+    return {"events": event_count, "lost": lost, "now_us": now_us}, names, events
+
+
+def to_chrome_trace(names: list[str], events: list[tuple]) -> dict:
+    """Chrome trace JSON of the events, times relative to the earliest one."""
+    out = []
+    tracks = {}
+
+    def tid(core: int, track: str) -> int:
+        key = (core, track)
+        if key not in tracks:
+            tracks[key] = len(tracks) + 1
+            out.append({"name": "thread_name", "ph": "M", "pid": 0, "tid": tracks[key],
+                        "args": {"name": f"core {core} {track}"}})
+        return tracks[key]
+
+    # micros() wraps every 71 minutes; events are in recording order, so unwrap as they come
+    base = events[0][0] if events else 0
+    epoch = 0
+    last = base
+    submitted = {}  # DMA strip buffer -> (start, bytes, core)
+    for us, dur, arg, kind, core, arg2 in events:
+        if us < last and last - us > 1 << 31:
+            epoch += 1 << 32
+        last = us
+        ts = us + epoch - base
+        if kind == DMA_SUBMIT:
+            submitted[arg2] = (ts, arg, core)
+        elif kind == DMA_DONE:
+            if arg2 in submitted:
+                start, size, submit_core = submitted.pop(arg2)
+                out.append({"name": f"strip {size} B", "ph": "X", "ts": start, "dur": max(ts - start, 0),
+                            "pid": 0, "tid": tid(submit_core, f"DMA buffer {arg2}"), "args": {"bytes": size}})
+        elif kind in TRACKS:
+            if kind == FRAME:
+                name, args = f"frame {arg}", {}
+            elif kind == DECODE:
+                name, args = "decode", {"frame": arg, "rc": arg2 - 0x10000 if arg2 & 0x8000 else arg2}
+            elif kind == SD_READ:
+                name, args = "SD read", {"bytes": arg}
+            else:
+                path = names[arg] if arg < len(names) else "?"
+                name, args = f"{HTTP_METHODS.get(arg2, 'HTTP')} {path}", {}
+            out.append({"name": name, "ph": "X", "ts": ts, "dur": dur, "pid": 0, "tid": tid(core, TRACKS[kind]),
+                        "args": args})
+    # spans are recorded when they end, so the earliest start is not always the first event's
+    start = min((e["ts"] for e in out if "ts" in e), default=0)
+    for e in out:
+        if "ts" in e:
+            e["ts"] -= start
+    return {"traceEvents": out, "displayTimeUnit": "ms"}
+
+
+def percentile(values: list, p: float) -> int:
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(len(ordered) * p))] if ordered else 0
+
+
+def contention(events: list[tuple]) -> dict:
+    """Decode compute times in µs, {"quiet": [...], "http": [...]}; see the module doc."""
+    spans = {DECODE: [], SD_READ: [], HTTP: []}
+    for us, dur, arg, kind, core, arg2 in events:
+        if kind in spans:
+            spans[kind].append((us, us + dur, core))  # wraps are rare enough to ignore here
+    times = {"quiet": [], "http": []}
+    for start, end, core in spans[DECODE]:
+        reads = sum(min(e, end) - max(s, start) for s, e, c in spans[SD_READ] if c == core and s < end and e > start)
+        busy = any(s < end and e > start for s, e, c in spans[HTTP])
+        times["http" if busy else "quiet"].append(end - start - reads)
+    return times
+
+
+def print_contention(times: dict):
+    for key, label in (("quiet", "no request"), ("http", "during HTTP")):
+        t = times[key]
+        print(f"decode compute, {label:11s}: {len(t):6d} frames, p50 {percentile(t, 0.5):6d} us, "
+              f"p99 {percentile(t, 0.99):6d} us, max {max(t, default=0):6d} us")
+    quiet, busy = percentile(times["quiet"], 0.99), percentile(times["http"], 0.99)
+    if quiet and busy:
+        print(f"p99 during HTTP is {(busy - quiet) / quiet * 100:+.1f}% of the quiet p99")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Convert an eye's /trace dump to Chrome trace JSON")
+    parser.add_argument("source", help="dump file, or the eye's address to fetch http://<ip>/trace from")
+    parser.add_argument("-o", "--output", default="trace.json", help="JSON to write")
+    parser.add_argument("--clear", action="store_true", help="start a new trace on the eye after fetching")
+    parser.add_argument("--contention", action="store_true", help="also print decode times with and without HTTP traffic")
+    args = parser.parse_args()
+    try:
+        if args.source.replace(".", "").isdigit() or args.source.startswith("http"):
+            url = args.source if args.source.startswith("http") else f"http://{args.source}/trace"
+            if args.clear:
+                url += "?clear=1"
+            with urllib.request.urlopen(url, timeout=30) as response:
+                data = response.read()
+        else:
+            with open(args.source, "rb") as f:
+                data = f.read()
+        header, names, events = parse_dump(data)
+    except (OSError, ValueError) as e:
+        print(f"Error: {e}")
+        sys.exit(1)
+    with open(args.output, "w") as f:
+        json.dump(to_chrome_trace(names, events), f)
+    print(f"Wrote {args.output}: {header['events']} events, {header['lost']} lost before them")
+    if args.contention:
+        print_contention(contention(events))
+
+
+if __name__ == "__main__":
+    main()
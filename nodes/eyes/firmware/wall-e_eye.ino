@@ -3,14 +3,74 @@
 #include <TFT_eSPI.h>
 #include <SPI.h>
 #include <SD.h>
+#include <ff.h>     // FatFs under SD, for contiguous media (USE_CONTIGUOUS_MEDIA)
+#include <diskio.h>
+#include <LittleFS.h>
+#include <esp_partition.h>
+#include <esp_ota_ops.h>
+#include <esp_rom_crc.h>
+#include <esp_pm.h>
+#include <driver/ledc.h>
 #include <math.h>
 #include <algorithm>
 #include <WiFi.h>
+#include <WiFiUdp.h>
+#include <ESPmDNS.h>
 #include <WebServer.h>
+#include <uri/UriBraces.h>
 #include <Preferences.h>
+#include <MD5Builder.h>
+#define USE_JPEGDEC // decode JPEGs with JPEGDEC (big-endian MCUs, 1/2 to 1/8 scaling, buffered SD reads); undefine for JPEGDecoder
+#ifdef USE_JPEGDEC
+#include <JPEGDEC.h>
+#define USE_JPEG_SIMD // expect JPEGDEC's ESP32-S3 vector kernels (dequantisation, IDCT, YCbCr to RGB565)
+#if defined(HAS_SIMD) || defined(ESP32S3_SIMD)
+#define JPEG_SIMD_BUILT
+#elif defined(USE_JPEG_SIMD)
+#warning "This JPEGDEC has no ESP32-S3 SIMD path (update it, it needs ESP-DSP): JPEGs decode with scalar code"
+#endif
+#else
 #include <JPEGDecoder.h> // Using JPEG format for static images
+#endif
+// #define USE_LVGL // status text through LVGL 8.3 (lv_conf.h in libraries/, needs the lvgl library and USE_DMA)
+#ifdef USE_LVGL
+#include <lvgl.h>
+#include <esp_timer.h>
+#endif
+
+#define REPLY_TEXT_SIZE 160 // longest plain text reply of the control routes
+
+// WebServer with argument access and plain text replies that don't copy into Strings, so the
+// control routes the eyes node calls at a high rate cause no heap churn of their own
+class EyeServer : public WebServer {
+public:
+  using WebServer::WebServer;
+
+  // Value of a query or form argument, NULL if there is none; valid until the next request
+  const char *argValue(const char *name) {
+    for (int i = 0; i < _currentArgCount; i++)
+      if (_currentArgs[i].key == name)
+        return _currentArgs[i].value.c_str();
+    return NULL;
+  }
+  const char *argNameAt(int i) { return i < _currentArgCount ? _currentArgs[i].key.c_str() : ""; }
+  const char *argValueAt(int i) { return i < _currentArgCount ? _currentArgs[i].value.c_str() : ""; }
+
+  void sendText(int code, const char *text) { send_P(code, "text/plain", text, strlen(text)); }
 
-WebServer server(80);
+  void sendTextf(int code, const char *format, ...) __attribute__((format(printf, 3, 4))) {
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(reply, sizeof(reply), format, args);
+    va_end(args);
+    send_P(code, "text/plain", reply, n < 0 ? 0 : std::min((size_t)n, sizeof(reply) - 1));
+  }
+
+private:
+  char reply[REPLY_TEXT_SIZE];
+};
+
+EyeServer server(80);
 Preferences prefs;
 
 
@@ -19,7 +79,13 @@ Preferences prefs;
 #endif
 #include "AnimatedGIF.h"
 
-AnimatedGIF gif;
+// The LZW tables, file and line buffers only hold data while a frame decodes, so the player's
+// decoders (the GIF and the GIF overlay layer) take turns on one workspace in internal RAM and
+// only their state and palettes are kept apart; see setupGifWorkspace()
+typedef AnimatedGIFT<MAX_WIDTH, MAX_COLORS, true> SharedGIF;
+static uint32_t gifWorkspace[(GIF_WORKSPACE_BYTES(MAX_WIDTH, MAX_COLORS) + 3) / 4];
+static uint32_t gifPalettes[(GIF_PALETTE_SET_BYTES(MAX_COLORS) + 3) / 4];
+SharedGIF gif;
 TFT_eSPI tft = TFT_eSPI();
 
 // rule: loop GIF at least during 3s, maximum 5 times, and don't loop/animate longer than 30s per GIF
@@ -39,647 +105,10626 @@ char GifComment[256];
 
 static File FSGifFile; // temp gif file holder
 static File GifRootFolder; // directory listing
-std::vector<std::string> GifFiles; // GIF files path
 static File uploadFile; // file upload handler
 bool uploadTooLarge = false; // flag for oversized uploads
-volatile bool cancelPlayback = false; // flag to cancel ongoing GIF playback
-#define DISPLAY_WIDTH 240
+bool uploadFailed = false; // SD write or rename failed
 
-static void MyCustomDelay( unsigned long ms ) {
-  delay( ms );
-  // log_d("delay %d\n", ms);
-}
+#define UPLOAD_BUFFER_SIZE (32 * 1024) // uploads reach the card in whole 32 KB writes
+#define UPLOAD_TEMP_PATH "/gif/.upload.tmp" // hidden from listings until renamed
+#define UPLOAD_MAX_SIZE (10 * 1024 * 1024)  // checked against the request size before anything is written
 
-static void * GIFOpenFile(const char *fname, int32_t *pSize)
+static uint8_t uploadBuffer[UPLOAD_BUFFER_SIZE] __attribute__((aligned(4)));
+static size_t uploadBuffered = 0;
+static fs::FS *uploadFs = &SD; // store the running upload goes to
+static bool uploadPreallocated = false; // the temp file was allocated in one run, see beginUpload()
+static MD5Builder uploadMd5;   // content hash of the running upload, kept in the catalog
+static bool uploadChecksumMismatch = false; // the upload didn't match its ?md5=
+
+// Media live in /gif on the SD card or on the LittleFS partition of the internal flash. Flash
+// reads have a lower and steadier latency and don't share the display's SPI bus, so hot eye
+// loops are uploaded there (/upload?store=flash); the card takes the rest and any overflow.
+// Native copies, previews and the catalog index stay on the card
+static bool flashStoreReady = false;
+static bool storageReady = false; // the card is mounted
+
+// Store holding a /gif path: flash if the file is there, the card otherwise
+static fs::FS &mediaFs(const char *path)
 {
-  // log_d("GIFOpenFile( %s )\n", fname );
-  FSGifFile = SD.open(fname);
-  if (FSGifFile) {
-    *pSize = FSGifFile.size();
-    return (void *)&FSGifFile;
-  }
-  return NULL;
+  if (flashStoreReady && LittleFS.exists(path))
+    return LittleFS;
+  return SD;
 }
+#define DISPLAY_WIDTH 240
 
-static void GIFCloseFile(void *pHandle)
+#define USE_DMA             // queue GIF lines to the display through SPI DMA (ESP32-S3)
+#define DMA_STRIP_LINES 8   // lines collected per DMA transfer (240 * 8 * 2 = 3840 bytes per buffer)
+#define DMA_STRIP_BUFFERS 3 // strips queued for DMA while the decoder fills the next one
+#define SPI_TUNE_MAX_HZ 80000000 // fastest write clock the boot auto-tune tries, see initSpiClock()
+// #define USE_RGB444       // send the DMA strips as 12 bit pixels (2 in 3 bytes), 25% fewer bytes on the bus
+#define USE_SCREEN_SHADOW   // keep an RGB565 copy of the screen in PSRAM for /screen (TFT_eSPI setShadowBuffer())
+#define USE_IRAM_HOT_LOOPS  // GIFDraw(), the strip writer and compositing run from IRAM, away from flash cache misses
+#define USE_TRACE           // record frame, decode, DMA, SD and HTTP events in a PSRAM ring for /trace
+#define USE_PROFILER        // sample the interrupted PC of both cores at each FreeRTOS tick for /profile
+#define USE_HEAP_MONITOR    // free memory, largest blocks and what each HTTP route leaves allocated in /stats
+#define USE_BACKLIGHT_PWM   // drive TFT_BL from LEDC, with hardware fades for /backlight and the idle governor
+#define USE_IDLE_GOVERNOR   // lower the CPU clock and WiFi power while the eye shows something static, see /power
+#define USE_SPRITE_POOL     // temporary sprites from fixed PSRAM blocks (TFT_eSpritePool) instead of malloc/free
+#define USE_MEMORY_PLAN     // reserve the decoders' buffers at boot as fixed arenas (memoryPlan), see /stats
+#define USE_PIXEL_KERNEL    // /fx screen effects, one fused pass over each DMA strip (TFT_ePixelKernel)
+#define USE_LOOK_CANVAS     // a 320x320 eye in PSRAM (200 KB) that /look pans the screen over
+#define USE_SPRITE_ATLAS    // /atlas decodes a sheet of eye poses into PSRAM once and shows its tiles by index
+#define USE_GIF_LAYER       // /overlay?gif= animates a small GIF over the playing one, decoded on the shared workspace
+#define USE_PREFETCH        // /prefetch reads the GIFs the host expects next into the PSRAM caches while the player idles
+#if defined(USE_LVGL) && !defined(USE_DMA)
+#error "USE_LVGL flushes with pushImageDMA(), define USE_DMA too"
+#endif
+#if defined(USE_PIXEL_KERNEL) && !defined(USE_DMA)
+#error "USE_PIXEL_KERNEL runs on the DMA strips, define USE_DMA too"
+#endif
+#if defined(USE_GIF_LAYER) && !defined(USE_DMA)
+#error "USE_GIF_LAYER is an overlay, which are blended into the DMA strips, define USE_DMA too"
+#endif
+#define USE_PNG_LAYER       // /overlay?png= shows a PNG with its alpha over the playing GIF (needs the PNGdec library)
+#ifdef USE_PNG_LAYER
+#ifndef USE_DMA
+#error "USE_PNG_LAYER is an overlay, which are blended into the DMA strips, define USE_DMA too"
+#endif
+#include <PNGdec.h>
+#endif
+#ifdef USE_IRAM_HOT_LOOPS // AnimatedGIF's decoders and TFT_eSPI's pushes and DMA path have their own, GIF_NO_IRAM and TFT_NO_IRAM
+#define HOT_IRAM IRAM_ATTR
+#else
+#define HOT_IRAM
+#endif
+
+#define USE_TURBO           // decode with AnimatedGIF Turbo mode into PSRAM buffers when available
+// #define USE_TURBO_WINDOW // Turbo decoding through a window of recent lines in internal RAM, no frame sized PSRAM buffer
+#define USE_DELTA           // in Turbo mode only send the pixels that changed since the previous frame
+#define USE_DECODE_AHEAD    // in Turbo mode decode the next frame into a PSRAM back buffer while the current one is shown
+// #define USE_FRAME_RING   // in Turbo mode decode on the other core into a PSRAM strip ring the player drains
+#if (defined(USE_DECODE_AHEAD) || defined(USE_FRAME_RING)) && !defined(USE_DMA)
+#error "USE_DECODE_AHEAD and USE_FRAME_RING present frames through the DMA strips, define USE_DMA too"
+#endif
+
+#define PLAYER_CORE 0            // loop() and the web server run on core 1
+#define PLAYER_STACK_SIZE 12288
+#define DECODER_STACK_SIZE 12288 // decoder task of USE_FRAME_RING, on the web server's core
+#define MJPEG_STACK_SIZE 6144    // MJPEG feed reader, on the web server's core
+#define FETCH_STACK_SIZE 6144    // GIF fetch reader (/fetch), on the web server's core
+#define WEB_STACK_SIZE 12288     // web server task, see webTask()
+#define DISPLAY_QUEUE_LENGTH 8
+
+// Everything that draws runs on the player task; HTTP handlers only queue commands
+enum DisplayCommandType {
+  CMD_PLAY,
+  CMD_OPEN,
+  CMD_CLOSE,
+  CMD_BLINK,
+  CMD_COLORFUL,
+  CMD_ROTATE,
+  CMD_PUPIL,
+  CMD_DROP_CACHE,  // cache maintenance is applied between frames without stopping playback
+  CMD_CLEAR_CACHE,
+  CMD_TRIM_CACHE,
+  CMD_TRANSCODE,   // convert an uploaded GIF into the native RGB565 container
+  CMD_LOAD_PACK,   // swap in a completely received asset pack, see installAssetPack()
+  CMD_EYE,         // new targets for the procedural eye, see EyeState
+  CMD_OVERLAY,     // highlight and eyelid over GIFs, applied between frames like the cache commands
+  CMD_COLOR,       // colour effect of GIFs, applied between frames and used from the next GIF on
+  CMD_PLAYLIST,    // value 1 starts the playlist from the top, 0 stops it
+  CMD_STREAM,      // show the remote frames of the stream port until it goes quiet, see playStream()
+  CMD_MJPEG,       // show the frames of the MJPEG feed until it ends, see playMjpeg()
+  CMD_AUDIO,       // a new audio envelope sample arrived, see followAudio()
+  CMD_BENCH,       // run the primitive benchmark for /bench, see runBench()
+  CMD_SHIFT,       // move the picture y rows with the panel's vertical scroll, applied between frames
+  CMD_SD_BENCH,    // time reads of the card for /sdbench, see runSdBench()
+  CMD_FX,          // screen effects of the strips, applied between frames like CMD_COLOR
+  CMD_LOOK,        // pan the screen over the look canvas to x, y, see startLook()
+  CMD_ATLAS_LOAD,  // decode sheet `name` as x columns by y rows of tiles and show the first, see loadAtlas()
+  CMD_ATLAS        // show atlas tile `value`, or with value -1 the tile nearest to gaze x, y
+};
+
+struct DisplayCommand {
+  uint8_t type;
+  int value;
+  uint32_t startAt; // sync clock time to start at, 0 = right away
+  int x, y;         // pupil position, -100..100 on each axis
+  uint8_t lid, dilation; // CMD_EYE targets, value holds the EYE_SET_* bits of the fields that are set
+                         // (CMD_OVERLAY: highlight at x, y with radius `dilation`, OVERLAY_SET_* bits)
+                         // (CMD_COLOR: hue x, brightness y, tint `color` by `lid` %, gamma * 100 in value)
+                         // (CMD_FX: vignette x %, scanlines y %, scanline speed `dilation`, glow `color` by `lid` %)
+  uint16_t color;
+  uint32_t queuedUs; // micros() when queued, for the time to first pixel in /stats
+  char name[96];
+};
+
+static QueueHandle_t displayQueue = NULL;
+static volatile int preemptsQueued = 0; // queued commands that replace what is shown, see sendDisplayCommand()
+
+static bool isCacheCommand(uint8_t type);
+
+// Commands the player applies between two frames of the image it plays instead of stopping it,
+// see playbackPreempted()
+static bool appliedBetweenFrames(uint8_t type)
 {
-  File *f = static_cast<File *>(pHandle);
-  if (f != NULL)
-     f->close();
+  return isCacheCommand(type) || type == CMD_OVERLAY || type == CMD_COLOR || type == CMD_AUDIO ||
+         type == CMD_SHIFT || type == CMD_FX;
 }
 
-static int32_t GIFReadFile(GIFFILE *pFile, uint8_t *pBuf, int32_t iLen)
+// Hand a command to the player task, counting those that cancel the rendering in progress;
+// false if the queue stayed full for `wait`
+static bool sendDisplayCommand(DisplayCommand &cmd, TickType_t wait)
 {
-  int32_t iBytesRead;
-  iBytesRead = iLen;
-  File *f = static_cast<File *>(pFile->fHandle);
-  // Note: If you read a file all the way to the last byte, seek() stops working
-  if ((pFile->iSize - pFile->iPos) < iLen)
-      iBytesRead = pFile->iSize - pFile->iPos - 1; // <-- ugly work-around
-  if (iBytesRead <= 0)
-      return 0;
-  iBytesRead = (int32_t)f->read(pBuf, iBytesRead);
-  pFile->iPos = f->position();
-  return iBytesRead;
+  bool preempts = !appliedBetweenFrames(cmd.type);
+  cmd.queuedUs = micros();
+  if (preempts) // before it can be taken, so the player never sees it uncounted
+    __atomic_add_fetch(&preemptsQueued, 1, __ATOMIC_RELEASE);
+  if (xQueueSend(displayQueue, &cmd, wait) == pdTRUE)
+    return true;
+  if (preempts)
+    __atomic_sub_fetch(&preemptsQueued, 1, __ATOMIC_RELEASE);
+  return false;
 }
 
-static int32_t GIFSeekFile(GIFFILE *pFile, int32_t iPosition)
+// Cancellation point of the render paths, checked per strip, MCU row or band: a command that
+// replaces the image is waiting, so the rest of it need not be sent. One load, unlike a queue peek
+static inline bool renderCancelled()
 {
-  int i = micros();
-  File *f = static_cast<File *>(pFile->fHandle);
-  f->seek(iPosition);
-  pFile->iPos = (int32_t)f->position();
-  i = micros() - i;
-  // log_d("Seek time = %d us\n", i);
-  return pFile->iPos;
+  return __atomic_load_n(&preemptsQueued, __ATOMIC_ACQUIRE) > 0;
 }
+static SemaphoreHandle_t cacheLock = NULL; // guards the cache lists while /cache reads them
+static char playingName[96] = ""; // file currently being played
+static bool playingDropped = false; // the playing file was replaced or deleted
 
-static void TFTDraw(int x, int y, int w, int h, uint16_t* lBuf )
+// Playback events for /events: the player and the catalog post them without waiting, the web
+// task sends them to the subscribed clients as Server-Sent Events, see serviceEvents()
+#define EVENTS_QUEUE_LENGTH 16
+#define EVENTS_FRAME_STEP 100 // a `frame` event for the first shown frame and every this many
+enum EventType { EVENT_STARTED, EVENT_FRAME, EVENT_FINISHED, EVENT_CANCELLED, EVENT_CATALOG };
+struct PlaybackEvent {
+  uint8_t type;
+  uint32_t frame; // frames shown so far
+  uint32_t ms;    // since the play started
+  char name[64];
+};
+static QueueHandle_t eventQueue = NULL;
+static volatile bool eventsWanted = false; // a client is subscribed, nothing is queued otherwise
+static uint32_t eventsDropped = 0;         // the queue was full
+static uint32_t eventFrames = 0;           // frames shown of the current play
+static uint32_t eventPlayStart = 0;        // millis() it started
+
+static void postEvent(uint8_t type, const char *name)
 {
-  tft.pushRect( x+xOffset, y+yOffset, w, h, lBuf );
+  if (!eventsWanted || !eventQueue)
+    return;
+  PlaybackEvent e = { type, eventFrames, millis() - eventPlayStart, "" };
+  strlcpy(e.name, name, sizeof(e.name));
+  if (xQueueSend(eventQueue, &e, 0) != pdTRUE)
+    eventsDropped++;
 }
 
-// Draw a line of image directly on the LCD
-void GIFDraw(GIFDRAW *pDraw)
-{
-  uint8_t *s;
-  uint16_t *d, *usPalette, usTemp[320];
-  int x, y, iWidth;
+static char keptGifName[96] = "";       // GIF left open in `gif` after playing, replays only rewind it
+static const uint8_t *keptGifData = NULL; // blob it decodes from, NULL for the SD file
 
-  iWidth = pDraw->iWidth;
-  if (iWidth > DISPLAY_WIDTH)
-      iWidth = DISPLAY_WIDTH;
-  usPalette = pDraw->pPalette;
-  y = pDraw->iY + pDraw->y; // current line
+// Playlist the player runs whenever it has nothing else to show, see runPlaylistItem()
+#define PLAYLIST_MAX_LOOPS 1000
+#define PLAYLIST_MAX_WEIGHT 1000
+#define PLAYLIST_RETRY_MS 1000    // wait before another pass when nothing in the playlist could be played
 
-  s = pDraw->pPixels;
-  if (pDraw->ucDisposalMethod == 2) {// restore to background color
-    for (x=0; x<iWidth; x++) {
-      if (s[x] == pDraw->ucTransparent)
-          s[x] = pDraw->ucBackground;
-    }
-    pDraw->ucHasTransparency = 0;
-  }
-  // Apply the new pixels to the main image
-  if (pDraw->ucHasTransparency) { // if transparency used
-    uint8_t *pEnd, c, ucTransparent = pDraw->ucTransparent;
-    int x, iCount;
-    pEnd = s + iWidth;
-    x = 0;
-    iCount = 0; // count non-transparent pixels
-    while(x < iWidth) {
-      c = ucTransparent-1;
-      d = usTemp;
-      while (c != ucTransparent && s < pEnd) {
-        c = *s++;
-        if (c == ucTransparent) { // done, stop
-          s--; // back up to treat it like transparent
-        } else { // opaque
-            *d++ = usPalette[c];
-            iCount++;
-        }
-      } // while looking for opaque pixels
-      if (iCount) { // any opaque pixels?
-        TFTDraw( pDraw->iX+x, y, iCount, 1, (uint16_t*)usTemp );
-        x += iCount;
-        iCount = 0;
-      }
-      // no, look for a run of transparent pixels
-      c = ucTransparent;
-      while (c == ucTransparent && s < pEnd) {
-        c = *s++;
-        if (c == ucTransparent)
-            iCount++;
-        else
-            s--;
-      }
-      if (iCount) {
-        x += iCount; // skip these
-        iCount = 0;
-      }
-    }
-  } else {
-    s = pDraw->pPixels;
-    // Translate the 8-bit pixels through the RGB565 palette (already byte reversed)
-    for (x=0; x<iWidth; x++)
-      usTemp[x] = usPalette[*s++];
-    TFTDraw( pDraw->iX, y, iWidth, 1, (uint16_t*)usTemp );
-  }
-} /* GIFDraw() */
+struct PlaylistItem {
+  std::string path; // "/gif/<name>"
+  uint16_t loops;   // times a GIF is played, seconds a JPEG is shown
+  uint16_t weight;  // chance of being picked in shuffle mode, relative to the other items
+};
 
-int gifPlay( char* gifPath )
-{ // 0=infinite
-  gif.begin(BIG_ENDIAN_PIXELS);
-  if( ! gif.open( gifPath, GIFOpenFile, GIFCloseFile, GIFReadFile, GIFSeekFile, GIFDraw ) ) {
-    // log_n("Could not open gif %s", gifPath );
-    return maxLoopsDuration;
-  }
+static std::vector<PlaylistItem> playlist; // replaced by /playlist, guarded by playlistLock
+static bool playlistShuffle = false;
+static SemaphoreHandle_t playlistLock = NULL;
+static volatile bool playlistRunning = false; // paused while the procedural eye is shown
+static volatile int playlistPos = -1;         // item playing or played last
+static int playlistNext = -1;                 // item picked to follow it, guarded by playlistLock
+static TickType_t playlistWait = 0;           // until the next pass, player task only
+static char playlistUpNext[96] = "";          // path of that item until it has been read ahead
+static void readAheadPlaylist();
 
-  cancelPlayback = false; // Reset cancel flag before starting
-  const float speedFactor = 0.5; // adjust this value to fine-tune playback speed
-  int frameDelay = 0; // store delay for the last frame
-  int then = 0; // store overall delay
-  bool showcomment = false;
+#define CONTROL_PORT 4211         // persistent TCP and UDP command channel, see pollControl()
+#define CONTROL_MAX_CLIENTS 2
+#define CONTROL_LINE_LENGTH 128
+#define BATCH_STEPS 32            // commands in one /batch
+#define BATCH_MAX_MS 60000        // latest a batch command may run, after the request
+#define USE_SERIAL_CONTROL        // framed control commands over the USB CDC port, see pollSerialControl()
+#define SERIAL_FRAME_START 0xA5   // not ASCII, so the boot log on the same port never starts a frame
+#define SERIAL_FRAME_TIMEOUT_MS 20 // a frame left unfinished this long is dropped
+#define PUPIL_RANGE 20            // px the iris moves off center at +-100
 
-  // center the GIF !!
-  int w = gif.getCanvasWidth();
-  int h = gif.getCanvasHeight();
-  xOffset = ( tft.width()  - w )  /2;
-  yOffset = ( tft.height() - h ) /2;
+#define EYE_TICK_MS 33            // procedural eye frame interval, ~30 fps
+#define EYE_SCLERA_RADIUS 50
+#define EYE_IRIS_RADIUS 30
+#define EYE_BOX (2 * EYE_SCLERA_RADIUS + 1) // width and height of the area the eye is drawn in
+#define EYE_IRIS_TEXTURE 64       // iris texture size, scaled down to the iris by pushTransformed()
+#define EYE_IRIS_RIM_SHADE 89     // irisPalette shade at the texture's outer edge, the anti-aliased rim under it
+#define EYE_LID_STEP 25           // % of the lid travel per tick, closing takes 4 ticks
+#define EYE_SET_X 1               // CMD_EYE value bits
+#define EYE_SET_Y 2
+#define EYE_SET_LID 4
+#define EYE_SET_DILATION 8
+#define EYE_SET_COLOR 16
 
-  if( lastFile != currentFile ) {
-    // log_n("Playing %s [%d,%d] with offset [%d,%d]", gifPath, w, h, xOffset, yOffset );
-    lastFile = currentFile;
-    showcomment = true;
-  }
+static WiFiServer controlServer(CONTROL_PORT);
+static WiFiUDP controlUdp;
+static WiFiClient controlClients[CONTROL_MAX_CLIENTS];
+static char controlLines[CONTROL_MAX_CLIENTS][CONTROL_LINE_LENGTH];
+static int controlLineLength[CONTROL_MAX_CLIENTS];
+static bool panelMirrored = false; // set by applyOrientation(), gaze x is flipped to match
 
-  while (gif.playFrame(true, &frameDelay)) {
-    if (cancelPlayback) {
-      // Cancel the playback if a new command has arrived
-      break;
-    }
-    if (showcomment) {
-      if (gif.getComment(GifComment)) {
-        // log_n("GIF Comment: %s", GifComment);
-      }
-    }
-    unsigned long adjustedDelay = (unsigned long)(frameDelay * speedFactor);
-    then += adjustedDelay;
-    if (then > maxGifDuration) { // avoid being trapped in infinite GIF's
-      // log_w("Broke the GIF loop, max duration exceeded");
-      break;
-    }
-    unsigned long frameStart = millis();
-    while (millis() - frameStart < adjustedDelay) {
-      server.handleClient();
-      delay(1);
-    }
-  }
+// Which eye this is. Assets and commands are authored for the left eye; the right eye
+// derives its mirror image locally (panel MADCTL flip, mirrored gaze and overlay x), so
+// both eyes play one asset set from the same broadcast command
+enum EyeSide { SIDE_NONE, SIDE_LEFT, SIDE_RIGHT };
+static const char *const sideNames[] = {"none", "left", "right"};
+static uint8_t eyeSide = SIDE_NONE; // "side" preference; none leaves mirroring to "mirror"
 
-  gif.close();
-  return then;
+static int parseSide(const String &name) {
+  for (int i = 0; i < 3; i++)
+    if (name == sideNames[i])
+      return i;
+  return -1;
 }
 
-// Function to draw a line of JPEG pixels to the TFT display
-void jpegRender(int xpos, int ypos) {
-  // Retrieve information about the image
-  uint16_t *pImg;
-  uint16_t mcu_w = JpegDec.MCUWidth;
-  uint16_t mcu_h = JpegDec.MCUHeight;
-  uint32_t max_x = JpegDec.width;
-  uint32_t max_y = JpegDec.height;
+// Mirror setting for the panel: the side decides it when one is set
+static bool sideMirror(bool mirror) {
+  return eyeSide == SIDE_NONE ? mirror : eyeSide == SIDE_RIGHT;
+}
 
-  // Calculate center position
-  int centerX = (tft.width() - max_x) / 2;
-  int centerY = (tft.height() - max_y) / 2;
-  
-  // Adjust for centering
-  xpos += centerX;
-  ypos += centerY;
+// Remote frames: the host sends dirty rectangles of big-endian RGB565, raw or compressed, one per
+// datagram. loop() keeps the newest STREAM_PACKETS of them, the player task draws them in order
+#define STREAM_PORT 4212
+#define STREAM_PACKET_SIZE 1472    // largest datagram without IP fragmentation on Ethernet-sized MTUs
+#define STREAM_PACKETS 48          // datagrams waiting for the player; when full the oldest is dropped
+#define STREAM_RECT_PIXELS (DISPLAY_WIDTH * DMA_STRIP_LINES) // a rectangle decodes into one DMA strip
+#define STREAM_IDLE_MS 1000        // the stream gives the screen back after this long without datagrams
+#define STREAM_FRAME_END 1         // StreamHeader flags: the last datagram of a frame
+#define STREAM_KEYFRAME 2          // the frame covers the whole screen
 
-  // Retrieve the pixel data
-  pImg = JpegDec.pImage;
+enum StreamCodec { STREAM_RAW, STREAM_RLE, STREAM_LZ4 };
 
-  // Check if the MCU is out of bounds
-  if ((xpos >= tft.width()) || (ypos >= tft.height())) return;
-  
-  // Push the pixels to the TFT display
-  tft.pushImage(xpos, ypos, mcu_w, mcu_h, pImg);
+// Datagram header, little-endian; tools/eyestream.cpp writes it
+struct __attribute__((packed)) StreamHeader {
+  char magic[2];      // "ES"
+  uint8_t codec;      // StreamCodec of the payload that follows
+  uint8_t flags;      // STREAM_FRAME_END, STREAM_KEYFRAME
+  uint16_t seq;       // per datagram, gaps are lost datagrams
+  uint16_t frame;
+  uint16_t x, y, w, h; // w 0 for a frame without changes
+};
+
+struct StreamPacket {
+  int length;
+  uint8_t data[STREAM_PACKET_SIZE];
+};
+
+struct StreamCounters {
+  uint32_t packets, frames, keyframes;
+  uint32_t lost;     // sequence gaps
+  uint32_t late;     // arrived after a newer datagram, not drawn
+  uint32_t overrun;  // dropped unread because the player fell STREAM_PACKETS behind
+  uint32_t invalid;  // bad header, rectangle or payload
+  uint32_t ignored;  // arrived while another command had taken the screen
+};
+
+static WiFiUDP streamUdp;
+static StreamPacket *streamPool = NULL; // PSRAM when found
+static QueueHandle_t streamFree = NULL, streamReady = NULL;
+static volatile bool streamActive = false;  // CMD_STREAM is queued or running
+static volatile uint32_t streamMutedUntil = 0; // millis() until which datagrams are ignored
+static StreamCounters streamStats;
+static void playStream();
+
+// Audio envelope: the audio node sends 1-byte amplitude samples (0-255, e.g. 50 per second,
+// one or more per datagram) while a clip plays; the procedural eye's pupil and iris follow the
+// latest one. Only the eye box is redrawn, on the tick or at once when the eye was idle
+#define AUDIO_PORT 4213
+#define AUDIO_HOLD_MS 250 // without samples for this long the eye eases back to its own targets
+
+enum AudioMode { AUDIO_OFF, AUDIO_PUPIL, AUDIO_GLOW, AUDIO_BOTH }; // bit 0 pupil, bit 1 glow
+static const char *audioModeNames[] = { "off", "pupil", "glow", "both" };
+static WiFiUDP audioUdp;
+static volatile uint8_t audioMode = AUDIO_PUPIL; // set by /audio
+static volatile uint8_t audioMin = 20, audioMax = 70; // pupil radius in % of the iris at level 0 and 255
+static volatile uint8_t audioLevel = 0;
+static volatile uint32_t audioAt = 0;     // millis() of the latest sample, 0 before the first
+static volatile bool audioWake = false;   // CMD_AUDIO is queued
+
+// Eye drawings go to a full-screen back buffer in PSRAM; presentCanvas() sends the rows
+// that differ from the copy of what the panel shows, so no half-drawn eye is ever visible
+static TFT_eSprite eyeBack = TFT_eSprite(&tft);
+static uint16_t *eyeFront = NULL;  // pixels last presented, NULL if drawing goes to the panel
+static bool eyeFrontValid = false; // false once something else drew on the panel
+static TFT_eSPI *canvas = &tft;    // target of the eye drawings
+
+// Procedural eye: commands set targets, the player task eases towards them every EYE_TICK_MS
+// and redraws only the eye box, so the host streams a few bytes instead of playing GIFs
+struct EyeState {
+  float gazeX, gazeY; // -100..100, iris offset from center
+  float lid;          // 0 open .. 100 closed
+  float dilation;     // pupil radius in % of the iris radius
+  uint16_t irisColor;
+};
+static EyeState eyeNow = { 0, 0, 0, 33, TFT_BLUE };
+static EyeState eyeTarget = eyeNow;
+static bool eyeShown = false;       // the procedural eye owns the screen
+static bool eyeDirty = false;       // eyeNow changed since the last render
+static bool eyeFullPresent = false; // something outside the eye box changed too
+static TFT_eSprite irisTexture = TFT_eSprite(&tft); // 8-bit shading, coloured by irisPalette
+static TFT_eSprite eyeOpenBox = TFT_eSprite(&tft);  // the eye box without lids, lid moves restore rows from it
+static EyeState eyeBoxState;        // eye drawn in eyeOpenBox, its lid is unused
+static bool eyeBoxValid = false;
+static int eyeLidRows = 0;          // lid rows drawn in the back buffer
+static bool eyeBlinking = false;    // lids close, then go back to eyeBlinkLid
+static float eyeBlinkLid = 0;
+
+// Look canvas: a larger eye, drawn once into PSRAM. "look" moves the screen's window over it, so
+// a gaze step sends one window of rows through the DMA strips and draws nothing
+#define LOOK_CANVAS 320 // side of the canvas; a 240 px screen pans 40 px each way
+#define LOOK_SCLERA_RADIUS 112
+#define LOOK_IRIS_RADIUS 64
+static TFT_eSprite lookCanvas = TFT_eSprite(&tft);
+static bool lookShown = false;     // the screen shows a window of the look canvas
+static bool lookDrawn = false;     // lookCanvas holds the eye in lookColor and lookDilation
+static uint16_t lookColor;
+static float lookDilation;
+static float lookX = 0, lookY = 0, lookTargetX = 0, lookTargetY = 0; // -100..100, eased like the gaze
+static int lookSentX = -1, lookSentY = -1; // window on the panel, -1 when it has to be sent
+
+// Sprite atlas: a sheet of eye poses in a grid, decoded once into PSRAM. Each tile's box of the
+// pixels that differ from tile 0 is indexed at load, so showing a tile sends only the union of
+// its box and the shown tile's, straight from the sheet through the DMA strips
+#define ATLAS_MAX_BYTES (2 * 1024 * 1024)
+#define ATLAS_MAX_TILES 64
+struct AtlasTile {
+  int16_t x0, y0, x1, y1; // pixels that differ from tile 0, empty when x0 >= x1
+};
+static uint16_t *atlasSheet = NULL; // big-endian RGB565 like the strips, atlasSheetW pixels per line
+static int atlasSheetW = 0, atlasSheetH = 0, atlasCols = 0, atlasRows = 0, atlasTileW = 0, atlasTileH = 0;
+static AtlasTile atlasTiles[ATLAS_MAX_TILES];
+static bool atlasShown = false;     // the screen shows an atlas tile
+static int atlasSent = -1;          // tile on the panel, -1 when a whole tile has to be sent
+static uint16_t irisPalette[256];
+
+#define SYNC_PORT 4210
+#define SYNC_BEACON_INTERVAL 500 // ms between time beacons from the leader
+#define SYNC_LEAD_TIME 100       // ms from a synced play command to its start, covers delivery to both eyes
+#define SYNC_SAMPLES 8           // beacons kept for the clock offset estimate
+
+// Both eyes start synced animations at the same time on the leader's clock:
+// the leader multicasts "B <millis>" beacons and "P <start> <rate> <path>" play commands
+enum SyncRole { SYNC_OFF, SYNC_LEADER, SYNC_FOLLOWER };
+static const char *syncRoleNames[] = { "off", "leader", "follower" };
+static IPAddress syncGroup(239, 10, 42, 1);
+static WiFiUDP syncUdp;
+static SemaphoreHandle_t syncLock = NULL; // recursive, syncUdp is used by loop() and by /playgif and /sync
+static uint8_t syncRole = SYNC_OFF;
+static volatile long syncOffset = 0; // leader clock minus local millis()
+static long syncSamples[SYNC_SAMPLES];
+static int syncSampleCount = 0, syncSampleIdx = 0;
+static unsigned long lastBeacon = 0;
+
+// Local clock on the leader, the leader's clock as estimated from beacons on followers
+static inline uint32_t syncMillis()
+{
+  return millis() + syncOffset;
 }
 
-// Function to display a JPEG file
-bool displayJPEG(const char *filename) {
-  cancelPlayback = true;
-  
-  // Clear the screen before drawing
-  tft.fillScreen(TFT_BLACK);
-  
-  File jpegFile = SD.open(filename, FILE_READ);
-  if (!jpegFile) {
-    Serial.println("JPEG file not found");
-    
-    // Show error placeholder
-    int centerX = tft.width() / 2;
-    int centerY = tft.height() / 2;
-    
-    tft.setTextColor(TFT_WHITE, TFT_BLACK);
-    tft.setTextDatum(MC_DATUM);
-    tft.setTextSize(1);
-    tft.drawString("Error: Image not found", centerX, centerY - 30);
-    tft.drawString(filename, centerX, centerY);
-    
-    return false;
+// The panel's geometry as constants: its circle is a table the compiler builds, so the
+// strips of a frame are clipped without the viewport checks and square roots of TFT_eSPI
+typedef TFT_eFixedPanel<DISPLAY_WIDTH, DISPLAY_WIDTH> EyePanel;
+
+#ifdef USE_DMA
+// One strip is filled by the decoder while the others are queued for transfer
+static uint16_t dmaStrip[DMA_STRIP_BUFFERS][DISPLAY_WIDTH * DMA_STRIP_LINES];
+static bool dmaStripQueued[DMA_STRIP_BUFFERS]; // cleared when the strip has been sent
+static uint8_t dmaStripIdx = 0;
+static int stripX = 0, stripY = 0, stripW = 0, stripLines = 0;
+static uint16_t *gifStrip = NULL; // strip buffer the decoder cooks lines into, NULL when it doesn't
+static void setGifStrip(bool on);
+#endif
+
+// Memory plan: the player's decoding buffers come from arenas reserved once at boot, sized for the
+// largest canvas the display can show, instead of being allocated and grown as GIFs need them.
+// An arena is a bump allocator: arenaTake() carves the next block, arenaReset() frees all of them
+// at once, so nothing fragments. A GIF whose buffers don't fit its arena is refused up front and
+// takes the same fallback as when the heap ran out. Arenas are only used by the player task
+#define PLAN_CANVAS_PIXELS (DISPLAY_WIDTH * DISPLAY_WIDTH)
+#define PLAN_DECODE_PIXELS (PLAN_CANVAS_PIXELS << (2 * GIF_SCALE_QUARTER)) // Turbo decodes before scaling
+#define ARENA_ALIGN 16
+#define ARENA_FALLBACK_BLOCKS 4
+
+enum ArenaId {
+  ARENA_TABLES, // Turbo LZW tables (and Turbo window), internal RAM for the random lookups
+  ARENA_GIF,    // Turbo buffer, 8-bit frame buffer and dispose buffer, see reserveGifBuffers()
+  ARENA_AHEAD,  // RGB565 back buffer of USE_DECODE_AHEAD
+  ARENA_RAW,    // RGB565 canvas of RAW decoding
+  ARENA_JPEG,   // the player's JPEGDEC instance
+  ARENA_COUNT
+};
+
+struct MemoryArena {
+  const char *name;
+  size_t size;          // bytes reserved at boot
+  uint32_t caps;        // heap_caps of the reservation
+  uint32_t fallbackCaps; // heap blocks taken instead when the reservation failed
+  uint8_t *base;
+  size_t used, highWater;
+  uint32_t misses;      // arenaTake() calls that didn't fit
+  void *fallback[ARENA_FALLBACK_BLOCKS];
+};
+
+static MemoryArena memoryPlan[ARENA_COUNT] = {
+  { "tables", GIF_TURBO_TABLE_BYTES + ARENA_ALIGN
+#ifdef USE_TURBO_WINDOW
+                  + GIF_TURBO_WINDOW_BYTES(DISPLAY_WIDTH, 24) + ARENA_ALIGN
+#endif
+    , MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT },
+  { "gif", TURBO_BUFFER_SIZE + PLAN_DECODE_PIXELS + PLAN_CANVAS_PIXELS + 2 * MAX_WIDTH + PLAN_CANVAS_PIXELS + 3 * ARENA_ALIGN,
+    MALLOC_CAP_SPIRAM, MALLOC_CAP_SPIRAM },
+  { "ahead", PLAN_CANVAS_PIXELS * sizeof(uint16_t), MALLOC_CAP_SPIRAM, MALLOC_CAP_SPIRAM },
+  { "raw", PLAN_CANVAS_PIXELS * sizeof(uint16_t), MALLOC_CAP_SPIRAM, MALLOC_CAP_8BIT },
+#ifdef USE_JPEGDEC
+  { "jpeg", sizeof(JPEGDEC), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT, MALLOC_CAP_8BIT },
+#else
+  { "jpeg", 0, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT, MALLOC_CAP_8BIT },
+#endif
+};
+
+// Reserve the arenas, internal RAM ones first while it is in one piece; without USE_MEMORY_PLAN,
+// or if a reservation fails, that arena hands out heap blocks instead
+static void reserveMemoryPlan() {
+#ifdef USE_MEMORY_PLAN
+  for (MemoryArena &a : memoryPlan) {
+    if (!a.size || (a.caps & MALLOC_CAP_SPIRAM))
+      continue;
+    a.base = (uint8_t *)heap_caps_aligned_alloc(ARENA_ALIGN, a.size, a.caps);
   }
-  
-  // Start JPEG decoding
-  bool decoded = JpegDec.decodeSdFile(jpegFile);
-  if (decoded) {
-    Serial.println("JPEG image decoded successfully");
-    
-    // Retrieve information about the image
-    uint32_t max_x = JpegDec.width;
-    uint32_t max_y = JpegDec.height;
-    Serial.printf("JPEG image specs: (%d x %d)\n", max_x, max_y);
-    
-    // Start rendering blocks (Minimum Coded Units)
-    uint32_t mcu_count = 0;
-    while (JpegDec.read()) {
-      mcu_count++;
-      
-      // Get MCU coordinates
-      int x = JpegDec.MCUx;
-      int y = JpegDec.MCUy;
-      
-      // Render the current MCU block
-      jpegRender(x, y);
-      
-      // Handle other tasks during rendering
-      if (mcu_count % 20 == 0) {
-        server.handleClient();
-        yield();
+  for (MemoryArena &a : memoryPlan) {
+    if (a.size && (a.caps & MALLOC_CAP_SPIRAM) && psramFound())
+      a.base = (uint8_t *)heap_caps_aligned_alloc(ARENA_ALIGN, a.size, a.caps);
+  }
+  for (const MemoryArena &a : memoryPlan) {
+    if (a.size && !a.base)
+      Serial.printf("Memory plan: no room for the %s arena (%u bytes), it uses the heap\n", a.name, (unsigned)a.size);
+  }
+#endif
+}
+
+// Next block of bytes from arena a, NULL if it doesn't fit (or the heap has no room)
+static void *arenaTake(ArenaId id, size_t bytes) {
+  MemoryArena &a = memoryPlan[id];
+  if (!a.base) {
+    for (void *&block : a.fallback) {
+      if (!block) {
+        block = heap_caps_malloc(bytes, a.fallbackCaps);
+        if (!block)
+          a.misses++;
+        return block;
       }
     }
-    
-    jpegFile.close();
-    return true;
-  } else {
-    Serial.println("JPEG decode error");
-    jpegFile.close();
-    
-    // Show error placeholder
-    int centerX = tft.width() / 2;
-    int centerY = tft.height() / 2;
-    
-    tft.setTextColor(TFT_WHITE, TFT_BLACK);
-    tft.setTextDatum(MC_DATUM);
-    tft.setTextSize(1);
-    tft.drawString("Error decoding JPEG", centerX, centerY - 30);
-    tft.drawString(filename, centerX, centerY);
-    
-    return false;
+    a.misses++;
+    return NULL;
+  }
+  size_t start = (a.used + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  if (start + bytes > a.size) {
+    a.misses++;
+    return NULL;
   }
+  a.used = start + bytes;
+  a.highWater = std::max(a.highWater, a.used);
+  return a.base + start;
 }
 
-// Function to determine image type and display accordingly
-bool displayImage(const char *filename) {
-  String fname = String(filename);
-  fname.toLowerCase();
-  
-  if (fname.endsWith(".jpg") || fname.endsWith(".jpeg")) {
-    return displayJPEG(filename);
-  } else if (fname.endsWith(".gif")) {
-    int playTime = gifPlay((char*)filename);
+// Give back every block taken from arena a
+static void arenaReset(ArenaId id) {
+  MemoryArena &a = memoryPlan[id];
+  a.used = 0;
+  for (void *&block : a.fallback) {
+    free(block);
+    block = NULL;
+  }
+}
+
+// Turbo/frame buffers live in PSRAM and are reused across GIFs; taken from ARENA_GIF
+static uint8_t *turboBuf = NULL;
+static uint8_t *frameBuf = NULL;
+static uint8_t *disposeBuf = NULL; // canvas under a "restore to previous" frame, see setDisposeBuffer()
+static int gifBufPixels = 0; // canvas pixels the buffers were sized for
+static int gifTurboPixels = 0; // decoded frame pixels the Turbo buffer was sized for
+static uint8_t *turboTables = NULL; // Turbo LZW tables in internal RAM, NULL leaves them in turboBuf (PSRAM)
+#ifdef USE_TURBO_WINDOW
+// Turbo LZW tables and the last lines decoded, in place of turboBuf; wider frames get fewer lines
+#define TURBO_WINDOW_LINES 24
+#define TURBO_WINDOW_BYTES GIF_TURBO_WINDOW_BYTES(DISPLAY_WIDTH, TURBO_WINDOW_LINES)
+static uint8_t *turboWindow = NULL;
+
+// Taken once from ARENA_TABLES, NULL when it can't be had
+static uint8_t *reserveTurboWindow()
+{
+  if (!turboWindow)
+    turboWindow = (uint8_t *)arenaTake(ARENA_TABLES, TURBO_WINDOW_BYTES);
+  return turboWindow;
+}
+#endif
+static bool gifCooked = false; // GIFDraw receives RGB565 lines instead of 8-bit palette indices
+// RGB565 copy of the canvas for RAW decoding, so transparent lines can be sent whole
+static uint16_t *rawCanvas = NULL;
+static int rawCanvasW = 0, rawCanvasH = 0;
+static const char *playbackMode = "raw"; // reported by /playgif
+#ifdef USE_FRAME_RING
+static bool decodingRing = false; // the decoder task is playing the GIF into the frame ring
+#endif
+// Frames of the open GIF, indexed as they are played, so a late frame can be skipped when the next one covers it
+#define GIF_INDEX_FRAMES 128
+static GIFFRAME gifFrameIndex[GIF_INDEX_FRAMES];
+
+// Make sure the shared buffers can hold a w x h canvas; false means fall back to the RAW path
+// A scaled canvas (see setGifScale()) still decodes each frame at its original size
+static bool reserveGifBuffers(int w, int h, int scale = GIF_SCALE_FULL)
+{
+  int pixels = w * h;
+  int decodePixels = pixels << (2 * scale);
+#ifdef USE_TURBO_WINDOW
+  if (reserveTurboWindow())
+    decodePixels = 0; // no frame sized Turbo buffer needed
+#endif
+  if ((turboBuf || !decodePixels) && frameBuf && pixels <= gifBufPixels && decodePixels <= gifTurboPixels)
     return true;
-  } else {
-    // For unsupported formats
-    tft.fillScreen(TFT_BLACK);
-    int centerX = tft.width() / 2;
-    int centerY = tft.height() / 2;
-    
-    tft.setTextColor(TFT_WHITE, TFT_BLACK);
-    tft.setTextDatum(MC_DATUM);
-    tft.setTextSize(1);
-    tft.drawString("Unsupported format", centerX, centerY - 30);
-    tft.drawString(filename, centerX, centerY);
+  if (!psramFound())
+    return false;
+  arenaReset(ARENA_GIF);
+  turboBuf = frameBuf = disposeBuf = NULL;
+  gifBufPixels = gifTurboPixels = 0;
+  if (decodePixels) {
+    // the tables are read at random for every LZW code, PSRAM cache misses there cost the most
+    if (!turboTables)
+      turboTables = (uint8_t *)arenaTake(ARENA_TABLES, GIF_TURBO_TABLE_BYTES);
+    turboBuf = (uint8_t *)arenaTake(ARENA_GIF, TURBO_BUFFER_SIZE + decodePixels);
+  }
+  // 8-bit canvas plus one cooked RGB565 line (the decoder writes it past the end of the canvas)
+  frameBuf = (uint8_t *)arenaTake(ARENA_GIF, pixels + 2 * MAX_WIDTH);
+  disposeBuf = (uint8_t *)arenaTake(ARENA_GIF, pixels); // optional, frames to restore are kept otherwise
+  if ((decodePixels && !turboBuf) || !frameBuf) {
+    Serial.printf("A %dx%d turbo canvas doesn't fit the gif arena, using RAW mode\n", w, h);
+    arenaReset(ARENA_GIF);
+    turboBuf = frameBuf = disposeBuf = NULL;
     return false;
   }
+  gifBufPixels = pixels;
+  gifTurboPixels = decodePixels;
+  return true;
 }
 
-int getGifInventory( const char* basePath )
+// Decode `gif` at the smallest scale (full, 1/2 or 1/4) that fits the display, instead of cropping it
+static int setGifScale()
 {
-  int amount = 0;
-  GifRootFolder = SD.open(basePath);
-  if(!GifRootFolder){
-    // log_n("Failed to open directory");
-    return 0;
-  }
+  gif.setScale(GIF_SCALE_FULL); // a rewound decoder keeps the scale of its last play
+  int scale = GIF_SCALE_FULL;
+  while (scale < GIF_SCALE_QUARTER && (gif.getCanvasWidth() > DISPLAY_WIDTH || gif.getCanvasHeight() > DISPLAY_WIDTH))
+    gif.setScale(++scale);
+  return scale;
+}
 
-  if(!GifRootFolder.isDirectory()){
-    // log_n("Not a directory");
-    return 0;
-  }
+#define FRAME_CACHE_BUDGET (2 * 1024 * 1024) // default PSRAM bytes for decoded frames, see /cache
 
-  File file = GifRootFolder.openNextFile();
+// Decoded RGB565 frames of recently played GIFs, replayed without SD reads or LZW decoding
+struct CachedFrame {
+  int16_t x, y;     // frame rectangle on the canvas
+  uint16_t w, h;
+  uint16_t delayMs;
+  uint16_t *pixels; // w * h big-endian RGB565 pixels in PSRAM, NULL if the frame drew nothing
+};
 
-  tft.setTextColor( TFT_WHITE, TFT_BLACK );
-  tft.setTextSize( 2 );
+struct CachedGif {
+  std::string name;
+  int canvasW, canvasH;
+  std::vector<CachedFrame> frames;
+  size_t bytes;
+  unsigned long lastUsed; // millis() of the last replay, for LRU eviction
+};
 
-  int textPosX = tft.width()/2 - 16;
-  int textPosY = tft.height()/2 - 10;
+static std::vector<CachedGif *> frameCache; // complete entries only
+static CachedGif *capture = NULL; // entry being recorded while a GIF is decoded
+static bool captureNewFrame = false;
+static size_t frameCacheBudget = FRAME_CACHE_BUDGET;
+static size_t frameCacheBytes = 0;
 
-  tft.drawString("GIF Files:", textPosX-40, textPosY-20 );
+#define FIRST_FRAME_BUDGET (512 * 1024) // PSRAM bytes for first frames, see showFirstFrame()
 
-  while( file ) {
-    if(!file.isDirectory()) {
-      String fname = file.name();
-      if (fname.charAt(0) != '.') {
-        GifFiles.push_back(std::string(fname.c_str()));
-        amount++;
-        tft.drawString(String(amount), textPosX, textPosY );
-      }
-      file.close();
-    }
-    file = GifRootFolder.openNextFile();
-  }
-  GifRootFolder.close();
-  // log_n("Found %d GIF files", amount);
-  return amount;
-}
+// First frame of each GIF played before, as (count, colour) runs of big-endian RGB565 in raster
+// order across the canvas, so a GIF asked for again is on screen before its file is even opened
+struct FirstFrame {
+  std::string name;
+  uint16_t w, h;  // canvas as played
+  uint16_t *runs; // PSRAM
+  size_t bytes;
+};
+static std::vector<FirstFrame> firstFrames; // oldest first; changed by the player under cacheLock
+static size_t firstFrameBytes = 0;
 
-String getGifInventoryApi(const char* basePath) {
-  String json = "[";
-  File root = SD.open(basePath);
-  if(!root || !root.isDirectory()){
-    return json + "]";
-  }
-  File file = root.openNextFile();
-  bool first = true;
-  while(file) {
-    if(!file.isDirectory()){
-      String fname = file.name();
-      if(fname.charAt(0) != '.'){
-        if(!first) {
-          json += ",";
-        }
-        json += "\"" + fname + "\"";
-        first = false;
-      }
-    }
-    file = root.openNextFile();
-  }
-  root.close();
-  json += "]";
-  return json;
-}
+#define GIF_RAM_THRESHOLD (256 * 1024) // GIFs up to this size are loaded into PSRAM once, see /cache
 
-void handleFileUpload() {
-  HTTPUpload& upload = server.upload();
-  const unsigned long MAX_SIZE = 10485760; // 10 MB in bytes
+// Whole GIF files pinned in PSRAM by name and played with the memory reader
+struct GifBlob {
+  std::string name;
+  uint8_t *data;
+  int32_t size;
+  bool flash;       // built into the firmware, read with openFLASH()
+  bool hinted;      // read by /prefetch and not played since, evicted within prefetchBudget
+  unsigned long lastUsed; // millis() of the last hint, for LRU eviction
+};
 
-  if(upload.status == UPLOAD_FILE_START) {
-    if(upload.totalSize > MAX_SIZE) {
-      uploadTooLarge = true;
-      Serial.println("Upload refused: file too large");
-      return;
-    }
-    String fullPath = "/gif/" + String(upload.filename);
-    if(SD.exists(fullPath.c_str())) {
-      SD.remove(fullPath.c_str());
-    }
-    uploadFile = SD.open(fullPath.c_str(), FILE_WRITE);
-  } else if(upload.status == UPLOAD_FILE_WRITE) {
-    if(uploadTooLarge)
-      return;
-    if(uploadFile)
-      uploadFile.write(upload.buf, upload.currentSize);
-  } else if(upload.status == UPLOAD_FILE_END) {
-    if(uploadTooLarge)
-      return;
-    if(uploadFile)
-      uploadFile.close();
-  }
-}
+static std::vector<GifBlob> gifBlobs;
+static int32_t gifRamThreshold = GIF_RAM_THRESHOLD;
 
-void setup() {
-  tft.begin();
-  prefs.begin("display", false);
-  int rotation = prefs.getInt("rotation", 0);  // 0-3 for quarter turns
-  tft.setRotation(rotation);
-  
-  tft.fillScreen(TFT_BLACK);
-  tft.setTextSize(2);
-  tft.setTextDatum(MC_DATUM); // center text
-  // Show initial statuses:
-  tft.setTextColor(TFT_WHITE, TFT_BLACK);
-  // Center all status info vertically
-  int centerY = tft.height()/2;
-  tft.drawString("SD: waiting", tft.width()/2, centerY - 40);
-  tft.drawString("WiFi: waiting", tft.width()/2, centerY - 20);
+#ifdef USE_PREFETCH
+#define PREFETCH_BUDGET  (1024 * 1024) // default PSRAM bytes for hinted GIFs and frame indexes, see /prefetch
+#define PREFETCH_HINTS   8             // names of one hint that are read ahead
+#define PREFETCH_IDLE_MS 100           // the player reads ahead only with this long to its next tick
 
-  Serial.begin(115200);
-  
-  pinMode(D2, OUTPUT);
-  
-  // Update SD status to "initializing" (yellow)
-  tft.fillScreen(TFT_BLACK); // Clear entire screen
-  tft.setTextColor(TFT_YELLOW, TFT_BLACK);
-  tft.drawString("SD: initializing", tft.width()/2, centerY - 30);
-  
-  if (!SD.begin(D2)) {
-    tft.fillScreen(TFT_BLACK);
-    tft.setTextColor(TFT_RED, TFT_BLACK);
-    tft.drawString("SD: failed", tft.width()/2, centerY - 30);
-    Serial.println("SD initialization failed!");
-    delay(1000);
-    setup();
-  } else {
-    tft.fillScreen(TFT_BLACK);
-    tft.setTextColor(TFT_GREEN, TFT_BLACK);
-    tft.drawString("SD: initialized", tft.width()/2, centerY - 30);
-    Serial.println("SD initialized.");
-  }
+// Frame index of a GIF read by /prefetch, handed to the decoder when the GIF is opened, so
+// frame skipping and seeking work from its first play
+struct PrefetchedIndex {
+  std::string name;
+  GIFFRAME *frames; // PSRAM
+  int count;
+  bool played;
+  unsigned long lastUsed;
+};
 
-  Serial.println("DEBUG: SD card initialized successfully.");
+struct PrefetchHint {
+  std::string path; // "/gif/<name>"
+  uint32_t size;    // from the catalog
+};
+
+static std::vector<PrefetchedIndex> prefetchedIndexes; // changed by the player under cacheLock
+static std::vector<PrefetchHint> prefetchHints; // not read yet, the first is next; under cacheLock
+static size_t prefetchBudget = PREFETCH_BUDGET;
+static uint32_t prefetchReads = 0, prefetchHits = 0, prefetchEvictions = 0;
+#endif
+
+// GIFs compiled into the firmware by embed_gifs.py (`make builtin_gifs.h`, from builtin/*.gif),
+// so the eyes keep playing their core animations without SD reads, or without a card at all.
+// A built-in GIF shadows a file of the same name in /gif
+struct BuiltinGif {
+  const char *path; // "/gif/<name>"
+  const uint8_t *data;
+  int32_t size;
+  bool progmem;     // compiled in and read with openFLASH(), the media partition is read as memory
+};
+#if __has_include("builtin_gifs.h")
+#include "builtin_gifs.h"
+#else
+static const BuiltinGif builtinGifs[] = { { NULL, NULL, 0 } };
+#endif
+
+// The control page served at /, gzip-compressed into the firmware by embed_web.py (`make web_ui.h`,
+// from web/index.html). It is sent as stored and fetches the catalog from /gifs and /manifest
+#if __has_include("web_ui.h")
+#include "web_ui.h"
+#define HAVE_WEB_UI
+#endif
+#define WEB_UI_MAX_AGE 86400 // s the browser keeps the page before it asks again with the ETag
+
+// Larger sets go into the "media" data partition (partitions.csv) as a media pack made by
+// pack_media.py and written with `make flash-media`. The partition is mapped into the address
+// space once at boot, and its GIFs are decoded from the mapped flash like the PSRAM blobs, so
+// playback has no file system, no SD bus and no copy into a read buffer
+#define MEDIA_PARTITION "media"
+
+struct MediaPackHeader {
+  char magic[4];    // "EPAK"
+  uint16_t version; // 1
+  uint16_t count;   // entries following the header
+};
+
+struct MediaPackEntry {
+  char name[56];    // file name, NUL terminated
+  uint32_t offset;  // from the start of the pack
+  uint32_t size;
+};
+
+static std::vector<BuiltinGif> flashGifs;         // builtinGifs and the media partition, fixed before the player starts
+static std::vector<std::string> mediaPackPaths;  // path storage of the partition entries
+
+// The same pack format on the card is the asset pack: GIFs, JPEGs, their _preview thumbnails
+// and native copies (".native/<gif>.565") in one file, built by `pack_media.py --assets` and
+// uploaded in resumable ranges by `sync_images.py --pack`, see /pack. The player opens it once
+// and reads everything in it by offset, so a play costs no directory lookup. Packed files
+// shadow loose ones on the card; the flash store and the built-in GIFs shadow the pack
+#define ASSET_PACK_PATH "/gif/.pack"
+#define ASSET_PACK_TEMP_PATH "/gif/.pack.tmp" // received ranges, swapped in once complete
+
+struct PackedAsset {
+  std::string name; // path inside /gif
+  uint32_t offset;
+  uint32_t size;
+};
+
+static std::vector<PackedAsset> packAssets; // table of the installed pack, guarded by cacheLock
+static File packFile;                       // the player's handle on it, see openAssetPack()
+static volatile bool assetPackInstalled = false; // set by the player, the web task rebuilds the catalog
+
+#define NATIVE_DIR "/gif/.native"              // pre-rendered copies of GIFs, see transcodeGif()
+#define NATIVE_TEMP_PATH NATIVE_DIR "/.tmp"
+#define NATIVE_MAX_BYTES (16 * 1024 * 1024)    // give up on GIFs that would need more SD space
+
+// Native container: a header, then per frame a NativeFrame and w * h big-endian RGB565 pixels
+struct NativeHeader {
+  char magic[4];    // "E565"
+  uint16_t width, height;
+  uint16_t frames;
+  uint16_t reserved;
+};
+
+struct NativeFrame {
+  int16_t x, y;     // changed rectangle on the canvas, w or h 0 if nothing changed
+  uint16_t w, h;
+  uint16_t delayMs;
+  uint16_t reserved;
+};
+
+static bool autoTranscode = false; // convert GIFs after upload, see /transcode
+
+// "/gif/eyes.gif" -> "/gif/.native/eyes.gif.565"
+static std::string nativePathFor(const char *path)
+{
+  const char *base = strrchr(path, '/');
+  return std::string(NATIVE_DIR "/") + (base ? base + 1 : path) + ".565";
+}
+
+#define MAX_FRAME_LAG 100 // ms behind schedule after which the clock is re-anchored instead of catching up
+
+// Absolute presentation times, so decode and SPI time don't add to the frame delays
+struct FrameClock {
+  uint32_t start;      // syncMillis() when playback started
+  float due;           // ms after start when the next frame is due
+  float rate;          // 1.0 plays the authored durations, 2.0 twice as fast
+  uint32_t shownAt;    // syncMillis() when the current frame went on screen, for /stats
+  long behind;         // ms the next frame is already overdue, 0 if on time
+};
+
+// Event trace (/trace): 16-byte events in a PSRAM ring, recorded from every task at frame start
+// and end, GIF decode, DMA submit and completion, SD reads and HTTP requests, so SD/SPI contention
+// shows up on a timeline. Recording is a few stores under a spinlock, cheap enough to leave on;
+// trace_to_json.py turns a dump into Chrome trace JSON for Perfetto or chrome://tracing
+#define TRACE_EVENTS 8192 // 128 KB, a few seconds of playback
+#define TRACE_NAMES 32    // distinct HTTP paths a dump can name, later ones share the last slot
+#define TRACE_NAME_LEN 24
+#define TRACE_VERSION 1
+
+enum TraceId : uint8_t { TRACE_FRAME = 1, TRACE_DECODE, TRACE_DMA_SUBMIT, TRACE_DMA_DONE, TRACE_SD_READ, TRACE_HTTP };
+
+struct TraceEvent {
+  uint32_t us;    // micros() at the start
+  uint32_t durUs; // 0 for an instant
+  uint32_t arg;   // frame number, bytes, name index
+  uint8_t id;     // TraceId
+  uint8_t core;
+  uint16_t arg2;  // DMA strip buffer, HTTP method, playFrame() result
+};
+static_assert(sizeof(TraceEvent) == 16, "/trace dumps the events as they are");
+
+// Head of a /trace dump, followed by the names and the events, oldest first
+struct TraceDumpHeader {
+  char magic[4];  // "ETRC"
+  uint16_t version;
+  uint16_t names; // of TRACE_NAME_LEN bytes each
+  uint32_t events;
+  uint32_t lost;  // overwritten since the last clear
+  uint32_t nowUs; // micros() when the dump was taken
+};
+
+static TraceEvent *traceBuf = NULL;
+static uint32_t traceHead = 0;          // events recorded since the last clear, the ring keeps the newest
+static volatile bool traceOn = false;
+static portMUX_TYPE traceMux = portMUX_INITIALIZER_UNLOCKED;
+static char traceNames[TRACE_NAMES][TRACE_NAME_LEN]; // only the web task touches these
+static int traceNameCount = 0;
+static uint32_t traceFrames = 0;        // arg of TRACE_FRAME
+
+static void HOT_IRAM traceRecord(uint8_t id, uint32_t startUs, uint32_t durUs, uint32_t arg, uint16_t arg2)
+{
+  if (!traceOn)
+    return;
+  portENTER_CRITICAL(&traceMux);
+  TraceEvent &e = traceBuf[traceHead++ % TRACE_EVENTS];
+  portEXIT_CRITICAL(&traceMux);
+  e = { startUs, durUs, arg, id, (uint8_t)xPortGetCoreID(), arg2 };
+}
+
+// Something that ran from startUs until now
+static void traceSpan(uint8_t id, uint32_t startUs, uint32_t arg, uint16_t arg2)
+{
+  if (traceOn)
+    traceRecord(id, startUs, micros() - startUs, arg, arg2);
+}
+
+static void HOT_IRAM traceInstant(uint8_t id, uint32_t arg, uint16_t arg2)
+{
+  if (traceOn)
+    traceRecord(id, micros(), 0, arg, arg2);
+}
+
+// gif.playFrame() on the trace, the draw callbacks' transfers nest inside it
+static int decodeGifFrame(int *frameDelay)
+{
+  uint32_t t0 = micros();
+  int rc = gif.playFrame(false, frameDelay);
+  traceSpan(TRACE_DECODE, t0, traceFrames, (uint16_t)rc);
+  return rc;
+}
+
+// Index of an HTTP path in the dump's name table
+static uint16_t traceName(const String &path)
+{
+  for (int i = 0; i < traceNameCount; i++)
+    if (strncmp(traceNames[i], path.c_str(), TRACE_NAME_LEN - 1) == 0)
+      return i;
+  if (traceNameCount == TRACE_NAMES)
+    return TRACE_NAMES - 1;
+  strlcpy(traceNames[traceNameCount], traceNameCount == TRACE_NAMES - 1 ? "(other)" : path.c_str(), TRACE_NAME_LEN);
+  return traceNameCount++;
+}
+
+#ifdef USE_PROFILER
+#include <esp_freertos_hooks.h>
+#if __has_include(<xtensa_context.h>)
+#include <xtensa_context.h>
+#else
+#include <freertos/xtensa_context.h>
+#endif
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+#include <esp_private/cache_utils.h>
+#else
+#include <esp_spi_flash.h>
+#endif
+
+// Sampling profiler (/profile): while it runs, the FreeRTOS tick interrupt of each core records
+// the PC the running task was interrupted at and the return address in its a0, read from the
+// exception frame the interrupt entry saved on the task's stack. At the tick rate that shows
+// where each core spends its time, in DecodeLZW, pushPixels or the WiFi stack; an interrupt the
+// tick preempted counts as the task under it. The samples fill the PSRAM buffer once, so a
+// profile covers one stretch of time; profile_to_flame.py symbolises a dump against the ELF
+#define PROFILE_SAMPLES 32768 // 384 KB, 16 s of both cores at 1 kHz
+#define PROFILE_TASKS 24      // distinct tasks a dump can name, later ones share the last slot
+#define PROFILE_TASK_LEN 16
+#define PROFILE_MAX_MS 600000
+#define PROFILE_VERSION 1
+
+struct ProfileSample {
+  uint32_t pc;     // where the task was interrupted
+  uint32_t caller; // return address in a0 with its window bits cleared, 0 if unknown
+  uint16_t task;   // index of the task's name
+  uint8_t core;
+  uint8_t reserved;
+};
+static_assert(sizeof(ProfileSample) == 12, "/profile dumps the samples as they are");
+
+// Head of a /profile dump, followed by the task names and the samples in the order taken
+struct ProfileDumpHeader {
+  char magic[4];    // "EPRF"
+  uint16_t version;
+  uint16_t tasks;   // names of PROFILE_TASK_LEN bytes each
+  uint32_t samples;
+  uint32_t dropped; // ticks while the buffer was full or the flash cache off (flash writes)
+  uint32_t hz;      // ticks per second on each core
+  uint32_t ms;      // time sampled
+};
+
+static ProfileSample *profileBuf = NULL;
+static volatile bool profileOn = false;
+static bool profileHooked = false;
+static uint32_t profileCount = 0, profileDropped = 0;
+static uint32_t profileStartMs = 0, profileMs = 0;   // requested duration, 0 = until stopped
+static TickType_t profileEndTick = 0;
+static TaskHandle_t profileTasks[PROFILE_TASKS];
+static char profileTaskNames[PROFILE_TASK_LEN * PROFILE_TASKS];
+static int profileTaskCount = 0;
+static portMUX_TYPE profileMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Tick hook of both cores. In IRAM: it also runs while a flash write has the cache off, and
+// then returns before touching PSRAM or code in flash
+static void IRAM_ATTR profileTick()
+{
+  if (!profileOn)
+    return;
+  bool cache = spi_flash_cache_enabled();
+  portENTER_CRITICAL_ISR(&profileMux);
+  if (profileMs && xTaskGetTickCountFromISR() - profileEndTick < portMAX_DELAY / 2) {
+    profileOn = false; // the time is up
+  } else if (!cache || profileCount == PROFILE_SAMPLES) {
+    profileDropped++;
+  } else {
+    // pxTopOfStack, the first member of the TCB, points at the frame the interrupt entry saved
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    const XtExcFrame *frame = *(const XtExcFrame *const *)task;
+    int t = 0;
+    while (t < profileTaskCount && profileTasks[t] != task)
+      t++;
+    if (t == profileTaskCount && t < PROFILE_TASKS) {
+      profileTasks[t] = task;
+      strlcpy(profileTaskNames + t * PROFILE_TASK_LEN, t == PROFILE_TASKS - 1 ? "(other)" : pcTaskGetName(task),
+              PROFILE_TASK_LEN);
+      profileTaskCount++;
+    }
+    uint32_t a0 = frame->a0;
+    profileBuf[profileCount++] = { (uint32_t)frame->pc, a0 ? (a0 & 0x3FFFFFFF) | 0x40000000 : 0,
+                                   (uint16_t)std::min(t, PROFILE_TASKS - 1), (uint8_t)xPortGetCoreID(), 0 };
+  }
+  portEXIT_CRITICAL_ISR(&profileMux);
+}
+#endif
+
+// Heap monitor (/stats "heap"): the web task samples free memory and the largest free block per
+// capability and keeps their low-water marks, and notes how many heap blocks and bytes each HTTP
+// route leaves allocated. Leaks and fragmentation then show up in a soak run (soak_test.py)
+// instead of as a failed allocation after days of uptime
+#define HEAP_SAMPLE_MS 250
+#define HEAP_ROUTES 24     // distinct routes counted, later ones share the last slot
+#define HEAP_ROUTE_LEN 24
+
+enum HeapKind { HEAP_INTERNAL, HEAP_PSRAM, HEAP_DMA, HEAP_KINDS };
+static const char *heapKindNames[] = { "internal", "psram", "dma" };
+static const uint32_t heapKindCaps[] = { MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT, MALLOC_CAP_SPIRAM, MALLOC_CAP_DMA };
+
+struct HeapRoute {
+  char path[HEAP_ROUTE_LEN];
+  uint32_t requests;
+  uint32_t grew;     // requests after which more blocks were allocated than before
+  int32_t netBlocks; // left allocated by all of them; other tasks' changes meanwhile count too
+  int32_t netBytes;
+};
+
+// All of these belong to the web task, except the failure counters
+static bool heapMonitorOn = false;
+static uint32_t heapMinFree[HEAP_KINDS], heapMinLargest[HEAP_KINDS]; // since boot or ?reset
+static uint32_t heapSampledAt = 0;
+static HeapRoute heapRoutes[HEAP_ROUTES];
+static int heapRouteCount = 0;
+static int heapRequestRoute = -1; // route of the request being handled
+static multi_heap_info_t heapBefore;
+static volatile uint32_t allocFailures = 0, allocFailedSize = 0, allocFailedCaps = 0;
+
+// Registered with heap_caps_register_failed_alloc_callback(), runs in the failing task
+static void heapAllocFailed(size_t size, uint32_t caps, const char *function)
+{
+  allocFailures++;
+  allocFailedSize = size;
+  allocFailedCaps = caps;
+}
+
+static void resetHeapMonitor()
+{
+  for (int k = 0; k < HEAP_KINDS; k++)
+    heapMinFree[k] = heapMinLargest[k] = UINT32_MAX;
+  heapRouteCount = 0;
+  heapRequestRoute = -1;
+  allocFailures = 0;
+  heapSampledAt = 0;
+}
+
+static void sampleHeap()
+{
+  for (int k = 0; k < HEAP_KINDS; k++) {
+    heapMinFree[k] = std::min<uint32_t>(heapMinFree[k], heap_caps_get_free_size(heapKindCaps[k]));
+    heapMinLargest[k] = std::min<uint32_t>(heapMinLargest[k], heap_caps_get_largest_free_block(heapKindCaps[k]));
+  }
+  heapSampledAt = millis();
+}
+
+// Web task, every pass: low-water marks between requests
+static void pollHeapMonitor()
+{
+  if (heapMonitorOn && millis() - heapSampledAt >= HEAP_SAMPLE_MS)
+    sampleHeap();
+}
+
+// Route of a request path: the first segment, so /gif/<name> and /asset/<name> count as one
+static int heapRoute(const String &uri)
+{
+  int end = uri.indexOf('/', 1);
+  String path = end > 0 ? uri.substring(0, end + 1) + "*" : uri;
+  path.replace("\"", "_"); // goes into JSON as it is
+  path.replace("\\", "_");
+  for (int i = 0; i < heapRouteCount; i++)
+    if (strncmp(heapRoutes[i].path, path.c_str(), HEAP_ROUTE_LEN - 1) == 0)
+      return i;
+  if (heapRouteCount == HEAP_ROUTES)
+    return HEAP_ROUTES - 1;
+  HeapRoute &r = heapRoutes[heapRouteCount];
+  memset(&r, 0, sizeof(r));
+  strlcpy(r.path, heapRouteCount == HEAP_ROUTES - 1 ? "(other)" : path.c_str(), HEAP_ROUTE_LEN);
+  return heapRouteCount++;
+}
+
+// A request was parsed; heap_caps_get_info() walks the heap, a few hundred µs per request
+static void heapRequestStarted(const String &uri)
+{
+  if (!heapMonitorOn)
+    return;
+  heapRequestRoute = heapRoute(uri);
+  heap_caps_get_info(&heapBefore, MALLOC_CAP_8BIT);
+}
+
+static void heapRequestDone()
+{
+  if (heapRequestRoute < 0)
+    return;
+  multi_heap_info_t after;
+  heap_caps_get_info(&after, MALLOC_CAP_8BIT);
+  HeapRoute &r = heapRoutes[heapRequestRoute];
+  int32_t blocks = (int32_t)after.allocated_blocks - (int32_t)heapBefore.allocated_blocks;
+  r.requests++;
+  r.grew += blocks > 0;
+  r.netBlocks += blocks;
+  r.netBytes += (int32_t)after.total_allocated_bytes - (int32_t)heapBefore.total_allocated_bytes;
+  heapRequestRoute = -1;
+  sampleHeap(); // a handler's peak is gone by now, but what it fragmented is not
+}
+
+// Backlight (/backlight): TFT_BL is driven by an LEDC channel, and level changes are hardware
+// fades (ledc_set_fade_with_time()) that run without the CPU, so dimming or "sleeping" the eye
+// costs no SPI frames. Levels are percent, mapped to duty on a square curve so steps look even
+#define BACKLIGHT_CHANNEL LEDC_CHANNEL_7 // out of the way of the channels Arduino hands out from 0
+#define BACKLIGHT_TIMER LEDC_TIMER_3
+#define BACKLIGHT_FREQ 20000             // Hz, above hearing and camera flicker
+#define BACKLIGHT_BITS LEDC_TIMER_10_BIT
+#define BACKLIGHT_MAX_DUTY ((1 << 10) - 1)
+#define BACKLIGHT_IDLE_LEVEL 30          // percent while the idle governor has stepped down
+#define BACKLIGHT_DIM_MS 1500            // fade into the idle level
+#define BACKLIGHT_WAKE_MS 150            // and back out of it
+#define BACKLIGHT_MAX_FADE_MS 10000
+
+static bool backlightReady = false;
+static volatile uint8_t backlightLevel = 100;      // what /backlight set, persisted
+static volatile uint8_t backlightIdleLevel = BACKLIGHT_IDLE_LEVEL;
+static volatile uint8_t backlightTarget = 100;     // where the running or last fade goes
+static volatile uint8_t backlightScale = 100;      // percent of every level, from the quality profile
+static SemaphoreHandle_t backlightLock = NULL;
+#if CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t backlightSleepLock = NULL; // LEDC stops in light sleep, so a dimmed level keeps the chip awake
+static bool backlightSleepHeld = false;
+#endif
+
+static uint32_t backlightDuty(uint8_t level) {
+  return (uint32_t)level * level * BACKLIGHT_MAX_DUTY / (100 * 100);
+}
+
+static void initBacklight() {
+#ifdef TFT_BL
+  ledc_timer_config_t timer = {};
+  timer.speed_mode = LEDC_LOW_SPEED_MODE;
+  timer.duty_resolution = BACKLIGHT_BITS;
+  timer.timer_num = BACKLIGHT_TIMER;
+  timer.freq_hz = BACKLIGHT_FREQ;
+  timer.clk_cfg = LEDC_AUTO_CLK;
+  ledc_channel_config_t channel = {};
+  channel.gpio_num = TFT_BL;
+  channel.speed_mode = LEDC_LOW_SPEED_MODE;
+  channel.channel = BACKLIGHT_CHANNEL;
+  channel.timer_sel = BACKLIGHT_TIMER;
+  channel.duty = backlightDuty(backlightLevel);
+  if (ledc_timer_config(&timer) != ESP_OK || ledc_channel_config(&channel) != ESP_OK || ledc_fade_func_install(0) != ESP_OK) {
+    Serial.println("Backlight PWM not available, TFT_BL stays as it is");
+    return;
+  }
+  backlightTarget = backlightLevel;
+  backlightLock = xSemaphoreCreateMutex();
+#if CONFIG_PM_ENABLE
+  if (esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "backlight", &backlightSleepLock) != ESP_OK)
+    backlightSleepLock = NULL;
+#endif
+  backlightReady = true;
+#endif
+}
+
+// Start a hardware fade to level (percent) over ms and return at once
+static void fadeBacklight(uint8_t level, uint32_t ms) {
+  if (!backlightReady)
+    return;
+  level = std::min<uint8_t>(level, 100) * backlightScale / 100;
+  xSemaphoreTake(backlightLock, portMAX_DELAY);
+#if CONFIG_PM_ENABLE
+  bool dimmed = level > 0 && level < 100;
+  if (backlightSleepLock && dimmed != backlightSleepHeld) {
+    if (dimmed)
+      esp_pm_lock_acquire(backlightSleepLock);
+    else
+      esp_pm_lock_release(backlightSleepLock);
+    backlightSleepHeld = dimmed;
+  }
+#endif
+#if ESP_IDF_VERSION_MAJOR >= 5
+  ledc_fade_stop(LEDC_LOW_SPEED_MODE, BACKLIGHT_CHANNEL); // a new level replaces a fade in progress
+#endif // IDF 4 waits for it to end instead
+  backlightTarget = level;
+  if (ms == 0) {
+    ledc_set_duty(LEDC_LOW_SPEED_MODE, BACKLIGHT_CHANNEL, backlightDuty(level));
+    ledc_update_duty(LEDC_LOW_SPEED_MODE, BACKLIGHT_CHANNEL);
+  } else {
+    ledc_set_fade_with_time(LEDC_LOW_SPEED_MODE, BACKLIGHT_CHANNEL, backlightDuty(level), ms);
+    ledc_fade_start(LEDC_LOW_SPEED_MODE, BACKLIGHT_CHANNEL, LEDC_FADE_NO_WAIT);
+  }
+  xSemaphoreGive(backlightLock);
+}
+
+// Level the panel is at right now, part way through a fade
+static uint8_t backlightNow() {
+  if (!backlightReady)
+    return 100;
+  uint32_t duty = ledc_get_duty(LEDC_LOW_SPEED_MODE, BACKLIGHT_CHANNEL);
+  return (uint8_t)lroundf(sqrtf((float)duty / BACKLIGHT_MAX_DUTY) * 100);
+}
+
+// Idle governor (/power): once the player shows something static (a JPEG, the closed eye, an eye
+// at rest, a playlist still) and no command, request or control line came for IDLE_AFTER_MS, the
+// CPU steps down to IDLE_CPU_MHZ, WiFi wakes for fewer beacons and loop() and the web task poll
+// every IDLE_POLL_MS instead of every tick. With power management in the core (CONFIG_PM_ENABLE) a
+// PM lock is released instead, so frequency scaling and, with tickless idle, automatic light sleep
+// take over and the radio wakes the chip for traffic. Whatever arrives steps back up before it is
+// handled, and the player steps up before it draws
+#define IDLE_AFTER_MS 3000
+#define IDLE_CPU_MHZ 80    // lowest clock with the 80 MHz APB, so SPI and UART timing don't change
+#define IDLE_POLL_MS 10
+
+enum PowerMode { POWER_AUTO, POWER_IDLE, POWER_ACTIVE };
+static const char *powerModeNames[] = { "auto", "idle", "active" };
+
+static volatile uint32_t lastActivity = 0;   // millis() of the last command, request or control line
+static volatile bool playerStatic = false;   // the player waits with nothing to animate for a while
+static volatile bool powerIdle = false;
+static volatile uint8_t powerMode = POWER_AUTO; // forced from /power to compare the current draw
+static bool governorReady = false;
+static uint32_t activeCpuMhz = 240;
+static SemaphoreHandle_t powerLock = NULL;    // the governor and noteActivity() from any task
+static uint32_t powerSince = 0;              // millis() of the last change or reset
+static uint32_t powerIdleMs = 0, powerActiveMs = 0, powerIdleEntries = 0;
+#if CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t pmActiveLock = NULL; // held while active, when esp_pm_configure() took
+#endif
+
+static void initIdleGovernor() {
+  powerLock = xSemaphoreCreateMutex();
+  activeCpuMhz = getCpuFrequencyMhz();
+  powerSince = lastActivity = millis();
+#if CONFIG_PM_ENABLE
+#if ESP_IDF_VERSION_MAJOR >= 5
+  esp_pm_config_t pm = {};
+#else
+  esp_pm_config_esp32s3_t pm = {};
+#endif
+  pm.max_freq_mhz = activeCpuMhz;
+  pm.min_freq_mhz = IDLE_CPU_MHZ;
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+  pm.light_sleep_enable = true;
+#endif
+  if (esp_pm_configure(&pm) == ESP_OK && esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "active", &pmActiveLock) == ESP_OK)
+    esp_pm_lock_acquire(pmActiveLock);
+  else
+    pmActiveLock = NULL;
+#endif
+  governorReady = true;
+}
+
+static bool powerManaged() {
+#if CONFIG_PM_ENABLE
+  return pmActiveLock != NULL;
+#else
+  return false;
+#endif
+}
+
+static void setPowerIdle(bool idle) {
+  xSemaphoreTake(powerLock, portMAX_DELAY);
+  if (idle != powerIdle) {
+    uint32_t now = millis();
+    (powerIdle ? powerIdleMs : powerActiveMs) += now - powerSince;
+    powerSince = now;
+    powerIdle = idle;
+    powerIdleEntries += idle;
+#if CONFIG_PM_ENABLE
+    if (pmActiveLock) {
+      if (idle)
+        esp_pm_lock_release(pmActiveLock);
+      else
+        esp_pm_lock_acquire(pmActiveLock);
+    } else
+#endif
+      setCpuFrequencyMhz(idle ? IDLE_CPU_MHZ : activeCpuMhz);
+    WiFi.setSleep(idle ? WIFI_PS_MAX_MODEM : WIFI_PS_MIN_MODEM); // the core's default while active
+    if (backlightIdleLevel < backlightLevel) // the panel dims along with the chip
+      fadeBacklight(idle ? backlightIdleLevel : backlightLevel, idle ? BACKLIGHT_DIM_MS : BACKLIGHT_WAKE_MS);
+  }
+  xSemaphoreGive(powerLock);
+}
+
+// Something to do arrived: step up now rather than on loop()'s next pass
+static void noteActivity() {
+  lastActivity = millis();
+  if (governorReady && powerIdle && powerMode != POWER_IDLE)
+    setPowerIdle(false);
+}
+
+// loop(): step down once the player has been static for long enough
+static void pollIdleGovernor() {
+  if (!governorReady)
+    return;
+  bool idle = powerMode == POWER_IDLE ||
+              (powerMode == POWER_AUTO && playerStatic && millis() - lastActivity >= IDLE_AFTER_MS);
+  if (idle != powerIdle)
+    setPowerIdle(idle);
+}
+
+// Ticks loop() and the web task sleep between passes
+static TickType_t pollDelay() {
+  return powerIdle ? pdMS_TO_TICKS(IDLE_POLL_MS) : 1;
+}
+
+// Quality governor (/quality, control "power <soc> [runtime min]"): the host forwards the battery
+// level of the power node and the eye trades render quality for current as it drains. Below full,
+// GIF frames stay on screen for at least minFrameMs (frames that come due meanwhile are skipped
+// like late ones), decode-ahead and the frame ring are off so only the changed spans of each frame
+// are sent, and the backlight is scaled. At "static" the frame on screen is held, so the idle
+// governor steps the CPU down. A profile is left for the one above QUALITY_HYSTERESIS points
+// over its threshold, so a level wavering around it doesn't flip the profile back and forth
+enum QualityProfile { QUALITY_FULL, QUALITY_REDUCED, QUALITY_SAVER, QUALITY_STATIC, QUALITY_PROFILES };
+
+struct QualitySettings {
+  const char *name;
+  uint8_t belowSoc;     // battery % under which the profile applies
+  uint16_t minFrameMs;  // 0 plays at the GIF's own rate
+  bool decodeAhead;
+  uint8_t backlightPct; // of the /backlight level
+};
+static const QualitySettings qualityProfiles[QUALITY_PROFILES] = {
+  { "full", 101, 0, true, 100 },
+  { "reduced", 50, 66, false, 75 }, // 15 fps
+  { "saver", 25, 125, false, 50 },  // 8 fps
+  { "static", 10, 0, false, 30 },
+};
+#define QUALITY_HYSTERESIS 3
+#define QUALITY_LOW_RUNTIME_MIN 20 // a runtime estimate under this means saver at least
+#define QUALITY_HOLD_POLL_MS 100   // a held static frame looks for a new profile this often
+
+static volatile uint8_t qualityProfile = QUALITY_FULL;
+static volatile bool qualityAuto = true;        // follows the power level; /quality?profile= pins one
+static volatile int qualitySoc = -1, qualityRuntimeMin = -1; // last level pushed, -1 for none yet
+static volatile uint32_t qualityChanges = 0;
+
+static void setQualityProfile(uint8_t profile) {
+  if (profile == qualityProfile)
+    return;
+  qualityProfile = profile;
+  qualityChanges++;
+  backlightScale = qualityProfiles[profile].backlightPct;
+  bool dimmed = powerIdle && backlightIdleLevel < backlightLevel;
+  fadeBacklight(dimmed ? backlightIdleLevel : backlightLevel, BACKLIGHT_DIM_MS);
+}
+
+// Profile for a battery level, with the hysteresis from the current one
+static uint8_t qualityForLevel(int soc, int runtimeMin) {
+  uint8_t profile = QUALITY_FULL;
+  for (int p = QUALITY_PROFILES - 1; p > QUALITY_FULL; p--) {
+    int below = qualityProfiles[p].belowSoc + (p <= qualityProfile ? QUALITY_HYSTERESIS : 0);
+    if (soc < below) {
+      profile = p;
+      break;
+    }
+  }
+  if (runtimeMin >= 0 && runtimeMin < QUALITY_LOW_RUNTIME_MIN)
+    profile = std::max<uint8_t>(profile, QUALITY_SAVER);
+  return profile;
+}
+
+// A level from the host; runtimeMin -1 when it has no estimate. False if out of range
+static bool applyPowerLevel(int soc, int runtimeMin) {
+  if (soc < 0 || soc > 100)
+    return false;
+  qualitySoc = soc;
+  qualityRuntimeMin = runtimeMin;
+  if (qualityAuto)
+    setQualityProfile(qualityForLevel(soc, runtimeMin));
+  return true;
+}
+
+#define STATS_BUCKETS 12   // histogram buckets of doubling width: < 16 us, < 32 us, ... >= 16 ms
+#define STATS_SLOTS 5      // the rolling window is made of this many slots
+#define STATS_SLOT_MS 2000 // so /stats covers the last 10 s
+
+// The last two are per command: from the play being asked for to its first pixels being sent, and
+// from a command that replaces the image being queued to the player taking it up (preemption)
+enum StatMetric { STAT_SD_READ, STAT_DECODE, STAT_PALETTE, STAT_TRANSFER, STAT_FRAME, STAT_FIRST_PIXEL, STAT_PREEMPT,
+                  STAT_METRICS };
+#define STAT_FRAME_METRICS STAT_FIRST_PIXEL // metrics recorded for every frame
+static const char *statNames[] = { "sdRead", "decode", "palette", "transfer", "frame", "firstPixel", "preempt" };
+
+// Time per frame spent in one stage
+struct StatHistogram {
+  uint32_t count;
+  uint32_t totalUs;
+  uint32_t maxUs;
+  uint32_t buckets[STATS_BUCKETS];
+};
+
+struct StatSlot {
+  uint32_t startedAt; // millis()
+  StatHistogram hist[STAT_METRICS];
+  uint32_t sdBytes;
+  uint32_t frames, late, dropped;
+  float targetMs;     // scheduled duration of the frames shown
+  uint32_t shownMs;   // time they were actually on screen
+};
+
+static StatSlot statSlots[STATS_SLOTS];
+static int statSlotIdx = 0;
+static portMUX_TYPE statsMux = portMUX_INITIALIZER_UNLOCKED; // player writes, /stats reads
+
+// Per-frame accumulators, only touched by the player task
+static uint32_t frameStageUs[STAT_METRICS];
+static uint32_t frameSdBytes = 0;
+static uint32_t frameStartUs = 0;
+
+// What the soak test (/soak) needs beyond the 10 s window, gathered while soakRecording and taken
+// and cleared by it once per summary period; guarded by statsMux like the slots
+struct SoakCounters {
+  StatHistogram frame, sdRead;
+  uint32_t late, dropped;
+};
+static SoakCounters soakCounters;
+static bool soakRecording = false;
+
+// Current slot, starting new ones as time passes; call with statsMux held
+static StatSlot &currentStatSlot()
+{
+  uint32_t now = millis();
+  StatSlot *slot = &statSlots[statSlotIdx];
+  if (now - slot->startedAt >= STATS_SLOT_MS) { // overwrite the oldest; /stats skips slots that are too old
+    statSlotIdx = (statSlotIdx + 1) % STATS_SLOTS;
+    slot = &statSlots[statSlotIdx];
+    memset(slot, 0, sizeof(*slot));
+    slot->startedAt = now;
+  }
+  return *slot;
+}
+
+static void addStatSample(StatHistogram &h, uint32_t us)
+{
+  int bucket = 0;
+  for (uint32_t limit = 16; bucket < STATS_BUCKETS - 1 && us >= limit; limit <<= 1)
+    bucket++;
+  h.count++;
+  h.totalUs += us;
+  h.maxUs = std::max(h.maxUs, us);
+  h.buckets[bucket]++;
+}
+
+static void startFrameStats()
+{
+  memset(frameStageUs, 0, sizeof(frameStageUs));
+  frameSdBytes = 0;
+  frameStartUs = micros();
+}
+
+static void HOT_IRAM addStageTime(uint8_t metric, uint32_t startUs)
+{
+  frameStageUs[metric] += micros() - startUs;
+}
+
+// Record the frame that was just put on screen; decoding is what the measured stages don't cover
+static void commitFrameStats()
+{
+  uint32_t total = micros() - frameStartUs;
+  uint32_t measured = frameStageUs[STAT_SD_READ] + frameStageUs[STAT_PALETTE] + frameStageUs[STAT_TRANSFER];
+  frameStageUs[STAT_DECODE] = total > measured ? total - measured : 0;
+  frameStageUs[STAT_FRAME] = total;
+  traceSpan(TRACE_FRAME, frameStartUs, traceFrames++, 0);
+  portENTER_CRITICAL(&statsMux);
+  StatSlot &slot = currentStatSlot();
+  for (int m = 0; m < STAT_FRAME_METRICS; m++)
+    addStatSample(slot.hist[m], frameStageUs[m]);
+  slot.sdBytes += frameSdBytes;
+  if (soakRecording) {
+    addStatSample(soakCounters.frame, frameStageUs[STAT_FRAME]);
+    addStatSample(soakCounters.sdRead, frameStageUs[STAT_SD_READ]);
+  }
+  portEXIT_CRITICAL(&statsMux);
+}
+
+// Frame pacing, from waitNextFrame()
+static void recordFramePacing(float targetMs, uint32_t shownMs, bool late, uint32_t dropped)
+{
+  portENTER_CRITICAL(&statsMux);
+  StatSlot &slot = currentStatSlot();
+  slot.frames++;
+  slot.targetMs += targetMs;
+  slot.shownMs += shownMs;
+  slot.late += late;
+  slot.dropped += dropped;
+  if (soakRecording) {
+    soakCounters.late += late;
+    soakCounters.dropped += dropped;
+  }
+  portEXIT_CRITICAL(&statsMux);
+  if (++eventFrames == 1 || eventFrames % EVENTS_FRAME_STEP == 0)
+    postEvent(EVENT_FRAME, playingName);
+}
+
+static uint32_t firstPixelFrom = 0; // micros() when the image being started was asked for, 0 once sent
+
+// Time the first pixels of an image from `fromUs`, a command's queuedUs or now
+static void startFirstPixelClock(uint32_t fromUs)
+{
+  firstPixelFrom = fromUs ? fromUs : 1;
+}
+
+// Called wherever pixels go to the panel; records the time to first pixel once per image
+static void noteFirstPixel()
+{
+  if (!firstPixelFrom)
+    return;
+  uint32_t us = micros() - firstPixelFrom;
+  firstPixelFrom = 0;
+  portENTER_CRITICAL(&statsMux);
+  addStatSample(currentStatSlot().hist[STAT_FIRST_PIXEL], us);
+  portEXIT_CRITICAL(&statsMux);
+}
+
+#ifdef USE_DMA
+// DMA completion, called from the TFT_eSPI poll/wait functions in the player task
+static void HOT_IRAM stripSent(void *strip)
+{
+  dmaStripQueued[(intptr_t)strip] = false;
+  traceInstant(TRACE_DMA_DONE, 0, (intptr_t)strip);
+}
+#endif
+
+// Overlay layers over decoded GIFs, bottom to top: a soft highlight (alpha mask), a GIF, a PNG
+// (alpha) and the eyelid (key colour). They are blended into the strips on their way to the panel, so each line goes out
+// once however many layers cover it, and only the lines under layers that changed are redrawn
+// between frames, from the GIF canvas (see presentOverlays())
+enum OverlayId { OVERLAY_HIGHLIGHT, OVERLAY_GIF, OVERLAY_PNG, OVERLAY_LID, OVERLAYS };
+#define OVERLAY_SET_HIGHLIGHT 1
+#define OVERLAY_SET_LID 2
+#define OVERLAY_SET_COLOR 4
+#define OVERLAY_SET_GIF 8 // `name` in /gif centred on x, y, or none if empty
+#define OVERLAY_SET_PNG 16 // the same for the PNG layer
+#define OVERLAY_MAX_RADIUS 60
+#define SHIFT_MAX_ROWS 40 // /shift range; the band that wraps round and the rows lost off the other edge stay near the rim
+
+struct OverlayLayer {
+  int16_t x, y, w, h;   // on the display
+  uint16_t *pixels;     // RGB565 in panel byte order, like the GIF lines
+  uint8_t *alpha;       // coverage 0-255 per pixel, NULL if `key` marks the transparent pixels
+  uint16_t key;
+  int capacity;         // pixels allocated
+  bool visible;
+};
+static OverlayLayer overlays[OVERLAYS];
+static int16_t overlayDirtyX0 = 0, overlayDirtyY0 = 0, overlayDirtyX1 = 0, overlayDirtyY1 = 0; // to redraw
+static bool overlayGif = false; // a decoded GIF is playing, its strips get the overlays
+static int overlayHighlightX = 0, overlayHighlightY = 0, overlayHighlightR = 0; // r 0 = off
+static int overlayLid = 0;      // % of the display height the lid covers in the middle
+static uint16_t overlayLidColor = TFT_BLACK;
+
+static bool overlaysVisible()
+{
+  for (const OverlayLayer &l : overlays)
+    if (l.visible)
+      return true;
+  return false;
+}
+
+// Blend the visible layers into a line of x..x+w-1 on display row y
+static void HOT_IRAM compositeOverlays(uint16_t *line, int32_t x, int32_t y, int32_t w)
+{
+  for (const OverlayLayer &l : overlays) {
+    if (!l.visible || y < l.y || y >= l.y + l.h)
+      continue;
+    int32_t x0 = std::max<int32_t>(x, l.x), x1 = std::min<int32_t>(x + w, l.x + l.w);
+    const uint16_t *src = l.pixels + (y - l.y) * l.w - l.x; // indexed by display column
+    const uint8_t *alpha = l.alpha ? l.alpha + (y - l.y) * l.w - l.x : NULL;
+    uint16_t *dst = line - x;
+    for (int32_t i = x0; i < x1; i++) {
+      if (!alpha) {
+        if (src[i] != l.key)
+          dst[i] = src[i];
+      } else if (alpha[i] == 255) {
+        dst[i] = src[i];
+      } else if (alpha[i]) { // swarBlend() works in native order, all three channels in two multiplies
+        dst[i] = __builtin_bswap16(swarBlend(alpha[i], __builtin_bswap16(src[i]), __builtin_bswap16(dst[i])));
+      }
+    }
+  }
+}
+
+// Screen effects (/fx): a vignette, moving scanlines and a glow ring around the iris, fused into
+// one TFT_ePixelKernel that runs over each strip after the overlays and the circle clip, so the
+// visible pixels get every effect in one pass on their way out. Only pixels that are sent get them:
+// presents that skip unchanged pixels leave the scanlines where they were there
+struct FxEffect {
+  uint8_t vignette;    // % darker at the rim, 0 = off
+  uint8_t scanlines;   // % darker in the dark lines, 0 = off
+  uint8_t scanSpeed;   // 1/256 of a cycle per eye tick
+  uint8_t glow;        // % of the glow colour added at the ring, 0 = off
+  uint16_t glowColor;  // RGB565
+};
+static const FxEffect fxEffectNone = { 0, 0, 0, 0, TFT_WHITE };
+static FxEffect fxEffect = fxEffectNone;   // player task
+static FxEffect fxSetting = fxEffectNone;  // web task, persisted, see /fx
+#define FX_SCAN_PERIOD 4                   // lines per scanline cycle
+#define FX_GLOW_WIDTH 6                    // px the glow fades over on either side of the iris rim
+
+#ifdef USE_PIXEL_KERNEL
+enum { FX_VIGNETTE, FX_SCANLINES, FX_GLOW };
+static TFT_ePixelKernel<TFT_eVignette, TFT_eScanlines, TFT_eGlow> stripKernel;
+#endif
+
+// Set up the kernel for fxEffect
+static void setStripKernel()
+{
+#ifdef USE_PIXEL_KERNEL
+  TFT_eVignette &vignette = stripKernel.get<FX_VIGNETTE>();
+  vignette.on = fxEffect.vignette > 0;
+  vignette.strength = fxEffect.vignette;
+  vignette.cx = tft.width() / 2;
+  vignette.cy = tft.height() / 2;
+  vignette.outer = std::min(tft.width(), tft.height()) / 2;
+  vignette.inner = vignette.outer * 2 / 3;
+  TFT_eScanlines &scan = stripKernel.get<FX_SCANLINES>();
+  scan.on = fxEffect.scanlines > 0;
+  scan.depth = fxEffect.scanlines;
+  scan.period = FX_SCAN_PERIOD;
+  TFT_eGlow &glow = stripKernel.get<FX_GLOW>();
+  glow.strength = fxEffect.glow;
+  glow.color = fxEffect.glowColor;
+  glow.radius = EYE_IRIS_RADIUS;
+  glow.width = FX_GLOW_WIDTH;
+#endif
+}
+
+// Player task: take new settings from CMD_FX, used from the next strip on
+static void applyFxCommand(const DisplayCommand &cmd)
+{
+  fxEffect.vignette = cmd.x;
+  fxEffect.scanlines = cmd.y;
+  fxEffect.scanSpeed = cmd.dilation;
+  fxEffect.glow = cmd.lid;
+  fxEffect.glowColor = cmd.color;
+  setStripKernel();
+  if (eyeShown) { // send the eye again in full with the new effects
+    eyeFullPresent = true;
+    eyeDirty = true;
+  }
+}
+
+// Web task: hand new settings to the player; false if the queue stayed full
+static bool queueFxEffect(const FxEffect &e)
+{
+  DisplayCommand cmd;
+  cmd.type = CMD_FX;
+  cmd.startAt = 0;
+  cmd.name[0] = '\0';
+  cmd.x = e.vignette;
+  cmd.y = e.scanlines;
+  cmd.dilation = e.scanSpeed;
+  cmd.lid = e.glow;
+  cmd.color = e.glowColor;
+  return sendDisplayCommand(cmd, pdMS_TO_TICKS(100));
+}
+
+// Queue the pending strip for DMA and switch to the next buffer
+static void HOT_IRAM flushStrip()
+{
+#ifdef USE_DMA
+  if (stripLines == 0)
+    return;
+  uint32_t t0 = micros();
+  if (overlayGif && overlaysVisible()) { // the strip still holds whole lines here
+    for (int row = 0; row < stripLines; row++)
+      compositeOverlays(dmaStrip[dmaStripIdx] + row * stripW, stripX + xOffset, stripY + yOffset + row, stripW);
+  }
+  tft.startWrite(); // DMA needs the TFT chip select held low
+  // The panel is round: send only the part of the strip inside the visible circle
+  int32_t x = stripX + xOffset, y = stripY + yOffset, w = stripW, h = stripLines;
+  bool queued = false;
+  bool visible = EyePanel::matches(tft) ? EyePanel::clipCircleRect(&x, &y, &w, &h) : tft.clipCircleRect(&x, &y, &w, &h);
+  if (visible) {
+    uint16_t *pixels = dmaStrip[dmaStripIdx] + (y - stripY - yOffset) * stripW + (x - stripX - xOffset);
+    if (w != stripW) { // trimmed columns, close the gaps so the lines stay contiguous
+      for (int row = 0; row < h; row++)
+        memmove(dmaStrip[dmaStripIdx] + row * w, pixels + row * stripW, w * sizeof(uint16_t));
+      pixels = dmaStrip[dmaStripIdx];
+    }
+#ifdef USE_PIXEL_KERNEL
+    stripKernel.get<FX_SCANLINES>().phase = millis() / EYE_TICK_MS * fxEffect.scanSpeed;
+    stripKernel.get<FX_GLOW>().on = fxEffect.glow && eyeShown;
+    stripKernel.apply(pixels, x, y, w, h, w);
+#endif
+#ifdef USE_RGB444
+    while (!(queued = tft.dmaSubmitImage12(x, y, w, h, pixels, stripSent, (void *)(intptr_t)dmaStripIdx))
+           && tft.spiBusyCheck)
+#else
+    while (!(queued = tft.dmaSubmitImage(x, y, w, h, pixels, stripSent, (void *)(intptr_t)dmaStripIdx))
+           && tft.spiBusyCheck)
+#endif
+      tft.dmaPoll(true); // queue full, wait for the oldest strip
+  }
+  dmaStripQueued[dmaStripIdx] = queued;
+  if (queued) {
+    noteFirstPixel();
+    traceInstant(TRACE_DMA_SUBMIT, w * h * sizeof(uint16_t), dmaStripIdx);
+  }
+  dmaStripIdx = (dmaStripIdx + 1) % DMA_STRIP_BUFFERS;
+  stripLines = 0;
+  addStageTime(STAT_TRANSFER, t0); // includes waiting for room in the queue
+  if (gifStrip) // the decoder cooks its next strip into the buffer that is current now
+    setGifStrip(true);
+#endif
+}
+
+// SD card and display share the SPI bus: wait for DMA and release the TFT chip select
+static void releaseDisplayBus()
+{
+#ifdef USE_DMA
+  uint32_t t0 = micros();
+  tft.endWrite();
+  addStageTime(STAT_TRANSFER, t0);
+#endif
+}
+
+// Black out the part of the screen which a centred w x h canvas doesn't cover, once per play.
+// With the shadow buffer only spans that aren't black yet are sent, so replays and GIFs of the
+// same size cost nothing
+static void clearSpan(const uint16_t *line, int32_t y, int32_t x0, int32_t x1)
+{
+  if (line) {
+    while (x0 < x1 && !line[x0])
+      x0++;
+    while (x1 > x0 && !line[x1 - 1])
+      x1--;
+  }
+  if (x0 < x1)
+    tft.drawFastHLine(x0, y, x1 - x0, TFT_BLACK);
+}
+
+static void clearCanvasBorder(int w, int h)
+{
+  int32_t dw = tft.width(), dh = tft.height();
+  int32_t x0 = std::max<int32_t>(0, xOffset), x1 = std::min<int32_t>(dw, xOffset + w);
+  int32_t y0 = std::max<int32_t>(0, yOffset), y1 = std::min<int32_t>(dh, yOffset + h);
+  if (x0 == 0 && y0 == 0 && x1 == dw && y1 == dh)
+    return;
+  const uint16_t *shadow = tft.getShadowBuffer();
+  tft.beginBatch(); // the spans of consecutive rows share a window
+  for (int32_t y = 0; y < dh; y++) {
+    const uint16_t *line = shadow ? shadow + y * dw : NULL;
+    if (y < y0 || y >= y1 || x1 <= x0) {
+      clearSpan(line, y, 0, dw);
+    } else {
+      clearSpan(line, y, 0, x0);
+      clearSpan(line, y, x1, dw);
+    }
+  }
+  tft.endBatch();
+}
+
+#ifdef USE_DMA
+// Wait until the current strip buffer has been sent from an earlier round
+static HOT_IRAM uint16_t *freeStrip()
+{
+  if (dmaStripQueued[dmaStripIdx]) {
+    uint32_t t0 = micros();
+    while (dmaStripQueued[dmaStripIdx])
+      tft.dmaPoll(true);
+    addStageTime(STAT_TRANSFER, t0);
+  }
+  return dmaStrip[dmaStripIdx];
+}
+
+// Let the decoder cook DMA_STRIP_LINES lines at a time straight into the current strip
+// buffer, so GIFDraw() is called once per strip; or stop it with on false
+static void setGifStrip(bool on)
+{
+  gifStrip = on ? freeStrip() : NULL;
+  gif.setStripBuffer(gifStrip, DISPLAY_WIDTH * DMA_STRIP_LINES, DMA_STRIP_LINES);
+}
+
+// Return the next free line of the current strip, flushing first if the line doesn't continue it
+static HOT_IRAM uint16_t *stripLine(int x, int y, int w)
+{
+  if (stripLines && (x != stripX || w != stripW || y != stripY + stripLines))
+    flushStrip();
+  if (stripLines == 0) {
+    stripX = x;
+    stripY = y;
+    stripW = w;
+    freeStrip();
+  }
+  return &dmaStrip[dmaStripIdx][stripLines * w];
+}
+
+// Queue the strip the decoder cooked into the current buffer, lines `pitch` pixels apart;
+// only the w columns from `skip` on changed, they are moved together first
+static void HOT_IRAM pushCookedStrip(int x, int y, int w, int lines, int pitch, int skip)
+{
+  if (w <= 0)
+    return; // nothing changed, the decoder reuses the buffer
+  uint16_t *strip = dmaStrip[dmaStripIdx];
+  if (w != pitch)
+    for (int row = 0; row < lines; row++)
+      memmove(strip + row * w, strip + row * pitch + skip, w * sizeof(uint16_t));
+  stripX = x;
+  stripY = y;
+  stripW = w;
+  stripLines = lines;
+  flushStrip();
+}
+
+// Redraw the lines under overlays that changed since the last frame: the canvas of the playing
+// GIF (frame buffer or RAW canvas) with the layers on top, sent as strips
+static void presentOverlays()
+{
+  if (!overlayGif || overlayDirtyX0 >= overlayDirtyX1 || overlayDirtyY0 >= overlayDirtyY1)
+    return;
+  int x0 = overlayDirtyX0, x1 = overlayDirtyX1;
+  int cw = gifCooked ? gif.getCanvasWidth() : rawCanvasW, ch = gifCooked ? gif.getCanvasHeight() : rawCanvasH;
+  int cx0 = std::max(x0, xOffset), cx1 = std::min(x1, xOffset + cw); // columns on the canvas
+  const uint16_t *palette = gif.getFramePalette();
+  if (gifCooked || rawCanvas) { // otherwise the next frames bring the layers in
+    for (int y = overlayDirtyY0; y < overlayDirtyY1; y++) {
+      uint16_t *line = stripLine(x0 - xOffset, y - yOffset, x1 - x0);
+      int cy = y - yOffset;
+      if (cy < 0 || cy >= ch || cx0 >= cx1) {
+        memset(line, 0, (x1 - x0) * sizeof(uint16_t)); // the border is black
+      } else {
+        memset(line, 0, (cx0 - x0) * sizeof(uint16_t));
+        if (gifCooked)
+          GIF_expandLine565(line + cx0 - x0, frameBuf + cy * cw + cx0 - xOffset, palette, cx1 - cx0);
+        else
+          memcpy(line + cx0 - x0, rawCanvas + cy * cw + cx0 - xOffset, (cx1 - cx0) * sizeof(uint16_t));
+        memset(line + cx1 - x0, 0, (x1 - cx1) * sizeof(uint16_t));
+      }
+      if (++stripLines == DMA_STRIP_LINES)
+        flushStrip();
+    }
+    flushStrip();
+  }
+  overlayDirtyX0 = overlayDirtyX1 = overlayDirtyY0 = overlayDirtyY1 = 0;
+}
+#endif
+
+// Add a display area to what presentOverlays() redraws
+static void markOverlayArea(int x0, int y0, int x1, int y1)
+{
+  x0 = std::max<int>(0, x0);
+  y0 = std::max<int>(0, y0);
+  x1 = std::min<int>(tft.width(), x1);
+  y1 = std::min<int>(tft.height(), y1);
+  if (x0 >= x1 || y0 >= y1)
+    return;
+  if (overlayDirtyX0 >= overlayDirtyX1 || overlayDirtyY0 >= overlayDirtyY1) {
+    overlayDirtyX0 = x0;
+    overlayDirtyY0 = y0;
+    overlayDirtyX1 = x1;
+    overlayDirtyY1 = y1;
+    return;
+  }
+  overlayDirtyX0 = std::min<int>(overlayDirtyX0, x0);
+  overlayDirtyY0 = std::min<int>(overlayDirtyY0, y0);
+  overlayDirtyX1 = std::max<int>(overlayDirtyX1, x1);
+  overlayDirtyY1 = std::max<int>(overlayDirtyY1, y1);
+}
+
+static void markOverlayDirty(const OverlayLayer &l)
+{
+  if (l.visible)
+    markOverlayArea(l.x, l.y, l.x + l.w, l.y + l.h);
+}
+
+// Make room for a w x h layer in PSRAM; false hides it
+static bool reserveOverlay(OverlayLayer &l, int w, int h, bool alpha)
+{
+  if (l.capacity < w * h || (alpha && !l.alpha)) {
+    free(l.pixels);
+    free(l.alpha);
+    l.pixels = (uint16_t *)ps_malloc(w * h * sizeof(uint16_t));
+    l.alpha = alpha ? (uint8_t *)ps_malloc(w * h) : NULL;
+    l.capacity = l.pixels && (l.alpha || !alpha) ? w * h : 0;
+  }
+  if (!l.capacity)
+    return false;
+  if (!alpha) {
+    free(l.alpha);
+    l.alpha = NULL;
+  }
+  l.w = w;
+  l.h = h;
+  return true;
+}
+
+// White disc fading out towards its rim, centred on x, y
+static void buildOverlayHighlight()
+{
+  OverlayLayer &l = overlays[OVERLAY_HIGHLIGHT];
+  int r = overlayHighlightR;
+  markOverlayDirty(l);
+  l.visible = r > 0 && reserveOverlay(l, 2 * r, 2 * r, true);
+  if (!l.visible)
+    return;
+  l.x = overlayHighlightX - r;
+  l.y = overlayHighlightY - r;
+  for (int y = 0; y < l.h; y++) {
+    for (int x = 0; x < l.w; x++) {
+      float d = sqrtf((x - r + 0.5f) * (x - r + 0.5f) + (y - r + 0.5f) * (y - r + 0.5f)) / r;
+      float a = d < 1 ? 1 - d : 0;
+      l.pixels[y * l.w + x] = __builtin_bswap16(TFT_WHITE);
+      l.alpha[y * l.w + x] = (uint8_t)(a * a * 230);
+    }
+  }
+  markOverlayDirty(l);
+}
+
+// Upper lid across the display, lowest in the middle; everything below its edge is the key colour
+static void buildOverlayLid()
+{
+  OverlayLayer &l = overlays[OVERLAY_LID];
+  int w = tft.width(), h = tft.height() * overlayLid / 100;
+  markOverlayDirty(l);
+  l.visible = h > 0 && reserveOverlay(l, w, h, false);
+  if (!l.visible)
+    return;
+  l.x = l.y = 0;
+  uint16_t color = __builtin_bswap16(overlayLidColor);
+  l.key = ~color;
+  for (int x = 0; x < w; x++) {
+    float u = (2.0f * x - w) / w; // -1..1 across the display
+    int edge = h - (int)(h / 4 * u * u);
+    for (int y = 0; y < h; y++)
+      l.pixels[y * w + x] = y < edge ? color : l.key;
+  }
+  markOverlayDirty(l);
+}
+
+#ifdef USE_GIF_LAYER
+// GIF overlay layer: a small animation (a sparkle, a tear) over the playing GIF. Its decoder
+// shares gifWorkspace with `gif` and steps between the GIF's frames on the player task, at its
+// own frame delays, drawing into the layer's pixels; the lines it covers are redrawn with the
+// other overlays. Not while the decoder task plays `gif` on the other core (USE_FRAME_RING)
+#define GIF_LAYER_MAX_WIDTH 160
+#define GIF_LAYER_MAX_BYTES (256 * 1024) // the file is read into PSRAM once
+#define GIF_LAYER_MIN_DELAY_MS 20
+#define GIF_LAYER_KEY 0x2000             // transparent, in panel byte order; opaque pixels of this colour move off it
+
+static AnimatedGIFT<GIF_LAYER_MAX_WIDTH, MAX_COLORS, true> layerGif;
+static uint32_t layerGifPalettes[(GIF_PALETTE_SET_BYTES(MAX_COLORS) + 3) / 4];
+static uint8_t *layerGifData = NULL;        // the file, PSRAM
+static char layerGifName[64] = "";          // the layer to show, empty for none
+static bool layerGifPending = false;        // layerGifName changed, opened by stepGifLayer()
+static int layerGifX = 0, layerGifY = 0;    // centre on the display
+static uint32_t layerGifDue = 0;            // millis() of its next frame
+static int16_t layerPrevX, layerPrevY, layerPrevW, layerPrevH; // last frame, cleared before the next
+static uint8_t layerPrevDisposal = 0;
+
+// RAW lines of the layer's frames, over what earlier frames left where they're transparent
+static void layerGifLine(GIFDRAW *pDraw)
+{
+  OverlayLayer &l = overlays[OVERLAY_GIF];
+  if (pDraw->y == 0) { // a new frame: dispose of the last one ("restore to background")
+    if (layerPrevDisposal == 2)
+      for (int y = layerPrevY; y < layerPrevY + layerPrevH; y++)
+        std::fill_n(l.pixels + y * l.w + layerPrevX, layerPrevW, (uint16_t)GIF_LAYER_KEY);
+    layerPrevX = pDraw->iX;
+    layerPrevY = pDraw->iY;
+    layerPrevW = pDraw->iWidth;
+    layerPrevH = pDraw->iHeight;
+    layerPrevDisposal = pDraw->ucDisposalMethod;
+  }
+  int y = pDraw->iY + pDraw->y;
+  if (y >= l.h)
+    return;
+  uint16_t *dst = l.pixels + y * l.w + pDraw->iX;
+  int w = std::min(pDraw->iWidth, l.w - pDraw->iX);
+  for (int x = 0; x < w; x++) {
+    uint8_t c = pDraw->pPixels[x];
+    if (pDraw->ucHasTransparency && c == pDraw->ucTransparent)
+      continue;
+    uint16_t color = pDraw->pPalette[c];
+    dst[x] = color == GIF_LAYER_KEY ? GIF_LAYER_KEY ^ 0x0100 : color;
+  }
+}
+
+static void closeGifLayer()
+{
+  OverlayLayer &l = overlays[OVERLAY_GIF];
+  markOverlayDirty(l);
+  l.visible = false;
+  if (layerGifData) {
+    layerGif.close();
+    free(layerGifData);
+    layerGifData = NULL;
+  }
+}
+
+// Read /gif/<layerGifName> into PSRAM and open it; false leaves the layer off
+static bool openGifLayer()
+{
+  closeGifLayer();
+  String path = "/gif/" + String(layerGifName);
+  if (!layerGifName[0] || !isGifName(path))
+    return false;
+  releaseDisplayBus(); // the card may share the bus
+  File f = mediaFs(path.c_str()).open(path.c_str(), FILE_READ);
+  size_t size = f ? f.size() : 0;
+  if (size && size <= GIF_LAYER_MAX_BYTES && (layerGifData = (uint8_t *)ps_malloc(size)) != NULL &&
+      f.read(layerGifData, size) != size) {
+    free(layerGifData);
+    layerGifData = NULL;
+  }
+  f.close();
+  if (!layerGifData)
+    return false;
+  OverlayLayer &l = overlays[OVERLAY_GIF];
+  layerGif.begin(BIG_ENDIAN_PIXELS);
+  if (!layerGif.open(layerGifData, size, layerGifLine) ||
+      !reserveOverlay(l, layerGif.getCanvasWidth(), layerGif.getCanvasHeight(), false)) {
+    free(layerGifData);
+    layerGifData = NULL;
+    return false;
+  }
+  l.key = GIF_LAYER_KEY;
+  l.x = layerGifX - l.w / 2;
+  l.y = layerGifY - l.h / 2;
+  std::fill_n(l.pixels, l.w * l.h, (uint16_t)GIF_LAYER_KEY);
+  layerPrevDisposal = 0;
+  layerGifDue = millis();
+  l.visible = true;
+  return true;
+}
+
+// Player task, between frames of `gif`: open a new layer, and decode the layer's next frame
+// once it is due; the lines it covers go out with the next presentOverlays()
+static void stepGifLayer()
+{
+  if (decodingRing) // `gif` is decoding on the other core, on the same workspace
+    return;
+  if (layerGifPending) {
+    layerGifPending = false;
+    if (!openGifLayer() && layerGifName[0])
+      Serial.printf("GIF layer %s could not be opened\n", layerGifName);
+  }
+  OverlayLayer &l = overlays[OVERLAY_GIF];
+  if (!l.visible || (int32_t)(millis() - layerGifDue) < 0)
+    return;
+  int delayMs = 0;
+  if (layerGif.playFrame(false, &delayMs) < 0) {
+    closeGifLayer();
+    return;
+  }
+  layerGifDue = millis() + std::max(delayMs, GIF_LAYER_MIN_DELAY_MS);
+  markOverlayDirty(l); // the frame's rectangle would do, but layers are small
+}
+#endif
+
+#ifdef USE_PNG_LAYER
+// PNG overlay layer: reflections, soft lids and other art with real alpha. Each PNG is inflated
+// once with PNGdec into a PSRAM sprite of panel-order RGB565 plus 8-bit alpha and kept in a small
+// cache, so showing it again, or over every frame, costs only the blend in compositeOverlays()
+#define PNG_LAYER_SLOTS 4                // decoded PNGs kept, the least recently shown is dropped
+#define PNG_LAYER_MAX_BYTES (128 * 1024) // the file is read into PSRAM to be decoded
+
+struct PngSprite {
+  char name[64];      // in /gif, empty for a free slot
+  int16_t w, h;
+  uint16_t *pixels;   // PSRAM, RGB565 in panel byte order
+  uint8_t *alpha;     // PSRAM, 0-255 per pixel
+  uint32_t lastShown; // millis()
+};
+static PngSprite pngSprites[PNG_LAYER_SLOTS];
+static PngSprite *pngDecoding = NULL;  // target of pngLine()
+static int pngLayerX = 0, pngLayerY = 0; // centre on the display
+
+// One decoded line: colour through PNGdec, alpha from the pixel data for the 8-bit formats
+// with an alpha channel or a tRNS chunk, opaque otherwise
+static int pngLine(PNGDRAW *pDraw)
+{
+  PNG *png = (PNG *)pDraw->pUser;
+  PngSprite &s = *pngDecoding;
+  int w = std::min<int>(pDraw->iWidth, s.w);
+  png->getLineAsRGB565(pDraw, s.pixels + pDraw->y * s.w, PNG_RGB565_BIG_ENDIAN, 0x00000000);
+  uint8_t *alpha = s.alpha + pDraw->y * s.w;
+  const uint8_t *p = pDraw->pPixels;
+  if (pDraw->iBpp != 8) {
+    memset(alpha, 255, w);
+  } else if (pDraw->iPixelType == PNG_PIXEL_TRUECOLOR_ALPHA) {
+    for (int x = 0; x < w; x++)
+      alpha[x] = p[4 * x + 3];
+  } else if (pDraw->iPixelType == PNG_PIXEL_GRAY_ALPHA) {
+    for (int x = 0; x < w; x++)
+      alpha[x] = p[2 * x + 1];
+  } else if (pDraw->iPixelType == PNG_PIXEL_INDEXED && pDraw->iHasAlpha) {
+    for (int x = 0; x < w; x++)
+      alpha[x] = pDraw->pPalette[768 + p[x]]; // PNGdec keeps the tRNS values after the RGB palette
+  } else {
+    memset(alpha, 255, w);
+  }
+  return 1;
+}
+
+static void freePngSprite(PngSprite &s)
+{
+  free(s.pixels);
+  free(s.alpha);
+  memset(&s, 0, sizeof(s));
+}
+
+// The decoded sprite of /gif/<name>, decoded into the least recently shown slot if it isn't
+// cached; NULL if it can't be read or decoded
+static PngSprite *loadPngSprite(const char *name)
+{
+  PngSprite *slot = &pngSprites[0];
+  for (PngSprite &s : pngSprites) {
+    if (s.name[0] && strcmp(s.name, name) == 0)
+      return &s;
+    if (slot->name[0] && (!s.name[0] || (int32_t)(s.lastShown - slot->lastShown) < 0))
+      slot = &s;
+  }
+  freePngSprite(*slot);
+  String path = "/gif/" + String(name);
+  releaseDisplayBus(); // the card may share the bus
+  File f = mediaFs(path.c_str()).open(path.c_str(), FILE_READ);
+  size_t size = f ? f.size() : 0;
+  uint8_t *data = size && size <= PNG_LAYER_MAX_BYTES ? (uint8_t *)ps_malloc(size) : NULL;
+  bool read = data && f.read(data, size) == size;
+  f.close();
+  void *mem = read ? ps_malloc(sizeof(PNG)) : NULL; // PNGdec's inflate window, only while decoding
+  bool decoded = false;
+  if (mem) {
+    PNG *png = new (mem) PNG();
+    if (png->openRAM(data, size, pngLine) == PNG_SUCCESS) {
+      int w = png->getWidth(), h = png->getHeight();
+      if (w <= tft.width() && h <= tft.height()) {
+        slot->pixels = (uint16_t *)ps_malloc(w * h * sizeof(uint16_t));
+        slot->alpha = (uint8_t *)ps_malloc(w * h);
+        slot->w = w;
+        slot->h = h;
+        pngDecoding = slot;
+        decoded = slot->pixels && slot->alpha && png->decode(png, 0) == PNG_SUCCESS;
+      }
+      png->close();
+    }
+    png->~PNG();
+    free(mem);
+  }
+  free(data);
+  if (!decoded) {
+    freePngSprite(*slot);
+    return NULL;
+  }
+  strlcpy(slot->name, name, sizeof(slot->name));
+  return slot;
+}
+
+// Player task: show /gif/<name> centred on pngLayerX, pngLayerY, or hide the layer with ""
+static void showPngLayer(const char *name)
+{
+  OverlayLayer &l = overlays[OVERLAY_PNG];
+  markOverlayDirty(l);
+  l.visible = false;
+  PngSprite *s = name[0] ? loadPngSprite(name) : NULL;
+  if (!s) {
+    if (name[0])
+      Serial.printf("PNG layer %s could not be decoded\n", name);
+    return;
+  }
+  s->lastShown = millis();
+  l.pixels = s->pixels; // the cache owns the buffers, reserveOverlay() is never called on this layer
+  l.alpha = s->alpha;
+  l.capacity = 0;
+  l.w = s->w;
+  l.h = s->h;
+  l.x = pngLayerX - l.w / 2;
+  l.y = pngLayerY - l.h / 2;
+  l.visible = true;
+  markOverlayDirty(l);
+}
+#endif
+
+static void applyOverlayCommand(const DisplayCommand &cmd)
+{
+  if (cmd.value & OVERLAY_SET_HIGHLIGHT) {
+    overlayHighlightX = panelMirrored ? tft.width() - cmd.x : cmd.x; // x is given for the left eye
+    overlayHighlightY = cmd.y;
+    overlayHighlightR = cmd.dilation;
+    buildOverlayHighlight();
+  }
+  if (cmd.value & OVERLAY_SET_COLOR)
+    overlayLidColor = cmd.color;
+  if (cmd.value & (OVERLAY_SET_LID | OVERLAY_SET_COLOR)) {
+    if (cmd.value & OVERLAY_SET_LID)
+      overlayLid = cmd.lid;
+    buildOverlayLid();
+  }
+#ifdef USE_GIF_LAYER
+  if (cmd.value & OVERLAY_SET_GIF) {
+    strlcpy(layerGifName, cmd.name, sizeof(layerGifName));
+    layerGifX = panelMirrored ? tft.width() - cmd.x : cmd.x;
+    layerGifY = cmd.y;
+    layerGifPending = true; // `gif` may be decoding on the other core right now
+    if (!layerGifName[0])
+      closeGifLayer();
+  }
+#endif
+#ifdef USE_PNG_LAYER
+  if (cmd.value & OVERLAY_SET_PNG) {
+    pngLayerX = panelMirrored ? tft.width() - cmd.x : cmd.x;
+    pngLayerY = cmd.y;
+    showPngLayer(cmd.name);
+  }
+#endif
+}
+
+static void MyCustomDelay( unsigned long ms ) {
+  delay( ms );
+  // log_d("delay %d\n", ms);
+}
+
+#define SD_READAHEAD_SIZE (16 * 1024) // read-ahead window for GIF streaming, multiple of the sector size
+#define SD_SECTOR_SIZE 512
+#define SD_CS_PIN D2
+#define SD_SPI_FREQUENCIES 40000000, 26000000, 20000000, 16000000, 10000000 // tried fastest first, see tuneSdClock()
+#define SD_SPI_SAFE_FREQUENCY 4000000 // SD.begin()'s default, reads the reference of the verify sectors
+#define SD_TUNE_PASSES 3              // reads of the verify sectors that must all match at a clock
+#define USE_CONTIGUOUS_MEDIA          // card uploads take one run of clusters, media in one run are read by raw sectors
+#define SD_FATFS_DRIVE "0:"           // FatFs drive of the card, the only FAT volume (the flash store is LittleFS)
+// The card shares SCLK/MISO/MOSI with the panel on the XIAO round display, so every card read
+// waits for the strips in flight and takes the bus from them. Wired to pins of its own, the card
+// can go on the second SPI host and read while DMA keeps sending:
+// #define SD_SPI_SCK  D5
+// #define SD_SPI_MISO D4
+// #define SD_SPI_MOSI D7
+#ifdef SD_SPI_SCK
+static SPIClass sdSpi(HSPI); // the panel has FSPI
+#else
+#define sdSpi SPI
+#endif
+
+// GIFGetMoreData() reads a 1 byte length and then a 255 byte chunk per sub-block,
+// so serve those from a sector aligned window instead of hitting the card each time
+static uint8_t sdWindow[SD_READAHEAD_SIZE] __attribute__((aligned(4)));
+static int32_t sdWindowStart = 0; // file offset of sdWindow[0]
+static int32_t sdWindowLen = 0;   // valid bytes in sdWindow
+static int32_t sdFilePos = 0;     // current position of FSGifFile, to skip redundant seeks
+static uint32_t sdFileBase = 0;   // offset of the open file inside packFile, 0 for a file of its own
+static File *sdWindowFile = NULL; // file the window holds, for sdReadAhead()
+static int32_t sdWindowSize = 0;  // its size
+static int32_t sdNextPos = 0;     // where the last read through the window ended
+#ifdef USE_CONTIGUOUS_MEDIA
+// A file whose clusters follow each other on the card is read by sector numbers, in one
+// multi-block read per window fill, without FatFs following the cluster chain or the VFS
+// and File layers in between
+static uint32_t sdExtentSector = 0;   // first sector of the open file (of the pack for a packed one), 0 if not in one run
+static uint8_t sdExtentDrive = 0;     // its FatFs physical drive
+static uint32_t packExtentSector = 0; // the same for packFile, found when it is opened
+static uint8_t packExtentDrive = 0;
+#endif
+
+// Read the table of an asset pack; false if the file is not one
+static bool readPackTable(File &f, std::vector<PackedAsset> &assets)
+{
+  MediaPackHeader header;
+  if (f.read((uint8_t *)&header, sizeof(header)) != sizeof(header) ||
+      memcmp(header.magic, "EPAK", 4) != 0 || header.version != 1)
+    return false;
+  uint32_t size = f.size();
+  uint32_t tableEnd = sizeof(MediaPackHeader) + (uint32_t)header.count * sizeof(MediaPackEntry);
+  if (tableEnd > size)
+    return false;
+  assets.reserve(header.count);
+  for (int i = 0; i < header.count; i++) {
+    MediaPackEntry e;
+    if (f.read((uint8_t *)&e, sizeof(e)) != sizeof(e))
+      return false;
+    if (!memchr(e.name, 0, sizeof(e.name)) || e.offset < tableEnd || e.offset > size || e.size > size - e.offset)
+      continue;
+    PackedAsset asset = { e.name, e.offset, e.size };
+    assets.push_back(asset);
+  }
+  return true;
+}
+
+// Load the installed pack's table, an empty one without a pack
+static void loadAssetPack()
+{
+  std::vector<PackedAsset> assets;
+  File f = SD.open(ASSET_PACK_PATH);
+  if (f) {
+    if (!readPackTable(f, assets))
+      Serial.println("Ignoring " ASSET_PACK_PATH ", it is not an asset pack");
+    f.close();
+    Serial.printf("Asset pack: %u files\n", (unsigned)assets.size());
+  }
+  xSemaphoreTake(cacheLock, portMAX_DELAY);
+  packAssets.swap(assets);
+  xSemaphoreGive(cacheLock);
+}
+
+// Look up a /gif path in the asset pack; a file in the flash store shadows it
+static bool findPackedAsset(const char *path, PackedAsset *asset)
+{
+  if (strncmp(path, "/gif/", 5) != 0 || (flashStoreReady && LittleFS.exists(path)))
+    return false;
+  bool found = false;
+  xSemaphoreTake(cacheLock, portMAX_DELAY);
+  for (const PackedAsset &a : packAssets) {
+    if (a.name == path + 5) {
+      if (asset)
+        *asset = a;
+      found = true;
+      break;
+    }
+  }
+  xSemaphoreGive(cacheLock);
+  return found;
+}
+
+#ifdef USE_CONTIGUOUS_MEDIA
+// First sector of a file on the card whose clusters follow each other, 0 if they don't
+static uint32_t sdContiguousSector(const char *path, uint8_t *drive)
+{
+  char fatPath[128];
+  snprintf(fatPath, sizeof(fatPath), SD_FATFS_DRIVE "%s", path);
+  FIL fil;
+  if (f_open(&fil, fatPath, FA_READ) != FR_OK)
+    return 0;
+  FATFS *fs = fil.obj.fs;
+  uint32_t first = fil.obj.sclust, size = f_size(&fil);
+  uint32_t clusterBytes = (uint32_t)fs->csize * SD_SECTOR_SIZE;
+  bool contiguous = first >= 2 && size > 0;
+  // A forward seek follows the chain, fil.clust then holds the cluster of the byte before the position
+  for (uint32_t at = clusterBytes, i = 1; contiguous && at < size; at += clusterBytes, i++)
+    contiguous = f_lseek(&fil, at + 1) == FR_OK && fil.clust == first + i;
+  uint32_t sector = contiguous ? (uint32_t)(fs->database + (first - 2) * fs->csize) : 0;
+  *drive = fs->pdrv;
+  f_close(&fil);
+  return sector;
+}
+
+// Create `path` on the card with `size` bytes in one run of clusters, for the writes that follow
+static bool preallocateSdFile(const char *path, uint32_t size)
+{
+#if FF_USE_EXPAND
+  char fatPath[128];
+  snprintf(fatPath, sizeof(fatPath), SD_FATFS_DRIVE "%s", path);
+  FIL fil;
+  if (size == 0 || f_open(&fil, fatPath, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+    return false;
+  bool ok = f_expand(&fil, size, 1) == FR_OK; // FR_DENIED when no free run is long enough
+  f_close(&fil);
+  if (!ok)
+    f_unlink(fatPath);
+  return ok;
+#else
+  return false;
+#endif
+}
+
+// Cut a pre-allocated file back to what was written, freeing the clusters after it
+static bool truncateSdFile(const char *path, uint32_t size)
+{
+  char fatPath[128];
+  snprintf(fatPath, sizeof(fatPath), SD_FATFS_DRIVE "%s", path);
+  FIL fil;
+  if (f_open(&fil, fatPath, FA_WRITE) != FR_OK)
+    return false;
+  bool ok = f_lseek(&fil, size) == FR_OK && f_truncate(&fil) == FR_OK;
+  return f_close(&fil) == FR_OK && ok;
+}
+#endif
+
+// The player's handle on the asset pack, opened on first use and kept open
+static File *openAssetPack()
+{
+  if (!packFile && storageReady) {
+    packFile = SD.open(ASSET_PACK_PATH);
+#ifdef USE_CONTIGUOUS_MEDIA
+    packExtentSector = packFile ? sdContiguousSector(ASSET_PACK_PATH, &packExtentDrive) : 0;
+#endif
+  }
+  return packFile ? &packFile : NULL;
+}
+
+// Open a /gif path on the player task, positioned at its first byte. A packed file is read
+// through the pack's handle, which must not be closed; anything else is opened into `file`
+static File *openMediaFile(const char *path, File &file, int32_t *pSize, uint32_t *pBase)
+{
+  PackedAsset asset;
+  if (findPackedAsset(path, &asset)) {
+    File *pack = openAssetPack();
+    sdFilePos = -1; // the read-ahead window's file position no longer holds
+    if (!pack || !pack->seek(asset.offset))
+      return NULL;
+    *pSize = asset.size;
+    *pBase = asset.offset;
+    return pack;
+  }
+  file = mediaFs(path).open(path);
+  if (!file)
+    return NULL;
+  *pSize = file.size();
+  *pBase = 0;
+  return &file;
+}
+
+static void * GIFOpenFile(const char *fname, int32_t *pSize)
+{
+  // log_d("GIFOpenFile( %s )\n", fname );
+  uint32_t base;
+  File *f = openMediaFile(fname, FSGifFile, pSize, &base);
+  if (f) {
+    sdFileBase = base;
+    sdWindowStart = 0;
+    sdWindowLen = 0;
+    sdFilePos = 0;
+    sdWindowFile = f;
+    sdWindowSize = *pSize;
+    sdNextPos = 0;
+#ifdef USE_CONTIGUOUS_MEDIA
+    if (f == &packFile) {
+      sdExtentSector = packExtentSector;
+      sdExtentDrive = packExtentDrive;
+    } else {
+      bool onCard = !(flashStoreReady && LittleFS.exists(fname));
+      sdExtentSector = onCard ? sdContiguousSector(fname, &sdExtentDrive) : 0;
+    }
+#endif
+  }
+  return f;
+}
+
+static void GIFCloseFile(void *pHandle)
+{
+  File *f = static_cast<File *>(pHandle);
+  if (f == sdWindowFile)
+    sdWindowFile = NULL;
+  if (f != NULL && f != &packFile) // the pack stays open for the next file
+     f->close();
+}
+
+// Hand the bus to the card: on the shared bus the queued strips go out first and the panel's
+// chip select is released; on a bus of its own the card doesn't wait for the display
+static void claimSdBus()
+{
+#ifdef USE_FRAME_RING
+  if (decodingRing)
+    return; // the decoder task reads, the player releases the bus whenever it waits for strips
+#endif
+#ifndef SD_SPI_SCK
+  releaseDisplayBus();
+#endif
+}
+
+#ifdef USE_CONTIGUOUS_MEDIA
+// Whole sectors at a sector aligned `pos` of a file in one run, in one multi-block read; the
+// sector holding the end of the file too when pBuf has room for all of it. Returns the bytes
+// of the file read, 0 if none could be
+static int32_t sdReadSectors(int32_t pos, uint8_t *pBuf, int32_t iLen)
+{
+  uint32_t at = sdFileBase + pos;
+  int32_t want = std::min(iLen, sdWindowSize - pos);
+  if ((at & (SD_SECTOR_SIZE - 1)) || want <= 0)
+    return 0;
+  uint32_t count = want / SD_SECTOR_SIZE;
+  if (want % SD_SECTOR_SIZE && (count + 1) * SD_SECTOR_SIZE <= (uint32_t)iLen)
+    count++; // the bytes past the end are in the file's last cluster and never served
+  if (!count)
+    return 0;
+  uint32_t t0 = micros();
+  if (disk_read(sdExtentDrive, pBuf, sdExtentSector + at / SD_SECTOR_SIZE, count) != RES_OK)
+    return 0;
+  addStageTime(STAT_SD_READ, t0);
+  int32_t n = std::min<int32_t>(want, count * SD_SECTOR_SIZE);
+  traceSpan(TRACE_SD_READ, t0, n, 0);
+  frameSdBytes += n;
+  return n;
+}
+#endif
+
+// Read from the card at `pos` of the open file, seeking only when the file isn't already there
+static int32_t sdReadAt(File *f, int32_t pos, uint8_t *pBuf, int32_t iLen)
+{
+  claimSdBus();
+  int32_t raw = 0;
+#ifdef USE_CONTIGUOUS_MEDIA
+  if (sdExtentSector && f == sdWindowFile) {
+    raw = sdReadSectors(pos, pBuf, iLen);
+    if (raw == iLen || pos + raw >= sdWindowSize)
+      return raw;
+    pos += raw; // the rest of the last sector goes through the file
+    pBuf += raw;
+    iLen -= raw;
+  }
+#endif
+  if (sdFilePos != pos) {
+    if (!f->seek(sdFileBase + pos))
+      return raw;
+    sdFilePos = pos;
+  }
+  uint32_t t0 = micros();
+  int32_t iBytesRead = (int32_t)f->read(pBuf, iLen);
+  addStageTime(STAT_SD_READ, t0);
+  if (iBytesRead < 0)
+    iBytesRead = 0;
+  traceSpan(TRACE_SD_READ, t0, iBytesRead, 0);
+  sdFilePos += iBytesRead;
+  frameSdBytes += iBytesRead;
+  return raw + iBytesRead;
+}
+
+// Read iLen bytes at iPos of a file opened by GIFOpenFile(), through the read-ahead window
+static int32_t sdWindowRead(File *f, int32_t &iPos, int32_t iSize, uint8_t *pBuf, int32_t iLen)
+{
+  int32_t total = 0;
+  if (iLen > iSize - iPos)
+    iLen = iSize - iPos;
+  while (iLen > 0) {
+    int32_t offset = iPos - sdWindowStart;
+    if (offset >= 0 && offset < sdWindowLen) { // served from the window
+      int32_t n = std::min(iLen, sdWindowLen - offset);
+      memcpy(pBuf, &sdWindow[offset], n);
+      pBuf += n;
+      iPos += n;
+      total += n;
+      iLen -= n;
+    } else if (iLen >= SD_READAHEAD_SIZE) { // large reads bypass the window
+      int32_t n = sdReadAt(f, iPos, pBuf, iLen);
+      iPos += n;
+      total += n;
+      break;
+    } else { // refill starting at the sector holding iPos
+      sdWindowStart = iPos & ~(SD_SECTOR_SIZE - 1);
+      sdWindowLen = sdReadAt(f, sdWindowStart, sdWindow, SD_READAHEAD_SIZE);
+      if (sdWindowLen <= iPos - sdWindowStart)
+        break; // read error or unexpected end of file
+    }
+  }
+  sdNextPos = iPos;
+  return total;
+}
+
+// Between frames, with the strips sent: once less than half of the window is ahead of the
+// decoder, drop the sectors behind it and fill the rest in one burst from where the window
+// ends, so the next frame is decoded without taking the bus from its strips
+static void sdReadAhead()
+{
+  int32_t offset = sdNextPos - sdWindowStart;
+  if (!sdWindowFile || offset < 0 || offset > sdWindowLen || sdWindowLen - offset >= SD_READAHEAD_SIZE / 2)
+    return; // nothing open, the window was dropped or it still holds enough
+  int32_t end = sdWindowStart + sdWindowLen;
+  if (end >= sdWindowSize)
+    return; // the rest of the file is in already
+  int32_t drop = offset & ~(SD_SECTOR_SIZE - 1);
+  memmove(sdWindow, sdWindow + drop, sdWindowLen - drop);
+  sdWindowStart += drop;
+  sdWindowLen -= drop;
+  sdWindowLen += sdReadAt(sdWindowFile, end, sdWindow + sdWindowLen, SD_READAHEAD_SIZE - sdWindowLen);
+}
+
+// Clamp a seek target; only the logical position moves, the next read refills the window if needed
+static int32_t sdWindowSeek(int32_t &iPos, int32_t iSize, int32_t iPosition)
+{
+  if (iPosition < 0)
+    iPosition = 0;
+  if (iPosition > iSize)
+    iPosition = iSize;
+  iPos = iPosition;
+  return iPos;
+}
+
+static int32_t GIFReadFile(GIFFILE *pFile, uint8_t *pBuf, int32_t iLen)
+{
+  return sdWindowRead(static_cast<File *>(pFile->fHandle), pFile->iPos, pFile->iSize, pBuf, iLen);
+}
+
+static int32_t GIFSeekFile(GIFFILE *pFile, int32_t iPosition)
+{
+  return sdWindowSeek(pFile->iPos, pFile->iSize, iPosition);
+}
+
+// Lend the decoder the read-ahead window at iPos, so the LZW sub-blocks are de-chunked straight
+// out of it instead of being copied out chunk by chunk; the window is refilled there first if needed
+static int32_t GIFBorrowFile(GIFFILE *pFile, int32_t iPos, const uint8_t **ppData)
+{
+  File *f = static_cast<File *>(pFile->fHandle);
+  if (f != sdWindowFile || iPos >= pFile->iSize)
+    return 0;
+  int32_t offset = iPos - sdWindowStart;
+  if (offset < 0 || offset >= sdWindowLen) {
+    sdWindowStart = iPos & ~(SD_SECTOR_SIZE - 1);
+    sdWindowLen = sdReadAt(f, sdWindowStart, sdWindow, SD_READAHEAD_SIZE);
+    offset = iPos - sdWindowStart;
+    if (sdWindowLen <= offset)
+      return 0; // read error or unexpected end of file
+  }
+  sdNextPos = iPos;
+  *ppData = &sdWindow[offset];
+  return std::min(sdWindowLen, pFile->iSize - sdWindowStart) - offset;
+}
+
+// GIF fetched from a URL (/fetch): a reader task on the web server's core pulls the file into a
+// PSRAM ring while the player decodes it from there, so it never goes through the card first and
+// the first frame shows as soon as its bytes are in. The ring is bounded: while it is full the
+// reader stops reading the socket, which closes the TCP window until the decoder catches up, and
+// FETCH_KEEP bytes behind the decoder stay for its short seeks back. With ?save= the bytes are
+// also written to the card and listed as /gif/<save> once the whole file arrived
+#define FETCH_RING (256 * 1024)
+#define FETCH_KEEP (8 * 1024)
+#define FETCH_TIMEOUT_MS 5000
+#define FETCH_MAX_BYTES (UPLOAD_MAX_SIZE) // also the size assumed without a Content-Length
+#define FETCH_PATH "/gif/.fetch.gif"      // what the player plays a fetched GIF as
+#define FETCH_TEMP_PATH "/gif/.fetch.tmp"
+
+static uint8_t *fetchRing = NULL;        // PSRAM, file offset o at fetchRing[o % FETCH_RING]
+static volatile int32_t fetchHead = 0;   // bytes received, the offset the reader writes next
+static volatile int32_t fetchKeep = 0;   // oldest offset still in the ring
+static volatile int32_t fetchPos = 0;    // offset the decoder reads next
+static volatile int32_t fetchSize = -1;  // Content-Length, -1 if the server didn't send one
+static TaskHandle_t fetchTask = NULL;
+static char fetchUrl[160] = "";          // set by /fetch before the reader is started
+static char fetchSave[64] = "";          // name to keep the file under, empty for none
+static volatile bool fetchRunning = false;  // the reader is connected or connecting
+static volatile bool fetchStop = false;     // to the reader: close the connection
+static volatile bool fetchDetached = false; // the player is done with the ring, only the card copy goes on
+static bool fetchSaved = false;
+static uint32_t fetchStalls = 0; // reads the reader held back while the ring was full
+static uint32_t fetchWaits = 0;  // decoder reads that waited for data
+
+// Player: wait until the byte at iPos arrived; false if the fetch ended before it, it was already
+// dropped from the ring, or a new command came
+static bool fetchWait(int32_t iPos)
+{
+  uint32_t since = millis();
+  bool waited = false;
+  while (iPos >= __atomic_load_n(&fetchHead, __ATOMIC_ACQUIRE)) {
+    if (!fetchRunning || renderCancelled() || millis() - since > FETCH_TIMEOUT_MS)
+      return false;
+    if (!waited)
+      fetchWaits++;
+    waited = true;
+    vTaskDelay(1);
+  }
+  return iPos >= fetchKeep;
+}
+
+// Bytes in one piece from iPos on, up to what arrived or the end of the ring
+static int32_t fetchSpan(int32_t iPos, const uint8_t **ppData)
+{
+  int32_t at = iPos % FETCH_RING;
+  *ppData = fetchRing + at;
+  return std::min(__atomic_load_n(&fetchHead, __ATOMIC_ACQUIRE) - iPos, FETCH_RING - at);
+}
+
+// Without a Content-Length the file ends where the connection did
+static void fetchClampSize(GIFFILE *pFile)
+{
+  if (fetchSize < 0 && !fetchRunning)
+    pFile->iSize = std::min(pFile->iSize, (int32_t)fetchHead);
+}
+
+static void *GIFOpenFetch(const char *fname, int32_t *pSize)
+{
+  if (fetchKeep > 0)
+    return NULL; // the start of the file is gone
+  fetchDetached = false;
+  *pSize = fetchSize >= 0 ? fetchSize : FETCH_MAX_BYTES;
+  fetchPos = 0;
+  return fetchRing;
+}
+
+static void GIFCloseFetch(void *pHandle)
+{
+  fetchDetached = true;
+}
+
+static int32_t GIFReadFetch(GIFFILE *pFile, uint8_t *pBuf, int32_t iLen)
+{
+  int32_t total = 0;
+  fetchPos = pFile->iPos; // before the wait, so the reader keeps it
+  while (iLen > 0 && pFile->iPos < pFile->iSize && fetchWait(pFile->iPos)) {
+    const uint8_t *p;
+    int32_t n = std::min(iLen, fetchSpan(pFile->iPos, &p));
+    memcpy(pBuf, p, n);
+    pBuf += n;
+    total += n;
+    iLen -= n;
+    pFile->iPos += n;
+    fetchPos = pFile->iPos;
+  }
+  fetchClampSize(pFile);
+  return total;
+}
+
+static int32_t GIFSeekFetch(GIFFILE *pFile, int32_t iPosition)
+{
+  pFile->iPos = std::max<int32_t>(0, std::min(iPosition, pFile->iSize));
+  fetchPos = pFile->iPos;
+  return pFile->iPos;
+}
+
+// The ring itself is lent; what follows iPos isn't reclaimed before the next call moves fetchPos
+static int32_t GIFBorrowFetch(GIFFILE *pFile, int32_t iPos, const uint8_t **ppData)
+{
+  fetchPos = iPos;
+  if (iPos >= pFile->iSize || !fetchWait(iPos)) {
+    fetchClampSize(pFile);
+    return 0;
+  }
+  return fetchSpan(iPos, ppData);
+}
+
+static bool installUpload(fs::FS &store, const char *tempPath, const String &name, const char *md5);
+
+// Split http://host[:port]/path
+static void splitHttpUrl(const String &url, String &host, uint16_t &port, String &path)
+{
+  int hostStart = url.indexOf("://") + 3, pathStart = url.indexOf('/', hostStart);
+  host = url.substring(hostStart, pathStart < 0 ? url.length() : pathStart);
+  path = pathStart < 0 ? "/" : url.substring(pathStart);
+  port = 80;
+  int colon = host.indexOf(':');
+  if (colon >= 0) {
+    port = host.substring(colon + 1).toInt();
+    host = host.substring(0, colon);
+  }
+}
+
+// Reader task: GET fetchUrl, queue the play once the headers are in, then fill the ring (and the
+// card copy) until the file is complete or the fetch is stopped
+static void readFetch()
+{
+  String host, path;
+  uint16_t port;
+  splitHttpUrl(fetchUrl, host, port, path);
+  WiFiClient client;
+  if (!client.connect(host.c_str(), port, FETCH_TIMEOUT_MS)) {
+    Serial.println("Fetch: cannot connect to " + host);
+    return;
+  }
+  // HTTP/1.0 keeps the body free of chunked transfer encoding
+  client.print("GET " + path + " HTTP/1.0\r\nHost: " + host + "\r\n\r\n");
+  client.setTimeout(FETCH_TIMEOUT_MS);
+  String line = client.readStringUntil('\n');
+  if (line.indexOf(" 200") < 0) {
+    Serial.println("Fetch: " + line);
+    return;
+  }
+  int32_t length = -1;
+  for (;;) {
+    line = client.readStringUntil('\n');
+    line.trim();
+    if (!line.length())
+      break;
+    line.toLowerCase();
+    if (line.startsWith("content-length:"))
+      length = line.substring(15).toInt();
+  }
+  if (length > FETCH_MAX_BYTES) {
+    Serial.printf("Fetch: %ld bytes is too large\n", (long)length);
+    return;
+  }
+  File tee;
+  MD5Builder md5; // for the catalog, like an upload's
+  if (fetchSave[0]) {
+    SD.remove(FETCH_TEMP_PATH);
+    tee = SD.open(FETCH_TEMP_PATH, FILE_WRITE);
+    md5.begin();
+  }
+  fetchSize = length;
+  fetchHead = fetchKeep = fetchPos = 0;
+  fetchDetached = false;
+  if (!queueDisplayCommand(CMD_PLAY, FETCH_PATH, 1000)) // rate in thousandths
+    fetchDetached = true;
+  uint32_t lastData = millis();
+  int32_t head = 0;
+  while (!fetchStop && (length < 0 || head < length)) {
+    if (fetchDetached && !tee)
+      break; // nobody wants the rest
+    int32_t room = FETCH_RING - (head - fetchKeep);
+    if (room == 0 && !fetchDetached) { // drop what the decoder is done with, or wait for it
+      int32_t keep = std::min(head, __atomic_load_n(&fetchPos, __ATOMIC_ACQUIRE) - FETCH_KEEP);
+      if (keep > fetchKeep) {
+        fetchKeep = keep;
+      } else {
+        fetchStalls++;
+        vTaskDelay(1);
+        lastData = millis(); // the decoder is behind, not the server
+      }
+      continue;
+    }
+    if (fetchDetached)
+      room = FETCH_RING; // the ring is only a buffer for the card copy now
+    int available = client.available();
+    if (available <= 0) {
+      if (!client.connected() || millis() - lastData > FETCH_TIMEOUT_MS)
+        break;
+      vTaskDelay(1);
+      continue;
+    }
+    int32_t n = std::min({ (int32_t)available, room, FETCH_RING - head % FETCH_RING,
+                           length >= 0 ? length - head : INT32_MAX });
+    int got = client.read(fetchRing + head % FETCH_RING, n);
+    if (got <= 0)
+      continue;
+    if (tee && tee.write(fetchRing + head % FETCH_RING, got) != (size_t)got) {
+      tee.close();
+      SD.remove(FETCH_TEMP_PATH);
+    } else if (tee) {
+      md5.add(fetchRing + head % FETCH_RING, got);
+    }
+    head += got;
+    if (fetchDetached)
+      fetchKeep = head; // nothing is kept for the decoder
+    __atomic_store_n(&fetchHead, head, __ATOMIC_RELEASE);
+    lastData = millis();
+  }
+  bool complete = length >= 0 ? head == length : !fetchStop && !client.connected();
+  if (tee) {
+    tee.close();
+    md5.calculate();
+    fetchSaved = complete && installUpload(SD, FETCH_TEMP_PATH, fetchSave, md5.toString().c_str());
+    if (!fetchSaved)
+      SD.remove(FETCH_TEMP_PATH);
+  }
+  Serial.printf("Fetch %s: %ld bytes%s%s\n", fetchUrl, (long)head, complete ? "" : ", incomplete",
+                fetchSaved ? ", saved" : "");
+}
+
+static void fetchTaskLoop(void *param)
+{
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    readFetch();
+    fetchRunning = false;
+  }
+}
+
+void stopFetch()
+{
+  fetchStop = true;
+  while (fetchRunning)
+    delay(1);
+}
+
+// Web task: fetch and play `url`, replacing a fetch still running; false without PSRAM
+bool startFetch(const char *url, const char *save)
+{
+  if (!fetchRing)
+    fetchRing = psramFound() ? (uint8_t *)ps_malloc(FETCH_RING) : NULL;
+  if (!fetchRing)
+    return false;
+  stopFetch();
+  strlcpy(fetchUrl, url, sizeof(fetchUrl));
+  strlcpy(fetchSave, save, sizeof(fetchSave));
+  fetchSaved = false;
+  fetchStop = false;
+  fetchRunning = true;
+  if (!fetchTask)
+    xTaskCreatePinnedToCore(fetchTaskLoop, "fetch", FETCH_STACK_SIZE, NULL, 1, &fetchTask, 1 - PLAYER_CORE);
+  xTaskNotifyGive(fetchTask);
+  return true;
+}
+
+#ifdef USE_JPEGDEC
+// JPEGDEC reads through the same window, opened and closed with GIFOpenFile()/GIFCloseFile()
+static int32_t JPEGReadFile(JPEGFILE *pFile, uint8_t *pBuf, int32_t iLen)
+{
+  return sdWindowRead(static_cast<File *>(pFile->fHandle), pFile->iPos, pFile->iSize, pBuf, iLen);
+}
+
+static int32_t JPEGSeekFile(JPEGFILE *pFile, int32_t iPosition)
+{
+  return sdWindowSeek(pFile->iPos, pFile->iSize, iPosition);
+}
+#endif
+
+static void TFTDraw(int x, int y, int w, int h, uint16_t* lBuf )
+{
+  uint32_t t0 = micros();
+#ifdef USE_DMA
+  tft.dmaWait(); // blocking writes must not interleave with a running DMA transfer
+#endif
+  tft.pushRect( x+xOffset, y+yOffset, w, h, lBuf );
+  noteFirstPixel();
+  addStageTime(STAT_TRANSFER, t0);
+}
+
+// Send one line of GIF palette indices, looked up as they fill the SPI buffer; transparent < 0 for none
+static void TFTDrawIndexed(int x, int y, int w, uint8_t *pixels, uint16_t *palette, int transparent)
+{
+  uint32_t t0 = micros();
+#ifdef USE_DMA
+  tft.dmaWait(); // blocking writes must not interleave with a running DMA transfer
+#endif
+  if (transparent < 0)
+    tft.pushImage(x + xOffset, y + yOffset, w, 1, pixels, true, palette);
+  else
+    tft.pushImage(x + xOffset, y + yOffset, w, 1, pixels, (uint8_t)transparent, true, palette);
+  noteFirstPixel();
+  addStageTime(STAT_TRANSFER, t0);
+}
+
+static bool playbackPreempted();
+
+#define FRAME_WAIT_SLICE_MS 10 // longest block between two looks at playingDropped
+
+// Sleep for the given number of milliseconds; false if a new command preempted playback.
+// Blocks on the queue rather than polling it every tick, so a long frame lets the CPU idle, and a
+// still held for IDLE_AFTER_MS or more (a playlist JPEG, a long GIF frame) lets the governor step down
+static bool waitFrame(unsigned long ms)
+{
+  unsigned long frameStart = millis();
+  bool still = ms >= IDLE_AFTER_MS;
+  playerStatic = still;
+  bool preempted = false;
+  while (millis() - frameStart < ms && !(preempted = playbackPreempted())) {
+    DisplayCommand cmd;
+    unsigned long left = ms - (millis() - frameStart);
+    xQueuePeek(displayQueue, &cmd, std::max<TickType_t>(1, pdMS_TO_TICKS(std::min<unsigned long>(left, FRAME_WAIT_SLICE_MS))));
+  }
+  playerStatic = false;
+  if (still && powerIdle)
+    noteActivity(); // the next frame is drawn at full clock
+  return !preempted;
+}
+
+// Player task, QUALITY_STATIC: keep the frame on screen with the player static until a command
+// arrives (false) or the profile changes (true)
+static bool holdStaticFrame()
+{
+  playerStatic = true;
+  bool preempted = false;
+  while (qualityProfile == QUALITY_STATIC && !(preempted = playbackPreempted())) {
+    DisplayCommand cmd;
+    xQueuePeek(displayQueue, &cmd, pdMS_TO_TICKS(QUALITY_HOLD_POLL_MS));
+  }
+  playerStatic = false;
+  if (powerIdle)
+    noteActivity();
+  return !preempted;
+}
+
+// Sleep until the given sync clock time; false if preempted
+static bool waitUntil(uint32_t startAt)
+{
+  long early = (long)(startAt - syncMillis());
+  return early <= 0 || waitFrame(early);
+}
+
+// Transitions between images: the outgoing screen is kept from the shadow buffer, the first frame
+// of the incoming one is drawn under panel hold (shadow only), and the two are blended on the panel
+enum TransitionType { TRANSITION_NONE, TRANSITION_FADE, TRANSITION_IRIS, TRANSITION_LID };
+static const char *transitionNames[] = { "none", "fade", "iris", "lid" };
+#define TRANSITION_MS 300         // default length
+#define TRANSITION_MAX_MS 2000
+#define TRANSITION_STEP_MS 20     // one blended frame, 50 fps
+#define TRANSITION_ROWS 16        // rows per push
+static volatile uint8_t transitionType = TRANSITION_NONE; // set by /transition
+static volatile uint16_t transitionMs = TRANSITION_MS;
+static uint16_t *transitionFrom = NULL, *transitionTo = NULL; // outgoing and incoming screen in PSRAM, native order
+static bool transitionPending = false; // the incoming frame is being drawn off screen
+
+// Before a new image: keep the screen as the outgoing frame and draw the incoming one off screen
+static void beginTransition()
+{
+  uint16_t *shadow = tft.getShadowBuffer();
+  if (transitionType == TRANSITION_NONE || !shadow || transitionPending)
+    return;
+  size_t bytes = (size_t)tft.width() * tft.height() * sizeof(uint16_t);
+  if (!transitionFrom) {
+    transitionFrom = (uint16_t *)ps_malloc(bytes);
+    transitionTo = (uint16_t *)ps_malloc(bytes);
+    if (!transitionFrom || !transitionTo) {
+      free(transitionFrom);
+      free(transitionTo);
+      transitionFrom = transitionTo = NULL;
+      return;
+    }
+  }
+  releaseDisplayBus();
+#ifdef USE_DMA
+  tft.dmaWait();
+#endif
+  memcpy(transitionFrom, shadow, bytes);
+  tft.setPanelHold(true);
+  transitionPending = true;
+}
+
+// RGB565 a..b by alpha 0-32, all three channels at once in one 32-bit word
+static inline uint16_t blend565(uint16_t a, uint16_t b, uint32_t alpha)
+{
+  uint32_t x = (a | (uint32_t)a << 16) & 0x07E0F81F;
+  uint32_t y = (b | (uint32_t)b << 16) & 0x07E0F81F;
+  uint32_t r = ((x * (32 - alpha) + y * alpha) >> 5) & 0x07E0F81F;
+  return (uint16_t)(r | r >> 16);
+}
+
+// Half width of the iris wipe's opening on row y at progress p (0-256); 256 uncovers the corners
+static int irisHalfWidth(int y, int p)
+{
+  int w = tft.width(), h = tft.height();
+  int maxR = (int)sqrtf((float)(w * w + h * h)) / 2 + 1;
+  float r = (float)maxR * p / 256, dy = y + 0.5f - h / 2.0f;
+  return r > fabsf(dy) ? (int)sqrtf(r * r - dy * dy) : 0;
+}
+
+// What row y shows at progress p of the lid wipe: 0 lid (black), 1 outgoing, 2 incoming
+static int lidRowState(int y, int p)
+{
+  int h = tft.height();
+  int lid = (p <= 128 ? p : 256 - p) * (h / 2) / 128; // rows covered from the top and from the bottom
+  if (y < lid || y >= h - lid)
+    return 0;
+  return p < 128 ? 1 : 2;
+}
+
+// Columns of row y that change from progress p0 to p1, false if none
+static bool transitionSpan(int y, int p0, int p1, int *x0, int *x1)
+{
+  int w = tft.width();
+  *x0 = 0;
+  *x1 = w;
+  switch (transitionType) {
+    case TRANSITION_FADE:
+      return memcmp(transitionFrom + y * w, transitionTo + y * w, w * sizeof(uint16_t)) != 0;
+    case TRANSITION_IRIS: {
+      int half = irisHalfWidth(y, p1);
+      if (half <= irisHalfWidth(y, p0))
+        return false;
+      *x0 = std::max(0, w / 2 - half);
+      *x1 = std::min(w, w / 2 + half);
+      return true;
+    }
+    default:
+      return lidRowState(y, p0) != lidRowState(y, p1);
+  }
+}
+
+// Pixels x0..x1-1 of row y at progress p, in panel byte order
+static void transitionRow(uint16_t *out, int y, int x0, int x1, int p)
+{
+  int w = tft.width();
+  const uint16_t *from = transitionFrom + y * w, *to = transitionTo + y * w;
+  int half = transitionType == TRANSITION_IRIS ? irisHalfWidth(y, p) : 0;
+  int state = transitionType == TRANSITION_LID ? lidRowState(y, p) : 0;
+  for (int x = x0; x < x1; x++) {
+    uint16_t c;
+    if (transitionType == TRANSITION_FADE)
+      c = blend565(from[x], to[x], p >> 3);
+    else if (transitionType == TRANSITION_IRIS)
+      c = abs(2 * x + 1 - w) < 2 * half ? to[x] : from[x];
+    else
+      c = state == 0 ? TFT_BLACK : state == 1 ? from[x] : to[x];
+    *out++ = c >> 8 | c << 8;
+  }
+}
+
+// Send the rows that change from progress p0 to p1, runs of full rows go out together
+static void drawTransitionStep(int p0, int p1)
+{
+  static uint16_t lines[TFT_WIDTH * TRANSITION_ROWS];
+  int w = tft.width();
+  int blockY = 0, blockRows = 0, blockX0 = 0, blockX1 = 0;
+  for (int y = 0; y <= tft.height(); y++) {
+    int x0 = 0, x1 = 0;
+    bool changed = y < tft.height() && transitionSpan(y, p0, p1, &x0, &x1);
+    bool extends = changed && blockRows && x0 == blockX0 && x1 == blockX1 && y == blockY + blockRows &&
+                   blockRows < TRANSITION_ROWS && x1 - x0 == w;
+    if (blockRows && !extends) {
+      tft.pushRect(blockX0, blockY, blockX1 - blockX0, blockRows, lines);
+      blockRows = 0;
+    }
+    if (!changed)
+      continue;
+    if (!blockRows) {
+      blockY = y;
+      blockX0 = x0;
+      blockX1 = x1;
+    }
+    transitionRow(lines + blockRows * (x1 - x0), y, x0, x1, p1);
+    blockRows++;
+  }
+}
+
+// After the first frame of the new image: show the transition to it on the panel; returns the
+// ms it took, which the caller's frame clock skips. A preempted transition ends on the new frame
+static uint32_t finishTransition()
+{
+  if (!transitionPending)
+    return 0;
+  transitionPending = false;
+  releaseDisplayBus();
+#ifdef USE_DMA
+  tft.dmaWait();
+#endif
+  tft.setPanelHold(false);
+  uint32_t start = millis();
+  memcpy(transitionTo, tft.getShadowBuffer(), (size_t)tft.width() * tft.height() * sizeof(uint16_t));
+  int steps = std::max(1, transitionMs / TRANSITION_STEP_MS);
+  int shown = 0; // progress on the panel, 0-256
+  for (int i = 1; i <= steps; i++) {
+    uint32_t stepStart = millis();
+    int p = i * 256 / steps;
+    drawTransitionStep(shown, p);
+    shown = p;
+    uint32_t took = millis() - stepStart;
+    if (i < steps && !waitFrame(took < TRANSITION_STEP_MS ? TRANSITION_STEP_MS - took : 0)) {
+      drawTransitionStep(shown, 256);
+      break;
+    }
+  }
+  return millis() - start;
+}
+
+static void startClock(FrameClock &clock, float rate, uint32_t startAt)
+{
+  clock.start = startAt ? startAt : syncMillis();
+  clock.due = 0;
+  clock.rate = rate;
+  clock.shownAt = syncMillis();
+  clock.behind = 0;
+}
+
+// Wait until the frame that was just drawn has been shown for its delay; false if preempted.
+// Late frames are shown immediately to catch up, unless playback fell too far behind.
+static bool waitNextFrame(FrameClock &clock, int frameDelayMs)
+{
+  uint32_t transition = finishTransition(); // the first frame of an image ends its transition
+  clock.start += transition;
+  clock.shownAt += transition;
+  float targetMs = frameDelayMs / clock.rate;
+  clock.due += targetMs;
+  long late = (long)(syncMillis() - clock.start) - (long)clock.due;
+  uint32_t dropped = 0;
+  clock.behind = std::max(0L, late);
+  if (late > MAX_FRAME_LAG) {
+    clock.due += late; // give up on the lost time rather than rushing through frames
+    clock.behind = 0;
+    dropped = targetMs >= 1 ? (uint32_t)(late / targetMs) : 0; // frames' worth of time skipped
+  }
+  uint16_t minFrameMs = qualityProfiles[qualityProfile].minFrameMs;
+  long hold = (long)minFrameMs - (long)(syncMillis() - clock.shownAt); // the quality profile's frame rate cap
+  bool keepPlaying = (late >= 0 && hold <= 0) ? !playbackPreempted() : waitFrame(std::max(-late, hold));
+  uint32_t now = syncMillis();
+  recordFramePacing(targetMs, now - clock.shownAt, late > 0 && !minFrameMs, dropped); // capped frames are late by design
+  if (keepPlaying && qualityProfile == QUALITY_STATIC) {
+    keepPlaying = holdStaticFrame();
+    now = syncMillis();
+  }
+  clock.shownAt = now;
+  return keepPlaying;
+}
+
+// Whether the next frame's whole delay has already passed and the frame after it covers the canvas:
+// then it would not be seen; gif.skipFrame() steps over it, or decoding it only into the frame
+// buffer saves its transfer
+static bool skipNextFrame(const FrameClock &clock)
+{
+  int next = gif.getFrame();
+  if (!clock.behind || next + 1 >= gif.getIndexedFrames())
+    return false;
+  return clock.behind >= gifFrameIndex[next].iDelay / clock.rate && (gifFrameIndex[next + 1].ucFlags & GIF_FRAME_KEY);
+}
+
+// Account for a frame decoded without drawing; the frame before it stays on screen. False if preempted
+static bool skipFrameTime(FrameClock &clock, int frameDelayMs)
+{
+  clock.due += frameDelayMs / clock.rate;
+  long late = (long)(syncMillis() - clock.start) - (long)clock.due;
+  clock.behind = std::max(0L, late);
+  portENTER_CRITICAL(&statsMux);
+  currentStatSlot().dropped++;
+  portEXIT_CRITICAL(&statsMux);
+  return !playbackPreempted();
+}
+
+static void freeCachedGif(CachedGif *entry)
+{
+  for (CachedFrame &f : entry->frames)
+    free(f.pixels);
+  delete entry;
+}
+
+CachedGif *findCachedGif(const char *name)
+{
+  for (CachedGif *entry : frameCache) {
+    if (entry->name == name)
+      return entry;
+  }
+  return NULL;
+}
+
+GifBlob *findGifBlob(const char *name)
+{
+  for (GifBlob &blob : gifBlobs) {
+    if (blob.name == name)
+      return &blob;
+  }
+  return NULL;
+}
+
+const BuiltinGif *findBuiltinGif(const char *path)
+{
+  for (const BuiltinGif &b : flashGifs) {
+    if (strcmp(b.path, path) == 0)
+      return &b;
+  }
+  return NULL;
+}
+
+// Collect the compiled-in GIFs and map the media partition; a compiled-in GIF wins over a packed one
+static void initFlashGifs()
+{
+  for (const BuiltinGif *b = builtinGifs; b->path; b++) {
+    BuiltinGif gif = *b;
+    gif.progmem = true;
+    flashGifs.push_back(gif);
+  }
+  const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, MEDIA_PARTITION);
+  if (!part)
+    return;
+  const void *mapped;
+#if ESP_IDF_VERSION_MAJOR >= 5
+  esp_partition_mmap_handle_t handle;
+  esp_err_t err = esp_partition_mmap(part, 0, part->size, ESP_PARTITION_MMAP_DATA, &mapped, &handle);
+#else
+  spi_flash_mmap_handle_t handle;
+  esp_err_t err = esp_partition_mmap(part, 0, part->size, SPI_FLASH_MMAP_DATA, &mapped, &handle);
+#endif
+  if (err != ESP_OK) {
+    Serial.printf("Could not map the media partition: %s\n", esp_err_to_name(err));
+    return;
+  }
+  const uint8_t *base = (const uint8_t *)mapped;
+  const MediaPackHeader *header = (const MediaPackHeader *)base;
+  size_t tableEnd = sizeof(MediaPackHeader) + (size_t)header->count * sizeof(MediaPackEntry);
+  if (memcmp(header->magic, "EPAK", 4) != 0 || header->version != 1 || tableEnd > part->size) {
+    Serial.println("Media partition holds no media pack");
+    return; // stays mapped, it is only done once
+  }
+  const MediaPackEntry *entries = (const MediaPackEntry *)(base + sizeof(MediaPackHeader));
+  mediaPackPaths.reserve(header->count); // flashGifs points into the strings
+  for (int i = 0; i < header->count; i++) {
+    const MediaPackEntry &e = entries[i];
+    if (!memchr(e.name, 0, sizeof(e.name)) || e.offset < tableEnd || e.offset > part->size ||
+        e.size > part->size - e.offset)
+      continue;
+    const char *ext = strrchr(e.name, '.');
+    if (!ext || strcasecmp(ext, ".gif") != 0) // GIFs only, they are played like the compiled-in ones
+      continue;
+    mediaPackPaths.push_back(std::string("/gif/") + e.name);
+    if (findBuiltinGif(mediaPackPaths.back().c_str())) {
+      mediaPackPaths.pop_back();
+      continue;
+    }
+    BuiltinGif gif = { mediaPackPaths.back().c_str(), base + e.offset, (int32_t)e.size, false };
+    flashGifs.push_back(gif);
+  }
+  Serial.printf("Media partition: %u GIFs mapped\n", (unsigned)mediaPackPaths.size());
+}
+
+// Return the pinned copy of a small GIF, reading it from SD on first use. A hinted copy is read
+// ahead by /prefetch and stays evictable until it is asked for without a hint
+GifBlob *loadGifBlob(const char *name, bool hint = false)
+{
+  GifBlob *blob = findGifBlob(name);
+#ifdef USE_PREFETCH
+  if (blob && blob->hinted && !hint) {
+    blob->hinted = false; // played, pinned like any other from now on
+    prefetchHits++;
+  }
+#endif
+  if (blob || !psramFound() || gifRamThreshold <= 0)
+    return blob;
+
+  releaseDisplayBus();
+  File file;
+  int32_t size;
+  uint32_t base;
+  File *f = openMediaFile(name, file, &size, &base);
+  if (!f)
+    return NULL;
+  uint8_t *data = size > 0 && size <= gifRamThreshold ? (uint8_t *)ps_malloc(size) : NULL;
+  int32_t bytesRead = data ? (int32_t)f->read(data, size) : 0;
+  if (file)
+    file.close();
+  if (!data)
+    return NULL;
+  if (bytesRead != size) {
+    free(data);
+    return NULL;
+  }
+  GifBlob loaded = { name, data, size };
+  loaded.hinted = hint;
+  loaded.lastUsed = millis();
+  xSemaphoreTake(cacheLock, portMAX_DELAY);
+  gifBlobs.push_back(loaded);
+  blob = &gifBlobs.back();
+  xSemaphoreGive(cacheLock);
+  return blob;
+}
+
+#ifdef USE_PREFETCH
+static PrefetchedIndex *findPrefetchedIndex(const char *name)
+{
+  for (PrefetchedIndex &index : prefetchedIndexes) {
+    if (index.name == name)
+      return &index;
+  }
+  return NULL;
+}
+
+// Copy the prefetched frame index of a GIF being opened into gifFrameIndex; the entries copied
+static int usePrefetchedIndex(const char *name)
+{
+  PrefetchedIndex *index = findPrefetchedIndex(name);
+  if (!index)
+    return 0;
+  memcpy(gifFrameIndex, index->frames, index->count * sizeof(GIFFRAME));
+  index->lastUsed = millis();
+  if (!index->played) {
+    index->played = true;
+    prefetchHits++;
+  }
+  return index->count;
+}
+
+// PSRAM held by hinted GIFs and prefetched indexes; with cacheLock held
+static size_t prefetchedBytes()
+{
+  size_t bytes = 0;
+  for (const GifBlob &blob : gifBlobs)
+    bytes += blob.hinted ? blob.size : 0;
+  for (const PrefetchedIndex &index : prefetchedIndexes)
+    bytes += index.count * sizeof(GIFFRAME);
+  return bytes;
+}
+
+// Evict hinted GIFs and prefetched indexes, least recently used first, until `bytes` more fit
+// into prefetchBudget. Hinted GIFs are never open, playing one takes the hint off
+static bool trimPrefetched(size_t bytes)
+{
+  xSemaphoreTake(cacheLock, portMAX_DELAY);
+  size_t used = prefetchedBytes();
+  while (used + bytes > prefetchBudget) {
+    int blobAt = -1, indexAt = -1;
+    unsigned long oldest = ~0UL;
+    for (size_t i = 0; i < gifBlobs.size(); i++) {
+      if (gifBlobs[i].hinted && gifBlobs[i].lastUsed < oldest) {
+        oldest = gifBlobs[i].lastUsed;
+        blobAt = i;
+      }
+    }
+    for (size_t i = 0; i < prefetchedIndexes.size(); i++) {
+      if (prefetchedIndexes[i].lastUsed < oldest) {
+        oldest = prefetchedIndexes[i].lastUsed;
+        indexAt = i;
+        blobAt = -1;
+      }
+    }
+    if (indexAt >= 0) {
+      used -= prefetchedIndexes[indexAt].count * sizeof(GIFFRAME);
+      free(prefetchedIndexes[indexAt].frames);
+      prefetchedIndexes.erase(prefetchedIndexes.begin() + indexAt);
+    } else if (blobAt >= 0) {
+      used -= gifBlobs[blobAt].size;
+      free(gifBlobs[blobAt].data);
+      gifBlobs.erase(gifBlobs.begin() + blobAt);
+    } else {
+      break;
+    }
+    prefetchEvictions++;
+  }
+  xSemaphoreGive(cacheLock);
+  return used + bytes <= prefetchBudget;
+}
+
+static void dropPrefetchedIndex(const char *name)
+{
+  xSemaphoreTake(cacheLock, portMAX_DELAY);
+  for (size_t i = 0; i < prefetchedIndexes.size(); i++) {
+    if (prefetchedIndexes[i].name == name) {
+      free(prefetchedIndexes[i].frames);
+      prefetchedIndexes.erase(prefetchedIndexes.begin() + i);
+      break;
+    }
+  }
+  xSemaphoreGive(cacheLock);
+}
+
+static void clearPrefetchedIndexes()
+{
+  xSemaphoreTake(cacheLock, portMAX_DELAY);
+  for (PrefetchedIndex &index : prefetchedIndexes)
+    free(index.frames);
+  prefetchedIndexes.clear();
+  xSemaphoreGive(cacheLock);
+}
+#endif
+
+// Close the GIF kept open for replays, before its file or blob goes away or `gif` is needed for another one
+static void closeKeptGif()
+{
+  if (!keptGifName[0])
+    return;
+  gif.close();
+  keptGifName[0] = '\0';
+  keptGifData = NULL;
+}
+
+void clearGifBlobs()
+{
+  if (keptGifData)
+    closeKeptGif();
+  xSemaphoreTake(cacheLock, portMAX_DELAY);
+  for (GifBlob &blob : gifBlobs)
+    free(blob.data);
+  gifBlobs.clear();
+  xSemaphoreGive(cacheLock);
+}
+
+// Forget a cached GIF, e.g. because the file was replaced or deleted
+void dropCachedGif(const char *name)
+{
+  if (strcmp(name, playingName) == 0)
+    playingDropped = true; // stop before the next frame touches the freed data
+  releaseDisplayBus();
+  if (strcmp(name, keptGifName) == 0)
+    closeKeptGif();
+  SD.remove(nativePathFor(name).c_str()); // stale once the GIF changes
+  xSemaphoreTake(cacheLock, portMAX_DELAY);
+  for (size_t i = 0; i < gifBlobs.size(); i++) {
+    if (gifBlobs[i].name == name) {
+      free(gifBlobs[i].data);
+      gifBlobs.erase(gifBlobs.begin() + i);
+      break;
+    }
+  }
+  for (size_t i = 0; i < frameCache.size(); i++) {
+    if (frameCache[i]->name == name) {
+      frameCacheBytes -= frameCache[i]->bytes;
+      freeCachedGif(frameCache[i]);
+      frameCache.erase(frameCache.begin() + i);
+      break;
+    }
+  }
+  for (size_t i = 0; i < firstFrames.size(); i++) {
+    if (firstFrames[i].name == name) {
+      firstFrameBytes -= firstFrames[i].bytes;
+      free(firstFrames[i].runs);
+      firstFrames.erase(firstFrames.begin() + i);
+      break;
+    }
+  }
+  xSemaphoreGive(cacheLock);
+#ifdef USE_PREFETCH
+  dropPrefetchedIndex(name); // its offsets belong to the old file
+#endif
+}
+
+// Also drops the first frames, which have the same colours
+void clearFrameCache()
+{
+  xSemaphoreTake(cacheLock, portMAX_DELAY);
+  for (CachedGif *entry : frameCache)
+    freeCachedGif(entry);
+  frameCache.clear();
+  frameCacheBytes = 0;
+  for (FirstFrame &f : firstFrames)
+    free(f.runs);
+  firstFrames.clear();
+  firstFrameBytes = 0;
+  xSemaphoreGive(cacheLock);
+}
+
+// Evict least recently used GIFs until `bytes` more fit into the budget
+static bool reserveCacheBytes(size_t bytes)
+{
+  size_t recording = capture ? capture->bytes : 0;
+  xSemaphoreTake(cacheLock, portMAX_DELAY);
+  while (frameCacheBytes + recording + bytes > frameCacheBudget && !frameCache.empty()) {
+    size_t lru = 0;
+    for (size_t i = 1; i < frameCache.size(); i++) {
+      if (frameCache[i]->lastUsed < frameCache[lru]->lastUsed)
+        lru = i;
+    }
+    frameCacheBytes -= frameCache[lru]->bytes;
+    freeCachedGif(frameCache[lru]);
+    frameCache.erase(frameCache.begin() + lru);
+  }
+  xSemaphoreGive(cacheLock);
+  return frameCacheBytes + recording + bytes <= frameCacheBudget;
+}
+
+static void beginCapture(const char *name, int canvasW, int canvasH)
+{
+  if (!psramFound() || frameCacheBudget == 0)
+    return;
+  capture = new CachedGif();
+  capture->name = name;
+  capture->canvasW = canvasW;
+  capture->canvasH = canvasH;
+  capture->bytes = 0;
+  capture->lastUsed = millis();
+}
+
+static void captureFrameStart()
+{
+  captureNewFrame = (capture != NULL);
+}
+
+// Copy cooked line `line` of the frame into the frame being recorded; gives up if the budget is exhausted
+static void captureLine(GIFDRAW *pDraw, int line, const uint16_t *pCooked, int w)
+{
+  if (!capture)
+    return;
+  if (captureNewFrame) {
+    captureNewFrame = false;
+    size_t bytes = (size_t)w * pDraw->iHeight * sizeof(uint16_t);
+    uint16_t *pixels = NULL;
+    if (reserveCacheBytes(bytes))
+      pixels = (uint16_t *)ps_calloc(1, bytes);
+    if (!pixels) {
+      freeCachedGif(capture);
+      capture = NULL;
+      return;
+    }
+    CachedFrame f = { (int16_t)pDraw->iX, (int16_t)pDraw->iY, (uint16_t)w, (uint16_t)pDraw->iHeight, 0, pixels };
+    capture->frames.push_back(f);
+    capture->bytes += bytes;
+  }
+  CachedFrame &f = capture->frames.back();
+  memcpy(&f.pixels[line * f.w], pCooked, w * sizeof(uint16_t));
+}
+
+static void captureFrameEnd(int frameDelay)
+{
+  if (!capture)
+    return;
+  if (captureNewFrame) { // nothing was drawn, keep the delay anyway
+    CachedFrame f = { 0, 0, 0, 0, 0, NULL };
+    capture->frames.push_back(f);
+    captureNewFrame = false;
+  }
+  capture->frames.back().delayMs = frameDelay;
+}
+
+static void finishCapture(bool complete)
+{
+  if (!capture)
+    return;
+  if (complete && !capture->frames.empty()) {
+    xSemaphoreTake(cacheLock, portMAX_DELAY);
+    frameCacheBytes += capture->bytes;
+    frameCache.push_back(capture);
+    xSemaphoreGive(cacheLock);
+  } else {
+    freeCachedGif(capture);
+  }
+  capture = NULL;
+}
+
+// Step over the frames skipNextFrame() picks without reading them, as long as the index knows
+// where the next one starts. False if preempted
+static bool skipUnseenFrames(FrameClock &clock)
+{
+  int frameDelay;
+  while (skipNextFrame(clock) && gif.skipFrame(&frameDelay)) {
+    captureFrameEnd(frameDelay);
+    captureFrameStart();
+    if (!skipFrameTime(clock, frameDelay))
+      return false;
+  }
+  return true;
+}
+
+#ifdef USE_DECODE_AHEAD
+// Back frame buffer: while a frame is on screen the next one is decoded into this RGB565 copy of
+// the canvas, recording the rectangles it changed; when it is due only those are copied into the
+// strips, so the frame time is the longer of decode and transfer rather than their sum
+#define AHEAD_RECTS 48 // changed rectangles per frame, more are merged into the last one
+
+struct AheadRect {
+  int16_t x, y, w, h;
+};
+static uint16_t *aheadBuf = NULL; // from ARENA_AHEAD, reused across GIFs, only grows
+static int aheadPixels = 0;       // pixels allocated
+static int aheadW = 0, aheadH = 0;
+static AheadRect aheadRects[AHEAD_RECTS];
+static int aheadRectCount = 0;
+static bool decodingAhead = false; // GIFDraw() stores into aheadBuf instead of sending
+
+// Make room for a w x h back buffer, cleared like the frame buffer; false plays frames as they decode
+static bool reserveAheadBuffer(int w, int h)
+{
+  if (w * h > aheadPixels) {
+    arenaReset(ARENA_AHEAD);
+    aheadBuf = (uint16_t *)arenaTake(ARENA_AHEAD, (size_t)w * h * sizeof(uint16_t));
+    aheadPixels = aheadBuf ? w * h : 0;
+  }
+  if (!aheadBuf)
+    return false;
+  memset(aheadBuf, 0, (size_t)w * h * sizeof(uint16_t));
+  aheadW = w;
+  aheadH = h;
+  aheadRectCount = 0;
+  return true;
+}
+
+// Keep the changed span of a cooked line and add it to the frame's rectangles
+static void storeAheadLine(int x, int y, int w, const uint16_t *pixels)
+{
+  w = std::min(w, aheadW - x);
+  if (w <= 0 || y >= aheadH)
+    return;
+  memcpy(aheadBuf + y * aheadW + x, pixels, w * sizeof(uint16_t));
+  AheadRect *r = aheadRectCount ? &aheadRects[aheadRectCount - 1] : NULL;
+  if (r && r->x == x && r->w == w && r->y + r->h == y) {
+    r->h++;
+  } else if (aheadRectCount == AHEAD_RECTS) { // the buffer holds the whole canvas, sending more is harmless
+    int x0 = std::min<int>(r->x, x), y0 = std::min<int>(r->y, y);
+    int x1 = std::max<int>(r->x + r->w, x + w), y1 = std::max<int>(r->y + r->h, y + 1);
+    *r = { (int16_t)x0, (int16_t)y0, (int16_t)(x1 - x0), (int16_t)(y1 - y0) };
+  } else {
+    aheadRects[aheadRectCount++] = { (int16_t)x, (int16_t)y, (int16_t)w, 1 };
+  }
+}
+
+// Put the frame decoded ahead on screen: its rectangles go out as strips
+static void presentAheadFrame()
+{
+  bool cancelled = false; // the frame is left half sent, playback stops before the next
+  for (int i = 0; i < aheadRectCount && !cancelled; i++) {
+    const AheadRect &r = aheadRects[i];
+    const uint16_t *src = aheadBuf + r.y * aheadW + r.x;
+    for (int row = 0; row < r.h && !cancelled; row++, src += aheadW) {
+      memcpy(stripLine(r.x, r.y + row, r.w), src, r.w * sizeof(uint16_t));
+      if (++stripLines == DMA_STRIP_LINES) {
+        flushStrip();
+        cancelled = renderCancelled();
+      }
+    }
+  }
+  flushStrip();
+  aheadRectCount = 0;
+}
+#endif
+
+#ifdef USE_FRAME_RING
+// Two-stage pipeline: a decoder task on the other core runs AnimatedGIF and writes the cooked
+// strips into a single-producer/single-consumer ring in PSRAM, while the player drains the ring
+// to the panel through the DMA strips and keeps the frame clock. Each side only advances its
+// own index. A frame ends with an entry without lines that carries its delay and playFrame()'s
+// result. On the shared bus the card and the panel take turns through their SPI transactions
+#define FRAME_RING_STRIPS 32 // 32 * 3840 bytes, a whole 240 line frame fits
+
+struct RingStrip {
+  int16_t x, y, w, lines; // lines 0 marks the end of a frame
+  int16_t rc;             // end of frame: what playFrame() returned
+  uint16_t delayMs;
+  uint16_t *pixels;       // DISPLAY_WIDTH * DMA_STRIP_LINES, PSRAM
+};
+static RingStrip frameRing[FRAME_RING_STRIPS];
+static uint32_t ringHead = 0, ringTail = 0; // written only by the decoder / only by the player
+static bool ringFilling = false;            // decoder: the slot at ringHead has lines
+static volatile bool ringStop = false;      // player to decoder: finish the frame and stop
+static TaskHandle_t decoderTask = NULL, ringPlayer = NULL;
+static SemaphoreHandle_t ringStart = NULL, ringDone = NULL;
+
+// Allocate the strip buffers once; false plays frames as they decode
+static bool reserveFrameRing()
+{
+  if (!decoderTask || !psramFound())
+    return false;
+  for (RingStrip &s : frameRing) {
+    if (!s.pixels)
+      s.pixels = (uint16_t *)ps_malloc(DISPLAY_WIDTH * DMA_STRIP_LINES * sizeof(uint16_t));
+    if (!s.pixels)
+      return false;
+  }
+  return true;
+}
+
+// Decoder: wait for a free slot; false once the player asked to stop
+static bool ringWaitRoom()
+{
+  while (ringHead - __atomic_load_n(&ringTail, __ATOMIC_ACQUIRE) >= FRAME_RING_STRIPS && !ringStop)
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(5));
+  return !ringStop;
+}
+
+// Decoder: hand the slot at ringHead to the player
+static void ringPublish()
+{
+  ringFilling = false;
+  __atomic_store_n(&ringHead, ringHead + 1, __ATOMIC_RELEASE);
+  xTaskNotifyGive(ringPlayer);
+}
+
+// Decoder: next line of the strip being filled, publishing it first if the line doesn't continue
+// it; NULL when stopping
+static uint16_t *ringLine(int x, int y, int w)
+{
+  RingStrip *s = &frameRing[ringHead % FRAME_RING_STRIPS];
+  if (ringFilling && (x != s->x || w != s->w || y != s->y + s->lines)) {
+    ringPublish();
+    s = &frameRing[ringHead % FRAME_RING_STRIPS];
+  }
+  if (!ringFilling) {
+    if (!ringWaitRoom())
+      return NULL;
+    *s = { (int16_t)x, (int16_t)y, (int16_t)w, 0, 0, 0, s->pixels };
+    ringFilling = true;
+  }
+  return s->pixels + s->lines * w;
+}
+
+static void ringLineDone()
+{
+  if (++frameRing[ringHead % FRAME_RING_STRIPS].lines == DMA_STRIP_LINES)
+    ringPublish();
+}
+
+// Decoder: close the frame with its end entry; false when stopping
+static bool ringEndFrame(int rc, int frameDelay)
+{
+  if (ringFilling)
+    ringPublish();
+  if (!ringWaitRoom())
+    return false;
+  RingStrip *s = &frameRing[ringHead % FRAME_RING_STRIPS];
+  *s = { 0, 0, 0, 0, (int16_t)rc, (uint16_t)frameDelay, s->pixels };
+  ringPublish();
+  return true;
+}
+
+// Decoder task: plays the GIF set up by gifPlay() into the ring until it ends or is stopped
+static void decoderTaskLoop(void *)
+{
+  for (;;) {
+    xSemaphoreTake(ringStart, portMAX_DELAY);
+    int rc, frameDelay = 0;
+    do {
+      captureFrameStart();
+      rc = decodeGifFrame(&frameDelay);
+      if (rc >= 0)
+        captureFrameEnd(frameDelay);
+      if (!ringEndFrame(rc, frameDelay))
+        break;
+      sdReadAhead(); // the player sends the frame meanwhile
+    } while (rc > 0 && !ringStop);
+    ringFilling = false;
+    xSemaphoreGive(ringDone);
+  }
+}
+
+// Player: start the decoder on the open GIF
+static void startRingDecoder()
+{
+  ringHead = ringTail = 0;
+  ringStop = false;
+  ringPlayer = xTaskGetCurrentTaskHandle();
+  decodingRing = true;
+  xSemaphoreGive(ringStart);
+}
+
+// Player: wait for the next entry, releasing the bus while the ring is empty
+static RingStrip *ringNext()
+{
+  while (__atomic_load_n(&ringHead, __ATOMIC_ACQUIRE) == ringTail) {
+    releaseDisplayBus(); // the decoder may be waiting for the card
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(5));
+  }
+  return &frameRing[ringTail % FRAME_RING_STRIPS];
+}
+
+static void ringPop()
+{
+  __atomic_store_n(&ringTail, ringTail + 1, __ATOMIC_RELEASE);
+  xTaskNotifyGive(decoderTask);
+}
+
+// Player: stop the decoder and wait until it let go of `gif`
+static void stopRingDecoder()
+{
+  ringStop = true;
+  releaseDisplayBus();
+  xTaskNotifyGive(decoderTask);
+  xSemaphoreTake(ringDone, portMAX_DELAY);
+  decodingRing = false;
+}
+#endif
+
+// Draw a line of image directly on the LCD
+// Send one line span, lines with the same span share one DMA strip
+static void HOT_IRAM pushLineSpan(int x, int y, int w, const uint16_t *pixels, bool lastLine)
+{
+#ifdef USE_DMA
+  if (w > 0) {
+    memcpy(stripLine(x, y, w), pixels, w * sizeof(uint16_t));
+    if (++stripLines == DMA_STRIP_LINES)
+      flushStrip();
+  }
+  if (lastLine)
+    flushStrip();
+#else
+  if (w > 0)
+    TFTDraw( x, y, w, 1, (uint16_t *)pixels );
+#endif
+}
+
+void HOT_IRAM GIFDraw(GIFDRAW *pDraw)
+{
+  uint8_t *s;
+  uint16_t *d, *usPalette;
+  int x, y, iWidth;
+  bool lastLine = (pDraw->y == pDraw->iHeight - 1);
+
+  iWidth = pDraw->iWidth;
+  if (iWidth > DISPLAY_WIDTH)
+      iWidth = DISPLAY_WIDTH;
+  usPalette = pDraw->pPalette;
+  y = pDraw->iY + pDraw->y; // current line
+
+  if (gifCooked) { // transparency and disposal were already merged into the frame buffer
+    uint16_t *pCooked = (uint16_t *)pDraw->pPixels;
+    for (int line = 0; line < pDraw->iLines; line++)
+      captureLine(pDraw, pDraw->y + line, pCooked + line * pDraw->iPitch, iWidth);
+    int dirtyX = pDraw->iDirtyX; // whole line unless delta mode found unchanged pixels
+    int dirtyW = std::min(pDraw->iDirtyWidth, iWidth - dirtyX);
+#ifdef USE_FRAME_RING
+    if (decodingRing) { // drained by the player in gifPlay()
+      for (int line = 0; line < pDraw->iLines && dirtyW > 0; line++) {
+        uint16_t *d = ringLine(pDraw->iX + dirtyX, y + line, dirtyW);
+        if (!d)
+          break;
+        memcpy(d, pCooked + line * pDraw->iPitch + dirtyX, dirtyW * sizeof(uint16_t));
+        ringLineDone();
+      }
+      return;
+    }
+#endif
+#ifdef USE_DECODE_AHEAD
+    if (decodingAhead) { // sent by presentAheadFrame() when the frame is due
+      for (int line = 0; line < pDraw->iLines; line++)
+        storeAheadLine(pDraw->iX + dirtyX, y + line, dirtyW, pCooked + line * pDraw->iPitch + dirtyX);
+      return;
+    }
+#endif
+    if (renderCancelled())
+      return; // the rest of the frame is still decoded, not sent
+#ifdef USE_DMA
+    if (gifStrip && pCooked == gifStrip) { // the lines are already in the strip buffer
+      pushCookedStrip(pDraw->iX + dirtyX, y, dirtyW, pDraw->iLines, pDraw->iPitch, dirtyX);
+      return;
+    }
+#endif
+    pushLineSpan(pDraw->iX + dirtyX, y, dirtyW, pCooked + dirtyX, lastLine);
+    return;
+  }
+
+  if (renderCancelled())
+    return;
+  uint32_t t0 = micros(); // palette conversion and merging, sending is timed in flushStrip()
+  s = pDraw->pPixels;
+  if (pDraw->ucDisposalMethod == 2) {// restore to background color
+    for (x=0; x<iWidth; x++) {
+      if (s[x] == pDraw->ucTransparent)
+          s[x] = pDraw->ucBackground;
+    }
+    pDraw->ucHasTransparency = 0;
+  }
+
+  uint16_t *canvasRow = NULL; // this line of the RGB565 shadow canvas, if it covers the frame
+  if (rawCanvas && y < rawCanvasH && pDraw->iX + iWidth <= rawCanvasW)
+    canvasRow = &rawCanvas[y * rawCanvasW + pDraw->iX];
+
+  if (pDraw->ucDisposalMethod == 2 && canvasRow) {
+    // the line is opaque now, but most of it is often the background already shown: send what changed
+    uint16_t line[DISPLAY_WIDTH];
+    GIF_expandLine565(line, s, usPalette, iWidth);
+    int left = 0, right = iWidth;
+    while (left < right && line[left] == canvasRow[left])
+      left++;
+    while (right > left && line[right - 1] == canvasRow[right - 1])
+      right--;
+    memcpy(canvasRow + left, line + left, (right - left) * sizeof(uint16_t));
+    addStageTime(STAT_PALETTE, t0);
+    pushLineSpan(pDraw->iX + left, y, right - left, canvasRow + left, lastLine);
+    return;
+  }
+
+  // Apply the new pixels to the main image
+  if (pDraw->ucHasTransparency && canvasRow) {
+    // merge the opaque pixels into the shadow canvas and send the covered span in one go
+    int left, right;
+    GIF_blendLine565(canvasRow, s, usPalette, iWidth, pDraw->ucTransparent, &left, &right);
+    addStageTime(STAT_PALETTE, t0);
+    pushLineSpan(pDraw->iX + left, y, right - left, canvasRow + left, lastLine);
+  } else if (pDraw->ucHasTransparency) { // no shadow canvas, TFT_eSPI sends each opaque run
+    addStageTime(STAT_PALETTE, t0);
+    flushStrip(); // keep the lines in order on the display
+    TFTDrawIndexed(pDraw->iX, y, iWidth, s, usPalette, pDraw->ucTransparent);
+  } else {
+    s = pDraw->pPixels;
+#ifdef USE_DMA
+    // Translate straight into the strip buffer; it is sent once full or at the end of the frame
+    addStageTime(STAT_PALETTE, t0);
+    d = stripLine(pDraw->iX, y, iWidth); // may send the previous strip first
+    t0 = micros();
+    GIF_expandLine565(d, s, usPalette, iWidth);
+    if (canvasRow)
+      memcpy(canvasRow, d, iWidth * sizeof(uint16_t));
+    addStageTime(STAT_PALETTE, t0);
+    if (++stripLines == DMA_STRIP_LINES || lastLine)
+      flushStrip();
+#else
+    if (canvasRow) {
+      // Translate the 8-bit pixels through the RGB565 palette (already byte reversed) into the
+      // canvas, which is sent as it is
+      GIF_expandLine565(canvasRow, s, usPalette, iWidth);
+      addStageTime(STAT_PALETTE, t0);
+      TFTDraw( pDraw->iX, y, iWidth, 1, canvasRow );
+    } else {
+      addStageTime(STAT_PALETTE, t0);
+      TFTDrawIndexed(pDraw->iX, y, iWidth, s, usPalette, -1); // no RGB565 copy of the line at all
+    }
+#endif
+  }
+} /* GIFDraw() */
+
+static void pushCachedFrame(const CachedFrame &f)
+{
+#ifdef USE_DMA
+  const uint16_t *src = f.pixels;
+  for (int row = 0; row < f.h; row++, src += f.w) {
+    memcpy(stripLine(f.x, f.y + row, f.w), src, f.w * sizeof(uint16_t));
+    if (++stripLines == DMA_STRIP_LINES)
+      flushStrip();
+  }
+  flushStrip();
+#else
+  TFTDraw(f.x, f.y, f.w, f.h, f.pixels);
+#endif
+}
+
+// Replay a cached GIF with the same timing as the decoding path
+static int playCachedGif(CachedGif *entry, float rate, uint32_t startAt)
+{
+  FrameClock clock;
+  if (startAt)
+    waitUntil(startAt);
+  startClock(clock, rate, startAt);
+  entry->lastUsed = millis();
+  xOffset = ( tft.width()  - entry->canvasW ) /2;
+  yOffset = ( tft.height() - entry->canvasH ) /2;
+  clearCanvasBorder(entry->canvasW, entry->canvasH);
+
+  for (const CachedFrame &f : entry->frames) {
+    startFrameStats();
+    if (f.pixels)
+      pushCachedFrame(f);
+    releaseDisplayBus();
+    commitFrameStats();
+    if (clock.due > maxGifDuration)
+      break;
+    if (&f == &entry->frames.back())
+      readAheadPlaylist();
+    if (!waitNextFrame(clock, f.delayMs))
+      break; // don't touch the entry again, it may have been dropped
+  }
+  return (int)clock.due;
+}
+
+// Colour effect of GIFs (/color): hue rotation and tint make up the matrix, brightness and gamma
+// the curve of an AnimatedGIF colour transform, applied to each palette entry as it is converted.
+// One set of eye GIFs then serves every iris colour. A change takes effect with the next GIF;
+// the decoder kept for replays and the cached frames still have the old colours and are dropped
+struct ColorEffect {
+  int16_t hue;         // degrees, -180 to 180
+  uint8_t brightness;  // %, 100 leaves it
+  uint8_t tintAmount;  // % of the way from the colour to the tint at the same luminance
+  uint16_t tint;       // RGB565
+  uint16_t gamma;      // * 100, 100 leaves it
+};
+static const ColorEffect colorEffectNone = { 0, 100, 0, TFT_WHITE, 100 };
+static ColorEffect colorEffect = colorEffectNone;   // player task
+static ColorEffect colorSetting = colorEffectNone;  // web task, persisted, see /color
+static bool colorEffectPending = false;             // not applied to the decoder yet
+static GIFCOLORXFORM colorXform;
+
+static bool colorEffectActive(const ColorEffect &e)
+{
+  return e.hue || e.brightness != 100 || e.tintAmount || e.gamma != 100;
+}
+
+// Build colorXform from colorEffect
+static void buildColorTransform()
+{
+  const ColorEffect &e = colorEffect;
+  // Hue rotation around the luminance axis (as SVG's feHueRotate)
+  float c = cosf(e.hue * PI / 180), s = sinf(e.hue * PI / 180);
+  float hue[9] = {
+    0.213f + c * 0.787f - s * 0.213f, 0.715f - c * 0.715f - s * 0.715f, 0.072f - c * 0.072f + s * 0.928f,
+    0.213f - c * 0.213f + s * 0.143f, 0.715f + c * 0.285f + s * 0.140f, 0.072f - c * 0.072f - s * 0.283f,
+    0.213f - c * 0.213f - s * 0.787f, 0.715f - c * 0.715f + s * 0.715f, 0.072f + c * 0.928f + s * 0.072f,
+  };
+  // Tint: blend towards the tint colour scaled by the luminance
+  static const float luma[3] = { 0.213f, 0.715f, 0.072f };
+  float k = e.tintAmount / 100.0f;
+  float tint[3] = { ((e.tint >> 11) & 0x1F) / 31.0f, ((e.tint >> 5) & 0x3F) / 63.0f, (e.tint & 0x1F) / 31.0f };
+  for (int row = 0; row < 3; row++) {
+    for (int col = 0; col < 3; col++) {
+      float m = 0;
+      for (int i = 0; i < 3; i++) {
+        float t = (row == i ? 1 - k : 0) + k * tint[row] * luma[i]; // tint matrix, row x column i
+        m += t * hue[i * 3 + col];
+      }
+      colorXform.matrix[row * 3 + col] = (int16_t)lroundf(m * 256);
+    }
+    colorXform.offset[row] = 0;
+  }
+  float gamma = e.gamma / 100.0f;
+  for (int v = 0; v < 256; v++)
+    colorXform.curve[v] = (uint8_t)std::min(255L, lroundf(255 * powf(v / 255.0f, 1 / gamma) * e.brightness / 100));
+}
+
+// Player task: take a new effect from CMD_COLOR, applied when the next GIF starts
+static void applyColorCommand(const DisplayCommand &cmd)
+{
+  colorEffect.hue = cmd.x;
+  colorEffect.brightness = cmd.y;
+  colorEffect.tintAmount = cmd.lid;
+  colorEffect.tint = cmd.color;
+  colorEffect.gamma = cmd.value;
+  colorEffectPending = true;
+}
+
+// Web task: hand a new effect to the player; false if the queue stayed full
+static bool queueColorEffect(const ColorEffect &e)
+{
+  DisplayCommand cmd;
+  cmd.type = CMD_COLOR;
+  cmd.startAt = 0;
+  cmd.name[0] = '\0';
+  cmd.x = e.hue;
+  cmd.y = e.brightness;
+  cmd.lid = e.tintAmount;
+  cmd.color = e.tint;
+  cmd.value = e.gamma;
+  return sendDisplayCommand(cmd, pdMS_TO_TICKS(100));
+}
+
+static const FirstFrame *findFirstFrame(const char *name)
+{
+  for (const FirstFrame &f : firstFrames)
+    if (f.name == name)
+      return &f;
+  return NULL;
+}
+
+// Row y of the playing GIF's canvas as RGB565, from whichever copy of it this play keeps
+static const uint16_t *canvasRow565(int y, int w, uint16_t *line)
+{
+#ifdef USE_DECODE_AHEAD
+  if (decodingAhead)
+    return aheadBuf + y * aheadW;
+#endif
+  if (gifCooked) {
+    GIF_expandLine565(line, frameBuf + y * w, gif.getFramePalette(), w);
+    return line;
+  }
+  return rawCanvas ? rawCanvas + y * rawCanvasW : NULL;
+}
+
+// Keep the canvas after the first frame as runs, in two passes: count, then store. The canvas is
+// the playing GIF's, or `canvas` for one decoded elsewhere
+static void recordFirstFrame(const char *name, int w, int h, const uint16_t *canvas = NULL)
+{
+  if (!psramFound() || w > DISPLAY_WIDTH || findFirstFrame(name))
+    return;
+  uint16_t line[DISPLAY_WIDTH];
+  FirstFrame f = { name, (uint16_t)w, (uint16_t)h, NULL, 0 };
+  for (int pass = 0; pass < 2; pass++) {
+    size_t n = 0;
+    uint32_t count = 0;
+    uint16_t color = 0;
+    for (int y = 0; y < h; y++) {
+      const uint16_t *row = canvas ? canvas + y * w : canvasRow565(y, w, line);
+      if (!row)
+        return;
+      for (int x = 0; x < w; x++) {
+        if (count && (row[x] != color || count == 0xFFFF)) {
+          if (f.runs) {
+            f.runs[2 * n] = count;
+            f.runs[2 * n + 1] = color;
+          }
+          n++;
+          count = 0;
+        }
+        color = row[x];
+        count++;
+      }
+    }
+    if (f.runs) {
+      f.runs[2 * n] = count;
+      f.runs[2 * n + 1] = color;
+      break;
+    }
+    f.bytes = (n + 1) * 2 * sizeof(uint16_t);
+    if (f.bytes > (size_t)w * h * sizeof(uint16_t) || f.bytes > FIRST_FRAME_BUDGET)
+      return; // noise doesn't compress, it would take more room than the frame
+    xSemaphoreTake(cacheLock, portMAX_DELAY);
+    while (firstFrameBytes + f.bytes > FIRST_FRAME_BUDGET && !firstFrames.empty()) {
+      firstFrameBytes -= firstFrames.front().bytes;
+      free(firstFrames.front().runs);
+      firstFrames.erase(firstFrames.begin());
+    }
+    xSemaphoreGive(cacheLock);
+    f.runs = (uint16_t *)ps_malloc(f.bytes);
+    if (!f.runs)
+      return;
+  }
+  xSemaphoreTake(cacheLock, portMAX_DELAY);
+  firstFrames.push_back(f);
+  firstFrameBytes += f.bytes;
+  xSemaphoreGive(cacheLock);
+}
+
+// Send the stored first frame of a GIF; false if there is none
+static bool showFirstFrame(const char *name)
+{
+  const FirstFrame *f = findFirstFrame(name);
+  if (!f)
+    return false;
+  xOffset = (tft.width() - f->w) / 2;
+  yOffset = (tft.height() - f->h) / 2;
+  clearCanvasBorder(f->w, f->h);
+  uint16_t line[DISPLAY_WIDTH];
+  const uint16_t *run = f->runs;
+  uint32_t left = 0;
+  uint16_t color = 0;
+  for (int y = 0; y < f->h; y++) {
+    for (int x = 0; x < f->w;) {
+      if (!left) {
+        left = run[0];
+        color = run[1];
+        run += 2;
+      }
+      int n = std::min<int>(left, f->w - x);
+      std::fill(line + x, line + x + n, color);
+      x += n;
+      left -= n;
+    }
+    pushLineSpan(0, y, f->w, line, y == f->h - 1);
+  }
+  return true;
+}
+
+int gifPlay( char* gifPath, GifBlob *blob, float rate, uint32_t startAt )
+{ // 0=infinite
+  strncpy(playingName, gifPath, sizeof(playingName) - 1);
+#ifdef USE_GIF_LAYER
+  stepGifLayer(); // a layer set since the last GIF keeps this one off the frame cache and the ring
+#endif
+  playingDropped = false;
+  if (colorEffectPending) {
+    buildColorTransform();
+    closeKeptGif();
+    clearFrameCache();
+    colorEffectPending = false;
+  }
+  bool fetched = strcmp(gifPath, FETCH_PATH) == 0; // read from the fetch ring, kept nowhere
+  CachedGif *cached = overlaysVisible() || fetched ? NULL : findCachedGif(gifPath); // overlays need the decoder's canvas
+  if (cached) {
+    playbackMode = "cache";
+    return playCachedGif(cached, rate, startAt);
+  }
+
+  const uint8_t *data = blob ? blob->data : NULL;
+  // A GIF that isn't open yet shows its stored first frame at once; the decoder catches up below
+  // with that frame decoded but not drawn
+  bool firstShown = strcmp(keptGifName, gifPath) != 0 && !overlaysVisible() && !fetched && showFirstFrame(gifPath);
+  if (strcmp(keptGifName, gifPath) == 0 && keptGifData == data) {
+    gif.rewind(); // played again: header and palette are still parsed
+  } else {
+    closeKeptGif();
+    gif.begin(BIG_ENDIAN_PIXELS);
+    gif.setColorTransform(colorEffectActive(colorEffect) ? &colorXform : NULL);
+    bool opened = blob ? (blob->flash ? gif.openFLASH( blob->data, blob->size, GIFDraw )
+                                      : gif.open( blob->data, blob->size, GIFDraw ))
+                  : fetched ? gif.open( gifPath, GIFOpenFetch, GIFCloseFetch, GIFReadFetch, GIFSeekFetch, GIFDraw, GIFBorrowFetch )
+                       : gif.open( gifPath, GIFOpenFile, GIFCloseFile, GIFReadFile, GIFSeekFile, GIFDraw, GIFBorrowFile );
+    if( ! opened ) {
+      // log_n("Could not open gif %s", gifPath );
+      return maxLoopsDuration;
+    }
+    strncpy(keptGifName, gifPath, sizeof(keptGifName) - 1);
+    keptGifData = data;
+#ifdef USE_PREFETCH
+    int indexed = usePrefetchedIndex(gifPath); // read ahead by /prefetch, complete from the first play
+#else
+    int indexed = 0;
+#endif
+    gif.setFrameIndex(gifFrameIndex, GIF_INDEX_FRAMES, indexed); // filled while playing, replays reuse it
+  }
+
+  gifCooked = false;
+  playbackMode = "raw";
+  gif.setFrameBuf(NULL); // a rewound decoder keeps the buffers of its last play
+  gif.setTurboBuf(NULL);
+#ifdef USE_TURBO_WINDOW
+  gif.setTurboWindow(reserveTurboWindow(), TURBO_WINDOW_BYTES); // unless turboBuf is set too
+#endif
+  gif.setDrawType(GIF_DRAW_RAW);
+  gif.setSkipDraw(false);
+  gif.setDisposeBuffer(NULL, 0);
+#ifdef USE_DMA
+  setGifStrip(false);
+#endif
+  int scale = setGifScale();
+#ifdef USE_TURBO
+  int canvasW = gif.getCanvasWidth();
+  int canvasH = gif.getCanvasHeight();
+  if (reserveGifBuffers(canvasW, canvasH, scale)) {
+    memset(frameBuf, 0, canvasW * canvasH); // don't show leftovers of the previous GIF
+    gif.setFrameBuf(frameBuf);
+    gif.setTurboBuf(turboBuf);
+    gif.setTurboTables(turboTables);
+    gif.setDrawType(GIF_DRAW_COOKED);
+    gif.setDisposeBuffer(disposeBuf, canvasW * canvasH);
+#ifdef USE_DELTA
+    gif.setDeltaMode(true);
+#endif
+#ifdef USE_DMA
+    setGifStrip(true);
+#endif
+    gifCooked = true;
+    playbackMode = "turbo";
+  }
+#endif
+  if (!gifCooked) {
+    // ARENA_RAW, or the heap without PSRAM; without it transparent runs are sent one by one
+    rawCanvasW = gif.getCanvasWidth();
+    rawCanvasH = gif.getCanvasHeight();
+    size_t canvasBytes = (size_t)rawCanvasW * rawCanvasH * sizeof(uint16_t);
+    rawCanvas = (uint16_t *)arenaTake(ARENA_RAW, canvasBytes);
+    if (rawCanvas)
+      memset(rawCanvas, 0, canvasBytes);
+  }
+
+  int frameDelay = 0; // store delay for the last frame
+  FrameClock clock;
+  bool showcomment = false;
+  bool complete = true; // whole GIF was played, so a capture can be kept
+  bool skipped = false; // the frame was only decoded, see skipNextFrame()
+  int rc = 0;
+
+  // center the GIF !!
+  int w = gif.getCanvasWidth();
+  int h = gif.getCanvasHeight();
+  xOffset = ( tft.width()  - w )  /2;
+  yOffset = ( tft.height() - h ) /2;
+  clearCanvasBorder(w, h);
+  overlayGif = true;
+  bool ahead = false; // frames are decoded one ahead, see presentAheadFrame()
+  bool ring = false;  // frames are decoded on the other core, see decoderTaskLoop()
+#ifdef USE_FRAME_RING
+  if (gifCooked && !overlaysVisible() && qualityProfiles[qualityProfile].decodeAhead && reserveFrameRing()) { // layers are redrawn from the frame buffer
+    setGifStrip(false); // the lines go to the ring
+    ring = true;
+    playbackMode = "ring";
+  }
+#endif
+#ifdef USE_DECODE_AHEAD
+  if (!ring && gifCooked && qualityProfiles[qualityProfile].decodeAhead && reserveAheadBuffer(w, h)) {
+    setGifStrip(false); // the lines go to the back buffer
+    decodingAhead = ahead = true;
+    playbackMode = "ahead";
+  }
+#endif
+
+  if( lastFile != currentFile ) {
+    // log_n("Playing %s [%d,%d] with offset [%d,%d]", gifPath, w, h, xOffset, yOffset );
+    lastFile = currentFile;
+    showcomment = true;
+  }
+
+  bool firstPending = !ring && !fetched && !findFirstFrame(gifPath); // record the canvas after frame 0
+  if (gifCooked && !firstShown && !fetched) // frame 0 isn't drawn, the capture would miss it
+    beginCapture(gifPath, w, h);
+  captureFrameStart();
+#ifdef USE_FRAME_RING
+  if (ring)
+    startRingDecoder(); // the first frame decodes while waiting for the start time
+#endif
+  if (ahead) { // the first frame is ready before the clock starts
+    rc = decodeGifFrame(&frameDelay);
+    if (rc > 0)
+      captureFrameEnd(frameDelay);
+    if (firstShown)
+      aheadRectCount = 0; // already on screen
+    if (rc >= 0 && firstPending)
+      recordFirstFrame(gifPath, w, h);
+    firstPending = false;
+  }
+  if (startAt)
+    waitUntil(startAt); // file is open and buffers are set up, start in step with the other eye
+  startClock(clock, rate, startAt);
+  startFrameStats();
+#ifdef USE_DECODE_AHEAD
+  while (ahead && rc >= 0) { // rc is that of the frame waiting in the back buffer
+    presentAheadFrame();
+#ifdef USE_GIF_LAYER
+    stepGifLayer();
+#endif
+    presentOverlays(); // the frame buffer still holds the frame just presented
+    if (rc == 0)
+      break; // the last frame, finished below like in the loop that follows
+    int shownDelay = frameDelay;
+    captureFrameStart();
+    rc = decodeGifFrame(&frameDelay); // the next frame, while this one is on screen
+    if (rc > 0)
+      captureFrameEnd(frameDelay);
+    releaseDisplayBus();
+    sdReadAhead();
+    commitFrameStats(); // transfer of this frame and decode of the next
+    if (rc < 0)
+      break;
+    if (clock.due > maxGifDuration) {
+      complete = false;
+      break;
+    }
+    if (!waitNextFrame(clock, shownDelay)) {
+      complete = false;
+      break;
+    }
+    startFrameStats();
+  }
+#endif
+#ifdef USE_FRAME_RING
+  bool dropFirst = firstShown; // strips of frame 0, already on screen
+  while (ring) {
+    RingStrip *s = ringNext();
+    if (s->lines) {
+      if (!dropFirst && renderCancelled()) {
+        complete = false;
+        break;
+      }
+      if (!dropFirst) {
+        memcpy(stripLine(s->x, s->y, s->w), s->pixels, s->w * s->lines * sizeof(uint16_t));
+        stripLines = s->lines;
+        flushStrip();
+      }
+      ringPop();
+      continue;
+    }
+    dropFirst = false;
+    rc = s->rc;
+    frameDelay = s->delayMs;
+    ringPop();
+    if (rc <= 0)
+      break; // the last frame is finished below like in the loop that follows
+    releaseDisplayBus();
+    commitFrameStats();
+    if (clock.due > maxGifDuration) {
+      complete = false;
+      break;
+    }
+    if (!waitNextFrame(clock, frameDelay)) {
+      complete = false;
+      break;
+    }
+    startFrameStats();
+  }
+  if (ring)
+    stopRingDecoder();
+#endif
+  gif.setSkipDraw(firstShown && !ahead && !ring && gifCooked); // RAW mode needs frame 0 in its canvas
+  while (!ahead && !ring && (rc = decodeGifFrame(&frameDelay)) > 0) {
+    if (firstPending) {
+      recordFirstFrame(gifPath, w, h);
+      firstPending = false;
+    }
+    flushStrip(); // interlaced frames don't end on the last line
+#ifdef USE_GIF_LAYER
+    stepGifLayer();
+#endif
+#ifdef USE_DMA
+    presentOverlays();
+#endif
+    releaseDisplayBus(); // let HTTP handlers draw while we wait
+    sdReadAhead(); // the bus is idle until the next frame
+    commitFrameStats();
+    captureFrameEnd(frameDelay);
+    if (showcomment) {
+      if (gif.getComment(GifComment)) {
+        // log_n("GIF Comment: %s", GifComment);
+      }
+    }
+    if (clock.due > maxGifDuration) { // avoid being trapped in infinite GIF's
+      // log_w("Broke the GIF loop, max duration exceeded");
+      complete = false;
+      break;
+    }
+    if (!(skipped ? skipFrameTime(clock, frameDelay) : waitNextFrame(clock, frameDelay))) {
+      // Cancel the playback if a new command has arrived
+      complete = false;
+      break;
+    }
+    captureFrameStart();
+    startFrameStats();
+    if (!skipUnseenFrames(clock)) {
+      complete = false;
+      break;
+    }
+    skipped = skipNextFrame(clock) && gifCooked; // RAW mode draws as it decodes
+    gif.setSkipDraw(skipped);
+  }
+  gif.setSkipDraw(false);
+  if (firstPending && rc == 0)
+    recordFirstFrame(gifPath, w, h); // a GIF of one frame
+
+  flushStrip();
+  overlayGif = false;
+#ifdef USE_DECODE_AHEAD
+  decodingAhead = false;
+#endif
+#ifdef USE_DMA
+  setGifStrip(false); // a rewound decoder would keep it
+#endif
+  releaseDisplayBus();
+  if (rc == 0)
+    commitFrameStats(); // the last frame
+  if (complete && rc == 0)
+    captureFrameEnd(frameDelay); // the last frame was drawn by the final playFrame() call
+  finishCapture(complete && rc == 0);
+  arenaReset(ARENA_RAW);
+  rawCanvas = NULL;
+  if (rc < 0 || fetched)
+    closeKeptGif(); // don't replay a file that failed to decode, or the next fetch as this one
+  if (complete && rc == 0) {
+    readAheadPlaylist(); // the next item loads while the last frame is shown
+    waitNextFrame(clock, frameDelay); // show the last frame for its full delay too
+  }
+  return (int)clock.due;
+}
+
+static uint16_t *transcodeCanvas = NULL; // RGB565 canvas the frames are merged into while transcoding
+static int transcodeW = 0, transcodeH = 0;
+static int dirtyLeft, dirtyTop, dirtyRight, dirtyBottom; // bounding box of the changed spans
+
+static void resetDirtyBox()
+{
+  dirtyLeft = transcodeW;
+  dirtyTop = transcodeH;
+  dirtyRight = dirtyBottom = 0;
+}
+
+// Draw callback while transcoding: merge the cooked line and grow the changed rectangle
+static void transcodeDraw(GIFDRAW *pDraw)
+{
+  int y = pDraw->iY + pDraw->y;
+  int w = std::min(pDraw->iWidth, transcodeW - pDraw->iX);
+  if (y >= transcodeH || w <= 0)
+    return;
+  memcpy(&transcodeCanvas[y * transcodeW + pDraw->iX], pDraw->pPixels, w * sizeof(uint16_t));
+  int dirtyW = std::min(pDraw->iDirtyWidth, w - pDraw->iDirtyX);
+  if (dirtyW <= 0)
+    return;
+  dirtyLeft = std::min(dirtyLeft, pDraw->iX + pDraw->iDirtyX);
+  dirtyRight = std::max(dirtyRight, pDraw->iX + pDraw->iDirtyX + dirtyW);
+  dirtyTop = std::min(dirtyTop, y);
+  dirtyBottom = std::max(dirtyBottom, y + 1);
+}
+
+// Append the changed rectangle of the canvas as one frame; returns the bytes written, 0 on error
+static size_t writeNativeFrame(File &out, int delayMs)
+{
+  NativeFrame f = { 0, 0, 0, 0, (uint16_t)delayMs, 0 };
+  if (dirtyRight > dirtyLeft && dirtyBottom > dirtyTop) {
+    f.x = dirtyLeft;
+    f.y = dirtyTop;
+    f.w = dirtyRight - dirtyLeft;
+    f.h = dirtyBottom - dirtyTop;
+  }
+  if (out.write((const uint8_t *)&f, sizeof(f)) != sizeof(f))
+    return 0;
+  size_t rowBytes = f.w * sizeof(uint16_t);
+  if (f.w == transcodeW) { // full width rows are contiguous
+    size_t bytes = rowBytes * f.h;
+    if (out.write((const uint8_t *)&transcodeCanvas[f.y * transcodeW], bytes) != bytes)
+      return 0;
+  } else {
+    for (int row = f.y; row < f.y + f.h; row++) {
+      if (out.write((const uint8_t *)&transcodeCanvas[row * transcodeW + f.x], rowBytes) != rowBytes)
+        return 0;
+    }
+  }
+  return sizeof(f) + rowBytes * f.h;
+}
+
+// Decode a GIF once and store its frames pre-rendered, so playback only streams pixels from SD.
+// Needs the Turbo buffers; oversized GIFs are stored scaled down like they play, GIFs still bigger
+// than the display at 1/4 or than NATIVE_MAX_BYTES are left as they are.
+bool transcodeGif(const char *path)
+{
+  unsigned long started = millis();
+  releaseDisplayBus();
+  closeKeptGif(); // the transcode needs `gif` and the GIF file handle
+  gif.begin(BIG_ENDIAN_PIXELS);
+  if (!gif.open(path, GIFOpenFile, GIFCloseFile, GIFReadFile, GIFSeekFile, transcodeDraw, GIFBorrowFile))
+    return false;
+  int scale = setGifScale();
+  transcodeW = gif.getCanvasWidth();
+  transcodeH = gif.getCanvasHeight();
+  if (transcodeW > DISPLAY_WIDTH || transcodeH > DISPLAY_WIDTH || !reserveGifBuffers(transcodeW, transcodeH, scale)) {
+    gif.close();
+    return false;
+  }
+  transcodeCanvas = (uint16_t *)ps_calloc(1, (size_t)transcodeW * transcodeH * sizeof(uint16_t));
+  if (!transcodeCanvas) {
+    gif.close();
+    return false;
+  }
+  memset(frameBuf, 0, transcodeW * transcodeH);
+  gif.setFrameBuf(frameBuf);
+  gif.setTurboBuf(turboBuf);
+  gif.setTurboTables(turboTables);
+#ifdef USE_TURBO_WINDOW
+  gif.setTurboWindow(turboWindow, TURBO_WINDOW_BYTES);
+#endif
+  gif.setDrawType(GIF_DRAW_COOKED);
+  gif.setDeltaMode(true); // the changed spans give each frame's rectangle
+
+  if (!SD.exists(NATIVE_DIR))
+    SD.mkdir(NATIVE_DIR);
+  File out = SD.open(NATIVE_TEMP_PATH, FILE_WRITE);
+  NativeHeader header = { { 'E', '5', '6', '5' }, (uint16_t)transcodeW, (uint16_t)transcodeH, 0, 0 };
+  bool ok = out && out.write((const uint8_t *)&header, sizeof(header)) == sizeof(header);
+  size_t total = sizeof(header);
+  int rc = 1, frameDelay = 0;
+  while (ok && rc > 0) {
+    resetDirtyBox();
+    rc = decodeGifFrame(&frameDelay);
+    size_t written = (rc >= 0) ? writeNativeFrame(out, frameDelay) : 0;
+    total += written;
+    header.frames++;
+    ok = written > 0 && total <= NATIVE_MAX_BYTES && header.frames < 0xffff;
+  }
+  gif.close();
+  free(transcodeCanvas);
+  transcodeCanvas = NULL;
+
+  if (ok) { // frame count is only known now
+    ok = out.seek(0) && out.write((const uint8_t *)&header, sizeof(header)) == sizeof(header);
+  }
+  if (out)
+    out.close();
+  std::string nativePath = nativePathFor(path);
+  SD.remove(nativePath.c_str());
+  if (ok)
+    ok = SD.rename(NATIVE_TEMP_PATH, nativePath.c_str());
+  if (!ok)
+    SD.remove(NATIVE_TEMP_PATH);
+  Serial.printf("Transcode %s: %s, %u frames, %u bytes in %lu ms\n", path, ok ? "done" : "failed",
+                (unsigned)header.frames, (unsigned)total, millis() - started);
+  return ok;
+}
+
+// Store a decoded JPEG (its one cached frame) as a native copy, shown from then on without decoding
+static bool writeNativeJpeg(const char *path, const CachedGif *entry)
+{
+  const CachedFrame &f = entry->frames.front();
+  releaseDisplayBus();
+  if (!SD.exists(NATIVE_DIR))
+    SD.mkdir(NATIVE_DIR);
+  File out = SD.open(NATIVE_TEMP_PATH, FILE_WRITE);
+  NativeHeader header = { { 'E', '5', '6', '5' }, (uint16_t)entry->canvasW, (uint16_t)entry->canvasH, 1, 0 };
+  NativeFrame frame = { f.x, f.y, f.w, f.h, 0, 0 };
+  size_t bytes = (size_t)f.w * f.h * sizeof(uint16_t);
+  bool ok = out && out.write((const uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+            out.write((const uint8_t *)&frame, sizeof(frame)) == sizeof(frame) &&
+            out.write((const uint8_t *)f.pixels, bytes) == bytes;
+  if (out)
+    out.close();
+  std::string nativePath = nativePathFor(path);
+  SD.remove(nativePath.c_str());
+  if (ok)
+    ok = SD.rename(NATIVE_TEMP_PATH, nativePath.c_str());
+  if (!ok)
+    SD.remove(NATIVE_TEMP_PATH);
+  Serial.printf("Native copy of %s: %s, %u bytes\n", path, ok ? "done" : "failed", (unsigned)bytes);
+  return ok;
+}
+
+// Stream the pre-rendered frames of a GIF; -1 if it has no native copy
+static int playNativeGif(const char *gifPath, float rate, uint32_t startAt)
+{
+  releaseDisplayBus();
+  std::string nativePath = nativePathFor(gifPath);
+  File file;
+  File *f = NULL;
+  int32_t size;
+  uint32_t base;
+  if (findPackedAsset(nativePath.c_str(), NULL) || !findPackedAsset(gifPath, NULL))
+    f = openMediaFile(nativePath.c_str(), file, &size, &base); // a packed GIF only plays a packed copy
+  if (!f)
+    return -1;
+  NativeHeader header;
+  if (f->read((uint8_t *)&header, sizeof(header)) != sizeof(header) || memcmp(header.magic, "E565", 4) != 0) {
+    if (file)
+      file.close();
+    return -1;
+  }
+  strncpy(playingName, gifPath, sizeof(playingName) - 1);
+  playingDropped = false;
+  playbackMode = "native";
+  xOffset = ( tft.width()  - header.width ) /2;
+  yOffset = ( tft.height() - header.height ) /2;
+  clearCanvasBorder(header.width, header.height);
+  sdWindowLen = 0; // the read-ahead window is used as the transfer buffer, forget its contents
+  uint16_t *block = (uint16_t *)sdWindow;
+
+  FrameClock clock;
+  if (startAt)
+    waitUntil(startAt);
+  startClock(clock, rate, startAt);
+  for (int i = 0; i < header.frames; i++) {
+    startFrameStats();
+    NativeFrame frame;
+    if (f->read((uint8_t *)&frame, sizeof(frame)) != sizeof(frame))
+      break;
+    int rowsPerBlock = frame.w ? std::min((int)frame.h, (int)(SD_READAHEAD_SIZE / (frame.w * sizeof(uint16_t)))) : 0;
+    bool failed = false;
+    for (int row = 0; row < frame.h && !failed; row += rowsPerBlock) {
+      int rows = std::min(rowsPerBlock, frame.h - row);
+      size_t bytes = (size_t)rows * frame.w * sizeof(uint16_t);
+      releaseDisplayBus(); // the previous block must be out before SD uses the bus and the buffer
+      uint32_t t0 = micros();
+      failed = f->read((uint8_t *)block, bytes) != bytes;
+      addStageTime(STAT_SD_READ, t0);
+      frameSdBytes += bytes;
+      if (failed)
+        break;
+#ifdef USE_DMA
+      tft.startWrite();
+      tft.pushImageDMA(frame.x + xOffset, frame.y + row + yOffset, frame.w, rows, block);
+      noteFirstPixel();
+#else
+      TFTDraw(frame.x, frame.y + row, frame.w, rows, block);
+#endif
+    }
+    releaseDisplayBus();
+    commitFrameStats();
+    if (failed || clock.due > maxGifDuration)
+      break;
+    if (!waitNextFrame(clock, frame.delayMs))
+      break;
+  }
+  if (file)
+    file.close();
+  return (int)clock.due;
+}
+
+// Clear the panel; with DMA the fill is queued ahead of the strips that follow, so the
+// image decodes while it is sent. Blocking drawing afterwards needs tft.dmaWait() first
+static void clearScreen()
+{
+#ifdef USE_DMA
+  tft.startWrite(); // DMA needs the TFT chip select held low
+  if (tft.dmaFillRect(0, 0, tft.width(), tft.height(), TFT_BLACK))
+    return;
+  tft.dmaWait();
+#endif
+  tft.fillScreen(TFT_BLACK);
+}
+
+// Center a w x h image; only a smaller image leaves old pixels around it that need clearing
+static void placeJpeg(int32_t w, int32_t h)
+{
+  xOffset = (tft.width() - w) / 2;
+  yOffset = (tft.height() - h) / 2;
+  if (w < tft.width() || h < tft.height())
+    clearScreen();
+}
+
+#ifdef USE_DMA
+// JPEG blocks (one or more MCUs) arrive in raster order and are copied into the DMA strips.
+// Strips hold DMA_STRIP_LINES aligned line groups of the visible part of the image, and a
+// group is queued as soon as a block row below it starts, so it is sent while the rest decodes
+static int32_t jpegX0, jpegX1, jpegY0, jpegY1; // visible part of the image, in image coordinates
+static int32_t jpegGroups[2]; // line groups being filled, in dmaStrip ring order from dmaStripIdx
+static int jpegClaimed = 0;
+
+// Image line at which group g starts in its strip
+static int32_t jpegGroupStart(int32_t g)
+{
+  return std::max(g * DMA_STRIP_LINES, jpegY0);
+}
+
+// Queue the groups above group `g`
+static void flushJpegGroups(int32_t g)
+{
+  while (jpegClaimed && jpegGroups[0] < g) {
+    stripX = jpegX0;
+    stripY = jpegGroupStart(jpegGroups[0]);
+    stripW = jpegX1 - jpegX0;
+    stripLines = std::min((jpegGroups[0] + 1) * DMA_STRIP_LINES, jpegY1) - stripY;
+    if (capture) // before flushStrip() trims the lines to the circle
+      memcpy(capture->frames.back().pixels + (stripY - jpegY0) * stripW, dmaStrip[dmaStripIdx],
+             stripLines * stripW * sizeof(uint16_t));
+    flushStrip();
+    jpegGroups[0] = jpegGroups[1];
+    jpegClaimed--;
+  }
+}
+
+// Strips for a w x h image placed at xOffset, yOffset
+static void setJpegWindow(int32_t w, int32_t h)
+{
+  jpegX0 = std::max(0, -xOffset);
+  jpegX1 = std::min<int32_t>(w, tft.width() - xOffset);
+  jpegY0 = std::max(0, -yOffset);
+  jpegY1 = std::min<int32_t>(h, tft.height() - yOffset);
+  jpegClaimed = 0;
+}
+
+// Also records the visible part as one frame of the frame cache, so showing the JPEG again
+// needs no decoding
+static void beginJpegStrips(const char *name, int32_t w, int32_t h)
+{
+  placeJpeg(w, h);
+  setJpegWindow(w, h);
+  beginCapture(name, w, h);
+  if (!capture)
+    return;
+  size_t bytes = (size_t)(jpegX1 - jpegX0) * (jpegY1 - jpegY0) * sizeof(uint16_t);
+  uint16_t *pixels = bytes && reserveCacheBytes(bytes) ? (uint16_t *)ps_malloc(bytes) : NULL;
+  if (!pixels) {
+    freeCachedGif(capture);
+    capture = NULL;
+    return;
+  }
+  CachedFrame f = { (int16_t)jpegX0, (int16_t)jpegY0, (uint16_t)(jpegX1 - jpegX0), (uint16_t)(jpegY1 - jpegY0), 0, pixels };
+  capture->frames.push_back(f);
+  capture->bytes += bytes;
+}
+
+// Copy a bw x bh block at (bx, by) of the image; blocks are at most 2 * DMA_STRIP_LINES high
+// and start on a multiple of their height, so a block row needs one or two groups
+static void jpegStripBlock(int32_t bx, int32_t by, int32_t bw, int32_t bh, const uint16_t *pixels)
+{
+  int32_t ys = std::max(by, jpegY0), ye = std::min(by + bh, jpegY1);
+  int32_t cs = std::max(bx, jpegX0), ce = std::min(bx + bw, jpegX1);
+  if (ys >= ye || cs >= ce)
+    return;
+  flushJpegGroups(ys / DMA_STRIP_LINES); // a block row below them: the groups above are done
+  for (int32_t g = ys / DMA_STRIP_LINES; g <= (ye - 1) / DMA_STRIP_LINES; g++) {
+    if (jpegClaimed && jpegGroups[jpegClaimed - 1] >= g)
+      continue;
+    int idx = (dmaStripIdx + jpegClaimed) % DMA_STRIP_BUFFERS;
+    while (dmaStripQueued[idx]) // still being sent from an earlier round
+      tft.dmaPoll(true);
+    jpegGroups[jpegClaimed++] = g;
+  }
+  int32_t w = jpegX1 - jpegX0;
+  if (cs == bx && ce == bx + bw && bw == w) { // whole rows: one copy per group, e.g. a full-screen JPEG
+    for (int32_t y = ys; y < ye;) {
+      int32_t g = y / DMA_STRIP_LINES, end = std::min(ye, (g + 1) * DMA_STRIP_LINES);
+      uint16_t *strip = dmaStrip[(dmaStripIdx + g - jpegGroups[0]) % DMA_STRIP_BUFFERS];
+      memcpy(strip + (y - jpegGroupStart(g)) * w, pixels + (y - by) * bw, (end - y) * w * sizeof(uint16_t));
+      y = end;
+    }
+    return;
+  }
+  for (int32_t y = ys; y < ye; y++) {
+    int32_t g = y / DMA_STRIP_LINES;
+    uint16_t *strip = dmaStrip[(dmaStripIdx + g - jpegGroups[0]) % DMA_STRIP_BUFFERS];
+    memcpy(strip + (y - jpegGroupStart(g)) * w + (cs - jpegX0), pixels + (y - by) * bw + (cs - bx),
+           (ce - cs) * sizeof(uint16_t));
+  }
+}
+
+static void endJpegStrips(bool decoded)
+{
+  flushJpegGroups(INT32_MAX);
+  releaseDisplayBus();
+  finishCapture(decoded);
+}
+#endif
+
+#ifdef USE_JPEGDEC
+// JPEGDEC output: big-endian RGB565 blocks of one or more MCUs, already scaled
+static int JPEGDraw(JPEGDRAW *pDraw)
+{
+#ifdef USE_DMA
+  jpegStripBlock(pDraw->x, pDraw->y, pDraw->iWidth, pDraw->iHeight, pDraw->pPixels);
+#else
+  TFTDraw(pDraw->x, pDraw->y, pDraw->iWidth, pDraw->iHeight, pDraw->pPixels);
+#endif
+  return !renderCancelled(); // 0 stops the decoder after this MCU row
+}
+
+// Decode a JPEG from SD with JPEGDEC, at the smallest of 1/1 to 1/8 scale that fits the display
+static bool decodeJpeg(const char *filename)
+{
+  static const int scaleOptions[] = { 0, JPEG_SCALE_HALF, JPEG_SCALE_QUARTER, JPEG_SCALE_EIGHTH };
+  closeKeptGif(); // FSGifFile and the read-ahead window are needed
+  arenaReset(ARENA_JPEG);
+  void *mem = arenaTake(ARENA_JPEG, sizeof(JPEGDEC));
+  if (!mem)
+    return false;
+  JPEGDEC *jpeg = new (mem) JPEGDEC();
+  bool decoded = false;
+  if (jpeg->open(filename, GIFOpenFile, GIFCloseFile, JPEGReadFile, JPEGSeekFile, JPEGDraw)) {
+    jpeg->setPixelType(RGB565_BIG_ENDIAN); // what the display takes, no byte swapping on the way
+    int w = jpeg->getWidth(), h = jpeg->getHeight();
+    int scale = 0;
+    while (scale < 3 && ((w >> scale) > tft.width() || (h >> scale) > tft.height()))
+      scale++;
+    int scaledW = (w + (1 << scale) - 1) >> scale, scaledH = (h + (1 << scale) - 1) >> scale;
+#ifdef USE_DMA
+    beginJpegStrips(filename, scaledW, scaledH);
+#else
+    placeJpeg(scaledW, scaledH);
+#endif
+    startFrameStats(); // a still counts as one frame in /stats, so decode time shows next to GIFs
+    decoded = jpeg->decode(0, 0, scaleOptions[scale]);
+#ifdef USE_DMA
+    endJpegStrips(decoded);
+#endif
+    commitFrameStats();
+    Serial.printf("JPEG image (%d x %d) at 1/%d\n", w, h, 1 << scale);
+    jpeg->close();
+  }
+  jpeg->~JPEGDEC();
+  arenaReset(ARENA_JPEG);
+  return decoded;
+}
+
+// Live MJPEG feed (/mjpeg): a reader task on the web server's core pulls the stream, either
+// multipart/x-mixed-replace or JPEGs each after a 4-byte big-endian length, into PSRAM slots
+// without touching SD. The player decodes only the newest complete frame, frames it didn't get
+// to are dropped. The last strips of a frame are still sent by DMA while the next decodes
+#define MJPEG_SLOTS 3                // one filling, one waiting, one being decoded
+#define MJPEG_FRAME_SIZE (96 * 1024) // largest JPEG kept, bigger frames are skipped
+#define MJPEG_TIMEOUT_MS 5000        // the feed ends after this long without data
+
+static uint8_t *mjpegData[MJPEG_SLOTS]; // PSRAM
+static size_t mjpegSize[MJPEG_SLOTS];
+static int mjpegLatest = -1, mjpegShowing = -1; // slots, guarded by mjpegMux
+static portMUX_TYPE mjpegMux = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t mjpegReady = NULL; // given for every frame published
+static TaskHandle_t mjpegTask = NULL;
+static char mjpegUrl[160] = "";            // set by /mjpeg before the reader is started
+static volatile bool mjpegRunning = false; // the reader is connected or connecting
+static volatile bool mjpegStop = false;    // to the reader: close the feed
+static volatile bool mjpegPlaying = false; // CMD_MJPEG is queued or running
+static uint32_t mjpegReceived = 0, mjpegShown = 0, mjpegDropped = 0, mjpegSkipped = 0;
+
+// Read n bytes of the feed, or skip them with buf NULL; false once it stalls, closes or is stopped
+static bool mjpegRead(WiFiClient &client, uint8_t *buf, size_t n)
+{
+  static uint8_t scratch[512];
+  uint32_t lastData = millis();
+  while (n) {
+    if (mjpegStop)
+      return false;
+    int available = client.available();
+    if (available <= 0) {
+      if (!client.connected() || millis() - lastData > MJPEG_TIMEOUT_MS)
+        return false;
+      vTaskDelay(1);
+      continue;
+    }
+    size_t chunk = std::min<size_t>(n, buf ? available : std::min<int>(available, sizeof(scratch)));
+    int got = client.read(buf ? buf : scratch, chunk);
+    if (got <= 0)
+      continue;
+    if (buf)
+      buf += got;
+    n -= got;
+    lastData = millis();
+  }
+  return true;
+}
+
+static bool mjpegReadLine(WiFiClient &client, String &line)
+{
+  line = "";
+  uint8_t c;
+  while (mjpegRead(client, &c, 1)) {
+    if (c == '\n')
+      return true;
+    if (c != '\r' && line.length() < 256)
+      line += (char)c;
+  }
+  return false;
+}
+
+// Slot to fill: neither waiting nor being decoded
+static int mjpegFreeSlot()
+{
+  portENTER_CRITICAL(&mjpegMux);
+  int slot = 0;
+  while (slot == mjpegLatest || slot == mjpegShowing)
+    slot++;
+  portEXIT_CRITICAL(&mjpegMux);
+  return slot;
+}
+
+// Hand a complete frame to the player, replacing one it hasn't started on
+static void mjpegPublish(int slot, size_t size)
+{
+  mjpegSize[slot] = size;
+  portENTER_CRITICAL(&mjpegMux);
+  if (mjpegLatest >= 0)
+    mjpegDropped++;
+  mjpegLatest = slot;
+  portEXIT_CRITICAL(&mjpegMux);
+  mjpegReceived++;
+  xSemaphoreGive(mjpegReady);
+  if (!mjpegPlaying && !mjpegStop) {
+    mjpegPlaying = true;
+    if (!queueDisplayCommand(CMD_MJPEG, "", 0))
+      mjpegPlaying = false; // the next frame tries again
+  }
+}
+
+// Read one frame of `size` bytes into a free slot, or skip it when it doesn't fit
+static bool mjpegReadFrame(WiFiClient &client, size_t size)
+{
+  if (size > MJPEG_FRAME_SIZE) {
+    mjpegSkipped++;
+    return mjpegRead(client, NULL, size);
+  }
+  int slot = mjpegFreeSlot();
+  if (!mjpegRead(client, mjpegData[slot], size))
+    return false;
+  mjpegPublish(slot, size);
+  return true;
+}
+
+// A part without Content-Length: read up to the JPEG end marker
+static bool mjpegReadToEnd(WiFiClient &client)
+{
+  int slot = mjpegFreeSlot();
+  size_t size = 0;
+  uint8_t c, last = 0;
+  while (mjpegRead(client, &c, 1)) {
+    if (size < MJPEG_FRAME_SIZE)
+      mjpegData[slot][size] = c;
+    size++;
+    if (last == 0xFF && c == 0xD9) {
+      if (size > MJPEG_FRAME_SIZE)
+        mjpegSkipped++;
+      else
+        mjpegPublish(slot, size);
+      return true;
+    }
+    last = c;
+  }
+  return false;
+}
+
+// Connect to mjpegUrl and read frames until the feed ends or is stopped
+static void readMjpegFeed()
+{
+  String host, path;
+  uint16_t port;
+  splitHttpUrl(mjpegUrl, host, port, path);
+  WiFiClient client;
+  if (!client.connect(host.c_str(), port, MJPEG_TIMEOUT_MS)) {
+    Serial.println("MJPEG feed: cannot connect to " + host);
+    return;
+  }
+  client.print("GET " + path + " HTTP/1.1\r\nHost: " + host + "\r\nConnection: close\r\n\r\n");
+  String line, boundary;
+  if (!mjpegReadLine(client, line) || line.indexOf(" 200") < 0) {
+    Serial.println("MJPEG feed: " + line);
+    return;
+  }
+  while (mjpegReadLine(client, line) && line.length()) {
+    String lower = line;
+    lower.toLowerCase();
+    int b = lower.indexOf("boundary=");
+    if (lower.startsWith("content-type:") && lower.indexOf("multipart/") >= 0 && b >= 0) {
+      boundary = line.substring(b + 9);
+      boundary.replace("\"", "");
+      boundary.trim();
+      if (!boundary.startsWith("--"))
+        boundary = "--" + boundary;
+    }
+  }
+  if (boundary.length() == 0) { // length-prefixed frames
+    uint8_t length[4];
+    while (mjpegRead(client, length, sizeof(length))) {
+      size_t size = (size_t)length[0] << 24 | length[1] << 16 | length[2] << 8 | length[3];
+      if (!mjpegReadFrame(client, size))
+        break;
+    }
+    return;
+  }
+  while (mjpegReadLine(client, line)) {
+    if (!line.startsWith(boundary))
+      continue; // blank line after the previous part
+    long size = -1;
+    while (mjpegReadLine(client, line) && line.length()) {
+      String lower = line;
+      lower.toLowerCase();
+      if (lower.startsWith("content-length:"))
+        size = line.substring(15).toInt();
+    }
+    if (!(size >= 0 ? mjpegReadFrame(client, size) : mjpegReadToEnd(client)))
+      break;
+  }
+}
+
+static void mjpegTaskLoop(void *param)
+{
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    readMjpegFeed();
+    mjpegRunning = false;
+  }
+}
+
+void stopMjpeg()
+{
+  mjpegStop = true;
+  while (mjpegRunning)
+    delay(1);
+}
+
+// Web task: start reading `url`, replacing the feed being read; false without PSRAM
+bool startMjpeg(const char *url)
+{
+  for (int i = 0; i < MJPEG_SLOTS; i++) {
+    if (!mjpegData[i])
+      mjpegData[i] = psramFound() ? (uint8_t *)ps_malloc(MJPEG_FRAME_SIZE) : NULL;
+    if (!mjpegData[i])
+      return false;
+  }
+  stopMjpeg();
+  strncpy(mjpegUrl, url, sizeof(mjpegUrl) - 1);
+  mjpegStop = false;
+  mjpegRunning = true;
+  if (!mjpegTask) {
+    mjpegReady = xSemaphoreCreateBinary();
+    xTaskCreatePinnedToCore(mjpegTaskLoop, "mjpeg", MJPEG_STACK_SIZE, NULL, 1, &mjpegTask, 1 - PLAYER_CORE);
+  }
+  xTaskNotifyGive(mjpegTask);
+  return true;
+}
+
+// Player task: show the newest frame of the feed until it ends or a command takes the screen,
+// which also stops the feed
+static void playMjpeg()
+{
+  arenaReset(ARENA_JPEG);
+  void *mem = arenaTake(ARENA_JPEG, sizeof(JPEGDEC));
+  if (!mem) {
+    mjpegPlaying = false;
+    return;
+  }
+  JPEGDEC *jpeg = new (mem) JPEGDEC();
+  eyeFrontValid = false;
+  overlayGif = false;
+  playbackMode = "mjpeg";
+  int placedW = 0, placedH = 0;
+  uint32_t lastShown = millis();
+  for (;;) {
+    if (playbackPreempted()) {
+      mjpegStop = true; // the reader waits out its read, stopMjpeg() isn't needed here
+      break;
+    }
+    if (xSemaphoreTake(mjpegReady, pdMS_TO_TICKS(20)) != pdTRUE) {
+      if (!mjpegRunning)
+        break;
+      continue;
+    }
+    portENTER_CRITICAL(&mjpegMux);
+    int slot = mjpegShowing = mjpegLatest;
+    mjpegLatest = -1;
+    portEXIT_CRITICAL(&mjpegMux);
+    if (slot < 0)
+      continue;
+    startFrameStats();
+    if (jpeg->openRAM(mjpegData[slot], mjpegSize[slot], JPEGDraw)) {
+      jpeg->setPixelType(RGB565_BIG_ENDIAN);
+      int w = jpeg->getWidth(), h = jpeg->getHeight();
+      int scale = 0;
+      while (scale < 3 && ((w >> scale) > tft.width() || (h >> scale) > tft.height()))
+        scale++;
+      static const int scaleOptions[] = { 0, JPEG_SCALE_HALF, JPEG_SCALE_QUARTER, JPEG_SCALE_EIGHTH };
+      int scaledW = (w + (1 << scale) - 1) >> scale, scaledH = (h + (1 << scale) - 1) >> scale;
+      if (scaledW != placedW || scaledH != placedH) { // a feed keeps its size, clear only on a change
+        placeJpeg(scaledW, scaledH);
+        placedW = scaledW;
+        placedH = scaledH;
+      }
+#ifdef USE_DMA
+      setJpegWindow(scaledW, scaledH);
+#endif
+      jpeg->decode(0, 0, scaleOptions[scale]);
+#ifdef USE_DMA
+      flushJpegGroups(INT32_MAX); // no SD reads follow, the bus stays with the panel
+#endif
+      jpeg->close();
+      mjpegShown++;
+    }
+    portENTER_CRITICAL(&mjpegMux);
+    mjpegShowing = -1;
+    portEXIT_CRITICAL(&mjpegMux);
+    commitFrameStats();
+    recordFramePacing(millis() - lastShown, millis() - lastShown, false, 0);
+    lastShown = millis();
+  }
+#ifdef USE_DMA
+  releaseDisplayBus();
+#endif
+  jpeg->~JPEGDEC();
+  arenaReset(ARENA_JPEG);
+  mjpegPlaying = false;
+}
+#else
+// Function to draw a line of JPEG pixels to the TFT display
+void jpegRender(int xpos, int ypos) {
+  // Retrieve information about the image
+  uint16_t *pImg;
+  uint16_t mcu_w = JpegDec.MCUWidth;
+  uint16_t mcu_h = JpegDec.MCUHeight;
+  uint32_t max_x = JpegDec.width;
+  uint32_t max_y = JpegDec.height;
+
+  // Calculate center position
+  int centerX = (tft.width() - max_x) / 2;
+  int centerY = (tft.height() - max_y) / 2;
+  
+  // Adjust for centering
+  xpos += centerX;
+  ypos += centerY;
+
+  // Retrieve the pixel data
+  pImg = JpegDec.pImage;
+
+  // Check if the MCU is out of bounds
+  if ((xpos >= tft.width()) || (ypos >= tft.height())) return;
+  
+  // Push the pixels to the TFT display
+  tft.pushImage(xpos, ypos, mcu_w, mcu_h, pImg);
+}
+
+// Decode a JPEG with JPEGDecoder; with USE_DMA it is read into PSRAM first, so SD reads don't
+// stop the display transfers on the shared bus. A packed JPEG is always read into PSRAM,
+// decodeSdFile() can only start at the beginning of a file
+static bool decodeJpeg(const char *filename)
+{
+  File jpegFile;
+  int32_t size;
+  uint32_t base;
+  File *f = openMediaFile(filename, jpegFile, &size, &base);
+  if (!f)
+    return false;
+  bool decoded = false;
+#ifdef USE_DMA
+  bool fromPsram = true;
+#else
+  bool fromPsram = !jpegFile;
+#endif
+  uint8_t *data = fromPsram && psramFound() && size > 0 ? (uint8_t *)ps_malloc(size) : NULL;
+  if (data && f->read(data, size) == size) {
+    if (jpegFile)
+      jpegFile.close();
+    decoded = JpegDec.decodeArray(data, size);
+#ifdef USE_DMA
+    if (decoded && JpegDec.MCUHeight <= 2 * DMA_STRIP_LINES) {
+      int32_t mcuW = JpegDec.MCUWidth, mcuH = JpegDec.MCUHeight;
+      beginJpegStrips(filename, JpegDec.width, JpegDec.height);
+      while (!renderCancelled() && JpegDec.readSwappedBytes()) // the strips go out as they are, big-endian like GIF lines
+        jpegStripBlock(JpegDec.MCUx * mcuW, JpegDec.MCUy * mcuH, mcuW, mcuH, JpegDec.pImage);
+      decoded = !renderCancelled();
+      if (!decoded)
+        JpegDec.abort();
+      endJpegStrips(decoded);
+    } else
+#endif
+    if (decoded) {
+      tft.fillScreen(TFT_BLACK);
+      while (!renderCancelled() && JpegDec.read())
+        jpegRender(JpegDec.MCUx * JpegDec.MCUWidth, JpegDec.MCUy * JpegDec.MCUHeight);
+      if (renderCancelled()) {
+        JpegDec.abort();
+        decoded = false;
+      }
+    }
+    free(data);
+    return decoded;
+  }
+  free(data);
+  if (!jpegFile)
+    return false;
+  jpegFile.seek(0);
+  decoded = JpegDec.decodeSdFile(jpegFile);
+  if (decoded) {
+    tft.fillScreen(TFT_BLACK);
+    // Start rendering blocks (Minimum Coded Units)
+    uint32_t mcu_count = 0;
+    while (!renderCancelled() && JpegDec.read()) {
+      mcu_count++;
+      // Render the current MCU block at its pixel position
+      jpegRender(JpegDec.MCUx * JpegDec.MCUWidth, JpegDec.MCUy * JpegDec.MCUHeight);
+      // Let other tasks run during rendering
+      if (mcu_count % 20 == 0) {
+        yield();
+      }
+    }
+    if (renderCancelled()) {
+      JpegDec.abort();
+      decoded = false;
+    }
+  }
+  jpegFile.close();
+  return decoded;
+}
+#endif
+
+// Status and error text is retained: setTextLine() only records a line, showText() draws the
+// lines that changed into textLayer and sends that band of rows in one push, so boot status
+// changes and image errors neither flash through a cleared screen nor redraw every string
+#define TEXT_LINES 4        // lines centered on the display
+#define TEXT_LINE_HEIGHT 20 // rows per line, fits text size 2
+
+struct TextLine {
+  String text;
+  uint16_t color;
+  uint8_t size;
+  bool dirty; // changed since the last showText()
+};
+static TextLine textLines[TEXT_LINES];
+static TFT_eSprite textLayer = TFT_eSprite(&tft); // the TEXT_LINES lines across the display
+static bool textOnScreen = false; // the panel shows the text lines with black around them
+
+// Sprites made for a while (text boxes, transitions, /bench) take a block of their size class
+// instead of a heap allocation, so creating them costs no malloc and leaves no holes in PSRAM.
+// Classes in ascending size: a text band, an 8-bit screen and 16-bit screens
+static TFT_eSpritePool spritePool;
+static const spritePoolClass spritePoolClasses[] = {
+  { DISPLAY_WIDTH * TEXT_LINES * TEXT_LINE_HEIGHT * 2 + 2, 3 },
+  { DISPLAY_WIDTH * DISPLAY_WIDTH + 1, 1 },
+  { DISPLAY_WIDTH * DISPLAY_WIDTH * 2 + 2, 2 },
+};
+
+// Pool to create temporary sprites on, NULL without USE_SPRITE_POOL or PSRAM (they then use the heap)
+static TFT_eSpritePool *spritePoolFor() {
+#ifdef USE_SPRITE_POOL
+  return spritePool.classes() ? &spritePool : NULL;
+#else
+  return NULL;
+#endif
+}
+
+static void initSpritePool() {
+#ifdef USE_SPRITE_POOL
+  if (!spritePool.begin(spritePoolClasses, sizeof(spritePoolClasses) / sizeof(spritePoolClasses[0])))
+    Serial.println("Sprite pool not available, sprites use the heap");
+#endif
+}
+
+// Allocate the text layer; like initCanvas() before initDMA(), so it may go to PSRAM
+static void initTextLayer() {
+  if (textLayer.created())
+    return;
+  textLayer.setColorDepth(16);
+  if (textLayer.createSprite(tft.width(), TEXT_LINES * TEXT_LINE_HEIGHT, spritePoolFor()))
+    textLayer.fillSprite(TFT_BLACK);
+  else
+    Serial.println("Text layer not available, status text is drawn directly");
+}
+
+static void setTextLine(int line, const String &text, uint16_t color, uint8_t size = 2) {
+  TextLine &l = textLines[line];
+  if (l.text == text && l.color == color && l.size == size)
+    return;
+  l.text = text;
+  l.color = color;
+  l.size = size;
+  l.dirty = true;
+}
+
+static void clearTextLines() {
+  for (int i = 0; i < TEXT_LINES; i++)
+    setTextLine(i, "", TFT_BLACK);
+}
+
+// Span fonts compiled from GFX fonts by compile_fonts.py (`make span_fonts.h`): only the glyphs
+// that are used, each as runs of set pixels, so a line of text is a few memset-like fills into
+// the text layer or a strip line instead of a pixel or fastHLine call per run
+struct SpanGlyph {
+  uint16_t first;  // index of its first span
+  uint16_t count;  // 0 for a character that was left out
+  uint8_t advance;
+  int8_t xOffset, yOffset; // of the glyph box from the pen position on the baseline
+};
+struct SpanFont {
+  const SpanGlyph *glyphs;
+  const uint8_t *spans; // row, x, length in the glyph box, by row
+  uint8_t first, last;
+  uint8_t ascent, descent;
+};
+#if __has_include("span_fonts.h")
+#include "span_fonts.h"
+#define USE_SPAN_FONTS
+#endif
+
+#ifdef USE_SPAN_FONTS
+static const SpanGlyph *spanGlyph(const SpanFont &f, char c)
+{
+  uint8_t code = c;
+  if (code < f.first || code > f.last || (!f.glyphs[code - f.first].count && !f.glyphs[code - f.first].advance))
+    code = ' '; // left out, takes the room of a space if there is one
+  return code >= f.first && code <= f.last ? &f.glyphs[code - f.first] : NULL;
+}
+
+static int spanTextWidth(const SpanFont &f, const char *text)
+{
+  int w = 0;
+  for (; *text; text++)
+    if (const SpanGlyph *g = spanGlyph(f, *text))
+      w += g->advance;
+  return w;
+}
+
+// Draw text with its pen starting at x on row `baseline` into rows y0..y0+rows-1, held in buf
+// `pitch` pixels apart (a sprite, or a single line with rows 1); color in the buffer's byte order
+static void drawSpanText(uint16_t *buf, int pitch, int y0, int rows, int x, int baseline,
+                         const SpanFont &f, const char *text, uint16_t color)
+{
+  for (; *text; text++) {
+    const SpanGlyph *g = spanGlyph(f, *text);
+    if (!g)
+      continue;
+    int top = baseline + g->yOffset, left = x + g->xOffset;
+    const uint8_t *span = f.spans + g->first * 3;
+    for (int i = 0; i < g->count; i++, span += 3) {
+      int y = top + span[0];
+      if (y >= y0 + rows)
+        break; // spans are by row
+      if (y < y0)
+        continue;
+      int x0 = std::max(0, left + span[1]), x1 = std::min(pitch, left + span[1] + span[2]);
+      uint16_t *dst = buf + (y - y0) * pitch;
+      for (int px = x0; px < x1; px++)
+        dst[px] = color;
+    }
+    x += g->advance;
+  }
+}
+
+// Font of a text line's size, NULL if none was compiled for it
+static const SpanFont *spanFontOf(const TextLine &l)
+{
+  return l.size >= 1 && l.size <= SPAN_FONT_COUNT ? &spanFonts[l.size - 1] : NULL;
+}
+
+// Rows y0..y0+rows-1 of a text line's box into buf, big-endian like the panel; false if its
+// text size has no span font
+static bool drawSpanLine(uint16_t *buf, int pitch, int y0, int rows, int line)
+{
+  const TextLine &l = textLines[line];
+  if (!spanFontOf(l))
+    return false;
+  const SpanFont &f = *spanFontOf(l);
+  memset(buf, 0, pitch * rows * sizeof(uint16_t)); // TFT_BLACK
+  int baseline = (TEXT_LINE_HEIGHT + f.ascent - f.descent) / 2;
+  drawSpanText(buf, pitch, y0, rows, (pitch - spanTextWidth(f, l.text.c_str())) / 2, baseline,
+               f, l.text.c_str(), __builtin_bswap16(l.color));
+  return true;
+}
+#endif
+
+// Draw one line into its box, top being the box's first row in target
+static void drawTextLine(TFT_eSPI *target, int line, int top) {
+  const TextLine &l = textLines[line];
+#ifdef USE_SPAN_FONTS
+  if (target == &textLayer && // the sprite keeps its pixels big-endian
+      drawSpanLine((uint16_t *)textLayer.getPointer() + top * textLayer.width(), textLayer.width(), 0, TEXT_LINE_HEIGHT, line))
+    return;
+#endif
+  target->fillRect(0, top, tft.width(), TEXT_LINE_HEIGHT, TFT_BLACK);
+  target->setTextColor(l.color, TFT_BLACK);
+  target->setTextDatum(MC_DATUM);
+  target->setTextSize(l.size);
+  target->drawString(l.text, tft.width() / 2, top + TEXT_LINE_HEIGHT / 2);
+}
+
+#ifdef USE_LVGL
+// With LVGL the text lines are labels on an LVGL screen. LVGL renders only the areas it
+// invalidated into two partial buffers in internal RAM, and lvglFlush() sends each part with
+// pushImageDMA() while the next part renders. A changed line costs the pixels of its label
+#define LVGL_BUF_LINES 20 // rows per draw buffer, 240 * 20 * 2 = 9600 bytes each
+#define LVGL_TICK_MS 2    // lv_tick_inc() period, from an esp_timer
+#define LVGL_TIMER_MS 30  // lv_timer_handler() period while the text is shown (perf monitor)
+
+static lv_disp_draw_buf_t lvglDrawBuf;
+static lv_disp_drv_t lvglDisp;
+static lv_obj_t *lvglLines[TEXT_LINES];
+static bool lvglReady = false;
+
+static void lvglTick(void *arg) {
+  lv_tick_inc(LVGL_TICK_MS);
+}
+
+// pushImageDMA() waits for the previous part before it queues this one, so the buffer LVGL
+// renders into next has been sent already and the flush can be reported done at once
+static void lvglFlush(lv_disp_drv_t *disp, const lv_area_t *area, lv_color_t *pixels) {
+  tft.startWrite(); // DMA needs the TFT chip select held low
+  tft.pushImageDMA(area->x1, area->y1, area->x2 - area->x1 + 1, area->y2 - area->y1 + 1,
+                   (const uint16_t *)pixels); // big-endian already, LV_COLOR_16_SWAP
+  lv_disp_flush_ready(disp);
+}
+
+// Register the panel with LVGL and make the text line labels; after initDMA(), the draw
+// buffers must be DMA capable. Without them showText() draws with TFT_eSPI
+static void initLvgl() {
+  if (lvglReady)
+    return;
+  size_t pixels = tft.width() * LVGL_BUF_LINES;
+  lv_color_t *buf1 = (lv_color_t *)heap_caps_malloc(pixels * sizeof(lv_color_t), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+  lv_color_t *buf2 = (lv_color_t *)heap_caps_malloc(pixels * sizeof(lv_color_t), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+  if (!buf1 || !buf2) {
+    heap_caps_free(buf1);
+    heap_caps_free(buf2);
+    Serial.println("LVGL draw buffers not available, status text is drawn by TFT_eSPI");
+    return;
+  }
+  lv_init();
+  lv_disp_draw_buf_init(&lvglDrawBuf, buf1, buf2, pixels);
+  lv_disp_drv_init(&lvglDisp);
+  lvglDisp.hor_res = tft.width();
+  lvglDisp.ver_res = tft.height();
+  lvglDisp.flush_cb = lvglFlush;
+  lvglDisp.draw_buf = &lvglDrawBuf;
+  lv_disp_drv_register(&lvglDisp);
+
+  const esp_timer_create_args_t tickArgs = { .callback = lvglTick, .name = "lv_tick" };
+  esp_timer_handle_t tickTimer;
+  if (esp_timer_create(&tickArgs, &tickTimer) == ESP_OK)
+    esp_timer_start_periodic(tickTimer, LVGL_TICK_MS * 1000);
+
+  lv_obj_t *screen = lv_scr_act();
+  lv_obj_set_style_bg_color(screen, lv_color_black(), 0);
+  int top = tft.height() / 2 - TEXT_LINES * TEXT_LINE_HEIGHT / 2;
+  for (int i = 0; i < TEXT_LINES; i++) {
+    lv_obj_t *label = lv_label_create(screen);
+    lv_obj_set_size(label, tft.width(), TEXT_LINE_HEIGHT);
+    lv_obj_set_pos(label, 0, top + i * TEXT_LINE_HEIGHT);
+    lv_obj_set_style_text_align(label, LV_TEXT_ALIGN_CENTER, 0);
+    lv_label_set_long_mode(label, LV_LABEL_LONG_CLIP);
+    lv_label_set_text(label, "");
+    lvglLines[i] = label;
+  }
+  lvglReady = true;
+}
+
+// showText() through LVGL: false if LVGL is not set up
+static bool showTextLvgl() {
+  if (!lvglReady)
+    return false;
+  if (!textOnScreen) { // the panel shows something else, LVGL's screen is sent whole
+    lv_obj_invalidate(lv_scr_act());
+    textOnScreen = true;
+    eyeFrontValid = false;
+  }
+  for (int i = 0; i < TEXT_LINES; i++) {
+    TextLine &l = textLines[i];
+    if (!l.dirty)
+      continue;
+    lv_obj_set_style_text_color(lvglLines[i], lv_color_make((l.color >> 8) & 0xF8, (l.color >> 3) & 0xFC, (l.color << 3) & 0xF8), 0);
+    lv_obj_set_style_text_font(lvglLines[i], l.size > 1 ? &lv_font_montserrat_16 : &lv_font_montserrat_12, 0);
+    lv_label_set_text(lvglLines[i], l.text.c_str());
+    l.dirty = false;
+  }
+  lv_refr_now(NULL); // renders the invalidated areas only
+  releaseDisplayBus();
+  return true;
+}
+
+// Player task, while the text is shown: LVGL timers such as the perf monitor's
+static void serviceLvgl() {
+  if (!lvglReady || !textOnScreen)
+    return;
+  lv_timer_handler();
+  releaseDisplayBus();
+}
+#endif
+
+// Put the changed text lines on the panel; the screen is only cleared when it showed something else
+static void showText() {
+#ifdef USE_LVGL
+  if (showTextLvgl())
+    return;
+#endif
+  if (!textOnScreen) {
+    clearScreen();
+    textOnScreen = true;
+    eyeFrontValid = false;
+  }
+  int first = TEXT_LINES, last = -1;
+  for (int i = 0; i < TEXT_LINES; i++) {
+    if (!textLines[i].dirty)
+      continue;
+    first = std::min(first, i);
+    last = i;
+    textLines[i].dirty = false;
+  }
+  if (last < 0)
+    return;
+  int top = tft.height() / 2 - TEXT_LINES * TEXT_LINE_HEIGHT / 2;
+  if (!textLayer.created()) {
+#if defined(USE_SPAN_FONTS) && defined(USE_DMA)
+    // Without the layer the span fonts still draw a row at a time into the strips
+    bool spans = true;
+    for (int i = first; i <= last; i++)
+      spans = spans && spanFontOf(textLines[i]);
+    if (spans) {
+      int w = tft.width();
+      xOffset = 0;
+      yOffset = 0;
+      for (int i = first; i <= last; i++) {
+        for (int row = 0; row < TEXT_LINE_HEIGHT; row++) {
+          int y = top + i * TEXT_LINE_HEIGHT + row;
+          drawSpanLine(stripLine(0, y, w), w, row, 1, i);
+          if (++stripLines == DMA_STRIP_LINES)
+            flushStrip();
+        }
+      }
+      flushStrip();
+      releaseDisplayBus();
+      return;
+    }
+#endif
+#ifdef USE_DMA
+    tft.dmaWait();
+#endif
+    for (int i = first; i <= last; i++)
+      drawTextLine(&tft, i, top + i * TEXT_LINE_HEIGHT);
+    return;
+  }
+
+  // Unchanged lines between the changed ones are still in the layer and go along
+  for (int i = first; i <= last; i++)
+    drawTextLine(&textLayer, i, i * TEXT_LINE_HEIGHT);
+  uint16_t *pixels = (uint16_t *)textLayer.getPointer();
+  int w = textLayer.width(), y0 = first * TEXT_LINE_HEIGHT, rows = (last - first + 1) * TEXT_LINE_HEIGHT;
+  xOffset = 0; // the layer spans the display width
+  yOffset = 0;
+#ifdef USE_DMA
+  for (int row = y0; row < y0 + rows; row++) {
+    memcpy(stripLine(0, top + row, w), pixels + row * w, w * sizeof(uint16_t));
+    if (++stripLines == DMA_STRIP_LINES)
+      flushStrip();
+  }
+  flushStrip();
+  releaseDisplayBus();
+#else
+  TFTDraw(0, top + y0, w, rows, pixels + y0 * w);
+#endif
+}
+
+// Error placeholder in place of an image
+static void showImageError(const char *message, const char *filename)
+{
+  clearTextLines();
+  setTextLine(1, message, TFT_WHITE, 1);
+  setTextLine(2, filename, TFT_WHITE, 1);
+  showText();
+}
+
+// Whether a /gif path can be played, for the tasks that can't use the web task's catalog
+static bool mediaExists(const char *path) {
+  return findBuiltinGif(path) || findPackedAsset(path, NULL) || mediaFs(path).exists(path);
+}
+
+// Show a JPEG from the frame cache, where decodeJpeg() left the visible part
+static void showCachedJpeg(CachedGif *entry)
+{
+  entry->lastUsed = millis();
+  placeJpeg(entry->canvasW, entry->canvasH);
+  for (const CachedFrame &f : entry->frames) {
+    if (renderCancelled())
+      break;
+    pushCachedFrame(f);
+  }
+  releaseDisplayBus();
+}
+
+// Function to display a JPEG file
+bool displayJPEG(const char *filename) {
+  if (!findPackedAsset(filename, NULL) && !mediaFs(filename).exists(filename)) {
+    Serial.println("JPEG file not found");
+    showImageError("Error: Image not found", filename);
+    return false;
+  }
+
+  uint32_t t0 = millis();
+  if (CachedGif *cached = findCachedGif(filename)) { // decoded before, one push from PSRAM
+    playbackMode = "cache";
+    showCachedJpeg(cached);
+  } else if (playNativeGif(filename, 1.0f, 0) < 0) {
+    if (!decodeJpeg(filename)) {
+      if (renderCancelled())
+        return false; // stopped for the next command, not an error
+      Serial.println("JPEG decode error");
+      showImageError("Error decoding JPEG", filename);
+      return false;
+    }
+    CachedGif *decoded = findCachedGif(filename);
+    if (autoTranscode && decoded && !findPackedAsset(filename, NULL))
+      writeNativeJpeg(filename, decoded); // next time it's read instead of decoded, even after the cache
+  }
+  Serial.printf("JPEG image shown in %lu ms\n", millis() - t0);
+  return true;
+}
+
+// Case-insensitive check of a file name's extension, ext with its dot
+static bool hasExtension(const char *name, const char *ext) {
+  size_t n = strlen(name), e = strlen(ext);
+  return n >= e && strcasecmp(name + n - e, ext) == 0;
+}
+
+// Function to determine image type and display accordingly
+static bool showImageFile(const char *filename, float rate, uint32_t startAt) {
+  if (hasExtension(filename, ".jpg") || hasExtension(filename, ".jpeg")) {
+    playbackMode = "jpeg";
+    return displayJPEG(filename);
+  } else if (strcmp(filename, FETCH_PATH) == 0) {
+    playbackMode = "fetch";
+    gifPlay((char*)filename, NULL, rate, startAt); // straight from the fetch ring
+    return true;
+  } else if (hasExtension(filename, ".gif")) {
+    if (const BuiltinGif *builtin = findBuiltinGif(filename)) { // no SD access at all
+      static GifBlob builtinBlob; // only gifPlay() looks at it, on this task
+      builtinBlob = { filename, (uint8_t *)builtin->data, builtin->size, builtin->progmem };
+      gifPlay((char*)filename, &builtinBlob, rate, startAt);
+      return true;
+    }
+    // decoded frames in PSRAM beat the pre-rendered copy on SD
+    if (!findCachedGif(filename) && playNativeGif(filename, rate, startAt) >= 0)
+      return true;
+    // small GIFs are pinned in PSRAM and skip SD from the second play on
+    int playTime = gifPlay((char*)filename, loadGifBlob(filename), rate, startAt);
+    return true;
+  } else {
+    // For unsupported formats
+    showImageError("Unsupported format", filename);
+    return false;
+  }
+}
+
+// Show a file, posting its `started` and `finished` or `cancelled` events for /events
+bool displayImage(const char *filename, float rate, uint32_t startAt) {
+  eventFrames = 0;
+  eventPlayStart = millis();
+  playingDropped = false;
+  postEvent(EVENT_STARTED, filename);
+  bool shown = showImageFile(filename, rate, startAt);
+  postEvent(renderCancelled() || playingDropped ? EVENT_CANCELLED : EVENT_FINISHED, filename);
+  return shown;
+}
+
+#define CATALOG_INDEX "/gif/.catalog" // cached GIF metadata and checksums, one tab separated line per file
+
+// Where a catalog entry plays from; built-in and packed files are never written on the device
+enum MediaStore { STORE_SD, STORE_FLASH, STORE_BUILTIN, STORE_PACK };
+static const char *storeNames[] = { "sd", "flash", "builtin", "pack" };
+
+#define NO_NAME UINT32_MAX
+
+// Names of the catalog entries, NUL-terminated one after the other in one allocation, so the
+// catalog costs one block for all names instead of a String per file. Names of removed files stay
+// until compactCatalogNames()
+static std::vector<char> catalogNames;
+
+// Everything the listings need to know about a file in /gif, kept in RAM so requests don't walk the card
+struct MediaEntry {
+  uint32_t nameOff;       // file name inside /gif, offset in catalogNames
+  uint32_t previewOff;    // name of its _preview variant, NO_NAME if there is none
+  uint32_t size;
+  uint16_t width, height; // GIF canvas size, 0 for JPEGs
+  uint16_t frames;
+  uint32_t duration;      // ms for one loop of the animation
+  uint8_t store;          // MediaStore
+  char md5[33];           // hex MD5 of the content, hashed once at upload or when first seen, see /manifest
+
+  // Valid until the next name is added
+  const char *name() const { return catalogNames.data() + nameOff; }
+  const char *preview() const { return previewOff == NO_NAME ? "" : catalogNames.data() + previewOff; }
+  bool hasPreview() const { return previewOff != NO_NAME; }
+};
+
+static std::vector<MediaEntry> catalog; // sorted by name, only used from the web server task
+
+// Append a name to catalogNames, returning its offset
+static uint32_t addCatalogName(const char *name) {
+  uint32_t off = catalogNames.size();
+  catalogNames.insert(catalogNames.end(), name, name + strlen(name) + 1);
+  return off;
+}
+
+static MediaEntry newMediaEntry(const char *name, uint32_t size) {
+  MediaEntry entry = { addCatalogName(name), NO_NAME, size, 0, 0, 0, 0, STORE_SD, "" };
+  return entry;
+}
+
+static bool mediaNameLess(const MediaEntry &entry, const char *name) {
+  return strcmp(entry.name(), name) < 0;
+}
+
+// Put an entry in its place by name; the catalog has no entry of that name yet
+static MediaEntry &catalogInsert(const MediaEntry &entry) {
+  auto at = std::lower_bound(catalog.begin(), catalog.end(), entry.name(), mediaNameLess);
+  return *catalog.insert(at, entry);
+}
+
+static bool isGifName(const String &fname) {
+  return fname.endsWith(".gif") || fname.endsWith(".GIF");
+}
+
+static bool isMediaName(const String &fname) {
+  return isGifName(fname) || fname.endsWith(".jpg") || fname.endsWith(".JPG") ||
+         fname.endsWith(".jpeg") || fname.endsWith(".JPEG");
+}
+
+// Called during the last frame of a playlist item: pin the next GIF in PSRAM, so its
+// gif.open() only parses memory and the transition has no SD reads in it
+static void readAheadPlaylist() {
+  if (!playlistUpNext[0])
+    return;
+  char path[sizeof(playlistUpNext)];
+  strcpy(path, playlistUpNext);
+  playlistUpNext[0] = '\0';
+  if (!isGifName(String(path)) || findBuiltinGif(path) || findCachedGif(path) ||
+      mediaExists(nativePathFor(path).c_str()))
+    return; // already plays without opening the GIF
+  loadGifBlob(path);
+}
+
+static bool isPreviewName(const char *name) {
+  return strstr(name, "_preview") != NULL;
+}
+
+// "eye_o.gif" and "eye.gif" both use "eye_preview.gif"
+static std::string previewNameFor(const std::string &name) {
+  size_t dot = name.rfind('.');
+  std::string baseName = name.substr(0, dot);
+  std::string ext = dot == std::string::npos ? "" : name.substr(dot);
+  if (baseName.size() >= 2 && baseName.compare(baseName.size() - 2, 2, "_o") == 0)
+    baseName.resize(baseName.size() - 2);
+  return baseName + "_preview" + ext;
+}
+
+// Binary search of the catalog, no card access
+MediaEntry *findMedia(const char *name) {
+  auto at = std::lower_bound(catalog.begin(), catalog.end(), name, mediaNameLess);
+  return at != catalog.end() && strcmp(at->name(), name) == 0 ? &*at : NULL;
+}
+
+// "eye.jpg" gets "eye_preview.gif" from the device, see makePreview()
+static std::string generatedPreviewNameFor(const std::string &name) {
+  std::string preview = previewNameFor(name);
+  return preview.substr(0, preview.rfind('.')) + ".gif";
+}
+
+static void linkPreviews() {
+  for (MediaEntry &entry : catalog) {
+    const MediaEntry *preview = findMedia(previewNameFor(entry.name()).c_str());
+    if (!preview)
+      preview = findMedia(generatedPreviewNameFor(entry.name()).c_str());
+    entry.previewOff = !isPreviewName(entry.name()) && preview ? preview->nameOff : NO_NAME;
+  }
+}
+
+// Copy the names still in use into a new catalogNames, dropping those of removed files and
+// unmatched index lines
+static void compactCatalogNames() {
+  std::vector<char> names;
+  size_t bytes = 0;
+  for (const MediaEntry &entry : catalog)
+    bytes += strlen(entry.name()) + 1;
+  names.reserve(bytes);
+  for (MediaEntry &entry : catalog) {
+    const char *name = entry.name();
+    entry.nameOff = names.size();
+    names.insert(names.end(), name, name + strlen(name) + 1);
+  }
+  catalogNames.swap(names);
+  linkPreviews(); // the preview offsets moved with the names
+}
+
+// A file opened for the web task, packed files get a pack handle of their own
+struct CatalogFile {
+  File file;
+  uint32_t base; // offset of the file inside the pack, 0 for a file of its own
+};
+
+// Plain SD callbacks for metadata parsing, the player's read-ahead window stays untouched
+static void *catalogOpenFile(const char *fname, int32_t *pSize) {
+  CatalogFile *f = new CatalogFile();
+  PackedAsset asset;
+  if (findPackedAsset(fname, &asset)) {
+    f->file = SD.open(ASSET_PACK_PATH);
+    f->base = asset.offset;
+    *pSize = asset.size;
+    if (f->file && !f->file.seek(asset.offset))
+      f->file.close();
+  } else {
+    f->file = mediaFs(fname).open(fname);
+    f->base = 0;
+    *pSize = f->file ? f->file.size() : 0;
+  }
+  if (!f->file) {
+    delete f;
+    return NULL;
+  }
+  return f;
+}
+
+static void catalogCloseFile(void *pHandle) {
+  CatalogFile *f = static_cast<CatalogFile *>(pHandle);
+  f->file.close();
+  delete f;
+}
+
+// GIFFILE or JPEGFILE, both keep the position and size the same way
+template <typename MEDIAFILE>
+static int32_t catalogReadFile(MEDIAFILE *pFile, uint8_t *pBuf, int32_t iLen) {
+  CatalogFile *f = static_cast<CatalogFile *>(pFile->fHandle);
+  if (iLen > pFile->iSize - pFile->iPos)
+    iLen = pFile->iSize - pFile->iPos;
+  if (iLen <= 0)
+    return 0;
+  int32_t iBytesRead = (int32_t)f->file.read(pBuf, iLen);
+  pFile->iPos = f->file.position() - f->base;
+  return iBytesRead;
+}
+
+template <typename MEDIAFILE>
+static int32_t catalogSeekFile(MEDIAFILE *pFile, int32_t iPosition) {
+  CatalogFile *f = static_cast<CatalogFile *>(pFile->fHandle);
+  f->file.seek(f->base + iPosition);
+  pFile->iPos = (int32_t)(f->file.position() - f->base);
+  return pFile->iPos;
+}
+
+static uint8_t hashBuffer[4096]; // web task only
+
+static std::string hashMemory(const uint8_t *data, int32_t size) {
+  MD5Builder md5;
+  md5.begin();
+  for (int32_t done = 0; done < size;) {
+    int32_t n = std::min<int32_t>(size - done, sizeof(hashBuffer)); // add() takes 16-bit lengths on older cores
+    md5.add((uint8_t *)data + done, n);
+    done += n;
+  }
+  md5.calculate();
+  return md5.toString().c_str();
+}
+
+// Hex MD5 of a file in /gif, packed ones included; empty if it can't be read
+static std::string hashMedia(const char *path) {
+  int32_t left;
+  CatalogFile *f = static_cast<CatalogFile *>(catalogOpenFile(path, &left));
+  if (!f)
+    return "";
+  MD5Builder md5;
+  md5.begin();
+  while (left > 0) {
+    size_t n = f->file.read(hashBuffer, std::min<int32_t>(left, sizeof(hashBuffer)));
+    if (n == 0)
+      break;
+    md5.add(hashBuffer, n);
+    left -= n;
+  }
+  catalogCloseFile(f);
+  if (left > 0)
+    return "";
+  md5.calculate();
+  return md5.toString().c_str();
+}
+
+// Canvas size, frame count and loop duration, using a decoder of its own since the player may be busy
+static void readGifInfo(MediaEntry &entry, const BuiltinGif *builtin = NULL) {
+  void *mem = psramFound() ? ps_malloc(sizeof(AnimatedGIF)) : malloc(sizeof(AnimatedGIF));
+  if (!mem)
+    return;
+  AnimatedGIF *decoder = new (mem) AnimatedGIF();
+  String path = "/gif/" + String(entry.name());
+  decoder->begin(BIG_ENDIAN_PIXELS);
+  bool opened = builtin ? decoder->openFLASH((uint8_t *)builtin->data, builtin->size, NULL) // fine for mapped flash too
+                        : decoder->open(path.c_str(), catalogOpenFile, catalogCloseFile, catalogReadFile, catalogSeekFile, NULL);
+  if (opened) {
+    GIFINFO info;
+    entry.width = decoder->getCanvasWidth();
+    entry.height = decoder->getCanvasHeight();
+    if (decoder->getInfo(&info)) {
+      entry.frames = info.iFrameCount;
+      entry.duration = info.iDuration;
+    }
+    decoder->close();
+  }
+  decoder->~AnimatedGIF();
+  free(mem);
+}
+
+#ifdef USE_PREFETCH
+// RGB565 canvas the prefetch decoder draws a GIF's first frame into
+struct PrefetchCanvas {
+  uint16_t *pixels; // PSRAM
+  int w, h;
+};
+
+static void prefetchDraw(GIFDRAW *pDraw)
+{
+  PrefetchCanvas *canvas = (PrefetchCanvas *)pDraw->pUser;
+  int y = pDraw->iY + pDraw->y;
+  if (y >= canvas->h || pDraw->iX >= canvas->w)
+    return;
+  uint16_t *row = canvas->pixels + y * canvas->w + pDraw->iX;
+  int w = std::min(pDraw->iWidth, canvas->w - pDraw->iX);
+  for (int x = 0; x < w; x++) {
+    uint8_t c = pDraw->pPixels[x];
+    if (!pDraw->ucHasTransparency || c != pDraw->ucTransparent)
+      row[x] = pDraw->pPalette[c];
+  }
+}
+
+// Read one hinted GIF ahead: the whole file into PSRAM if it is small enough, then its frame index
+// and first frame, with a decoder of its own so the one kept for replays stays open. Parts cached
+// before are only marked as used. False if a display command arrived in between; the parts still
+// missing are read on a later pass
+static bool prefetchGif(const PrefetchHint &hint)
+{
+  const char *path = hint.path.c_str();
+  if (findCachedGif(path) || mediaExists(nativePathFor(path).c_str()))
+    return true; // plays from decoded frames, none of the parts are used
+  const BuiltinGif *builtin = findBuiltinGif(path);
+  GifBlob *blob = builtin ? NULL : findGifBlob(path);
+  if (blob && blob->hinted)
+    blob->lastUsed = millis();
+  if (!builtin && !blob && (int32_t)hint.size <= gifRamThreshold && trimPrefetched(hint.size)) {
+    blob = loadGifBlob(path, true);
+    if (blob)
+      prefetchReads++;
+    if (uxQueueMessagesWaiting(displayQueue))
+      return false;
+  }
+
+  PrefetchedIndex *index = findPrefetchedIndex(path);
+  if (index)
+    index->lastUsed = millis();
+  bool needFirst = !findFirstFrame(path) && !colorEffectPending; // pending, the colours would change
+  if (index && !needFirst)
+    return true;
+  void *mem = ps_malloc(sizeof(AnimatedGIF));
+  if (!mem)
+    return true;
+  AnimatedGIF *decoder = new (mem) AnimatedGIF();
+  decoder->begin(BIG_ENDIAN_PIXELS);
+  decoder->setColorTransform(colorEffectActive(colorEffect) ? &colorXform : NULL);
+  if (!builtin && !blob)
+    releaseDisplayBus();
+  bool opened = builtin ? decoder->openFLASH((uint8_t *)builtin->data, builtin->size, prefetchDraw)
+              : blob ? decoder->open(blob->data, blob->size, prefetchDraw)
+                     : decoder->open(path, catalogOpenFile, catalogCloseFile, catalogReadFile, catalogSeekFile, prefetchDraw);
+  bool done = true;
+  if (opened && needFirst) {
+    // as gifPlay() would record it, which doesn't for a canvas that plays scaled
+    PrefetchCanvas canvas = { NULL, decoder->getCanvasWidth(), decoder->getCanvasHeight() };
+    if (canvas.w <= DISPLAY_WIDTH && canvas.h <= DISPLAY_WIDTH)
+      canvas.pixels = (uint16_t *)ps_calloc(canvas.w * canvas.h, sizeof(uint16_t));
+    if (canvas.pixels && decoder->playFrame(false, NULL, &canvas) >= 0 && decoder->getLastError() == GIF_SUCCESS)
+      recordFirstFrame(path, canvas.w, canvas.h, canvas.pixels);
+    free(canvas.pixels);
+    done = !uxQueueMessagesWaiting(displayQueue);
+  }
+  if (opened && !index && done) {
+    GIFFRAME *frames = (GIFFRAME *)ps_malloc(GIF_INDEX_FRAMES * sizeof(GIFFRAME));
+    GIFINFO info;
+    decoder->setFrameIndex(frames, GIF_INDEX_FRAMES);
+    if (frames && decoder->getInfo(&info) && info.iFrameCount > 0) {
+      int count = std::min<int>(info.iFrameCount, GIF_INDEX_FRAMES);
+      if (trimPrefetched(count * sizeof(GIFFRAME))) {
+        PrefetchedIndex entry = { hint.path, (GIFFRAME *)ps_realloc(frames, count * sizeof(GIFFRAME)), count, false, millis() };
+        frames = NULL;
+        xSemaphoreTake(cacheLock, portMAX_DELAY);
+        prefetchedIndexes.push_back(entry);
+        xSemaphoreGive(cacheLock);
+      }
+    }
+    free(frames);
+  }
+  if (opened)
+    decoder->close();
+  decoder->~AnimatedGIF();
+  free(mem);
+  return done;
+}
+
+// One pass of the prefetcher on the player task: read the next hinted GIF ahead. False when
+// there is nothing to read
+static bool runPrefetch()
+{
+  xSemaphoreTake(cacheLock, portMAX_DELAY);
+  bool pending = !prefetchHints.empty();
+  PrefetchHint hint = pending ? prefetchHints.front() : PrefetchHint();
+  xSemaphoreGive(cacheLock);
+  if (!pending || !prefetchGif(hint))
+    return pending;
+  xSemaphoreTake(cacheLock, portMAX_DELAY);
+  if (!prefetchHints.empty() && prefetchHints.front().path == hint.path)
+    prefetchHints.erase(prefetchHints.begin()); // unless a new hint replaced the list meanwhile
+  xSemaphoreGive(cacheLock);
+  return true;
+}
+#endif
+
+static void saveCatalogIndex() {
+  SD.remove(CATALOG_INDEX);
+  File index = SD.open(CATALOG_INDEX, FILE_WRITE);
+  if (!index) {
+    Serial.println("Could not write the catalog index");
+    return;
+  }
+  for (const MediaEntry &entry : catalog) {
+    if (entry.store == STORE_BUILTIN)
+      continue;
+    index.printf("%s\t%lu\t%u\t%u\t%u\t%lu\t%s\n", entry.name(), (unsigned long)entry.size,
+                 entry.width, entry.height, entry.frames, (unsigned long)entry.duration, entry.md5);
+  }
+  index.close();
+}
+
+// The entries' names go into catalogNames, so the files that are still there keep them
+static std::vector<MediaEntry> loadCatalogIndex() {
+  std::vector<MediaEntry> entries;
+  File index = SD.open(CATALOG_INDEX);
+  if (!index)
+    return entries;
+  while (index.available()) {
+    String line = index.readStringUntil('\n');
+    char name[96], md5[33] = "";
+    unsigned long size, duration;
+    unsigned int width, height, frames;
+    // lines of older indexes end before the checksum, the file is hashed again then
+    if (sscanf(line.c_str(), "%95[^\t]\t%lu\t%u\t%u\t%u\t%lu\t%32s", name, &size, &width, &height, &frames, &duration, md5) >= 6) {
+      MediaEntry entry = newMediaEntry(name, size);
+      entry.width = width;
+      entry.height = height;
+      entry.frames = frames;
+      entry.duration = duration;
+      strlcpy(entry.md5, md5, sizeof(entry.md5));
+      entries.push_back(entry);
+    }
+  }
+  index.close();
+  return entries;
+}
+
+// Details of a new or changed file, named by nameOff; `md5` is passed when the upload already hashed it
+static MediaEntry makeMediaEntry(uint32_t nameOff, uint32_t size, const char *md5 = "") {
+  MediaEntry entry = { nameOff, NO_NAME, size, 0, 0, 0, 0, STORE_SD, "" };
+  String fname = entry.name();
+  if (isGifName(fname))
+    readGifInfo(entry);
+  strlcpy(entry.md5, *md5 ? md5 : hashMedia(("/gif/" + fname).c_str()).c_str(), sizeof(entry.md5));
+  return entry;
+}
+
+#define PREVIEW_SIZE 80             // longest side of the _preview thumbnails made on the device
+#define PREVIEW_JOB_INTERVAL 2000   // ms between two of them, so the card stays free for playback
+
+static std::vector<std::string> previewJobs; // media without a preview yet, web task only
+
+// Let the web task make a preview for a GIF or JPEG that has none
+static void queuePreview(const MediaEntry &entry) {
+  String fname = entry.name();
+  if (entry.hasPreview() || entry.store == STORE_BUILTIN || entry.store == STORE_PACK ||
+      isPreviewName(entry.name()) || !isMediaName(fname))
+    return;
+#ifndef USE_JPEGDEC
+  if (!isGifName(fname)) // JpegDec belongs to the player task
+    return;
+#endif
+  if (std::find(previewJobs.begin(), previewJobs.end(), entry.name()) == previewJobs.end())
+    previewJobs.push_back(entry.name());
+}
+
+// The built-in GIFs are listed without a card, buildCatalog() adds the files in /gif to them
+void addBuiltinMedia() {
+  for (const BuiltinGif &b : flashGifs) {
+    const char *name = b.path + 5; // past "/gif/"
+    if (!findMedia(name)) {
+      MediaEntry entry = newMediaEntry(name, b.size);
+      entry.store = STORE_BUILTIN;
+      readGifInfo(entry, &b);
+      strlcpy(entry.md5, hashMemory(b.data, b.size).c_str(), sizeof(entry.md5));
+      catalogInsert(entry);
+    }
+  }
+}
+
+// List a file, with the details from the index if it hasn't changed since
+static void addIndexedMedia(const String &fname, uint32_t size, uint8_t store, const std::vector<MediaEntry> &indexed, bool &changed) {
+  const MediaEntry *known = NULL;
+  for (const MediaEntry &entry : indexed) {
+    if (entry.size == size && strcmp(entry.name(), fname.c_str()) == 0)
+      known = &entry;
+  }
+  MediaEntry *added;
+  if (known) {
+    added = &catalogInsert(*known);
+    if (!added->md5[0]) {
+      strlcpy(added->md5, hashMedia(("/gif/" + fname).c_str()).c_str(), sizeof(added->md5));
+      changed = true;
+    }
+  } else {
+    added = &catalogInsert(makeMediaEntry(addCatalogName(fname.c_str()), size));
+    changed = true;
+  }
+  added->store = store;
+}
+
+// Add the files in /gif of one store; a name already listed (built-in, in flash or packed) shadows it
+static void addStoreMedia(fs::FS &store, uint8_t storeType, const std::vector<MediaEntry> &indexed, bool &changed, size_t &files) {
+  File root = store.open("/gif");
+  if (!root || !root.isDirectory())
+    return;
+  File file = root.openNextFile();
+  while (file) {
+    String fname = file.name();
+    if (!file.isDirectory() && fname.charAt(0) != '.' && !findMedia(fname.c_str())) {
+      files++;
+      addIndexedMedia(fname, file.size(), storeType, indexed, changed);
+    }
+    file.close();
+    file = root.openNextFile();
+  }
+  root.close();
+}
+
+// Add the media in the asset pack, the native copies and other hidden entries are not listed
+static void addPackMedia(const std::vector<MediaEntry> &indexed, bool &changed, size_t &files) {
+  std::vector<PackedAsset> assets;
+  xSemaphoreTake(cacheLock, portMAX_DELAY);
+  assets = packAssets;
+  xSemaphoreGive(cacheLock);
+  for (const PackedAsset &asset : assets) {
+    String fname = asset.name.c_str();
+    if (fname.charAt(0) == '.' || fname.indexOf('/') >= 0 || !isMediaName(fname) || findMedia(fname.c_str()))
+      continue;
+    files++;
+    addIndexedMedia(fname, asset.size, STORE_PACK, indexed, changed);
+  }
+}
+
+// Walk /gif of both stores and the asset pack; files unchanged since the last index are not
+// parsed again. Runs once the flash store is mounted, again when the card is and after a new pack
+void buildCatalog() {
+  catalog.clear();
+  catalogNames.clear();
+  std::vector<MediaEntry> indexed = loadCatalogIndex();
+  bool changed = false;
+  size_t files = 0;
+  addBuiltinMedia();
+  if (flashStoreReady)
+    addStoreMedia(LittleFS, STORE_FLASH, indexed, changed, files);
+  addPackMedia(indexed, changed, files);
+  addStoreMedia(SD, STORE_SD, indexed, changed, files);
+  compactCatalogNames();
+  if (storageReady && (changed || files != indexed.size()))
+    saveCatalogIndex();
+  for (const MediaEntry &entry : catalog)
+    queuePreview(entry);
+  Serial.printf("Catalog: %u files, %u bytes of names\n", (unsigned)catalog.size(), (unsigned)catalogNames.size());
+  postEvent(EVENT_CATALOG, "");
+}
+
+// Add or refresh a file after it was written to /gif, with its checksum if the upload has it
+void catalogAdd(const char *name, const char *md5) {
+  String path = "/gif/" + String(name);
+  fs::FS &store = mediaFs(path.c_str());
+  File file = store.open(path.c_str());
+  if (!file)
+    return;
+  uint32_t size = file.size();
+  file.close();
+  uint8_t storeType = &store == &LittleFS ? STORE_FLASH : STORE_SD;
+  MediaEntry *known = findMedia(name);
+  if (known && (known->store == STORE_BUILTIN || (known->store == STORE_PACK && storeType == STORE_SD)))
+    return; // the built-in or packed file is what plays
+  MediaEntry entry = makeMediaEntry(known ? known->nameOff : addCatalogName(name), size, md5);
+  entry.store = storeType;
+  if (known)
+    *known = entry;
+  else
+    catalogInsert(entry);
+  linkPreviews();
+  saveCatalogIndex();
+  queuePreview(entry);
+  postEvent(EVENT_CATALOG, name);
+}
+
+void catalogRemove(const char *name) {
+  MediaEntry *entry = findMedia(name);
+  if (!entry)
+    return;
+  catalog.erase(catalog.begin() + (entry - catalog.data()));
+  compactCatalogNames();
+  saveCatalogIndex();
+  postEvent(EVENT_CATALOG, name);
+}
+
+// First frame of a GIF or JPEG, sampled down to a thumbnail with a 256 colour palette
+struct PreviewImage {
+  int w, h;             // thumbnail size
+  int srcW, srcH;       // size of the decoded image
+  int transparent;      // palette index, -1 for none
+  bool started;
+  uint8_t palette[256 * 3];
+  uint8_t *pixels;      // w * h palette indices
+};
+
+// Thumbnail rows or columns [*t0, *t1) that sample source lines [s0, s1)
+static void previewRange(int s0, int s1, int src, int size, int *t0, int *t1) {
+  *t0 = (s0 * size + src - 1) / src;
+  *t1 = std::min(size, (s1 * size + src - 1) / src);
+}
+
+// RAW GIF lines: 8-bit indices into the frame's RGB888 palette, kept as they are
+static void previewGifLine(GIFDRAW *pDraw) {
+  PreviewImage *p = (PreviewImage *)pDraw->pUser;
+  if (!p->started) { // the canvas starts as the background colour, or transparent
+    p->started = true;
+    memcpy(p->palette, pDraw->pPalette24, sizeof(p->palette));
+    p->transparent = pDraw->ucHasTransparency ? pDraw->ucTransparent : -1;
+    memset(p->pixels, p->transparent >= 0 ? p->transparent : pDraw->ucBackground, p->w * p->h);
+  }
+  int ty0, ty1, tx0, tx1;
+  int sy = pDraw->iY + pDraw->y;
+  previewRange(sy, sy + 1, p->srcH, p->h, &ty0, &ty1);
+  previewRange(pDraw->iX, pDraw->iX + pDraw->iWidth, p->srcW, p->w, &tx0, &tx1);
+  for (int ty = ty0; ty < ty1; ty++) {
+    for (int tx = tx0; tx < tx1; tx++)
+      p->pixels[ty * p->w + tx] = pDraw->pPixels[tx * p->srcW / p->w - pDraw->iX];
+  }
+}
+
+#ifdef USE_JPEGDEC
+// Little-endian RGB565 JPEG blocks, quantized to RGB332
+static int previewJpegBlock(JPEGDRAW *pDraw) {
+  PreviewImage *p = (PreviewImage *)pDraw->pUser;
+  int ty0, ty1, tx0, tx1;
+  previewRange(pDraw->y, pDraw->y + pDraw->iHeight, p->srcH, p->h, &ty0, &ty1);
+  previewRange(pDraw->x, pDraw->x + pDraw->iWidth, p->srcW, p->w, &tx0, &tx1);
+  for (int ty = ty0; ty < ty1; ty++) {
+    const uint16_t *line = pDraw->pPixels + (ty * p->srcH / p->h - pDraw->y) * pDraw->iWidth;
+    for (int tx = tx0; tx < tx1; tx++) {
+      uint16_t c = line[tx * p->srcW / p->w - pDraw->x];
+      p->pixels[ty * p->w + tx] = ((c >> 13) << 5) | (((c >> 8) & 7) << 2) | ((c >> 3) & 3);
+    }
+  }
+  return 1;
+}
+#endif
+
+// Size the thumbnail to PREVIEW_SIZE on its longest side and allocate its pixels
+static bool startPreview(PreviewImage &p, int srcW, int srcH) {
+  if (srcW <= 0 || srcH <= 0)
+    return false;
+  p.srcW = srcW;
+  p.srcH = srcH;
+  int longest = std::max(srcW, srcH), size = std::min(longest, PREVIEW_SIZE);
+  p.w = std::max(1, srcW * size / longest);
+  p.h = std::max(1, srcH * size / longest);
+  p.pixels = (uint8_t *)calloc(p.w, p.h);
+  return p.pixels != NULL;
+}
+
+// GIF with one frame and 9-bit LZW codes: each pixel is a literal and a clear code every
+// PREVIEW_LZW_RUN literals keeps the table from growing, so no dictionary is needed
+#define PREVIEW_LZW_RUN 250 // below the 254 literals after which decoders widen the codes
+
+static bool writePreviewGif(const char *path, const PreviewImage &p) {
+  std::vector<uint8_t> out;
+  auto put16 = [&out](int v) { out.push_back(v & 0xff); out.push_back(v >> 8); };
+  const uint8_t header[] = { 'G', 'I', 'F', '8', '9', 'a' };
+  out.insert(out.end(), header, header + sizeof(header));
+  put16(p.w);
+  put16(p.h);
+  out.push_back(0xf7); // global 256 colour table
+  out.push_back(0);
+  out.push_back(0);
+  out.insert(out.end(), p.palette, p.palette + sizeof(p.palette));
+  if (p.transparent >= 0) {
+    const uint8_t control[] = { 0x21, 0xf9, 4, 1, 0, 0, (uint8_t)p.transparent, 0 };
+    out.insert(out.end(), control, control + sizeof(control));
+  }
+  out.push_back(0x2c);
+  put16(0);
+  put16(0);
+  put16(p.w);
+  put16(p.h);
+  out.push_back(0);
+  out.push_back(8); // LZW minimum code size
+
+  std::vector<uint8_t> codes;
+  uint32_t bits = 0;
+  int bitCount = 0;
+  auto putCode = [&](int code) {
+    bits |= (uint32_t)code << bitCount;
+    for (bitCount += 9; bitCount >= 8; bitCount -= 8, bits >>= 8)
+      codes.push_back(bits & 0xff);
+  };
+  for (int i = 0; i < p.w * p.h; i++) {
+    if (i % PREVIEW_LZW_RUN == 0)
+      putCode(256);
+    putCode(p.pixels[i]);
+  }
+  putCode(257);
+  if (bitCount)
+    codes.push_back(bits & 0xff);
+  for (size_t i = 0; i < codes.size(); i += 255) { // sub-blocks of up to 255 bytes
+    size_t n = std::min((size_t)255, codes.size() - i);
+    out.push_back(n);
+    out.insert(out.end(), codes.begin() + i, codes.begin() + i + n);
+  }
+  out.push_back(0);
+  out.push_back(0x3b);
+
+  File f = SD.open(path, FILE_WRITE);
+  if (!f)
+    return false;
+  bool ok = f.write(out.data(), out.size()) == out.size();
+  f.close();
+  if (!ok)
+    SD.remove(path);
+  return ok;
+}
+
+// Decode the first frame of /gif/<name> with a decoder of its own and save <base>_preview.gif
+static bool makePreview(const std::string &name) {
+  String path = "/gif/" + String(name.c_str());
+  PreviewImage preview = {};
+  preview.transparent = -1;
+  bool decoded = false;
+  if (isGifName(path)) {
+    void *mem = psramFound() ? ps_malloc(sizeof(AnimatedGIF)) : malloc(sizeof(AnimatedGIF));
+    if (!mem)
+      return false;
+    AnimatedGIF *decoder = new (mem) AnimatedGIF();
+    decoder->begin(GIF_PALETTE_RGB888);
+    if (decoder->open(path.c_str(), catalogOpenFile, catalogCloseFile, catalogReadFile, catalogSeekFile, previewGifLine)) {
+      if (startPreview(preview, decoder->getCanvasWidth(), decoder->getCanvasHeight()))
+        decoded = decoder->playFrame(false, NULL, &preview) >= 0 && preview.started;
+      decoder->close();
+    }
+    decoder->~AnimatedGIF();
+    free(mem);
+  }
+#ifdef USE_JPEGDEC
+  else {
+    static const int scaleOptions[] = { 0, JPEG_SCALE_HALF, JPEG_SCALE_QUARTER, JPEG_SCALE_EIGHTH };
+    void *mem = psramFound() ? ps_malloc(sizeof(JPEGDEC)) : malloc(sizeof(JPEGDEC));
+    if (!mem)
+      return false;
+    JPEGDEC *jpeg = new (mem) JPEGDEC();
+    if (jpeg->open(path.c_str(), catalogOpenFile, catalogCloseFile, catalogReadFile, catalogSeekFile, previewJpegBlock)) {
+      int w = jpeg->getWidth(), h = jpeg->getHeight();
+      int scale = 0; // decode at the smallest scale that still has a pixel per thumbnail pixel
+      while (scale < 3 && (w >> (scale + 1)) >= PREVIEW_SIZE && (h >> (scale + 1)) >= PREVIEW_SIZE)
+        scale++;
+      for (int i = 0; i < 256; i++) { // RGB332
+        preview.palette[i * 3] = (i >> 5) * 255 / 7;
+        preview.palette[i * 3 + 1] = ((i >> 2) & 7) * 255 / 7;
+        preview.palette[i * 3 + 2] = (i & 3) * 255 / 3;
+      }
+      jpeg->setPixelType(RGB565_LITTLE_ENDIAN);
+      jpeg->setUserPointer(&preview);
+      if (startPreview(preview, (w + (1 << scale) - 1) >> scale, (h + (1 << scale) - 1) >> scale))
+        decoded = jpeg->decode(0, 0, scaleOptions[scale]);
+      jpeg->close();
+    }
+    jpeg->~JPEGDEC();
+    free(mem);
+  }
+#endif
+  std::string previewName = generatedPreviewNameFor(name);
+  bool saved = decoded && writePreviewGif(("/gif/" + previewName).c_str(), preview);
+  free(preview.pixels);
+  if (saved)
+    catalogAdd(previewName.c_str(), "");
+  Serial.printf("Preview %s for %s: %s\n", previewName.c_str(), name.c_str(), saved ? "saved" : "failed");
+  return saved;
+}
+
+// Work through the preview queue from webTask(), one image every PREVIEW_JOB_INTERVAL
+static void runPreviewJobs() {
+  static unsigned long lastJob = 0;
+  if (previewJobs.empty() || millis() - lastJob < PREVIEW_JOB_INTERVAL)
+    return;
+  lastJob = millis();
+  std::string name = previewJobs.front();
+  previewJobs.erase(previewJobs.begin());
+  const MediaEntry *entry = findMedia(name.c_str());
+  if (entry && !entry->hasPreview()) // still there and nobody uploaded a preview meanwhile
+    makePreview(name);
+}
+
+// Shades of the iris colour for the texture, brightest at shade 255
+static void setIrisPalette(uint16_t color) {
+  int r = (color >> 11) & 0x1F, g = (color >> 5) & 0x3F, b = color & 0x1F;
+  for (int i = 0; i < 256; i++)
+    irisPalette[i] = ((r * i / 255) << 11) | ((g * i / 255) << 5) | (b * i / 255);
+}
+
+// Radial fibres and a darker rim as 8-bit shades, 0 outside the iris is transparent
+static void initIrisTexture() {
+  irisTexture.setColorDepth(8);
+  if (!irisTexture.createSprite(EYE_IRIS_TEXTURE, EYE_IRIS_TEXTURE))
+    return;
+  uint8_t *texels = (uint8_t *)irisTexture.getPointer();
+  const float c = (EYE_IRIS_TEXTURE - 1) / 2.0f;
+  for (int y = 0; y < EYE_IRIS_TEXTURE; y++) {
+    for (int x = 0; x < EYE_IRIS_TEXTURE; x++) {
+      float r = sqrtf((x - c) * (x - c) + (y - c) * (y - c)) / (c + 0.5f);
+      float shade = 0.85f + 0.15f * sinf(atan2f(y - c, x - c) * 13) * r - (r > 0.8f ? (r - 0.8f) * 2.5f : 0);
+      texels[y * EYE_IRIS_TEXTURE + x] = r > 1 ? 0 : (uint8_t)constrain(shade * 255, 1, 255);
+    }
+  }
+  irisTexture.setPivot(EYE_IRIS_TEXTURE / 2, EYE_IRIS_TEXTURE / 2);
+  setIrisPalette(eyeNow.irisColor);
+}
+
+static uint32_t spiTunedHz = 0; // write clock found by tuneWriteFrequency(), 0 if the panel can't be read back
+
+// Write clock for this board's wiring: tuned once at boot, then kept in prefs. Must run before
+// initDMA(), which takes the clock; /spi?retune drops the saved one
+static void initSpiClock() {
+  uint32_t hz = prefs.getUInt("spiClock", 0);
+  if (!hz) {
+    hz = tft.tuneWriteFrequency(SPI_TUNE_MAX_HZ);
+    if (hz)
+      prefs.putUInt("spiClock", hz);
+  }
+  if (hz)
+    tft.setWriteFrequency(hz);
+  spiTunedHz = hz;
+}
+
+// Allocate the back buffer; must run before initDMA(), TFT_eSprite only uses PSRAM while DMA is off
+static void initCanvas() {
+  if (!psramFound())
+    return;
+  eyeBack.setColorDepth(16);
+  uint16_t *back = (uint16_t *)eyeBack.createSprite(tft.width(), tft.height());
+  eyeFront = back ? (uint16_t *)ps_malloc(tft.width() * tft.height() * sizeof(uint16_t)) : NULL;
+  if (!eyeFront) {
+    eyeBack.deleteSprite();
+    Serial.println("Eye back buffer not available, drawing directly");
+    return;
+  }
+  eyeBack.fillSprite(TFT_BLACK);
+  canvas = &eyeBack;
+  initIrisTexture();
+  if (!eyeOpenBox.createSprite(EYE_BOX, EYE_BOX))
+    Serial.println("Eye cache not available, lid moves redraw the eye");
+#ifdef USE_LOOK_CANVAS
+  if (!lookCanvas.createSprite(LOOK_CANVAS, LOOK_CANVAS))
+    Serial.println("Look canvas not available");
+#endif
+}
+
+// Send the rows of a back buffer region that changed since the last present, trimmed to the changed columns
+static void presentRegion(int x0, int y0, int rw, int rh) {
+  if (!eyeFront)
+    return;
+  const uint16_t *back = (const uint16_t *)eyeBack.getPointer();
+  int w = eyeBack.width(), h = eyeBack.height();
+  if (!eyeFrontValid) { // the panel shows something else, send everything
+    x0 = y0 = 0;
+    rw = w;
+    rh = h;
+  }
+  xOffset = 0; // the back buffer covers the screen
+  yOffset = 0;
+  int y = y0, yEnd = y0 + rh, xEnd = x0 + rw;
+  while (y < yEnd) {
+    // Collect a band of changed rows and the columns they changed in
+    int top = y, left = xEnd, right = x0;
+    for (; y < yEnd; y++) {
+      const uint16_t *b = back + y * w, *f = eyeFront + y * w;
+      int l = x0, r = xEnd;
+      if (eyeFrontValid) {
+        while (l < xEnd && b[l] == f[l])
+          l++;
+        if (l == xEnd)
+          break; // unchanged row ends the band
+        while (r > l && b[r - 1] == f[r - 1])
+          r--;
+      }
+      left = std::min(left, l);
+      right = std::max(right, r);
+    }
+    if (y == top) { // this row is unchanged
+      y++;
+      continue;
+    }
+    int bw = right - left;
+    for (int row = top; row < y; row++) {
+#ifdef USE_DMA
+      memcpy(stripLine(left, row, bw), back + row * w + left, bw * sizeof(uint16_t));
+      if (++stripLines == DMA_STRIP_LINES)
+        flushStrip();
+#else
+      TFTDraw(left, row, bw, 1, (uint16_t *)back + row * w + left);
+#endif
+      memcpy(eyeFront + row * w + left, back + row * w + left, bw * sizeof(uint16_t));
+    }
+    flushStrip();
+  }
+  releaseDisplayBus(); // the strip buffers are reused and the SD card may need the bus
+  eyeFrontValid = true;
+}
+
+// Make presentRegion() send a region again although the back buffer didn't change there
+static void markUnsent(int x0, int y0, int x1, int y1) {
+  if (!eyeFront || !eyeFrontValid)
+    return;
+  const uint16_t *back = (const uint16_t *)eyeBack.getPointer();
+  int w = eyeBack.width();
+  x0 = std::max(0, x0);
+  y0 = std::max(0, y0);
+  x1 = std::min(w, x1);
+  y1 = std::min<int>(eyeBack.height(), y1);
+  for (int y = y0; y < y1; y++)
+    for (int x = x0; x < x1; x++)
+      eyeFront[y * w + x] = ~back[y * w + x];
+}
+
+static void presentCanvas() {
+  presentRegion(0, 0, eyeBack.width(), eyeBack.height());
+}
+
+// Procedural backgrounds ("colorful"), animated by the player task on the eye's 30 fps tick and
+// drawn straight into the DMA strips. Per frame the palette and the row, column and diagonal
+// terms come from a sine table, so a pixel is three adds and a palette read, no floating point
+#define EFFECT_TICK_MS EYE_TICK_MS
+enum EffectType : uint8_t { EFFECT_NONE, EFFECT_PLASMA };
+static EffectType effectShown = EFFECT_NONE;
+static uint32_t effectStart = 0;     // millis() when it started, the effect's clock
+static int8_t sineTable[256];         // sin(2 pi i / 256) * 127, built by startEffect()
+static uint16_t effectPalette[256];   // big-endian RGB565, as the strips are sent
+
+// Phase in 1/256 turns
+static inline int isin(uint32_t phase) {
+  return sineTable[phase & 255];
+}
+
+static void renderPlasma(uint32_t t) {
+  static int16_t colTerm[DISPLAY_WIDTH + 16], rowTerm[DISPLAY_WIDTH], diagTerm[2 * DISPLAY_WIDTH];
+  int w = std::min<int>(tft.width(), DISPLAY_WIDTH), h = std::min<int>(tft.height(), DISPLAY_WIDTH);
+  xOffset = 0; // drawn over the whole screen
+  yOffset = 0;
+  // Red, green and blue a third of a turn apart, cycled through the bands over time
+  for (int i = 0; i < 256; i++) {
+    uint32_t p = i + t / 12;
+    effectPalette[i] = __builtin_bswap16(tft.color565(128 + isin(p), 128 + isin(p + 85), 128 + isin(p + 171)));
+  }
+  for (int x = 0; x < w + 16; x++)
+    colTerm[x] = isin(x * 3 / 2 + t / 16);
+  for (int y = 0; y < h; y++)
+    rowTerm[y] = isin(y * 2 + t / 23);
+  for (int d = 0; d < w + h; d++)
+    diagTerm[d] = isin(d + t / 11);
+  for (int y = 0; y < h; y++) {
+#ifdef USE_DMA
+    uint16_t *line = stripLine(0, y, w);
+#else
+    uint16_t line[DISPLAY_WIDTH];
+#endif
+    const int16_t *col = colTerm + 8 + isin(y * 4 + t / 7) / 16; // rows sway sideways, -8..8 px
+    const int16_t *diag = diagTerm + y;
+    int row = rowTerm[y];
+    for (int x = 0; x < w; x++)
+      line[x] = effectPalette[((col[x] + row + diag[x]) >> 1) & 255];
+#ifdef USE_DMA
+    if (++stripLines == DMA_STRIP_LINES) {
+      flushStrip();
+      if (renderCancelled())
+        break; // the next command replaces the effect
+    }
+#else
+    TFTDraw(0, y, w, 1, line);
+    if (renderCancelled())
+      break;
+#endif
+  }
+  flushStrip();
+  releaseDisplayBus(); // the strip buffers are reused and the SD card may need the bus
+}
+
+static void renderEffect() {
+  uint32_t t = millis() - effectStart;
+  switch (effectShown) {
+    case EFFECT_PLASMA:
+      renderPlasma(t);
+      break;
+    default:
+      break;
+  }
+}
+
+static void startEffect(EffectType type) {
+  if (!sineTable[64]) {
+    for (int i = 0; i < 256; i++)
+      sineTable[i] = (int8_t)lroundf(sinf(i * 2 * PI / 256) * 127);
+  }
+  eyeFrontValid = false; // drawn straight to the panel
+  effectShown = type;
+  effectStart = millis();
+  renderEffect();
+}
+
+// Orientation is applied by the panel (GC9A01 MADCTL): quarter turns plus an optional
+// mirror for the other eye, so GIFs, JPEGs, native frames and eye drawings all share one
+// asset set and no frame is rotated by the CPU
+static void applyOrientation(int quarterTurns, bool mirror) {
+  tft.setRotation((quarterTurns & 3) | (mirror ? 4 : 0));
+  panelMirrored = mirror;
+}
+
+// Lid edge on a row of the eye box, as wide as the white at that row, its ends blended into the black
+static void drawLidEdge(int cx, int cy, int row) {
+  int dy = row - cy;
+  float edge = sqrtf(EYE_SCLERA_RADIUS * EYE_SCLERA_RADIUS - dy * dy);
+  int half = (int)edge;
+  canvas->drawFastHLine(cx - half, row, 2 * half + 1, TFT_WHITE);
+  uint8_t alpha = (uint8_t)((edge - half) * 255);
+  if (half < EYE_SCLERA_RADIUS && alpha) {
+    canvas->drawPixel(cx - half - 1, row, TFT_WHITE, alpha, TFT_BLACK);
+    canvas->drawPixel(cx + half + 1, row, TFT_WHITE, alpha, TFT_BLACK);
+  }
+}
+
+static int lidRowsFor(float lid) {
+  return (int)lroundf(lid * (EYE_SCLERA_RADIUS + 1) / 100);
+}
+
+static bool sameOpenEye(const EyeState &a, const EyeState &b) {
+  return a.gazeX == b.gazeX && a.gazeY == b.gazeY && a.dilation == b.dilation && a.irisColor == b.irisColor;
+}
+
+// Rebuild one row of the eye box in the back buffer: black under a lid, else restored from eyeOpenBox
+static void drawEyeRow(int cx, int cy, int row, int lidRows) {
+  const int R = EYE_SCLERA_RADIUS;
+  uint16_t *dst = (uint16_t *)eyeBack.getPointer() + row * eyeBack.width() + cx - R;
+  bool covered = lidRows > 0 && (row < cy - R + lidRows || row > cy + R - lidRows);
+  if (covered)
+    memset(dst, 0, EYE_BOX * sizeof(uint16_t)); // TFT_BLACK
+  else
+    memcpy(dst, (uint16_t *)eyeOpenBox.getPointer() + (row - cy + R) * EYE_BOX, EYE_BOX * sizeof(uint16_t));
+  if (covered && (row == cy - R + lidRows - 1 || row == cy + R + 1 - lidRows || row == cy + 1))
+    drawLidEdge(cx, cy, row); // edges, and the two pixel line of a closed eye
+}
+
+// Only the lids moved: rebuild the rows between the old and new edge of each lid and send just those
+static void moveLids(int cx, int cy, int lidRows) {
+  const int R = EYE_SCLERA_RADIUS;
+  int lo = std::min(eyeLidRows, lidRows), hi = std::max(eyeLidRows, lidRows);
+  int bands[2][2] = {
+    { std::max(cy - R, cy - R + lo - 1), cy - R + hi - 1 + (hi > R) }, // upper lid, with the closed line
+    { cy + R + 1 - hi, std::min(cy + R, cy + R + 1 - lo) }             // lower lid
+  };
+  eyeLidRows = lidRows;
+  for (const auto &band : bands) {
+    for (int row = band[0]; row <= band[1]; row++)
+      drawEyeRow(cx, cy, row, lidRows);
+    presentRegion(cx - R, band[0], EYE_BOX, band[1] - band[0] + 1);
+  }
+}
+
+// Draw eyeNow into the eye box: white, textured iris, pupil, then the lids closing from top and bottom.
+// In the back buffer the white, the iris rim and the pupil are anti-aliased, the blends go through the
+// 16-bit Sprite's in-buffer blend instead of reading pixels back
+static void renderEye() {
+  int cx = canvas->width()/2, cy = canvas->height()/2;
+  const int R = EYE_SCLERA_RADIUS;
+  int lidRows = lidRowsFor(eyeNow.lid);
+  bool cached = canvas == &eyeBack && eyeOpenBox.created();
+  if (cached && eyeBoxValid && !eyeFullPresent && sameOpenEye(eyeNow, eyeBoxState)) {
+    if (lidRows != eyeLidRows)
+      moveLids(cx, cy, lidRows);
+    eyeDirty = false;
+    return;
+  }
+  float gazeX = panelMirrored ? -eyeNow.gazeX : eyeNow.gazeX; // both eyes keep looking the same way
+  int ix = cx + (int)lroundf(gazeX * PUPIL_RANGE / 100), iy = cy + (int)lroundf(eyeNow.gazeY * PUPIL_RANGE / 100);
+  int pupil = (int)lroundf(EYE_IRIS_RADIUS * eyeNow.dilation / 100);
+  canvas->fillRect(cx - R, cy - R, EYE_BOX, EYE_BOX, TFT_BLACK);
+  if (canvas == &eyeBack) {
+    eyeBack.fillSmoothCircle(cx, cy, R, TFT_WHITE, TFT_BLACK);
+    if (irisTexture.created()) {
+      // The texture's edge is hard, a one pixel wider smooth disc in its rim shade blends it into the white
+      eyeBack.fillSmoothCircle(ix, iy, EYE_IRIS_RADIUS + 1, irisPalette[EYE_IRIS_RIM_SHADE], TFT_WHITE);
+      spriteTransform m;
+      float scale = (2 * EYE_IRIS_RADIUS + 1) / (float)EYE_IRIS_TEXTURE;
+      irisTexture.setTransform(&m, 0, scale, scale, ix, iy);
+      irisTexture.pushTransformed(&eyeBack, &m, 0, true, irisPalette);
+    } else {
+      eyeBack.fillSmoothCircle(ix, iy, EYE_IRIS_RADIUS, eyeNow.irisColor, TFT_WHITE);
+    }
+    eyeBack.fillSmoothCircle(ix, iy, pupil, TFT_BLACK); // over the texture, blended with the buffer
+  } else {
+    canvas->fillCircle(cx, cy, R, TFT_WHITE);
+    canvas->fillCircle(ix, iy, EYE_IRIS_RADIUS, eyeNow.irisColor);
+    canvas->fillCircle(ix, iy, pupil, TFT_BLACK);
+  }
+  if (cached) {
+    // Keep the open eye for lid moves, then put the lids on
+    const uint16_t *back = (const uint16_t *)eyeBack.getPointer();
+    for (int row = 0; row < EYE_BOX; row++)
+      memcpy((uint16_t *)eyeOpenBox.getPointer() + row * EYE_BOX, back + (cy - R + row) * eyeBack.width() + cx - R,
+             EYE_BOX * sizeof(uint16_t));
+    eyeBoxState = eyeNow;
+    eyeBoxValid = true;
+    if (lidRows > 0) {
+      for (int row = cy - R; row <= cy + R; row++)
+        if (row < cy - R + lidRows || row > cy + R - lidRows)
+          drawEyeRow(cx, cy, row, lidRows);
+    }
+  } else if (lidRows > 0) {
+    canvas->fillRect(cx - R, cy - R, EYE_BOX, lidRows, TFT_BLACK);
+    canvas->fillRect(cx - R, cy + R + 1 - lidRows, EYE_BOX, lidRows, TFT_BLACK);
+    drawLidEdge(cx, cy, cy - R + lidRows - 1);
+    drawLidEdge(cx, cy, cy + R + 1 - lidRows);
+    if (lidRows > R)
+      drawLidEdge(cx, cy, cy + 1); // closed: a two pixel line
+  }
+  eyeLidRows = lidRows;
+  int x0 = cx - R, y0 = cy - R, x1 = cx + R + 1, y1 = cy + R + 1; // region to present
+#ifdef USE_PIXEL_KERNEL
+  TFT_eGlow &glow = stripKernel.get<FX_GLOW>();
+  if (fxEffect.glow && (glow.cx != ix || glow.cy != iy)) {
+    // The ring moves over pixels that stay the same and reaches past the eye box: mark its old
+    // and new squares as not sent so presentRegion() covers them
+    int r = glow.radius + glow.width;
+    for (int i = 0; i < 2; i++) {
+      markUnsent(glow.cx - r, glow.cy - r, glow.cx + r + 1, glow.cy + r + 1);
+      x0 = std::max(0, std::min<int>(x0, glow.cx - r));
+      y0 = std::max(0, std::min<int>(y0, glow.cy - r));
+      x1 = std::min<int>(canvas->width(), std::max<int>(x1, glow.cx + r + 1));
+      y1 = std::min<int>(canvas->height(), std::max<int>(y1, glow.cy + r + 1));
+      glow.cx = ix;
+      glow.cy = iy;
+    }
+  }
+#endif
+  if (eyeFullPresent)
+    presentCanvas();
+  else
+    presentRegion(x0, y0, x1 - x0, y1 - y0);
+  eyeFullPresent = false;
+  eyeDirty = false;
+}
+
+// Take over the screen for the procedural eye, optionally starting from a given state
+static void showEye(const EyeState &from) {
+  if (!eyeShown) {
+    canvas->fillScreen(TFT_BLACK);
+    eyeNow = from;
+    eyeShown = true;
+    eyeFullPresent = true;
+  }
+  eyeDirty = true;
+}
+
+static bool sameEye(const EyeState &a, const EyeState &b) {
+  return a.gazeX == b.gazeX && a.gazeY == b.gazeY && a.lid == b.lid && a.dilation == b.dilation &&
+         a.irisColor == b.irisColor;
+}
+
+static bool audioDriving() {
+  return audioMode != AUDIO_OFF && audioAt && millis() - audioAt < AUDIO_HOLD_MS;
+}
+
+// Iris colour at 40% brightness for silence up to full for level 255
+static uint16_t glowColor(uint16_t color, uint8_t level) {
+  uint32_t f = 102 + level * 153 / 255; // of 255
+  int r = (color >> 11) & 0x1F, g = (color >> 5) & 0x3F, b = color & 0x1F;
+  return (r * f / 255) << 11 | (g * f / 255) << 5 | b * f / 255;
+}
+
+// While samples come in, the pupil and iris glow follow the latest one without easing
+static void followAudio() {
+  if (!audioDriving())
+    return;
+  uint8_t level = audioLevel;
+  if (audioMode & AUDIO_PUPIL)
+    eyeNow.dilation = audioMin + (audioMax - audioMin) * level / 255.0f;
+  if (audioMode & AUDIO_GLOW)
+    eyeNow.irisColor = glowColor(eyeTarget.irisColor, level);
+}
+
+static float easeTowards(float now, float target, float rate, float snap) {
+  float d = target - now;
+  return fabsf(d) <= snap ? target : now + d * rate;
+}
+
+static float stepTowards(float now, float target, float step) {
+  return now < target ? std::min(target, now + step) : std::max(target, now - step);
+}
+
+// One tick of the procedural eye; renders only when something moved
+static void stepEye() {
+  EyeState before = eyeNow;
+  eyeNow.gazeX = easeTowards(eyeNow.gazeX, eyeTarget.gazeX, 0.5f, 0.5f);
+  eyeNow.gazeY = easeTowards(eyeNow.gazeY, eyeTarget.gazeY, 0.5f, 0.5f);
+  eyeNow.dilation = easeTowards(eyeNow.dilation, eyeTarget.dilation, 0.3f, 0.5f);
+  eyeNow.lid = stepTowards(eyeNow.lid, eyeTarget.lid, EYE_LID_STEP);
+  if (eyeBlinking && eyeNow.lid >= 100) { // closed, open again from the next tick
+    eyeTarget.lid = eyeBlinkLid;
+    eyeBlinking = false;
+  }
+  eyeNow.irisColor = eyeTarget.irisColor;
+  followAudio();
+  if (eyeNow.irisColor != before.irisColor)
+    setIrisPalette(eyeNow.irisColor);
+  if (!sameEye(before, eyeNow))
+    eyeDirty = true;
+  if (eyeDirty)
+    renderEye();
+}
+
+// True while the eye is shown and still has to move or be drawn
+static bool eyeBusy() {
+  return eyeShown && (eyeDirty || !sameEye(eyeNow, eyeTarget) || audioDriving());
+}
+
+// Draw the look canvas: sclera, textured iris, pupil and a catchlight, centred, in the
+// procedural eye's iris colour and dilation
+static void drawLookCanvas() {
+  const int c = LOOK_CANVAS / 2;
+  lookColor = eyeTarget.irisColor;
+  lookDilation = eyeTarget.dilation;
+  lookCanvas.fillSprite(TFT_BLACK);
+  lookCanvas.fillSmoothCircle(c, c, LOOK_SCLERA_RADIUS, TFT_WHITE, TFT_BLACK);
+  if (irisTexture.created()) {
+    setIrisPalette(lookColor);
+    lookCanvas.fillSmoothCircle(c, c, LOOK_IRIS_RADIUS + 1, irisPalette[EYE_IRIS_RIM_SHADE], TFT_WHITE);
+    spriteTransform m;
+    float scale = (2 * LOOK_IRIS_RADIUS + 1) / (float)EYE_IRIS_TEXTURE;
+    irisTexture.setTransform(&m, 0, scale, scale, c, c);
+    irisTexture.pushTransformed(&lookCanvas, &m, 0, true, irisPalette);
+    setIrisPalette(eyeNow.irisColor); // the procedural eye's, which may follow the audio
+  } else {
+    lookCanvas.fillSmoothCircle(c, c, LOOK_IRIS_RADIUS, lookColor, TFT_WHITE);
+  }
+  lookCanvas.fillSmoothCircle(c, c, (int)lroundf(LOOK_IRIS_RADIUS * lookDilation / 100), TFT_BLACK);
+  lookCanvas.fillSmoothCircle(c - LOOK_IRIS_RADIUS / 3, c - LOOK_IRIS_RADIUS / 3, LOOK_IRIS_RADIUS / 6, TFT_WHITE);
+  lookDrawn = true;
+}
+
+// Send the screen's window of the look canvas at lookX, lookY, row by row into the DMA strips;
+// nothing if the window didn't move
+static void presentLook() {
+  int w = tft.width(), h = tft.height();
+  int marginX = (LOOK_CANVAS - w) / 2, marginY = (LOOK_CANVAS - h) / 2;
+  float gazeX = panelMirrored ? -lookX : lookX; // both eyes keep looking the same way
+  int sx = marginX - (int)lroundf(gazeX * marginX / 100), sy = marginY - (int)lroundf(lookY * marginY / 100);
+  if (sx == lookSentX && sy == lookSentY)
+    return;
+  const uint16_t *src = (const uint16_t *)lookCanvas.getPointer() + sy * LOOK_CANVAS + sx;
+  xOffset = 0; // the window covers the screen
+  yOffset = 0;
+  for (int row = 0; row < h; row++, src += LOOK_CANVAS) {
+#ifdef USE_DMA
+    memcpy(stripLine(0, row, w), src, w * sizeof(uint16_t));
+    if (++stripLines == DMA_STRIP_LINES)
+      flushStrip();
+#else
+    TFTDraw(0, row, w, 1, (uint16_t *)src);
+#endif
+  }
+  flushStrip();
+  releaseDisplayBus(); // the strip buffers are reused and the SD card may need the bus
+  lookSentX = sx;
+  lookSentY = sy;
+  eyeFrontValid = false; // the eye's back buffer no longer matches the panel
+}
+
+// CMD_LOOK: take over the screen at the given point, or pan towards it if already shown. The
+// canvas is drawn again only when the iris colour or dilation changed since
+static void startLook(const DisplayCommand &cmd) {
+  if (!lookDrawn || lookColor != eyeTarget.irisColor || lookDilation != eyeTarget.dilation) {
+    drawLookCanvas();
+    lookSentX = -1;
+  }
+  if (!lookShown) {
+    lookX = cmd.x;
+    lookY = cmd.y;
+    lookSentX = -1;
+    lookShown = true;
+  }
+  lookTargetX = cmd.x;
+  lookTargetY = cmd.y;
+  presentLook();
+}
+
+// One tick of panning, eased like the procedural eye's gaze
+static void stepLook() {
+  lookX = easeTowards(lookX, lookTargetX, 0.5f, 0.5f);
+  lookY = easeTowards(lookY, lookTargetY, 0.5f, 0.5f);
+  presentLook();
+}
+
+static bool lookBusy() {
+  return lookShown && (lookX != lookTargetX || lookY != lookTargetY || lookSentX < 0);
+}
+
+struct AtlasDecode {
+  uint16_t *pixels;
+  int w, h;
+};
+
+// First frame lines of a sheet GIF, looked up in the big-endian palette; transparent pixels stay black
+static void atlasGifLine(GIFDRAW *pDraw) {
+  AtlasDecode *d = (AtlasDecode *)pDraw->pUser;
+  int y = pDraw->iY + pDraw->y;
+  if (y >= d->h || pDraw->iX >= d->w)
+    return;
+  uint16_t *dst = d->pixels + y * d->w + pDraw->iX;
+  int n = std::min<int>(pDraw->iWidth, d->w - pDraw->iX);
+  for (int x = 0; x < n; x++) {
+    uint8_t c = pDraw->pPixels[x];
+    if (!pDraw->ucHasTransparency || c != pDraw->ucTransparent)
+      dst[x] = pDraw->pPalette[c];
+  }
+}
+
+#ifdef USE_JPEGDEC
+static int atlasJpegBlock(JPEGDRAW *pDraw) {
+  AtlasDecode *d = (AtlasDecode *)pDraw->pUser;
+  int n = std::min(pDraw->iWidth, d->w - pDraw->x);
+  for (int row = 0; row < pDraw->iHeight && pDraw->y + row < d->h; row++)
+    memcpy(d->pixels + (pDraw->y + row) * d->w + pDraw->x, pDraw->pPixels + row * pDraw->iWidth, n * sizeof(uint16_t));
+  return 1;
+}
+#endif
+
+static const uint16_t *atlasTilePixels(int tile) {
+  return atlasSheet + (tile / atlasCols) * atlasTileH * atlasSheetW + (tile % atlasCols) * atlasTileW;
+}
+
+// Box of the pixels in which each tile differs from tile 0
+static void indexAtlasTiles() {
+  for (int t = 0; t < atlasCols * atlasRows; t++) {
+    AtlasTile &box = atlasTiles[t];
+    box = { (int16_t)atlasTileW, (int16_t)atlasTileH, 0, 0 };
+    const uint16_t *base = atlasSheet, *tile = atlasTilePixels(t);
+    for (int y = 0; y < atlasTileH; y++, base += atlasSheetW, tile += atlasSheetW) {
+      int x0 = 0, x1 = atlasTileW;
+      while (x0 < x1 && tile[x0] == base[x0])
+        x0++;
+      if (x0 == x1)
+        continue;
+      while (tile[x1 - 1] == base[x1 - 1])
+        x1--;
+      box.x0 = std::min<int>(box.x0, x0);
+      box.x1 = std::max<int>(box.x1, x1);
+      box.y0 = std::min<int>(box.y0, y);
+      box.y1 = y + 1;
+    }
+  }
+}
+
+// CMD_ATLAS_LOAD: decode the first frame of /gif/<name> (GIF, or JPEG with USE_JPEGDEC) into a new
+// sheet with a decoder of its own, cut it into cols x rows tiles and index them
+static bool loadAtlas(const char *name, int cols, int rows) {
+  unsigned long started = millis();
+  String path = "/gif/" + String(name);
+  releaseDisplayBus(); // the card may share the bus
+  free(atlasSheet);
+  atlasSheet = NULL;
+  atlasShown = false;
+  AtlasDecode d = { NULL, 0, 0 };
+  bool decoded = false;
+  if (isGifName(path)) {
+    void *mem = ps_malloc(sizeof(AnimatedGIF));
+    if (!mem)
+      return false;
+    AnimatedGIF *decoder = new (mem) AnimatedGIF();
+    decoder->begin(BIG_ENDIAN_PIXELS);
+    if (decoder->open(path.c_str(), catalogOpenFile, catalogCloseFile, catalogReadFile, catalogSeekFile, atlasGifLine)) {
+      d.w = decoder->getCanvasWidth();
+      d.h = decoder->getCanvasHeight();
+      if ((size_t)d.w * d.h * sizeof(uint16_t) <= ATLAS_MAX_BYTES)
+        d.pixels = (uint16_t *)ps_calloc((size_t)d.w * d.h, sizeof(uint16_t));
+      if (d.pixels)
+        decoded = decoder->playFrame(false, NULL, &d) >= 0;
+      decoder->close();
+    }
+    decoder->~AnimatedGIF();
+    free(mem);
+  }
+#ifdef USE_JPEGDEC
+  else {
+    void *mem = ps_malloc(sizeof(JPEGDEC));
+    if (!mem)
+      return false;
+    JPEGDEC *jpeg = new (mem) JPEGDEC();
+    if (jpeg->open(path.c_str(), catalogOpenFile, catalogCloseFile, catalogReadFile, catalogSeekFile, atlasJpegBlock)) {
+      d.w = jpeg->getWidth();
+      d.h = jpeg->getHeight();
+      if ((size_t)d.w * d.h * sizeof(uint16_t) <= ATLAS_MAX_BYTES)
+        d.pixels = (uint16_t *)ps_calloc((size_t)d.w * d.h, sizeof(uint16_t));
+      if (d.pixels) {
+        jpeg->setPixelType(RGB565_BIG_ENDIAN);
+        jpeg->setUserPointer(&d);
+        decoded = jpeg->decode(0, 0, 0);
+      }
+      jpeg->close();
+    }
+    jpeg->~JPEGDEC();
+    free(mem);
+  }
+#endif
+  int tileW = cols > 0 ? d.w / cols : 0, tileH = rows > 0 ? d.h / rows : 0;
+  if (!decoded || tileW <= 0 || tileH <= 0 || tileW > tft.width() || tileH > tft.height() ||
+      cols * rows > ATLAS_MAX_TILES) {
+    free(d.pixels);
+    Serial.printf("Atlas %s: failed (%dx%d, %dx%d tiles)\n", name, d.w, d.h, cols, rows);
+    return false;
+  }
+  atlasSheet = d.pixels;
+  atlasSheetW = d.w;
+  atlasSheetH = d.h;
+  atlasCols = cols;
+  atlasRows = rows;
+  atlasTileW = tileW;
+  atlasTileH = tileH;
+  indexAtlasTiles();
+  Serial.printf("Atlas %s: %d tiles of %dx%d in %lu ms\n", name, cols * rows, tileW, tileH, millis() - started);
+  return true;
+}
+
+// Send tile `tile` centred: the whole tile after something else was shown, otherwise only the
+// rows and columns inside its box or the shown tile's box
+static void presentAtlas(int tile) {
+  if (tile == atlasSent)
+    return;
+  int x0 = 0, y0 = 0, x1 = atlasTileW, y1 = atlasTileH;
+  if (atlasSent < 0) {
+    if (atlasTileW < tft.width() || atlasTileH < tft.height()) {
+#ifdef USE_DMA
+      tft.dmaWait(); // blocking writes must not interleave with a running DMA transfer
+#endif
+      tft.fillScreen(TFT_BLACK);
+    }
+  } else {
+    const AtlasTile &a = atlasTiles[atlasSent], &b = atlasTiles[tile];
+    bool aEmpty = a.x0 >= a.x1, bEmpty = b.x0 >= b.x1;
+    if (aEmpty && bEmpty) { // both look like tile 0
+      atlasSent = tile;
+      return;
+    }
+    x0 = aEmpty ? b.x0 : bEmpty ? a.x0 : std::min(a.x0, b.x0);
+    y0 = aEmpty ? b.y0 : bEmpty ? a.y0 : std::min(a.y0, b.y0);
+    x1 = aEmpty ? b.x1 : bEmpty ? a.x1 : std::max(a.x1, b.x1);
+    y1 = aEmpty ? b.y1 : bEmpty ? a.y1 : std::max(a.y1, b.y1);
+  }
+  xOffset = (tft.width() - atlasTileW) / 2;
+  yOffset = (tft.height() - atlasTileH) / 2;
+  const uint16_t *src = atlasTilePixels(tile) + y0 * atlasSheetW + x0;
+  for (int row = y0; row < y1; row++, src += atlasSheetW) {
+#ifdef USE_DMA
+    memcpy(stripLine(x0, row, x1 - x0), src, (x1 - x0) * sizeof(uint16_t));
+    if (++stripLines == DMA_STRIP_LINES)
+      flushStrip();
+#else
+    TFTDraw(x0, row, x1 - x0, 1, (uint16_t *)src);
+#endif
+  }
+  flushStrip();
+  releaseDisplayBus();
+  atlasSent = tile;
+  eyeFrontValid = false; // the eye's back buffer no longer matches the panel
+}
+
+// Tile of the grid nearest to a gaze point: columns span x -100..100 left to right, rows y top to
+// bottom; mirrored panels flip the columns so both eyes look the same way
+static int atlasTileAt(int x, int y) {
+  if (panelMirrored)
+    x = -x;
+  int col = atlasCols > 1 ? (int)lroundf((x + 100) * (atlasCols - 1) / 200.0f) : 0;
+  int row = atlasRows > 1 ? (int)lroundf((y + 100) * (atlasRows - 1) / 200.0f) : 0;
+  return row * atlasCols + col;
+}
+
+// CMD_ATLAS and CMD_ATLAS_LOAD
+static void showAtlas(const DisplayCommand &cmd) {
+  if (cmd.type == CMD_ATLAS_LOAD && !loadAtlas(cmd.name, cmd.x, cmd.y))
+    return;
+  if (!atlasSheet)
+    return;
+  int tile = cmd.type == CMD_ATLAS_LOAD ? 0 : cmd.value >= 0 ? cmd.value : atlasTileAt(cmd.x, cmd.y);
+  if (tile >= atlasCols * atlasRows)
+    return;
+  if (!atlasShown) {
+    atlasSent = -1;
+    atlasShown = true;
+  }
+  presentAtlas(tile);
+}
+
+// CMD_AUDIO: draw the sample now instead of on the next tick
+static void applyAudioCommand() {
+  audioWake = false;
+  if (!eyeShown)
+    return;
+  EyeState before = eyeNow;
+  followAudio();
+  if (eyeNow.irisColor != before.irisColor)
+    setIrisPalette(eyeNow.irisColor);
+  if (!sameEye(before, eyeNow))
+    renderEye();
+}
+
+static void applyEyeCommand(const DisplayCommand &cmd) {
+  if (cmd.value & EYE_SET_X)
+    eyeTarget.gazeX = cmd.x;
+  if (cmd.value & EYE_SET_Y)
+    eyeTarget.gazeY = cmd.y;
+  if (cmd.value & EYE_SET_LID) {
+    eyeTarget.lid = cmd.lid;
+    eyeBlinking = false;
+  }
+  if (cmd.value & EYE_SET_DILATION)
+    eyeTarget.dilation = cmd.dilation;
+  if (cmd.value & EYE_SET_COLOR)
+    eyeTarget.irisColor = cmd.color;
+  showEye(eyeTarget);
+}
+
+// Memory rows [y0, y1) that wrap round to the other edge at scroll dy
+static void shiftWrapRows(int dy, int &y0, int &y1) {
+  y0 = dy > 0 ? tft.height() - dy : 0;
+  y1 = dy > 0 ? tft.height() : -dy;
+}
+
+// CMD_SHIFT: move what the panel shows cmd.y rows down (negative: up) without sending it again.
+// The rows pushed past one edge come round at the other, they are blanked there and clipped from
+// then on. Rows that come back are redrawn from the eye's back buffer or the playing GIF's canvas,
+// after anything else they stay black until it draws them again
+static void applyShiftCommand(const DisplayCommand &cmd) {
+  int from = tft.getScrollY(), dy = cmd.y;
+  if (dy == from || (tft.getRotation() & 1))
+    return;
+  releaseDisplayBus(); // the strips in flight were clipped for the old scroll
+  tft.blankScrollWrap(dy, TFT_BLACK);
+  tft.setScrollY(dy);
+  int y0, y1, n0, n1;
+  shiftWrapRows(from, y0, y1);
+  shiftWrapRows(dy, n0, n1);
+  if (n0 == y0) // the bands share an edge, only the part the new one doesn't cover comes back
+    y0 = std::max(y0, n1);
+  if (n1 == y1)
+    y1 = std::min(y1, n0);
+  if (y0 >= y1 || (!eyeShown && !overlayGif))
+    return;
+  if (eyeShown && eyeFront) {
+    int w = tft.width();
+    memset(eyeFront + y0 * w, 0, (y1 - y0) * w * sizeof(uint16_t)); // blanked when they wrapped
+    presentRegion(0, y0, w, y1 - y0);
+  } else if (eyeShown) {
+    eyeDirty = true; // drawn straight on the panel, the eye box is drawn again
+  } else {
+    markOverlayArea(0, y0, tft.width(), y1); // presentOverlays() after the next frame
+  }
+}
+
+static bool isCacheCommand(uint8_t type) {
+  return type == CMD_DROP_CACHE || type == CMD_CLEAR_CACHE || type == CMD_TRIM_CACHE;
+}
+
+static void applyCacheCommand(const DisplayCommand &cmd) {
+  switch (cmd.type) {
+    case CMD_DROP_CACHE:
+      dropCachedGif(cmd.name);
+      break;
+    case CMD_CLEAR_CACHE:
+      if (playingName[0])
+        playingDropped = true;
+      clearFrameCache();
+      clearGifBlobs();
+#ifdef USE_PREFETCH
+      clearPrefetchedIndexes();
+#endif
+      break;
+    case CMD_TRIM_CACHE:
+      reserveCacheBytes(0); // evict down to the new budget
+#ifdef USE_PREFETCH
+      trimPrefetched(0);
+#endif
+      break;
+  }
+}
+
+// Called between frames: applies queued cache maintenance and reports
+// whether a display command is waiting or the playing file went away
+static bool playbackPreempted() {
+  DisplayCommand cmd;
+  while (xQueuePeek(displayQueue, &cmd, 0) == pdTRUE) {
+    if (!appliedBetweenFrames(cmd.type))
+      return true;
+#ifdef USE_FRAME_RING
+    if (decodingRing && cmd.type == CMD_CLEAR_CACHE)
+      return true; // frees the GIF in RAM the decoder task may be reading, applied once it stopped
+#endif
+    xQueueReceive(displayQueue, &cmd, 0);
+    if (cmd.type == CMD_OVERLAY)
+      applyOverlayCommand(cmd); // drawn by presentOverlays() after the next frame
+    else if (cmd.type == CMD_COLOR)
+      applyColorCommand(cmd);
+    else if (cmd.type == CMD_AUDIO)
+      audioWake = false; // no eye to move while something plays
+    else if (cmd.type == CMD_SHIFT)
+      applyShiftCommand(cmd);
+    else if (cmd.type == CMD_FX)
+      applyFxCommand(cmd);
+    else
+      applyCacheCommand(cmd);
+  }
+  return playingDropped;
+}
+
+// Replace the asset pack with the one received by /pack. It runs as a command of its own, so
+// nothing is being played from the old pack; cached copies of its files may be stale now
+static void installAssetPack() {
+  closeKeptGif();
+  clearFrameCache();
+  clearGifBlobs();
+  releaseDisplayBus();
+  if (packFile)
+    packFile.close(); // openAssetPack() finds the new pack's sectors
+  SD.remove(ASSET_PACK_PATH);
+  if (!SD.rename(ASSET_PACK_TEMP_PATH, ASSET_PACK_PATH))
+    Serial.println("Could not install the asset pack");
+  loadAssetPack();
+  assetPackInstalled = true;
+}
+
+// Next playlist item after `pos`: the following one, or in shuffle mode a weighted random pick
+// that doesn't repeat the item that just played. Call with playlistLock held
+static int pickPlaylistItem(int pos) {
+  int count = playlist.size();
+  if (count == 0)
+    return -1;
+  if (!playlistShuffle)
+    return (pos + 1) % count;
+  uint32_t total = 0;
+  for (int i = 0; i < count; i++) {
+    if (i != pos || count == 1)
+      total += playlist[i].weight;
+  }
+  if (total == 0)
+    return (pos + 1) % count;
+  uint32_t pick = esp_random() % total;
+  for (int i = 0; i < count; i++) {
+    if (i == pos && count > 1)
+      continue;
+    if (pick < playlist[i].weight)
+      return i;
+    pick -= playlist[i].weight;
+  }
+  return 0;
+}
+
+// Name the item after the playing one for readAheadPlaylist()
+static void setPlaylistUpNext() {
+  xSemaphoreTake(playlistLock, portMAX_DELAY);
+  bool picked = playlistNext >= 0 && playlistNext < (int)playlist.size();
+  strncpy(playlistUpNext, picked ? playlist[playlistNext].path.c_str() : "", sizeof(playlistUpNext) - 1);
+  xSemaphoreGive(playlistLock);
+}
+
+// Play the next playlist item, its loops back to back; the one after it is picked up front so
+// readAheadPlaylist() can load it during the last frame. Any command preempts the item and the
+// playlist goes on with the next one afterwards. False once a whole pass found nothing to play
+static bool runPlaylistItem() {
+  static int misses = 0; // items in a row that could not be played
+  xSemaphoreTake(playlistLock, portMAX_DELAY);
+  int count = playlist.size();
+  int pos = playlistNext >= 0 && playlistNext < count ? playlistNext : pickPlaylistItem(playlistPos);
+  PlaylistItem item;
+  if (pos >= 0) {
+    item = playlist[pos];
+    playlistNext = pickPlaylistItem(pos);
+  }
+  xSemaphoreGive(playlistLock);
+  if (pos < 0)
+    return false;
+  playlistPos = pos;
+
+  if (!mediaExists(item.path.c_str())) {
+    if (++misses < count)
+      return true;
+    misses = 0;
+    return false;
+  }
+  misses = 0;
+  textOnScreen = false;
+  eyeFrontValid = false;
+  beginTransition();
+  startFirstPixelClock(micros());
+  if (!isGifName(String(item.path.c_str()))) {
+    displayImage(item.path.c_str(), 1.0f, 0);
+    finishTransition();
+    firstPixelFrom = 0;
+    setPlaylistUpNext();
+    readAheadPlaylist(); // a still has no last frame, the next item loads while it is shown
+    waitFrame(item.loops * 1000UL);
+    return true;
+  }
+  for (int i = 0; i < item.loops; i++) {
+    if (i == item.loops - 1)
+      setPlaylistUpNext();
+    displayImage(item.path.c_str(), 1.0f, 0);
+    finishTransition();
+    playingName[0] = '\0';
+    if (playbackPreempted())
+      break;
+  }
+  firstPixelFrom = 0;
+  playlistUpNext[0] = '\0';
+  return true;
+}
+
+// Primitive benchmark (/bench): a fixed suite of TFT_eSPI operations on this panel, timed on the
+// player task, so SPI clocks, DMA modes and library changes can be compared on the hardware
+#define BENCH_MIN_US 200000   // each case repeats for at least this long
+#define BENCH_TIMEOUT_MS 30000
+
+struct BenchCase {
+  const char *name;
+  uint32_t bytes; // pixel bytes sent per op, 0 where the library decides
+  void (*run)(int i);
+};
+
+static uint16_t *benchFrame = NULL; // test pattern of the whole screen, PSRAM
+static TFT_eSprite benchSprite8 = TFT_eSprite(&tft), benchSprite16 = TFT_eSprite(&tft);
+static TFT_eSprite benchSpans = TFT_eSprite(&tft); // benchSprite16 compiled with TFT_DARKGREY transparent
+static String benchResult;          // JSON of the last run, handed to the web task by benchDone
+static SemaphoreHandle_t benchDone = NULL;
+
+static void benchFill(int i) {
+  tft.fillScreen(i & 1 ? TFT_NAVY : TFT_MAROON);
+}
+
+static void benchImageLines(int i) {
+  for (int y = 0; y < DISPLAY_WIDTH; y++)
+    tft.pushImage(0, y, DISPLAY_WIDTH, 1, benchFrame + y * DISPLAY_WIDTH);
+}
+
+static void benchImageFrame(int i) {
+  tft.pushImage(0, 0, DISPLAY_WIDTH, DISPLAY_WIDTH, benchFrame);
+}
+
+#ifdef USE_DMA
+// The frame in DMA strips from internal RAM, as GIF playback sends it
+static void benchImageDma(int i) {
+  tft.startWrite();
+  for (int y = 0; y < DISPLAY_WIDTH; y += DMA_STRIP_LINES)
+    tft.pushImageDMA(0, y, DISPLAY_WIDTH, DMA_STRIP_LINES, dmaStrip[(y / DMA_STRIP_LINES) % DMA_STRIP_BUFFERS]);
+  tft.dmaWait();
+  tft.endWrite();
+}
+#endif
+
+static void benchSprite8bpp(int i) {
+  benchSprite8.pushSprite(0, 0);
+}
+
+static void benchSprite16bpp(int i) {
+  benchSprite16.pushSprite(0, 0);
+}
+
+// An overlay with a transparent colour, tested pixel by pixel and then from its run table
+static void benchSpriteKey(int i) {
+  benchSprite16.pushSprite(0, 0, TFT_DARKGREY);
+}
+
+static void benchSpriteSpans(int i) {
+  benchSpans.pushSprite(0, 0, TFT_DARKGREY);
+}
+
+static void benchSmoothCircle(int i) {
+  tft.fillSmoothCircle(120, 120, 100, i & 1 ? TFT_WHITE : TFT_BLUE, TFT_BLACK);
+}
+
+static void benchSmoothArc(int i) {
+  tft.drawSmoothArc(120, 120, 115, 95, 30, 330, i & 1 ? TFT_WHITE : TFT_ORANGE, TFT_BLACK, true);
+}
+
+static void benchWideLine(int i) {
+  tft.drawWideLine(20, 40 + (i & 7), 220, 200 - (i & 7), 6, i & 1 ? TFT_WHITE : TFT_GREEN, TFT_BLACK);
+}
+
+static void benchText(int i) {
+  tft.setTextColor(i & 1 ? TFT_WHITE : TFT_YELLOW, TFT_BLACK);
+  tft.drawString("WALL-E 0123456789", 120, 120, 1); // GLCD at size 2, the only font Setup66 loads
+}
+
+static const BenchCase benchCases[] = {
+  { "fillScreen", DISPLAY_WIDTH * DISPLAY_WIDTH * 2, benchFill },
+  { "pushImageLines", DISPLAY_WIDTH * DISPLAY_WIDTH * 2, benchImageLines },
+  { "pushImageFrame", DISPLAY_WIDTH * DISPLAY_WIDTH * 2, benchImageFrame },
+#ifdef USE_DMA
+  { "pushImageDMA", DISPLAY_WIDTH * DISPLAY_WIDTH * 2, benchImageDma },
+#endif
+  { "sprite8", DISPLAY_WIDTH * DISPLAY_WIDTH * 2, benchSprite8bpp },
+  { "sprite16", DISPLAY_WIDTH * DISPLAY_WIDTH * 2, benchSprite16bpp },
+  { "sprite16Key", 0, benchSpriteKey },
+  { "sprite16Spans", 0, benchSpriteSpans },
+  { "fillSmoothCircle", 0, benchSmoothCircle },
+  { "drawSmoothArc", 0, benchSmoothArc },
+  { "drawWideLine", 0, benchWideLine },
+  { "drawString", 0, benchText },
+};
+
+// CMD_BENCH: run every case for BENCH_MIN_US and leave the JSON in benchResult
+static void runBench() {
+  flushStrip();
+  releaseDisplayBus();
+#ifdef USE_DMA
+  tft.dmaWait();
+#endif
+  benchFrame = (uint16_t *)ps_malloc(DISPLAY_WIDTH * DISPLAY_WIDTH * sizeof(uint16_t));
+  benchSprite8.setColorDepth(8);
+  benchSprite16.setColorDepth(16);
+  TFT_eSpritePool *pool = spritePoolFor();
+  if (!benchFrame || !benchSprite8.createSprite(DISPLAY_WIDTH, DISPLAY_WIDTH, pool) ||
+      !benchSprite16.createSprite(DISPLAY_WIDTH, DISPLAY_WIDTH, pool) ||
+      !benchSpans.createSprite(DISPLAY_WIDTH, DISPLAY_WIDTH, pool)) {
+    benchResult = "{\"error\":\"no PSRAM for the test images\"}";
+  } else {
+    for (int y = 0; y < DISPLAY_WIDTH; y++)
+      for (int x = 0; x < DISPLAY_WIDTH; x++)
+        benchFrame[y * DISPLAY_WIDTH + x] = tft.color565(x, y, x ^ y);
+#ifdef USE_DMA
+    for (int i = 0; i < DMA_STRIP_BUFFERS; i++)
+      memcpy(dmaStrip[i], benchFrame + i * DMA_STRIP_LINES * DISPLAY_WIDTH, sizeof(dmaStrip[i]));
+#endif
+    for (TFT_eSprite *sprite : { &benchSprite8, &benchSprite16, &benchSpans }) {
+      sprite->fillSprite(TFT_DARKGREY);
+      sprite->fillCircle(120, 120, 90, TFT_WHITE);
+      sprite->fillCircle(120, 120, 40, TFT_BLUE);
+    }
+    benchSpans.compileSprite(TFT_DARKGREY);
+    tft.setTextDatum(MC_DATUM);
+    tft.setTextSize(2);
+    benchResult = "{\"spiHz\":" + String((unsigned long)tft.getWriteFrequency());
+#ifdef USE_DMA
+    benchResult += ",\"dma\":true";
+#else
+    benchResult += ",\"dma\":false";
+#endif
+    benchResult += ",\"shadow\":" + String(tft.getShadowBuffer() ? "true" : "false") + ",\"cases\":[";
+    for (size_t c = 0; c < sizeof(benchCases) / sizeof(benchCases[0]); c++) {
+      const BenchCase &bench = benchCases[c];
+      uint32_t ops = 0, elapsed, t0 = micros();
+      do {
+        bench.run(ops++);
+        elapsed = micros() - t0;
+      } while (elapsed < BENCH_MIN_US);
+      char line[160];
+      snprintf(line, sizeof(line), "%s{\"name\":\"%s\",\"ops\":%lu,\"usPerOp\":%.1f,\"mbps\":%.2f}", c ? "," : "",
+               bench.name, (unsigned long)ops, (float)elapsed / ops, bench.bytes ? (float)bench.bytes * ops / elapsed : 0.0f);
+      benchResult += line;
+    }
+    benchResult += "]}";
+    tft.setTextDatum(TL_DATUM);
+    tft.setTextSize(1);
+  }
+  benchSprite8.deleteSprite();
+  benchSprite16.deleteSprite();
+  benchSpans.deleteSprite();
+  free(benchFrame);
+  benchFrame = NULL;
+  tft.fillScreen(TFT_BLACK);
+  eyeFrontValid = false;
+  xSemaphoreGive(benchDone);
+}
+
+// Card benchmark (/sdbench): sequential and random reads of one file on the card, timed on the
+// player task the way playback reads, to qualify cards before they go into the robot
+#define SD_BENCH_BYTES (4 * 1024 * 1024) // read sequentially, at most the whole file
+#define SD_BENCH_RANDOM_READS 256
+#define SD_BENCH_RANDOM_SIZE 4096        // bytes per random read, sector aligned
+
+// CMD_SD_BENCH: read the file at path and leave the JSON in benchResult
+static void runSdBench(const char *path) {
+  flushStrip();
+  releaseDisplayBus();
+#ifdef USE_DMA
+  tft.dmaWait();
+#endif
+  uint8_t *buf = (uint8_t *)heap_caps_malloc(SD_READAHEAD_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  File f = SD.open(path);
+  if (!buf || !f || f.size() < SD_BENCH_RANDOM_SIZE) {
+    benchResult = buf ? "{\"error\":\"cannot read the file\"}" : "{\"error\":\"no memory for the read buffer\"}";
+  } else {
+    uint32_t size = f.size();
+    uint32_t seqBytes = 0, seqWanted = std::min<uint32_t>(size, SD_BENCH_BYTES);
+    uint32_t t0 = micros();
+    while (seqBytes < seqWanted) {
+      int n = f.read(buf, std::min<uint32_t>(SD_READAHEAD_SIZE, seqWanted - seqBytes));
+      if (n <= 0)
+        break;
+      seqBytes += n;
+    }
+    uint32_t seqUs = micros() - t0;
+
+    uint32_t sectors = (size - SD_BENCH_RANDOM_SIZE) / SD_SECTOR_SIZE + 1;
+    uint32_t randReads = 0, randUs = 0, randMaxUs = 0;
+    for (int i = 0; i < SD_BENCH_RANDOM_READS; i++) {
+      uint32_t at = esp_random() % sectors * SD_SECTOR_SIZE;
+      uint32_t r0 = micros();
+      if (!f.seek(at) || f.read(buf, SD_BENCH_RANDOM_SIZE) != (size_t)SD_BENCH_RANDOM_SIZE)
+        break;
+      uint32_t us = micros() - r0;
+      randUs += us;
+      randMaxUs = std::max(randMaxUs, us);
+      randReads++;
+    }
+
+    char json[320];
+    snprintf(json, sizeof(json),
+             "{\"file\":\"%s\",\"sdHz\":%lu,\"tuned\":%s,\"sequential\":{\"bytes\":%lu,\"mbps\":%.2f},"
+             "\"random\":{\"reads\":%lu,\"bytes\":%d,\"mbps\":%.2f,\"usAvg\":%lu,\"usMax\":%lu}}",
+             path + 5, (unsigned long)sdClockHz, sdClockTuned ? "true" : "false", (unsigned long)seqBytes,
+             seqUs ? (float)seqBytes / seqUs : 0.0f, (unsigned long)randReads, SD_BENCH_RANDOM_SIZE,
+             randUs ? (float)randReads * SD_BENCH_RANDOM_SIZE / randUs : 0.0f,
+             (unsigned long)(randReads ? randUs / randReads : 0), (unsigned long)randMaxUs);
+    benchResult = json;
+  }
+  if (f)
+    f.close();
+  heap_caps_free(buf);
+  xSemaphoreGive(benchDone);
+}
+
+static void runDisplayCommand(const DisplayCommand &cmd) {
+  if (cmd.type != CMD_PUPIL && cmd.type != CMD_EYE && cmd.type != CMD_OPEN && cmd.type != CMD_CLOSE &&
+      cmd.type != CMD_BLINK && cmd.type != CMD_ROTATE && cmd.type != CMD_LOAD_PACK && cmd.type != CMD_PLAYLIST &&
+      cmd.type != CMD_OVERLAY && cmd.type != CMD_COLOR && cmd.type != CMD_AUDIO && cmd.type != CMD_SHIFT &&
+      cmd.type != CMD_SD_BENCH && cmd.type != CMD_FX && !isCacheCommand(cmd.type))
+    eyeShown = false;
+  if (cmd.type != CMD_LOAD_PACK && cmd.type != CMD_PLAYLIST && cmd.type != CMD_OVERLAY && cmd.type != CMD_COLOR &&
+      cmd.type != CMD_AUDIO && cmd.type != CMD_SHIFT && cmd.type != CMD_SD_BENCH && cmd.type != CMD_FX &&
+      !isCacheCommand(cmd.type))
+    textOnScreen = false; // whatever it draws replaces the text
+  if (cmd.type != CMD_LOAD_PACK && cmd.type != CMD_PLAYLIST && cmd.type != CMD_OVERLAY && cmd.type != CMD_COLOR &&
+      cmd.type != CMD_AUDIO && cmd.type != CMD_SHIFT && cmd.type != CMD_ROTATE && cmd.type != CMD_SD_BENCH &&
+      cmd.type != CMD_FX && !isCacheCommand(cmd.type)) {
+    effectShown = EFFECT_NONE; // and the effect stops drawing over it
+    if (cmd.type != CMD_LOOK)
+      lookShown = false;
+    if (cmd.type != CMD_ATLAS)
+      atlasShown = false;
+  }
+  switch (cmd.type) {
+    case CMD_PLAY:
+      eyeFrontValid = false; // images are drawn straight to the panel
+      beginTransition();
+      if (!cmd.startAt) // a synced start waits on purpose
+        startFirstPixelClock(cmd.queuedUs);
+      displayImage(cmd.name, cmd.value / 1000.0f, cmd.startAt); // rate is queued in thousandths
+      finishTransition(); // stills and images that failed to open
+      firstPixelFrom = 0; // nothing was drawn if it failed to open
+      playingName[0] = '\0';
+      break;
+    case CMD_OPEN: {
+      EyeState closed = eyeTarget;
+      closed.lid = 100;
+      eyeTarget.lid = 0;
+      eyeBlinking = false;
+      showEye(closed); // a new eye opens from closed
+      break;
+    }
+    case CMD_PUPIL:
+      eyeTarget.gazeX = cmd.x;
+      eyeTarget.gazeY = cmd.y;
+      showEye(eyeTarget);
+      break;
+    case CMD_EYE:
+      applyEyeCommand(cmd);
+      break;
+    case CMD_AUDIO:
+      applyAudioCommand();
+      break;
+    case CMD_BENCH:
+      runBench();
+      break;
+    case CMD_SD_BENCH:
+      runSdBench(cmd.name);
+      break;
+    case CMD_CLOSE: {
+      EyeState open = eyeTarget;
+      open.lid = 0;
+      eyeTarget.lid = 100;
+      eyeBlinking = false;
+      showEye(open);
+      break;
+    }
+    case CMD_BLINK: {
+      // The lids close and reopen on the eye ticks, each step only sends the rows the lids crossed
+      if (!eyeBlinking)
+        eyeBlinkLid = eyeTarget.lid < 100 ? eyeTarget.lid : 0;
+      EyeState open = eyeTarget;
+      open.lid = eyeBlinkLid;
+      showEye(open);
+      eyeTarget.lid = 100;
+      eyeBlinking = true;
+      break;
+    }
+    case CMD_COLORFUL:
+      startEffect(EFFECT_PLASMA);
+      break;
+    case CMD_ROTATE:
+      applyOrientation(cmd.value & 3, cmd.value & 4);
+      eyeFrontValid = false;
+      eyeFullPresent = true; // a shown eye is drawn again in the new orientation
+      eyeDirty = true;
+      lookSentX = -1; // and so is the look window
+      atlasSent = -1;  // and the atlas tile
+      break;
+    case CMD_TRANSCODE:
+      transcodeGif(cmd.name);
+      break;
+    case CMD_LOAD_PACK:
+      installAssetPack();
+      break;
+    case CMD_OVERLAY:
+      applyOverlayCommand(cmd); // shown with the next GIF
+      break;
+    case CMD_COLOR:
+      applyColorCommand(cmd);
+      break;
+    case CMD_SHIFT:
+      applyShiftCommand(cmd);
+      break;
+    case CMD_FX:
+      applyFxCommand(cmd);
+      break;
+    case CMD_LOOK:
+      startLook(cmd);
+      break;
+    case CMD_ATLAS_LOAD:
+    case CMD_ATLAS:
+      showAtlas(cmd);
+      break;
+#ifdef USE_JPEGDEC
+    case CMD_MJPEG:
+      startFirstPixelClock(cmd.queuedUs);
+      playMjpeg();
+      firstPixelFrom = 0;
+      break;
+#endif
+    case CMD_STREAM: // no transition, the stream only sends what changed
+      startFirstPixelClock(cmd.queuedUs);
+      playStream();
+      firstPixelFrom = 0;
+      break;
+    case CMD_PLAYLIST:
+      playlistRunning = cmd.value != 0;
+      xSemaphoreTake(playlistLock, portMAX_DELAY);
+      playlistPos = playlistNext = -1;
+      xSemaphoreGive(playlistLock);
+      playlistWait = 0;
+      if (playlistRunning) {
+        eyeShown = false; // the playlist takes over from the procedural eye
+        effectShown = EFFECT_NONE;
+      }
+      break;
+    default:
+      applyCacheCommand(cmd);
+      break;
+  }
+}
+
+// Display owner, pinned to the core that doesn't run loop(); while the procedural eye moves
+// it is stepped every EYE_TICK_MS between commands
+static void playerTask(void *param) {
+  DisplayCommand cmd;
+  uint32_t nextTick = millis();
+  for (;;) {
+    TickType_t wait = portMAX_DELAY;
+    if (eyeBusy() || effectShown || lookBusy()) {
+      int32_t left = (int32_t)(nextTick - millis());
+      wait = left > 0 ? pdMS_TO_TICKS(left) : 0;
+    }
+    bool playlistDue = playlistRunning && !eyeShown && !effectShown && !lookShown && !atlasShown;
+    if (playlistDue)
+      wait = std::min(wait, playlistWait);
+#ifdef USE_LVGL
+    if (lvglReady && textOnScreen)
+      wait = std::min<TickType_t>(wait, pdMS_TO_TICKS(LVGL_TIMER_MS));
+#endif
+#ifdef USE_PREFETCH
+    // Hinted GIFs are read while nothing is due for a while, one per pass, so a command that arrives
+    // meanwhile waits at most for one of them
+    if (wait >= pdMS_TO_TICKS(PREFETCH_IDLE_MS) && !uxQueueMessagesWaiting(displayQueue) && runPrefetch())
+      continue;
+#endif
+    playerStatic = wait >= pdMS_TO_TICKS(IDLE_AFTER_MS); // lets the idle governor step down
+    BaseType_t received = xQueueReceive(displayQueue, &cmd, wait);
+    playerStatic = false;
+    if (powerIdle)
+      noteActivity(); // e.g. the next playlist item, at full clock
+    if (received == pdTRUE && !appliedBetweenFrames(cmd.type)) {
+      __atomic_sub_fetch(&preemptsQueued, 1, __ATOMIC_RELEASE);
+      uint32_t waited = micros() - cmd.queuedUs;
+      portENTER_CRITICAL(&statsMux);
+      addStatSample(currentStatSlot().hist[STAT_PREEMPT], waited);
+      portEXIT_CRITICAL(&statsMux);
+    }
+    if (received == pdTRUE)
+      runDisplayCommand(cmd);
+    else if (playlistDue)
+      playlistWait = runPlaylistItem() ? 0 : pdMS_TO_TICKS(PLAYLIST_RETRY_MS);
+#ifdef USE_LVGL
+    serviceLvgl();
+#endif
+    if (effectShown && (int32_t)(millis() - nextTick) >= 0) {
+      renderEffect();
+      nextTick += EFFECT_TICK_MS;
+      if ((int32_t)(millis() - nextTick) > EFFECT_TICK_MS)
+        nextTick = millis() + EFFECT_TICK_MS;
+    } else if ((eyeBusy() || lookBusy()) && (int32_t)(millis() - nextTick) >= 0) {
+      if (lookShown)
+        stepLook();
+      else
+        stepEye();
+      nextTick += EYE_TICK_MS;
+      if ((int32_t)(millis() - nextTick) > EYE_TICK_MS)
+        nextTick = millis() + EYE_TICK_MS; // idle or far behind, don't catch up
+    }
+  }
+}
+
+// Hand a command to the player task; false if the queue stayed full
+bool queueDisplayCommandAt(uint8_t type, const char *name, int value, uint32_t startAt) {
+  noteActivity();
+  DisplayCommand cmd;
+  cmd.type = type;
+  cmd.value = value;
+  cmd.startAt = startAt;
+  cmd.x = cmd.y = 0;
+  strncpy(cmd.name, name, sizeof(cmd.name) - 1);
+  cmd.name[sizeof(cmd.name) - 1] = '\0';
+  return sendDisplayCommand(cmd, pdMS_TO_TICKS(100));
+}
+
+bool queueDisplayCommand(uint8_t type, const char *name, int value) {
+  return queueDisplayCommandAt(type, name, value, 0);
+}
+
+void startSync(uint8_t role) {
+  xSemaphoreTakeRecursive(syncLock, portMAX_DELAY);
+  syncUdp.stop();
+  syncRole = role;
+  syncOffset = 0;
+  syncSampleCount = 0;
+  if (syncRole != SYNC_OFF)
+    syncUdp.beginMulticast(syncGroup, SYNC_PORT);
+  xSemaphoreGiveRecursive(syncLock);
+}
+
+static void sendSyncPacket(const char *packet) {
+  xSemaphoreTakeRecursive(syncLock, portMAX_DELAY);
+  syncUdp.beginMulticastPacket();
+  syncUdp.write((const uint8_t *)packet, strlen(packet));
+  syncUdp.endPacket();
+  xSemaphoreGiveRecursive(syncLock);
+}
+
+// Leader only: tell both eyes to start the same animation shortly on the leader clock
+bool startSyncedPlay(const char *path, int rateMilli) {
+  uint32_t startAt = syncMillis() + SYNC_LEAD_TIME;
+  if (startAt == 0)
+    startAt = 1; // 0 means "now"
+  char packet[128];
+  snprintf(packet, sizeof(packet), "P %lu %d %s", (unsigned long)startAt, rateMilli, path);
+  sendSyncPacket(packet);
+  return queueDisplayCommandAt(CMD_PLAY, path, rateMilli, startAt);
+}
+
+// Pupil moves don't wait for room in the queue, a dropped position is replaced by the next one
+static bool queuePupil(int x, int y) {
+  DisplayCommand cmd;
+  cmd.type = CMD_PUPIL;
+  cmd.value = 0;
+  cmd.startAt = 0;
+  cmd.x = constrain(x, -100, 100);
+  cmd.y = constrain(y, -100, 100);
+  cmd.name[0] = '\0';
+  return sendDisplayCommand(cmd, 0);
+}
+
+// Look targets are sent like pupil moves; false also if there is no look canvas
+static bool queueLook(int x, int y) {
+  if (!lookCanvas.created())
+    return false;
+  DisplayCommand cmd;
+  cmd.type = CMD_LOOK;
+  cmd.value = 0;
+  cmd.startAt = 0;
+  cmd.x = constrain(x, -100, 100);
+  cmd.y = constrain(y, -100, 100);
+  cmd.name[0] = '\0';
+  return sendDisplayCommand(cmd, 0);
+}
+
+// Atlas tiles are sent like pupil moves; false also if no sheet is loaded
+static bool queueAtlasTile(int tile, int x, int y) {
+  if (!atlasSheet)
+    return false;
+  DisplayCommand cmd;
+  cmd.type = CMD_ATLAS;
+  cmd.value = tile;
+  cmd.startAt = 0;
+  cmd.x = constrain(x, -100, 100);
+  cmd.y = constrain(y, -100, 100);
+  cmd.name[0] = '\0';
+  return sendDisplayCommand(cmd, 0);
+}
+
+static bool queueAtlasLoad(const char *name, int cols, int rows) {
+  DisplayCommand cmd;
+  cmd.type = CMD_ATLAS_LOAD;
+  cmd.value = 0;
+  cmd.startAt = 0;
+  cmd.x = cols;
+  cmd.y = rows;
+  strncpy(cmd.name, name, sizeof(cmd.name) - 1);
+  cmd.name[sizeof(cmd.name) - 1] = '\0';
+  return sendDisplayCommand(cmd, pdMS_TO_TICKS(100));
+}
+
+static bool queueShift(int dy) {
+  DisplayCommand cmd;
+  cmd.type = CMD_SHIFT;
+  cmd.value = 0;
+  cmd.startAt = 0;
+  cmd.x = 0;
+  cmd.y = dy;
+  cmd.name[0] = '\0';
+  return sendDisplayCommand(cmd, 0);
+}
+
+// Procedural eye targets are sent like pupil moves, without waiting for room in the queue
+static bool queueEye(DisplayCommand &cmd) {
+  cmd.type = CMD_EYE;
+  cmd.startAt = 0;
+  cmd.name[0] = '\0';
+  return sendDisplayCommand(cmd, 0);
+}
+
+// One procedural eye parameter: x, y (-100..100), lid (0 open..100 closed),
+// dilation (10..90 % of the iris) or color (rrggbb); NULL on success or an error message
+static const char *setEyeParam(DisplayCommand &cmd, const char *key, const char *value) {
+  bool color = strcmp(key, "color") == 0;
+  if (color && *value == '#')
+    value++;
+  char *end;
+  long v = strtol(value, &end, color ? 16 : 10);
+  if (end == value || *end)
+    return "invalid value";
+  if (strcmp(key, "x") == 0) {
+    cmd.x = constrain(v, -100, 100);
+    cmd.value |= EYE_SET_X;
+  } else if (strcmp(key, "y") == 0) {
+    cmd.y = constrain(v, -100, 100);
+    cmd.value |= EYE_SET_Y;
+  } else if (strcmp(key, "lid") == 0) {
+    cmd.lid = constrain(v, 0, 100);
+    cmd.value |= EYE_SET_LID;
+  } else if (strcmp(key, "dilation") == 0) {
+    cmd.dilation = constrain(v, 10, 90);
+    cmd.value |= EYE_SET_DILATION;
+  } else if (color) {
+    cmd.color = tft.color565((v >> 16) & 0xFF, (v >> 8) & 0xFF, v & 0xFF);
+    cmd.value |= EYE_SET_COLOR;
+  } else {
+    return "unknown parameter";
+  }
+  return NULL;
+}
+
+// One line of the control channel: "play <name> [rate]", "pupil <x> <y>", "eye <key>=<value>...",
+// "open", "close", "blink", "colorful" or "power <soc> [runtime min]".
+// Returns NULL on success or an error message.
+static const char *handleControlCommand(char *line) {
+  if (strncmp(line, "power ", 6) == 0) { // the host's battery level, taken without waking the idle governor
+    char *p = line + 6;
+    long soc = strtol(p, &p, 10);
+    long runtime = *p ? strtol(p, &p, 10) : -1;
+    return applyPowerLevel(soc, runtime) ? NULL : "invalid level";
+  }
+  noteActivity();
+  if (strncmp(line, "play ", 5) == 0) {
+    char *name = line + 5;
+    char *rate = strchr(name, ' ');
+    int rateMilli = 1000;
+    if (rate) {
+      *rate++ = '\0';
+      rateMilli = (int)(atof(rate) * 1000);
+      if (rateMilli < 100 || rateMilli > 10000)
+        return "invalid rate";
+    }
+    String fullPath = "/gif/" + String(name);
+    if (fullPath.length() >= sizeof(DisplayCommand::name))
+      return "name too long";
+    if (!mediaExists(fullPath.c_str()))
+      return "not found";
+    bool queued = (syncRole == SYNC_LEADER) ? startSyncedPlay(fullPath.c_str(), rateMilli)
+                                           : queueDisplayCommand(CMD_PLAY, fullPath.c_str(), rateMilli);
+    return queued ? NULL : "busy";
+  }
+  if (strncmp(line, "pupil ", 6) == 0) {
+    char *p = line + 6;
+    int x = (int)strtol(p, &p, 10);
+    if (*p == ',')
+      p++;
+    int y = (int)strtol(p, &p, 10);
+    return queuePupil(x, y) ? NULL : "busy";
+  }
+  if (strncmp(line, "look ", 5) == 0) {
+    char *p = line + 5;
+    int x = (int)strtol(p, &p, 10);
+    if (*p == ',')
+      p++;
+    int y = (int)strtol(p, &p, 10);
+    if (!lookCanvas.created())
+      return "no look canvas";
+    return queueLook(x, y) ? NULL : "busy";
+  }
+  if (strncmp(line, "atlas ", 6) == 0) {
+    char *p = line + 6;
+    int x = (int)strtol(p, &p, 10);
+    bool gaze = *p == ',';
+    int y = gaze ? (int)strtol(p + 1, &p, 10) : 0;
+    if (!atlasSheet)
+      return "no atlas";
+    return queueAtlasTile(gaze ? -1 : std::max(x, 0), x, y) ? NULL : "busy";
+  }
+  if (strncmp(line, "eye ", 4) == 0) {
+    DisplayCommand cmd;
+    cmd.value = 0;
+    char *save;
+    for (char *item = strtok_r(line + 4, " ", &save); item; item = strtok_r(NULL, " ", &save)) {
+      char *value = strchr(item, '=');
+      if (!value)
+        return "expected key=value";
+      *value++ = '\0';
+      const char *error = setEyeParam(cmd, item, value);
+      if (error)
+        return error;
+    }
+    return queueEye(cmd) ? NULL : "busy";
+  }
+  if (strncmp(line, "shift ", 6) == 0) { // "shift <rows>", positive moves the picture down
+    long dy = strtol(line + 6, NULL, 10);
+    if (dy < -SHIFT_MAX_ROWS || dy > SHIFT_MAX_ROWS)
+      return "invalid shift";
+    if (tft.getRotation() & 1)
+      return "no vertical scroll in landscape";
+    return queueShift(dy) ? NULL : "busy";
+  }
+  if (strncmp(line, "backlight ", 10) == 0) { // "backlight <percent> [fade ms]", not persisted
+    char *p = line + 10;
+    long level = strtol(p, &p, 10);
+    long ms = strtol(p, &p, 10);
+    if (level < 0 || level > 100 || ms < 0 || ms > BACKLIGHT_MAX_FADE_MS)
+      return "invalid level or fade";
+    backlightLevel = level;
+    fadeBacklight(level, ms);
+    return backlightReady ? NULL : "no backlight control";
+  }
+  static const struct { const char *name; uint8_t type; } simple[] = {
+    { "open", CMD_OPEN }, { "close", CMD_CLOSE }, { "blink", CMD_BLINK }, { "colorful", CMD_COLORFUL }
+  };
+  for (const auto &cmd : simple) {
+    if (strcmp(line, cmd.name) == 0)
+      return queueDisplayCommand(cmd.type, "", 0) ? NULL : "busy";
+  }
+  return "unknown command";
+}
+
+// Keep the largest offset of recent beacons: it is the one with the least network delay
+static void addSyncSample(long sample) {
+  syncSamples[syncSampleIdx] = sample;
+  syncSampleIdx = (syncSampleIdx + 1) % SYNC_SAMPLES;
+  if (syncSampleCount < SYNC_SAMPLES)
+    syncSampleCount++;
+  long best = syncSamples[0];
+  for (int i = 1; i < syncSampleCount; i++)
+    best = std::max(best, syncSamples[i]);
+  syncOffset = best;
+}
+
+static void handleSyncPacket(char *packet) {
+  if (packet[0] == 'B' && syncRole == SYNC_FOLLOWER) {
+    unsigned long leaderMillis = strtoul(packet + 2, NULL, 10);
+    addSyncSample((long)(leaderMillis - millis()));
+  } else if (packet[0] == 'P' && syncRole == SYNC_FOLLOWER) {
+    char *p = packet + 2;
+    uint32_t startAt = strtoul(p, &p, 10);
+    int rateMilli = (int)strtol(p, &p, 10);
+    if (*p == ' ' && rateMilli > 0)
+      queueDisplayCommandAt(CMD_PLAY, p + 1, rateMilli, startAt);
+  } else if (strncmp(packet, "play ", 5) == 0 && syncRole == SYNC_LEADER) {
+    handleControlCommand(packet); // "play <name> [rate]" trigger, e.g. from the eyes node
+  }
+}
+
+void startControl() {
+  controlServer.begin();
+  controlServer.setNoDelay(true);
+  controlUdp.begin(CONTROL_PORT);
+}
+
+// Called from loop(): newline separated commands over kept-open TCP connections
+// (answered with "ok" or "error <reason>") and one command per UDP datagram (no answer)
+void pollControl() {
+  if (controlServer.hasClient()) {
+    WiFiClient client = controlServer.accept();
+    int slot = -1;
+    for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+      if (!controlClients[i] || !controlClients[i].connected())
+        slot = i;
+    }
+    if (slot < 0) {
+      client.stop(); // all slots taken
+    } else {
+      controlClients[slot].stop();
+      controlClients[slot] = client;
+      controlClients[slot].setNoDelay(true);
+      controlLineLength[slot] = 0;
+    }
+  }
+
+  for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+    WiFiClient &client = controlClients[i];
+    while (client && client.available() > 0) {
+      int c = client.read();
+      if (c < 0)
+        break;
+      if (c == '\r')
+        continue;
+      if (c != '\n') {
+        if (controlLineLength[i] < CONTROL_LINE_LENGTH - 1)
+          controlLines[i][controlLineLength[i]++] = c;
+        continue;
+      }
+      controlLines[i][controlLineLength[i]] = '\0';
+      controlLineLength[i] = 0;
+      if (controlLines[i][0] == '\0')
+        continue;
+      const char *error = handleControlCommand(controlLines[i]);
+      if (error) {
+        client.print("error ");
+        client.println(error);
+      } else {
+        client.println("ok");
+      }
+    }
+  }
+
+  while (controlUdp.parsePacket() > 0) {
+    char line[CONTROL_LINE_LENGTH];
+    int len = controlUdp.read(line, sizeof(line) - 1);
+    if (len <= 0)
+      continue;
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+      len--;
+    line[len] = '\0';
+    handleControlCommand(line);
+  }
+}
+
+// /batch: control commands with the ms they run at, counted from the request, run by loop()
+// through handleControlCommand() so a choreography is one round trip with device-side timing
+struct BatchStep {
+  uint32_t at;
+  char line[CONTROL_LINE_LENGTH];
+};
+static BatchStep batchSteps[BATCH_STEPS];
+static SemaphoreHandle_t batchLock = NULL; // guards the batch between the web task and loop()
+static int batchCount = 0;
+static int batchNext = 0;                  // first step not run yet
+static unsigned long batchStart = 0;
+static char batchError[CONTROL_LINE_LENGTH + 32] = ""; // first failed step of the last batch
+
+static bool batchPending() {
+  return batchNext < batchCount;
+}
+
+// Items separated by newlines or ';': a control command, or "wait <ms>" to delay the ones after it.
+// Returns NULL and the steps, or an error message
+static const char *parseBatch(const String &text, BatchStep *steps, int &count) {
+  count = 0;
+  uint32_t at = 0;
+  int pos = 0;
+  while (pos < (int)text.length()) {
+    int end = pos;
+    while (end < (int)text.length() && text[end] != '\n' && text[end] != ';')
+      end++;
+    String item = text.substring(pos, end);
+    pos = end + 1;
+    item.trim();
+    if (!item.length())
+      continue;
+    if (item.startsWith("wait ")) {
+      char *tail;
+      long ms = strtol(item.c_str() + 5, &tail, 10);
+      if (*tail || ms < 0)
+        return "invalid wait";
+      at += ms;
+      if (at > BATCH_MAX_MS)
+        return "batch too long";
+      continue;
+    }
+    if (count == BATCH_STEPS)
+      return "too many commands";
+    if (item.length() >= CONTROL_LINE_LENGTH)
+      return "command too long";
+    steps[count].at = at;
+    strcpy(steps[count].line, item.c_str());
+    count++;
+  }
+  return count ? NULL : "no commands";
+}
+
+// Called from loop(): run the steps that are due
+void pollBatch() {
+  if (!batchPending() || xSemaphoreTake(batchLock, 0) != pdTRUE)
+    return;
+  while (batchPending() && (long)(millis() - batchStart - batchSteps[batchNext].at) >= 0) {
+    BatchStep &step = batchSteps[batchNext++];
+    char line[CONTROL_LINE_LENGTH];
+    strcpy(line, step.line); // the handler cuts it up
+    const char *error = handleControlCommand(line);
+    if (error && !batchError[0])
+      snprintf(batchError, sizeof(batchError), "%s: %s", step.line, error);
+  }
+  xSemaphoreGive(batchLock);
+}
+
+// POST (text/plain body) or GET ?cmds= replaces the running batch, ?stop=1 ends it, a bare GET
+// reports it
+void handleBatch() {
+  String text = server.method() == HTTP_POST ? server.arg("plain") : server.arg("cmds");
+  if (text.length()) {
+    static BatchStep parsed[BATCH_STEPS]; // only the web task parses
+    int count;
+    const char *error = parseBatch(text, parsed, count);
+    if (error) {
+      server.sendTextf(400, "Invalid batch: %s", error);
+      return;
+    }
+    xSemaphoreTake(batchLock, portMAX_DELAY);
+    memcpy(batchSteps, parsed, count * sizeof(BatchStep));
+    batchCount = count;
+    batchNext = 0;
+    batchError[0] = '\0';
+    batchStart = millis();
+    xSemaphoreGive(batchLock);
+  } else if (server.hasArg("stop")) {
+    xSemaphoreTake(batchLock, portMAX_DELAY);
+    batchNext = batchCount;
+    xSemaphoreGive(batchLock);
+  }
+  xSemaphoreTake(batchLock, portMAX_DELAY);
+  String error = batchError;
+  error.replace("\\", "\\\\");
+  error.replace("\"", "\\\"");
+  String json = "{\"steps\":" + String(batchCount) + ",\"done\":" + String(batchNext) +
+                ",\"running\":" + String(batchPending() ? "true" : "false") +
+                ",\"durationMs\":" + String(batchCount ? (unsigned long)batchSteps[batchCount - 1].at : 0UL) +
+                ",\"error\":\"" + error + "\"}";
+  xSemaphoreGive(batchLock);
+  server.send(200, "application/json", json);
+}
+
+#ifdef USE_SERIAL_CONTROL
+// Frames on the USB CDC port, both ways: SERIAL_FRAME_START, sequence number, op (status in
+// replies), payload length, payload, CRC-8 (poly 0x07) of everything after the start byte.
+// Each frame is answered with the same sequence number
+enum SerialControlOp : uint8_t {
+  SERIAL_OP_PING,  // payload is echoed back, for round trip timing
+  SERIAL_OP_LINE,  // payload is a control channel line, e.g. "play idle.gif"
+  SERIAL_OP_PUPIL, // int8 x, int8 y (-100..100)
+  SERIAL_OP_EYE    // EYE_SET_* bits, int8 x, int8 y, lid, dilation, RGB565 color (little-endian)
+};
+enum SerialControlStatus : uint8_t { SERIAL_OK, SERIAL_ERROR, SERIAL_BAD_FRAME };
+
+static uint8_t serialFrame[5 + CONTROL_LINE_LENGTH];
+static int serialFrameLength = 0;
+static unsigned long serialFrameTime = 0;
+
+static uint8_t crc8(const uint8_t *data, size_t len) {
+  uint8_t crc = 0;
+  while (len--) {
+    crc ^= *data++;
+    for (int i = 0; i < 8; i++)
+      crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+  }
+  return crc;
+}
+
+// One write, so log lines from other tasks land before or after the frame, not inside it
+static void sendSerialReply(uint8_t seq, uint8_t status, const void *payload, size_t len) {
+  uint8_t frame[5 + CONTROL_LINE_LENGTH];
+  len = std::min(len, (size_t)CONTROL_LINE_LENGTH);
+  frame[0] = SERIAL_FRAME_START;
+  frame[1] = seq;
+  frame[2] = status;
+  frame[3] = len;
+  if (len)
+    memcpy(frame + 4, payload, len);
+  frame[4 + len] = crc8(frame + 1, 3 + len);
+  Serial.write(frame, 5 + len);
+}
+
+static const char *runSerialFrame(uint8_t op, uint8_t *payload, size_t len) {
+  switch (op) {
+  case SERIAL_OP_LINE: {
+    char line[CONTROL_LINE_LENGTH + 1];
+    memcpy(line, payload, len);
+    line[len] = '\0';
+    return handleControlCommand(line);
+  }
+  case SERIAL_OP_PUPIL:
+    if (len != 2)
+      return "expected x, y";
+    noteActivity();
+    return queuePupil((int8_t)payload[0], (int8_t)payload[1]) ? NULL : "busy";
+  case SERIAL_OP_EYE: {
+    if (len != 7)
+      return "expected bits, x, y, lid, dilation, color";
+    DisplayCommand cmd;
+    cmd.value = payload[0] & (EYE_SET_X | EYE_SET_Y | EYE_SET_LID | EYE_SET_DILATION | EYE_SET_COLOR);
+    cmd.x = constrain((int8_t)payload[1], -100, 100);
+    cmd.y = constrain((int8_t)payload[2], -100, 100);
+    cmd.lid = constrain(payload[3], 0, 100);
+    cmd.dilation = constrain(payload[4], 10, 90);
+    cmd.color = payload[5] | (payload[6] << 8);
+    noteActivity();
+    return queueEye(cmd) ? NULL : "busy";
+  }
+  default:
+    return "unknown op";
+  }
+}
+
+// Called from loop(), also while WiFi is down. Bytes outside a frame are skipped, a bad frame is
+// answered with SERIAL_BAD_FRAME and dropped, so the host can send it again
+void pollSerialControl() {
+  if (serialFrameLength && millis() - serialFrameTime > SERIAL_FRAME_TIMEOUT_MS)
+    serialFrameLength = 0;
+  while (Serial.available() > 0) {
+    int c = Serial.read();
+    if (c < 0)
+      break;
+    if (serialFrameLength == 0 && c != SERIAL_FRAME_START)
+      continue;
+    serialFrameTime = millis();
+    serialFrame[serialFrameLength++] = c;
+    if (serialFrameLength == 4 && serialFrame[3] > CONTROL_LINE_LENGTH) {
+      sendSerialReply(serialFrame[1], SERIAL_BAD_FRAME, "too long", 8);
+      serialFrameLength = 0;
+      continue;
+    }
+    if (serialFrameLength < 5 || serialFrameLength < 5 + serialFrame[3])
+      continue;
+    size_t len = serialFrame[3];
+    serialFrameLength = 0;
+    uint8_t seq = serialFrame[1];
+    if (crc8(serialFrame + 1, 3 + len) != serialFrame[4 + len]) {
+      sendSerialReply(seq, SERIAL_BAD_FRAME, "crc", 3);
+      continue;
+    }
+    if (serialFrame[2] == SERIAL_OP_PING) {
+      sendSerialReply(seq, SERIAL_OK, serialFrame + 4, len);
+      continue;
+    }
+    const char *error = runSerialFrame(serialFrame[2], serialFrame + 4, len);
+    sendSerialReply(seq, error ? SERIAL_ERROR : SERIAL_OK, error, error ? strlen(error) : 0);
+  }
+}
+#endif
+
+// Called from loop(): send beacons as leader and handle incoming sync packets
+void pollSync() {
+  if (syncRole == SYNC_OFF)
+    return;
+  if (syncRole == SYNC_LEADER && millis() - lastBeacon >= SYNC_BEACON_INTERVAL) {
+    lastBeacon = millis();
+    char beacon[24];
+    snprintf(beacon, sizeof(beacon), "B %lu", (unsigned long)millis());
+    sendSyncPacket(beacon);
+  }
+  xSemaphoreTakeRecursive(syncLock, portMAX_DELAY);
+  while (syncUdp.parsePacket() > 0) {
+    char packet[128];
+    int len = syncUdp.read(packet, sizeof(packet) - 1);
+    if (len <= 0)
+      continue;
+    packet[len] = '\0';
+    handleSyncPacket(packet);
+  }
+  xSemaphoreGiveRecursive(syncLock);
+}
+
+// Big-endian RGB565 run-length code: a byte n < 128 is followed by n + 1 literal pixels,
+// a byte 128 + n by one pixel repeated n + 1 times
+static bool streamRleDecode(const uint8_t *src, size_t length, uint16_t *dst, size_t count)
+{
+  const uint8_t *end = src + length;
+  while (count) {
+    if (src >= end)
+      return false;
+    uint8_t c = *src++;
+    size_t n = (c & 0x7F) + 1;
+    size_t bytes = c & 0x80 ? 2 : 2 * n;
+    if (n > count || bytes > (size_t)(end - src))
+      return false;
+    if (c & 0x80) {
+      uint16_t pixel;
+      memcpy(&pixel, src, 2);
+      std::fill(dst, dst + n, pixel);
+    } else {
+      memcpy(dst, src, bytes);
+    }
+    src += bytes;
+    dst += n;
+    count -= n;
+  }
+  return src == end;
+}
+
+// Length of an LZ4 literal or match, continued in bytes while they are 255
+static bool streamLz4Length(const uint8_t *&src, const uint8_t *end, size_t &length)
+{
+  if (length != 15)
+    return true;
+  uint8_t b;
+  do {
+    if (src >= end)
+      return false;
+    b = *src++;
+    length += b;
+  } while (b == 255);
+  return true;
+}
+
+// LZ4 block format, as written by LZ4_compress_default(); the output must come out exactly `size` bytes
+static bool streamLz4Decode(const uint8_t *src, size_t length, uint8_t *dst, size_t size)
+{
+  const uint8_t *end = src + length;
+  uint8_t *out = dst, *outEnd = dst + size;
+  while (src < end) {
+    uint8_t token = *src++;
+    size_t literals = token >> 4;
+    if (!streamLz4Length(src, end, literals) || literals > (size_t)(end - src) ||
+        literals > (size_t)(outEnd - out))
+      return false;
+    memcpy(out, src, literals);
+    out += literals;
+    src += literals;
+    if (src == end)
+      break; // the last sequence has no match
+    if (end - src < 2)
+      return false;
+    size_t offset = src[0] | src[1] << 8;
+    src += 2;
+    size_t match = token & 15;
+    if (!offset || offset > (size_t)(out - dst) || !streamLz4Length(src, end, match))
+      return false;
+    match += 4;
+    if (match > (size_t)(outEnd - out))
+      return false;
+    for (const uint8_t *from = out - offset; match--;) // may overlap what it writes
+      *out++ = *from++;
+  }
+  return out == outEnd;
+}
+
+// Decode one datagram and send its rectangle
+static void drawStreamPacket(const StreamPacket *packet, bool &seqValid, uint16_t &seq)
+{
+  StreamHeader header;
+  if (packet->length < (int)sizeof(header)) {
+    streamStats.invalid++;
+    return;
+  }
+  memcpy(&header, packet->data, sizeof(header));
+  if (header.magic[0] != 'E' || header.magic[1] != 'S') {
+    streamStats.invalid++;
+    return;
+  }
+  int16_t gap = header.seq - seq;
+  if (seqValid && gap <= 0) {
+    streamStats.late++; // reordered or repeated, its pixels are older than what is shown
+    return;
+  }
+  if (seqValid)
+    streamStats.lost += gap - 1;
+  seqValid = true;
+  seq = header.seq;
+  streamStats.packets++;
+
+  const uint8_t *payload = packet->data + sizeof(header);
+  size_t length = packet->length - sizeof(header);
+  size_t pixels = (size_t)header.w * header.h;
+  if (pixels) {
+    if (header.x + header.w > DISPLAY_WIDTH || header.y + header.h > DISPLAY_WIDTH ||
+        pixels > STREAM_RECT_PIXELS) {
+      streamStats.invalid++;
+      return;
+    }
+#ifdef USE_DMA
+    uint16_t *dst = freeStrip();
+#else
+    static uint16_t dst[STREAM_RECT_PIXELS];
+#endif
+    uint32_t t0 = micros();
+    bool decoded = false;
+    if (header.codec == STREAM_RAW && length == pixels * 2) {
+      memcpy(dst, payload, length);
+      decoded = true;
+    } else if (header.codec == STREAM_RLE) {
+      decoded = streamRleDecode(payload, length, dst, pixels);
+    } else if (header.codec == STREAM_LZ4) {
+      decoded = streamLz4Decode(payload, length, (uint8_t *)dst, pixels * 2);
+    }
+    addStageTime(STAT_DECODE, t0);
+    if (!decoded) {
+      streamStats.invalid++;
+      return;
+    }
+#ifdef USE_DMA
+    pushCookedStrip(header.x, header.y, header.w, header.h, header.w, 0);
+#else
+    TFTDraw(header.x, header.y, header.w, header.h, dst);
+#endif
+  }
+  if (header.flags & STREAM_FRAME_END) {
+    streamStats.frames++;
+    if (header.flags & STREAM_KEYFRAME)
+      streamStats.keyframes++;
+  }
+}
+
+// Player task: draw stream datagrams as they come, until the stream goes quiet or a command
+// takes the screen; that command's owner keeps it until the host pauses for STREAM_IDLE_MS
+static void playStream()
+{
+  eyeFrontValid = false;
+  playbackMode = "stream";
+  xOffset = yOffset = 0;
+  overlayGif = false;
+  bool seqValid = false;
+  uint16_t seq = 0;
+  uint32_t lastPacket = millis();
+  StreamPacket *packet;
+  for (;;) {
+    if (playbackPreempted()) {
+      streamMutedUntil = millis() + STREAM_IDLE_MS;
+      break;
+    }
+    if (xQueueReceive(streamReady, &packet, pdMS_TO_TICKS(10)) != pdTRUE) {
+      flushStrip();
+      if (millis() - lastPacket >= STREAM_IDLE_MS)
+        break;
+      continue;
+    }
+    lastPacket = millis();
+    drawStreamPacket(packet, seqValid, seq);
+    xQueueSend(streamFree, &packet, 0);
+  }
+  flushStrip();
+  streamActive = false;
+}
+
+void startStream() {
+  streamFree = xQueueCreate(STREAM_PACKETS, sizeof(StreamPacket *));
+  streamReady = xQueueCreate(STREAM_PACKETS, sizeof(StreamPacket *));
+  size_t bytes = STREAM_PACKETS * sizeof(StreamPacket);
+  streamPool = (StreamPacket *)(psramFound() ? ps_malloc(bytes) : malloc(bytes));
+  if (!streamPool) {
+    Serial.println("No memory for the stream buffers");
+    return;
+  }
+  for (int i = 0; i < STREAM_PACKETS; i++) {
+    StreamPacket *packet = &streamPool[i];
+    xQueueSend(streamFree, &packet, 0);
+  }
+  streamUdp.begin(STREAM_PORT);
+}
+
+// Called from loop(): queue stream datagrams for the player, newest kept, and start
+// playStream() when the stream begins
+void pollStream() {
+  if (!streamPool)
+    return;
+  while (streamUdp.parsePacket() > 0) {
+    if ((int32_t)(streamMutedUntil - millis()) > 0) {
+      streamMutedUntil = millis() + STREAM_IDLE_MS; // still sending, keep ignoring it
+      streamStats.ignored++;
+      streamUdp.flush();
+      continue;
+    }
+    StreamPacket *packet;
+    if (xQueueReceive(streamFree, &packet, 0) != pdTRUE) {
+      if (xQueueReceive(streamReady, &packet, 0) != pdTRUE) {
+        streamUdp.flush();
+        continue;
+      }
+      streamStats.overrun++; // the oldest goes, so the latency stays bounded
+    }
+    packet->length = streamUdp.read(packet->data, sizeof(packet->data));
+    xQueueSend(streamReady, &packet, 0);
+    if (!streamActive) {
+      streamActive = true;
+      if (!queueDisplayCommand(CMD_STREAM, "", 0))
+        streamActive = false; // the next datagram tries again
+    }
+  }
+}
+
+// Called from loop(): keep the latest envelope sample and wake the player if the eye is idle
+void pollAudio() {
+  while (audioUdp.parsePacket() > 0) {
+    uint8_t samples[64];
+    int len = audioUdp.read(samples, sizeof(samples));
+    if (len <= 0)
+      continue;
+    audioLevel = samples[len - 1];
+    audioAt = millis() | 1;
+    if (audioMode != AUDIO_OFF && eyeShown && !audioWake) {
+      audioWake = true;
+      if (!queueDisplayCommand(CMD_AUDIO, "", 0))
+        audioWake = false;
+    }
+  }
+}
+
+// Screen preview (/screen): the shown frame as a 16-bit BMP, read from the TFT_eSPI shadow
+// buffer, or from the eye front copy while the panel shows it. No SPI reads. A stream
+// (/screen?stream=1) is a multipart/x-mixed-replace of BMPs that browsers play like MJPEG; the web
+// task sends it SCREEN_STREAM_ROWS at a time, so other requests keep being served
+#define SCREEN_STREAM_FPS 2       // default frame rate of a stream, ?fps= up to SCREEN_STREAM_MAX_FPS
+#define SCREEN_STREAM_MAX_FPS 10
+#define SCREEN_STREAM_ROWS 16     // rows per webTask() pass, 7.5 KB at 240 wide
+#define SCREEN_BMP_HEADER 66      // file and info header plus the three RGB565 masks
+
+static WiFiClient screenClient;   // the one stream being served
+static uint32_t screenInterval;   // ms between stream frames
+static uint32_t screenNextFrame;  // millis() of the next frame
+static int screenRow = -1;        // next row of the frame being sent, -1 between frames
+static uint16_t screenRows[DISPLAY_WIDTH * SCREEN_STREAM_ROWS];
+
+// Where the shown frame is, false if neither copy holds it; swapped means big-endian pixels
+static bool screenSource(const uint16_t **pixels, bool *swapped) {
+  if (const uint16_t *shadow = tft.getShadowBuffer()) {
+    *pixels = shadow;
+    *swapped = false;
+    return true;
+  }
+  if (eyeFront && eyeFrontValid) { // what presentRegion() last sent, in panel byte order
+    *pixels = eyeFront;
+    *swapped = true;
+    return true;
+  }
+  return false;
+}
+
+static uint32_t screenBmpSize() {
+  return SCREEN_BMP_HEADER + tft.width() * tft.height() * 2;
+}
+
+// Top-down RGB565 BMP header (BI_BITFIELDS) for the display size
+static void screenBmpHeader(uint8_t *h) {
+  auto put16 = [&](int at, uint16_t v) { h[at] = v; h[at + 1] = v >> 8; };
+  auto put32 = [&](int at, uint32_t v) { put16(at, v); put16(at + 2, v >> 16); };
+  memset(h, 0, SCREEN_BMP_HEADER);
+  h[0] = 'B';
+  h[1] = 'M';
+  put32(2, screenBmpSize());
+  put32(10, SCREEN_BMP_HEADER);   // pixel data offset
+  put32(14, 40);                  // BITMAPINFOHEADER
+  put32(18, tft.width());
+  put32(22, (uint32_t)-tft.height()); // negative: rows top to bottom
+  put16(26, 1);                   // planes
+  put16(28, 16);                  // bits per pixel
+  put32(30, 3);                   // BI_BITFIELDS
+  put32(34, tft.width() * tft.height() * 2);
+  put32(54, 0xF800);              // red, green and blue masks
+  put32(58, 0x07E0);
+  put32(62, 0x001F);
+}
+
+// Copy rows of the frame into screenRows as little-endian RGB565; false if the source went away
+static bool screenCopyRows(int y, int rows) {
+  const uint16_t *pixels;
+  bool swapped;
+  if (!screenSource(&pixels, &swapped))
+    return false;
+  int n = tft.width() * rows;
+  const uint16_t *src = pixels + y * tft.width();
+  if (swapped) {
+    for (int i = 0; i < n; i++)
+      screenRows[i] = src[i] << 8 | src[i] >> 8;
+  } else {
+    memcpy(screenRows, src, n * sizeof(uint16_t));
+  }
+  return true;
+}
+
+// Send the next rows of the stream, or start its next frame when due
+static void serviceScreenStream() {
+  if (!screenClient)
+    return;
+  if (!screenClient.connected()) {
+    screenClient.stop();
+    screenRow = -1;
+    return;
+  }
+  if (screenRow < 0) {
+    if ((int32_t)(millis() - screenNextFrame) < 0)
+      return;
+    screenNextFrame = millis() + screenInterval;
+    const uint16_t *pixels;
+    bool swapped;
+    if (!screenSource(&pixels, &swapped))
+      return; // nothing to show right now, try at the next frame
+    uint8_t header[SCREEN_BMP_HEADER];
+    screenBmpHeader(header);
+    screenClient.printf("--frame\r\nContent-Type: image/bmp\r\nContent-Length: %lu\r\n\r\n", (unsigned long)screenBmpSize());
+    screenClient.write(header, sizeof(header));
+    screenRow = 0;
+  }
+  int rows = std::min(SCREEN_STREAM_ROWS, (int)tft.height() - screenRow);
+  if (!screenCopyRows(screenRow, rows))
+    memset(screenRows, 0, tft.width() * rows * sizeof(uint16_t)); // the part must still be complete
+  size_t bytes = tft.width() * rows * sizeof(uint16_t);
+  if (screenClient.write((const uint8_t *)screenRows, bytes) != bytes) {
+    screenClient.stop();
+    screenRow = -1;
+    return;
+  }
+  screenRow += rows;
+  if (screenRow == tft.height()) {
+    screenClient.print("\r\n");
+    screenRow = -1;
+  }
+}
+
+// GET /screen: one BMP of the shown frame; ?stream=1 hands the connection to serviceScreenStream()
+static void handleScreen() {
+  const uint16_t *pixels;
+  bool swapped;
+  if (!screenSource(&pixels, &swapped)) {
+    server.send(503, "text/plain", "No screen copy: the shadow buffer needs PSRAM, or the panel shows a direct draw");
+    return;
+  }
+  if (server.hasArg("stream")) {
+    int fps = server.hasArg("fps") ? server.arg("fps").toInt() : SCREEN_STREAM_FPS;
+    fps = std::max(1, std::min(fps, SCREEN_STREAM_MAX_FPS));
+    if (screenClient)
+      screenClient.stop(); // one stream at a time, the newest wins
+    screenClient = server.client();
+    screenClient.print("HTTP/1.1 200 OK\r\nContent-Type: multipart/x-mixed-replace; boundary=frame\r\n"
+                       "Cache-Control: no-cache\r\nConnection: close\r\n\r\n");
+    screenInterval = 1000 / fps;
+    screenNextFrame = millis();
+    screenRow = -1;
+    return;
+  }
+  uint8_t header[SCREEN_BMP_HEADER];
+  screenBmpHeader(header);
+  server.sendHeader("Cache-Control", "no-cache");
+  server.setContentLength(screenBmpSize());
+  server.send(200, "image/bmp", "");
+  server.sendContent((const char *)header, sizeof(header));
+  for (int y = 0; y < tft.height(); y += SCREEN_STREAM_ROWS) {
+    int rows = std::min(SCREEN_STREAM_ROWS, (int)tft.height() - y);
+    if (!screenCopyRows(y, rows))
+      memset(screenRows, 0, tft.width() * rows * sizeof(uint16_t));
+    server.sendContent((const char *)screenRows, tft.width() * rows * sizeof(uint16_t));
+  }
+}
+
+#define CHUNK_BUFFER_SIZE 1024 // staging buffer for chunked responses
+
+// Streams a response with chunked transfer from a fixed buffer, so page size doesn't change peak heap use
+class ChunkedResponse {
+public:
+  ChunkedResponse(int code, const char *contentType) : length(0) {
+    server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    server.send(code, contentType, "");
+  }
+
+  void add(const char *text, size_t n) {
+    while (n > 0) {
+      size_t part = std::min(n, sizeof(buffer) - length);
+      memcpy(buffer + length, text, part);
+      length += part;
+      text += part;
+      n -= part;
+      if (length == sizeof(buffer))
+        flush();
+    }
+  }
+  void add(const char *text) { add(text, strlen(text)); }
+  void add(const std::string &text) { add(text.c_str(), text.size()); }
+
+  void addf(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+    char text[160];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (n > 0)
+      add(text, std::min((size_t)n, sizeof(text) - 1));
+  }
+
+  // Send what is left and the terminating empty chunk
+  void end() {
+    flush();
+    server.sendContent("");
+  }
+
+private:
+  void flush() {
+    if (length) {
+      server.sendContent(buffer, length);
+      length = 0;
+    }
+  }
+
+  char buffer[CHUNK_BUFFER_SIZE];
+  size_t length;
+};
+
+// "heap" of /stats: per capability now and low-water marks since boot or ?reset, then the routes
+static void sendHeapStats(ChunkedResponse &response) {
+  sampleHeap();
+  multi_heap_info_t info;
+  heap_caps_get_info(&info, MALLOC_CAP_8BIT);
+  response.addf(",\"heap\":{\"blocks\":%u,\"allocFailures\":%lu,\"lastFailedSize\":%lu,\"lastFailedCaps\":%lu",
+                (unsigned)info.allocated_blocks, (unsigned long)allocFailures, (unsigned long)allocFailedSize,
+                (unsigned long)allocFailedCaps);
+  for (int k = 0; k < HEAP_KINDS; k++) {
+    if (!heap_caps_get_total_size(heapKindCaps[k]))
+      continue; // no PSRAM
+    uint32_t free = heap_caps_get_free_size(heapKindCaps[k]), largest = heap_caps_get_largest_free_block(heapKindCaps[k]);
+    response.addf(",\"%s\":{\"free\":%lu,\"largest\":%lu,\"fragPct\":%u,\"minFree\":%lu,\"minLargest\":%lu,"
+                  "\"minFreeEver\":%lu}", heapKindNames[k], (unsigned long)free, (unsigned long)largest,
+                  free ? (unsigned)(100 - (uint64_t)largest * 100 / free) : 0, (unsigned long)heapMinFree[k],
+                  (unsigned long)heapMinLargest[k], (unsigned long)heap_caps_get_minimum_free_size(heapKindCaps[k]));
+  }
+  response.add(",\"arenas\":[");
+  for (int i = 0; i < ARENA_COUNT; i++) {
+    const MemoryArena &a = memoryPlan[i];
+    response.addf("%s{\"name\":\"%s\",\"bytes\":%lu,\"reserved\":%s,\"used\":%lu,\"highWater\":%lu,\"misses\":%lu}",
+                  i ? "," : "", a.name, (unsigned long)a.size, a.base ? "true" : "false", (unsigned long)a.used,
+                  (unsigned long)a.highWater, (unsigned long)a.misses);
+  }
+  response.add("]");
+#ifdef USE_SPRITE_POOL
+  response.addf(",\"spritePool\":{\"misses\":%lu,\"classes\":[", (unsigned long)spritePool.misses());
+  for (uint8_t c = 0; c < spritePool.classes(); c++)
+    response.addf("%s{\"bytes\":%lu,\"free\":%u}", c ? "," : "", (unsigned long)spritePool.blockBytes(c),
+                  spritePool.available(c));
+  response.add("]}");
+#endif
+  response.add(",\"routes\":[");
+  for (int i = 0; i < heapRouteCount; i++) {
+    const HeapRoute &r = heapRoutes[i];
+    response.addf("%s{\"path\":\"%s\",\"requests\":%lu,\"grew\":%lu,\"netBlocks\":%ld,\"netBytes\":%ld}",
+                  i ? "," : "", r.path, (unsigned long)r.requests, (unsigned long)r.grew, (long)r.netBlocks,
+                  (long)r.netBytes);
+  }
+  response.add("]}");
+}
+
+// Rolling frame statistics of the last STATS_SLOTS * STATS_SLOT_MS ms as JSON
+// Sum the slots of the last STATS_SLOTS * STATS_SLOT_MS into `sum`; returns the ms they cover
+static uint32_t sumStatSlots(StatSlot &sum) {
+  static StatSlot slots[STATS_SLOTS]; // copy, so the player is only held up for a memcpy
+  portENTER_CRITICAL(&statsMux);
+  currentStatSlot(); // retire slots that have run out
+  memcpy(slots, statSlots, sizeof(slots));
+  portEXIT_CRITICAL(&statsMux);
+
+  memset(&sum, 0, sizeof(sum));
+  uint32_t now = millis(), oldest = now;
+  for (const StatSlot &slot : slots) {
+    if (slot.startedAt == 0 || now - slot.startedAt >= STATS_SLOTS * STATS_SLOT_MS)
+      continue;
+    oldest = std::min(oldest, slot.startedAt);
+    for (int m = 0; m < STAT_METRICS; m++) {
+      StatHistogram &h = sum.hist[m];
+      h.count += slot.hist[m].count;
+      h.totalUs += slot.hist[m].totalUs;
+      h.maxUs = std::max(h.maxUs, slot.hist[m].maxUs);
+      for (int b = 0; b < STATS_BUCKETS; b++)
+        h.buckets[b] += slot.hist[m].buckets[b];
+    }
+    sum.sdBytes += slot.sdBytes;
+    sum.frames += slot.frames;
+    sum.late += slot.late;
+    sum.dropped += slot.dropped;
+    sum.targetMs += slot.targetMs;
+    sum.shownMs += slot.shownMs;
+  }
+  return now - oldest;
+}
+
+void sendStats() {
+  StatSlot sum;
+  uint32_t windowMs = sumStatSlots(sum);
+  ChunkedResponse response(200, "application/json");
+  response.addf("{\"windowMs\":%lu,\"mode\":\"%s\",\"playing\":\"%s\"", (unsigned long)windowMs,
+                playbackMode, playingName);
+  response.addf(",\"frames\":%lu,\"late\":%lu,\"dropped\":%lu", (unsigned long)sum.frames,
+                (unsigned long)sum.late, (unsigned long)sum.dropped);
+  response.addf(",\"fps\":%.1f,\"targetFps\":%.1f", sum.shownMs ? sum.frames * 1000.0f / sum.shownMs : 0.0f,
+                sum.targetMs > 0 ? sum.frames * 1000.0f / sum.targetMs : 0.0f);
+  response.addf(",\"sdBytes\":%lu,\"bucketLimitsUs\":[", (unsigned long)sum.sdBytes);
+  for (int b = 0; b < STATS_BUCKETS - 1; b++)
+    response.addf(b ? ",%lu" : "%lu", 16UL << b);
+  response.add("]");
+  for (int m = 0; m < STAT_METRICS; m++) {
+    const StatHistogram &h = sum.hist[m];
+    response.addf(",\"%s\":{\"count\":%lu,\"avgUs\":%lu,\"maxUs\":%lu,\"buckets\":[", statNames[m],
+                  (unsigned long)h.count, (unsigned long)(h.count ? h.totalUs / h.count : 0), (unsigned long)h.maxUs);
+    for (int b = 0; b < STATS_BUCKETS; b++)
+      response.addf(b ? ",%lu" : "%lu", (unsigned long)h.buckets[b]);
+    response.add("]}");
+  }
+  if (heapMonitorOn)
+    sendHeapStats(response);
+  response.add("}");
+  response.end();
+}
+
+// Soak test (/soak): the eye drives itself for hours with random commands (plays of random catalog
+// entries, blinks, gaze moves) and keeps a rolling summary of how playback holds up: fps and frame
+// time percentiles, SD read time percentiles, heap low-water marks and WiFi drops. What degrades
+// over days (fragmentation, a slowing card, reconnect stalls) shows up as a trend across periods
+#define SOAK_SAMPLE_MS (STATS_SLOTS * STATS_SLOT_MS) // fps and heap are sampled once per /stats window
+#define SOAK_PERIOD_MS (10 * 60 * 1000UL)            // one summary row per 10 minutes
+#define SOAK_PERIODS 48                              // rows kept, so the last 8 hours
+#define SOAK_SAMPLES (int)(SOAK_PERIOD_MS / SOAK_SAMPLE_MS)
+#define SOAK_FPS_BUCKETS 64                          // whole-run fps histogram, 1 fps wide
+#define SOAK_STEP_MIN_MS 2000                        // random gap between two commands
+#define SOAK_STEP_MAX_MS 15000
+
+struct SoakPeriod {
+  uint32_t startS;                    // seconds into the run
+  uint32_t commands, busy;            // commands sent, and those the queue had no room for
+  uint32_t frames, late, dropped;
+  uint16_t fpsP5, fpsP50;             // tenths of a frame per second, over SOAK_SAMPLE_MS windows
+  uint32_t frameP50Us, frameP99Us, frameMaxUs;
+  uint32_t sdP50Us, sdP99Us, sdMaxUs; // SD read time per frame
+  uint32_t internalMin, internalLargestMin, psramMin, psramLargestMin;
+  uint32_t wifiDrops;
+};
+
+static uint32_t wifiDrops = 0;        // connections lost since boot, counted by pollWifi()
+static bool soakRunning = false;
+static uint32_t soakStarted = 0, soakEndsAt = 0; // millis(); soakEndsAt 0 runs until stopped
+static uint32_t soakNextStep = 0, soakNextSample = 0, soakPeriodStart = 0;
+static SoakPeriod soakPeriods[SOAK_PERIODS]; // ring of finished periods
+static int soakPeriodCount = 0;
+static SoakPeriod soakNow;            // the period filling up
+static SoakPeriod soakDone;           // counts and low-water marks of all finished periods
+static StatHistogram soakFrame, soakSdRead, soakRunFrame, soakRunSdRead; // of the period and the run
+static uint16_t soakFps[SOAK_SAMPLES];
+static int soakFpsCount = 0;
+static uint32_t soakRunFps[SOAK_FPS_BUCKETS];
+static uint32_t soakStartWifiDrops = 0, soakPeriodWifiDrops = 0; // wifiDrops when the run and period started
+
+// Upper limit of the bucket holding the pct-th percentile; the buckets double, so it reads up to 2x high
+static uint32_t statPercentileUs(const StatHistogram &h, int pct) {
+  if (!h.count)
+    return 0;
+  uint32_t rank = (uint32_t)(((uint64_t)h.count * pct + 99) / 100), seen = 0;
+  for (int b = 0; b < STATS_BUCKETS - 1; b++) {
+    seen += h.buckets[b];
+    if (seen >= rank)
+      return std::min<uint32_t>(16UL << b, h.maxUs);
+  }
+  return h.maxUs;
+}
+
+static void mergeStatHistogram(StatHistogram &into, const StatHistogram &h) {
+  into.count += h.count;
+  into.totalUs += h.totalUs;
+  into.maxUs = std::max(into.maxUs, h.maxUs);
+  for (int b = 0; b < STATS_BUCKETS; b++)
+    into.buckets[b] += h.buckets[b];
+}
+
+static void clearSoakPeriod(SoakPeriod &p) {
+  memset(&p, 0, sizeof(p));
+  p.internalMin = p.internalLargestMin = p.psramMin = p.psramLargestMin = UINT32_MAX;
+}
+
+// Add a period's counts and low-water marks to `into`
+static void foldSoakPeriod(SoakPeriod &into, const SoakPeriod &p) {
+  into.commands += p.commands;
+  into.busy += p.busy;
+  into.late += p.late;
+  into.dropped += p.dropped;
+  into.internalMin = std::min(into.internalMin, p.internalMin);
+  into.internalLargestMin = std::min(into.internalLargestMin, p.internalLargestMin);
+  into.psramMin = std::min(into.psramMin, p.psramMin);
+  into.psramLargestMin = std::min(into.psramLargestMin, p.psramLargestMin);
+}
+
+static void startSoakPeriod(uint32_t now) {
+  clearSoakPeriod(soakNow);
+  soakNow.startS = (now - soakStarted) / 1000;
+  soakPeriodStart = now;
+  memset(&soakFrame, 0, sizeof(soakFrame));
+  memset(&soakSdRead, 0, sizeof(soakSdRead));
+  soakFpsCount = 0;
+  soakPeriodWifiDrops = wifiDrops;
+}
+
+static void startSoak(uint32_t hours) {
+  uint32_t now = millis();
+  portENTER_CRITICAL(&statsMux);
+  memset(&soakCounters, 0, sizeof(soakCounters));
+  soakRecording = true;
+  portEXIT_CRITICAL(&statsMux);
+  soakStarted = now;
+  soakEndsAt = hours ? now + hours * 3600000UL : 0;
+  soakNextStep = now;
+  soakNextSample = now + SOAK_SAMPLE_MS;
+  soakPeriodCount = 0;
+  clearSoakPeriod(soakDone);
+  soakStartWifiDrops = wifiDrops;
+  memset(&soakRunFrame, 0, sizeof(soakRunFrame));
+  memset(&soakRunSdRead, 0, sizeof(soakRunSdRead));
+  memset(soakRunFps, 0, sizeof(soakRunFps));
+  startSoakPeriod(now);
+  soakRunning = true;
+  Serial.printf("Soak test started for %lu h (0: until stopped)\n", (unsigned long)hours);
+}
+
+// Fold in the frames the player counted since the last call
+static void takeSoakCounters() {
+  SoakCounters taken;
+  portENTER_CRITICAL(&statsMux);
+  taken = soakCounters;
+  memset(&soakCounters, 0, sizeof(soakCounters));
+  portEXIT_CRITICAL(&statsMux);
+  soakNow.late += taken.late;
+  soakNow.dropped += taken.dropped;
+  mergeStatHistogram(soakFrame, taken.frame);
+  mergeStatHistogram(soakSdRead, taken.sdRead);
+  mergeStatHistogram(soakRunFrame, taken.frame);
+  mergeStatHistogram(soakRunSdRead, taken.sdRead);
+  soakNow.frames = soakFrame.count;
+  soakNow.frameP50Us = statPercentileUs(soakFrame, 50);
+  soakNow.frameP99Us = statPercentileUs(soakFrame, 99);
+  soakNow.frameMaxUs = soakFrame.maxUs;
+  soakNow.sdP50Us = statPercentileUs(soakSdRead, 50);
+  soakNow.sdP99Us = statPercentileUs(soakSdRead, 99);
+  soakNow.sdMaxUs = soakSdRead.maxUs;
+}
+
+static uint16_t sortedPercentile(uint16_t *values, int count, int pct) {
+  if (!count)
+    return 0;
+  std::sort(values, values + count);
+  return values[(count - 1) * pct / 100];
+}
+
+// One fps and heap sample per /stats window; windows where nothing played (the eye) give no fps
+static void sampleSoak() {
+  takeSoakCounters();
+  StatSlot sum;
+  sumStatSlots(sum);
+  if (sum.frames && sum.shownMs) {
+    uint32_t fps10 = (uint32_t)((uint64_t)sum.frames * 10000 / sum.shownMs);
+    if (soakFpsCount < SOAK_SAMPLES)
+      soakFps[soakFpsCount++] = fps10;
+    soakRunFps[std::min<uint32_t>(fps10 / 10, SOAK_FPS_BUCKETS - 1)]++;
+    uint16_t sorted[SOAK_SAMPLES];
+    memcpy(sorted, soakFps, soakFpsCount * sizeof(sorted[0]));
+    soakNow.fpsP5 = sortedPercentile(sorted, soakFpsCount, 5);
+    soakNow.fpsP50 = sortedPercentile(sorted, soakFpsCount, 50);
+  }
+  soakNow.internalMin = std::min<uint32_t>(soakNow.internalMin, heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+  soakNow.internalLargestMin =
+      std::min<uint32_t>(soakNow.internalLargestMin, heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+  if (psramFound()) {
+    soakNow.psramMin = std::min<uint32_t>(soakNow.psramMin, heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+    soakNow.psramLargestMin =
+        std::min<uint32_t>(soakNow.psramLargestMin, heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM));
+  }
+  soakNow.wifiDrops = wifiDrops - soakPeriodWifiDrops;
+}
+
+// A random command, like a host would send: mostly plays, some blinks and gaze moves
+static void soakStep() {
+  int pick = esp_random() % 100;
+  bool sent = false;
+  if (pick < 70 && !catalog.empty()) {
+    const MediaEntry &entry = catalog[esp_random() % catalog.size()];
+    char path[sizeof(DisplayCommand::name)];
+    if (!strstr(entry.name(), "_preview.") &&
+        (size_t)snprintf(path, sizeof(path), "/gif/%s", entry.name()) < sizeof(path))
+      sent = queueDisplayCommand(CMD_PLAY, path, 1000);
+    else
+      return; // not playable, the next step picks again
+  } else if (pick < 85) {
+    sent = queueDisplayCommand(CMD_BLINK, "", 0);
+  } else {
+    DisplayCommand cmd;
+    cmd.value = EYE_SET_X | EYE_SET_Y;
+    cmd.x = (int)(esp_random() % 201) - 100;
+    cmd.y = (int)(esp_random() % 201) - 100;
+    sent = queueEye(cmd);
+  }
+  soakNow.commands++;
+  soakNow.busy += !sent;
+}
+
+static void stopSoak() {
+  if (!soakRunning)
+    return;
+  portENTER_CRITICAL(&statsMux);
+  soakRecording = false;
+  portEXIT_CRITICAL(&statsMux);
+  takeSoakCounters();
+  soakRunning = false;
+  Serial.println("Soak test stopped");
+}
+
+// Called from the web task, whether or not the network is up
+static void serviceSoak() {
+  if (!soakRunning)
+    return;
+  uint32_t now = millis();
+  if ((int32_t)(now - soakNextStep) >= 0) {
+    soakStep();
+    soakNextStep = now + SOAK_STEP_MIN_MS + esp_random() % (SOAK_STEP_MAX_MS - SOAK_STEP_MIN_MS);
+  }
+  if ((int32_t)(now - soakNextSample) < 0)
+    return;
+  soakNextSample += SOAK_SAMPLE_MS;
+  sampleSoak();
+  if (now - soakPeriodStart >= SOAK_PERIOD_MS) {
+    foldSoakPeriod(soakDone, soakNow);
+    soakPeriods[soakPeriodCount++ % SOAK_PERIODS] = soakNow;
+    startSoakPeriod(now);
+  }
+  if (soakEndsAt && (int32_t)(now - soakEndsAt) >= 0)
+    stopSoak();
+}
+
+static void addSoakPeriod(ChunkedResponse &response, const SoakPeriod &p) {
+  response.addf("{\"startS\":%lu,\"commands\":%lu,\"busy\":%lu,\"frames\":%lu,\"late\":%lu,\"dropped\":%lu,"
+                "\"fpsP5\":%.1f,\"fpsP50\":%.1f,\"frameP50Us\":%lu,\"frameP99Us\":%lu,\"frameMaxUs\":%lu,"
+                "\"sdReadP50Us\":%lu,\"sdReadP99Us\":%lu,\"sdReadMaxUs\":%lu,",
+                (unsigned long)p.startS, (unsigned long)p.commands, (unsigned long)p.busy, (unsigned long)p.frames,
+                (unsigned long)p.late, (unsigned long)p.dropped, p.fpsP5 / 10.0f, p.fpsP50 / 10.0f,
+                (unsigned long)p.frameP50Us, (unsigned long)p.frameP99Us, (unsigned long)p.frameMaxUs,
+                (unsigned long)p.sdP50Us, (unsigned long)p.sdP99Us, (unsigned long)p.sdMaxUs);
+  response.addf("\"internalMin\":%lu,\"internalLargestMin\":%lu,\"psramMin\":%lu,\"psramLargestMin\":%lu,"
+                "\"wifiDrops\":%lu}",
+                (unsigned long)(p.internalMin == UINT32_MAX ? 0 : p.internalMin),
+                (unsigned long)(p.internalLargestMin == UINT32_MAX ? 0 : p.internalLargestMin),
+                (unsigned long)(p.psramMin == UINT32_MAX ? 0 : p.psramMin),
+                (unsigned long)(p.psramLargestMin == UINT32_MAX ? 0 : p.psramLargestMin), (unsigned long)p.wifiDrops);
+}
+
+static uint16_t fpsHistogramPercentile(int pct) {
+  uint32_t count = 0, seen = 0;
+  for (uint32_t n : soakRunFps)
+    count += n;
+  uint32_t rank = (count * pct + 99) / 100;
+  for (int b = 0; b < SOAK_FPS_BUCKETS; b++)
+    if (count && (seen += soakRunFps[b]) >= rank)
+      return b * 10;
+  return 0;
+}
+
+// The summary: the whole run, then the periods oldest first with the one filling up last
+static void sendSoakSummary() {
+  if (soakRunning)
+    takeSoakCounters();
+  SoakPeriod run = soakDone;
+  foldSoakPeriod(run, soakNow);
+  run.frames = soakRunFrame.count;
+  run.fpsP5 = fpsHistogramPercentile(5);
+  run.fpsP50 = fpsHistogramPercentile(50);
+  run.frameP50Us = statPercentileUs(soakRunFrame, 50);
+  run.frameP99Us = statPercentileUs(soakRunFrame, 99);
+  run.frameMaxUs = soakRunFrame.maxUs;
+  run.sdP50Us = statPercentileUs(soakRunSdRead, 50);
+  run.sdP99Us = statPercentileUs(soakRunSdRead, 99);
+  run.sdMaxUs = soakRunSdRead.maxUs;
+  run.wifiDrops = soakPeriodWifiDrops + soakNow.wifiDrops - soakStartWifiDrops;
+
+  uint32_t now = millis();
+  int kept = std::min(soakPeriodCount, SOAK_PERIODS);
+  ChunkedResponse response(200, "application/json");
+  response.addf("{\"firmware\":\"" FIRMWARE_VERSION "\",\"build\":\"" __DATE__ " " __TIME__ "\",\"running\":%s,"
+                "\"elapsedS\":%lu,\"remainingS\":%lu,\"periodS\":%lu,\"run\":",
+                soakRunning ? "true" : "false", soakStarted ? (unsigned long)((now - soakStarted) / 1000) : 0UL,
+                soakRunning && soakEndsAt ? (unsigned long)((soakEndsAt - now) / 1000) : 0UL,
+                (unsigned long)(SOAK_PERIOD_MS / 1000));
+  addSoakPeriod(response, run);
+  response.add(",\"periods\":[");
+  for (int i = 0; i < kept; i++) {
+    addSoakPeriod(response, soakPeriods[(soakPeriodCount - kept + i) % SOAK_PERIODS]);
+    response.add(",");
+  }
+  addSoakPeriod(response, soakNow);
+  response.add("]}");
+  response.end();
+}
+
+int getGifInventory( const char* basePath )
+{
+  int amount = 0;
+
+  textOnScreen = false; // drawn over whatever the panel shows
+  tft.setTextColor( TFT_WHITE, TFT_BLACK );
+  tft.setTextSize( 2 );
+
+  int textPosX = tft.width()/2 - 16;
+  int textPosY = tft.height()/2 - 10;
+
+  tft.drawString("GIF Files:", textPosX-40, textPosY-20 );
+
+  for (size_t i = 0; i < catalog.size(); i++) {
+    amount++;
+    tft.drawString(String(amount), textPosX, textPosY );
+  }
+  // log_n("Found %d GIF files", amount);
+  return amount;
+}
+
+// Names of all files in /gif, or their catalog entries with details=true
+void sendGifInventoryApi(bool details) {
+  ChunkedResponse response(200, "application/json");
+  response.add("[");
+  bool first = true;
+  for (const MediaEntry &entry : catalog) {
+    if(!first) {
+      response.add(",");
+    }
+    if (details) {
+      response.add("{\"name\":\"");
+      response.add(entry.name());
+      response.addf("\",\"size\":%lu,\"width\":%u,\"height\":%u,\"frames\":%u,\"duration\":%lu,\"store\":\"%s\",\"preview\":\"",
+                    (unsigned long)entry.size, entry.width, entry.height, entry.frames, (unsigned long)entry.duration,
+                    storeNames[entry.store]);
+      response.add(entry.preview());
+      response.add("\"}");
+    } else {
+      response.add("\"");
+      response.add(entry.name());
+      response.add("\"");
+    }
+    first = false;
+  }
+  response.add("]");
+  response.end();
+}
+
+// Changes whenever a file is added, replaced or removed; the catalog is sorted by name, so the
+// same media hash the same on every boot
+static uint32_t catalogHash() {
+  uint32_t crc = 0;
+  for (const MediaEntry &entry : catalog) {
+    crc = esp_rom_crc32_le(crc, (const uint8_t *)entry.name(), strlen(entry.name()) + 1);
+    crc = esp_rom_crc32_le(crc, (const uint8_t *)entry.md5, strlen(entry.md5));
+    crc = esp_rom_crc32_le(crc, (const uint8_t *)&entry.size, sizeof(entry.size));
+  }
+  return crc;
+}
+
+// What a host needs before it talks to the eye: firmware, formats, control channels, the panel
+// and a catalog hash, so a sync only fetches /manifest when the hash moved
+void sendCapabilities() {
+  char json[640];
+  snprintf(json, sizeof(json),
+           "{\"firmware\":\"" FIRMWARE_VERSION "\",\"build\":\"" __DATE__ " " __TIME__ "\","
+           "\"formats\":[\"gif\",\"jpg\",\"565\"],\"modes\":[\"eye\",\"playlist\",\"stream\",\"sync\",\"audio\""
+#ifdef USE_JPEGDEC
+           ",\"mjpeg\""
+#endif
+           "],\"ports\":{\"http\":80,\"control\":%d,\"stream\":%d,\"sync\":%d,\"audio\":%d},"
+#ifdef USE_SERIAL_CONTROL
+           "\"serialControl\":true,"
+#else
+           "\"serialControl\":false,"
+#endif
+#ifdef JPEG_SIMD_BUILT
+           "\"jpegSimd\":true,"
+#else
+           "\"jpegSimd\":false,"
+#endif
+#if defined(USE_IRAM_HOT_LOOPS) && defined(GIF_HOT_LOOPS_IN_IRAM)
+           "\"iramHotLoops\":true,"
+#else
+           "\"iramHotLoops\":false,"
+#endif
+           "\"catalog\":{\"hash\":\"%08lx\",\"files\":%u},"
+           "\"panel\":{\"driver\":\"GC9A01\",\"width\":%d,\"height\":%d,\"round\":true,\"rotation\":%d,"
+           "\"mirrored\":%s,\"side\":\"%s\",\"spiHz\":%lu,\"bitsPerPixel\":%d},\"psram\":%s,\"storage\":%s}",
+           CONTROL_PORT, STREAM_PORT, SYNC_PORT, AUDIO_PORT, (unsigned long)catalogHash(), (unsigned)catalog.size(),
+           (int)tft.width(), (int)tft.height(), (int)(tft.getRotation() & 3), panelMirrored ? "true" : "false",
+           sideNames[eyeSide], (unsigned long)tft.getWriteFrequency(),
+#ifdef USE_RGB444
+           12,
+#else
+           16,
+#endif
+           psramFound() ? "true" : "false", storageReady ? "true" : "false");
+  server.send(200, "application/json", json);
+}
+
+// Playback events (/events): each client gets a text/event-stream of `started`, `frame`,
+// `finished` and `cancelled` plays, `catalog` changes and, with ?stats=ms, `stats` snapshots of the
+// frame timing, so a host reacts to the eye instead of polling it. The web task keeps the
+// connections like the screen stream's and writes to them between requests
+#define EVENTS_MAX_CLIENTS 3
+#define EVENTS_KEEPALIVE_MS 15000 // a comment line, so proxies and the client see the link is alive
+#define EVENTS_MIN_STATS_MS 1000
+
+struct EventClient {
+  WiFiClient client;
+  uint32_t statsMs;   // 0 for no snapshots
+  uint32_t nextStats; // millis() of the next one
+};
+static EventClient eventClients[EVENTS_MAX_CLIENTS];
+static uint32_t eventsKeepalive = 0;
+
+static const char *const eventNames[] = { "started", "frame", "finished", "cancelled", "catalog" };
+
+// Write one event to every client, dropping those that are gone
+static void broadcastEvent(const char *text, size_t n, EventClient *only = NULL)
+{
+  for (EventClient &c : eventClients) {
+    if (!c.client || (only && &c != only))
+      continue;
+    if (!c.client.connected() || c.client.write((const uint8_t *)text, n) != n)
+      c.client.stop();
+  }
+}
+
+// Web task: send what the player and the catalog posted, the due snapshots and keepalives
+static void serviceEvents()
+{
+  bool any = false;
+  for (EventClient &c : eventClients)
+    any |= (bool)c.client;
+  eventsWanted = any;
+  if (!any)
+    return;
+  char text[256];
+  PlaybackEvent e;
+  while (xQueueReceive(eventQueue, &e, 0) == pdTRUE) {
+    int n = e.type == EVENT_CATALOG
+      ? snprintf(text, sizeof(text), "event: catalog\ndata: {\"name\":\"%s\",\"hash\":\"%08lx\",\"files\":%u}\n\n",
+                 e.name, (unsigned long)catalogHash(), (unsigned)catalog.size())
+      : snprintf(text, sizeof(text), "event: %s\ndata: {\"name\":\"%s\",\"frame\":%lu,\"ms\":%lu,\"mode\":\"%s\"}\n\n",
+                 eventNames[e.type], e.name, (unsigned long)e.frame, (unsigned long)e.ms, playbackMode);
+    broadcastEvent(text, std::min((size_t)n, sizeof(text) - 1));
+  }
+  uint32_t now = millis();
+  for (EventClient &c : eventClients) {
+    if (!c.client || !c.statsMs || (int32_t)(now - c.nextStats) < 0)
+      continue;
+    c.nextStats = now + c.statsMs;
+    StatSlot sum;
+    uint32_t windowMs = sumStatSlots(sum);
+    int n = snprintf(text, sizeof(text),
+                     "event: stats\ndata: {\"windowMs\":%lu,\"mode\":\"%s\",\"playing\":\"%s\",\"frames\":%lu,"
+                     "\"late\":%lu,\"dropped\":%lu,\"fps\":%.1f,\"eventsDropped\":%lu}\n\n",
+                     (unsigned long)windowMs, playbackMode, playingName, (unsigned long)sum.frames,
+                     (unsigned long)sum.late, (unsigned long)sum.dropped,
+                     sum.shownMs ? sum.frames * 1000.0f / sum.shownMs : 0.0f, (unsigned long)eventsDropped);
+    broadcastEvent(text, std::min((size_t)n, sizeof(text) - 1), &c);
+  }
+  if ((int32_t)(now - eventsKeepalive) >= 0) {
+    eventsKeepalive = now + EVENTS_KEEPALIVE_MS;
+    broadcastEvent(":\n\n", 3);
+  }
+}
+
+// GET /events: hand the connection to serviceEvents()
+static void handleEvents()
+{
+  uint32_t statsMs = 0;
+  if (const char *ms = server.argValue("stats"))
+    statsMs = std::max<uint32_t>(atol(ms), EVENTS_MIN_STATS_MS);
+  EventClient *slot = NULL;
+  for (EventClient &c : eventClients)
+    if (!slot && !c.client)
+      slot = &c;
+  if (!slot) { // all taken, the one in the first slot goes
+    std::rotate(eventClients, eventClients + 1, eventClients + EVENTS_MAX_CLIENTS);
+    slot = &eventClients[EVENTS_MAX_CLIENTS - 1];
+  }
+  slot->client.stop();
+  if (!eventsWanted)
+    xQueueReset(eventQueue); // nothing queued while nobody listened is news
+  slot->client = server.client();
+  slot->client.setNoDelay(true);
+  slot->client.print("HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n"
+                     "Connection: close\r\nAccess-Control-Allow-Origin: *\r\n\r\nretry: 2000\n\n");
+  slot->statsMs = statsMs;
+  slot->nextStats = millis();
+  eventsWanted = true;
+}
+
+// Name, checksum and size of every file in /gif as a JSON object, so a sync only sends what changed
+void sendManifest() {
+  ChunkedResponse response(200, "application/json");
+  response.add("{");
+  bool first = true;
+  for (const MediaEntry &entry : catalog) {
+    response.add(first ? "\"" : ",\"");
+    response.add(entry.name());
+    response.addf("\":{\"checksum\":\"%s\",\"size\":%lu,\"store\":\"%s\"}", entry.md5,
+                  (unsigned long)entry.size, storeNames[entry.store]);
+    first = false;
+  }
+  response.add("}");
+  response.end();
+}
+
+// Write the staged upload data; offsets stay multiples of the buffer size until the last write
+static bool flushUploadBuffer() {
+  if (uploadBuffered == 0)
+    return true;
+  size_t written = uploadFile.write(uploadBuffer, uploadBuffered);
+  bool ok = (written == uploadBuffered);
+  uploadBuffered = 0;
+  return ok;
+}
+
+// Stage received data, writing it out in whole buffers; false if a write failed
+static bool bufferUpload(const uint8_t *data, size_t remaining) {
+  while (remaining > 0) {
+    size_t part = std::min(remaining, UPLOAD_BUFFER_SIZE - uploadBuffered);
+    memcpy(uploadBuffer + uploadBuffered, data, part);
+    uploadBuffered += part;
+    data += part;
+    remaining -= part;
+    if (uploadBuffered == UPLOAD_BUFFER_SIZE && !flushUploadBuffer())
+      return false;
+  }
+  return true;
+}
+
+static void abortUpload() {
+  if (uploadFile)
+    uploadFile.close();
+  uploadFs->remove(UPLOAD_TEMP_PATH);
+  uploadBuffered = 0;
+}
+
+// Flash when asked for with ?store=flash and the file fits, the card otherwise
+static fs::FS *uploadStoreFor(size_t bytes) {
+  if (server.arg("store") != "flash" || !flashStoreReady)
+    return &SD;
+  size_t used = LittleFS.usedBytes(), total = LittleFS.totalBytes();
+  if (total > used && bytes < total - used)
+    return &LittleFS;
+  Serial.println("Flash store full, uploading to the SD card");
+  return &SD;
+}
+
+// Move a completely received file from `tempPath` into place as /gif/<name> and list it
+static bool installUpload(fs::FS &store, const char *tempPath, const String &name, const char *md5) {
+  String fullPath = "/gif/" + name;
+  queueDisplayCommand(CMD_DROP_CACHE, fullPath.c_str(), 0);
+  if (SD.exists(fullPath.c_str()))
+    SD.remove(fullPath.c_str()); // FAT can't rename over an existing file, and one copy is kept
+  if (flashStoreReady && LittleFS.exists(fullPath.c_str()))
+    LittleFS.remove(fullPath.c_str());
+  if (!store.rename(tempPath, fullPath.c_str()))
+    return false;
+  catalogAdd(name.c_str(), md5);
+  if (autoTranscode && isGifName(name))
+    queueDisplayCommand(CMD_TRANSCODE, fullPath.c_str(), 0);
+  return true;
+}
+
+// Start an upload of about `bytes` into the temp file of the store it goes to
+static void beginUpload(size_t bytes) {
+  uploadFailed = false;
+  uploadChecksumMismatch = false;
+  uploadTooLarge = bytes > UPLOAD_MAX_SIZE;
+  if(uploadTooLarge) {
+    Serial.println("Upload refused: file too large");
+    return;
+  }
+  uploadFs = uploadStoreFor(bytes);
+  uploadFs->remove(UPLOAD_TEMP_PATH); // leftover of an interrupted upload
+#ifdef USE_CONTIGUOUS_MEDIA
+  // On the card the file gets the request's size in one run of clusters up front, written over
+  // in place and cut to the file's size at the end, so playback can read it by sectors
+  uploadPreallocated = uploadFs == &SD && preallocateSdFile(UPLOAD_TEMP_PATH, bytes);
+  uploadFile = uploadPreallocated ? SD.open(UPLOAD_TEMP_PATH, "r+") : uploadFs->open(UPLOAD_TEMP_PATH, FILE_WRITE);
+#else
+  uploadFile = uploadFs->open(UPLOAD_TEMP_PATH, FILE_WRITE);
+#endif
+  uploadBuffered = 0;
+  uploadMd5.begin();
+  uploadFailed = !uploadFile;
+}
+
+// Hash and stage a piece of the upload, the checksum comes for free on the way to the card
+static void writeUpload(const uint8_t *data, size_t len) {
+  if(uploadTooLarge || uploadFailed)
+    return;
+  uploadMd5.add((uint8_t *)data, len);
+  if (!bufferUpload(data, len)) {
+    uploadFailed = true;
+    abortUpload();
+  }
+}
+
+// Move the complete upload into place as /gif/<name>; with `expectedMd5` set the content must match it
+static void endUpload(const String &name, const String &expectedMd5) {
+  if(uploadTooLarge || uploadFailed)
+    return;
+  bool ok = flushUploadBuffer();
+#ifdef USE_CONTIGUOUS_MEDIA
+  uint32_t written = uploadFile.position();
+  uploadFile.close();
+  if (ok && uploadPreallocated)
+    ok = truncateSdFile(UPLOAD_TEMP_PATH, written);
+#else
+  uploadFile.close();
+#endif
+  uploadMd5.calculate();
+  String md5 = uploadMd5.toString();
+  if (ok && expectedMd5.length() && !expectedMd5.equalsIgnoreCase(md5)) {
+    Serial.println("Upload rejected: checksum mismatch for " + name);
+    uploadChecksumMismatch = true;
+    uploadFailed = true;
+    abortUpload();
+    return;
+  }
+  if (!ok || !installUpload(*uploadFs, UPLOAD_TEMP_PATH, name, md5.c_str())) {
+    Serial.println("Upload failed: could not write /gif/" + name);
+    uploadFailed = true;
+    abortUpload();
+  }
+}
+
+// Uploads are written to a temp file and renamed when complete, so half-written files never show up
+void handleFileUpload() {
+  HTTPUpload& upload = server.upload();
+  if(upload.status == UPLOAD_FILE_START) {
+    beginUpload(server.clientContentLength()); // request body, a little more than the file
+  } else if(upload.status == UPLOAD_FILE_WRITE) {
+    writeUpload(upload.buf, upload.currentSize);
+  } else if(upload.status == UPLOAD_FILE_END) {
+    endUpload(upload.filename, server.arg("md5"));
+  } else if(upload.status == UPLOAD_FILE_ABORTED) {
+    abortUpload();
+  }
+}
+
+// A plain file name for /gif, no directories and no hidden files
+static bool isUploadName(const String &name) {
+  return name.length() > 0 && name.length() < 64 && name.indexOf('/') < 0 && name.charAt(0) != '.';
+}
+
+// PUT /upload?name=: the request body is the file, streamed to the card without multipart framing
+void handleRawUpload() {
+  HTTPRaw &raw = server.raw();
+  if (raw.status == RAW_START) {
+    if (isUploadName(server.arg("name")))
+      beginUpload(server.clientContentLength());
+    else
+      uploadFailed = true;
+  } else if (raw.status == RAW_WRITE) {
+    writeUpload(raw.buf, raw.currentSize);
+  } else if (raw.status == RAW_END) {
+    endUpload(server.arg("name"), server.arg("md5"));
+  } else {
+    abortUpload();
+  }
+}
+
+// Reply to an upload and reset its state for the next one
+static void finishUpload(bool redirect) {
+  if(uploadTooLarge) {
+    server.send(400, "text/plain", "Upload refused: file too large");
+  } else if (uploadChecksumMismatch) {
+    server.send(400, "text/plain", "Upload failed: checksum mismatch");
+  } else if(uploadFailed) {
+    server.send(500, "text/plain", uploadFs == &SD ? "Upload failed: could not write to SD card"
+                                                   : "Upload failed: could not write to the flash store");
+  } else if (redirect) {
+    server.sendHeader("Location", "/?upload=success");
+    server.send(302, "text/plain", "");
+  } else {
+    server.send(200, "application/json", "{\"md5\":\"" + uploadMd5.toString() + "\"}");
+  }
+  uploadTooLarge = false;
+  uploadChecksumMismatch = false;
+  uploadFailed = false;
+}
+
+// Firmware updates: PUT /ota?md5= streams the app image into the OTA partition that isn't
+// running, through the upload buffer so flash is written in whole 32 KB steps, erased as it
+// goes. The image is checked against ?md5= and by esp_ota_end() before it is made the boot
+// partition, and the eye restarts into it after the reply
+static esp_ota_handle_t otaHandle = 0; // 0 unless an update is open, whether it failed or not
+static const esp_partition_t *otaPartition = NULL;
+static const char *otaError = NULL; // why the running update failed, NULL while it is fine
+static int otaErrorCode = 0;        // and the HTTP status for it
+static size_t otaSize = 0;
+
+static void failOta(int code, const char *error) {
+  otaError = error;
+  otaErrorCode = code;
+}
+
+// Give the open update's partition back, so the next esp_ota_begin() can have it
+static void abortOta() {
+  if (otaHandle)
+    esp_ota_abort(otaHandle);
+  otaHandle = 0;
+}
+
+static void beginOta(size_t length) {
+  abortOta(); // left open by a request that never ended
+  otaError = NULL;
+  otaSize = 0;
+  uploadBuffered = 0;
+  uploadMd5.begin();
+  otaPartition = esp_ota_get_next_update_partition(NULL);
+  if (!otaPartition) {
+    failOta(500, "no OTA partition, flash partitions.csv over USB once");
+  } else if (length > otaPartition->size) {
+    failOta(400, "image larger than the OTA partition");
+  } else if (esp_ota_begin(otaPartition, OTA_WITH_SEQUENTIAL_WRITES, &otaHandle) != ESP_OK) {
+    otaHandle = 0;
+    failOta(500, "could not start the update");
+  }
+  if (!otaError)
+    Serial.printf("OTA: writing %u bytes to %s\n", (unsigned)length, otaPartition->label);
+}
+
+static void flushOta() {
+  if (uploadBuffered && !otaError && esp_ota_write(otaHandle, uploadBuffer, uploadBuffered) != ESP_OK)
+    failOta(500, "flash write failed");
+  uploadBuffered = 0;
+}
+
+static void writeOta(const uint8_t *data, size_t len) {
+  if (otaError)
+    return;
+  uploadMd5.add((uint8_t *)data, len);
+  otaSize += len;
+  while (len) {
+    size_t n = std::min(len, (size_t)UPLOAD_BUFFER_SIZE - uploadBuffered);
+    memcpy(uploadBuffer + uploadBuffered, data, n);
+    uploadBuffered += n;
+    data += n;
+    len -= n;
+    if (uploadBuffered == UPLOAD_BUFFER_SIZE)
+      flushOta();
+  }
+}
+
+static void endOta(const String &expectedMd5) {
+  flushOta();
+  if (otaError) {
+    abortOta();
+    return;
+  }
+  uploadMd5.calculate();
+  if (expectedMd5.length() && !expectedMd5.equalsIgnoreCase(uploadMd5.toString())) {
+    failOta(400, "checksum mismatch");
+    abortOta();
+    return;
+  }
+  esp_err_t ended = esp_ota_end(otaHandle); // frees the handle, valid image or not
+  otaHandle = 0;
+  if (ended != ESP_OK) {
+    failOta(400, "not a valid app image");
+  } else if (esp_ota_set_boot_partition(otaPartition) != ESP_OK) {
+    failOta(500, "could not select the new image");
+  }
+}
+
+void handleOtaUpload() {
+  HTTPRaw &raw = server.raw();
+  if (raw.status == RAW_START) {
+    beginOta(server.clientContentLength());
+  } else if (raw.status == RAW_WRITE) {
+    writeOta(raw.buf, raw.currentSize);
+  } else if (raw.status == RAW_END) {
+    endOta(server.arg("md5"));
+  } else {
+    abortOta(); // also after a failed write, which leaves the update open
+    if (!otaError)
+      failOta(400, "upload aborted");
+  }
+}
+
+void finishOta() {
+  if (otaError) {
+    Serial.printf("OTA failed: %s\n", otaError);
+    server.sendTextf(otaErrorCode, "Update failed: %s", otaError);
+    otaError = NULL;
+    return;
+  }
+  Serial.printf("OTA: %u bytes written, restarting into %s\n", (unsigned)otaSize, otaPartition->label);
+  server.send(200, "application/json", "{\"md5\":\"" + uploadMd5.toString() + "\",\"size\":" + String((unsigned long)otaSize) +
+              ",\"partition\":\"" + String(otaPartition->label) + "\"}");
+  delay(100);
+  ESP.restart();
+}
+
+// Range uploads: PUT /asset/<name>?offset=&total=&crc= carries one chunk of up to
+// UPLOAD_BUFFER_SIZE bytes, which is checked against its CRC-32 in the upload buffer and
+// then appended to /gif/.part/<name> in one write. The part file is the resume state: it
+// survives dropped connections and reboots, GET /asset/<name> reports its size, and chunks
+// of several files can take turns. The last chunk moves the file into place
+#define ASSET_PART_DIR "/gif/.part"
+
+enum AssetChunkResult { CHUNK_OK, CHUNK_BAD_NAME, CHUNK_BAD_TOTAL, CHUNK_TOO_LARGE, CHUNK_PAST_TOTAL,
+                        CHUNK_OUT_OF_ORDER, CHUNK_BAD_CRC, CHUNK_BAD_MD5, CHUNK_WRITE_FAILED };
+static const char *chunkErrors[] = { "", "invalid name", "missing total", "too large", "past total",
+                                     "offset is not the received size", "chunk CRC mismatch", "checksum mismatch",
+                                     "could not write to SD card" };
+static const int chunkStatus[] = { 200, 400, 400, 400, 400, 409, 400, 400, 500 };
+static uint8_t assetChunkResult = CHUNK_OK;
+static uint32_t assetChunkCrc = 0;
+
+static String assetPartPath(const String &name) {
+  return String(ASSET_PART_DIR "/") + name;
+}
+
+static uint32_t assetReceived(const String &name) {
+  File part = SD.open(assetPartPath(name).c_str());
+  uint32_t size = part ? part.size() : 0;
+  if (part)
+    part.close();
+  return size;
+}
+
+// Collect the chunk in the upload buffer; nothing reaches the card before its CRC matched
+void handleAssetChunk() {
+  HTTPRaw &raw = server.raw();
+  if (raw.status == RAW_START) {
+    String name = server.pathArg(0);
+    uint32_t offset = server.arg("offset").toInt();
+    long total = server.arg("total").toInt();
+    uploadBuffered = 0;
+    assetChunkCrc = 0;
+    if (!isUploadName(name) || !storageReady)
+      assetChunkResult = CHUNK_BAD_NAME;
+    else if (total <= 0) // missing or not a number, every chunk would look like the last one
+      assetChunkResult = CHUNK_BAD_TOTAL;
+    else if (total > UPLOAD_MAX_SIZE || server.clientContentLength() > UPLOAD_BUFFER_SIZE)
+      assetChunkResult = CHUNK_TOO_LARGE;
+    else if (offset + server.clientContentLength() > (size_t)total)
+      assetChunkResult = CHUNK_PAST_TOTAL;
+    else if (offset != 0 && offset != assetReceived(name)) // 0 starts the file over
+      assetChunkResult = CHUNK_OUT_OF_ORDER;
+    else
+      assetChunkResult = CHUNK_OK;
+  } else if (raw.status == RAW_WRITE && assetChunkResult == CHUNK_OK) {
+    if (uploadBuffered + raw.currentSize > UPLOAD_BUFFER_SIZE) {
+      assetChunkResult = CHUNK_TOO_LARGE;
+      return;
+    }
+    memcpy(uploadBuffer + uploadBuffered, raw.buf, raw.currentSize);
+    uploadBuffered += raw.currentSize;
+    assetChunkCrc = esp_rom_crc32_le(assetChunkCrc, raw.buf, raw.currentSize);
+  }
+  // RAW_END is answered by finishAssetChunk(), an aborted chunk has written nothing
+}
+
+// Append the checked chunk and reply with the received size to continue from
+void finishAssetChunk() {
+  String name = server.pathArg(0);
+  String partPath = assetPartPath(name);
+  uint32_t offset = server.arg("offset").toInt();
+  uint32_t total = server.arg("total").toInt();
+  if (assetChunkResult == CHUNK_OK && strtoul(server.arg("crc").c_str(), NULL, 16) != assetChunkCrc)
+    assetChunkResult = CHUNK_BAD_CRC;
+  if (assetChunkResult == CHUNK_OK) {
+    if (!SD.exists(ASSET_PART_DIR))
+      SD.mkdir(ASSET_PART_DIR);
+    if (offset == 0)
+      SD.remove(partPath.c_str());
+    File part = SD.open(partPath.c_str(), offset == 0 ? FILE_WRITE : FILE_APPEND);
+    if (!part || part.write(uploadBuffer, uploadBuffered) != uploadBuffered)
+      assetChunkResult = CHUNK_WRITE_FAILED;
+    if (part)
+      part.close();
+  }
+  uploadBuffered = 0;
+  uint32_t received = isUploadName(name) ? assetReceived(name) : 0;
+  std::string md5;
+  if (assetChunkResult == CHUNK_OK && received > total) {
+    assetChunkResult = CHUNK_PAST_TOTAL; // a chunk without a length, or a part file left from another total
+    SD.remove(partPath.c_str());
+    received = 0;
+  } else if (assetChunkResult == CHUNK_OK && received == total) {
+    md5 = hashMedia(partPath.c_str()); // what is on the card, not what was sent
+    String expected = server.arg("md5");
+    if (expected.length() && !expected.equalsIgnoreCase(md5.c_str()))
+      assetChunkResult = CHUNK_BAD_MD5;
+    else if (!installUpload(SD, partPath.c_str(), name, md5.c_str()))
+      assetChunkResult = CHUNK_WRITE_FAILED;
+    if (assetChunkResult != CHUNK_OK) {
+      SD.remove(partPath.c_str()); // start over
+      received = 0;
+    }
+  }
+  String json = "{\"received\":" + String((unsigned long)received);
+  if (!md5.empty() && assetChunkResult == CHUNK_OK)
+    json += ",\"md5\":\"" + String(md5.c_str()) + "\"";
+  if (assetChunkResult != CHUNK_OK)
+    json += ",\"error\":\"" + String(chunkErrors[assetChunkResult]) + "\"";
+  server.send(chunkStatus[assetChunkResult], "application/json", json + "}");
+  assetChunkResult = CHUNK_OK;
+}
+
+// Resume point of a range upload and the checksum of the file in place, if any
+void sendAssetStatus() {
+  String name = server.pathArg(0);
+  if (!isUploadName(name)) {
+    server.send(400, "text/plain", "Invalid file name");
+    return;
+  }
+  const MediaEntry *entry = findMedia(name.c_str());
+  String json = "{\"received\":" + String((unsigned long)(storageReady ? assetReceived(name) : 0));
+  json += ",\"md5\":\"" + String(entry ? entry->md5 : "") + "\"}";
+  server.send(200, "application/json", json);
+}
+
+// An asset pack arrives as raw POST bodies of consecutive ranges (/pack?id=&offset=&total=)
+// appended to ASSET_PACK_TEMP_PATH. What reached the card survives a dropped connection or a
+// reboot, so a sync resumes at GET /pack's "received" instead of starting over
+static bool packRangeRejected = false; // the range doesn't continue the pending pack
+
+void handlePackUpload() {
+  HTTPRaw &raw = server.raw();
+  if (raw.status == RAW_START) {
+    uploadFailed = false;
+    packRangeRejected = false;
+    uint32_t offset = server.arg("offset").toInt();
+    uploadFs = &SD;
+    uploadBuffered = 0;
+    if (offset == 0) { // a new pack
+      SD.remove(ASSET_PACK_TEMP_PATH);
+      prefs.putString("packId", server.arg("id"));
+      prefs.putUInt("packTotal", server.arg("total").toInt());
+      uploadFile = SD.open(ASSET_PACK_TEMP_PATH, FILE_WRITE);
+    } else {
+      uploadFile = SD.open(ASSET_PACK_TEMP_PATH, FILE_APPEND);
+      packRangeRejected = !uploadFile || uploadFile.size() != offset || server.arg("id") != prefs.getString("packId");
+      if (packRangeRejected && uploadFile)
+        uploadFile.close();
+    }
+    uploadFailed = !packRangeRejected && !uploadFile;
+  } else if (raw.status == RAW_WRITE) {
+    if (packRangeRejected || uploadFailed)
+      return;
+    if (!bufferUpload(raw.buf, raw.currentSize)) {
+      uploadFailed = true;
+      uploadFile.close();
+    }
+  } else if (uploadFile) { // RAW_END or RAW_ABORTED, both keep what was received
+    if (!flushUploadBuffer())
+      uploadFailed = true;
+    uploadFile.close();
+  }
+}
+
+static uint32_t packReceived() {
+  File f = SD.open(ASSET_PACK_TEMP_PATH);
+  uint32_t size = f ? f.size() : 0;
+  if (f)
+    f.close();
+  return size;
+}
+
+void sendPackStatus(int code) {
+  size_t packed;
+  xSemaphoreTake(cacheLock, portMAX_DELAY);
+  packed = packAssets.size();
+  xSemaphoreGive(cacheLock);
+  String json = "{\"id\":\"" + prefs.getString("packId") + "\"";
+  json += ",\"received\":" + String((unsigned long)packReceived());
+  json += ",\"total\":" + String((unsigned long)prefs.getUInt("packTotal", 0));
+  json += ",\"installed\":\"" + prefs.getString("packLoaded") + "\"";
+  json += ",\"files\":" + String((unsigned long)packed) + "}";
+  server.send(code, "application/json", json);
+}
+
+// After a range: once the whole pack is there, check its table and have the player swap it in
+void finishPackRange() {
+  if (!storageReady) {
+    server.send(503, "text/plain", "No SD card");
+    return;
+  }
+  if (packRangeRejected || uploadFailed) {
+    int code = packRangeRejected ? 409 : 500; // 409: resume from GET /pack's "received"
+    packRangeRejected = false;
+    uploadFailed = false;
+    sendPackStatus(code);
+    return;
+  }
+  uint32_t total = prefs.getUInt("packTotal", 0);
+  if (total == 0 || packReceived() != total) {
+    sendPackStatus(200);
+    return;
+  }
+  std::vector<PackedAsset> assets;
+  File f = SD.open(ASSET_PACK_TEMP_PATH);
+  bool valid = f && readPackTable(f, assets);
+  if (f)
+    f.close();
+  if (!valid) {
+    SD.remove(ASSET_PACK_TEMP_PATH);
+    prefs.remove("packId");
+    server.send(400, "text/plain", "Not an asset pack");
+    return;
+  }
+  if (!queueDisplayCommand(CMD_LOAD_PACK, "", 0)) {
+    sendPackStatus(503); // complete on the card, an empty range at "total" retries the swap
+    return;
+  }
+  prefs.putString("packLoaded", prefs.getString("packId"));
+  prefs.remove("packId");
+  prefs.putUInt("packTotal", 0);
+  sendPackStatus(200);
+}
+
+#define MEDIA_IMMUTABLE_AGE 31536000 // s a versioned /gif/<name>?v=<md5> may be cached, the name changes with the content
+
+// ?v= for a /gif link, the first 8 hex digits of the entry's MD5 so the URL changes with the content
+static std::string mediaVersion(const MediaEntry &entry) {
+  return std::string(entry.md5, strnlen(entry.md5, 8));
+}
+
+// A single "bytes=first-last", "bytes=first-" or "bytes=-suffix" range; false if it can't be served
+static bool parseByteRange(const String &header, uint32_t size, uint32_t *first, uint32_t *last) {
+  if (!header.startsWith("bytes=") || header.indexOf(',') >= 0 || size == 0)
+    return false;
+  int dash = header.indexOf('-');
+  if (dash < 0)
+    return false;
+  String from = header.substring(6, dash);
+  String to = header.substring(dash + 1);
+  if (from.length() == 0) { // the last n bytes
+    uint32_t suffix = to.toInt();
+    if (suffix == 0)
+      return false;
+    *first = suffix < size ? size - suffix : 0;
+    *last = size - 1;
+    return true;
+  }
+  *first = from.toInt();
+  *last = to.length() ? (uint32_t)to.toInt() : size - 1;
+  if (*last >= size)
+    *last = size - 1;
+  return *first <= *last;
+}
+
+// Serves /gif/<name> for everything in the catalog, from whichever store holds it, with the
+// catalog MD5 as a strong ETag: If-None-Match gets a 304 without touching the card, Range gets
+// a 206 of just those bytes, and the index page's versioned links are cached for good. Files
+// the catalog doesn't list fall through to serveStatic()
+class MediaHandler : public RequestHandler {
+public:
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+  bool canHandle(HTTPMethod method, const String &uri) override { return canServe(method, uri); }
+  bool handle(WebServer &server, HTTPMethod method, const String &uri) override { return serve(uri); }
+#else
+  bool canHandle(HTTPMethod method, String uri) override { return canServe(method, uri); }
+  bool handle(WebServer &server, HTTPMethod method, String uri) override { return serve(uri); }
+#endif
+
+private:
+  static bool canServe(HTTPMethod method, const String &uri) {
+    return method == HTTP_GET && uri.startsWith("/gif/") && findMedia(uri.c_str() + 5);
+  }
+
+  static bool serve(const String &uri) {
+    const MediaEntry *entry = findMedia(uri.c_str() + 5);
+    if (!entry)
+      return false;
+    String etag = "\"" + String(entry->md5) + "\"";
+    if (entry->md5[0]) {
+      server.sendHeader("ETag", etag);
+      bool versioned = server.hasArg("v") && server.arg("v") == mediaVersion(*entry).c_str();
+      server.sendHeader("Cache-Control", versioned ? "public, max-age=" + String(MEDIA_IMMUTABLE_AGE) + ", immutable"
+                                                   : String("no-cache")); // revalidate, a 304 is cheap
+      String match = server.header("If-None-Match");
+      if (match == "*" || match.indexOf(etag) >= 0) {
+        server.send(304);
+        return true;
+      }
+    }
+    server.sendHeader("Accept-Ranges", "bytes");
+
+    uint32_t first = 0, last = entry->size - 1;
+    int code = 200;
+    if (server.hasHeader("Range")) {
+      if (!parseByteRange(server.header("Range"), entry->size, &first, &last)) {
+        server.sendHeader("Content-Range", "bytes */" + String(entry->size));
+        server.send(416, "text/plain", "Range not satisfiable");
+        return true;
+      }
+      server.sendHeader("Content-Range", "bytes " + String(first) + "-" + String(last) + "/" + String(entry->size));
+      code = 206;
+    }
+    const char *type = isGifName(uri) ? "image/gif" : "image/jpeg";
+    uint32_t length = entry->size ? last - first + 1 : 0;
+
+    const BuiltinGif *builtin = entry->store == STORE_BUILTIN ? findBuiltinGif(uri.c_str()) : NULL;
+    if (builtin) {
+      server.send_P(code, type, (const char *)builtin->data + first, length);
+      return true;
+    }
+    int32_t size;
+    CatalogFile *f = static_cast<CatalogFile *>(catalogOpenFile(uri.c_str(), &size));
+    if (!f || !f->file.seek(f->base + first)) {
+      if (f)
+        catalogCloseFile(f);
+      server.send(500, "text/plain", "Could not read the file");
+      return true;
+    }
+    server.setContentLength(length);
+    server.send(code, type, "");
+    uint8_t buffer[CHUNK_BUFFER_SIZE];
+    for (uint32_t left = length; left > 0;) {
+      size_t n = f->file.read(buffer, std::min<uint32_t>(left, sizeof(buffer)));
+      if (n == 0)
+        break;
+      server.sendContent((const char *)buffer, n);
+      left -= n;
+    }
+    catalogCloseFile(f);
+    return true;
+  }
+};
+
+// First in the handler list, so it sees every request and notes when it began and what the heap
+// held; it never handles one. webTask() records the trace span and the heap change once
+// handleClient() returns
+static uint32_t traceHttpStart = 0;
+static uint16_t traceHttpName = 0, traceHttpMethod = 0;
+
+class RequestProbe : public RequestHandler {
+public:
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+  bool canHandle(HTTPMethod method, const String &uri) override { return note(method, uri); }
+#else
+  bool canHandle(HTTPMethod method, String uri) override { return note(method, uri); }
+#endif
+
+private:
+  static bool note(HTTPMethod method, const String &uri) {
+    if (traceOn && !traceHttpStart) {
+      traceHttpStart = micros();
+      traceHttpName = traceName(uri);
+      traceHttpMethod = method;
+    }
+    heapRequestStarted(uri);
+    noteActivity();
+    return false;
+  }
+};
+
+// GET /trace: the ring as a binary dump (TraceDumpHeader, names, events); tracing pauses
+// while it is copied. ?clear=1 starts over, ?on=0/1 stops and resumes recording
+static void handleTrace() {
+  if (!traceBuf) {
+    server.send(501, "text/plain", "Tracing is not available (USE_TRACE, PSRAM)");
+    return;
+  }
+  if (server.hasArg("on"))
+    traceOn = server.arg("on") != "0";
+  bool wasOn = traceOn;
+  traceOn = false;
+  delay(1); // let a recording in progress on the other core finish its store
+  TraceDumpHeader header = { { 'E', 'T', 'R', 'C' }, TRACE_VERSION, (uint16_t)traceNameCount, 0, 0, micros() };
+  uint32_t head = traceHead;
+  header.events = std::min<uint32_t>(head, TRACE_EVENTS);
+  header.lost = head - header.events;
+  uint32_t first = head % TRACE_EVENTS, older = head > TRACE_EVENTS ? TRACE_EVENTS - first : 0;
+  server.setContentLength(sizeof(header) + traceNameCount * TRACE_NAME_LEN + header.events * sizeof(TraceEvent));
+  server.send(200, "application/octet-stream", "");
+  server.sendContent((const char *)&header, sizeof(header));
+  server.sendContent((const char *)traceNames, traceNameCount * TRACE_NAME_LEN);
+  if (older) // the ring has wrapped: the oldest events run from the head to the end
+    server.sendContent((const char *)(traceBuf + first), older * sizeof(TraceEvent));
+  server.sendContent((const char *)traceBuf, (header.events - older) * sizeof(TraceEvent));
+  if (server.hasArg("clear")) {
+    traceHead = 0;
+    traceNameCount = 0;
+  }
+  traceOn = wasOn;
+}
+
+#ifdef USE_PROFILER
+// GET /profile?start=1[&ms=N]: clear the samples and sample for N ms, or until the next dump.
+// GET /profile: stop and return the samples as a binary dump (ProfileDumpHeader, task names, samples)
+static void handleProfile() {
+  if (!profileBuf) {
+    server.send(501, "text/plain", "Profiling is not available (USE_PROFILER, PSRAM)");
+    return;
+  }
+  if (server.hasArg("start")) {
+    long ms = server.hasArg("ms") ? server.arg("ms").toInt() : 0;
+    if (ms < 0 || ms > PROFILE_MAX_MS) {
+      server.sendTextf(400, "Invalid ms, use 1-%d or leave out to sample until the dump", PROFILE_MAX_MS);
+      return;
+    }
+    profileOn = false;
+    delay(2); // let a tick on the other core finish its sample
+    profileCount = profileDropped = 0;
+    profileTaskCount = 0;
+    if (!profileHooked) {
+      for (int core = 0; core < portNUM_PROCESSORS; core++)
+        esp_register_freertos_tick_hook_for_cpu(profileTick, core);
+      profileHooked = true;
+    }
+    profileMs = ms;
+    profileStartMs = millis();
+    profileEndTick = xTaskGetTickCount() + pdMS_TO_TICKS(ms);
+    profileOn = true;
+    server.send(200, "application/json", "{\"sampling\":true,\"hz\":" + String(configTICK_RATE_HZ) +
+                ",\"ms\":" + String(ms) + ",\"capacity\":" + String(PROFILE_SAMPLES) + "}");
+    return;
+  }
+  bool wasOn = profileOn;
+  profileOn = false;
+  delay(2);
+  uint32_t elapsed = millis() - profileStartMs;
+  if (profileMs && (!wasOn || elapsed > profileMs))
+    elapsed = profileMs;
+  ProfileDumpHeader header = { { 'E', 'P', 'R', 'F' }, PROFILE_VERSION, (uint16_t)profileTaskCount, profileCount,
+                               profileDropped, configTICK_RATE_HZ, elapsed };
+  server.setContentLength(sizeof(header) + profileTaskCount * PROFILE_TASK_LEN + profileCount * sizeof(ProfileSample));
+  server.send(200, "application/octet-stream", "");
+  server.sendContent((const char *)&header, sizeof(header));
+  server.sendContent(profileTaskNames, profileTaskCount * PROFILE_TASK_LEN);
+  server.sendContent((const char *)profileBuf, profileCount * sizeof(ProfileSample));
+}
+#endif
+
+#define PLAYLIST_MAX_TEXT 4000 // bytes, the longest string Preferences keeps
+
+// Replace the playlist with lines of "<name> [loops] [weight]", loops and weight default to 1;
+// false if a line is invalid, the old playlist stays then
+static bool setPlaylist(const String &text, bool shuffle) {
+  std::vector<PlaylistItem> items;
+  for (int start = 0; start < (int)text.length();) {
+    int end = text.indexOf('\n', start);
+    if (end < 0)
+      end = text.length();
+    String line = text.substring(start, end);
+    start = end + 1;
+    line.trim();
+    if (line.length() == 0)
+      continue;
+    char name[96];
+    int loops = 1, weight = 1;
+    if (sscanf(line.c_str(), "%95s %d %d", name, &loops, &weight) < 1)
+      return false;
+    String path = "/gif/" + String(name);
+    if (!isMediaName(path) || path.length() >= sizeof(playlistUpNext) || loops < 1 || loops > PLAYLIST_MAX_LOOPS ||
+        weight < 0 || weight > PLAYLIST_MAX_WEIGHT)
+      return false;
+    items.push_back({ path.c_str(), (uint16_t)loops, (uint16_t)weight });
+  }
+  xSemaphoreTake(playlistLock, portMAX_DELAY);
+  playlist.swap(items);
+  playlistShuffle = shuffle;
+  playlistNext = -1; // picked again from the new items
+  xSemaphoreGive(playlistLock);
+  return true;
+}
+
+static void sendPlaylistStatus() {
+  xSemaphoreTake(playlistLock, portMAX_DELAY);
+  String json = "{\"running\":" + String(playlistRunning ? "true" : "false");
+  json += ",\"mode\":\"" + String(playlistShuffle ? "shuffle" : "order") + "\"";
+  json += ",\"playing\":" + String(playlistRunning ? (int)playlistPos : -1);
+  json += ",\"items\":[";
+  for (size_t i = 0; i < playlist.size(); i++) {
+    if (i)
+      json += ",";
+    json += "{\"name\":\"" + String(playlist[i].path.c_str() + 5) + "\"";
+    json += ",\"loops\":" + String(playlist[i].loops);
+    json += ",\"weight\":" + String(playlist[i].weight) + "}";
+  }
+  xSemaphoreGive(playlistLock);
+  json += "]}";
+  server.send(200, "application/json", json);
+}
+
+// GET reports or starts and stops the playlist, POST replaces it (text/plain body) and starts it
+void handlePlaylist() {
+  int run = -1;
+  if (server.method() == HTTP_POST) {
+    String text = server.arg("plain");
+    bool shuffle = server.arg("mode") == "shuffle";
+    if (text.length() > PLAYLIST_MAX_TEXT) {
+      server.send(400, "text/plain", "Playlist too long");
+      return;
+    }
+    if (!setPlaylist(text, shuffle)) {
+      server.send(400, "text/plain", "Invalid playlist, use lines of <name> [loops] [weight]");
+      return;
+    }
+    prefs.putString("playlist", text);
+    prefs.putBool("plShuffle", shuffle);
+    run = 1;
+  } else if (server.hasArg("run")) {
+    run = server.arg("run") == "1";
+  }
+  if (run >= 0) {
+    prefs.putBool("plRun", run);
+    if (!queueDisplayCommand(CMD_PLAYLIST, "", run)) {
+      server.send(503, "text/plain", "Display busy");
+      return;
+    }
+    playlistRunning = run; // the player sets it too, this way the status shows it right away
+  }
+  sendPlaylistStatus();
+}
+
+#define BOOT_SD_RETRY_MS 1000    // between SD mount attempts while the card is missing
+#define BOOT_WIFI_TIMEOUT 15000  // ms after which the server starts without a connection
+
+// Boot runs in stages so the eye is up at once: setup() only brings up the panel and starts the
+// player task on the procedural eye, then the web task mounts the card while loop() waits for
+// WiFi, each on its own, so a missing card doesn't keep the server down
+static volatile bool networkReady = false;
+static unsigned long bootSdAttempt = 0; // millis() of the last SD.begin(), 0 before the first
+static unsigned long bootWifiStart = 0;
+
+// TODO: Load credentials securely (e.g., from SPIFFS, EEPROM, or WiFiManager)
+static const char *wifiSsid = "YOUR_WIFI_SSID";         // Replace with your SSID
+static const char *wifiPassword = "YOUR_WIFI_PASSWORD"; // Replace with your Password
+
+#define FIRMWARE_VERSION "1.0.0"   // reported by /capabilities and the mDNS announcement
+#define MDNS_NAME "wall-e-eye"     // host name prefix, the last 3 bytes of the MAC are appended
+#define MDNS_SERVICE "walle-eye"   // announced next to http, so the eyes node finds the eyes only
+static bool mdnsStarted = false;
+
+#define WIFI_FAST_JOIN_MS 1500   // a join on the cached channel and BSSID falls back to a full scan after this
+#define WIFI_RETRY_MS 8000       // a scan join that hasn't connected by then starts over
+// #define WIFI_REUSE_LEASE      // join with the cached DHCP lease as a static address, no DHCP round trip;
+                                 // only where the router keeps the eye's address reserved
+
+// Connection manager polled by loop(): the first attempt after boot or a drop goes straight to the
+// access point and channel of the last connection, so there is no scan, and a full scan only
+// follows when that doesn't connect. The driver's own reconnect is off so the two don't race
+enum WifiJoinState : uint8_t { WIFI_JOIN_DIRECT, WIFI_JOIN_SCAN, WIFI_JOINED };
+static WifiJoinState wifiState = WIFI_JOIN_SCAN;
+static unsigned long wifiAttemptStart = 0;
+static unsigned long wifiDropTime = 0; // millis() when the connection was lost, 0 at boot
+
+static bool joinWifiDirect() {
+  uint8_t bssid[6];
+  uint8_t channel = prefs.getUChar("wifiChan", 0);
+  if (!channel || prefs.getBytes("wifiBssid", bssid, sizeof(bssid)) != sizeof(bssid))
+    return false;
+  WiFi.disconnect();
+#ifdef WIFI_REUSE_LEASE
+  uint32_t ip = prefs.getUInt("wifiIp", 0);
+  if (ip)
+    WiFi.config(IPAddress(ip), IPAddress(prefs.getUInt("wifiGw", 0)), IPAddress(prefs.getUInt("wifiMask", 0)),
+                IPAddress(prefs.getUInt("wifiDns", 0)));
+#endif
+  WiFi.begin(wifiSsid, wifiPassword, channel, bssid);
+  return true;
+}
+
+static void joinWifiScan() {
+  WiFi.disconnect();
+#ifdef WIFI_REUSE_LEASE
+  WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0)); // back to DHCP
+#endif
+  WiFi.begin(wifiSsid, wifiPassword);
+}
+
+static void startWifiJoin() {
+  wifiAttemptStart = millis();
+  if (joinWifiDirect()) {
+    wifiState = WIFI_JOIN_DIRECT;
+  } else {
+    joinWifiScan();
+    wifiState = WIFI_JOIN_SCAN;
+  }
+}
+
+// Only what changed is written, so a steady network doesn't wear the flash
+static void cacheWifiLink() {
+  uint8_t bssid[6], cached[6];
+  memcpy(bssid, WiFi.BSSID(), sizeof(bssid));
+  if (prefs.getBytes("wifiBssid", cached, sizeof(cached)) != sizeof(cached) || memcmp(bssid, cached, sizeof(bssid)))
+    prefs.putBytes("wifiBssid", bssid, sizeof(bssid));
+  if (prefs.getUChar("wifiChan", 0) != WiFi.channel())
+    prefs.putUChar("wifiChan", WiFi.channel());
+  const struct { const char *key; uint32_t value; } lease[] = {
+    { "wifiIp", (uint32_t)WiFi.localIP() }, { "wifiGw", (uint32_t)WiFi.gatewayIP() },
+    { "wifiMask", (uint32_t)WiFi.subnetMask() }, { "wifiDns", (uint32_t)WiFi.dnsIP() }
+  };
+  for (const auto &item : lease) {
+    if (prefs.getUInt(item.key, 0) != item.value)
+      prefs.putUInt(item.key, item.value);
+  }
+}
+
+// wall-e-eye-xxxxxx.local, with the HTTP API as _http._tcp and _walle-eye._tcp services. The responder
+// follows the interface through drops on its own, so this only runs on the first join
+static void startMdns() {
+  uint8_t mac[6];
+  WiFi.macAddress(mac);
+  char name[32];
+  snprintf(name, sizeof(name), MDNS_NAME "-%02x%02x%02x", mac[3], mac[4], mac[5]);
+  if (!MDNS.begin(name)) {
+    Serial.println("mDNS responder failed to start");
+    return;
+  }
+  MDNS.addService("http", "tcp", 80);
+  MDNS.addService(MDNS_SERVICE, "tcp", 80);
+  MDNS.addServiceTxt(MDNS_SERVICE, "tcp", "version", FIRMWARE_VERSION);
+  MDNS.addServiceTxt(MDNS_SERVICE, "tcp", "caps", "/capabilities");
+  char port[8];
+  snprintf(port, sizeof(port), "%d", CONTROL_PORT);
+  MDNS.addServiceTxt(MDNS_SERVICE, "tcp", "control", port);
+  mdnsStarted = true;
+  Serial.printf("mDNS: %s.local\n", name);
+}
+
+// Called from loop(), never waits on the driver
+void pollWifi() {
+  bool up = WiFi.status() == WL_CONNECTED;
+  unsigned long now = millis();
+  if (wifiState == WIFI_JOINED) {
+    if (!up) {
+      Serial.println("WiFi lost, rejoining");
+      wifiDrops++;
+      wifiDropTime = now;
+      startWifiJoin();
+    }
+    return;
+  }
+  if (up) {
+    Serial.printf("WiFi joined %lu ms after %s%s\n", now - (wifiDropTime ? wifiDropTime : wifiAttemptStart),
+                  wifiDropTime ? "the drop" : "the first attempt",
+                  wifiState == WIFI_JOIN_DIRECT ? ", cached channel and BSSID" : ", scanned");
+    wifiState = WIFI_JOINED;
+    wifiDropTime = 0;
+    cacheWifiLink();
+    if (!mdnsStarted)
+      startMdns();
+  } else if (wifiState == WIFI_JOIN_DIRECT && now - wifiAttemptStart > WIFI_FAST_JOIN_MS) {
+    joinWifiScan(); // the access point moved or is gone
+    wifiState = WIFI_JOIN_SCAN;
+    wifiAttemptStart = now;
+  } else if (wifiState == WIFI_JOIN_SCAN && now - wifiAttemptStart > WIFI_RETRY_MS) {
+    startWifiJoin();
+  }
+}
+
+static uint32_t sdClockHz = 0;   // clock the card is mounted with, 0 while it isn't
+static bool sdClockTuned = false; // found by tuneSdClock() on this boot rather than read from prefs
+
+static bool beginSd(uint32_t hz) {
+  if (SD.begin(SD_CS_PIN, sdSpi, hz))
+    return true;
+  SD.end(); // lets the next attempt start from scratch
+  return false;
+}
+
+// CRC of the boot sector and three sectors spread over the card, false if a read fails
+static bool readSdVerifySectors(uint32_t &crc) {
+  static uint8_t sector[SD_SECTOR_SIZE] __attribute__((aligned(4)));
+  uint32_t count = SD.numSectors();
+  const uint32_t spread[] = { 0, count / 4, count / 2, count / 4 * 3 };
+  crc = 0;
+  for (uint32_t at : spread) {
+    if (!SD.readRAW(sector, at))
+      return false;
+    crc = esp_rom_crc32_le(crc, sector, sizeof(sector));
+  }
+  return true;
+}
+
+// Fastest of SD_SPI_FREQUENCIES at which the verify sectors read back SD_TUNE_PASSES times as
+// they do at SD_SPI_SAFE_FREQUENCY, the card stays mounted with it; 0 if none does
+static uint32_t tuneSdClock() {
+  static const uint32_t clocks[] = { SD_SPI_FREQUENCIES };
+  uint32_t reference, crc;
+  if (!beginSd(SD_SPI_SAFE_FREQUENCY))
+    return 0;
+  bool ok = readSdVerifySectors(reference);
+  SD.end();
+  if (!ok)
+    return 0;
+  for (uint32_t hz : clocks) {
+    if (!beginSd(hz))
+      continue;
+    int pass = 0;
+    while (pass < SD_TUNE_PASSES && readSdVerifySectors(crc) && crc == reference)
+      pass++;
+    if (pass == SD_TUNE_PASSES)
+      return hz;
+    SD.end();
+  }
+  return beginSd(SD_SPI_SAFE_FREQUENCY) ? SD_SPI_SAFE_FREQUENCY : 0;
+}
+
+// Mount the card and rebuild the catalog; false while it is missing. The clock is tuned at the
+// first mount and kept in prefs; a card that no longer mounts with it is tuned again
+// Mount the card at the clock stored in prefs, or with `tune` at the one tuneSdClock() finds
+static bool mountSdCard(bool tune) {
+#ifdef SD_SPI_SCK
+  sdSpi.begin(SD_SPI_SCK, SD_SPI_MISO, SD_SPI_MOSI, SD_CS_PIN);
+#endif
+  uint32_t hz = prefs.getUInt("sdClock", 0);
+  uint32_t crc;
+  if (hz && !(beginSd(hz) && readSdVerifySectors(crc))) {
+    SD.end();
+    hz = 0;
+  }
+  if (!hz && !tune)
+    return false;
+  sdClockTuned = !hz;
+  if (!hz && (hz = tuneSdClock()) != 0)
+    prefs.putUInt("sdClock", hz);
+  if (!hz) {
+    Serial.println("SD initialization failed, retrying");
+    return false;
+  }
+  sdClockHz = hz;
+  Serial.printf("SD initialized at %lu MHz%s.\n", (unsigned long)(hz / 1000000), sdClockTuned ? " (tuned)" : "");
+  return true;
+}
+
+// The card may already be mounted by setup(), during the panel's waits
+static bool mountStorage() {
+  if (!sdClockHz) {
+    if (bootSdAttempt && millis() - bootSdAttempt < BOOT_SD_RETRY_MS)
+      return false;
+    bootSdAttempt = millis();
+    if (!mountSdCard(true))
+      return false;
+  }
   if (!SD.exists("/gif")) {
-    Serial.println("DEBUG: Creating /gif directory...");
+    Serial.println("Creating /gif directory...");
     SD.mkdir("/gif");
   }
-  
-  WiFi.mode(WIFI_STA);
-  
-  // TODO: Load credentials securely (e.g., from SPIFFS, EEPROM, or WiFiManager)
-  const char* ssid = "YOUR_WIFI_SSID"; // Replace with your SSID
-  const char* password = "YOUR_WIFI_PASSWORD"; // Replace with your Password
-  
-  // Update WiFi status to "connecting" (yellow)
-  tft.fillScreen(TFT_BLACK);
-  tft.setTextColor(TFT_GREEN, TFT_BLACK);
-  tft.drawString("SD: initialized", tft.width()/2, centerY - 30);
-  tft.setTextColor(TFT_YELLOW, TFT_BLACK);
-  tft.drawString("WiFi: connecting", tft.width()/2, centerY - 10);
-  
-  Serial.print("Connecting to WiFi");
-  WiFi.begin(ssid, password);
-  
-  unsigned long wifiTimeout = millis();
-  while (WiFi.status() != WL_CONNECTED && (millis() - wifiTimeout) < 15000) {
-    delay(500);
-    Serial.print(".");
-  }
-  
-  if (WiFi.status() == WL_CONNECTED) {
-    tft.setTextColor(TFT_GREEN, TFT_BLACK);
-    tft.drawString("SD: initialized", tft.width()/2, centerY - 30);
-    tft.drawString("WiFi: connected", tft.width()/2, centerY - 10);
-    String ip = WiFi.localIP().toString();
-    // Center status info vertically and horizontally
-    int centerY = tft.height()/2;  // Vertical center of display
-    tft.drawString("IP: " + ip, tft.width()/2, centerY + 10);
-    tft.drawString("API: Ready", tft.width()/2, centerY + 30);
-    Serial.println(" Connected!");
-    Serial.print("IP Address: ");
-    Serial.println(ip);
+  storageReady = true;
+  loadAssetPack();
+  buildCatalog(); // adds the pack and the card's files to the built-in and flash ones
+  return true;
+}
+
+// Start the servers once WiFi is up, or without it after BOOT_WIFI_TIMEOUT like before
+static bool startNetwork() {
+  bool connected = WiFi.status() == WL_CONNECTED;
+  if (!connected && millis() - bootWifiStart < BOOT_WIFI_TIMEOUT)
+    return false;
+  if (connected) {
+    Serial.println("WiFi connected, IP address: " + WiFi.localIP().toString());
+    esp_ota_mark_app_valid_cancel_rollback(); // an image from /ota that gets this far is kept
   } else {
-    tft.setTextColor(TFT_GREEN, TFT_BLACK);
-    tft.drawString("SD: initialized", tft.width()/2, centerY - 30);
-    tft.setTextColor(TFT_RED, TFT_BLACK);
-    tft.drawString("WiFi: failed", tft.width()/2, centerY - 10);
     Serial.println("WiFi connection failed!");
   }
+  server.begin();
+  startSync(prefs.getUChar("syncRole", SYNC_OFF));
+  startControl();
+  startStream();
+  audioUdp.begin(AUDIO_PORT);
+  Serial.println("HTTP server started");
+  return true;
+}
 
-  delay(2000); // Show status for 2 seconds
+static void logBootComplete() {
+  if (storageReady && networkReady)
+    Serial.printf("Boot complete after %lu ms\n", millis());
+}
 
-  server.on("/", []() {
-    int currentRotation = prefs.getInt("rotation", 0);
-    String gifListHtml = "<div class='row'>";
-    File root = SD.open("/gif");
-    if (root && root.isDirectory()) {
-      Serial.println("DEBUG: Successfully opened /gif directory for scanning.");
-      File file = root.openNextFile();
-      while (file) {
-        if (!file.isDirectory()) {
-          String fname = file.name();
-          if (fname.charAt(0) == '.' || fname.indexOf("_preview") != -1) {
-            file = root.openNextFile();
-            continue;
-          }
-          if (fname.endsWith(".gif") || fname.endsWith(".GIF") || 
-              fname.endsWith(".jpg") || fname.endsWith(".JPG") ||
-              fname.endsWith(".jpeg") || fname.endsWith(".JPEG")) {
-            gifListHtml += "<div class='col-sm-6 col-md-4 col-lg-3 mb-3'>";
-            gifListHtml += "<div class='card'>";
-            gifListHtml += "<div class='preview-container' style='background-color: #000; padding: 10px; display: flex; justify-content: center; align-items: center;'>";
-            String baseName = fname.substring(0, fname.lastIndexOf('.'));
-            if (baseName.endsWith("_o")) {
-              baseName = baseName.substring(0, baseName.length() - 2);
-            }
-            String ext = fname.substring(fname.lastIndexOf('.'));
-            String previewName = baseName + "_preview" + ext;
-            String srcURL;
-            if(SD.exists((String("/gif/") + previewName).c_str())) {
-              srcURL = "/gif/" + previewName;
-            } else {
-              srcURL = "/gif/" + fname;
-            }
-            gifListHtml += "<img src='" + srcURL + "' class='card-img-top' alt='" + fname + "' style='cursor:pointer; border-radius:120px;' onclick=\"sendCommand('/playgif?name=" + fname + "')\">";
-            gifListHtml += "</div><div class='card-body p-2'>";
-            gifListHtml += "<p class='card-text text-center' style='font-size:0.8rem;'>" + fname + "</p>";
-            gifListHtml += "<button class='btn btn-danger btn-sm' onclick=\"if(confirm('Are you sure you want to delete " + fname + "?')) { sendCommand('/delete?name=" + fname + "'); window.location.reload(); }\">Delete</button>";
-            gifListHtml += "</div>";
-            gifListHtml += "</div></div>";
-          }
-        }
-        file = root.openNextFile();
+// Web server task on loop()'s core. HTTP handlers, the media catalog, previews and the screen
+// stream live here, so a slow page, upload or listing never holds up the sync beacons and the
+// control channel in loop(), and the player on the other core is fed through displayQueue
+// either way. Handlers only share syncUdp (syncLock) and the cache lists (cacheLock)
+static void webTask(void *param) {
+  for (;;) {
+    if (!storageReady && mountStorage())
+      logBootComplete();
+    if (networkReady) {
+      server.handleClient();
+      if (traceHttpStart) {
+        traceSpan(TRACE_HTTP, traceHttpStart, traceHttpName, traceHttpMethod);
+        traceHttpStart = 0;
       }
-      gifListHtml += "</div>";
-      root.close();
-    } else {
-      Serial.println("DEBUG: Failed to open /gif directory.");
-    }
-    String html = "<!DOCTYPE html><html><head><meta charset='UTF-8'><title>TFT_eSPI Image Player API</title>";
-    html += "<link rel='stylesheet' href='https://stackpath.bootstrapcdn.com/bootstrap/4.5.2/css/bootstrap.min.css'>";
-    html += "<style>body { background-color: #f8f9fa; } .header { margin: 20px 0; } .card-img-top { background-color: black; width: 240px; height: 240px; object-fit: cover; display: block; margin: 0 auto; }</style>";
-    html += "</head><body><div class='container'>";
-    if (server.hasArg("upload") && server.arg("upload") == "success") {
-      html += "<div class='alert alert-success mt-3' role='alert'>Upload successful</div>";
+      heapRequestDone();
+      serviceScreenStream();
+      serviceEvents();
     }
-    html += "<div class='mb-5'><h2>Image Previews</h2>" + gifListHtml + "</div>";
-    html += "<div class='mb-5'><h2>Display Rotation</h2>";
-    html += "<div class='btn-group' role='group'>";
-    for(int i = 0; i < 4; i++) {
-      html += "<button class='btn btn-" + String(i == currentRotation ? "primary" : "secondary") + "' onclick='updateRotation(" + String(i) + ")'>" + String(i * 90) + "°</button>";
+    pollHeapMonitor();
+    serviceSoak(); // keeps going while WiFi is down, that is part of what it measures
+    if (assetPackInstalled) {
+      assetPackInstalled = false;
+      buildCatalog();
     }
-    html += "</div>";
-    html += "</div>";
-    
-    html += "<div class='mb-5'>";
-    html += "<h2>Commands</h2>";
-    html += "<div class='btn-group' role='group'>";
-    html += "<button class='btn btn-primary' onclick=\"sendCommand('/open')\">Open</button>";
-    html += "<button class='btn btn-primary' onclick=\"sendCommand('/close')\">Close</button>";
-    html += "<button class='btn btn-primary' onclick=\"sendCommand('/blink')\">Blink</button>";
-    html += "<button class='btn btn-primary' onclick=\"sendCommand('/colorful')\">Colorful</button>";
-    html += "</div></div>";
-    
-    html += "<div class='mb-5'><h2>Upload Image</h2>";
-    html += "<form method='POST' action='/upload' enctype='multipart/form-data'>";
-    html += "<div class='form-group'>";
-    html += "<label for='file'>Select GIF or JPG file:</label>";
-    html += "<input type='file' name='file' accept='.gif,.jpg,.jpeg,.GIF,.JPG,.JPEG' class='form-control-file' id='file'>";
-    html += "</div>";
-    html += "<button type='submit' class='btn btn-primary'>Upload</button>";
-    html += "</form></div>";
-    html += "<script>function sendCommand(cmd){fetch(cmd).then(response=>response.text()).then(text=>console.log(text));}</script>";
-    html += "<script>";
-    html += "function updateRotation(val){";
-    html += "fetch('/rotate?value='+val).then(response=>response.text()).then(text=>console.log(text));";
-    html += "}";
-    html += "</script>";
-    html += "</div></body></html>";
-    server.send(200, "text/html", html);
+    runPreviewJobs();
+    vTaskDelay(pollDelay());
+  }
+}
+
+// Give the player's decoders their turns on gifWorkspace, before anything opens a GIF
+static void setupGifWorkspace()
+{
+  gif.setWorkspace(gifWorkspace, sizeof(gifWorkspace), gifPalettes);
+#ifdef USE_GIF_LAYER
+  layerGif.setWorkspace(gifWorkspace, sizeof(gifWorkspace), layerGifPalettes);
+#endif
+}
+
+// The panel's reset and sleep-out waits (about 300 ms of the GC9A01 init) are spent on boot work
+// that doesn't draw: preferences, starting the WiFi association and mounting the card
+static uint32_t panelStepAt = 0; // millis() the next step of TFT_eSPI::initStep() is due
+static bool panelInitDone = false;
+
+// Run the steps of the panel init that are due; with `finish`, wait for the rest
+static void stepPanelInit(bool finish) {
+  while (!panelInitDone && (finish || (int32_t)(millis() - panelStepAt) >= 0)) {
+    int32_t wait = (int32_t)(panelStepAt - millis());
+    if (wait > 0)
+      delay(wait);
+    uint32_t ms = tft.initStep();
+    panelInitDone = ms == 0;
+    panelStepAt = millis() + ms;
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+  pinMode(SD_CS_PIN, OUTPUT);
+  digitalWrite(SD_CS_PIN, HIGH); // the card stays off the shared bus while the panel is set up
+  stepPanelInit(false);          // bus and reset pulse
+  reserveMemoryPlan();
+  setupGifWorkspace();
+  prefs.begin("display", false);
+  stepPanelInit(false);
+  WiFi.mode(WIFI_STA);
+  WiFi.setAutoReconnect(false); // pollWifi() rejoins, on the cached channel first
+  startWifiJoin();              // the association goes on in the driver from here
+  bootWifiStart = millis();
+  Serial.println("Connecting to WiFi");
+  stepPanelInit(false);
+  mountSdCard(false); // at the stored clock, in the sleep-out wait; tuning one is left to the web task
+  stepPanelInit(true);
+  Serial.printf("Panel ready after %lu ms\n", millis());
+  tft.setViewportCircle(true); // GC9A01 is round, the corners are never sent
+  EyePanel::attach(tft);       // and the circle's row spans come from the table
+#ifdef USE_SCREEN_SHADOW
+  if (!tft.getShadowBuffer() && !tft.setShadowBuffer(true))
+    Serial.println("No PSRAM for the screen shadow, /screen only works while the eye is shown");
+#endif
+#ifdef USE_BACKLIGHT_PWM
+  backlightLevel = std::min<uint8_t>(prefs.getUChar("backlight", 100), 100);
+  backlightIdleLevel = std::min<uint8_t>(prefs.getUChar("blIdle", BACKLIGHT_IDLE_LEVEL), 100);
+  initBacklight();
+#endif
+  initSpiClock();
+  initCanvas();
+  initSpritePool();
+  initTextLayer();
+#ifdef USE_DMA
+  tft.initDMA();
+#endif
+#ifdef USE_LVGL
+  initLvgl();
+#endif
+  displayQueue = xQueueCreate(DISPLAY_QUEUE_LENGTH, sizeof(DisplayCommand));
+  eventQueue = xQueueCreate(EVENTS_QUEUE_LENGTH, sizeof(PlaybackEvent));
+  cacheLock = xSemaphoreCreateMutex();
+  syncLock = xSemaphoreCreateRecursiveMutex();
+  playlistLock = xSemaphoreCreateMutex();
+  batchLock = xSemaphoreCreateMutex();
+  benchDone = xSemaphoreCreateBinary();
+#ifdef USE_TRACE
+  traceBuf = (TraceEvent *)ps_malloc(TRACE_EVENTS * sizeof(TraceEvent));
+  traceOn = traceBuf != NULL;
+#endif
+#ifdef USE_PROFILER
+  profileBuf = (ProfileSample *)ps_malloc(PROFILE_SAMPLES * sizeof(ProfileSample));
+#endif
+#ifdef USE_IDLE_GOVERNOR
+  initIdleGovernor();
+#endif
+#ifdef USE_HEAP_MONITOR
+  resetHeapMonitor();
+  heap_caps_register_failed_alloc_callback(heapAllocFailed);
+  heapMonitorOn = true;
+#endif
+  initFlashGifs(); // flashGifs is read by both tasks from here on
+  int rotation = prefs.getInt("rotation", 0);  // 0-3 for quarter turns
+  eyeSide = std::min<uint8_t>(prefs.getUChar("side", SIDE_NONE), SIDE_RIGHT);
+  applyOrientation(rotation, sideMirror(prefs.getBool("mirror", false)));
+  frameCacheBudget = prefs.getUInt("cacheBudget", FRAME_CACHE_BUDGET);
+  gifRamThreshold = prefs.getInt("ramThreshold", GIF_RAM_THRESHOLD);
+  autoTranscode = prefs.getBool("transcode", false);
+  setPlaylist(prefs.getString("playlist", ""), prefs.getBool("plShuffle", false));
+  transitionType = std::min<uint8_t>(prefs.getUChar("transition", TRANSITION_NONE), TRANSITION_LID);
+  transitionMs = prefs.getUShort("transitionMs", TRANSITION_MS);
+  if (prefs.getBytesLength("color") == sizeof(colorSetting))
+    prefs.getBytes("color", &colorSetting, sizeof(colorSetting));
+  colorEffect = colorSetting;
+  colorEffectPending = colorEffectActive(colorEffect);
+  if (prefs.getBytesLength("fx") == sizeof(fxSetting))
+    prefs.getBytes("fx", &fxSetting, sizeof(fxSetting));
+  fxEffect = fxSetting;
+  setStripKernel();
+  audioMode = std::min<uint8_t>(prefs.getUChar("audioMode", AUDIO_PUPIL), AUDIO_BOTH);
+  audioMin = std::min<uint8_t>(prefs.getUChar("audioMin", 20), 100);
+  audioMax = std::min<uint8_t>(prefs.getUChar("audioMax", 70), 100);
+
+  // From here on only the player task touches the display; it opens the eye from PSRAM
+  // right away, while the web task brings up the card and loop() the network
+#ifdef USE_FRAME_RING
+  ringStart = xSemaphoreCreateBinary();
+  ringDone = xSemaphoreCreateBinary();
+  xTaskCreatePinnedToCore(decoderTaskLoop, "decoder", DECODER_STACK_SIZE, NULL, 1, &decoderTask, 1 - PLAYER_CORE);
+#endif
+  xTaskCreatePinnedToCore(playerTask, "player", PLAYER_STACK_SIZE, NULL, 1, NULL, PLAYER_CORE);
+  queueDisplayCommand(CMD_OPEN, "", 0);
+  if (prefs.getBool("plRun", false))
+    queueDisplayCommand(CMD_PLAYLIST, "", 1); // items on the card are skipped until it is mounted
+  Serial.printf("SPI write clock %lu Hz%s\n", (unsigned long)tft.getWriteFrequency(),
+                spiTunedHz ? "" : " (not tuned, the panel does not read back)");
+
+  flashStoreReady = LittleFS.begin(true); // formats the partition on first use
+  if (flashStoreReady && !LittleFS.exists("/gif"))
+    LittleFS.mkdir("/gif");
+  buildCatalog(); // built-in and flash media are playable before the card is mounted
+
+  server.addHandler(new RequestProbe()); // ahead of every route
+  server.on("/", []() {
+#ifdef HAVE_WEB_UI
+    server.sendHeader("ETag", WEB_UI_ETAG);
+    server.sendHeader("Cache-Control", "public, max-age=" + String(WEB_UI_MAX_AGE));
+    if (server.header("If-None-Match") == WEB_UI_ETAG) {
+      server.send(304);
+      return;
+    }
+    server.sendHeader("Content-Encoding", "gzip");
+    server.send_P(200, "text/html", (const char *)webUiGz, sizeof(webUiGz));
+#else
+    server.sendText(503, "The control page is not built in, run make web_ui.h and rebuild");
+#endif
   });
   server.on("/open", []() {
-    cancelPlayback = true;
-    tft.fillScreen(TFT_BLACK);
-    tft.fillCircle(tft.width()/2, tft.height()/2, 50, TFT_WHITE);
-    tft.fillCircle(tft.width()/2, tft.height()/2, 30, TFT_BLUE);
-    tft.fillCircle(tft.width()/2, tft.height()/2, 10, TFT_BLACK);
-    server.send(200, "text/plain", "Executed command: open");
+    if (!queueDisplayCommand(CMD_OPEN, "", 0)) {
+      server.sendText(503, "Display busy");
+      return;
+    }
+    server.sendText(200, "Executed command: open");
   });
   server.on("/close", []() {
-    cancelPlayback = true;
-    tft.fillScreen(TFT_BLACK);
-    tft.drawLine(tft.width()/2 - 50, tft.height()/2, tft.width()/2 + 50, tft.height()/2, TFT_WHITE);
-    tft.drawLine(tft.width()/2 - 50, tft.height()/2 + 1, tft.width()/2 + 50, tft.height()/2 + 1, TFT_WHITE);
-    server.send(200, "text/plain", "Executed command: close");
+    if (!queueDisplayCommand(CMD_CLOSE, "", 0)) {
+      server.sendText(503, "Display busy");
+      return;
+    }
+    server.sendText(200, "Executed command: close");
   });
   server.on("/blink", []() {
-    cancelPlayback = true;
-    tft.fillScreen(TFT_BLACK);
-    tft.drawLine(tft.width()/2 - 50, tft.height()/2, tft.width()/2 + 50, tft.height()/2, TFT_WHITE);
-    delay(200);
-    tft.fillScreen(TFT_BLACK);
-    tft.fillCircle(tft.width()/2, tft.height()/2, 50, TFT_WHITE);
-    tft.fillCircle(tft.width()/2, tft.height()/2, 30, TFT_BLUE);
-    tft.fillCircle(tft.width()/2, tft.height()/2, 10, TFT_BLACK);
-    server.send(200, "text/plain", "Executed command: blink");
+    if (!queueDisplayCommand(CMD_BLINK, "", 0)) {
+      server.sendText(503, "Display busy");
+      return;
+    }
+    server.sendText(200, "Executed command: blink");
   });
   server.on("/colorful", []() {
-    cancelPlayback = true;
-    unsigned long time = millis();
-    for (int yPos = 0; yPos < tft.height(); yPos += 10) {
-      for (int xPos = 0; xPos < tft.width(); xPos += 10) {
-        float wave = sin((xPos + time / 10.0) * 0.05) + cos((yPos + time / 10.0) * 0.05);
-        uint16_t color = tft.color565(
-          (int)((sin(wave + time / 1000.0) + 1) * 127.5),
-          (int)((cos(wave + time / 1000.0) + 1) * 127.5),
-          (int)(((sin(wave) + cos(wave)) / 2 + 1) * 127.5)
-        );
-        tft.fillRect(xPos, yPos + (int)(10 * sin((xPos + time / 100.0) * 0.1)), 10, 10, color);
-      }
+    if (!queueDisplayCommand(CMD_COLORFUL, "", 0)) {
+      server.sendText(503, "Display busy");
+      return;
     }
-    server.send(200, "text/plain", "Executed command: colorful");
+    server.sendText(200, "Executed command: colorful");
   });
 
   server.on("/gifs", []() {
-    String json = getGifInventoryApi("/gif");
-    server.send(200, "application/json", json);
+    sendGifInventoryApi(server.hasArg("details"));
   });
   server.on("/playgif", []() {
-    cancelPlayback = true;
-    if (server.hasArg("name")) {
-      String imageName = server.arg("name");
-      String fullPath = "/gif/" + imageName;
-      
-      // Use the unified image display function
-      if (displayImage(fullPath.c_str())) {
-        server.send(200, "text/plain", "Displaying image: " + imageName);
-      } else {
-        server.send(500, "text/plain", "Error displaying image: " + imageName);
+    const char *imageName = server.argValue("name");
+    if (!imageName) {
+      server.sendText(400, "Missing image name");
+      return;
+    }
+    char fullPath[sizeof(DisplayCommand::name)];
+    if ((size_t)snprintf(fullPath, sizeof(fullPath), "/gif/%s", imageName) >= sizeof(fullPath)) {
+      server.sendText(400, "Image name too long");
+      return;
+    }
+    if (!findMedia(imageName)) {
+      server.sendTextf(404, "Image not found: %s", imageName);
+      return;
+    }
+    float rate = 1.0;
+    if (const char *rateArg = server.argValue("rate")) {
+      rate = atof(rateArg);
+      if (rate < 0.1 || rate > 10.0) {
+        server.sendText(400, "Invalid rate, use 0.1 to 10");
+        return;
       }
-    } else {
-      server.send(400, "text/plain", "Missing image name");
     }
+    // Returns right away; the player task preempts the current animation within a frame
+    bool queued;
+    if (server.argValue("sync") && syncRole == SYNC_LEADER)
+      queued = startSyncedPlay(fullPath, (int)(rate * 1000));
+    else
+      queued = queueDisplayCommand(CMD_PLAY, fullPath, (int)(rate * 1000));
+    if (queued)
+      server.sendTextf(200, "Displaying image: %s", imageName);
+    else
+      server.sendTextf(503, "Display busy, try again: %s", imageName);
   });
   server.on("/upload", HTTP_GET, []() {
     String html = "<!DOCTYPE html><html><head><meta charset='UTF-8'><title>Upload Image</title>";
@@ -697,51 +10742,853 @@ void setup() {
     server.send(200, "text/html", html);
   });
   server.on("/upload", HTTP_POST, []() {
-    if(uploadTooLarge) {
-      server.send(400, "text/plain", "Upload refused: file too large");
-      uploadTooLarge = false; // reset for the next upload
+    finishUpload(true);
+  }, handleFileUpload);
+  server.on("/upload", HTTP_PUT, []() {
+    if (!isUploadName(server.arg("name"))) {
+      server.send(400, "text/plain", "Invalid file name");
+      uploadFailed = false;
       return;
     }
-    server.sendHeader("Location", "/?upload=success");
-    server.send(302, "text/plain", "");
-  }, handleFileUpload);
+    finishUpload(false);
+  }, handleRawUpload);
+  server.on("/manifest", sendManifest);
+  server.on("/ota", HTTP_PUT, finishOta, handleOtaUpload);
+  server.on(UriBraces("/asset/{}"), HTTP_GET, sendAssetStatus);
+  server.on(UriBraces("/asset/{}"), HTTP_PUT, finishAssetChunk, handleAssetChunk);
   server.on("/delete", []() {
-    if (server.hasArg("name")) {
-      String gifName = server.arg("name");
-      String fullPath = "/gif/" + gifName;
-      if (SD.exists(fullPath.c_str())) {
-        SD.remove(fullPath.c_str());
-        server.send(200, "text/plain", "Deleted gif: " + gifName);
-      } else {
-        server.send(404, "text/plain", "Gif not found: " + gifName);
-      }
+    const char *gifName = server.argValue("name");
+    if (!gifName) {
+      server.sendText(400, "Missing gif name");
+      return;
+    }
+    char fullPath[sizeof(DisplayCommand::name)];
+    const MediaEntry *entry = findMedia(gifName);
+    if (entry && entry->store == STORE_BUILTIN) {
+      server.sendTextf(400, "Built-in gif can't be deleted: %s", gifName);
+    } else if (entry && entry->store == STORE_PACK) {
+      server.sendTextf(400, "Packed gif is replaced with the next asset pack: %s", gifName);
+    } else if (entry && (size_t)snprintf(fullPath, sizeof(fullPath), "/gif/%s", gifName) < sizeof(fullPath)) {
+      queueDisplayCommand(CMD_DROP_CACHE, fullPath, 0);
+      mediaFs(fullPath).remove(fullPath);
+      catalogRemove(gifName);
+      server.sendTextf(200, "Deleted gif: %s", gifName);
     } else {
-      server.send(400, "text/plain", "Missing gif name");
+      server.sendTextf(404, "Gif not found: %s", gifName);
     }
   });
+  server.on("/pack", HTTP_GET, []() {
+    sendPackStatus(200);
+  });
+  server.on("/pack", HTTP_POST, finishPackRange, handlePackUpload);
   server.on("/rotate", []() {
-    if (server.hasArg("value")) {
-      int rotation = server.arg("value").toInt();
+    if (server.hasArg("side")) {
+      int side = parseSide(server.arg("side"));
+      if (side < 0) {
+        server.send(400, "text/plain", "side must be left, right or none");
+        return;
+      }
+      eyeSide = side;
+      prefs.putUChar("side", eyeSide);
+    }
+    if (server.hasArg("value") || server.hasArg("mirror") || server.hasArg("side")) {
+      int rotation = server.hasArg("value") ? server.arg("value").toInt() : prefs.getInt("rotation", 0);
       if (rotation < 0) rotation = 0;
       if (rotation > 3) rotation = 3;
+      bool mirror = server.hasArg("mirror") ? server.arg("mirror").toInt() != 0 : prefs.getBool("mirror", false);
       prefs.putInt("rotation", rotation);
-      tft.setRotation(rotation);
-      server.send(200, "text/plain", "Rotation updated to " + String(rotation * 90) + "°");
+      prefs.putBool("mirror", mirror);
+      mirror = sideMirror(mirror);
+      queueDisplayCommand(CMD_ROTATE, "", rotation | (mirror ? 4 : 0));
+      server.send(200, "text/plain", "Rotation updated to " + String(rotation * 90) + "°" + (mirror ? ", mirrored" : "") +
+                  (eyeSide != SIDE_NONE ? String(", ") + sideNames[eyeSide] + " eye" : String()));
     } else {
       server.send(400, "text/plain", "Missing rotation value");
     }
   });
 
-  server.serveStatic("/gif", SD, "/gif");
-  server.begin();
-  Serial.println("HTTP server started");
-  delay(2000);
+  server.on("/eye", []() {
+    DisplayCommand cmd;
+    cmd.value = 0;
+    for (int i = 0; i < server.args(); i++) {
+      const char *error = setEyeParam(cmd, server.argNameAt(i), server.argValueAt(i));
+      if (error) {
+        server.sendTextf(400, "%s: %s", error, server.argNameAt(i));
+        return;
+      }
+    }
+    if (!queueEye(cmd)) {
+      server.sendText(503, "Display busy");
+      return;
+    }
+    server.sendText(200, "Eye updated");
+  });
+
+  server.on("/look", []() {
+    if (!lookCanvas.created()) {
+      server.sendText(501, "No look canvas (USE_LOOK_CANVAS, PSRAM)");
+      return;
+    }
+    const char *x = server.argValue("x"), *y = server.argValue("y");
+    if (!queueLook(x ? atoi(x) : 0, y ? atoi(y) : 0)) {
+      server.sendText(503, "Display busy");
+      return;
+    }
+    server.sendText(200, "Looking");
+  });
+
+  server.on("/atlas", []() {
+#ifdef USE_SPRITE_ATLAS
+    const char *name = server.argValue("name");
+    if (name) {
+      const char *cols = server.argValue("cols"), *rows = server.argValue("rows");
+      if (!findMedia(name) || strlen(name) + 5 >= sizeof(DisplayCommand::name)) {
+        server.sendTextf(404, "Gif not found: %s", name);
+        return;
+      }
+      if (!queueAtlasLoad(name, cols ? atoi(cols) : 1, rows ? atoi(rows) : 1)) {
+        server.sendText(503, "Display busy");
+        return;
+      }
+      server.sendText(200, "Loading atlas");
+      return;
+    }
+    if (!atlasSheet) {
+      server.sendText(409, "No atlas loaded, use name, cols and rows");
+      return;
+    }
+    const char *tile = server.argValue("tile"), *x = server.argValue("x"), *y = server.argValue("y");
+    if (tile && (atoi(tile) < 0 || atoi(tile) >= atlasCols * atlasRows)) {
+      server.sendTextf(400, "Invalid tile, use 0 to %d", atlasCols * atlasRows - 1);
+      return;
+    }
+    if (!queueAtlasTile(tile ? atoi(tile) : -1, x ? atoi(x) : 0, y ? atoi(y) : 0)) {
+      server.sendText(503, "Display busy");
+      return;
+    }
+    server.sendText(200, "Atlas tile shown");
+#else
+    server.sendText(501, "No sprite atlas (USE_SPRITE_ATLAS)");
+#endif
+  });
+
+  server.on("/color", []() {
+    ColorEffect e = server.hasArg("reset") ? colorEffectNone : colorSetting;
+    if (server.hasArg("hue")) {
+      int hue = server.arg("hue").toInt();
+      if (hue < -180 || hue > 180) {
+        server.send(400, "text/plain", "Invalid hue, use -180 to 180");
+        return;
+      }
+      e.hue = hue;
+    }
+    if (server.hasArg("brightness")) {
+      int brightness = server.arg("brightness").toInt();
+      if (brightness < 0 || brightness > 200) {
+        server.send(400, "text/plain", "Invalid brightness, use 0-200");
+        return;
+      }
+      e.brightness = brightness;
+    }
+    if (server.hasArg("tint")) {
+      String hex = server.arg("tint");
+      long v = strtol(hex.c_str() + (hex[0] == '#'), NULL, 16);
+      e.tint = tft.color565((v >> 16) & 0xFF, (v >> 8) & 0xFF, v & 0xFF);
+    }
+    if (server.hasArg("amount")) {
+      int amount = server.arg("amount").toInt();
+      if (amount < 0 || amount > 100) {
+        server.send(400, "text/plain", "Invalid amount, use 0-100");
+        return;
+      }
+      e.tintAmount = amount;
+    }
+    if (server.hasArg("gamma")) {
+      float gamma = server.arg("gamma").toFloat();
+      if (gamma < 0.2f || gamma > 5.0f) {
+        server.send(400, "text/plain", "Invalid gamma, use 0.2-5.0");
+        return;
+      }
+      e.gamma = (uint16_t)lroundf(gamma * 100);
+    }
+    if (memcmp(&e, &colorSetting, sizeof(e)) != 0) {
+      if (!queueColorEffect(e)) {
+        server.send(503, "text/plain", "Display busy");
+        return;
+      }
+      colorSetting = e;
+      prefs.putBytes("color", &e, sizeof(e));
+    }
+    char tint[7];
+    snprintf(tint, sizeof(tint), "%02x%02x%02x", (e.tint >> 8) & 0xF8, (e.tint >> 3) & 0xFC, (e.tint << 3) & 0xF8);
+    server.send(200, "application/json", "{\"hue\":" + String(e.hue) + ",\"brightness\":" + String(e.brightness) +
+                ",\"tint\":\"" + tint + "\",\"amount\":" + String(e.tintAmount) +
+                ",\"gamma\":" + String(e.gamma / 100.0f, 2) + "}");
+  });
+
+  server.on("/fx", []() {
+    FxEffect e = server.hasArg("reset") ? fxEffectNone : fxSetting;
+    static const struct { const char *arg; uint8_t FxEffect::*field; int max; } percents[] = {
+      { "vignette", &FxEffect::vignette, 100 }, { "scanlines", &FxEffect::scanlines, 100 },
+      { "speed", &FxEffect::scanSpeed, 255 }, { "glow", &FxEffect::glow, 100 },
+    };
+    for (const auto &p : percents) {
+      if (!server.hasArg(p.arg))
+        continue;
+      int v = server.arg(p.arg).toInt();
+      if (v < 0 || v > p.max) {
+        server.sendTextf(400, "Invalid %s, use 0-%d", p.arg, p.max);
+        return;
+      }
+      e.*p.field = v;
+    }
+    if (server.hasArg("color")) {
+      String hex = server.arg("color");
+      long v = strtol(hex.c_str() + (hex[0] == '#'), NULL, 16);
+      e.glowColor = tft.color565((v >> 16) & 0xFF, (v >> 8) & 0xFF, v & 0xFF);
+    }
+    if (memcmp(&e, &fxSetting, sizeof(e)) != 0) {
+      if (!queueFxEffect(e)) {
+        server.send(503, "text/plain", "Display busy");
+        return;
+      }
+      fxSetting = e;
+      prefs.putBytes("fx", &e, sizeof(e));
+    }
+    char color[7];
+    snprintf(color, sizeof(color), "%02x%02x%02x", (e.glowColor >> 8) & 0xF8, (e.glowColor >> 3) & 0xFC,
+             (e.glowColor << 3) & 0xF8);
+    server.send(200, "application/json", "{\"vignette\":" + String(e.vignette) + ",\"scanlines\":" +
+                String(e.scanlines) + ",\"speed\":" + String(e.scanSpeed) + ",\"glow\":" + String(e.glow) +
+                ",\"color\":\"" + color + "\"}");
+  });
+
+  server.on("/overlay", []() {
+    DisplayCommand cmd;
+    cmd.type = CMD_OVERLAY;
+    cmd.value = 0;
+    cmd.startAt = 0;
+    cmd.name[0] = '\0';
+    if (server.hasArg("hr")) {
+      cmd.x = server.hasArg("hx") ? server.arg("hx").toInt() : tft.width() / 2;
+      cmd.y = server.hasArg("hy") ? server.arg("hy").toInt() : tft.height() / 2;
+      cmd.dilation = constrain(server.arg("hr").toInt(), 0, OVERLAY_MAX_RADIUS);
+      cmd.value |= OVERLAY_SET_HIGHLIGHT;
+    }
+    if (server.hasArg("lid")) {
+      cmd.lid = constrain(server.arg("lid").toInt(), 0, 100);
+      cmd.value |= OVERLAY_SET_LID;
+    }
+    if (server.hasArg("lidcolor")) {
+      String hex = server.arg("lidcolor");
+      long v = strtol(hex.c_str() + (hex[0] == '#'), NULL, 16);
+      cmd.color = tft.color565((v >> 16) & 0xFF, (v >> 8) & 0xFF, v & 0xFF);
+      cmd.value |= OVERLAY_SET_COLOR;
+    }
+#ifdef USE_GIF_LAYER
+    if (server.hasArg("gif")) { // a command of its own, x and y are the highlight's
+      DisplayCommand layer = cmd;
+      layer.value = OVERLAY_SET_GIF;
+      layer.x = server.hasArg("gx") ? server.arg("gx").toInt() : tft.width() / 2;
+      layer.y = server.hasArg("gy") ? server.arg("gy").toInt() : tft.height() / 2;
+      strlcpy(layer.name, server.arg("gif").c_str(), sizeof(layer.name));
+      if (!sendDisplayCommand(layer, 0)) {
+        server.send(503, "text/plain", "Display busy");
+        return;
+      }
+      if (!cmd.value) {
+        server.send(200, "text/plain", "Overlay updated");
+        return;
+      }
+    }
+#endif
+#ifdef USE_PNG_LAYER
+    if (server.hasArg("png")) { // like gif, decoded once and then only blended
+      DisplayCommand layer = cmd;
+      layer.value = OVERLAY_SET_PNG;
+      layer.x = server.hasArg("px") ? server.arg("px").toInt() : tft.width() / 2;
+      layer.y = server.hasArg("py") ? server.arg("py").toInt() : tft.height() / 2;
+      strlcpy(layer.name, server.arg("png").c_str(), sizeof(layer.name));
+      if (!sendDisplayCommand(layer, 0)) {
+        server.send(503, "text/plain", "Display busy");
+        return;
+      }
+      if (!cmd.value) {
+        server.send(200, "text/plain", "Overlay updated");
+        return;
+      }
+    }
+#endif
+    if (!cmd.value) {
+      server.send(400, "text/plain", "Missing parameter: hr, lid, lidcolor, gif or png");
+      return;
+    }
+    if (!sendDisplayCommand(cmd, 0)) {
+      server.send(503, "text/plain", "Display busy");
+      return;
+    }
+    server.send(200, "text/plain", "Overlay updated");
+  });
+
+  server.on("/shift", []() {
+    const char *rows = server.argValue("y");
+    if (!rows) {
+      server.sendText(400, "Missing parameter: y");
+      return;
+    }
+    int dy = atoi(rows);
+    if (dy < -SHIFT_MAX_ROWS || dy > SHIFT_MAX_ROWS) {
+      server.sendTextf(400, "Invalid shift, use %d to %d rows", -SHIFT_MAX_ROWS, SHIFT_MAX_ROWS);
+      return;
+    }
+    if (tft.getRotation() & 1) {
+      server.sendText(409, "The panel scrolls sideways in landscape, use a portrait rotation");
+      return;
+    }
+    if (!queueShift(dy)) {
+      server.sendText(503, "Display busy");
+      return;
+    }
+    server.sendTextf(200, "Shifted %d rows", dy);
+  });
+
+  server.on("/playlist", handlePlaylist);
+  server.on("/batch", handleBatch);
+
+  server.on("/audio", []() {
+    if (server.hasArg("mode")) {
+      int mode = -1;
+      for (int i = 0; i <= AUDIO_BOTH; i++) {
+        if (server.arg("mode") == audioModeNames[i])
+          mode = i;
+      }
+      if (mode < 0) {
+        server.send(400, "text/plain", "Invalid mode, use off, pupil, glow or both");
+        return;
+      }
+      audioMode = mode;
+      prefs.putUChar("audioMode", mode);
+    }
+    const char *bounds[] = { "min", "max" };
+    volatile uint8_t *values[] = { &audioMin, &audioMax };
+    for (int i = 0; i < 2; i++) {
+      if (!server.hasArg(bounds[i]))
+        continue;
+      int value = server.arg(bounds[i]).toInt();
+      if (value < 0 || value > 100) {
+        server.send(400, "text/plain", "Invalid pupil size, use 0-100");
+        return;
+      }
+      *values[i] = value;
+      prefs.putUChar(i ? "audioMax" : "audioMin", value);
+    }
+    server.send(200, "application/json", "{\"mode\":\"" + String(audioModeNames[audioMode]) + "\",\"min\":" +
+                String(audioMin) + ",\"max\":" + String(audioMax) + ",\"level\":" + String(audioLevel) +
+                ",\"active\":" + String(audioDriving() ? "true" : "false") + "}");
+  });
+
+  server.on("/transition", []() {
+    if (server.hasArg("type")) {
+      int type = -1;
+      for (int i = 0; i <= TRANSITION_LID; i++) {
+        if (server.arg("type") == transitionNames[i])
+          type = i;
+      }
+      if (type < 0) {
+        server.send(400, "text/plain", "Invalid type, use none, fade, iris or lid");
+        return;
+      }
+      transitionType = type;
+      prefs.putUChar("transition", type);
+    }
+    if (server.hasArg("ms")) {
+      int ms = server.arg("ms").toInt();
+      if (ms < TRANSITION_STEP_MS || ms > TRANSITION_MAX_MS) {
+        server.send(400, "text/plain", "Invalid length, use 20-2000 ms");
+        return;
+      }
+      transitionMs = ms;
+      prefs.putUShort("transitionMs", ms);
+    }
+    server.send(200, "application/json", "{\"type\":\"" + String(transitionNames[transitionType]) +
+                "\",\"ms\":" + String(transitionMs) + "}");
+  });
+
+  server.on("/sync", []() {
+    if (server.hasArg("role")) {
+      String role = server.arg("role");
+      int newRole = -1;
+      for (int i = 0; i < 3; i++) {
+        if (role == syncRoleNames[i])
+          newRole = i;
+      }
+      if (newRole < 0) {
+        server.send(400, "text/plain", "Invalid role, use off, leader or follower");
+        return;
+      }
+      prefs.putUChar("syncRole", newRole);
+      startSync(newRole);
+    }
+    String json = "{\"role\":\"" + String(syncRoleNames[syncRole]) + "\"";
+    json += ",\"offset\":" + String((long)syncOffset);
+    json += ",\"beacons\":" + String(syncSampleCount);
+    json += ",\"clock\":" + String((unsigned long)syncMillis()) + "}";
+    server.send(200, "application/json", json);
+  });
+
+  server.on("/transcode", []() {
+    if (server.hasArg("auto")) {
+      autoTranscode = server.arg("auto") == "1";
+      prefs.putBool("transcode", autoTranscode);
+    }
+    if (server.hasArg("name")) {
+      String gifName = server.arg("name");
+      const MediaEntry *entry = findMedia(gifName.c_str());
+      if (!entry) {
+        server.send(404, "text/plain", "Gif not found: " + gifName);
+        return;
+      }
+      if (!isGifName(gifName) || entry->store == STORE_BUILTIN || entry->store == STORE_PACK) {
+        server.send(400, "text/plain", "Only GIFs on the card can be transcoded");
+        return;
+      }
+      String fullPath = "/gif/" + gifName;
+      if (!queueDisplayCommand(CMD_TRANSCODE, fullPath.c_str(), 0)) {
+        server.send(503, "text/plain", "Display busy");
+        return;
+      }
+    }
+    server.send(200, "application/json", "{\"auto\":" + String(autoTranscode ? "true" : "false") + "}");
+  });
+
+  server.on("/spi", []() {
+    if (server.hasArg("retune")) {
+      prefs.remove("spiClock");
+      server.send(200, "text/plain", "Restarting to retune the SPI clock");
+      delay(100);
+      ESP.restart();
+      return;
+    }
+    server.send(200, "application/json", "{\"hz\":" + String((unsigned long)tft.getWriteFrequency()) +
+                ",\"tuned\":" + String(spiTunedHz ? "true" : "false") +
+                ",\"sdHz\":" + String((unsigned long)sdClockHz) +
+#ifdef USE_RGB444
+                ",\"bitsPerPixel\":12" +
+#else
+                ",\"bitsPerPixel\":16" +
+#endif
+#ifdef SD_SPI_SCK
+                ",\"sdShared\":false}");
+#else
+                ",\"sdShared\":true}");
+#endif
+  });
+
+  server.on("/capabilities", sendCapabilities);
+
+  server.on("/screen", handleScreen);
+
+  server.on("/bench", []() {
+    xSemaphoreTake(benchDone, 0); // a result of a run that timed out
+    if (!queueDisplayCommand(CMD_BENCH, "", 0)) {
+      server.send(503, "text/plain", "Display busy");
+      return;
+    }
+    if (xSemaphoreTake(benchDone, pdMS_TO_TICKS(BENCH_TIMEOUT_MS)) != pdTRUE) {
+      server.send(504, "text/plain", "Benchmark did not finish");
+      return;
+    }
+    server.send(200, "application/json", benchResult);
+  });
+
+  server.on("/sdbench", []() {
+    if (server.hasArg("retune")) {
+      prefs.remove("sdClock");
+      server.send(200, "text/plain", "Restarting to retune the SD clock");
+      delay(100);
+      ESP.restart();
+      return;
+    }
+    if (!storageReady) {
+      server.send(503, "text/plain", "No SD card");
+      return;
+    }
+    // The largest file on the card, so the sequential reads run long enough to mean something
+    const MediaEntry *largest = NULL;
+    for (const MediaEntry &entry : catalog)
+      if (entry.store == STORE_SD && (!largest || entry.size > largest->size))
+        largest = &entry;
+    if (!largest || largest->size < SD_BENCH_RANDOM_SIZE) {
+      server.send(404, "text/plain", "No media on the card to read");
+      return;
+    }
+    String path = String("/gif/") + largest->name();
+    xSemaphoreTake(benchDone, 0); // a result of a run that timed out
+    if (!queueDisplayCommand(CMD_SD_BENCH, path.c_str(), 0)) {
+      server.send(503, "text/plain", "Display busy");
+      return;
+    }
+    if (xSemaphoreTake(benchDone, pdMS_TO_TICKS(BENCH_TIMEOUT_MS)) != pdTRUE) {
+      server.send(504, "text/plain", "Benchmark did not finish");
+      return;
+    }
+    server.send(200, "application/json", benchResult);
+  });
+
+  server.on("/stats", []() {
+    if (server.hasArg("reset")) {
+      portENTER_CRITICAL(&statsMux);
+      memset(statSlots, 0, sizeof(statSlots));
+      portEXIT_CRITICAL(&statsMux);
+      resetHeapMonitor();
+    }
+    sendStats();
+  });
+
+  server.on("/soak", []() {
+    if (const char *run = server.argValue("run")) {
+      if (atoi(run)) {
+        const char *hours = server.argValue("hours");
+        startSoak(hours ? std::max(atoi(hours), 0) : 0);
+      } else {
+        stopSoak();
+      }
+    }
+    sendSoakSummary();
+  });
+  server.on("/events", handleEvents);
+  server.on("/trace", handleTrace);
+#ifdef USE_PROFILER
+  server.on("/profile", handleProfile);
+#endif
+
+  server.on("/backlight", []() {
+    if (!backlightReady) {
+      server.sendText(501, "The backlight is not driven by PWM (USE_BACKLIGHT_PWM, TFT_BL)");
+      return;
+    }
+    long fade = 0;
+    if (const char *ms = server.argValue("fade")) {
+      fade = atol(ms);
+      if (fade < 0 || fade > BACKLIGHT_MAX_FADE_MS) {
+        server.sendText(400, "Invalid fade, use 0-10000 ms");
+        return;
+      }
+    }
+    if (const char *idle = server.argValue("idle")) {
+      int level = atoi(idle);
+      if (level < 0 || level > 100) {
+        server.sendText(400, "Invalid idle level, use 0-100");
+        return;
+      }
+      backlightIdleLevel = level;
+      prefs.putUChar("blIdle", level);
+    }
+    if (const char *value = server.argValue("level")) {
+      int level = atoi(value);
+      if (level < 0 || level > 100) {
+        server.sendText(400, "Invalid level, use 0-100");
+        return;
+      }
+      backlightLevel = level;
+      if (server.argValue("save"))
+        prefs.putUChar("backlight", level);
+      fadeBacklight(level, fade);
+    }
+    char json[96];
+    snprintf(json, sizeof(json), "{\"level\":%u,\"target\":%u,\"now\":%u,\"idleLevel\":%u}",
+             backlightLevel, backlightTarget, backlightNow(), backlightIdleLevel);
+    server.send(200, "application/json", json);
+  });
+
+  server.on("/power", []() {
+    if (!governorReady) {
+      server.sendText(501, "The idle governor is not built in (USE_IDLE_GOVERNOR)");
+      return;
+    }
+    if (const char *mode = server.argValue("mode")) {
+      int m = 0;
+      while (m <= POWER_ACTIVE && strcmp(mode, powerModeNames[m]) != 0)
+        m++;
+      if (m > POWER_ACTIVE) {
+        server.sendText(400, "Invalid mode, use auto, idle or active");
+        return;
+      }
+      powerMode = m;
+      setPowerIdle(m == POWER_IDLE); // auto starts from active, pollIdleGovernor() decides from there
+    }
+    if (server.argValue("reset")) {
+      xSemaphoreTake(powerLock, portMAX_DELAY);
+      powerSince = millis();
+      powerIdleMs = powerActiveMs = powerIdleEntries = 0;
+      xSemaphoreGive(powerLock);
+    }
+    xSemaphoreTake(powerLock, portMAX_DELAY);
+    uint32_t idleMs = powerIdleMs + (powerIdle ? millis() - powerSince : 0);
+    uint32_t activeMs = powerActiveMs + (powerIdle ? 0 : millis() - powerSince);
+    xSemaphoreGive(powerLock);
+    char json[256];
+    snprintf(json, sizeof(json), "{\"mode\":\"%s\",\"idle\":%s,\"cpuMhz\":%lu,\"activeMhz\":%lu,\"idleMhz\":%d,"
+             "\"pm\":%s,\"idleAfterMs\":%d,\"idleMs\":%lu,\"activeMs\":%lu,\"idlePct\":%.1f,\"idleEntries\":%lu}",
+             powerModeNames[powerMode], powerIdle ? "true" : "false", (unsigned long)getCpuFrequencyMhz(),
+             (unsigned long)activeCpuMhz, IDLE_CPU_MHZ, powerManaged() ? "true" : "false", IDLE_AFTER_MS,
+             (unsigned long)idleMs, (unsigned long)activeMs,
+             idleMs + activeMs ? idleMs * 100.0f / (idleMs + activeMs) : 0.0f, (unsigned long)powerIdleEntries);
+    server.send(200, "application/json", json);
+  });
+
+  server.on("/quality", []() {
+    if (const char *name = server.argValue("profile")) {
+      int p = 0;
+      while (p < QUALITY_PROFILES && strcmp(name, qualityProfiles[p].name) != 0)
+        p++;
+      if (p == QUALITY_PROFILES && strcmp(name, "auto") != 0) {
+        server.sendText(400, "Invalid profile, use auto, full, reduced, saver or static");
+        return;
+      }
+      qualityAuto = p == QUALITY_PROFILES;
+      setQualityProfile(qualityAuto ? (qualitySoc < 0 ? QUALITY_FULL : qualityForLevel(qualitySoc, qualityRuntimeMin)) : p);
+    }
+    if (const char *soc = server.argValue("soc")) {
+      const char *runtime = server.argValue("runtime");
+      if (!applyPowerLevel(atoi(soc), runtime ? atoi(runtime) : -1)) {
+        server.sendText(400, "Invalid soc, use 0-100");
+        return;
+      }
+    }
+    const QualitySettings &q = qualityProfiles[qualityProfile];
+    char json[256];
+    snprintf(json, sizeof(json), "{\"profile\":\"%s\",\"auto\":%s,\"soc\":%d,\"runtimeMin\":%d,\"minFrameMs\":%u,"
+             "\"decodeAhead\":%s,\"backlightPct\":%u,\"changes\":%lu}",
+             q.name, qualityAuto ? "true" : "false", qualitySoc, qualityRuntimeMin, q.minFrameMs,
+             q.decodeAhead ? "true" : "false", q.backlightPct, (unsigned long)qualityChanges);
+    server.send(200, "application/json", json);
+  });
+
+  server.on("/mjpeg", []() {
+#ifdef USE_JPEGDEC
+    if (server.hasArg("stop")) {
+      stopMjpeg();
+    } else if (server.hasArg("url")) {
+      String url = server.arg("url");
+      if (!url.startsWith("http://") || url.length() >= sizeof(mjpegUrl)) {
+        server.send(400, "text/plain", "Invalid url, use http://host[:port]/path");
+        return;
+      }
+      if (!startMjpeg(url.c_str())) {
+        server.send(503, "text/plain", "No PSRAM for the MJPEG frames");
+        return;
+      }
+    }
+    String json = "{\"url\":\"" + String(mjpegUrl) + "\"";
+    json += ",\"running\":" + String(mjpegRunning ? "true" : "false");
+    json += ",\"received\":" + String((unsigned long)mjpegReceived);
+    json += ",\"shown\":" + String((unsigned long)mjpegShown);
+    json += ",\"dropped\":" + String((unsigned long)mjpegDropped);
+    json += ",\"skipped\":" + String((unsigned long)mjpegSkipped) + "}";
+    server.send(200, "application/json", json);
+#else
+    server.send(501, "text/plain", "MJPEG feeds need USE_JPEGDEC");
+#endif
+  });
+
+  server.on("/fetch", []() {
+    if (server.hasArg("stop")) {
+      stopFetch();
+    } else if (server.hasArg("url")) {
+      String url = server.arg("url");
+      String save = server.arg("save");
+      if (!url.startsWith("http://") || url.length() >= sizeof(fetchUrl)) {
+        server.sendText(400, "Invalid url, use http://host[:port]/path");
+        return;
+      }
+      if (save.length() && (!isUploadName(save) || !isGifName(save))) {
+        server.sendText(400, "Invalid file name");
+        return;
+      }
+      if (!startFetch(url.c_str(), save.c_str())) {
+        server.sendText(503, "No PSRAM for the fetch ring");
+        return;
+      }
+    }
+    String json = "{\"url\":\"" + String(fetchUrl) + "\"";
+    json += ",\"running\":" + String(fetchRunning ? "true" : "false");
+    json += ",\"received\":" + String((long)fetchHead);
+    json += ",\"size\":" + String((long)fetchSize);
+    json += ",\"stalls\":" + String((unsigned long)fetchStalls);
+    json += ",\"waits\":" + String((unsigned long)fetchWaits);
+    json += ",\"saved\":" + String(fetchSaved ? "true" : "false") + "}";
+    server.send(200, "application/json", json);
+  });
+
+  server.on("/stream", []() {
+    if (server.hasArg("reset"))
+      memset(&streamStats, 0, sizeof(streamStats));
+    String json = "{\"port\":" + String(STREAM_PORT);
+    json += ",\"active\":" + String(streamActive ? "true" : "false");
+    json += ",\"packets\":" + String((unsigned long)streamStats.packets);
+    json += ",\"frames\":" + String((unsigned long)streamStats.frames);
+    json += ",\"keyframes\":" + String((unsigned long)streamStats.keyframes);
+    json += ",\"lost\":" + String((unsigned long)streamStats.lost);
+    json += ",\"late\":" + String((unsigned long)streamStats.late);
+    json += ",\"overrun\":" + String((unsigned long)streamStats.overrun);
+    json += ",\"invalid\":" + String((unsigned long)streamStats.invalid);
+    json += ",\"ignored\":" + String((unsigned long)streamStats.ignored) + "}";
+    server.send(200, "application/json", json);
+  });
+
+  server.on("/cache", []() {
+    if (server.hasArg("clear")) {
+      queueDisplayCommand(CMD_CLEAR_CACHE, "", 0);
+    }
+    if (server.hasArg("ramThreshold")) {
+      long threshold = server.arg("ramThreshold").toInt();
+      if (threshold < 0) {
+        server.send(400, "text/plain", "Invalid RAM threshold");
+        return;
+      }
+      gifRamThreshold = (int32_t)threshold;
+      prefs.putInt("ramThreshold", gifRamThreshold);
+    }
+    if (server.hasArg("budget")) {
+      long budget = server.arg("budget").toInt();
+      if (budget < 0) {
+        server.send(400, "text/plain", "Invalid cache budget");
+        return;
+      }
+      frameCacheBudget = (size_t)budget;
+      prefs.putUInt("cacheBudget", frameCacheBudget);
+      queueDisplayCommand(CMD_TRIM_CACHE, "", 0);
+    }
+    xSemaphoreTake(cacheLock, portMAX_DELAY);
+    String json = "{\"mode\":\"" + String(playbackMode) + "\"";
+    json += ",\"budget\":" + String((unsigned long)frameCacheBudget);
+    json += ",\"used\":" + String((unsigned long)frameCacheBytes);
+    json += ",\"entries\":[";
+    for (size_t i = 0; i < frameCache.size(); i++) {
+      if (i) json += ",";
+      json += "{\"name\":\"" + String(frameCache[i]->name.c_str()) + "\",\"frames\":" + String((unsigned long)frameCache[i]->frames.size());
+      json += ",\"bytes\":" + String((unsigned long)frameCache[i]->bytes) + "}";
+    }
+    json += "],\"firstFrames\":" + String((unsigned long)firstFrames.size());
+    json += ",\"firstFrameBytes\":" + String((unsigned long)firstFrameBytes);
+    json += ",\"ramThreshold\":" + String((long)gifRamThreshold);
+    json += ",\"pinned\":[";
+    for (size_t i = 0; i < gifBlobs.size(); i++) {
+      if (i) json += ",";
+      json += "{\"name\":\"" + String(gifBlobs[i].name.c_str()) + "\",\"bytes\":" + String((long)gifBlobs[i].size) + "}";
+    }
+    json += "]}";
+    xSemaphoreGive(cacheLock);
+    server.send(200, "application/json", json);
+  });
+
+  // GET /prefetch?names=a.gif,b.gif: the GIFs the host expects to play next, most likely first.
+  // The player reads them into PSRAM while it idles (whole file, frame index, first frame), so the
+  // switch to one of them doesn't wait for the card. A new hint replaces the pending ones; names
+  // that aren't GIFs in the catalog are counted as unknown. ?budget= sets the PSRAM the hints may
+  // hold until the next restart
+  server.on("/prefetch", []() {
+#ifdef USE_PREFETCH
+    if (server.hasArg("budget")) {
+      long budget = server.arg("budget").toInt();
+      if (budget < 0) {
+        server.sendText(400, "Invalid prefetch budget");
+        return;
+      }
+      prefetchBudget = (size_t)budget;
+      queueDisplayCommand(CMD_TRIM_CACHE, "", 0);
+    }
+    int unknown = 0;
+    if (server.hasArg("names")) {
+      std::vector<PrefetchHint> hints;
+      String names = server.arg("names");
+      int from = 0;
+      while (from <= (int)names.length() && hints.size() < PREFETCH_HINTS) {
+        int comma = names.indexOf(',', from);
+        String name = names.substring(from, comma < 0 ? names.length() : comma);
+        name.trim();
+        from = comma < 0 ? names.length() + 1 : comma + 1;
+        if (name.isEmpty())
+          continue;
+        const MediaEntry *entry = findMedia(name.c_str());
+        if (!entry || !isGifName(name)) {
+          unknown++;
+          continue;
+        }
+        hints.push_back({ std::string("/gif/") + entry->name(), entry->size });
+      }
+      xSemaphoreTake(cacheLock, portMAX_DELAY);
+      prefetchHints.swap(hints);
+      xSemaphoreGive(cacheLock);
+    }
+    xSemaphoreTake(cacheLock, portMAX_DELAY);
+    String json = "{\"pending\":[";
+    for (size_t i = 0; i < prefetchHints.size(); i++) {
+      if (i) json += ",";
+      json += "\"" + String(prefetchHints[i].path.c_str()) + "\"";
+    }
+    json += "],\"budget\":" + String((unsigned long)prefetchBudget);
+    json += ",\"used\":" + String((unsigned long)prefetchedBytes());
+    json += ",\"files\":[";
+    bool first = true;
+    for (size_t i = 0; i < gifBlobs.size(); i++) {
+      if (!gifBlobs[i].hinted)
+        continue;
+      if (!first) json += ",";
+      first = false;
+      json += "{\"name\":\"" + String(gifBlobs[i].name.c_str()) + "\",\"bytes\":" + String((long)gifBlobs[i].size) + "}";
+    }
+    json += "],\"indexes\":[";
+    for (size_t i = 0; i < prefetchedIndexes.size(); i++) {
+      if (i) json += ",";
+      json += "{\"name\":\"" + String(prefetchedIndexes[i].name.c_str()) + "\",\"frames\":" + String(prefetchedIndexes[i].count);
+      json += ",\"played\":" + String(prefetchedIndexes[i].played ? "true" : "false") + "}";
+    }
+    json += "],\"firstFrames\":" + String((unsigned long)firstFrames.size());
+    json += ",\"reads\":" + String((unsigned long)prefetchReads);
+    json += ",\"hits\":" + String((unsigned long)prefetchHits);
+    json += ",\"evictions\":" + String((unsigned long)prefetchEvictions);
+    json += ",\"unknown\":" + String(unknown) + "}";
+    xSemaphoreGive(cacheLock);
+    server.send(200, "application/json", json);
+#else
+    server.sendText(501, "No prefetching (USE_PREFETCH)");
+#endif
+  });
+
+  static const char *mediaHeaders[] = { "If-None-Match", "Range" };
+  server.collectHeaders(mediaHeaders, 2);
+  server.addHandler(new MediaHandler()); // built-in, flash, pack and card media, in catalog order
+  server.serveStatic("/gif", LittleFS, "/gif"); // anything else, flash before the card
+  server.serveStatic("/gif", SD, "/gif"); // the server starts in startNetwork()
+
+  // From here on the catalog and the server belong to the web task
+  xTaskCreatePinnedToCore(webTask, "web", WEB_STACK_SIZE, NULL, 1, NULL, 1 - PLAYER_CORE);
 }
 
 
 
+// Brings up the network, then keeps the sync clock and the control channel running, neither
+// of which waits behind an HTTP request any more
 void loop() {
-  server.handleClient();
-  delay(1);
+#ifdef USE_SERIAL_CONTROL
+  pollSerialControl();
+#endif
+  pollWifi();
+  if (!networkReady) {
+    networkReady = startNetwork();
+    if (networkReady)
+      logBootComplete();
+    delay(1);
+    return;
+  }
+  pollSync();
+  pollControl();
+  pollBatch();
+  pollStream();
+  pollAudio();
+  pollIdleGovernor();
+  vTaskDelay(batchPending() ? 1 : pollDelay()); // batch steps keep their ms timing when idle
 }
 
@@ -0,0 +1,15 @@
+from eyes.inputs.eye_events import parse_events
+
+
+def test_parse_events_skips_comments_and_joins_data():
+    lines = [
+        "retry: 2000", "",
+        "event: started", 'data: {"name":"/gif/a.gif","frame":0}', "",
+        ":", "",
+        "data: one", "data: two", "",
+        "event: finished", "data: {}",
+    ]
+    assert list(parse_events(lines)) == [
+        ("started", '{"name":"/gif/a.gif","frame":0}'),
+        ("message", "one\ntwo"),
+    ]
@@ -0,0 +1,35 @@
+from eyes.inputs import power_level
+from eyes.inputs.power_level import power_line, process_power_level
+
+
+def test_power_line_rounds_and_adds_runtime_in_minutes():
+    assert power_line(42.6, 0) == "power 43"
+    assert power_line(101.0, None) == "power 100"
+    assert power_line(18.2, 5400.0) == "power 18 90"
+
+
+def test_levels_are_sent_on_change_only(monkeypatch):
+    sent = []
+
+    class FakeSocket:
+        def __init__(self, *args):
+            pass
+
+        def __enter__(self):
+            return self
+
+        def __exit__(self, *args):
+            return False
+
+        def sendto(self, data, address):
+            sent.append((data.decode(), address))
+
+    monkeypatch.setattr(power_level.socket, "socket", FakeSocket)
+    context = {}
+    process_power_level(context, {"id": "runtime", "value": [3600.0]})
+    process_power_level(context, {"id": "soc", "value": [55.0]})
+    process_power_level(context, {"id": "soc", "value": [55.4]})
+    process_power_level(context, {"id": "soc", "value": [53.9]})
+    lines = [line for line, _ in sent]
+    assert lines == ["power 55 60"] * 2 + ["power 54 60"] * 2
+    assert {address for _, address in sent} == {(ip, 4211) for ip in power_level.EYE_DISPLAYS}
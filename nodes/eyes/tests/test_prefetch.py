@@ -0,0 +1,28 @@
+from eyes.inputs import prefetch
+from eyes.inputs.prefetch import prefetch_names, process_prefetch
+
+
+def test_names_are_split_deduplicated_and_capped():
+    assert prefetch_names({"value": ["happy.gif, sad.gif", "happy.gif", " "]}) == ["happy.gif", "sad.gif"]
+    names = [f"{i}.gif" for i in range(12)]
+    assert prefetch_names({"value": names}) == names[:prefetch.MAX_HINTS]
+    assert prefetch_names({"value": None}) == []
+
+
+def test_hints_go_to_both_eyes_once(monkeypatch):
+    calls = []
+
+    class Response:
+        status_code = 200
+
+    def fake_get(url, params=None, timeout=None):
+        calls.append((url, params["names"]))
+        return Response()
+
+    monkeypatch.setattr(prefetch.requests, "get", fake_get)
+    context = {}
+    process_prefetch(context, {"id": "prefetch", "value": ["happy.gif", "sad.gif"]})
+    process_prefetch(context, {"id": "prefetch", "value": ["happy.gif", "sad.gif"]})
+    assert sorted(calls) == sorted((f"http://{ip}/prefetch", "happy.gif,sad.gif") for ip in prefetch.EYE_DISPLAYS)
+    process_prefetch(context, {"id": "prefetch", "value": ["sad.gif"]})
+    assert len(calls) == 2 * len(prefetch.EYE_DISPLAYS)
@@ -0,0 +1,417 @@
+// Host client of the tracks binary protocol, see tracks_client.h
+
+#include "tracks_client.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <mutex>
+#include <thread>
+
+// Frame layout, as in firmware/main.cpp and tracks/protocol.py
+#define FRAME_SYNC      0xA5
+#define FRAME_MOVE      0x01
+#define FRAME_HEARTBEAT 0x02
+#define FRAME_ODOMETRY  0x81
+#define FRAME_TELEMETRY 0x82
+#define FRAME_ACK       0x83
+#define FRAME_PONG      0x84
+#define FRAME_SCALE     100
+#define FRAME_IN_MAX_LEN 49
+
+#define LINE_LEN    128 // longest text line kept, the firmware's are shorter
+#define LINE_COUNT  32  // text lines kept until read
+#define TX_QUEUE_LEN 1024
+#define READ_CHUNK  512
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static uint8_t crc8(const uint8_t *data, int len) {
+    uint8_t crc = 0;
+    while (len--) {
+        crc ^= *data++;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+static int16_t to_fixed(float value) {
+    long fixed = lroundf(value * FRAME_SCALE);
+    return (int16_t)(fixed < -32768 ? -32768 : fixed > 32767 ? 32767 : fixed);
+}
+
+static uint16_t le16(const uint8_t *p) { return (uint16_t)(p[0] | p[1] << 8); }
+static uint32_t le32(const uint8_t *p) { return (uint32_t)p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24; }
+
+// Length of a frame the Pico sends, sync to CRC; 0 for an unknown type
+static int inbound_length(uint8_t type) {
+    switch (type) {
+        case FRAME_ODOMETRY:  return 20;
+        case FRAME_TELEMETRY: return 49;
+        case FRAME_ACK:       return 14;
+        case FRAME_PONG:      return 16;
+        default:              return 0;
+    }
+}
+
+struct tracks_client {
+    int fd = -1;
+    int wake[2] = { -1, -1 }; // pipe that ends the I/O thread's poll()
+    int moves_in_flight = 0;
+    std::thread io;
+
+    std::mutex lock; // everything below
+    bool running = true;
+    bool move_pending = false;
+    int16_t move_linear = 0, move_angular = 0;
+    bool heartbeat_pending = false;
+    uint8_t tx_queue[TX_QUEUE_LEN]; // text commands waiting
+    int tx_len = 0;
+    tracks_odometry_t odometry = {};
+    tracks_telemetry_t telemetry = {};
+    bool odometry_new = false, telemetry_new = false;
+    char lines[LINE_COUNT][LINE_LEN];
+    uint32_t line_head = 0, line_tail = 0;
+    tracks_stats_t stats = {};
+
+    // I/O thread only
+    uint8_t seq = 0;
+    bool sent_any = false;
+    int16_t sent_linear = 0, sent_angular = 0;
+    uint64_t sent_ns[256] = {}; // per MOVE sequence number, for the ACK latency
+    uint64_t last_move_ns = 0;
+    uint8_t frame[FRAME_IN_MAX_LEN];
+    int frame_len = 0;
+    char text[LINE_LEN];
+    int text_len = 0;
+};
+
+static void wake_io(tracks_client_t *c) {
+    uint8_t byte = 0;
+    if (write(c->wake[1], &byte, 1) < 0) {} // a full pipe wakes it just as well
+}
+
+static int put_frame(tracks_client_t *c, uint8_t *out, uint8_t type, const uint8_t *payload, int len) {
+    out[0] = FRAME_SYNC;
+    out[1] = type;
+    out[2] = c->seq++;
+    memcpy(out + 3, payload, len);
+    out[3 + len] = crc8(out + 1, len + 2);
+    return len + 4;
+}
+
+static bool write_all(tracks_client_t *c, const uint8_t *data, int len) {
+    while (len > 0) {
+        ssize_t n = write(c->fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::lock_guard<std::mutex> guard(c->lock);
+            c->stats.error = errno;
+            return false;
+        }
+        data += n;
+        len -= (int)n;
+    }
+    return true;
+}
+
+// Called with the lock held
+static void handle_frame(tracks_client_t *c, const uint8_t *f, uint64_t at_ns) {
+    const uint8_t *p = f + 3;
+    if (f[1] == FRAME_ODOMETRY) {
+        c->odometry = { (int32_t)le32(p), (int32_t)le32(p + 4), (int32_t)le32(p + 8), (int32_t)le32(p + 12), at_ns };
+        c->odometry_new = true;
+    } else if (f[1] == FRAME_TELEMETRY) {
+        tracks_telemetry_t *t = &c->telemetry;
+        t->left_duty = (int16_t)le16(p);
+        t->right_duty = (int16_t)le16(p + 2);
+        t->heartbeat_age_ms = le16(p + 4);
+        t->tick_max_us = le16(p + 6);
+        t->tick_late_max_us = le16(p + 8);
+        t->flags = p[10];
+        t->frames_ok = le32(p + 11);
+        t->frames_bad = le32(p + 15);
+        t->frames_lost = le32(p + 19);
+        t->log_dropped = le32(p + 23);
+        t->left_current_ma = le16(p + 27);
+        t->right_current_ma = le16(p + 29);
+        t->deadlines_missed = le32(p + 31);
+        t->rx_high_water = le16(p + 35);
+        t->moves_coalesced = le32(p + 37);
+        t->rx_overflows = le32(p + 41);
+        t->host_ns = at_ns;
+        c->telemetry_new = true;
+    } else if (f[1] == FRAME_ACK) {
+        uint32_t credits = 1 + p[9];
+        c->stats.in_flight = c->stats.in_flight > credits ? c->stats.in_flight - credits : 0;
+        c->stats.moves_acked++;
+        if (c->sent_ns[p[0]]) {
+            uint32_t us = (uint32_t)((at_ns - c->sent_ns[p[0]]) / 1000);
+            c->sent_ns[p[0]] = 0;
+            c->stats.ack_last_us = us;
+            if (us > c->stats.ack_max_us) c->stats.ack_max_us = us;
+        }
+    }
+}
+
+// Called with the lock held
+static void push_line(tracks_client_t *c) {
+    int start = 0, end = c->text_len;
+    while (start < end && (c->text[start] == ' ' || c->text[start] == '\t')) start++;
+    while (end > start && (c->text[end - 1] == ' ' || c->text[end - 1] == '\t')) end--;
+    c->text_len = 0;
+    if (start == end) return;
+    if (c->line_head - c->line_tail == LINE_COUNT) { // full, the oldest goes
+        c->line_tail++;
+        c->stats.lines_dropped++;
+    }
+    char *line = c->lines[c->line_head++ % LINE_COUNT];
+    memcpy(line, c->text + start, end - start);
+    line[end - start] = '\0';
+}
+
+// Split received bytes into frames and text lines, as StreamDecoder does
+static void feed(tracks_client_t *c, const uint8_t *data, int len, uint64_t at_ns) {
+    std::lock_guard<std::mutex> guard(c->lock);
+    for (int i = 0; i < len; i++) {
+        uint8_t byte = data[i];
+        if (c->frame_len > 0) {
+            c->frame[c->frame_len++] = byte;
+            int need = inbound_length(c->frame[1]);
+            if (need == 0) {
+                c->stats.bad_frames++;
+                c->frame_len = 0;
+            } else if (c->frame_len == need) {
+                if (crc8(c->frame + 1, need - 2) == c->frame[need - 1])
+                    handle_frame(c, c->frame, at_ns);
+                else
+                    c->stats.bad_frames++;
+                c->frame_len = 0;
+            }
+        } else if (byte == FRAME_SYNC) {
+            c->frame[0] = byte;
+            c->frame_len = 1;
+        } else if (byte == '\n' || byte == '\r') {
+            push_line(c);
+        } else if (c->text_len < LINE_LEN - 1) {
+            c->text[c->text_len++] = (char)byte;
+        }
+    }
+}
+
+// Write what is queued: text commands first, then a heartbeat, then the
+// newest setpoint if it is new and there is a credit for it
+static void send_pending(tracks_client_t *c) {
+    uint8_t out[TX_QUEUE_LEN + 16];
+    int len = 0;
+    uint64_t now = now_ns();
+    {
+        std::lock_guard<std::mutex> guard(c->lock);
+        memcpy(out, c->tx_queue, c->tx_len);
+        len = c->tx_len;
+        c->tx_len = 0;
+        if (c->heartbeat_pending) {
+            len += put_frame(c, out + len, FRAME_HEARTBEAT, NULL, 0);
+            c->heartbeat_pending = false;
+        }
+        if (c->move_pending && c->sent_any && c->move_linear == c->sent_linear && c->move_angular == c->sent_angular)
+            c->move_pending = false; // back to what was sent last
+        if (c->move_pending && c->moves_in_flight > 0 && c->stats.in_flight >= (uint32_t)c->moves_in_flight) {
+            if (now - c->last_move_ns >= TRACKS_ACK_TIMEOUT_MS * 1000000ull)
+                c->stats.in_flight = 0; // ACKs lost or the firmware restarted
+        }
+        if (c->move_pending && (c->moves_in_flight == 0 || c->stats.in_flight < (uint32_t)c->moves_in_flight)) {
+            uint8_t payload[4];
+            payload[0] = (uint8_t)c->move_linear;
+            payload[1] = (uint8_t)((uint16_t)c->move_linear >> 8);
+            payload[2] = (uint8_t)c->move_angular;
+            payload[3] = (uint8_t)((uint16_t)c->move_angular >> 8);
+            c->sent_ns[c->seq] = now;
+            len += put_frame(c, out + len, FRAME_MOVE, payload, sizeof(payload));
+            c->sent_linear = c->move_linear;
+            c->sent_angular = c->move_angular;
+            c->sent_any = true;
+            c->move_pending = false;
+            if (c->moves_in_flight > 0) c->stats.in_flight++;
+            c->stats.moves_sent++;
+            c->last_move_ns = now;
+        }
+    }
+    if (len > 0) write_all(c, out, len);
+}
+
+static void io_main(tracks_client_t *c) {
+    uint8_t buf[READ_CHUNK];
+    while (true) {
+        send_pending(c);
+        int timeout_ms = -1;
+        {
+            std::lock_guard<std::mutex> guard(c->lock);
+            if (!c->running) break;
+            if (c->move_pending) timeout_ms = 5; // held back for a credit, check the ACK timeout
+        }
+        struct pollfd fds[2] = { { c->fd, POLLIN, 0 }, { c->wake[0], POLLIN, 0 } };
+        if (poll(fds, 2, timeout_ms) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents & POLLIN)
+            while (read(c->wake[0], buf, sizeof(buf)) > 0) {}
+        if (fds[0].revents & (POLLIN | POLLERR | POLLHUP)) {
+            ssize_t n = read(c->fd, buf, sizeof(buf));
+            uint64_t at_ns = now_ns();
+            if (n > 0) {
+                feed(c, buf, (int)n, at_ns);
+            } else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                std::lock_guard<std::mutex> guard(c->lock);
+                c->stats.error = errno;
+                break; // the port is gone, e.g. the Pico was unplugged
+            } else if (n == 0) {
+                std::lock_guard<std::mutex> guard(c->lock);
+                c->stats.error = EIO;
+                break;
+            }
+        }
+    }
+}
+
+static speed_t baud_constant(int baud) {
+    switch (baud) {
+        case 9600:   return B9600;
+        case 57600:  return B57600;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        default:     return B115200;
+    }
+}
+
+static int queue_text(tracks_client_t *c, const char *line) {
+    int len = (int)strlen(line);
+    std::lock_guard<std::mutex> guard(c->lock);
+    if (c->tx_len + len + 1 > TX_QUEUE_LEN) {
+        c->stats.tx_dropped++;
+        return 0;
+    }
+    memcpy(c->tx_queue + c->tx_len, line, len);
+    c->tx_queue[c->tx_len + len] = '\n';
+    c->tx_len += len + 1;
+    return 1;
+}
+
+extern "C" {
+
+tracks_client_t *tracks_open(const char *path, int baud, int moves_in_flight) {
+    int fd = open(path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0) { // a plain file or pipe in tests has no termios
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, baud_constant(baud));
+        cfsetospeed(&tio, baud_constant(baud));
+        tio.c_cc[VMIN] = 0;
+        tio.c_cc[VTIME] = 0;
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    tracks_client_t *c = new tracks_client;
+    c->fd = fd;
+    c->moves_in_flight = moves_in_flight > 0 ? moves_in_flight : 0;
+    if (pipe2(c->wake, O_NONBLOCK | O_CLOEXEC) < 0) {
+        int err = errno;
+        close(fd);
+        delete c;
+        errno = err;
+        return NULL;
+    }
+    queue_text(c, c->moves_in_flight ? "ack 1" : "ack 0");
+    c->io = std::thread(io_main, c);
+    return c;
+}
+
+void tracks_close(tracks_client_t *c) {
+    if (!c) return;
+    tracks_move(c, 0, 0);
+    queue_text(c, "move 0 0"); // also stops a firmware that missed the frame
+    {
+        std::lock_guard<std::mutex> guard(c->lock);
+        c->running = false;
+        c->moves_in_flight = 0; // the stop goes out without a credit
+    }
+    wake_io(c);
+    c->io.join();
+    send_pending(c);
+    close(c->fd);
+    close(c->wake[0]);
+    close(c->wake[1]);
+    delete c;
+}
+
+void tracks_move(tracks_client_t *c, float linear, float angular) {
+    {
+        std::lock_guard<std::mutex> guard(c->lock);
+        if (c->move_pending) c->stats.moves_coalesced++;
+        c->move_linear = to_fixed(linear);
+        c->move_angular = to_fixed(angular);
+        c->move_pending = true;
+    }
+    wake_io(c);
+}
+
+void tracks_heartbeat(tracks_client_t *c) {
+    {
+        std::lock_guard<std::mutex> guard(c->lock);
+        c->heartbeat_pending = true;
+    }
+    wake_io(c);
+}
+
+int tracks_command(tracks_client_t *c, const char *line) {
+    int queued = queue_text(c, line);
+    if (queued) wake_io(c);
+    return queued;
+}
+
+int tracks_odometry(tracks_client_t *c, tracks_odometry_t *out) {
+    std::lock_guard<std::mutex> guard(c->lock);
+    *out = c->odometry;
+    int fresh = c->odometry_new;
+    c->odometry_new = false;
+    return fresh;
+}
+
+int tracks_telemetry(tracks_client_t *c, tracks_telemetry_t *out) {
+    std::lock_guard<std::mutex> guard(c->lock);
+    *out = c->telemetry;
+    int fresh = c->telemetry_new;
+    c->telemetry_new = false;
+    return fresh;
+}
+
+int tracks_line(tracks_client_t *c, char *buf, int size) {
+    std::lock_guard<std::mutex> guard(c->lock);
+    if (c->line_tail == c->line_head || size <= 0) return 0;
+    const char *line = c->lines[c->line_tail++ % LINE_COUNT];
+    int len = (int)strlen(line);
+    if (len > size - 1) len = size - 1;
+    memcpy(buf, line, len);
+    buf[len] = '\0';
+    return 1;
+}
+
+void tracks_get_stats(tracks_client_t *c, tracks_stats_t *out) {
+    std::lock_guard<std::mutex> guard(c->lock);
+    *out = c->stats;
+}
+
+}
@@ -0,0 +1,99 @@
+// Host client of the tracks firmware's binary protocol (see firmware/main.cpp
+// and tracks/protocol.py), for the node and other host programs.
+//
+// tracks_open() starts an I/O thread that owns the serial port: it waits in
+// poll() on the port and a wake-up pipe, so a new setpoint goes out at once
+// instead of on the next pass of a polling loop. Frames are encoded and
+// decoded in fixed buffers, nothing is allocated after tracks_open().
+// Received frames are stamped with CLOCK_MONOTONIC when read and kept
+// latest-value-wins; text lines go to a small ring.
+//
+// Setpoints are coalesced like in the firmware: tracks_move() only records
+// the newest one, the I/O thread sends it when it differs from the last one
+// sent and fewer than moves_in_flight MOVE frames wait for their ACK. Each
+// ACK returns one credit plus the frames it superseded, see decode_ack() in
+// tracks/protocol.py. A credit lost with its ACK comes back after
+// TRACKS_ACK_TIMEOUT_MS.
+//
+// The API is plain C so tracks/client.py can load it with ctypes; every call
+// is thread safe and returns without waiting on the port.
+
+#ifndef TRACKS_CLIENT_H
+#define TRACKS_CLIENT_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRACKS_ACK_TIMEOUT_MS 250
+
+typedef struct tracks_client tracks_client_t;
+
+typedef struct {
+    int32_t left_count, right_count; // encoder steps
+    int32_t left_speed, right_speed; // steps per second
+    uint64_t host_ns;                // CLOCK_MONOTONIC when received
+} tracks_odometry_t;
+
+// Fields as in decode_telemetry() of tracks/protocol.py
+typedef struct {
+    int16_t left_duty, right_duty;
+    uint16_t heartbeat_age_ms, tick_max_us, tick_late_max_us;
+    uint8_t flags; // TELEMETRY_FAILSAFE, TELEMETRY_STALL_LEFT, TELEMETRY_STALL_RIGHT
+    uint32_t frames_ok, frames_bad, frames_lost, log_dropped;
+    uint16_t left_current_ma, right_current_ma;
+    uint32_t deadlines_missed;
+    uint16_t rx_high_water;
+    uint32_t moves_coalesced;
+    uint32_t rx_overflows;
+    uint64_t host_ns;
+} tracks_telemetry_t;
+
+typedef struct {
+    uint32_t moves_sent;      // MOVE frames written
+    uint32_t moves_coalesced; // setpoints replaced on the host before being sent
+    uint32_t moves_acked;     // ACKs received
+    uint32_t in_flight;       // MOVE frames waiting for an ACK
+    uint32_t ack_last_us;     // host send to ACK receipt of the newest ACK
+    uint32_t ack_max_us;      // the same, the most since tracks_open()
+    uint32_t bad_frames;      // corrupt or unknown frames received
+    uint32_t lines_dropped;   // text lines lost to a full ring
+    uint32_t tx_dropped;      // commands dropped, the queue was full
+    int32_t error;            // errno of a failed read or write, 0 while the port works
+} tracks_stats_t;
+
+// Open the serial port at path (raw mode, baud ignored by USB CDC) and
+// start the I/O thread. moves_in_flight 0 sends every new setpoint at once
+// and leaves ACKs off. Returns NULL with errno set on failure
+tracks_client_t *tracks_open(const char *path, int baud, int moves_in_flight);
+
+// Send "move 0 0", stop the thread and close the port
+void tracks_close(tracks_client_t *client);
+
+// Newest setpoint, -100..100 like the text move command
+void tracks_move(tracks_client_t *client, float linear, float angular);
+
+// Queue a HEARTBEAT frame
+void tracks_heartbeat(tracks_client_t *client);
+
+// Queue a text command, a newline is added; returns 0 if the queue is full
+int tracks_command(tracks_client_t *client, const char *line);
+
+// Copy the newest ODOMETRY or TELEMETRY frame; returns 1 if it arrived
+// since the previous call, 0 if there is none or nothing new
+int tracks_odometry(tracks_client_t *client, tracks_odometry_t *out);
+int tracks_telemetry(tracks_client_t *client, tracks_telemetry_t *out);
+
+// Take the oldest text line received into buf (NUL-terminated, cut to
+// size - 1); returns 1 if there was one
+int tracks_line(tracks_client_t *client, char *buf, int size);
+
+void tracks_get_stats(tracks_client_t *client, tracks_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,151 @@
+// Test of the tracks client against a pseudo terminal standing in for the
+// Pico: frame layout, setpoint coalescing under the ACK credit, decoding of
+// the Pico's frames and text lines. Exits non-zero if a check fails.
+
+#include "tracks_client.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+static int failures = 0;
+
+#define CHECK(cond)                                                      \
+    do {                                                                 \
+        if (!(cond)) {                                                   \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                  \
+        }                                                                \
+    } while (0)
+
+static uint8_t crc8(const uint8_t *data, int len) {
+    uint8_t crc = 0;
+    while (len--) {
+        crc ^= *data++;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+// What the client wrote within timeout_ms of the first byte
+static int read_pico(int fd, uint8_t *buf, int size, int timeout_ms) {
+    int len = 0;
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    while (len < size && poll(&pfd, 1, timeout_ms) > 0) {
+        ssize_t n = read(fd, buf + len, size - len);
+        if (n <= 0) break;
+        len += (int)n;
+        timeout_ms = 20; // the rest of a burst
+    }
+    return len;
+}
+
+static void send_pico_frame(int fd, uint8_t type, const uint8_t *payload, int len) {
+    uint8_t frame[64] = { 0xA5, type, 0 };
+    memcpy(frame + 3, payload, len);
+    frame[3 + len] = crc8(frame + 1, len + 2);
+    if (write(fd, frame, len + 4) != len + 4) failures++;
+}
+
+static void send_ack(int fd, uint8_t seq, uint8_t superseded) {
+    uint8_t payload[10] = { seq };
+    payload[9] = superseded;
+    send_pico_frame(fd, 0x83, payload, sizeof(payload));
+}
+
+int main() {
+    int master, slave;
+    char name[64];
+    if (openpty(&master, &slave, name, NULL, NULL) < 0) {
+        perror("openpty");
+        return 1;
+    }
+    struct termios tio;
+    tcgetattr(master, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(master, TCSANOW, &tio);
+
+    tracks_client_t *client = tracks_open(name, 115200, 1);
+    CHECK(client != NULL);
+    if (!client) return 1;
+    uint8_t buf[256];
+    int len = read_pico(master, buf, sizeof(buf), 500);
+    CHECK(len == 6 && memcmp(buf, "ack 1\n", 6) == 0);
+
+    // A MOVE frame as encode_move() builds it: 0.5 -> 50, -1.25 -> -125
+    tracks_move(client, 0.5f, -1.25f);
+    len = read_pico(master, buf, sizeof(buf), 500);
+    const uint8_t move[] = { 0xA5, 0x01, 0x00, 50, 0, (uint8_t)-125, 0xFF, 0 };
+    CHECK(len == 8 && memcmp(buf, move, 7) == 0 && buf[7] == crc8(buf + 1, 6));
+
+    // The one credit is taken: newer setpoints wait, the newest goes out with the ACK
+    tracks_move(client, 10, 0);
+    tracks_move(client, 20, 0);
+    tracks_move(client, 30, 5);
+    CHECK(read_pico(master, buf, sizeof(buf), 50) == 0);
+    send_ack(master, 0, 0);
+    len = read_pico(master, buf, sizeof(buf), 500);
+    CHECK(len == 8 && buf[1] == 0x01 && buf[2] == 1 && buf[3] == (3000 & 0xFF) && buf[4] == 3000 >> 8 && buf[5] == (500 & 0xFF));
+    tracks_stats_t stats;
+    tracks_get_stats(client, &stats);
+    CHECK(stats.moves_sent == 2 && stats.moves_coalesced == 2 && stats.moves_acked == 1 && stats.in_flight == 1);
+
+    // An unchanged setpoint is not sent again; without an ACK the credit returns after the timeout
+    tracks_move(client, 30, 5);
+    CHECK(read_pico(master, buf, sizeof(buf), 50) == 0);
+    tracks_move(client, 0, 0);
+    len = read_pico(master, buf, sizeof(buf), TRACKS_ACK_TIMEOUT_MS + 200);
+    CHECK(len == 8 && buf[3] == 0 && buf[5] == 0);
+
+    // Heartbeats and text commands
+    tracks_heartbeat(client);
+    CHECK(tracks_command(client, "telemetry 20"));
+    len = read_pico(master, buf, sizeof(buf), 500);
+    CHECK(len == 13 + 4 && memcmp(buf, "telemetry 20\n", 13) == 0 && buf[13] == 0xA5 && buf[14] == 0x02);
+
+    // Frames and text from the Pico, mixed
+    uint8_t telemetry[45] = {};
+    telemetry[0] = 0x2C; telemetry[1] = 0x01;      // left duty 300
+    telemetry[10] = 1 | 4;                        // failsafe, right stall
+    telemetry[37] = 12;                           // moves coalesced
+    telemetry[41] = 3;                            // RX overflows
+    const char *text = "Track Controller Initialized.\r\n";
+    if (write(master, text, strlen(text)) < 0) failures++;
+    send_pico_frame(master, 0x82, telemetry, sizeof(telemetry));
+    int32_t odometry[4] = { 60, -20, 3000, -1000 };
+    send_pico_frame(master, 0x81, (const uint8_t *)odometry, sizeof(odometry));
+    send_ack(master, 2, 3);
+    usleep(100000);
+    tracks_telemetry_t t;
+    CHECK(tracks_telemetry(client, &t) == 1 && t.left_duty == 300 && t.flags == 5 && t.moves_coalesced == 12 && t.rx_overflows == 3 && t.host_ns);
+    CHECK(tracks_telemetry(client, &t) == 0);
+    tracks_odometry_t o;
+    CHECK(tracks_odometry(client, &o) == 1 && o.left_count == 60 && o.right_speed == -1000);
+    char line[64];
+    CHECK(tracks_line(client, line, sizeof(line)) == 1 && strcmp(line, "Track Controller Initialized.") == 0);
+    CHECK(tracks_line(client, line, sizeof(line)) == 0);
+    tracks_get_stats(client, &stats);
+    CHECK(stats.in_flight == 0 && stats.bad_frames == 0 && stats.error == 0);
+
+    // Closing stops the tracks
+    tracks_move(client, 50, 0);
+    read_pico(master, buf, sizeof(buf), 100);
+    tracks_close(client);
+    len = read_pico(master, buf, sizeof(buf), 500);
+    CHECK(len >= 9 && memcmp(buf, "move 0 0\n", 9) == 0);
+
+    close(slave);
+    close(master);
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("tracks client: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,394 @@
+// Host benchmark of the track control core (track_control.h): runs simulated
+// command streams through track_control_tick() and reports the step response
+// in control ticks, the stall cut-off, the heading hold, the response curve, the cost of one
+// tick and of parsing a move command. Exits non-zero if the response breaks the ramp, failsafe,
+// stall or heading limits, the curve strays from its formula or the parser disagrees with
+// strtod(), so it doubles as a test.
+//
+// Usage: track_control_bench [ticks]   (default 2000000 for the cost run)
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "track_control.h"
+
+#define TICK_MS (CONTROL_PERIOD_US / 1000)
+
+// Simulated HAL: remembers the outputs and checks every change of them
+typedef struct {
+    int output[2];
+    int max_step; // allowed change per tick
+    int violations;
+    int current_ma[2]; // what read_current reports
+    int yaw_drift;     // cdps the tracks turn at equal duty
+    int64_t heading;   // turned so far, centidegrees/1000
+} sim_hal_t;
+
+static void sim_set_outputs(void *ctx, const int duty[2]) {
+    sim_hal_t *sim = (sim_hal_t *)ctx;
+    for (int track = 0; track < 2; track++) {
+        int change = abs(duty[track] - sim->output[track]);
+        if (change > sim->max_step || abs(duty[track]) > DUTY_MAX) sim->violations++;
+        sim->output[track] = duty[track];
+    }
+}
+
+static int sim_read_current(void *ctx, int track) {
+    return ((sim_hal_t *)ctx)->current_ma[track];
+}
+
+// The robot turns at HEADING_RATE_MAX for full angular duty, plus a drift
+static int sim_read_yaw_rate(void *ctx) {
+    sim_hal_t *sim = (sim_hal_t *)ctx;
+    int rate = (sim->output[1] - sim->output[0]) / 2 * HEADING_RATE_MAX / DUTY_MAX + sim->yaw_drift;
+    sim->heading += rate * TICK_MS;
+    return rate;
+}
+
+// A control loop with its command side, driven one tick at a time
+typedef struct {
+    track_control_t ctl;
+    motion_queue_t queue;
+    uint32_t setpoint;
+    uint32_t count;
+    uint32_t heartbeat_age_ms;
+    sim_hal_t sim;
+    track_hal_t hal;
+} sim_t;
+
+static void sim_init(sim_t *s) {
+    *s = sim_t{};
+    s->sim.max_step = FAILSAFE_RAMP_STEP;
+    s->hal = { sim_set_outputs, &s->sim, sim_read_current, sim_read_yaw_rate };
+}
+
+static void sim_move(sim_t *s, int linear, int angular) {
+    int left, right;
+    mix_tracks(linear, angular, &left, &right);
+    motion_flush(&s->queue);
+    s->setpoint = setpoint_pack(left, right, ++s->count);
+    s->heartbeat_age_ms = 0;
+}
+
+static void sim_tick(sim_t *s) {
+    track_control_tick(&s->ctl, &s->queue, s->setpoint, s->heartbeat_age_ms, &s->hal);
+    s->heartbeat_age_ms += TICK_MS;
+}
+
+// Tick until the left output reaches target; ticks[i] is when it first got
+// 10%, 90% and 100% of the way there from its current value, -1 if not
+// within limit ticks
+static void step_to(sim_t *s, int target, int limit, int ticks[3]) {
+    const float fractions[3] = { 0.1f, 0.9f, 1.0f };
+    int start = s->sim.output[0];
+    for (int i = 0; i < 3; i++) ticks[i] = -1;
+    for (int t = 1; t <= limit && ticks[2] < 0; t++) {
+        sim_tick(s);
+        int out = s->sim.output[0];
+        for (int i = 0; i < 3; i++) {
+            float goal = start + (target - start) * fractions[i];
+            if (ticks[i] < 0 && (target >= start ? out >= goal : out <= goal)) ticks[i] = t;
+        }
+    }
+}
+
+static int failures = 0;
+
+static void expect(bool ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// Rise time and settling of a full scale step, a reversal and the failsafe stop
+static void step_response() {
+    printf("step response (ticks of %d us)\n", CONTROL_PERIOD_US);
+    const int full_ticks = DUTY_MAX / RAMP_STEP;
+    const int stop_ticks = DUTY_MAX / FAILSAFE_RAMP_STEP;
+
+    sim_t s;
+    sim_init(&s);
+    sim_move(&s, -100 * COMMAND_SCALE, 0); // full forward
+    int ticks[3];
+    step_to(&s, -DUTY_MAX, 1000, ticks);
+    printf("  0 -> full forward     10%% %4d  90%% %4d  100%% %4d\n", ticks[0], ticks[1], ticks[2]);
+    expect(ticks[2] == full_ticks, "full scale step takes DUTY_MAX / RAMP_STEP ticks");
+
+    sim_move(&s, 100 * COMMAND_SCALE, 0); // straight into full reverse
+    step_to(&s, DUTY_MAX, 1000, ticks);
+    printf("  full fwd -> full rev  10%% %4d  90%% %4d  100%% %4d\n", ticks[0], ticks[1], ticks[2]);
+    expect(ticks[2] == 2 * full_ticks, "reversal takes twice the full scale ramp");
+
+    s.heartbeat_age_ms = HEARTBEAT_TIMEOUT_US / 1000 + 1; // heartbeat lost
+    step_to(&s, 0, 1000, ticks);
+    printf("  failsafe full -> 0    10%% %4d  90%% %4d  100%% %4d\n", ticks[0], ticks[1], ticks[2]);
+    expect(ticks[2] == stop_ticks, "failsafe stops within DUTY_MAX / FAILSAFE_RAMP_STEP ticks");
+    expect(s.ctl.failsafe, "failsafe flag set while the heartbeat is missing");
+
+    s.heartbeat_age_ms = 0; // heartbeat back, but no new command
+    for (int t = 0; t < 100; t++) sim_tick(&s);
+    expect(s.sim.output[0] == 0 && !s.ctl.failsafe, "a heartbeat alone does not resume driving");
+
+    // A queued manoeuvre: ramp to half forward in 200 ms, hold, stop in 200 ms
+    sim_move(&s, 0, 0);
+    motion_push(&s.queue, -50 * COMMAND_SCALE, 0, 200);
+    motion_push(&s.queue, -50 * COMMAND_SCALE, 0, 300);
+    motion_push(&s.queue, 0, 0, 200);
+    int worst = 0;
+    for (int t = 1; t <= 800; t++) {
+        sim_tick(&s);
+        int ideal = t <= 200 ? -DUTY_MAX / 2 * t / 200 : t <= 500 ? -DUTY_MAX / 2 :
+                    t <= 700 ? -DUTY_MAX / 2 * (700 - t) / 200 : 0;
+        int error = abs(s.sim.output[0] - ideal);
+        if (error > worst) worst = error;
+    }
+    printf("  motion queue ramp/hold/stop, worst deviation %d duty\n", worst);
+    expect(worst <= 2 * RAMP_STEP, "queued ramps within the slew limit are followed");
+    expect(s.sim.output[0] == 0, "queued manoeuvre ends at its last target");
+    expect(s.sim.violations == 0, "outputs stay within DUTY_MAX and the slew limit");
+}
+
+// Ticks from a blocked track to its duty being cut, the hold and the recovery
+static void stall_response() {
+    printf("stall detection\n");
+    sim_t s;
+    sim_init(&s);
+    s.sim.max_step = DUTY_MAX; // the cut is a step by design
+    sim_move(&s, -100 * COMMAND_SCALE, 0);
+    for (int t = 0; t < 300; t++) sim_tick(&s);
+    s.sim.current_ma[0] = 2 * STALL_CURRENT_MA; // left track blocked
+    int cut = -1;
+    for (int t = 1; t <= 100 && cut < 0; t++) {
+        s.heartbeat_age_ms = 0;
+        sim_tick(&s);
+        if (abs(s.sim.output[0]) <= STALL_DUTY) cut = t;
+    }
+    printf("  blocked -> duty cut  %4d ticks\n", cut);
+    expect(cut > 0 && cut <= STALL_TICKS + 2, "a stalled track is cut within STALL_TICKS plus the filter lag");
+    expect(s.sim.output[1] == -DUTY_MAX && s.ctl.stalled == 1, "only the stalled track is cut");
+
+    s.sim.current_ma[0] = STALL_CURRENT_MA / 2; // free again
+    int restored = -1;
+    for (int t = 1; t <= 2 * STALL_HOLD_TICKS && restored < 0; t++) {
+        s.heartbeat_age_ms = 0;
+        sim_tick(&s);
+        if (s.sim.output[0] == -DUTY_MAX) restored = t;
+    }
+    printf("  freed -> full duty   %4d ticks\n", restored);
+    expect(restored > 0 && s.ctl.stalled == 0, "a freed track ramps back up after the hold");
+    expect(abs(s.ctl.current_ma[0] - STALL_CURRENT_MA / 2) <= 4, "the filtered current settles on the sensed one");
+}
+
+// Heading after driving straight against a drift, with and without the hold,
+// and the turn rate of a turn request
+static void heading_response() {
+    printf("heading hold (drift %d cdps)\n", HEADING_RATE_MAX / 10);
+    for (int hold = 0; hold < 2; hold++) {
+        sim_t s;
+        sim_init(&s);
+        s.sim.yaw_drift = HEADING_RATE_MAX / 10;
+        s.ctl.heading_hold = hold;
+        sim_move(&s, -50 * COMMAND_SCALE, 0);
+        for (int t = 0; t < 2000; t++) {
+            s.heartbeat_age_ms = 0;
+            sim_tick(&s);
+        }
+        printf("  straight 2 s, hold %s: heading %+.1f deg\n", hold ? "on " : "off", s.sim.heading / 100000.0);
+        if (hold) {
+            expect(llabs(s.sim.heading) < 300000, "the hold keeps the heading within 3 degrees against the drift");
+            expect(s.sim.violations == 0, "the heading correction stays within the slew limit");
+        }
+    }
+    sim_t s;
+    sim_init(&s);
+    s.sim.yaw_drift = HEADING_RATE_MAX / 10;
+    s.ctl.heading_hold = true;
+    sim_move(&s, 0, 50 * COMMAND_SCALE); // half rate turn on the spot
+    for (int t = 0; t < 2000; t++) {
+        s.heartbeat_age_ms = 0;
+        sim_tick(&s);
+    }
+    int64_t before = s.sim.heading;
+    for (int t = 0; t < 1000; t++) {
+        s.heartbeat_age_ms = 0;
+        sim_tick(&s);
+    }
+    double rate = (s.sim.heading - before) / 1000.0;
+    printf("  turn request %d cdps: %.0f cdps\n", HEADING_RATE_MAX / 2, rate);
+    expect(fabs(rate - HEADING_RATE_MAX / 2) < HEADING_RATE_MAX / 50, "a turn request is followed as a rate");
+}
+
+// The curve's table against its formula in floating point, its edges, and a
+// control loop driving through it
+static void curve_response() {
+    printf("response curve\n");
+    const int settings[][2] = { { 0, 0 }, { 30 * COMMAND_SCALE, 0 }, { 0, 10 * COMMAND_SCALE },
+                                { 50 * COMMAND_SCALE, 5 * COMMAND_SCALE }, { MIX_EXPO_MAX, MIX_DEADBAND_MAX } };
+    for (const auto &setting : settings) {
+        mix_curve_t curve;
+        expect(mix_curve_init(&curve, setting[0], setting[1]), "valid curve settings are taken");
+        double e = setting[0] / (double)MIX_EXPO_MAX, dead = setting[1] / (100.0 * COMMAND_SCALE);
+        int worst = 0, previous = 0;
+        bool monotonic = true, odd = true, dead_zero = true;
+        for (int duty = 0; duty <= DUTY_MAX; duty++) {
+            int shaped = mix_curve_apply(&curve, duty);
+            double x = duty / (double)DUTY_MAX > dead ? (duty / (double)DUTY_MAX - dead) / (1 - dead) : 0;
+            int expected = (int)lround(((1 - e) * x + e * x * x * x) * DUTY_MAX);
+            if (abs(shaped - expected) > worst) worst = abs(shaped - expected);
+            if (shaped < previous) monotonic = false;
+            if (mix_curve_apply(&curve, -duty) != -shaped) odd = false;
+            if (duty <= dead * DUTY_MAX && shaped != 0) dead_zero = false;
+            previous = shaped;
+        }
+        printf("  expo %3d%% deadband %2d%%: worst difference from the formula %d duty\n",
+               setting[0] / COMMAND_SCALE, setting[1] / COMMAND_SCALE, worst);
+        expect(worst <= DUTY_MAX / 1000, "the interpolated table follows the curve's formula within 0.1 %");
+        expect(mix_curve_apply(&curve, DUTY_MAX) == DUTY_MAX, "full scale stays full scale");
+        expect(monotonic && odd && dead_zero, "the curve is monotonic, odd and zero within the deadband");
+    }
+    mix_curve_t curve;
+    expect(!mix_curve_init(&curve, MIX_EXPO_MAX + 1, 0) && !mix_curve_init(&curve, 0, MIX_DEADBAND_MAX + 1) &&
+           !mix_curve_init(&curve, -1, 0), "out of range settings are refused");
+
+    mix_curve_init(&curve, 50 * COMMAND_SCALE, 0);
+    sim_t s;
+    sim_init(&s);
+    s.ctl.curve = &curve;
+    sim_move(&s, -50 * COMMAND_SCALE, 20 * COMMAND_SCALE);
+    for (int t = 0; t < 500; t++) sim_tick(&s);
+    int left, right;
+    mix_tracks(-50 * COMMAND_SCALE, 20 * COMMAND_SCALE, &left, &right);
+    expect(s.sim.output[0] == mix_curve_apply(&curve, left) && s.sim.output[1] == mix_curve_apply(&curve, right),
+           "the control loop settles on the shaped targets");
+    expect(s.ctl.target[0] == left && s.ctl.curve_used == &curve, "the loop keeps the commanded target and notes its curve");
+    expect(s.sim.violations == 0, "the shaped outputs stay within the slew limit");
+}
+
+// Per tick cost over a command stream with moves, queued segments and
+// heartbeat gaps, as the firmware sees it from a noisy host
+static void cycle_cost(long ticks) {
+    sim_t s;
+    sim_init(&s);
+    mix_curve_t curve;
+    mix_curve_init(&curve, 30 * COMMAND_SCALE, 5 * COMMAND_SCALE); // the mixer stage costs its part too
+    s.ctl.curve = &curve;
+    srand(1);
+    long blocks = ticks / 1000, slow_blocks = 0;
+    double block_ns_max = 0, total_ns = 0;
+    for (long b = 0; b < blocks; b++) {
+        // command side between blocks, like core 0 between ticks
+        int r = rand() % 100;
+        if (r < 60) {
+            sim_move(&s, (rand() % 201 - 100) * COMMAND_SCALE, (rand() % 201 - 100) * COMMAND_SCALE);
+        } else if (r < 80) {
+            for (int i = 0; i < 3; i++)
+                motion_push(&s.queue, (rand() % 201 - 100) * COMMAND_SCALE, 0, (uint16_t)(rand() % 400));
+            s.heartbeat_age_ms = 0;
+        } else if (r < 85) {
+            s.heartbeat_age_ms = HEARTBEAT_TIMEOUT_US / 1000 - 500; // runs into the failsafe
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (int t = 0; t < 1000; t++) {
+            if (t == 800 && r >= 85) sim_move(&s, 10 * COMMAND_SCALE, 0);
+            sim_tick(&s);
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        total_ns += ns;
+        if (ns > block_ns_max) block_ns_max = ns;
+        if (ns / 1000 > 1000.0) slow_blocks++; // over 1 us per tick on the host
+    }
+    printf("cycle cost over %ld ticks\n", blocks * 1000);
+    printf("  mean %.1f ns/tick, worst 1000 tick block %.1f ns/tick, %ld blocks over 1 us/tick\n",
+           total_ns / (blocks * 1000), block_ns_max / 1000, slow_blocks);
+    printf("  %.3f%% of the %d us period at host speed\n",
+           total_ns / (blocks * 1000) / (CONTROL_PERIOD_US * 10.0), CONTROL_PERIOD_US);
+    expect(s.sim.violations == 0, "outputs stay within DUTY_MAX and the slew limit over the stream");
+}
+
+// parse_scaled() against strtod() and the float mixing it replaces, then the
+// cost of a "move" command's numbers and mixing both ways
+static void command_parsing(long count) {
+    printf("command parsing\n");
+    const char *numbers[] = { "0", "-100", "100", "50.5", "-12.345", "0.999", "+7", "1e-05", "-3.2e1",
+                              "99.99", "-0.01", "1e3", "65535", "-100000" };
+    int mismatches = 0;
+    for (const char *text : numbers) {
+        const char *p = text;
+        int16_t value;
+        double expected = strtod(text, NULL) * COMMAND_SCALE;
+        if (expected > INT16_MAX) expected = INT16_MAX;
+        if (expected < -INT16_MAX) expected = -INT16_MAX;
+        if (!parse_scaled(&p, &value) || value != (int16_t)expected || *p) {
+            printf("  %s parsed as %d, expected %d\n", text, value, (int16_t)expected);
+            mismatches++;
+        }
+    }
+    const char *bad[] = { "", "-", ".", "1x", "1e", "--1", "1.2.3" };
+    for (const char *text : bad) {
+        const char *p = text;
+        int16_t value;
+        if (parse_scaled(&p, &value)) {
+            printf("  \"%s\" accepted\n", text);
+            mismatches++;
+        }
+    }
+    expect(mismatches == 0, "parse_scaled() agrees with strtod() and rejects malformed numbers");
+
+    int worst = 0;
+    for (int linear = -100; linear <= 100; linear++) {
+        for (int angular = -100; angular <= 100; angular += 5) {
+            int left, right;
+            mix_tracks(linear * COMMAND_SCALE, angular * COMMAND_SCALE, &left, &right);
+            int expected = clamp_track_duty((int)((float)(linear - angular) * (DUTY_MAX / 100)));
+            if (abs(left - expected) > worst) worst = abs(left - expected);
+        }
+    }
+    printf("  Q15 mixing, worst difference from float %d duty\n", worst);
+    expect(worst <= 1, "Q15 mixing matches the float mixing within one duty step");
+
+    char commands[64][32];
+    for (int i = 0; i < 64; i++)
+        snprintf(commands[i], sizeof(commands[i]), "%.6g %.6g", (rand() % 20001 - 10000) / 100.0,
+                 (rand() % 20001 - 10000) / 100.0);
+    int sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < count; i++) {
+        float linear, angular;
+        if (sscanf(commands[i & 63], "%f %f", &linear, &angular) == 2)
+            sink += clamp_track_duty((int)((linear - angular) * (DUTY_MAX / 100)));
+    }
+    double float_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    start = std::chrono::steady_clock::now();
+    for (long i = 0; i < count; i++) {
+        const char *p = commands[i & 63];
+        int16_t linear, angular;
+        int left, right;
+        if (parse_scaled(&p, &linear) && parse_scaled(&p, &angular)) {
+            mix_tracks(linear, angular, &left, &right);
+            sink += left;
+        }
+    }
+    double fixed_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    printf("  move numbers: sscanf + float %.1f ns, parse_scaled + Q15 %.1f ns (%d)\n",
+           float_ns / count, fixed_ns / count, sink & 1);
+}
+
+int main(int argc, char **argv) {
+    long ticks = argc > 1 ? strtol(argv[1], NULL, 10) : 2000000;
+    if (ticks < 1000) ticks = 1000;
+    step_response();
+    stall_response();
+    heading_response();
+    curve_response();
+    cycle_cost(ticks);
+    command_parsing(ticks / 10);
+    if (failures) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
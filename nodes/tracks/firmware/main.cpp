@@ -1,9 +1,49 @@
 #include "pico/stdlib.h"
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
 #include <stdlib.h>
+#include "hardware/adc.h"
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/flash.h"
+#include "hardware/i2c.h"
+#include "hardware/pio.h"
 #include "hardware/pwm.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+#include "pico/multicore.h"
 #include "pico/time.h"
+#include "quadrature_encoder.pio.h"
+#include "track_control.h"
+
+// Command and telemetry link, picked at build time by TRACKS_TRANSPORT in
+// CMakeLists.txt. LINK_USB writes straight into the TinyUSB CDC FIFO and runs
+// tud_task() from the main loop, LINK_UART hands UART0 its output by DMA, and
+// LINK_STDIO is the SDK stdio on both, which copies every write to both and
+// waits while either is busy. LINK_VENDOR is LINK_USB plus a vendor class
+// interface with a bulk endpoint each way (usb_descriptors.c) that carries the
+// binary frames; the CDC serial port is left with the text log
+#define LINK_STDIO  0
+#define LINK_USB    1
+#define LINK_UART   2
+#define LINK_VENDOR 3
+#ifndef LINK_TRANSPORT
+#define LINK_TRANSPORT LINK_STDIO
+#endif
+#define LINK_TINYUSB (LINK_TRANSPORT == LINK_USB || LINK_TRANSPORT == LINK_VENDOR)
+#if LINK_TINYUSB
+#include "tusb.h"
+#elif LINK_TRANSPORT == LINK_UART
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/uart.h"
+#define LINK_UART_ID      uart0
+#define LINK_UART_IRQ     UART0_IRQ
+#define LINK_UART_BAUD    115200
+#define LINK_UART_TX_PIN  0
+#define LINK_UART_RX_PIN  1
+#endif
 
 // GPIO Pin definitions (adjust if different)
 #define LEFT_VCC_PIN  2
@@ -12,15 +52,490 @@
 #define RIGHT_VCC_PIN 6
 #define RIGHT_DIR_PIN 8
 #define RIGHT_PWM_PIN 7
+#define LEFT_ENC_PIN  10 // encoder phase A, phase B on the next pin
+#define RIGHT_ENC_PIN 12
+
+// PWM frequency, "pwm <hz> [wrap]" changes it and stores it in flash. Without
+// a wrap the finest resolution (largest wrap up to 65535) is picked
+#define PWM_DEFAULT_FREQ_HZ 20000 // above the audible range
+#define PWM_MIN_WRAP        99    // at least 100 duty steps
+#define PWM_LATCH_GUARD     16    // counts before a wrap in which both levels might not land in the same period
+
+// Core 0 parses commands and only sets a target duty per track. Core 1 runs
+// the control loop of track_control.h every CONTROL_PERIOD_US, so ramping and
+// the failsafe keep working however long core 0 is stuck on the USB link
+
+// Failsafe backstop: a hardware alarm that every heartbeat pushes back to
+// FAILSAFE_BACKSTOP_US ahead. Control ticks ramp the tracks down once the
+// heartbeat is HEARTBEAT_TIMEOUT_US old; should core 1 have stopped ticking by
+// the time the alarm fires, its interrupt on core 0 cuts the PWM instead
+#define FAILSAFE_BACKSTOP_US (HEARTBEAT_TIMEOUT_US + 200000) // the ramp-down takes 100 ms
+
+// Odometry: PIO counts the encoder steps, core 1 samples the counts every tick
+// and derives the speed over SPEED_WINDOW_TICKS, core 0 streams both back in
+// an ODOMETRY frame every ODOMETRY_INTERVAL_MS
+#define ENCODER_PIO          pio0
+#define SPEED_WINDOW_TICKS   10 // 10 ms
+#define ODOMETRY_INTERVAL_MS 50 // 20 Hz
+
+// Motor current: the drivers' current sense outputs on ADC0/ADC1, sampled
+// round robin by the ADC into a DMA ring without any CPU work; every control
+// tick averages the newest CURRENT_AVG_SAMPLES of each track
+#define CURRENT_ADC_PIN        26    // left on ADC0, right on the next pin (ADC1)
+#define CURRENT_SAMPLE_HZ      16000 // both channels together, 8 samples per track per tick
+#define CURRENT_RING_LEN       64    // samples, power of two, alternating left/right
+#define CURRENT_AVG_SAMPLES    8     // power of two
+#define CURRENT_SENSE_MV_PER_A 500   // driver current sense output
+#define ADC_VREF_MV            3300
+
+// Gyro for the heading hold: an MPU-6050 on I2C1. Core 1 kicks off a DMA read
+// of the yaw rate register every control tick and picks up the result of the
+// previous one, so the loop never waits on the bus (1 kHz, ~120 us per read)
+#define IMU_I2C          i2c1
+#define IMU_SDA_PIN      14
+#define IMU_SCL_PIN      15
+#define IMU_I2C_HZ       400000
+#define IMU_ADDR         0x68 // AD0 low
+#define IMU_YAW_SIGN     1    // -1 if the IMU is mounted so that turning left reads negative
+#define IMU_BIAS_SAMPLES 256  // averaged at boot while standing still
+#define IMU_TIMEOUT_TICKS 5   // a read still running after this many ticks is aborted
+
+// Control loop statistics, compiled out with CONTROL_STATS 0: a histogram of
+// the period between tick starts (bucket bounds relative to
+// CONTROL_PERIOD_US), the worst tick, the deadlines missed (a tick ending
+// after the next one was due) and the most bytes waiting on the link, all
+// since boot or "stats reset"; "stats" prints them, TELEMETRY carries the
+// last two
+#ifndef CONTROL_STATS
+#define CONTROL_STATS 1
+#endif
+#define PERIOD_BUCKETS 8
+
+// Default period of the TELEMETRY frame, "telemetry <ms>" changes it (0 = off).
+// Debug text (command echo, targets) is off unless enabled with "verbose 1"
+#define TELEMETRY_INTERVAL_MS 100
+
+// Binary frames, accepted next to the text commands:
+//   sync, type, seq, payload, crc
+// The CRC-8 (poly 0x07) covers type, seq and payload. MOVE carries linear and
+// angular as little-endian int16 in 1/100 of a text command unit (-100..100).
+// MOTION queues a manoeuvre: flags (bit 0 flushes the queue first), count,
+// then count segments of linear, angular (int16 as in MOVE) and duration ms
+// (uint16), see the motion queue below. PING carries a host token (uint32)
+// that comes straight back in a PONG.
+// Binary commands are not echoed, see the "stats" text command. Frames sent
+// by the Pico have the high bit set in the type, all fields little-endian:
+//   ODOMETRY  left/right encoder count, left/right speed (steps/s), int32
+//   TELEMETRY left/right signed duty (int16), heartbeat age ms, longest
+//             control tick us, worst tick lateness us (uint16), flags (uint8),
+//             frames ok/bad/lost, dropped log lines (uint32), left/right
+//             filtered motor current mA (uint16), missed control deadlines
+//             (uint32), link RX high-water mark in bytes (uint16), moves
+//             replaced by a newer one before being applied (uint32), received
+//             bytes dropped because the RX ring was full (uint32)
+//   ACK       after "ack 1", per MOVE frame whose setpoint reached the PWM:
+//             its seq (uint8), received and applied time_us_64() (low uint32),
+//             MOVE frames received since the previous ACK that this one
+//             replaced before they were applied (uint8, saturating)
+//   PONG      PING token (uint32), time_us_64() on receipt (uint64)
+#define FRAME_SYNC      0xA5 // never part of an ASCII text command
+#define FRAME_MOVE      0x01
+#define FRAME_HEARTBEAT 0x02
+#define FRAME_MOTION    0x03
+#define FRAME_PING      0x04
+#define FRAME_ODOMETRY  0x81
+#define FRAME_TELEMETRY 0x82
+#define FRAME_ACK       0x83
+#define FRAME_PONG      0x84
+#define FRAME_MOTION_FLUSH 0x01
+#define FRAME_MAX_LEN   (6 + 6 * MOTION_QUEUE_LEN)
+#define FRAME_OUT_MAX_LEN 49
+#define TELEMETRY_FAILSAFE 0x01 // flags: heartbeat missing, tracks stopped
+#define TELEMETRY_STALL_LEFT  0x02 // flags: duty cut by a stall, see track_control.h
+#define TELEMETRY_STALL_RIGHT 0x04
+
+static uint32_t frames_ok = 0, frames_bad = 0, frames_lost = 0;
+static uint32_t telemetry_interval_ms = TELEMETRY_INTERVAL_MS;
+static bool ack_enabled = false; // "ack 1" sends an ACK per applied MOVE frame
+// Received bytes handled per main loop pass before the newest move is applied
+#define RX_DRAIN_MAX 256
+
+// Log output is queued in a ring and written out by the main loop between
+// received bytes, so a congested USB CDC link never stalls command parsing.
+// Received bytes wait in a ring too, between the link and the parser: they
+// are taken out of the transport as they arrive (by the UART interrupt on
+// LINK_UART), parsed in bursts of up to RX_DRAIN_MAX, and the newest move of
+// each burst goes to core 1 as its setpoint
+#define TX_RING_SIZE 2048 // power of two
+#define RX_RING_SIZE 512  // power of two
+#define IO_CHUNK     64   // bytes handed to the link per write
+
+typedef struct {
+    uint8_t *buf;
+    uint32_t mask;          // size - 1
+    volatile uint32_t head; // only advanced by the producer
+    volatile uint32_t tail; // only advanced by the consumer
+} byte_ring_t;
 
-#define PWM_WRAP_VALUE 1000 // Max PWM duty cycle value
-#define HEARTBEAT_TIMEOUT_US 3000000 // 3 seconds
+static uint8_t tx_buf[TX_RING_SIZE], rx_buf[RX_RING_SIZE];
+static byte_ring_t tx_ring = { tx_buf, TX_RING_SIZE - 1, 0, 0 };
+static byte_ring_t rx_ring = { rx_buf, RX_RING_SIZE - 1, 0, 0 };
+static uint32_t log_dropped = 0;           // log lines dropped because the link fell behind
+static volatile uint32_t rx_overflows = 0; // bytes dropped because the parser fell behind
+
+static uint32_t ring_used(const byte_ring_t *r) {
+    return r->head - r->tail;
+}
+
+static uint32_t ring_free(const byte_ring_t *r) {
+    return r->mask + 1 - ring_used(r);
+}
+
+static bool ring_push(byte_ring_t *r, uint8_t c) {
+    if (ring_free(r) == 0) return false;
+    r->buf[r->head & r->mask] = c;
+    __dmb(); // data before index, the consumer may be an interrupted loop
+    r->head = r->head + 1;
+    return true;
+}
+
+static int ring_pop(byte_ring_t *r) {
+    if (r->tail == r->head) return -1;
+    __dmb();
+    int c = r->buf[r->tail & r->mask];
+    __dmb(); // read the byte before handing the slot back
+    r->tail = r->tail + 1;
+    return c;
+}
+
+static bool verbose = false; // "verbose 1" enables log_debug() output
+
+static void log_vprintf(const char *fmt, va_list args) {
+    char line[128];
+    int len = vsnprintf(line, sizeof(line), fmt, args);
+    if (len < 0) return;
+    if (len >= (int)sizeof(line)) len = sizeof(line) - 1;
+    if (ring_free(&tx_ring) < (uint32_t)len) {
+        log_dropped++;
+        return;
+    }
+    for (int i = 0; i < len; i++)
+        ring_push(&tx_ring, (uint8_t)line[i]);
+}
 
-// Clamp speed to the allowed PWM range (0 to PWM_WRAP_VALUE)
-static int clamp_pwm_duty(int duty) {
-    if (duty < 0) return 0;
-    if (duty > PWM_WRAP_VALUE) return PWM_WRAP_VALUE;
-    return duty;
+// printf() replacement: queues the whole line or drops it, never blocks
+static void log_printf(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    log_vprintf(fmt, args);
+    va_end(args);
+}
+
+// Like log_printf(), only while verbose
+static void log_debug(const char *fmt, ...) {
+    if (!verbose) return;
+    va_list args;
+    va_start(args, fmt);
+    log_vprintf(fmt, args);
+    va_end(args);
+}
+
+#if LINK_TRANSPORT == LINK_UART
+static int link_dma_chan;
+static uint8_t link_dma_buf[IO_CHUNK]; // the chunk in flight, the ring may reuse its bytes meanwhile
+
+// UART RX interrupt (FIFO level or timeout): empty the 32 byte FIFO into
+// rx_ring, however long the main loop is busy
+static void link_uart_irq() {
+    while (uart_is_readable(LINK_UART_ID)) {
+        if (!ring_push(&rx_ring, (uint8_t)uart_getc(LINK_UART_ID)))
+            rx_overflows = rx_overflows + 1;
+    }
+}
+#endif
+
+// Set up the link; stdio_init_all() has already run
+static void link_init() {
+#if LINK_TRANSPORT == LINK_UART
+    uart_init(LINK_UART_ID, LINK_UART_BAUD);
+    gpio_set_function(LINK_UART_TX_PIN, GPIO_FUNC_UART);
+    gpio_set_function(LINK_UART_RX_PIN, GPIO_FUNC_UART);
+    link_dma_chan = dma_claim_unused_channel(true);
+    dma_channel_config config = dma_channel_get_default_config(link_dma_chan);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, false);
+    channel_config_set_dreq(&config, uart_get_dreq(LINK_UART_ID, true));
+    dma_channel_configure(link_dma_chan, &config, &uart_get_hw(LINK_UART_ID)->dr, link_dma_buf, 0, false);
+    irq_set_exclusive_handler(LINK_UART_IRQ, link_uart_irq);
+    irq_set_enabled(LINK_UART_IRQ, true);
+    uart_set_irq_enables(LINK_UART_ID, true, false);
+#elif LINK_TRANSPORT == LINK_VENDOR
+    tusb_init(); // stdio_usb is not linked, usb_descriptors.c has the device
+#endif
+}
+
+// Housekeeping of the link, once per main loop iteration
+static void link_task() {
+#if LINK_TINYUSB
+    tud_task(); // not in the background, so all TinyUSB calls stay on core 0
+#endif
+}
+
+#if CONTROL_STATS
+// Received bytes waiting, as far as the transport tells
+static uint32_t link_rx_pending() {
+#if LINK_TRANSPORT == LINK_VENDOR
+    return tud_cdc_available() + tud_vendor_available();
+#elif LINK_TINYUSB
+    return tud_cdc_available();
+#elif LINK_TRANSPORT == LINK_UART
+    const uint32_t fr = uart_get_hw(LINK_UART_ID)->fr;
+    return fr & UART_UARTFR_RXFF_BITS ? 32 : !(fr & UART_UARTFR_RXFE_BITS); // a full FIFO holds 32
+#else
+    return 0; // stdio does not say
+#endif
+}
+#endif
+
+// Move the bytes waiting in the transport into rx_ring. TinyUSB and stdio keep
+// what does not fit until the parser has made room; on LINK_UART the
+// interrupt does this, and drops what does not fit
+static void link_fill_rx() {
+#if LINK_TINYUSB
+    while (ring_free(&rx_ring) && tud_cdc_available())
+        ring_push(&rx_ring, (uint8_t)tud_cdc_read_char());
+#elif LINK_TRANSPORT != LINK_UART
+    for (int c; ring_free(&rx_ring) && (c = getchar_timeout_us(0)) != PICO_ERROR_TIMEOUT;)
+        ring_push(&rx_ring, (uint8_t)c);
+#endif
+}
+
+// Bytes link_write() takes right now without waiting
+static uint32_t link_room() {
+#if LINK_TINYUSB
+    if (!tud_cdc_connected()) return IO_CHUNK; // nobody listening, dropped like stdio does
+    return tud_cdc_write_available();
+#elif LINK_TRANSPORT == LINK_UART
+    return dma_channel_is_busy(link_dma_chan) ? 0 : IO_CHUNK;
+#else
+    return IO_CHUNK;
+#endif
+}
+
+// Send up to link_room() bytes
+static void link_write(const uint8_t *data, int len) {
+#if LINK_TINYUSB
+    if (!tud_cdc_connected()) return;
+    tud_cdc_write(data, len);
+    tud_cdc_write_flush();
+#elif LINK_TRANSPORT == LINK_UART
+    memcpy(link_dma_buf, data, len);
+    dma_channel_transfer_from_buffer_now(link_dma_chan, link_dma_buf, len);
+#else
+    fwrite(data, 1, len, stdout);
+    fflush(stdout);
+#endif
+}
+
+// Write as much queued log output as the link takes without waiting, at most
+// IO_CHUNK bytes; returns false if nothing was written
+static bool flush_log() {
+    uint8_t chunk[IO_CHUNK];
+    uint32_t room = link_room();
+    int n = 0, c;
+    while (n < IO_CHUNK && (uint32_t)n < room && (c = ring_pop(&tx_ring)) >= 0)
+        chunk[n++] = (uint8_t)c;
+    if (n == 0) return false;
+    link_write(chunk, n);
+    return true;
+}
+
+#if LINK_TRANSPORT == LINK_VENDOR
+// Outgoing binary frames, for the vendor interface rather than between log lines
+#define FRAME_RING_SIZE 1024 // power of two
+static uint8_t frame_buf[FRAME_RING_SIZE];
+static byte_ring_t frame_ring = { frame_buf, FRAME_RING_SIZE - 1, 0, 0 };
+
+// Hand queued frames to the vendor IN endpoint, several to a bulk packet, at
+// most IO_CHUNK bytes; returns false if nothing was written
+static bool flush_frames() {
+    if (!tud_vendor_mounted()) {
+        frame_ring.tail = frame_ring.head; // nobody listening, dropped like the log
+        return false;
+    }
+    uint8_t chunk[IO_CHUNK];
+    uint32_t room = tud_vendor_write_available();
+    int n = 0, c;
+    while (n < IO_CHUNK && (uint32_t)n < room && (c = ring_pop(&frame_ring)) >= 0)
+        chunk[n++] = (uint8_t)c;
+    if (n == 0) return false;
+    tud_vendor_write(chunk, n);
+    tud_vendor_write_flush();
+    return true;
+}
+
+// Read up to max bytes the host sent to the vendor OUT endpoint into buf
+static int vendor_read(uint8_t *buf, int max) {
+    return tud_vendor_available() ? (int)tud_vendor_read(buf, max) : 0;
+}
+#endif
+
+typedef struct {
+    uint slice, chan, dir_pin;
+    uint32_t dir_mask;        // 1 << dir_pin
+    uint16_t mask_a, mask_b;  // 0xFFFF for the channel this track's level goes on, 0 for the other
+    uint enc_sm; // PIO state machine counting this track's encoder
+} track_ctl_t;
+
+// Written by core 1 only; odometry_seq is odd while an update is in progress
+typedef struct {
+    volatile int32_t count[2]; // left, right encoder steps since boot
+    volatile int32_t speed[2]; // left, right steps per second
+} odometry_t;
+
+// Setpoint word, see track_control.h. Core 0 is the only writer, core 1
+// always picks up the latest
+static track_ctl_t left_track, right_track;
+static volatile uint32_t setpoint = 0;
+static volatile uint32_t last_heartbeat_ms = 0;
+static uint failsafe_alarm;
+static volatile bool backstop_fired = false; // the alarm cut the PWM, core 0 logs it
+static track_control_t control = {}; // core 1 only, bar the heading_hold write and the output, failsafe, stall and rate reads
+static motion_queue_t motion_queue = {};
+static odometry_t odometry;
+static volatile uint32_t odometry_seq = 0;
+// Control loop timing in us, maxima since core 0 last set timing_reset
+static volatile uint32_t tick_max_us = 0, tick_late_max_us = 0;
+static volatile bool timing_reset = false;
+#if CONTROL_STATS
+static const int period_bounds_us[PERIOD_BUCKETS - 1] = { -100, -20, -5, 5, 20, 100, 500 }; // upper, exclusive
+static volatile uint32_t period_hist[PERIOD_BUCKETS]; // written by core 1
+static volatile uint32_t tick_wcet_us = 0, deadlines_missed = 0;
+static volatile bool stats_reset = false; // set by core 0, handled by core 1
+static uint32_t rx_high_water = 0; // core 0 only
+#endif
+// Latency measurement: core 1 publishes the setpoint word it last put on the
+// PWM and when; core 0 remembers per setpoint count which MOVE frame it was
+static volatile uint32_t applied_setpoint = 0, applied_us = 0;
+
+typedef struct {
+    bool valid;        // set by a binary MOVE, text moves are not acknowledged
+    uint8_t seq;       // frame sequence number
+    uint32_t rx_us;    // time the frame was complete
+    uint32_t received; // moves_received when it was
+} ack_slot_t;
+
+static ack_slot_t ack_slots[SETPOINT_COUNTS];
+
+// The newest move of the bytes drained so far. Moves are applied once the
+// link is drained (or before a command that must see them), the newest
+// wins: a burst of setpoints queued up behind a slow link costs one
+// drive_tracks() instead of being played back late, one after the other
+typedef struct {
+    bool pending;
+    bool binary;       // a MOVE frame, acknowledged after "ack 1"
+    int16_t linear, angular;
+    uint8_t seq;
+    uint32_t rx_us;
+    uint32_t received; // moves_received when it arrived
+} move_request_t;
+
+static move_request_t next_move;
+static uint32_t moves_coalesced = 0; // moves replaced before being applied
+static uint32_t moves_received = 0;  // MOVE frames, numbering them for ACK
+static uint32_t acked_received = 0;  // moves_received of the MOVE acknowledged last
+// PWM wrap in bits 0-15 and clock divider in 1/16 in bits 16-27, written by
+// core 0 and applied to both slices by core 1
+static volatile uint32_t pwm_config = 0;
+static uint32_t pwm_freq_hz = PWM_DEFAULT_FREQ_HZ, pwm_wrap_request = 0; // as set, 0 = finest
+
+// Settings kept in the last flash sector
+#define SETTINGS_MAGIC  0x544B5331 // "TKS1"
+#define SETTINGS_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t pwm_freq_hz;
+    uint32_t pwm_wrap; // 0 = finest resolution
+    uint32_t check;    // ~(magic ^ pwm_freq_hz ^ pwm_wrap)
+} settings_t;
+
+// Compute the pwm_config word for freq_hz; false if the PWM cannot do it
+static bool pwm_config_for(uint32_t freq_hz, uint32_t wrap, uint32_t *config) {
+    if (freq_hz == 0 || wrap > 0xFFFF) return false;
+    uint64_t clk16 = (uint64_t)clock_get_hz(clk_sys) * 16;
+    uint64_t div16;
+    if (wrap == 0) {
+        // smallest divider that still fits 65536 counts per period
+        uint64_t per_count = (uint64_t)freq_hz * 65536;
+        div16 = (clk16 + per_count - 1) / per_count;
+        if (div16 < 16) div16 = 16;
+        uint64_t counts = clk16 / (div16 * freq_hz);
+        if (counts < PWM_MIN_WRAP + 1) return false;
+        wrap = (uint32_t)(counts - 1);
+    } else {
+        div16 = (clk16 + (uint64_t)freq_hz * (wrap + 1) / 2) / ((uint64_t)freq_hz * (wrap + 1));
+        if (wrap < PWM_MIN_WRAP || div16 < 16) return false;
+    }
+    if (div16 > 0xFFF) return false; // 8.4 bit divider, below 256
+    *config = wrap | (uint32_t)(div16 << 16);
+    return true;
+}
+
+static uint32_t settings_check(const settings_t *settings) {
+    return ~(settings->magic ^ settings->pwm_freq_hz ^ settings->pwm_wrap);
+}
+
+// Take the PWM settings from flash if a valid record is there
+static void load_settings() {
+    const settings_t *stored = (const settings_t *)(XIP_BASE + SETTINGS_OFFSET);
+    uint32_t config;
+    if (stored->magic == SETTINGS_MAGIC && stored->check == settings_check(stored) &&
+        pwm_config_for(stored->pwm_freq_hz, stored->pwm_wrap, &config)) {
+        pwm_freq_hz = stored->pwm_freq_hz;
+        pwm_wrap_request = stored->pwm_wrap;
+    }
+}
+
+// Write the PWM settings to flash unless they are already stored. Core 1 is
+// parked meanwhile, leaving the tracks at their current duty for ~50 ms
+static void save_settings() {
+    const settings_t *stored = (const settings_t *)(XIP_BASE + SETTINGS_OFFSET);
+    settings_t settings = { SETTINGS_MAGIC, pwm_freq_hz, pwm_wrap_request, 0 };
+    settings.check = settings_check(&settings);
+    if (memcmp(stored, &settings, sizeof(settings)) == 0) return;
+
+    static uint8_t page[FLASH_PAGE_SIZE];
+    memset(page, 0xFF, sizeof(page));
+    memcpy(page, &settings, sizeof(settings));
+    multicore_lockout_start_blocking();
+    uint32_t irq = save_and_disable_interrupts();
+    flash_range_erase(SETTINGS_OFFSET, FLASH_SECTOR_SIZE);
+    flash_range_program(SETTINGS_OFFSET, page, FLASH_PAGE_SIZE);
+    restore_interrupts(irq);
+    multicore_lockout_end_blocking();
+}
+
+// Response curves: core 0 builds a new one in the buffer core 1 doesn't use
+// and hands it over in control.curve
+static mix_curve_t curves[2];
+
+// Set the response curve, false if expo or deadband is out of range
+static bool set_curve(int expo, int deadband) {
+    while (control.curve_used != control.curve)
+        tight_loop_contents(); // core 1 takes the previous one within a tick
+    mix_curve_t *curve = control.curve == &curves[0] ? &curves[1] : &curves[0];
+    if (!mix_curve_init(curve, expo, deadband)) return false;
+    __dmb(); // the table before the pointer
+    control.curve = expo == 0 && deadband == 0 ? NULL : curve;
+    return true;
+}
+
+static void note_heartbeat() {
+    absolute_time_t now = get_absolute_time();
+    last_heartbeat_ms = to_ms_since_boot(now);
+    hardware_alarm_set_target(failsafe_alarm, delayed_by_us(now, FAILSAFE_BACKSTOP_US));
 }
 
 // Initialize GPIO and PWM for one track
@@ -39,122 +554,793 @@ static void init_track(uint vcc_pin, uint dir_pin, uint pwm_pin, uint *slice, ui
     gpio_set_function(pwm_pin, GPIO_FUNC_PWM);
     *slice = pwm_gpio_to_slice_num(pwm_pin);
     *channel = pwm_gpio_to_channel(pwm_pin);
-    pwm_set_wrap(*slice, PWM_WRAP_VALUE); // Set PWM frequency wrap value
+    // Frequency and wrap are set by core 1 from pwm_config
     pwm_set_chan_level(*slice, *channel, initial_duty); // Set initial duty cycle
     pwm_set_enabled(*slice, true); // Enable PWM slice
 }
 
-// Process incoming serial commands
-static void process_command(const char* cmd, absolute_time_t *last_heartbeat,
-                             uint slice_left, uint chan_left, uint slice_right, uint chan_right,
-                             uint left_dir_pin, uint right_dir_pin) {
+// Count one track's encoder on a free state machine of ENCODER_PIO
+static void init_encoder(track_ctl_t *track, uint pin_a) {
+    track->enc_sm = pio_claim_unused_sm(ENCODER_PIO, true);
+    quadrature_encoder_program_init(ENCODER_PIO, track->enc_sm, pin_a, 0);
+}
+
+// Set a new target for both tracks, cancelling a queued manoeuvre; returns
+// the setpoint count that identifies this command
+static uint32_t drive_tracks(int linear, int angular, bool log) {
+    int left_target, right_target;
+    mix_tracks(linear, angular, &left_target, &right_target);
+
+    if (log) {
+        log_debug("left_target: %d\n", left_target);
+        log_debug("right_target: %d\n", right_target);
+    }
+
+    motion_flush(&motion_queue);
+    static uint32_t seq = 0;
+    seq++;
+    __dmb(); // publish the heartbeat noted by the caller before the setpoint
+    uint32_t count = seq & (SETPOINT_COUNTS - 1);
+    ack_slots[count].valid = false;
+    setpoint = setpoint_pack(left_target, right_target, count);
+    return count;
+}
+
+// Note the newest move, replacing one not applied yet
+static void request_move(int16_t linear, int16_t angular, bool binary, uint8_t seq, uint32_t rx_us) {
+    if (next_move.pending) moves_coalesced++;
+    next_move.pending = true;
+    next_move.binary = binary;
+    next_move.linear = linear;
+    next_move.angular = angular;
+    next_move.seq = seq;
+    next_move.rx_us = rx_us;
+    if (binary) next_move.received = ++moves_received;
+}
+
+// Hand the pending move, if any, to core 1
+static void apply_move() {
+    if (!next_move.pending) return;
+    next_move.pending = false;
+    uint32_t count = drive_tracks(next_move.linear, next_move.angular, !next_move.binary);
+    if (!next_move.binary) return;
+    ack_slot_t *slot = &ack_slots[count];
+    slot->seq = next_move.seq;
+    slot->rx_us = next_move.rx_us;
+    slot->received = next_move.received;
+    slot->valid = true;
+}
+
+static uint32_t pwm_wrap = 0; // wrap of the applied pwm_config, core 1 only
+static uint32_t pwm_counts_q14 = 0; // PWM counts per duty, Q14 rounded up, core 1 only
+static uint32_t dir_levels = 0; // direction pin levels last put, core 1 only
+
+// track_hal_t::set_outputs for the PWM pins, ctx is unused. The direction pins
+// change together, with one SIO write, and only when a direction does; a
+// stopped track keeps its own. Each level is one store of its slice's CC
+// register (pwm_set_both_levels(), channel A being unused), not the read,
+// modify and write of pwm_set_chan_level(). Both slices count in phase (see
+// apply_pwm_config()) and latch CC at their wrap, so the levels are written
+// outside the last PWM_LATCH_GUARD counts of a period and take effect together
+static void put_track_outputs(void *ctx, const int duty[2]) {
+    (void)ctx;
+    const track_ctl_t *tracks[2] = { &left_track, &right_track };
+    uint32_t level[2], dir = dir_levels;
+    for (int i = 0; i < 2; i++) {
+        int sign = duty[i] >> 31; // GPIO HIGH = Forward (adjust if needed)
+        uint32_t magnitude = (uint32_t)((duty[i] ^ sign) - sign);
+        level[i] = magnitude * pwm_counts_q14 >> 14; // wrap + 1 is always on
+        if (level[i] > 0xFFFF) level[i] = 0xFFFF;
+        if (magnitude) dir = (dir & ~tracks[i]->dir_mask) | (tracks[i]->dir_mask & (uint32_t)sign);
+    }
+    if (dir != dir_levels) {
+        gpio_put_masked(left_track.dir_mask | right_track.dir_mask, dir);
+        dir_levels = dir;
+    }
+    while (pwm_get_counter(left_track.slice) > pwm_wrap - PWM_LATCH_GUARD)
+        tight_loop_contents();
+    for (int i = 0; i < 2; i++)
+        pwm_set_both_levels(tracks[i]->slice, level[i] & tracks[i]->mask_a, level[i] & tracks[i]->mask_b);
+}
+
+// Failsafe alarm, on core 0: the heartbeat is still missing and the tracks
+// still driven, so core 1 missed the ramp-down. Set both duties to zero; a
+// control tick that runs again puts its own output back
+static void failsafe_backstop(uint alarm) {
+    (void)alarm;
+    uint32_t age_ms = to_ms_since_boot(get_absolute_time()) - last_heartbeat_ms;
+    if (age_ms <= HEARTBEAT_TIMEOUT_US / 1000 || (control.output[0] == 0 && control.output[1] == 0))
+        return; // a heartbeat raced the alarm, or the control loop did stop
+    pwm_set_both_levels(left_track.slice, 0, 0); // single stores, no read-modify-write to race core 1
+    pwm_set_both_levels(right_track.slice, 0, 0);
+    backstop_fired = true;
+}
+
+static int current_dma_chan;
+static uint16_t current_ring[CURRENT_RING_LEN] __attribute__((aligned(CURRENT_RING_LEN * sizeof(uint16_t))));
 
-    printf("cmd: %s\n", cmd); // Log received command
+// (Re)start the round robin from ADC0 at the start of the ring, so even
+// samples are the left track and odd ones the right
+static void start_current_sampling() {
+    adc_run(false);
+    while (!(adc_hw->cs & ADC_CS_READY_BITS))
+        tight_loop_contents(); // a conversion in flight would land in the FIFO
+    dma_channel_abort(current_dma_chan);
+    adc_fifo_drain();
+    dma_channel_config config = dma_channel_get_default_config(current_dma_chan);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_16);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    channel_config_set_ring(&config, true, __builtin_ctz(sizeof(current_ring)));
+    channel_config_set_dreq(&config, DREQ_ADC);
+    dma_channel_configure(current_dma_chan, &config, current_ring, &adc_hw->fifo, 0xFFFFFFFF, true);
+    adc_select_input(0);
+    adc_run(true);
+}
+
+static void init_current_sense() {
+    adc_init();
+    adc_gpio_init(CURRENT_ADC_PIN);
+    adc_gpio_init(CURRENT_ADC_PIN + 1);
+    adc_set_round_robin(0x3);
+    adc_fifo_setup(true, true, 1, false, false); // DREQ per sample, 12 bits
+    adc_set_clkdiv(48000000 / CURRENT_SAMPLE_HZ - 1); // 48 MHz ADC clock, one cycle per sample added
+    current_dma_chan = dma_claim_unused_channel(true);
+    start_current_sampling();
+}
+
+// track_hal_t::read_current: mean of the newest samples in the DMA ring
+static int read_track_current(void *ctx, int track) {
+    uint32_t next = (dma_channel_hw_addr(current_dma_chan)->write_addr - (uint32_t)(uintptr_t)current_ring) / 2;
+    uint32_t end = next & ~1u; // samples before it form left/right pairs
+    uint32_t sum = 0;
+    for (int i = 1; i <= CURRENT_AVG_SAMPLES; i++)
+        sum += current_ring[(end - 2 * i + track) & (CURRENT_RING_LEN - 1)];
+    return (int)(sum * (ADC_VREF_MV * 1000 / CURRENT_SENSE_MV_PER_A) / (4096 * CURRENT_AVG_SAMPLES));
+}
+
+// MPU-6050 registers
+#define MPU_SMPLRT_DIV   0x19
+#define MPU_CONFIG       0x1A
+#define MPU_GYRO_CONFIG  0x1B
+#define MPU_GYRO_ZOUT_H  0x47
+#define MPU_PWR_MGMT_1   0x6B
+#define MPU_WHO_AM_I     0x75
+
+static int imu_tx_chan, imu_rx_chan;
+static int imu_bias = 0; // raw reading at rest
+static uint32_t imu_errors = 0; // reads aborted, counted by core 1
+// IC_DATA_CMD words of one yaw rate read: register address, then two reads
+// after a restart, the last one ending with a stop
+static const uint32_t imu_read_cmd[3] = {
+    MPU_GYRO_ZOUT_H,
+    I2C_IC_DATA_CMD_CMD_BITS | I2C_IC_DATA_CMD_RESTART_BITS,
+    I2C_IC_DATA_CMD_CMD_BITS | I2C_IC_DATA_CMD_STOP_BITS,
+};
+static uint8_t imu_rx[2];
+
+static bool imu_write(uint8_t reg, uint8_t value) {
+    uint8_t data[2] = { reg, value };
+    return i2c_write_blocking(IMU_I2C, IMU_ADDR, data, 2, false) == 2;
+}
+
+static bool imu_read(uint8_t reg, uint8_t *data, int len) {
+    return i2c_write_blocking(IMU_I2C, IMU_ADDR, &reg, 1, true) == 1 &&
+           i2c_read_blocking(IMU_I2C, IMU_ADDR, data, len, false) == len;
+}
+
+// Set up the gyro for 1 kHz samples at ±500°/s and measure its bias; false
+// if there is none. Leaves IMU_ADDR as the I2C target for the DMA reads
+static bool init_imu() {
+    i2c_init(IMU_I2C, IMU_I2C_HZ); // also enables the DMA handshakes
+    gpio_set_function(IMU_SDA_PIN, GPIO_FUNC_I2C);
+    gpio_set_function(IMU_SCL_PIN, GPIO_FUNC_I2C);
+    gpio_pull_up(IMU_SDA_PIN);
+    gpio_pull_up(IMU_SCL_PIN);
+    uint8_t id = 0;
+    if (!imu_read(MPU_WHO_AM_I, &id, 1) || id != IMU_ADDR) return false;
+    if (!imu_write(MPU_PWR_MGMT_1, 0x01) ||  // awake, clocked from the X gyro
+        !imu_write(MPU_CONFIG, 0x02) ||      // 94 Hz low pass, 1 kHz sample rate
+        !imu_write(MPU_SMPLRT_DIV, 0) ||
+        !imu_write(MPU_GYRO_CONFIG, 0x08))   // ±500°/s, 65.5 LSB per °/s
+        return false;
+    sleep_ms(50); // let the gyro settle
+    int32_t sum = 0;
+    for (int i = 0; i < IMU_BIAS_SAMPLES; i++) {
+        uint8_t raw[2];
+        if (!imu_read(MPU_GYRO_ZOUT_H, raw, 2)) return false;
+        sum += (int16_t)(raw[0] << 8 | raw[1]);
+        sleep_ms(1);
+    }
+    imu_bias = sum / IMU_BIAS_SAMPLES;
+
+    imu_tx_chan = dma_claim_unused_channel(true);
+    imu_rx_chan = dma_claim_unused_channel(true);
+    dma_channel_config config = dma_channel_get_default_config(imu_tx_chan);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_32);
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, false);
+    channel_config_set_dreq(&config, i2c_get_dreq(IMU_I2C, true));
+    dma_channel_configure(imu_tx_chan, &config, &i2c_get_hw(IMU_I2C)->data_cmd, imu_read_cmd, 0, false);
+    config = dma_channel_get_default_config(imu_rx_chan);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    channel_config_set_dreq(&config, i2c_get_dreq(IMU_I2C, false));
+    dma_channel_configure(imu_rx_chan, &config, imu_rx, &i2c_get_hw(IMU_I2C)->data_cmd, 0, false);
+    return true;
+}
+
+// track_hal_t::read_yaw_rate: the result of the read started last tick, then
+// the next read. A NAK or bus error leaves the read unfinished, it is aborted
+// after IMU_TIMEOUT_TICKS and the last rate is kept meanwhile
+static int read_imu_yaw_rate(void *ctx) {
+    static int rate = 0, waited = 0;
+    static bool started = false;
+    if (dma_channel_is_busy(imu_rx_chan)) {
+        if (++waited < IMU_TIMEOUT_TICKS) return rate;
+        dma_channel_abort(imu_tx_chan);
+        dma_channel_abort(imu_rx_chan);
+        (void)i2c_get_hw(IMU_I2C)->clr_tx_abrt;
+        imu_errors++;
+    } else if (started) {
+        int raw = (int16_t)(imu_rx[0] << 8 | imu_rx[1]) - imu_bias;
+        rate = IMU_YAW_SIGN * raw * 200 / 131; // 65.5 LSB per °/s
+    }
+    waited = 0;
+    started = true;
+    dma_channel_transfer_to_buffer_now(imu_rx_chan, imu_rx, 2);
+    dma_channel_transfer_from_buffer_now(imu_tx_chan, imu_read_cmd, 3);
+    return rate;
+}
+
+// read_yaw_rate is filled in once init_imu() found the gyro
+static track_hal_t pico_hal = { put_track_outputs, NULL, read_track_current, NULL };
+
+// Put a new pwm_config on both slices and restart them in phase: stopped,
+// counters cleared and started again with one write of the enable mask
+static void apply_pwm_config(uint32_t config) {
+    uint slices[2] = { left_track.slice, right_track.slice };
+    uint32_t mask = (1u << slices[0]) | (1u << slices[1]);
+    pwm_set_mask_enabled(pwm_hw->en & ~mask);
+    for (int i = 0; i < 2; i++) {
+        pwm_set_clkdiv_int_frac(slices[i], (uint8_t)(config >> 20), (config >> 16) & 0xF);
+        pwm_set_wrap(slices[i], config & 0xFFFF);
+        pwm_set_counter(slices[i], 0);
+    }
+    pwm_set_mask_enabled(pwm_hw->en | mask);
+}
+
+// Publish the encoder counts, and every SPEED_WINDOW_TICKS the speed, to core 0
+static void sample_encoders() {
+    static int ticks = 0;
+    static int32_t window_start[2] = {0, 0};
+    int32_t count[2] = {
+        quadrature_encoder_get_count(ENCODER_PIO, left_track.enc_sm),
+        quadrature_encoder_get_count(ENCODER_PIO, right_track.enc_sm),
+    };
+    bool window_done = ++ticks == SPEED_WINDOW_TICKS;
+
+    odometry_seq = odometry_seq + 1;
+    __dmb();
+    for (int i = 0; i < 2; i++) {
+        odometry.count[i] = count[i];
+        if (window_done) {
+            odometry.speed[i] = (count[i] - window_start[i]) * (1000000 / (SPEED_WINDOW_TICKS * CONTROL_PERIOD_US));
+            window_start[i] = count[i];
+        }
+    }
+    __dmb();
+    odometry_seq = odometry_seq + 1;
+    if (window_done) ticks = 0;
+}
+
+// Consistent copy of the odometry for core 0
+static void read_odometry(int32_t count[2], int32_t speed[2]) {
+    uint32_t seq;
+    do {
+        while ((seq = odometry_seq) & 1)
+            tight_loop_contents();
+        __dmb();
+        for (int i = 0; i < 2; i++) {
+            count[i] = odometry.count[i];
+            speed[i] = odometry.speed[i];
+        }
+        __dmb();
+    } while (odometry_seq != seq);
+}
+
+// One control loop iteration on core 1
+static void control_tick() {
+    static uint32_t applied_config = 0;
+
+    uint32_t config = pwm_config;
+    if (config != applied_config) {
+        apply_pwm_config(config);
+        applied_config = config;
+        pwm_wrap = config & 0xFFFF;
+        pwm_counts_q14 = (((pwm_wrap + 1) << 14) + DUTY_MAX - 1) / DUTY_MAX;
+    }
+
+    if (dma_channel_hw_addr(current_dma_chan)->transfer_count < CURRENT_RING_LEN)
+        start_current_sampling(); // once every three days
+
+    uint32_t sp = setpoint; // read before the heartbeat, core 0 writes the heartbeat first
+    __dmb();
+    uint32_t now_ms = to_ms_since_boot(get_absolute_time());
+    track_control_tick(&control, &motion_queue, sp, now_ms - last_heartbeat_ms, &pico_hal);
+    static uint32_t last_setpoint = 0;
+    if (sp != last_setpoint) { // just put on the PWM
+        last_setpoint = sp;
+        applied_us = (uint32_t)time_us_64();
+        __dmb();
+        applied_setpoint = sp;
+    }
+    sample_encoders();
+}
+
+#if CONTROL_STATS
+// Account for one control tick that started at start_us (low 32 bits)
+static void record_tick_stats(uint32_t start_us, uint32_t took_us, int64_t late_us) {
+    static uint32_t last_start_us = 0;
+    static bool started = false;
+    if (stats_reset) {
+        for (int i = 0; i < PERIOD_BUCKETS; i++) period_hist[i] = 0;
+        tick_wcet_us = 0;
+        deadlines_missed = 0;
+        started = false;
+        stats_reset = false;
+    }
+    if (started) {
+        int deviation = (int)(start_us - last_start_us) - CONTROL_PERIOD_US;
+        int bucket = 0;
+        while (bucket < PERIOD_BUCKETS - 1 && deviation >= period_bounds_us[bucket]) bucket++;
+        period_hist[bucket] = period_hist[bucket] + 1;
+    }
+    last_start_us = start_us;
+    started = true;
+    if (took_us > tick_wcet_us) tick_wcet_us = took_us;
+    if (late_us + took_us > CONTROL_PERIOD_US) deadlines_missed = deadlines_missed + 1;
+}
+#endif
+
+// Core 1: run control_tick() at a fixed rate, independent of the serial link
+static void control_core_main() {
+    multicore_lockout_victim_init(); // lets save_settings() park this core
+    absolute_time_t next = get_absolute_time();
+    while (true) {
+        absolute_time_t start = get_absolute_time();
+        control_tick();
+        int64_t late_us = absolute_time_diff_us(next, start); // sleep_until() never wakes early
+        uint32_t took_us = (uint32_t)absolute_time_diff_us(start, get_absolute_time());
+        if (timing_reset) {
+            tick_max_us = 0;
+            tick_late_max_us = 0;
+            timing_reset = false;
+        }
+        if (took_us > tick_max_us) tick_max_us = took_us;
+        if (late_us > (int64_t)tick_late_max_us) tick_late_max_us = (uint32_t)late_us;
+#if CONTROL_STATS
+        record_tick_stats((uint32_t)to_us_since_boot(start), took_us, late_us);
+#endif
+        next = delayed_by_us(next, CONTROL_PERIOD_US);
+        sleep_until(next);
+    }
+}
+
+// Process incoming serial commands. Numbers are parsed with parse_scaled() and
+// parse_uint() rather than sscanf(), and mixed in fixed point: the RP2040 has
+// no FPU, and soft-float scanning cost more than the rest of a command
+static void process_command(const char* cmd) {
+
+    log_debug("cmd: %s\n", cmd); // Log received command
+
+    // Anything but another move or a heartbeat sees the moves before it applied,
+    // so e.g. "move" then "queue" still cancels first and queues after
+    if (strncmp(cmd, "move ", 5) != 0 && strcmp(cmd, "heartbeat") != 0)
+        apply_move();
 
     if (strcmp(cmd, "heartbeat") == 0) {
-        *last_heartbeat = get_absolute_time();
+        note_heartbeat();
+    } else if (strcmp(cmd, "stats") == 0) {
+        log_printf("stats: frames %lu bad %lu lost %lu rx_overflow %lu log_dropped %lu coalesced %lu\n",
+                   (unsigned long)frames_ok, (unsigned long)frames_bad, (unsigned long)frames_lost,
+                   (unsigned long)rx_overflows, (unsigned long)log_dropped, (unsigned long)moves_coalesced);
+#if CONTROL_STATS
+        log_printf("stats: wcet %lu us missed %lu rx_high_water %lu\n", (unsigned long)tick_wcet_us,
+                   (unsigned long)deadlines_missed, (unsigned long)rx_high_water);
+        char line[96];
+        int len = snprintf(line, sizeof(line), "stats: period");
+        for (int i = 0; i < PERIOD_BUCKETS && len < (int)sizeof(line); i++) {
+            if (i < PERIOD_BUCKETS - 1)
+                len += snprintf(line + len, sizeof(line) - len, " <%+d:%lu", period_bounds_us[i],
+                                (unsigned long)period_hist[i]);
+            else
+                len += snprintf(line + len, sizeof(line) - len, " more:%lu", (unsigned long)period_hist[i]);
+        }
+        log_printf("%s us\n", line);
+    } else if (strcmp(cmd, "stats reset") == 0) {
+        stats_reset = true;
+        rx_high_water = 0;
+#endif
+    } else if (strncmp(cmd, "queue ", 6) == 0) {
+        note_heartbeat();
+        const char *args = cmd + 6;
+        int16_t linear, angular;
+        uint32_t duration_ms;
+        if (!parse_scaled(&args, &linear) || !parse_scaled(&args, &angular) ||
+            !parse_uint(&args, &duration_ms) || duration_ms > 0xFFFF) {
+            log_printf("Error parsing queue command: %s\n", cmd);
+        } else if (!motion_push(&motion_queue, linear, angular, (uint16_t)duration_ms)) {
+            log_printf("WARN: Motion queue full, segment dropped!\n");
+        }
+    } else if (strcmp(cmd, "flush") == 0) {
+        motion_flush(&motion_queue);
+    } else if (strcmp(cmd, "pwm") == 0) {
+        uint32_t config = pwm_config;
+        log_printf("pwm: %lu Hz wrap %lu div %lu/16\n", (unsigned long)pwm_freq_hz,
+                   (unsigned long)(config & 0xFFFF), (unsigned long)(config >> 16));
+    } else if (strncmp(cmd, "pwm ", 4) == 0) {
+        const char *args = cmd + 4;
+        uint32_t freq_hz, wrap = 0, config;
+        if (parse_uint(&args, &freq_hz) && (*args == '\0' || parse_uint(&args, &wrap)) &&
+            pwm_config_for(freq_hz, wrap, &config)) {
+            pwm_freq_hz = freq_hz;
+            pwm_wrap_request = wrap;
+            pwm_config = config;
+            save_settings();
+            log_printf("pwm: %lu Hz wrap %lu div %lu/16\n", (unsigned long)freq_hz,
+                       (unsigned long)(config & 0xFFFF), (unsigned long)(config >> 16));
+        } else {
+            log_printf("Error: unsupported pwm setting: %s\n", cmd);
+        }
+    } else if (strncmp(cmd, "telemetry ", 10) == 0) {
+        telemetry_interval_ms = strtoul(cmd + 10, NULL, 10);
+    } else if (strncmp(cmd, "ack ", 4) == 0) {
+        ack_enabled = atoi(cmd + 4) != 0;
+        acked_received = moves_received; // count superseded moves from here on
+    } else if (strcmp(cmd, "heading") == 0) {
+        log_printf("heading: hold %s, gyro %s, yaw rate %d cdps, %lu read errors\n",
+                   control.heading_hold ? "on" : "off", pico_hal.read_yaw_rate ? "ok" : "missing",
+                   control.yaw_rate, (unsigned long)imu_errors);
+    } else if (strncmp(cmd, "heading ", 8) == 0) {
+        control.heading_hold = atoi(cmd + 8) != 0;
+        if (control.heading_hold && !pico_hal.read_yaw_rate)
+            log_printf("WARN: No gyro, heading hold has no effect!\n");
+    } else if (strcmp(cmd, "curve") == 0) {
+        const mix_curve_t *curve = control.curve;
+        int expo = curve ? curve->expo : 0, deadband = curve ? curve->deadband : 0;
+        log_printf("curve: expo %d.%02d%% deadband %d.%02d%%\n", expo / COMMAND_SCALE, expo % COMMAND_SCALE,
+                   deadband / COMMAND_SCALE, deadband % COMMAND_SCALE);
+    } else if (strncmp(cmd, "curve ", 6) == 0) {
+        const char *args = cmd + 6;
+        int16_t expo, deadband;
+        if (!parse_scaled(&args, &expo) || !parse_scaled(&args, &deadband) || !set_curve(expo, deadband))
+            log_printf("Error: unsupported curve setting: %s\n", cmd);
+    } else if (strncmp(cmd, "verbose ", 8) == 0) {
+        verbose = atoi(cmd + 8) != 0;
     } else if (strncmp(cmd, "move ", 5) == 0) {
-        *last_heartbeat = get_absolute_time(); // Treat move command as heartbeat too
-
-        float linear = 0.0f, angular = 0.0f;
-        if (sscanf(cmd + 5, "%f %f", &linear, &angular) == 2) {
-
-            // --- Standard Differential Drive Mixing ---
-            // Note: Python script sends -100 to 100. Firmware multiplies by 10.
-            // Resulting range for left_mix/right_mix is approx -2000 to 2000.
-            float left_mix = (linear - angular);
-            float right_mix = (linear + angular);
-
-            // --- Determine Direction and PWM Duty Cycle ---
-            // Based on observation: positive calculated value means BACKWARD motion.
-            // Therefore, negative calculated value means FORWARD motion.
-
-            int left_pwm_duty;
-            int right_pwm_duty;
-
-            // Left Motor
-            if (left_mix < 0) { // Negative mix value means FORWARD
-                gpio_put(left_dir_pin, 1); // Assuming GPIO HIGH = Forward (adjust if needed)
-                left_pwm_duty = clamp_pwm_duty((int)(-left_mix * 10)); // Make value positive for PWM, scale, clamp
-            } else { // Positive or zero mix value means BACKWARD (or Stop)
-                gpio_put(left_dir_pin, 0); // Assuming GPIO LOW = Backward (adjust if needed)
-                left_pwm_duty = clamp_pwm_duty((int)(left_mix * 10)); // Value is already positive, scale, clamp
-            }
+        note_heartbeat(); // Treat move command as heartbeat too
 
-            // Right Motor
-            if (right_mix < 0) { // Negative mix value means FORWARD
-                gpio_put(right_dir_pin, 1); // Assuming GPIO HIGH = Forward (adjust if needed)
-                right_pwm_duty = clamp_pwm_duty((int)(-right_mix * 10)); // Make value positive for PWM, scale, clamp
-            } else { // Positive or zero mix value means BACKWARD (or Stop)
-                gpio_put(right_dir_pin, 0); // Assuming GPIO LOW = Backward (adjust if needed)
-                right_pwm_duty = clamp_pwm_duty((int)(right_mix * 10)); // Value is already positive, scale, clamp
-            }
+        const char *args = cmd + 5;
+        int16_t linear, angular;
+        if (parse_scaled(&args, &linear) && parse_scaled(&args, &angular)) {
+            request_move(linear, angular, false, 0, 0);
+        } else {
+            log_printf("Error parsing move command: %s\n", cmd);
+        }
+    } else {
+        log_printf("Unknown command: %s\n", cmd);
+    }
+}
+
+// CRC-8, polynomial 0x07, initial value 0
+static uint8_t crc8(const uint8_t *data, int len) {
+    uint8_t crc = 0;
+    while (len--) {
+        crc ^= *data++;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
 
-            // Log the *final* PWM values being set
-            printf("left_pwm: %d\n", left_pwm_duty);
-            printf("right_pwm: %d\n", right_pwm_duty);
+// Queue an outgoing binary frame, like a log line whole or not at all, on the
+// vendor interface if there is one
+static void send_frame(uint8_t type, const uint8_t *payload, int len) {
+    static uint8_t seq = 0;
+    uint8_t frame[FRAME_OUT_MAX_LEN];
+    frame[0] = FRAME_SYNC;
+    frame[1] = type;
+    frame[2] = seq++;
+    memcpy(frame + 3, payload, len);
+    frame[3 + len] = crc8(frame + 1, len + 2);
+#if LINK_TRANSPORT == LINK_VENDOR
+    byte_ring_t *ring = &frame_ring;
+#else
+    byte_ring_t *ring = &tx_ring;
+#endif
+    if (ring_free(ring) < (uint32_t)len + 4) {
+        log_dropped++;
+        return;
+    }
+    for (int i = 0; i < len + 4; i++)
+        ring_push(ring, frame[i]);
+}
 
-            // Set PWM levels
-            pwm_set_chan_level(slice_left, chan_left, left_pwm_duty);
-            pwm_set_chan_level(slice_right, chan_right, right_pwm_duty);
+static void put_le32(uint8_t *out, int32_t value) {
+    for (int i = 0; i < 4; i++)
+        out[i] = (uint8_t)((uint32_t)value >> (8 * i));
+}
 
-        } else {
-            printf("Error parsing move command: %s\n", cmd);
+static void put_le16(uint8_t *out, uint32_t value) {
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+}
+
+static uint32_t saturate16(uint32_t value) {
+    return value > 0xFFFF ? 0xFFFF : value;
+}
+
+static void send_telemetry() {
+    uint8_t payload[45];
+    uint32_t age_ms = to_ms_since_boot(get_absolute_time()) - last_heartbeat_ms;
+    put_le16(payload, (uint32_t)control.output[0]);
+    put_le16(payload + 2, (uint32_t)control.output[1]);
+    put_le16(payload + 4, saturate16(age_ms));
+    put_le16(payload + 6, saturate16(tick_max_us));
+    put_le16(payload + 8, saturate16(tick_late_max_us));
+    payload[10] = (control.failsafe ? TELEMETRY_FAILSAFE : 0) |
+                  (control.stalled & 1 ? TELEMETRY_STALL_LEFT : 0) | (control.stalled & 2 ? TELEMETRY_STALL_RIGHT : 0);
+    put_le32(payload + 11, frames_ok);
+    put_le32(payload + 15, frames_bad);
+    put_le32(payload + 19, frames_lost);
+    put_le32(payload + 23, log_dropped);
+    put_le16(payload + 27, saturate16((uint32_t)control.current_ma[0]));
+    put_le16(payload + 29, saturate16((uint32_t)control.current_ma[1]));
+#if CONTROL_STATS
+    put_le32(payload + 31, deadlines_missed);
+    put_le16(payload + 35, saturate16(rx_high_water));
+#else
+    memset(payload + 31, 0, 6);
+#endif
+    put_le32(payload + 37, moves_coalesced);
+    put_le32(payload + 41, rx_overflows);
+    timing_reset = true; // maxima per telemetry period
+    send_frame(FRAME_TELEMETRY, payload, sizeof(payload));
+}
+
+// ACK the MOVE frame whose setpoint core 1 applied last, once
+static void send_ack() {
+    static uint32_t acked = 0;
+    uint32_t sp = applied_setpoint;
+    if (sp == acked) return;
+    __dmb();
+    uint32_t at_us = applied_us;
+    __dmb();
+    if (applied_setpoint != sp) return; // applied another one meanwhile, next time
+    acked = sp;
+    ack_slot_t *slot = &ack_slots[setpoint_count(sp)];
+    if (!ack_enabled || !slot->valid) return;
+    slot->valid = false;
+    // MOVE frames between the last one acknowledged and this one were replaced,
+    // in the main loop or within one control tick, and get no ACK of their own
+    int32_t superseded = (int32_t)(slot->received - acked_received) - 1;
+    acked_received = slot->received;
+    uint8_t payload[10];
+    payload[0] = slot->seq;
+    put_le32(payload + 1, (int32_t)slot->rx_us);
+    put_le32(payload + 5, (int32_t)at_us);
+    payload[9] = superseded < 0 ? 0 : superseded > 0xFF ? 0xFF : (uint8_t)superseded;
+    send_frame(FRAME_ACK, payload, sizeof(payload));
+}
+
+static void send_odometry() {
+    int32_t count[2], speed[2];
+    read_odometry(count, speed);
+    uint8_t payload[16];
+    put_le32(payload, count[0]);
+    put_le32(payload + 4, count[1]);
+    put_le32(payload + 8, speed[0]);
+    put_le32(payload + 12, speed[1]);
+    send_frame(FRAME_ODOMETRY, payload, sizeof(payload));
+}
+
+// Length of a binary frame including sync and CRC given its first len bytes:
+// FRAME_MAX_LEN while that is not known yet, 0 for an unknown type
+static int frame_length(const uint8_t *frame, int len) {
+    if (len < 2) return FRAME_MAX_LEN;
+    switch (frame[1]) {
+        case FRAME_MOVE:      return 8;
+        case FRAME_HEARTBEAT: return 4;
+        case FRAME_PING:      return 8;
+        case FRAME_MOTION:
+            if (len < 5) return FRAME_MAX_LEN;
+            return frame[4] <= MOTION_QUEUE_LEN ? 6 + 6 * frame[4] : 0;
+        default:              return 0;
+    }
+}
+
+// Process a complete binary frame; returns false if it was corrupt
+static bool process_frame(const uint8_t *frame, int len) {
+    static bool seq_started = false;
+    static uint8_t last_seq = 0;
+
+    if (crc8(frame + 1, len - 2) != frame[len - 1]) {
+        frames_bad++;
+        return false;
+    }
+    uint8_t seq = frame[2];
+    if (seq_started)
+        frames_lost += (uint8_t)(seq - last_seq - 1);
+    seq_started = true;
+    last_seq = seq;
+    frames_ok++;
+
+    note_heartbeat(); // any valid frame is a heartbeat
+    if (frame[1] == FRAME_MOVE) {
+        int16_t linear = (int16_t)(frame[3] | (frame[4] << 8));
+        int16_t angular = (int16_t)(frame[5] | (frame[6] << 8));
+        request_move(linear, angular, true, seq, (uint32_t)time_us_64());
+    } else if (frame[1] == FRAME_PING) {
+        uint8_t payload[12];
+        uint64_t now_us = time_us_64();
+        memcpy(payload, frame + 3, 4); // token as received
+        put_le32(payload + 4, (int32_t)(uint32_t)now_us);
+        put_le32(payload + 8, (int32_t)(uint32_t)(now_us >> 32));
+        send_frame(FRAME_PONG, payload, sizeof(payload));
+    } else if (frame[1] == FRAME_MOTION) {
+        apply_move(); // applied later, an earlier move would cancel the manoeuvre
+        if (frame[3] & FRAME_MOTION_FLUSH)
+            motion_flush(&motion_queue);
+        for (int i = 0; i < frame[4]; i++) {
+            const uint8_t *segment = frame + 5 + 6 * i;
+            int16_t linear = (int16_t)(segment[0] | (segment[1] << 8));
+            int16_t angular = (int16_t)(segment[2] | (segment[3] << 8));
+            uint16_t duration_ms = (uint16_t)(segment[4] | (segment[5] << 8));
+            if (!motion_push(&motion_queue, linear, angular, duration_ms)) {
+                log_printf("WARN: Motion queue full, segment dropped!\n");
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+// Receive state of one byte stream, text commands and binary frames mixed
+typedef struct {
+    char text[64];
+    int text_len;
+    uint8_t frame[FRAME_MAX_LEN];
+    int frame_len; // bytes of the binary frame being received, 0 while reading text
+} rx_stream_t;
+
+// Take one received byte
+static void rx_byte(rx_stream_t *rx, uint8_t c) {
+    char ch = (char)c;
+    if (rx->frame_len > 0) { // inside a binary frame
+        rx->frame[rx->frame_len++] = c;
+        int need = frame_length(rx->frame, rx->frame_len);
+        if (need == 0) { // unknown type, wait for the next sync byte
+            frames_bad++;
+            rx->frame_len = 0;
+        } else if (rx->frame_len == need) {
+            process_frame(rx->frame, rx->frame_len);
+            rx->frame_len = 0;
         }
+    } else if (c == FRAME_SYNC) {
+        rx->frame[0] = c;
+        rx->frame_len = 1;
+        rx->text_len = 0; // drop a partial text command
+    // Handle line endings and buffer filling
+    } else if (ch == '\n' || ch == '\r') {
+        if (rx->text_len > 0) { // Process only if buffer not empty
+            rx->text[rx->text_len] = '\0'; // Null-terminate
+            process_command(rx->text);
+            rx->text_len = 0; // Reset buffer index
+        }
+    } else if (rx->text_len < (sizeof(rx->text) - 1)) {
+        rx->text[rx->text_len++] = ch; // Add character to buffer
     } else {
-        printf("Unknown command: %s\n", cmd);
+        // Buffer overflow, discard and reset
+        log_printf("WARN: Serial command buffer overflow!\n");
+        rx->text_len = 0;
     }
 }
 
 int main() {
     stdio_init_all();
-    // UART setup is assumed to be handled by stdio_init_all and CMakeLists
-
-    uint slice_num_left, chan_left;
-    uint slice_num_right, chan_right;
+    link_init();
 
     // Initialize tracks - VCC is enabled inside init_track now
-    init_track(LEFT_VCC_PIN, LEFT_DIR_PIN, LEFT_PWM_PIN, &slice_num_left, &chan_left, 0);
-    init_track(RIGHT_VCC_PIN, RIGHT_DIR_PIN, RIGHT_PWM_PIN, &slice_num_right, &chan_right, 0);
+    init_track(LEFT_VCC_PIN, LEFT_DIR_PIN, LEFT_PWM_PIN, &left_track.slice, &left_track.chan, 0);
+    init_track(RIGHT_VCC_PIN, RIGHT_DIR_PIN, RIGHT_PWM_PIN, &right_track.slice, &right_track.chan, 0);
+    left_track.dir_pin = LEFT_DIR_PIN;
+    right_track.dir_pin = RIGHT_DIR_PIN;
+    track_ctl_t *tracks[2] = { &left_track, &right_track };
+    for (int i = 0; i < 2; i++) {
+        tracks[i]->dir_mask = 1u << tracks[i]->dir_pin;
+        tracks[i]->mask_a = tracks[i]->chan == PWM_CHAN_A ? 0xFFFF : 0;
+        tracks[i]->mask_b = tracks[i]->chan == PWM_CHAN_B ? 0xFFFF : 0;
+    }
+    pio_add_program(ENCODER_PIO, &quadrature_encoder_program); // lands at offset 0, see .origin
+    init_encoder(&left_track, LEFT_ENC_PIN);
+    init_encoder(&right_track, RIGHT_ENC_PIN);
+    init_current_sense();
+    if (init_imu())
+        pico_hal.read_yaw_rate = read_imu_yaw_rate;
 
-    printf("Track Controller Initialized. Waiting for commands...\n");
+    uint32_t config;
+    load_settings();
+    pwm_config_for(pwm_freq_hz, pwm_wrap_request, &config); // valid, checked by load_settings()
+    pwm_config = config;
+
+    log_printf("Track Controller Initialized. Waiting for commands...\n");
+
+    failsafe_alarm = (uint)hardware_alarm_claim_unused(true);
+    hardware_alarm_set_callback(failsafe_alarm, failsafe_backstop);
+    note_heartbeat();
+    multicore_launch_core1(control_core_main);
 
-    absolute_time_t last_heartbeat = get_absolute_time();
     bool heartbeat_warned = false;
-    char serial_cmd_buf[64] = {0};
-    int buf_index = 0;
+    uint8_t stall_warned = 0;
+    rx_stream_t link_rx = {}; // the serial link
+#if LINK_TRANSPORT == LINK_VENDOR
+    rx_stream_t vendor_rx = {}; // the vendor interface's OUT endpoint
+#endif
+    absolute_time_t next_odometry = make_timeout_time_ms(ODOMETRY_INTERVAL_MS);
+    absolute_time_t next_telemetry = make_timeout_time_ms(telemetry_interval_ms);
 
     while (true) {
-        int c = getchar_timeout_us(0); // Non-blocking read
-        if (c != PICO_ERROR_TIMEOUT) {
-            char ch = (char)c;
-            // Handle line endings and buffer filling
-            if (ch == '\n' || ch == '\r') {
-                if (buf_index > 0) { // Process only if buffer not empty
-                    serial_cmd_buf[buf_index] = '\0'; // Null-terminate
-                    process_command(serial_cmd_buf, &last_heartbeat, slice_num_left, chan_left, slice_num_right, chan_right, LEFT_DIR_PIN, RIGHT_DIR_PIN);
-                    buf_index = 0; // Reset buffer index
-                    heartbeat_warned = false; // Reset warning on any valid command processed
-                }
-            } else if (buf_index < (sizeof(serial_cmd_buf) - 1)) {
-                serial_cmd_buf[buf_index++] = ch; // Add character to buffer
-            } else {
-                // Buffer overflow, discard and reset
-                printf("WARN: Serial command buffer overflow!\n");
-                buf_index = 0;
-            }
+        link_task();
+        if (absolute_time_diff_us(next_odometry, get_absolute_time()) >= 0) {
+            next_odometry = delayed_by_ms(next_odometry, ODOMETRY_INTERVAL_MS);
+            send_odometry();
         }
+        if (telemetry_interval_ms > 0 && absolute_time_diff_us(next_telemetry, get_absolute_time()) >= 0) {
+            next_telemetry = make_timeout_time_ms(telemetry_interval_ms); // picks up a changed interval
+            send_telemetry();
+        }
+        send_ack();
+        bool logged = flush_log();
+#if LINK_TRANSPORT == LINK_VENDOR
+        logged |= flush_frames();
+#endif
+        link_fill_rx();
+#if CONTROL_STATS
+        uint32_t pending = ring_used(&rx_ring) + link_rx_pending();
+        if (pending > rx_high_water) rx_high_water = pending;
+#endif
+        // Take all bytes waiting, up to RX_DRAIN_MAX, then apply the newest move
+        int received = 0;
+        for (int c; received < RX_DRAIN_MAX && (c = ring_pop(&rx_ring)) >= 0; received++)
+            rx_byte(&link_rx, (uint8_t)c);
+#if LINK_TRANSPORT == LINK_VENDOR
+        uint8_t chunk[64];
+        for (int n; received < RX_DRAIN_MAX && (n = vendor_read(chunk, sizeof(chunk))) > 0; received += n)
+            for (int i = 0; i < n; i++)
+                rx_byte(&vendor_rx, chunk[i]);
+#endif
+        apply_move();
+        if (received == 0 && !logged) sleep_us(100); // idle, poll again shortly
 
-        // Heartbeat Check
-        if (absolute_time_diff_us(last_heartbeat, get_absolute_time()) > HEARTBEAT_TIMEOUT_US) {
+        // Heartbeat Check - control_tick() does the stopping, log it once per timeout
+        if (control.failsafe) {
             if (!heartbeat_warned) {
-                printf("WARN: Heartbeat missing, stopping motors!\n");
-                // Stop motors by setting PWM duty cycle to 0
-                pwm_set_chan_level(slice_num_left, chan_left, 0);
-                pwm_set_chan_level(slice_num_right, chan_right, 0);
+                log_printf("WARN: Heartbeat missing, stopping motors!\n");
                 heartbeat_warned = true;
             }
+        } else {
+            heartbeat_warned = false;
+        }
+        if (backstop_fired) {
+            log_printf("ERROR: Control loop missed the failsafe, PWM cut!\n");
+            backstop_fired = false;
         }
+        uint8_t stalled = control.stalled;
+        if (stalled & ~stall_warned)
+            log_printf("WARN: Track stalled (%s), duty cut!\n", stalled & ~stall_warned & 1 ? "left" : "right");
+        stall_warned = stalled;
     } // end while(true)
 
     return 0; // Should not be reached
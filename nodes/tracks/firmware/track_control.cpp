@@ -0,0 +1,305 @@
+#include "track_control.h"
+
+// Orders the queue and setpoint accesses between the two sides; a DMB on the
+// RP2040, a fence on the host
+static inline void control_barrier() {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+int clamp_track_duty(int duty) {
+    if (duty < -DUTY_MAX) return -DUTY_MAX;
+    if (duty > DUTY_MAX) return DUTY_MAX;
+    return duty;
+}
+
+// Scale a 1/COMMAND_SCALE value to duty, rounded to nearest with halves away
+// from zero: one less to round for a negative value, whose shift floors. The
+// products of two saturated int16 values fit in 31 bits
+static int scale_to_duty(int32_t value) {
+    int32_t q15 = value * MIX_DUTY_Q15;
+    return (q15 + 0x4000 - (int32_t)((uint32_t)q15 >> 31)) >> 15;
+}
+
+void mix_tracks(int linear, int angular, int *left_target, int *right_target) {
+    // --- Standard Differential Drive Mixing ---
+    // Note: Python script sends -100 to 100. Firmware scales that to DUTY_MAX.
+    // Based on observation: positive calculated value means BACKWARD motion.
+    // Therefore, negative calculated value means FORWARD motion.
+    *left_target = clamp_track_duty(scale_to_duty(linear - angular));
+    *right_target = clamp_track_duty(scale_to_duty(linear + angular));
+}
+
+bool mix_curve_init(mix_curve_t *curve, int expo, int deadband) {
+    if (expo < 0 || expo > MIX_EXPO_MAX || deadband < 0 || deadband > MIX_DEADBAND_MAX) return false;
+    const int last = MIX_CURVE_POINTS - 1;
+    for (int i = 0; i < last; i++) {
+        int64_t n = ((int64_t)i << (MIX_CURVE_SHIFT + 15)) / DUTY_MAX; // Q15 of full scale
+        int64_t cubic = (n * n >> 15) * n >> 15;
+        int64_t shaped = (n * (MIX_EXPO_MAX - expo) + cubic * expo) / MIX_EXPO_MAX;
+        curve->duty[i] = (int16_t)((shaped * DUTY_MAX + 0x4000) >> 15);
+    }
+    // The last segment runs from the point before DUTY_MAX through DUTY_MAX itself
+    int before = curve->duty[last - 1], span = DUTY_MAX - ((last - 1) << MIX_CURVE_SHIFT);
+    curve->duty[last] = (int16_t)(before + (DUTY_MAX - before) * (1 << MIX_CURVE_SHIFT) / span);
+    curve->dead = deadband * DUTY_MAX / (100 * COMMAND_SCALE);
+    curve->stretch_q16 = (((uint32_t)DUTY_MAX << 16) + DUTY_MAX - curve->dead - 1) / (DUTY_MAX - curve->dead);
+    curve->expo = (int16_t)expo;
+    curve->deadband = (int16_t)deadband;
+    return true;
+}
+
+// Branch free but for the clamps: the sign is folded out and back in with an
+// xor, the deadband is a subtraction and a multiply and the table step a shift
+int mix_curve_apply(const mix_curve_t *curve, int duty) {
+    int sign = duty >> 31; // 0 or -1
+    int live = ((duty ^ sign) - sign) - curve->dead;
+    if (live < 0) live = 0;
+    int magnitude = (int)(((uint32_t)live * curve->stretch_q16 + 0x8000) >> 16);
+    if (magnitude > DUTY_MAX) magnitude = DUTY_MAX;
+    int i = magnitude >> MIX_CURVE_SHIFT, frac = magnitude & ((1 << MIX_CURVE_SHIFT) - 1);
+    int a = curve->duty[i], b = curve->duty[i + 1];
+    int shaped = a + (((b - a) * frac) >> MIX_CURVE_SHIFT);
+    if (shaped > DUTY_MAX) shaped = DUTY_MAX;
+    return (shaped ^ sign) - sign;
+}
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// True if a number ends at text: a separating space or the end of the command
+static bool at_separator(const char *text) {
+    return *text == ' ' || *text == '\0';
+}
+
+bool parse_scaled(const char **text, int16_t *value) {
+    const char *p = *text;
+    while (*p == ' ') p++;
+    bool negative = *p == '-';
+    if (*p == '-' || *p == '+') p++;
+    // The value is mantissa * 10^exponent units; digits beyond 9 significant ones only move the exponent
+    uint32_t mantissa = 0;
+    int exponent = 0, digits = 0;
+    for (; is_digit(*p); p++, digits++) {
+        if (mantissa < 100000000) mantissa = mantissa * 10 + (*p - '0');
+        else exponent++;
+    }
+    if (*p == '.') {
+        for (p++; is_digit(*p); p++, digits++) {
+            if (mantissa < 100000000) {
+                mantissa = mantissa * 10 + (*p - '0');
+                exponent--;
+            }
+        }
+    }
+    if (digits == 0) return false;
+    if (*p == 'e' || *p == 'E') {
+        p++;
+        bool negative_exponent = *p == '-';
+        if (*p == '-' || *p == '+') p++;
+        if (!is_digit(*p)) return false;
+        int e = 0;
+        for (; is_digit(*p); p++)
+            if (e < 100) e = e * 10 + (*p - '0');
+        exponent += negative_exponent ? -e : e;
+    }
+    if (!at_separator(p)) return false;
+    *text = p;
+    for (int scale = COMMAND_SCALE; scale > 1; scale /= 10) exponent++;
+    for (; exponent < 0 && mantissa; exponent++) mantissa /= 10;
+    for (; exponent > 0 && mantissa && mantissa <= INT16_MAX; exponent--) mantissa *= 10;
+    if (mantissa > INT16_MAX) mantissa = INT16_MAX;
+    *value = (int16_t)(negative ? -(int32_t)mantissa : (int32_t)mantissa);
+    return true;
+}
+
+bool parse_uint(const char **text, uint32_t *value) {
+    const char *p = *text;
+    while (*p == ' ') p++;
+    if (!is_digit(*p)) return false;
+    uint64_t result = 0;
+    for (; is_digit(*p); p++) {
+        result = result * 10 + (*p - '0');
+        if (result > UINT32_MAX) return false;
+    }
+    if (!at_separator(p)) return false;
+    *text = p;
+    *value = (uint32_t)result;
+    return true;
+}
+
+uint32_t setpoint_pack(int left, int right, uint32_t count) {
+    const uint32_t duty_mask = (1u << SETPOINT_DUTY_BITS) - 1;
+    return ((uint32_t)left & duty_mask) |
+           (((uint32_t)right & duty_mask) << SETPOINT_DUTY_BITS) |
+           ((count & (SETPOINT_COUNTS - 1)) << SETPOINT_SEQ_SHIFT);
+}
+
+// The duty fields are sign extended
+int setpoint_left(uint32_t setpoint) {
+    return (int32_t)(setpoint << (32 - SETPOINT_DUTY_BITS)) >> (32 - SETPOINT_DUTY_BITS);
+}
+
+int setpoint_right(uint32_t setpoint) {
+    return (int32_t)(setpoint << (32 - SETPOINT_SEQ_SHIFT)) >> (32 - SETPOINT_DUTY_BITS);
+}
+
+uint32_t setpoint_count(uint32_t setpoint) {
+    return setpoint >> SETPOINT_SEQ_SHIFT;
+}
+
+void motion_flush(motion_queue_t *queue) {
+    queue->flush_head = queue->head;
+    control_barrier();
+    queue->flush_seq = queue->flush_seq + 1;
+}
+
+bool motion_push(motion_queue_t *queue, int linear, int angular, uint16_t duration_ms) {
+    if (queue->head - queue->tail >= MOTION_QUEUE_LEN) return false;
+    int left, right;
+    mix_tracks(linear, angular, &left, &right);
+    motion_segment_t *segment = &queue->slots[queue->head & (MOTION_QUEUE_LEN - 1)];
+    segment->left = (int16_t)left;
+    segment->right = (int16_t)right;
+    segment->duration_ms = duration_ms;
+    control_barrier(); // segment before index, the control loop reads them in that order
+    queue->head = queue->head + 1;
+    return true;
+}
+
+// Advance the motion queue by one tick; true while it owns the targets
+static bool motion_tick(motion_player_t *player, motion_queue_t *queue, bool drop,
+                        const int current[2], int target[2]) {
+    uint32_t head = queue->head;
+    uint32_t flush_seq = queue->flush_seq;
+    if (flush_seq != player->flush_seq) {
+        control_barrier();
+        queue->tail = queue->flush_head;
+        player->flush_seq = flush_seq;
+        player->owns = player->playing = false;
+    }
+    if (drop) {
+        queue->tail = head;
+        player->owns = player->playing = false;
+        return false;
+    }
+    if (!player->playing && queue->tail != head) {
+        control_barrier();
+        const motion_segment_t *segment = &queue->slots[queue->tail & (MOTION_QUEUE_LEN - 1)];
+        player->start[0] = current[0];
+        player->start[1] = current[1];
+        player->end[0] = segment->left;
+        player->end[1] = segment->right;
+        player->ticks = (uint32_t)segment->duration_ms * 1000 / CONTROL_PERIOD_US;
+        player->elapsed = 0;
+        control_barrier(); // done with the slot before handing it back
+        queue->tail = queue->tail + 1;
+        player->owns = player->playing = true;
+    }
+    if (player->playing) {
+        player->elapsed++;
+        if (player->elapsed >= player->ticks) {
+            player->playing = false;
+            player->elapsed = player->ticks;
+        }
+    }
+    if (player->owns) {
+        for (int i = 0; i < 2; i++)
+            target[i] = player->ticks == 0 ? player->end[i] :
+                player->start[i] + (int)((int64_t)(player->end[i] - player->start[i]) * (int64_t)player->elapsed / (int64_t)player->ticks);
+    }
+    return player->owns;
+}
+
+// Move out at most step toward target
+static int slew(int out, int target, int step) {
+    if (out < target)
+        return (target - out > step) ? out + step : target;
+    if (out > target)
+        return (out - target > step) ? out - step : target;
+    return out;
+}
+
+// Filter the current of both tracks and update their stall state
+static void current_tick(track_control_t *ctl, const track_hal_t *hal) {
+    uint8_t stalled = 0;
+    for (int i = 0; i < 2; i++) {
+        ctl->current_acc[i] += hal->read_current(hal->ctx, i) - (ctl->current_acc[i] >> CURRENT_FILTER_SHIFT);
+        ctl->current_ma[i] = ctl->current_acc[i] >> CURRENT_FILTER_SHIFT;
+        if (ctl->stall_hold[i] > 0) {
+            ctl->stall_hold[i]--;
+        } else if (ctl->current_ma[i] <= STALL_CURRENT_MA) {
+            ctl->stall_ticks[i] = 0;
+        } else if (++ctl->stall_ticks[i] >= STALL_TICKS) {
+            ctl->stall_ticks[i] = 0;
+            ctl->stall_hold[i] = STALL_HOLD_TICKS;
+        }
+        if (ctl->stall_hold[i] > 0) stalled |= 1 << i;
+    }
+    ctl->stalled = stalled;
+}
+
+static int32_t clamp32(int32_t value, int32_t limit) {
+    return value > limit ? limit : value < -limit ? -limit : value;
+}
+
+// Turn the target's angular part into a yaw rate request and correct it from
+// the gyro; the loop only runs while the tracks are meant to move
+static void heading_tick(track_control_t *ctl, const track_hal_t *hal, bool active, int target[2]) {
+    int rate = hal->read_yaw_rate(hal->ctx);
+    ctl->yaw_rate = rate;
+    if (!active || !ctl->heading_hold || (target[0] == 0 && target[1] == 0)) {
+        ctl->heading_error = ctl->heading_integral = 0;
+        return;
+    }
+    int angular = (target[1] - target[0]) / 2;
+    int error = angular * HEADING_RATE_MAX / DUTY_MAX - rate;
+    ctl->heading_error = clamp32(ctl->heading_error + error * (CONTROL_PERIOD_US / 1000), HEADING_ERROR_MAX);
+    ctl->heading_integral = clamp32(ctl->heading_integral + ctl->heading_error, HEADING_INTEGRAL_MAX);
+    int32_t correction = ((error * HEADING_KD_Q8) >> 8) +
+                         (int32_t)(((int64_t)ctl->heading_error * HEADING_KP_Q16) >> 16) +
+                         (int32_t)(((int64_t)ctl->heading_integral * HEADING_KI_Q24) >> 24);
+    correction = clamp32(correction, HEADING_CORR_MAX);
+    target[0] = clamp_track_duty(target[0] - correction);
+    target[1] = clamp_track_duty(target[1] + correction);
+}
+
+void track_control_tick(track_control_t *ctl, motion_queue_t *queue, uint32_t setpoint,
+                        uint32_t heartbeat_age_ms, const track_hal_t *hal) {
+    bool timed_out = heartbeat_age_ms > HEARTBEAT_TIMEOUT_US / 1000;
+    if (timed_out) {
+        // Forget the targets, a heartbeat alone must not resume driving
+        ctl->halted = true;
+        ctl->halted_seq = setpoint_count(setpoint);
+    } else if (ctl->halted && setpoint_count(setpoint) != ctl->halted_seq) {
+        ctl->halted = false;
+    }
+
+    int target[2] = {0, 0};
+    if (motion_tick(&ctl->player, queue, timed_out, ctl->target, target)) {
+        ctl->halted = false; // a queued segment is a new command too
+    } else if (!ctl->halted) {
+        target[0] = setpoint_left(setpoint);
+        target[1] = setpoint_right(setpoint);
+    }
+    ctl->target[0] = target[0]; // as commanded, a queued segment starts from it
+    ctl->target[1] = target[1];
+    const mix_curve_t *curve = ctl->curve;
+    ctl->curve_used = curve;
+    if (curve) {
+        target[0] = mix_curve_apply(curve, target[0]);
+        target[1] = mix_curve_apply(curve, target[1]);
+    }
+    if (hal->read_yaw_rate) heading_tick(ctl, hal, !timed_out && !ctl->halted, target);
+    if (hal->read_current) current_tick(ctl, hal);
+    int step = timed_out ? FAILSAFE_RAMP_STEP : RAMP_STEP;
+    int out[2];
+    for (int i = 0; i < 2; i++) {
+        out[i] = slew(ctl->output[i], target[i], step);
+        if (ctl->stall_hold[i] > 0) // cut at once, not ramped
+            out[i] = out[i] > STALL_DUTY ? STALL_DUTY : out[i] < -STALL_DUTY ? -STALL_DUTY : out[i];
+        ctl->output[i] = out[i];
+    }
+    hal->set_outputs(hal->ctx, out);
+    ctl->failsafe = timed_out;
+}
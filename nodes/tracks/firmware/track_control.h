@@ -0,0 +1,179 @@
+// Track control core: command number parsing, differential mixing, the
+// response curve, slew limiting, the heartbeat failsafe, stall detection, heading hold and the
+// motion queue player. Nothing in here uses floating point, which the RP2040 only has in
+// software, or touches the Pico SDK; the firmware puts the outputs on the pins
+// through track_hal_t and the host benchmark in bench/ runs the very same code
+// against a simulated HAL
+#ifndef TRACK_CONTROL_H
+#define TRACK_CONTROL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define DUTY_MAX 8000 // Full scale of the signed track duty, independent of the PWM wrap
+
+// Linear and angular travel in 1/100 of a text command unit, -10000..10000 for
+// -100..100, as in the binary frames. Mixing scales them to duty in Q15
+#define COMMAND_SCALE 100
+#define MIX_DUTY_Q15  ((DUTY_MAX * 32768 + 50 * COMMAND_SCALE) / (100 * COMMAND_SCALE)) // duty per unit
+
+// The control loop runs every CONTROL_PERIOD_US: it ramps the output toward
+// the target and, once the heartbeat is missing, ramps both tracks down to a
+// stop, however long the command side is stuck
+#define CONTROL_PERIOD_US    1000    // 1 kHz
+#define RAMP_STEP            32      // duty per tick, full scale in 250 ms
+#define FAILSAFE_RAMP_STEP   80      // duty per tick, full scale in 100 ms
+#define HEARTBEAT_TIMEOUT_US 3000000 // 3 seconds
+
+// Stall detection, with current sensing (track_hal_t::read_current): each
+// tick's current is low-pass filtered over about 2^CURRENT_FILTER_SHIFT ticks.
+// Once the filtered current stays above STALL_CURRENT_MA for STALL_TICKS, the
+// track's duty is cut to STALL_DUTY at once and held there for
+// STALL_HOLD_TICKS, then ramps back up; a track still stalled is cut again
+#define CURRENT_FILTER_SHIFT 2    // ~4 ms time constant
+#define STALL_CURRENT_MA     2500
+#define STALL_TICKS          10   // 10 ms
+#define STALL_DUTY           (DUTY_MAX / 5)
+#define STALL_HOLD_TICKS     500  // 0.5 s
+
+// Heading hold, with a gyro (track_hal_t::read_yaw_rate) and hold enabled:
+// the turning part of the target, (right - left) / 2, is taken as a yaw rate
+// request, HEADING_RATE_MAX at full duty. The rate error integrates into a
+// heading error, and a PID loop on that heading (the rate error being its
+// derivative) adds a correction, so driving straight keeps the heading
+// whatever pulls the robot aside. Rates are in centidegrees/s
+#define HEADING_RATE_MAX   9000       // 90°/s at full angular duty
+#define HEADING_KD_Q8      128        // duty per cdps of rate error, Q8
+#define HEADING_KP_Q16     131        // duty per centidegree/1000 of heading error, Q16
+#define HEADING_KI_Q24     134        // duty per (centidegree/1000 * tick), Q24
+#define HEADING_ERROR_MAX  3000000    // heading error clamp, 30° in centidegrees/1000
+#define HEADING_CORR_MAX   (DUTY_MAX / 2)
+#define HEADING_INTEGRAL_MAX ((int32_t)(((int64_t)HEADING_CORR_MAX << 24) / HEADING_KI_Q24))
+
+// Response curve, the mixer stage of the control loop: each track's target
+// duty goes through a deadband and an expo curve, out = (1 - e) x + e x^3 with
+// x the part past the deadband, stretched so full scale stays full scale. The
+// expo is a table of MIX_CURVE_POINTS duties, one per 1 << MIX_CURVE_SHIFT
+// duty of input and interpolated in between, built by the command side when
+// it changes; the last point extends the last segment to exactly DUTY_MAX
+#define MIX_CURVE_SHIFT    7
+#define MIX_CURVE_POINTS   ((DUTY_MAX >> MIX_CURVE_SHIFT) + 2)
+#define MIX_EXPO_MAX       (100 * COMMAND_SCALE) // 100 %, the curve is x^3
+#define MIX_DEADBAND_MAX   (50 * COMMAND_SCALE)  // 50 % of full scale
+
+// Motion queue: timed segments "ramp from the previous target to (linear,
+// angular) over ms", queued by the command side and played by the control
+// loop, so a manoeuvre keeps its timing whatever the host does. A segment with
+// the previous values holds, one with 0 ms steps. A move command or a flush
+// drops the queue; the last segment's target stays until the next command
+#define MOTION_QUEUE_LEN 8 // power of two
+
+// Setpoint handed from the command side to the control loop as one atomic
+// word: bits 0-13 left and 14-27 right target duty (signed), 28-31 a count
+// that changes with every command
+#define SETPOINT_DUTY_BITS 14
+#define SETPOINT_SEQ_SHIFT (2 * SETPOINT_DUTY_BITS)
+#define SETPOINT_COUNTS    (1u << (32 - SETPOINT_SEQ_SHIFT))
+
+// What the control loop needs from the hardware
+typedef struct {
+    // put the signed duties (-DUTY_MAX to DUTY_MAX, negative means FORWARD) of
+    // both tracks, left then right, so that they take effect in the same PWM period
+    void (*set_outputs)(void *ctx, const int duty[2]);
+    void *ctx;
+    // motor current of a track in mA, once per tick; NULL without current sensing
+    int (*read_current)(void *ctx, int track);
+    // yaw rate in centidegrees/s, positive the way a positive angular command
+    // turns, once per tick; NULL without a gyro
+    int (*read_yaw_rate)(void *ctx);
+} track_hal_t;
+
+typedef struct {
+    int16_t duty[MIX_CURVE_POINTS]; // shaped duty for an input of i << MIX_CURVE_SHIFT past the deadband
+    int32_t dead;                   // deadband in duty
+    uint32_t stretch_q16;           // DUTY_MAX / (DUTY_MAX - dead), Q16 rounded up
+    int16_t expo, deadband;         // as set, 1/COMMAND_SCALE %
+} mix_curve_t;
+
+typedef struct {
+    int16_t left, right;  // target duty at the end of the segment
+    uint16_t duration_ms;
+} motion_segment_t;
+
+// Single producer (command side) / single consumer (control loop). A flush
+// publishes the head at that moment in flush_head, then bumps flush_seq; the
+// control loop then skips everything before that head
+typedef struct {
+    motion_segment_t slots[MOTION_QUEUE_LEN];
+    volatile uint32_t head, tail;
+    volatile uint32_t flush_head, flush_seq;
+} motion_queue_t;
+
+// Motion queue player state, control loop only
+typedef struct {
+    bool owns;             // targets come from the queue, not the setpoint
+    bool playing;          // a segment is in progress
+    int start[2], end[2];  // left, right duty at the segment's start and end
+    uint32_t ticks, elapsed;
+    uint32_t flush_seq;    // last flush_seq seen
+} motion_player_t;
+
+// Control loop state; output and failsafe may be read from the command side
+typedef struct {
+    bool halted;              // stopped by the failsafe...
+    uint32_t halted_seq;      // ...until a command newer than this one arrives
+    motion_player_t player;
+    const mix_curve_t *volatile curve; // set by the command side, NULL for a linear response
+    const mix_curve_t *volatile curve_used; // the curve of the last tick, any other may be rebuilt
+    int target[2];            // left, right target of the last tick, before the curve
+    volatile int output[2];   // left, right signed duty on the pins
+    volatile bool failsafe;   // heartbeat missing, tracks ramping down
+    int32_t current_acc[2];   // current filter state, mA << CURRENT_FILTER_SHIFT
+    volatile int current_ma[2]; // left, right filtered motor current
+    int stall_ticks[2];       // ticks in a row above STALL_CURRENT_MA
+    int stall_hold[2];        // ticks the duty stays cut to STALL_DUTY
+    volatile uint8_t stalled; // bit 0 left, bit 1 right: duty cut by a stall
+    volatile bool heading_hold; // set by the command side
+    volatile int yaw_rate;    // last gyro reading, cdps
+    int32_t heading_error;    // requested minus turned heading, centidegrees/1000
+    int32_t heading_integral; // sum of heading_error over the ticks
+} track_control_t;
+
+// Clamp a signed duty to the allowed range (-DUTY_MAX to DUTY_MAX)
+int clamp_track_duty(int duty);
+
+// Mix linear/angular (-10000..10000, see COMMAND_SCALE) into the target duty of both tracks
+void mix_tracks(int linear, int angular, int *left_target, int *right_target);
+
+// Build the response curve for expo (0..MIX_EXPO_MAX) and deadband
+// (0..MIX_DEADBAND_MAX), in 1/COMMAND_SCALE %; false if either is out of range
+bool mix_curve_init(mix_curve_t *curve, int expo, int deadband);
+// Shape a signed duty with the curve
+int mix_curve_apply(const mix_curve_t *curve, int duty);
+
+// Parse the decimal number at *text ("-50", "12.5", "1e-05", leading spaces
+// skipped) in 1/COMMAND_SCALE units, truncated toward zero and saturated to
+// int16. False unless a space or the end follows it; *text is moved past it
+bool parse_scaled(const char **text, int16_t *value);
+// Same for an unsigned integer ("20000"), false if it does not fit in 32 bits
+bool parse_uint(const char **text, uint32_t *value);
+
+// Build a setpoint word from both target duties and a command count
+uint32_t setpoint_pack(int left, int right, uint32_t count);
+int setpoint_left(uint32_t setpoint);
+int setpoint_right(uint32_t setpoint);
+uint32_t setpoint_count(uint32_t setpoint);
+
+// Command side: queue one segment, false if the queue is full
+bool motion_push(motion_queue_t *queue, int linear, int angular, uint16_t duration_ms);
+// Command side: drop every queued segment
+void motion_flush(motion_queue_t *queue);
+
+// One control loop iteration: pick the target from the motion queue or the
+// setpoint, apply the failsafe once the heartbeat is older than
+// HEARTBEAT_TIMEOUT_US, shape it with the curve, correct the heading, cut stalled tracks and put the
+// slew limited outputs on hal
+void track_control_tick(track_control_t *ctl, motion_queue_t *queue, uint32_t setpoint,
+                        uint32_t heartbeat_age_ms, const track_hal_t *hal);
+
+#endif
@@ -0,0 +1,24 @@
+// TinyUSB configuration of TRACKS_TRANSPORT=vendor, see usb_descriptors.c.
+// The other transports get theirs from the SDK's stdio_usb
+#ifndef TUSB_CONFIG_H
+#define TUSB_CONFIG_H
+
+#define CFG_TUSB_RHPORT0_MODE  (OPT_MODE_DEVICE)
+#define CFG_TUD_ENDPOINT0_SIZE 64
+
+#define CFG_TUD_CDC    1 // text commands and the log
+#define CFG_TUD_VENDOR 1 // binary frames
+
+#ifndef CFG_TUD_CDC_RX_BUFSIZE
+#define CFG_TUD_CDC_RX_BUFSIZE 512
+#endif
+#ifndef CFG_TUD_CDC_TX_BUFSIZE
+#define CFG_TUD_CDC_TX_BUFSIZE 1024
+#endif
+
+// A bulk packet holds several frames, the FIFOs a burst of them
+#define CFG_TUD_VENDOR_EPSIZE     64
+#define CFG_TUD_VENDOR_RX_BUFSIZE 512
+#define CFG_TUD_VENDOR_TX_BUFSIZE 1024
+
+#endif
@@ -0,0 +1,162 @@
+// USB device of TRACKS_TRANSPORT=vendor, in place of the SDK's stdio_usb:
+//   interface 0, 1  CDC serial port, text commands and the log
+//   interface 2     vendor class, bulk OUT 0x03 / IN 0x83, binary frames
+//   interface 3     the SDK's reset interface, so picotool can still reboot it
+// Vendor and product ID, strings and the serial number are the ones stdio_usb
+// uses, so /dev/serial/by-id/usb-Raspberry_Pi_Pico_<id>-if00 stays the same.
+
+#include <string.h>
+#include "tusb.h"
+#include "device/usbd_pvt.h"
+#include "hardware/watchdog.h"
+#include "pico/bootrom.h"
+#include "pico/unique_id.h"
+#include "pico/usb_reset_interface.h"
+
+#define USB_VID 0x2E8A // Raspberry Pi
+#define USB_PID 0x000A // Pico SDK CDC
+
+enum { ITF_NUM_CDC, ITF_NUM_CDC_DATA, ITF_NUM_VENDOR, ITF_NUM_RESET, ITF_NUM_TOTAL };
+
+#define EPNUM_CDC_NOTIF  0x81
+#define EPNUM_CDC_OUT    0x02
+#define EPNUM_CDC_IN     0x82
+#define EPNUM_VENDOR_OUT 0x03
+#define EPNUM_VENDOR_IN  0x83
+
+#define RESET_DESC_LEN 9
+#define CONFIG_TOTAL_LEN (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + TUD_VENDOR_DESC_LEN + RESET_DESC_LEN)
+
+enum { STR_LANGID, STR_MANUFACTURER, STR_PRODUCT, STR_SERIAL, STR_CDC, STR_VENDOR, STR_RESET };
+
+static const tusb_desc_device_t device_descriptor = {
+    .bLength = sizeof(tusb_desc_device_t),
+    .bDescriptorType = TUSB_DESC_DEVICE,
+    .bcdUSB = 0x0200,
+    .bDeviceClass = TUSB_CLASS_MISC, // interface association, for the CDC pair
+    .bDeviceSubClass = MISC_SUBCLASS_COMMON,
+    .bDeviceProtocol = MISC_PROTOCOL_IAD,
+    .bMaxPacketSize0 = CFG_TUD_ENDPOINT0_SIZE,
+    .idVendor = USB_VID,
+    .idProduct = USB_PID,
+    .bcdDevice = 0x0100,
+    .iManufacturer = STR_MANUFACTURER,
+    .iProduct = STR_PRODUCT,
+    .iSerialNumber = STR_SERIAL,
+    .bNumConfigurations = 1,
+};
+
+static const uint8_t config_descriptor[] = {
+    TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, 0, 250),
+    TUD_CDC_DESCRIPTOR(ITF_NUM_CDC, STR_CDC, EPNUM_CDC_NOTIF, 8, EPNUM_CDC_OUT, EPNUM_CDC_IN, 64),
+    TUD_VENDOR_DESCRIPTOR(ITF_NUM_VENDOR, STR_VENDOR, EPNUM_VENDOR_OUT, EPNUM_VENDOR_IN, CFG_TUD_VENDOR_EPSIZE),
+    // Reset interface: no endpoints, only control requests
+    RESET_DESC_LEN, TUSB_DESC_INTERFACE, ITF_NUM_RESET, 0, 0, TUSB_CLASS_VENDOR_SPECIFIC,
+    RESET_INTERFACE_SUBCLASS, RESET_INTERFACE_PROTOCOL, STR_RESET,
+};
+
+static const char *const strings[] = {
+    [STR_MANUFACTURER] = "Raspberry Pi",
+    [STR_PRODUCT] = "Pico",
+    [STR_CDC] = "Board CDC",
+    [STR_VENDOR] = "Tracks frames",
+    [STR_RESET] = "Reset",
+};
+
+const uint8_t *tud_descriptor_device_cb(void) {
+    return (const uint8_t *)&device_descriptor;
+}
+
+const uint8_t *tud_descriptor_configuration_cb(uint8_t index) {
+    (void)index;
+    return config_descriptor;
+}
+
+const uint16_t *tud_descriptor_string_cb(uint8_t index, uint16_t langid) {
+    (void)langid;
+    static uint16_t desc[32];
+    static char serial[2 * PICO_UNIQUE_BOARD_ID_SIZE_BYTES + 1];
+    const char *str;
+    int len;
+    if (index == STR_LANGID) {
+        desc[1] = 0x0409; // English
+        len = 1;
+    } else {
+        if (index == STR_SERIAL) {
+            if (!serial[0]) pico_get_unique_board_id_string(serial, sizeof(serial));
+            str = serial;
+        } else if (index < sizeof(strings) / sizeof(strings[0]) && strings[index]) {
+            str = strings[index];
+        } else {
+            return NULL;
+        }
+        len = (int)strlen(str);
+        if (len > 31) len = 31;
+        for (int i = 0; i < len; i++)
+            desc[1 + i] = (uint8_t)str[i];
+    }
+    desc[0] = (uint16_t)((TUSB_DESC_STRING << 8) | (2 * len + 2));
+    return desc;
+}
+
+// Reset interface driver, as in stdio_usb: BOOTSEL or a plain reboot on request
+static uint8_t reset_itf_num;
+
+static void resetd_init(void) {
+}
+
+static void resetd_reset(uint8_t rhport) {
+    (void)rhport;
+    reset_itf_num = 0;
+}
+
+static uint16_t resetd_open(uint8_t rhport, const tusb_desc_interface_t *itf_desc, uint16_t max_len) {
+    (void)rhport;
+    // The frames interface is vendor class too, it differs in the protocol
+    TU_VERIFY(itf_desc->bInterfaceClass == TUSB_CLASS_VENDOR_SPECIFIC &&
+              itf_desc->bInterfaceSubClass == RESET_INTERFACE_SUBCLASS &&
+              itf_desc->bInterfaceProtocol == RESET_INTERFACE_PROTOCOL, 0);
+    TU_VERIFY(max_len >= sizeof(tusb_desc_interface_t), 0);
+    reset_itf_num = itf_desc->bInterfaceNumber;
+    return sizeof(tusb_desc_interface_t);
+}
+
+static bool resetd_control_xfer_cb(uint8_t rhport, uint8_t stage, const tusb_control_request_t *request) {
+    (void)rhport;
+    if (stage != CONTROL_STAGE_SETUP) return true;
+    if (request->wIndex != reset_itf_num) return false;
+    if (request->bRequest == RESET_REQUEST_BOOTSEL) {
+        reset_usb_boot(0, request->wValue & 0x7F); // does not return
+    } else if (request->bRequest == RESET_REQUEST_FLASH) {
+        watchdog_reboot(0, 0, 100);
+        return true;
+    }
+    return false;
+}
+
+static bool resetd_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes) {
+    (void)rhport;
+    (void)ep_addr;
+    (void)result;
+    (void)xferred_bytes;
+    return true;
+}
+
+static const usbd_class_driver_t resetd_driver = {
+#if CFG_TUSB_DEBUG >= 2
+    .name = "RESET",
+#endif
+    .init = resetd_init,
+    .reset = resetd_reset,
+    .open = resetd_open,
+    .control_xfer_cb = resetd_control_xfer_cb,
+    .xfer_cb = resetd_xfer_cb,
+    .sof = NULL,
+};
+
+// TinyUSB tries application drivers before its own, so the vendor class
+// driver only gets the frames interface
+const usbd_class_driver_t *usbd_app_driver_get_cb(uint8_t *driver_count) {
+    *driver_count = 1;
+    return &resetd_driver;
+}
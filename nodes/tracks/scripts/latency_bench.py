@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+"""Measure the latency of the host -> tracks firmware command path.
+
+Usage:
+    python3 latency_bench.py /dev/serial/by-id/usb-Raspberry_Pi_Pico_E66...-if00 [--count 500] [--interval 0.02]
+    python3 latency_bench.py --usb E6612483CB1A9621
+
+Alternates PING frames, which give the serial round trip and map the Pico's
+clock onto the host clock, with MOVE frames, whose ACKs tell when each frame
+was received and when the control loop put it on the PWM. Prints the
+distribution of each leg in milliseconds.
+
+With --usb the frames go over the vendor interface of a firmware built with
+TRACKS_TRANSPORT=vendor, given the Pico's serial number, instead of the CDC
+serial port.
+
+The MOVE frames command speed 0, so the tracks do not move. Stop the tracks
+node first, only one process can own the serial port.
+"""
+
+import argparse
+import os
+import sys
+import time
+
+from serial import Serial
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+from tracks.protocol import (StreamDecoder, decode_ack, decode_pong, encode_move, encode_ping,  # noqa: E402
+                             FRAME_ACK, FRAME_PONG)
+from tracks.usb_link import VendorLink  # noqa: E402
+
+OFFSET_WINDOW = 20  # pings considered for each clock offset estimate
+
+
+def now_us() -> int:
+    """Host clock in microseconds."""
+    return time.perf_counter_ns() // 1000
+
+
+def percentile(values: list, fraction: float) -> float:
+    """Nearest-rank percentile of the sorted list `values`."""
+    index = min(len(values) - 1, max(0, int(round(fraction * (len(values) - 1)))))
+    return values[index]
+
+
+def report(name: str, samples_us: list):
+    """Print min/median/p90/p99/max of `samples_us` in milliseconds."""
+    if not samples_us:
+        print(f"{name:<34} no samples")
+        return
+    values = sorted(samples_us)
+    stats = [values[0], percentile(values, 0.5), percentile(values, 0.9), percentile(values, 0.99), values[-1]]
+    print(f"{name:<34} n={len(values):<5} " +
+          "  ".join(f"{label} {value / 1000:7.3f}" for label, value in zip(("min", "p50", "p90", "p99", "max"), stats)) +
+          " ms")
+
+
+def unwrap32(low: int, near: int) -> int:
+    """Full Pico time for the low 32 bits `low`, closest to the estimate `near`."""
+    delta = (low - near) & 0xFFFFFFFF
+    if delta >= 1 << 31:
+        delta -= 1 << 32
+    return near + delta
+
+
+class Bench:
+    """Link to the firmware, collecting PONGs and ACKs as they arrive."""
+
+    def __init__(self, port: str, usb: bool = False):
+        self.ser = VendorLink(port, timeout=0) if usb else Serial(port, 115200, timeout=0)
+        self.decoder = StreamDecoder()
+        self.pongs = {}    # token -> (mcu_us, host receive us)
+        self.pending = {}  # MOVE frame seq -> (host send us, clock offset us)
+        self.to_pico, self.to_pwm, self.pico_internal = [], [], []
+
+    def pump(self):
+        """Read what is available and sort the frames."""
+        data = self.ser.read(self.ser.in_waiting or 1)
+        received_us = now_us()
+        for item in self.decoder.feed(data):
+            if item[0] != "frame":
+                continue
+            if item[1] == FRAME_PONG:
+                pong = decode_pong(item[3])
+                self.pongs[pong["token"]] = (pong["mcu_us"], received_us)
+            elif item[1] == FRAME_ACK:
+                self.record_ack(decode_ack(item[3]))
+
+    def record_ack(self, ack: dict):
+        """Turn an ACK into host-clock latencies of its MOVE frame."""
+        if ack["seq"] not in self.pending:
+            return
+        sent_us, offset = self.pending.pop(ack["seq"])
+        expected = sent_us + offset
+        rx_us = unwrap32(ack["rx_us"], expected) - offset
+        applied_us = unwrap32(ack["applied_us"], expected) - offset
+        self.to_pico.append(rx_us - sent_us)
+        self.to_pwm.append(applied_us - sent_us)
+        self.pico_internal.append(applied_us - rx_us)
+
+    def wait_for_pong(self, token: int, timeout: float):
+        """Return (mcu_us, host receive us) for `token`, or None on timeout."""
+        deadline = time.monotonic() + timeout
+        while token not in self.pongs and time.monotonic() < deadline:
+            self.pump()
+        return self.pongs.pop(token, None)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("port", help="serial port of the tracks Pico, its serial number with --usb")
+    parser.add_argument("--usb", action="store_true", help="use the vendor interface instead of the serial port")
+    parser.add_argument("--count", type=int, default=500, help="PING/MOVE pairs to send")
+    parser.add_argument("--interval", type=float, default=0.02, help="seconds between pairs")
+    args = parser.parse_args()
+
+    bench = Bench(args.port, args.usb)
+    bench.ser.write(b"ack 1\n")
+    bench.ser.flush()
+    time.sleep(0.1)
+
+    round_trips = []
+    syncs = []     # (rtt, host send us, offset us) per answered ping
+    moves = 0
+    lost_pings = 0
+    seq = 0
+    for i in range(args.count):
+        sent_us = now_us()
+        bench.ser.write(encode_ping(i, seq))
+        seq += 1
+        pong = bench.wait_for_pong(i, 0.5)
+        if pong is None:
+            lost_pings += 1
+        else:
+            mcu_us, received_us = pong
+            rtt = received_us - sent_us
+            round_trips.append(rtt)
+            # Pico clock minus host clock, assuming a symmetric link
+            syncs.append((rtt, sent_us, mcu_us - (sent_us + received_us) // 2))
+
+        if syncs:
+            recent = syncs[-OFFSET_WINDOW:]
+            offset = min(recent)[2]  # the fastest round trip has the least asymmetry
+            bench.pending[seq & 0xFF] = (now_us(), offset)  # replaces a MOVE never acknowledged
+            bench.ser.write(encode_move(0, 0, seq))
+            seq += 1
+            moves += 1
+        time.sleep(args.interval)
+        bench.pump()
+
+    deadline = time.monotonic() + 0.3
+    while time.monotonic() < deadline:
+        bench.pump()
+    bench.ser.write(b"ack 0\n")
+    bench.ser.close()
+
+    print(f"{args.count} pings ({lost_pings} lost), {moves} moves ({moves - len(bench.to_pwm)} not acknowledged)")
+    report("round trip (PING -> PONG)", round_trips)
+    report("host -> Pico (MOVE received)", bench.to_pico)
+    report("host -> PWM (MOVE applied)", bench.to_pwm)
+    report("Pico receive -> PWM", bench.pico_internal)
+    print("One-way figures assume a symmetric link, see the round trip for their uncertainty.")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,92 @@
+import struct
+
+import pytest
+
+from tracks.protocol import (crc8, encode_move, encode_heartbeat, encode_motion, encode_ping, decode_ack,
+                             decode_odometry, decode_pong, decode_telemetry, StreamDecoder, FRAME_SYNC,
+                             FRAME_MOVE, FRAME_HEARTBEAT, FRAME_MOTION, FRAME_MOTION_FLUSH, FRAME_PING,
+                             FRAME_ACK, FRAME_PONG, FRAME_ODOMETRY, FRAME_TELEMETRY, MOTION_QUEUE_LEN)
+
+
+def test_crc8_check_value():
+    # CRC-8/SMBUS check value for "123456789"
+    assert crc8(b"123456789") == 0xF4
+
+
+def test_move_frame_layout():
+    frame = encode_move(50, -12.5, 257)
+    assert len(frame) == 8
+    assert frame[0] == FRAME_SYNC
+    assert frame[1] == FRAME_MOVE
+    assert frame[2] == 1  # low 8 bits of the sequence number
+    assert frame[3:7] == (5000).to_bytes(2, "little", signed=True) + (-1250).to_bytes(2, "little", signed=True)
+    assert frame[7] == crc8(frame[1:7])
+
+
+def test_motion_frame_layout():
+    frame = encode_motion([(-50, 0, 200), (0, 0, 0)], 3)
+    assert len(frame) == 6 + 2 * 6
+    assert frame[:5] == bytes([FRAME_SYNC, FRAME_MOTION, 3, FRAME_MOTION_FLUSH, 2])
+    assert frame[5:11] == struct.pack("<hhH", -5000, 0, 200)
+    assert frame[-1] == crc8(frame[1:-1])
+    assert encode_motion([], 4, flush=False)[3:5] == bytes([0, 0])
+
+
+def test_motion_frame_rejects_too_many_segments():
+    with pytest.raises(ValueError):
+        encode_motion([(0, 0, 10)] * (MOTION_QUEUE_LEN + 1), 0)
+
+
+def test_heartbeat_frame_layout():
+    frame = encode_heartbeat(7)
+    assert frame == bytes([FRAME_SYNC, FRAME_HEARTBEAT, 7, crc8(bytes([FRAME_HEARTBEAT, 7]))])
+
+
+def test_stream_decoder_splits_text_and_frames():
+    body = bytes([FRAME_ODOMETRY, 3]) + struct.pack("<iiii", 60, -20, 3000, -1000)
+    frame = bytes([FRAME_SYNC]) + body + bytes([crc8(body)])
+    decoder = StreamDecoder()
+    items = decoder.feed(b"cmd: st" + frame[:5])
+    items += decoder.feed(frame[5:] + b"ats\r\n")
+    assert items[0] == ("frame", FRAME_ODOMETRY, 3, body[2:])
+    assert items[1] == ("text", "cmd: stats")
+    assert decode_odometry(items[0][3]) == {
+        "left_count": 60, "right_count": -20, "left_speed": 3000, "right_speed": -1000}
+
+
+def test_stream_decoder_drops_corrupt_frame():
+    body = bytes([FRAME_ODOMETRY, 0]) + bytes(16)
+    decoder = StreamDecoder()
+    assert decoder.feed(bytes([FRAME_SYNC]) + body + bytes([crc8(body) ^ 1]) + b"ok\n") == [("text", "ok")]
+    assert decoder.bad_frames == 1
+
+
+def test_telemetry_frame_decodes():
+    payload = struct.pack("<hhHHHBIIIIHHIHII", 300, -300, 1234, 17, 5, 1 | 4, 10, 2, 3, 4, 850, 3100, 7, 96, 12, 5)
+    body = bytes([FRAME_TELEMETRY, 1]) + payload
+    items = StreamDecoder().feed(bytes([FRAME_SYNC]) + body + bytes([crc8(body)]))
+    assert len(items) == 1 and items[0][1] == FRAME_TELEMETRY
+    telemetry = decode_telemetry(items[0][3])
+    assert telemetry["left_duty"] == 300 and telemetry["right_duty"] == -300
+    assert telemetry["heartbeat_age_ms"] == 1234 and telemetry["tick_max_us"] == 17
+    assert telemetry["failsafe"] is True
+    assert (telemetry["frames_ok"], telemetry["frames_bad"], telemetry["frames_lost"], telemetry["log_dropped"]) == (10, 2, 3, 4)
+    assert telemetry["left_current_ma"] == 850 and telemetry["right_current_ma"] == 3100
+    assert telemetry["left_stalled"] is False and telemetry["right_stalled"] is True
+    assert telemetry["deadlines_missed"] == 7 and telemetry["rx_high_water"] == 96
+    assert telemetry["moves_coalesced"] == 12 and telemetry["rx_overflows"] == 5
+
+
+def test_ping_frame_layout():
+    frame = encode_ping(0x04030201, 43)
+    assert frame == bytes([FRAME_SYNC, FRAME_PING, 43, 1, 2, 3, 4, crc8(bytes([FRAME_PING, 43, 1, 2, 3, 4]))])
+
+
+def test_ack_and_pong_frames_decode():
+    # An ACK that replaced 3 MOVE frames, then a PONG, as the firmware sends them
+    stream = bytes.fromhex("a583022a287085003c758500033ea58403010203043c75850001000000a0")
+    items = StreamDecoder().feed(stream)
+    assert [item[1] for item in items] == [FRAME_ACK, FRAME_PONG]
+    assert decode_ack(items[0][3]) == {"seq": 42, "rx_us": 0x857028, "applied_us": 0x85753C,
+                                     "superseded": 3}
+    assert decode_pong(items[1][3]) == {"token": 0x04030201, "mcu_us": 0x10085753C}
@@ -0,0 +1,63 @@
+import sys
+import types
+
+import pytest
+
+from tracks.usb_link import VendorLink
+
+
+class FakeEndpoint:
+    def __init__(self, address, packets=()):
+        self.bEndpointAddress = address
+        self.packets = list(packets)
+        self.written = []
+
+    def read(self, size, timeout):
+        if not self.packets:
+            raise TimeoutError
+        return self.packets.pop(0)[:size]
+
+    def write(self, data, timeout):
+        self.written.append(bytes(data))
+        return len(data)
+
+
+@pytest.fixture
+def fake_usb(monkeypatch):
+    """A pyusb stand-in with one Pico whose frames interface has two endpoints."""
+    ep_out, ep_in = FakeEndpoint(0x03), FakeEndpoint(0x83)
+    interface = types.SimpleNamespace(endpoints=[ep_out, ep_in])
+    device = types.SimpleNamespace(get_active_configuration=lambda: "config", claimed=[])
+
+    def find_descriptor(parent, custom_match=None, **match):
+        if parent == "config":
+            return interface if match.get("bInterfaceProtocol") == 0 else None
+        return next(e for e in parent.endpoints if custom_match(e))
+
+    core = types.SimpleNamespace(find=lambda **match: device, USBTimeoutError=TimeoutError)
+    util = types.SimpleNamespace(find_descriptor=find_descriptor, ENDPOINT_OUT=0x00, ENDPOINT_IN=0x80,
+                                 endpoint_direction=lambda address: address & 0x80,
+                                 claim_interface=lambda d, i: d.claimed.append(i),
+                                 release_interface=lambda d, i: d.claimed.remove(i),
+                                 dispose_resources=lambda d: None)
+    usb = types.ModuleType("usb")
+    usb.core, usb.util = core, util
+    monkeypatch.setitem(sys.modules, "usb", usb)
+    monkeypatch.setitem(sys.modules, "usb.core", core)
+    monkeypatch.setitem(sys.modules, "usb.util", util)
+    return device, ep_out, ep_in
+
+
+def test_vendor_link_reads_like_a_serial_port(fake_usb):
+    device, ep_out, ep_in = fake_usb
+    link = VendorLink("E6612483CB1A9621", timeout=0)
+    assert device.claimed and link.is_open
+    assert link.in_waiting == 0 and link.read(8) == b""
+    ep_in.packets.append(b"\xa5\x84frame")
+    assert link.in_waiting == 7
+    assert link.read(2) == b"\xa5\x84"
+    assert link.read(link.in_waiting) == b"frame"
+    link.write(b"\xa5\x02\x00\x0e")
+    assert ep_out.written == [b"\xa5\x02\x00\x0e"]
+    link.close()
+    assert not device.claimed and not link.is_open
@@ -0,0 +1,139 @@
+"""ctypes bindings of the native tracks client (`client/tracks_client.h`).
+
+The library owns the serial port in its own I/O thread: it encodes and
+decodes the frames of `tracks/protocol.py` in C++, stamps what arrives with
+the monotonic clock and coalesces setpoints under the ACK credit, so none of
+that waits for the GIL. ctypes releases the GIL for every call, and every
+call returns at once.
+
+Build the library with `make tracks/client`; `TRACKS_CLIENT_LIB` points
+elsewhere.
+"""
+
+import ctypes
+import os
+
+from tracks.protocol import TELEMETRY_FAILSAFE, TELEMETRY_STALL_LEFT, TELEMETRY_STALL_RIGHT
+
+DEFAULT_LIBRARY = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "client", "build",
+                               "libtracks_client.so")
+LINE_LEN = 128
+
+
+class _Odometry(ctypes.Structure):
+    _fields_ = [("left_count", ctypes.c_int32), ("right_count", ctypes.c_int32),
+                ("left_speed", ctypes.c_int32), ("right_speed", ctypes.c_int32),
+                ("host_ns", ctypes.c_uint64)]
+
+
+class _Telemetry(ctypes.Structure):
+    _fields_ = [("left_duty", ctypes.c_int16), ("right_duty", ctypes.c_int16),
+                ("heartbeat_age_ms", ctypes.c_uint16), ("tick_max_us", ctypes.c_uint16),
+                ("tick_late_max_us", ctypes.c_uint16), ("flags", ctypes.c_uint8),
+                ("frames_ok", ctypes.c_uint32), ("frames_bad", ctypes.c_uint32),
+                ("frames_lost", ctypes.c_uint32), ("log_dropped", ctypes.c_uint32),
+                ("left_current_ma", ctypes.c_uint16), ("right_current_ma", ctypes.c_uint16),
+                ("deadlines_missed", ctypes.c_uint32), ("rx_high_water", ctypes.c_uint16),
+                ("moves_coalesced", ctypes.c_uint32), ("rx_overflows", ctypes.c_uint32),
+                ("host_ns", ctypes.c_uint64)]
+
+
+class _Stats(ctypes.Structure):
+    _fields_ = [(name, ctypes.c_uint32) for name in
+                ("moves_sent", "moves_coalesced", "moves_acked", "in_flight", "ack_last_us", "ack_max_us",
+                 "bad_frames", "lines_dropped", "tx_dropped")] + [("error", ctypes.c_int32)]
+
+
+def _load(path: str) -> ctypes.CDLL:
+    lib = ctypes.CDLL(path, use_errno=True)
+    handle = ctypes.c_void_p
+    lib.tracks_open.argtypes = [ctypes.c_char_p, ctypes.c_int, ctypes.c_int]
+    lib.tracks_open.restype = handle
+    lib.tracks_close.argtypes = [handle]
+    lib.tracks_move.argtypes = [handle, ctypes.c_float, ctypes.c_float]
+    lib.tracks_heartbeat.argtypes = [handle]
+    lib.tracks_command.argtypes = [handle, ctypes.c_char_p]
+    lib.tracks_odometry.argtypes = [handle, ctypes.POINTER(_Odometry)]
+    lib.tracks_telemetry.argtypes = [handle, ctypes.POINTER(_Telemetry)]
+    lib.tracks_line.argtypes = [handle, ctypes.c_char_p, ctypes.c_int]
+    lib.tracks_get_stats.argtypes = [handle, ctypes.POINTER(_Stats)]
+    return lib
+
+
+def _as_dict(struct: ctypes.Structure) -> dict:
+    return {name: getattr(struct, name) for name, _ in struct._fields_}
+
+
+class TracksClient:
+    """The tracks Pico on a serial port, driven by the native client."""
+
+    def __init__(self, port: str, baud: int = 115200, moves_in_flight: int = 2, library: str = None):
+        """Open `port` and start the client's I/O thread.
+
+        Args:
+            port: Serial port of the Pico.
+            baud: Baud rate, for a UART link; USB CDC ignores it.
+            moves_in_flight: MOVE frames sent ahead of their ACKs, 0 sends
+                every new setpoint at once without ACKs.
+            library: Path of libtracks_client.so, by default TRACKS_CLIENT_LIB
+                or the one `make tracks/client` builds.
+
+        Raises:
+            OSError: The library or the port could not be opened.
+        """
+        self._lib = _load(library or os.environ.get("TRACKS_CLIENT_LIB", DEFAULT_LIBRARY))
+        self._client = self._lib.tracks_open(port.encode(), baud, moves_in_flight)
+        if not self._client:
+            error = ctypes.get_errno()
+            raise OSError(error, os.strerror(error), port)
+        self._line = ctypes.create_string_buffer(LINE_LEN)
+
+    def move(self, linear: float, angular: float):
+        """Set the newest setpoint (-100..100); it replaces one not sent yet."""
+        self._lib.tracks_move(self._client, linear, angular)
+
+    def heartbeat(self):
+        """Send a HEARTBEAT frame."""
+        self._lib.tracks_heartbeat(self._client)
+
+    def command(self, line: str) -> bool:
+        """Send a text command; False if the client's queue was full."""
+        return bool(self._lib.tracks_command(self._client, line.encode("utf-8")))
+
+    def odometry(self):
+        """The ODOMETRY sample received since the previous call, as `decode_odometry`
+        returns it plus `host_ns`, or None."""
+        sample = _Odometry()
+        return _as_dict(sample) if self._lib.tracks_odometry(self._client, ctypes.byref(sample)) else None
+
+    def telemetry(self):
+        """The TELEMETRY frame received since the previous call, as `decode_telemetry`
+        returns it plus `host_ns`, or None."""
+        sample = _Telemetry()
+        if not self._lib.tracks_telemetry(self._client, ctypes.byref(sample)):
+            return None
+        telemetry = _as_dict(sample)
+        flags = telemetry.pop("flags")
+        telemetry["failsafe"] = bool(flags & TELEMETRY_FAILSAFE)
+        telemetry["left_stalled"] = bool(flags & TELEMETRY_STALL_LEFT)
+        telemetry["right_stalled"] = bool(flags & TELEMETRY_STALL_RIGHT)
+        return telemetry
+
+    def lines(self) -> list:
+        """The text lines received so far."""
+        lines = []
+        while self._lib.tracks_line(self._client, self._line, LINE_LEN):
+            lines.append(self._line.value.decode("utf-8", errors="replace"))
+        return lines
+
+    def stats(self) -> dict:
+        """The client's counters, see tracks_stats_t in client/tracks_client.h."""
+        stats = _Stats()
+        self._lib.tracks_get_stats(self._client, ctypes.byref(stats))
+        return _as_dict(stats)
+
+    def close(self):
+        """Stop the tracks, the I/O thread and close the port."""
+        if self._client:
+            self._lib.tracks_close(self._client)
+            self._client = None
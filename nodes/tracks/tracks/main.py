@@ -2,7 +2,8 @@
 
 Handles communication with the RP2040 microcontroller via serial port
 to control the robot's tracks based on joystick input received via Dora.
-Includes logic for easing/smoothing movement commands and sending heartbeats.
+Includes optional easing of movement commands and sending heartbeats; by
+default the firmware ramps toward the commanded speed instead.
 """
 
 from dora import Node
@@ -15,11 +16,26 @@ import queue
 import sys
 import math # Import math for abs
 import serial # Explicitly import serial exceptions if needed
+from tracks.protocol import (encode_move, encode_heartbeat, decode_ack, decode_odometry, decode_telemetry,
+                             StreamDecoder, FRAME_ACK, FRAME_ODOMETRY, FRAME_TELEMETRY)
+from tracks.usb_link import VendorLink
+from tracks.client import TracksClient
 
 # --- Configuration ---
 SERIAL_PORT = '/dev/serial/by-id/usb-Raspberry_Pi_Pico_E6612483CB1A9621-if00'
 BAUD_RATE = 115200
+LINK = "serial" # "usb": frames on the vendor interface of a TRACKS_TRANSPORT=vendor build (tracks/usb_link.py)
+USB_SERIAL_NUMBER = "E6612483CB1A9621" # The Pico to use with LINK = "usb", as in SERIAL_PORT
 COMMAND_SCALE = 100.0 # Scale joystick (-1..1) to Pico command range (-100..100)
+BINARY_PROTOCOL = True # Send move/heartbeat as binary frames (tracks/protocol.py) instead of text lines
+TELEMETRY_INTERVAL_MS = 20 # Period of the firmware's TELEMETRY frame, 0 turns it off
+FIRMWARE_VERBOSE = False # Let the firmware echo every command as debug text
+HEADING_HOLD = False # Let the firmware hold the heading with its gyro; angular then requests a turn rate
+CURVE_EXPO = 0 # % of cubic response the firmware's mixer stage puts on each track, finer control at low speed
+CURVE_DEADBAND = 0 # % of full scale each track ignores around zero, e.g. joystick drift
+MOVES_IN_FLIGHT = 2 # Binary MOVE frames sent but not yet acknowledged before the next one waits, 0 = no limit
+ACK_TIMEOUT_S = 0.25 # Stop waiting for the ACKs of the frames in flight after this long
+NATIVE_CLIENT = False # Drive SERIAL_PORT with the C++ client (client/, `make tracks/client`) instead of pyserial
 
 # --- Joystick Mapping Configuration ---
 # Configuration for joystick axis mapping
@@ -28,40 +44,46 @@ INVERT_X_AXIS = True  # Invert left/right to fix the turning direction
 JOYSTICK_DEADZONE = 0.0 # Old script had no deadzone, set to 0.0
 
 # --- Easing Configuration ---
-EASING_ENABLED = True # Enable/disable easing
+EASING_ENABLED = False # The firmware already ramps at 1 kHz, enable only for extra smoothing
 EASING_FACTOR = 0.3  # Easing factor (0.0-1.0): lower = smoother but less responsive
 MAX_ACCEL_RATE = 20   # Maximum acceleration change per tick (prevents abrupt changes)
 # ---
 
 serial_buffer = queue.Queue()
+odometry_buffer = queue.Queue()  # decoded ODOMETRY frames from the Pico
+telemetry_buffer = queue.Queue()  # decoded TELEMETRY frames from the Pico
+ack_buffer = queue.Queue()  # decoded ACK frames from the Pico
 serial_read_stop_event = threading.Event()  # To signal the reader thread to stop
 
 
 # --- Background Serial Reader ---
 def background_serial_reader(ser: Serial, stop_event: threading.Event):
-    """Continuously read lines from the serial port in a background thread.
+    """Continuously read from the serial port in a background thread.
 
-    Reads lines ending in newline characters, decodes them as UTF-8,
-    and puts them into the global `serial_buffer` queue. Handles potential
-    serial errors and stops when the `stop_event` is set.
+    Splits the stream into text lines, which go into the global
+    `serial_buffer` queue, and binary frames, of which ODOMETRY, TELEMETRY and
+    ACK frames go into `odometry_buffer`, `telemetry_buffer` and `ack_buffer`. Handles potential serial errors and
+    stops when the `stop_event` is set.
 
     Args:
         ser: The PySerial Serial object.
         stop_event: A threading.Event object to signal when to stop reading.
     """
     print("Serial reader thread started.")
+    decoder = StreamDecoder()
     while not stop_event.is_set():
         try:
             if ser.in_waiting > 0:
                 try:
-                    # Use read_until, default timeout is from Serial object
-                    line_bytes = ser.read_until(b'\n')
-                    if line_bytes:
-                         line = line_bytes.decode('utf-8', errors='replace').strip()
-                         if line:
-                              serial_buffer.put('RP2040: ' + line)
-                except UnicodeDecodeError as ude:
-                    serial_buffer.put(f"SERIAL DECODE ERROR: {ude}")
+                    for item in decoder.feed(ser.read(ser.in_waiting)):
+                        if item[0] == "text":
+                            serial_buffer.put('RP2040: ' + item[1])
+                        elif item[1] == FRAME_ODOMETRY:
+                            odometry_buffer.put(decode_odometry(item[3]))
+                        elif item[1] == FRAME_TELEMETRY:
+                            telemetry_buffer.put(decode_telemetry(item[3]))
+                        elif item[1] == FRAME_ACK:
+                            ack_buffer.put(decode_ack(item[3]))
                 except Exception as read_err:
                     serial_buffer.put(f"SERIAL READ ERROR: {read_err}")
                     time.sleep(0.5)
@@ -89,6 +111,51 @@ def flush_serial_buffer():
             print(f"Error getting from serial buffer: {e}")
 
 
+def latest_from(buffer: queue.Queue):
+    """Drain `buffer` and return its newest item, or None if it was empty."""
+    latest = None
+    while True:
+        try:
+            latest = buffer.get_nowait()
+        except queue.Empty:
+            return latest
+
+
+def send_latest_odometry(node: Node, client: TracksClient = None):
+    """Send the newest queued odometry sample on the `odometry` output.
+
+    The value is [left_count, right_count, left_speed, right_speed], counts in
+    encoder steps and speeds in steps per second. Older samples are dropped.
+    With the native `client` its newest sample is sent instead.
+    """
+    latest = client.odometry() if client else latest_from(odometry_buffer)
+    if latest is not None:
+        node.send_output("odometry", pa.array([latest["left_count"], latest["right_count"],
+                                               latest["left_speed"], latest["right_speed"]]),
+                         metadata={})
+
+
+def send_latest_telemetry(node: Node, client: TracksClient = None):
+    """Send the newest firmware telemetry (see `decode_telemetry`) on the `telemetry` output."""
+    latest = client.telemetry() if client else latest_from(telemetry_buffer)
+    if latest is not None:
+        node.send_output("telemetry", pa.array([latest]), metadata={})
+
+
+def moves_acknowledged() -> int:
+    """Drain `ack_buffer` and return how many MOVE frames the ACKs account for.
+
+    Each ACK stands for its own frame and the `superseded` frames the firmware
+    replaced with it, which are never acknowledged on their own.
+    """
+    count = 0
+    while True:
+        try:
+            count += 1 + ack_buffer.get_nowait()["superseded"]
+        except queue.Empty:
+            return count
+
+
 def start_background_thread(ser: Serial, stop_event: threading.Event) -> threading.Thread:
     """Start the background serial reader thread.
 
@@ -113,23 +180,50 @@ def main():
     microcontroller, and handles node shutdown.
     """
     ser = None
+    client = None
     reader_thread = None
     try:
-        print(f"Attempting to open serial port {SERIAL_PORT} at {BAUD_RATE} baud...")
-        ser = Serial(SERIAL_PORT, BAUD_RATE, timeout=0.1, write_timeout=0.5)
-        print("Serial port opened successfully.")
+        if NATIVE_CLIENT:
+            print(f"Attempting to open serial port {SERIAL_PORT} with the native client...")
+            client = TracksClient(SERIAL_PORT, BAUD_RATE, MOVES_IN_FLIGHT) # Encodes, coalesces and reads on its own thread
+        elif LINK == "usb":
+            print(f"Attempting to claim the frames interface of Pico {USB_SERIAL_NUMBER}...")
+            ser = VendorLink(USB_SERIAL_NUMBER, timeout=0.1) # Serial-like, firmware text goes to its CDC port
+        else:
+            print(f"Attempting to open serial port {SERIAL_PORT} at {BAUD_RATE} baud...")
+            ser = Serial(SERIAL_PORT, BAUD_RATE, timeout=0.1, write_timeout=0.5)
+        print("Link opened successfully.")
     except Exception as e:
-        print(f"FATAL: Error opening serial port {SERIAL_PORT}: {e}")
-        print("Check connection, permissions (e.g., 'dialout' group), and port ID.")
+        print(f"FATAL: Error opening {LINK} link to the Pico: {e}")
+        print("Check connection, permissions (e.g., 'dialout' group or the udev rule in tracks/usb_link.py), and port ID.")
         return
 
-    serial_read_stop_event.clear()
-    reader_thread = start_background_thread(ser, serial_read_stop_event)
+    if client:
+        # The client sends "ack" itself and limits its MOVE frames by their ACKs
+        for command in (f"telemetry {TELEMETRY_INTERVAL_MS}", f"verbose {int(FIRMWARE_VERBOSE)}",
+                        f"heading {int(HEADING_HOLD)}", f"curve {CURVE_EXPO} {CURVE_DEADBAND}"):
+            client.command(command)
+        credits = False
+    else:
+        serial_read_stop_event.clear()
+        reader_thread = start_background_thread(ser, serial_read_stop_event)
+
+        credits = BINARY_PROTOCOL and MOVES_IN_FLIGHT > 0 # rate-limit MOVE frames by their ACKs
+        try:
+            ser.write(f"telemetry {TELEMETRY_INTERVAL_MS}\nverbose {int(FIRMWARE_VERBOSE)}\n"
+                      f"heading {int(HEADING_HOLD)}\ncurve {CURVE_EXPO} {CURVE_DEADBAND}\n"
+                      f"ack {int(credits)}\n".encode("utf-8"))
+            ser.flush()
+        except Exception as write_err:
+            print(f"ERROR: Failed to configure firmware telemetry: {write_err}")
 
     node = Node()
     latest_joystick_x = 0.0
     latest_joystick_y = 0.0
     last_command_sent = ""
+    frame_seq = 0 # Sequence number of the next binary frame
+    moves_in_flight = 0 # MOVE frames sent and not acknowledged yet
+    last_move_time = 0.0
     
     # Variables for easing implementation
     current_linear = 0
@@ -144,7 +238,13 @@ def main():
                 event_id = event["id"]
 
                 if event_id == "tick":
+                    if client:
+                        for line in client.lines():
+                            print('RP2040: ' + line)
                     flush_serial_buffer() # Print Pico messages
+                    send_latest_odometry(node, client)
+                    send_latest_telemetry(node, client)
+                    moves_in_flight = max(0, moves_in_flight - moves_acknowledged())
 
                     # --- Apply Mapping (No Deadzone, No Inversion - matching old script) ---
                     current_x_raw = latest_joystick_x
@@ -189,11 +289,27 @@ def main():
 
                     cmd = f"move {linear} {angular}"
 
-                    if cmd != last_command_sent:
+                    # With too many frames in flight hold back, the newest command goes out on a later tick
+                    if (credits and moves_in_flight >= MOVES_IN_FLIGHT and
+                            time.monotonic() - last_move_time < ACK_TIMEOUT_S):
+                        pass
+                    elif cmd != last_command_sent:
                         try:
                             # Simplified log to match old script's effective output
                             print(f"Sending: {cmd}")
-                            ser.write((cmd + "\n").encode("utf-8"))
+                            if client:
+                                client.move(linear, angular)
+                                last_command_sent = cmd
+                                continue
+                            if BINARY_PROTOCOL:
+                                ser.write(encode_move(linear, angular, frame_seq))
+                                frame_seq += 1
+                                if time.monotonic() - last_move_time >= ACK_TIMEOUT_S:
+                                    moves_in_flight = 0 # ACKs lost or the firmware restarted
+                                moves_in_flight += 1
+                                last_move_time = time.monotonic()
+                            else:
+                                ser.write((cmd + "\n").encode("utf-8"))
                             ser.flush()
                             last_command_sent = cmd
                         except serial.SerialTimeoutException:
@@ -204,7 +320,14 @@ def main():
                 elif event_id == "heartbeat":
                      try:
                          # print("Sending: heartbeat") # Reduce noise
-                         ser.write(("heartbeat\n").encode("utf-8"))
+                         if client:
+                             client.heartbeat()
+                             continue
+                         if BINARY_PROTOCOL:
+                             ser.write(encode_heartbeat(frame_seq))
+                             frame_seq += 1
+                         else:
+                             ser.write(("heartbeat\n").encode("utf-8"))
                          ser.flush()
                      except Exception as write_err:
                           print(f"ERROR: Failed to write heartbeat: {write_err}")
@@ -249,6 +372,10 @@ def main():
     finally:
         serial_read_stop_event.set()
 
+        if client:
+            print("Stopping the tracks and closing the native client...")
+            client.close()
+
         if ser and ser.is_open:
             try:
                 # Reset the easing values to ensure immediate stop
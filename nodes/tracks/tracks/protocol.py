@@ -0,0 +1,205 @@
+"""Binary frames for the tracks RP2040 firmware.
+
+Mirrors the frame layout in `firmware/main.cpp`: sync byte, type, sequence
+number, payload and a CRC-8 (polynomial 0x07) over type, sequence and
+payload. MOVE carries linear and angular as little-endian int16 in 1/100 of
+a text command unit, so setpoints need no float parsing on the Pico.
+
+The Pico answers with text log lines and binary frames on the same link;
+`StreamDecoder` splits the two apart.
+"""
+
+import struct
+
+FRAME_SYNC = 0xA5
+FRAME_MOVE = 0x01
+FRAME_HEARTBEAT = 0x02
+FRAME_MOTION = 0x03
+FRAME_MOTION_FLUSH = 0x01  # MOTION flag: drop the queued segments first
+MOTION_QUEUE_LEN = 8  # segments the firmware queues, and so at most per frame
+FRAME_PING = 0x04
+FRAME_ODOMETRY = 0x81  # sent by the Pico: left/right encoder count and speed
+FRAME_TELEMETRY = 0x82  # sent by the Pico: duty, heartbeat age, loop timing, counters, current
+TELEMETRY_FAILSAFE = 0x01  # flag: heartbeat missing, tracks stopped
+TELEMETRY_STALL_LEFT = 0x02  # flag: left duty cut by the stall detector
+TELEMETRY_STALL_RIGHT = 0x04  # flag: right duty cut by the stall detector
+FRAME_ACK = 0x83  # sent by the Pico after "ack 1": MOVE frame applied to the PWM
+FRAME_PONG = 0x84  # sent by the Pico: answer to PING with its clock
+FRAME_SCALE = 100  # fixed-point steps per command unit (-100..100)
+
+
+def crc8(data: bytes) -> int:
+    """Return the CRC-8 (polynomial 0x07, initial value 0) of `data`."""
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def _frame(frame_type: int, seq: int, payload: bytes = b"") -> bytes:
+    body = bytes([frame_type, seq & 0xFF]) + payload
+    return bytes([FRAME_SYNC]) + body + bytes([crc8(body)])
+
+
+def _fixed(value: float) -> int:
+    return max(-32768, min(32767, int(round(value * FRAME_SCALE))))
+
+
+def encode_move(linear: float, angular: float, seq: int) -> bytes:
+    """Encode a MOVE frame for the given linear/angular setpoint (-100..100).
+
+    Args:
+        linear: Forward/backward command, as in the text `move` command.
+        angular: Turn command, as in the text `move` command.
+        seq: Sequence number; only the low 8 bits are sent.
+
+    Returns:
+        The 8-byte frame.
+    """
+    return _frame(FRAME_MOVE, seq, struct.pack("<hh", _fixed(linear), _fixed(angular)))
+
+
+def encode_motion(segments, seq: int, flush: bool = True) -> bytes:
+    """Encode a MOTION frame queueing a manoeuvre on the firmware.
+
+    Each segment ramps from the previous target to its own over its
+    duration; repeat the previous values to hold, use 0 ms to step. The
+    last target stays until the next command, so end with (0, 0, ...) to stop.
+
+    Args:
+        segments: Up to MOTION_QUEUE_LEN (linear, angular, duration_ms) tuples,
+            linear/angular as in `encode_move`.
+        seq: Sequence number; only the low 8 bits are sent.
+        flush: Replace whatever is still queued instead of appending.
+
+    Returns:
+        The frame, 6 + 6 bytes per segment.
+    """
+    if len(segments) > MOTION_QUEUE_LEN:
+        raise ValueError(f"at most {MOTION_QUEUE_LEN} segments per frame")
+    payload = bytes([FRAME_MOTION_FLUSH if flush else 0, len(segments)])
+    for linear, angular, duration_ms in segments:
+        payload += struct.pack("<hhH", _fixed(linear), _fixed(angular), max(0, min(0xFFFF, int(duration_ms))))
+    return _frame(FRAME_MOTION, seq, payload)
+
+
+def encode_heartbeat(seq: int) -> bytes:
+    """Encode a 4-byte HEARTBEAT frame."""
+    return _frame(FRAME_HEARTBEAT, seq)
+
+
+def encode_ping(token: int, seq: int) -> bytes:
+    """Encode an 8-byte PING frame; the Pico answers with a PONG carrying `token`."""
+    return _frame(FRAME_PING, seq, struct.pack("<I", token & 0xFFFFFFFF))
+
+
+# Total length (sync to CRC) of the frames the Pico sends
+_INBOUND_LENGTHS = {FRAME_ODOMETRY: 20, FRAME_TELEMETRY: 49, FRAME_ACK: 14, FRAME_PONG: 16}
+
+
+def decode_odometry(payload: bytes) -> dict:
+    """Unpack an ODOMETRY payload into counts (steps) and speeds (steps/s)."""
+    left_count, right_count, left_speed, right_speed = struct.unpack("<iiii", payload)
+    return {
+        "left_count": left_count,
+        "right_count": right_count,
+        "left_speed": left_speed,
+        "right_speed": right_speed,
+    }
+
+
+def decode_telemetry(payload: bytes) -> dict:
+    """Unpack a TELEMETRY payload.
+
+    Duties are signed like the firmware's track outputs (negative is
+    forward), timings are the maxima since the previous TELEMETRY frame,
+    currents are the control loop's filtered motor currents in mA. The
+    missed control deadlines and the link's RX high-water mark (bytes) count
+    since boot or the `stats reset` command, 0 if the firmware was built
+    without CONTROL_STATS. `moves_coalesced` counts the moves since boot that
+    a newer one replaced before they were applied, `rx_overflows` the received
+    bytes dropped since boot because the firmware's RX ring was full.
+    """
+    (left_duty, right_duty, heartbeat_age_ms, tick_max_us, tick_late_max_us, flags,
+     frames_ok, frames_bad, frames_lost, log_dropped,
+     left_current_ma, right_current_ma, deadlines_missed, rx_high_water,
+     moves_coalesced, rx_overflows) = struct.unpack("<hhHHHBIIIIHHIHII", payload)
+    return {
+        "left_duty": left_duty,
+        "right_duty": right_duty,
+        "heartbeat_age_ms": heartbeat_age_ms,
+        "tick_max_us": tick_max_us,
+        "tick_late_max_us": tick_late_max_us,
+        "failsafe": bool(flags & TELEMETRY_FAILSAFE),
+        "frames_ok": frames_ok,
+        "frames_bad": frames_bad,
+        "frames_lost": frames_lost,
+        "log_dropped": log_dropped,
+        "left_current_ma": left_current_ma,
+        "right_current_ma": right_current_ma,
+        "left_stalled": bool(flags & TELEMETRY_STALL_LEFT),
+        "right_stalled": bool(flags & TELEMETRY_STALL_RIGHT),
+        "deadlines_missed": deadlines_missed,
+        "rx_high_water": rx_high_water,
+        "moves_coalesced": moves_coalesced,
+        "rx_overflows": rx_overflows,
+    }
+
+
+def decode_ack(payload: bytes) -> dict:
+    """Unpack an ACK payload: the MOVE frame's sequence number, the Pico's
+    `time_us_64()` (low 32 bits) when it was received and put on the PWM, and
+    how many MOVE frames sent since the previous ACK it replaced unapplied
+    (saturating at 255). Those get no ACK, so the frames in flight drop by
+    1 + `superseded`."""
+    seq, rx_us, applied_us, superseded = struct.unpack("<BIIB", payload)
+    return {"seq": seq, "rx_us": rx_us, "applied_us": applied_us, "superseded": superseded}
+
+
+def decode_pong(payload: bytes) -> dict:
+    """Unpack a PONG payload: the PING token and the Pico's `time_us_64()`."""
+    token, mcu_us = struct.unpack("<IQ", payload)
+    return {"token": token, "mcu_us": mcu_us}
+
+
+class StreamDecoder:
+    """Split the byte stream from the Pico into text lines and binary frames.
+
+    Feed raw bytes as they arrive; `feed` returns the complete items found so
+    far, each either `("text", line)` or `("frame", type, seq, payload)`.
+    Corrupt frames and unknown types are counted in `bad_frames` and skipped.
+    """
+
+    def __init__(self):
+        self._text = bytearray()
+        self._frame = bytearray()
+        self.bad_frames = 0
+
+    def feed(self, data: bytes) -> list:
+        items = []
+        for byte in data:
+            if self._frame:
+                self._frame.append(byte)
+                length = _INBOUND_LENGTHS.get(self._frame[1]) if len(self._frame) >= 2 else None
+                if len(self._frame) >= 2 and length is None:
+                    self.bad_frames += 1
+                    self._frame.clear()
+                elif length is not None and len(self._frame) == length:
+                    frame = bytes(self._frame)
+                    self._frame.clear()
+                    if crc8(frame[1:-1]) == frame[-1]:
+                        items.append(("frame", frame[1], frame[2], frame[3:-1]))
+                    else:
+                        self.bad_frames += 1
+            elif byte == FRAME_SYNC:
+                self._frame.append(byte)
+            elif byte in (0x0A, 0x0D):
+                line = self._text.decode("utf-8", errors="replace").strip()
+                self._text.clear()
+                if line:
+                    items.append(("text", line))
+            else:
+                self._text.append(byte)
+        return items
@@ -0,0 +1,99 @@
+"""Binary frames over the vendor class USB interface of the tracks firmware.
+
+A firmware built with `-DTRACKS_TRANSPORT=vendor` carries its binary frames
+on a pair of bulk endpoints, next to the CDC serial port that keeps the text
+log. Bulk transfers skip the tty layer and its line discipline, and several
+frames share a 64-byte packet each way.
+
+`VendorLink` has the part of pyserial's `Serial` interface the node and the
+scripts use (`write`, `flush`, `read`, `in_waiting`, `close`, `is_open`), so
+it can stand in for the serial port. Text commands work on it too, their
+answers go to the CDC log. Needs pyusb, and for a normal user a udev rule:
+
+    SUBSYSTEM=="usb", ATTRS{idVendor}=="2e8a", ATTRS{idProduct}=="000a", MODE="0666"
+"""
+
+USB_VID = 0x2E8A  # as the SDK's stdio_usb, see firmware/usb_descriptors.c
+USB_PID = 0x000A
+FRAMES_PROTOCOL = 0x00  # vendor class interface protocol of the frames; the reset interface has 0x01
+READ_SIZE = 512  # bytes asked for per bulk read, a multiple of the packet size
+WRITE_TIMEOUT_MS = 500
+
+
+class VendorLink:
+    """The frames interface of one tracks Pico, claimed until `close`."""
+
+    def __init__(self, serial_number: str = None, timeout: float = 0.1):
+        """Find and claim the interface.
+
+        Args:
+            serial_number: The Pico's USB serial number, as in its
+                /dev/serial/by-id name; None takes the first one found.
+            timeout: Seconds `read` waits for data; 0 polls for 1 ms, None waits forever.
+
+        Raises:
+            OSError: No such device, or its firmware has no frames interface.
+        """
+        import usb.core
+        import usb.util
+
+        self._usb = usb
+        match = {"idVendor": USB_VID, "idProduct": USB_PID}
+        if serial_number:
+            match["serial_number"] = serial_number
+        device = usb.core.find(**match)
+        if device is None:
+            raise OSError(f"no Pico with serial number {serial_number} on USB" if serial_number else "no Pico on USB")
+        interface = usb.util.find_descriptor(device.get_active_configuration(), bInterfaceClass=0xFF,
+                                             bInterfaceProtocol=FRAMES_PROTOCOL, bNumEndpoints=2)
+        if interface is None:
+            raise OSError("the firmware has no frames interface, build it with -DTRACKS_TRANSPORT=vendor")
+        usb.util.claim_interface(device, interface)
+
+        def endpoint(direction):
+            return usb.util.find_descriptor(
+                interface, custom_match=lambda e: usb.util.endpoint_direction(e.bEndpointAddress) == direction)
+
+        self._device = device
+        self._interface = interface
+        self._out = endpoint(usb.util.ENDPOINT_OUT)
+        self._in = endpoint(usb.util.ENDPOINT_IN)
+        self._rx = bytearray()
+        self.timeout_ms = 0 if timeout is None else max(1, int(timeout * 1000))  # libusb: 0 is forever
+        self.is_open = True
+
+    def _transfer(self, timeout_ms: int) -> bytes:
+        """One bulk read, empty if nothing arrived within `timeout_ms`."""
+        try:
+            return bytes(self._in.read(READ_SIZE, timeout=timeout_ms))
+        except self._usb.core.USBTimeoutError:
+            return b""
+
+    @property
+    def in_waiting(self) -> int:
+        """Bytes received and not read yet, polling the endpoint for 1 ms if there are none."""
+        if not self._rx:
+            self._rx += self._transfer(1)
+        return len(self._rx)
+
+    def read(self, size: int = 1) -> bytes:
+        """Up to `size` received bytes, waiting up to the timeout if there are none."""
+        if not self._rx:
+            self._rx += self._transfer(self.timeout_ms)
+        data = bytes(self._rx[:size])
+        del self._rx[:size]
+        return data
+
+    def write(self, data: bytes) -> int:
+        """Send `data` in one bulk transfer."""
+        return self._out.write(data, timeout=WRITE_TIMEOUT_MS)
+
+    def flush(self):
+        """Nothing to do, `write` returns once the transfer completed."""
+
+    def close(self):
+        """Release the interface."""
+        if self.is_open:
+            self._usb.util.release_interface(self._device, self._interface)
+            self._usb.util.dispose_resources(self._device)
+            self.is_open = False